@@ -15,14 +15,33 @@
 #include "nrf51.h"
 #include "nrf51_bitfields.h"
 
+#include "nrf_sdm.h"
+
 #include "app_error.h"
 #include "app_util.h"
+#include "app_util_platform.h"
+#include "app_scheduler.h"
 
 #include "global.h"
 #include "pins.h"
 
 #include "adc.h"
 
+/* The sequence presently being converted and those waiting for the ADC */
+static adcSequence_t * volatile activeSequence = NULL;
+static adcSequence_t *pendingHead = NULL;
+static adcSequence_t *pendingTail = NULL;
+
+static bool irqConfigured = false;
+
+static adcStats_t stats;
+
+static void adc_configChannel(uint8_t channel);
+static uint16_t adc_rawToMV(uint32_t raw, uint32_t nsamples);
+static void adc_beginSequence(adcSequence_t *p_sequence);
+static void adc_stop(void);
+static void adc_sequenceEventHandler(void *p_event_data, uint16_t event_size);
+
 bool adc_init() {
     /* Make the VINSENSE, FRAMETEMP, LIPROVBATOUT, and ICHARGE pins inputs with
      * their input buffers disabled so that they do not consume current when
@@ -65,19 +84,15 @@ uint16_t adc_read_mV(uint8_t channel) {
     	return 0;
     }
 
-    /* Disable the ADC before changing its configuration */
-    NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Disabled << ADC_ENABLE_ENABLE_Pos;
+    /* A blocking conversion cannot share the ADC with a sequence, so we let
+     * any sequences in progress finish first. */
+    adc_waitIdle();
 
     /* Disable ADC interrupt */
     NRF_ADC->INTENCLR = ADC_INTENSET_END_Msk;
 
     /* Configure the ADC parameters */
-    NRF_ADC->CONFIG = (ADC_CONFIG_RES_10bit << ADC_CONFIG_RES_Pos) | /* 10-bit result */
-	(ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling << ADC_CONFIG_INPSEL_Pos) | /* Scale positive input by 1/3 */
-	(ADC_CONFIG_REFSEL_VBG << ADC_CONFIG_REFSEL_Pos) | /* Use 1.2V bandgap reference voltage */
-	((0x01 << channel) << ADC_CONFIG_PSEL_Pos) | /* Select the specified channel */
-	(ADC_CONFIG_EXTREFSEL_None << ADC_CONFIG_EXTREFSEL_Pos); /* Disable external reference pins */
-
+    adc_configChannel(channel);
 
     /* Clear the conversion complete flag */
     NRF_ADC->EVENTS_END = 0;
@@ -100,7 +115,8 @@ uint16_t adc_read_mV(uint8_t channel) {
      *    number of counts.
      */
     raw = NRF_ADC->RESULT;
-    mV = (3 * raw * 1200) / 1023;
+    mV = adc_rawToMV(raw, 1);
+    stats.conversions++;
 
     /* Explicitly stop the ADC to lower current consumption.  This is a work-
      * around for PAN 028 rev 1.5m anomaly 1. */
@@ -122,3 +138,229 @@ uint16_t adc_avg_mV(uint8_t channel, uint8_t nsamples) {
 
     return (uint16_t)(accum / nsamples);
 }
+
+/**@brief Queues a conversion sequence.  If the ADC is idle, the first
+ * conversion starts immediately; otherwise, the sequence starts as soon as
+ * those ahead of it have finished.  Each subsequent conversion is started
+ * from the ADC END interrupt, so the CPU only wakes for roughly 5us per
+ * conversion rather than spinning for the entire sequence.  When all channels
+ * have been converted, the sequence's handler is called through the
+ * scheduler.
+ *
+ * Returns false if the sequence is invalid or is already busy.
+ */
+bool adc_startSequence(adcSequence_t *p_sequence) {
+    uint32_t err_code;
+    uint8_t softdevice_enabled;
+    uint8_t i;
+
+    if ((p_sequence == NULL) || p_sequence->busy ||
+	    (p_sequence->channelCount == 0) || (p_sequence->channelCount > ADC_SEQUENCE_MAX_CHANNELS)) {
+	return false;
+    }
+
+    for (i = 0; i < p_sequence->channelCount; i++) {
+	if (p_sequence->channels[i] >= 8) {
+	    return false;
+	}
+    }
+
+    if (!irqConfigured) {
+	err_code = sd_softdevice_is_enabled(&softdevice_enabled);
+	APP_ERROR_CHECK(err_code);
+
+	if (softdevice_enabled) {
+	    err_code = sd_nvic_ClearPendingIRQ(ADC_IRQn);
+	    APP_ERROR_CHECK(err_code);
+	    err_code = sd_nvic_SetPriority(ADC_IRQn, NRF_APP_PRIORITY_LOW);
+	    APP_ERROR_CHECK(err_code);
+	    err_code = sd_nvic_EnableIRQ(ADC_IRQn);
+	    APP_ERROR_CHECK(err_code);
+	} else {
+	    NVIC_ClearPendingIRQ(ADC_IRQn);
+	    NVIC_SetPriority(ADC_IRQn, APP_IRQ_PRIORITY_LOW);
+	    NVIC_EnableIRQ(ADC_IRQn);
+	}
+
+	irqConfigured = true;
+    }
+
+    p_sequence->busy = true;
+    p_sequence->next = NULL;
+
+    CRITICAL_REGION_ENTER();
+
+    if (activeSequence == NULL) {
+	adc_beginSequence(p_sequence);
+    } else if (pendingHead == NULL) {
+	pendingHead = pendingTail = p_sequence;
+    } else {
+	pendingTail->next = p_sequence;
+	pendingTail = p_sequence;
+    }
+
+    CRITICAL_REGION_EXIT();
+
+    return true;
+}
+
+bool adc_isBusy() {
+    return (activeSequence != NULL);
+}
+
+/**@brief Waits for all queued sequences to finish.  Only used before a
+ * blocking conversion or before reconfiguring an external multiplexer which
+ * feeds one of the ADC inputs.
+ */
+void adc_waitIdle() {
+    if (activeSequence == NULL) {
+	return;
+    }
+
+    stats.blockingWaits++;
+    while (activeSequence != NULL);
+}
+
+void adc_getStats(adcStats_t *p_stats) {
+    *p_stats = stats;
+}
+
+void adc_clearStats() {
+    stats.sequences = 0;
+    stats.conversions = 0;
+    stats.dropped = 0;
+    stats.blockingWaits = 0;
+}
+
+void adc_configChannel(uint8_t channel) {
+    /* Disable the ADC before changing its configuration */
+    NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Disabled << ADC_ENABLE_ENABLE_Pos;
+
+    /* Configure the ADC parameters */
+    NRF_ADC->CONFIG = (ADC_CONFIG_RES_10bit << ADC_CONFIG_RES_Pos) | /* 10-bit result */
+	(ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling << ADC_CONFIG_INPSEL_Pos) | /* Scale positive input by 1/3 */
+	(ADC_CONFIG_REFSEL_VBG << ADC_CONFIG_REFSEL_Pos) | /* Use 1.2V bandgap reference voltage */
+	((0x01 << channel) << ADC_CONFIG_PSEL_Pos) | /* Select the specified channel */
+	(ADC_CONFIG_EXTREFSEL_None << ADC_CONFIG_EXTREFSEL_Pos); /* Disable external reference pins */
+}
+
+/**@brief Converts the sum of nsamples raw 10-bit results to millivolts.  See
+ * adc_read_mV() for an explanation of the scaling.  Averaging the raw counts
+ * before scaling keeps the fraction that would be lost by averaging
+ * millivolts.
+ */
+uint16_t adc_rawToMV(uint32_t raw, uint32_t nsamples) {
+    return (3 * 1200 * raw) / (1023 * nsamples);
+}
+
+/**@brief Starts the first conversion of a sequence.  Called with the ADC idle,
+ * either from adc_startSequence() or from the interrupt handler.
+ */
+void adc_beginSequence(adcSequence_t *p_sequence) {
+    activeSequence = p_sequence;
+
+    p_sequence->channelIndex = 0;
+    p_sequence->sampleCount = 0;
+    p_sequence->accum = 0;
+
+    adc_configChannel(p_sequence->channels[0]);
+
+    NRF_ADC->EVENTS_END = 0;
+    NRF_ADC->INTENSET = ADC_INTENSET_END_Msk;
+    NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Enabled << ADC_ENABLE_ENABLE_Pos;
+    NRF_ADC->TASKS_START = 1;
+}
+
+void adc_stop() {
+    NRF_ADC->INTENCLR = ADC_INTENSET_END_Msk;
+
+    /* Explicitly stop the ADC to lower current consumption.  This is a work-
+     * around for PAN 028 rev 1.5m anomaly 1. */
+    NRF_ADC->TASKS_STOP = 1;
+
+    /* Disable the ADC to reduce power consumption */
+    NRF_ADC->ENABLE = (ADC_ENABLE_ENABLE_Disabled << ADC_ENABLE_ENABLE_Pos);
+}
+
+void ADC_IRQHandler(void) {
+    adcSequence_t *p_sequence;
+    uint8_t nsamples;
+
+    if (NRF_ADC->EVENTS_END == 0) {
+	return;
+    }
+
+    NRF_ADC->EVENTS_END = 0;
+
+    p_sequence = activeSequence;
+    if (p_sequence == NULL) {
+	adc_stop();
+	return;
+    }
+
+    p_sequence->accum += NRF_ADC->RESULT;
+    p_sequence->sampleCount++;
+    stats.conversions++;
+
+    nsamples = p_sequence->samples[p_sequence->channelIndex];
+    if (nsamples == 0) {
+	nsamples = 1;
+    }
+
+    /* Keep converting the same channel until it has been oversampled the
+     * requested number of times. */
+    if (p_sequence->sampleCount < nsamples) {
+	NRF_ADC->TASKS_START = 1;
+	return;
+    }
+
+    p_sequence->results_mV[p_sequence->channelIndex] = adc_rawToMV(p_sequence->accum, nsamples);
+
+    /* Move on to the next channel in the sequence */
+    p_sequence->channelIndex++;
+    if (p_sequence->channelIndex < p_sequence->channelCount) {
+	p_sequence->sampleCount = 0;
+	p_sequence->accum = 0;
+	adc_configChannel(p_sequence->channels[p_sequence->channelIndex]);
+	NRF_ADC->ENABLE = ADC_ENABLE_ENABLE_Enabled << ADC_ENABLE_ENABLE_Pos;
+	NRF_ADC->TASKS_START = 1;
+	return;
+    }
+
+    /* The sequence is complete, so we pass it to the scheduler, which will
+     * call its handler from the main loop. */
+    adc_stop();
+    stats.sequences++;
+
+    if (app_sched_event_put(&p_sequence, sizeof(p_sequence), adc_sequenceEventHandler) != NRF_SUCCESS) {
+	stats.dropped++;
+	p_sequence->busy = false;
+    }
+
+    /* Start the next sequence, if there is one waiting. */
+    activeSequence = NULL;
+    if (pendingHead != NULL) {
+	p_sequence = pendingHead;
+	pendingHead = p_sequence->next;
+	if (pendingHead == NULL) {
+	    pendingTail = NULL;
+	}
+	adc_beginSequence(p_sequence);
+    }
+}
+
+void adc_sequenceEventHandler(void *p_event_data, uint16_t event_size) {
+    adcSequence_t *p_sequence;
+
+    UNUSED_PARAMETER(event_size);
+
+    p_sequence = *(adcSequence_t **)p_event_data;
+
+    /* The sequence is released before its handler is called so that the
+     * handler may restart it. */
+    p_sequence->busy = false;
+
+    if (p_sequence->handler != NULL) {
+	p_sequence->handler(p_sequence);
+    }
+}
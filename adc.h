@@ -11,9 +11,52 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Maximum number of channels in a single conversion sequence */
+#define ADC_SEQUENCE_MAX_CHANNELS	3
+
+struct adcSequence_s;
+
+typedef void (*adc_sequenceHandler_t)(struct adcSequence_s *p_sequence);
+
+/* A sequence converts each of its channels the given number of times,
+ * back-to-back from the ADC interrupt, and then passes the averaged results to
+ * its handler through the scheduler.  The structure belongs to the caller and
+ * must not be modified while busy is set, i.e. from adc_startSequence() until
+ * the handler has been called. */
+typedef struct adcSequence_s {
+    uint8_t channelCount;
+    uint8_t channels[ADC_SEQUENCE_MAX_CHANNELS];
+    uint8_t samples[ADC_SEQUENCE_MAX_CHANNELS];
+    uint16_t results_mV[ADC_SEQUENCE_MAX_CHANNELS];
+    adc_sequenceHandler_t handler;
+
+    /* Used by adc.c */
+    volatile bool busy;
+    uint8_t channelIndex;
+    uint8_t sampleCount;
+    uint32_t accum;
+    struct adcSequence_s *next;
+} adcSequence_t;
+
+typedef struct {
+    uint16_t sequences;
+    uint32_t conversions;
+    /* Sequences whose results could not be passed to the scheduler */
+    uint16_t dropped;
+    /* Blocking reads which had to wait for a sequence to finish */
+    uint16_t blockingWaits;
+} adcStats_t;
+
 bool adc_init(void);
 void adc_deinit(void);
 uint16_t adc_read_mV(uint8_t channel);
 uint16_t adc_avg_mV(uint8_t channel, uint8_t nsamples);
 
+bool adc_startSequence(adcSequence_t *p_sequence);
+bool adc_isBusy(void);
+void adc_waitIdle(void);
+
+void adc_getStats(adcStats_t *p_stats);
+void adc_clearStats(void);
+
 #endif /* ADC_H_ */
@@ -0,0 +1,369 @@
+/*
+ * beacon.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "global.h"
+#include "imu.h"
+#include "light.h"
+#include "beacon.h"
+
+/* The ambient samples are read often enough that the faceboards' buffers
+ * never hold more than one batch. */
+#define BEACON_LIGHT_INTERVAL_MS	20
+
+/* The noise floor is measured in two bins either side of the beacon's, this
+ * many bins away. */
+#define BEACON_NOISE_BIN_OFFSET		3
+
+/* The beacon is detected on a face when the power in its bin exceeds the
+ * noise floor by this factor and its amplitude is at least the minimum, for
+ * this many blocks in a row, and it is lost after as many blocks without. */
+#define BEACON_SNR			8
+#define BEACON_MIN_SIGNAL		4
+#define BEACON_DETECT_BLOCKS		2
+#define BEACON_LOSS_BLOCKS		3
+
+/* Goertzel filter coefficients are kept with 12 fractional bits, which keeps
+ * the filter states and their products within 32 bits for any input. */
+#define BEACON_COEFF_SHIFT		12
+
+/* Highest mains harmonic kept away from the beacon's and the noise bins */
+#define BEACON_FLICKER_HARMONICS	3
+
+/* Fixed-point scale of the weighted sum of face normals behind the bearing */
+#define BEACON_BEARING_SCALE		16
+
+typedef enum {
+    BEACON_BIN_SIGNAL = 0,
+    BEACON_BIN_NOISE_LOW,
+    BEACON_BIN_NOISE_HIGH,
+    BEACON_BIN_FLICKER_100,
+    BEACON_BIN_FLICKER_120,
+    BEACON_BIN_COUNT
+} beaconBin_t;
+
+typedef struct {
+    int32_t s1[BEACON_BIN_COUNT];
+    int32_t s2[BEACON_BIN_COUNT];
+    uint8_t n;
+    /* The mean of the previous block is removed from each sample */
+    int16_t dc;
+    int32_t sum;
+    uint32_t amplitude[BEACON_BIN_COUNT];
+    uint8_t hits;
+    uint8_t misses;
+    bool detected;
+    uint16_t blocks;
+} beaconFace_t;
+
+static bool running = false;
+static uint16_t frequency_hz;
+static int32_t coeffs[BEACON_BIN_COUNT];
+
+/* Half of a Hann window (scaled to 255), which keeps flicker that drifts off
+ * its bin with the mains frequency from leaking into the beacon's. */
+static uint8_t window[BEACON_BLOCK_LENGTH / 2];
+static beaconFace_t faces[6];
+
+/* Light sampling as it was before the beacon detector took it over */
+static bool lightWasRunning;
+static uint16_t lightInterval_ms;
+
+static bool beacon_isNearFlicker(uint8_t bin);
+static void beacon_setBin(beaconBin_t index, uint8_t bin);
+static void beacon_endBlock(beaconFace_t *p_face);
+static uint32_t beacon_sqrt(uint64_t x);
+
+/**@brief Starts looking for a light beacon blinking at the given frequency on
+ * all six faces.  The frequency must be a multiple of BEACON_BIN_WIDTH_HZ,
+ * and not close to a harmonic of mains flicker.
+ */
+bool beacon_start(uint16_t newFrequency_hz) {
+    uint8_t bin, lowBin, highBin;
+    uint8_t n;
+
+    if ((newFrequency_hz < BEACON_MIN_FREQUENCY_HZ) || (newFrequency_hz > BEACON_MAX_FREQUENCY_HZ) ||
+	    (newFrequency_hz % BEACON_BIN_WIDTH_HZ != 0)) {
+	return false;
+    }
+
+    bin = newFrequency_hz / BEACON_BIN_WIDTH_HZ;
+    if (beacon_isNearFlicker(bin)) {
+	return false;
+    }
+
+    /* The noise bins must not pick up flicker either.  Going down, DC counts
+     * as flicker, so the lowest beacon frequency leaves room for one. */
+    lowBin = bin - BEACON_NOISE_BIN_OFFSET;
+    while (beacon_isNearFlicker(lowBin)) {
+	lowBin--;
+    }
+    highBin = bin + BEACON_NOISE_BIN_OFFSET;
+    while (beacon_isNearFlicker(highBin)) {
+	highBin++;
+    }
+
+    for (n = 0; n < BEACON_BLOCK_LENGTH / 2; n++) {
+	window[n] = lroundf(127.5f * (1.0f - cosf(2.0f * (float)M_PI * n / (BEACON_BLOCK_LENGTH - 1))));
+    }
+
+    beacon_setBin(BEACON_BIN_SIGNAL, bin);
+    beacon_setBin(BEACON_BIN_NOISE_LOW, lowBin);
+    beacon_setBin(BEACON_BIN_NOISE_HIGH, highBin);
+    beacon_setBin(BEACON_BIN_FLICKER_100, 100 / BEACON_BIN_WIDTH_HZ);
+    beacon_setBin(BEACON_BIN_FLICKER_120, 120 / BEACON_BIN_WIDTH_HZ);
+
+    memset(faces, 0, sizeof(faces));
+    frequency_hz = newFrequency_hz;
+
+    if (!running) {
+	lightWasRunning = light_isRunning();
+	lightInterval_ms = light_getInterval();
+    }
+
+    light_setSampleHandler(beacon_processSamples);
+    if (!light_start(BEACON_LIGHT_INTERVAL_MS)) {
+	light_setSampleHandler(NULL);
+	return false;
+    }
+
+    running = true;
+
+    return true;
+}
+
+void beacon_stop() {
+    if (!running) {
+	return;
+    }
+
+    light_setSampleHandler(NULL);
+    if (lightWasRunning) {
+	light_start(lightInterval_ms);
+    } else {
+	light_stop();
+    }
+
+    running = false;
+}
+
+bool beacon_isRunning() {
+    return running;
+}
+
+uint16_t beacon_getFrequency() {
+    return frequency_hz;
+}
+
+bool beacon_getFaceStatus(uint8_t faceNum, beaconFaceStatus_t *p_status) {
+    beaconFace_t *p_face;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    p_status->detected = p_face->detected;
+    p_status->signal = p_face->amplitude[BEACON_BIN_SIGNAL];
+    p_status->noise = (p_face->amplitude[BEACON_BIN_NOISE_LOW] > p_face->amplitude[BEACON_BIN_NOISE_HIGH]) ?
+	p_face->amplitude[BEACON_BIN_NOISE_LOW] : p_face->amplitude[BEACON_BIN_NOISE_HIGH];
+    p_status->flicker = (p_face->amplitude[BEACON_BIN_FLICKER_100] > p_face->amplitude[BEACON_BIN_FLICKER_120]) ?
+	p_face->amplitude[BEACON_BIN_FLICKER_100] : p_face->amplitude[BEACON_BIN_FLICKER_120];
+    p_status->blocks = p_face->blocks;
+
+    return true;
+}
+
+/**@brief Estimates the direction of the beacon from the strength of its
+ * signal on each face which detects it.
+ *
+ * @param[out] bearing  Unit vector towards the beacon in the module's frame
+ *                      (that of the faceboard IMU), scaled by 1000.
+ *
+ * @return The face which receives the beacon most strongly, or 0 if no face
+ *         detects it.
+ */
+uint8_t beacon_getBearing(int16_t bearing[3]) {
+    int32_t sum[3] = {0, 0, 0};
+    uint32_t magnitude, strongest = 0;
+    uint8_t faceNum, strongestFace = 0;
+    uint8_t axis;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if (!faces[faceNum-1].detected) {
+	    continue;
+	}
+
+	for (axis = 0; axis < 3; axis++) {
+	    sum[axis] += frameFaceNormals[faceNum-1][axis] * (int32_t)faces[faceNum-1].amplitude[BEACON_BIN_SIGNAL];
+	}
+
+	if (faces[faceNum-1].amplitude[BEACON_BIN_SIGNAL] > strongest) {
+	    strongest = faces[faceNum-1].amplitude[BEACON_BIN_SIGNAL];
+	    strongestFace = faceNum;
+	}
+    }
+
+    /* The sums are scaled up before the square root, which would otherwise
+     * be too coarse for the bearing to come out as a unit vector when the
+     * amplitudes are small. */
+    for (axis = 0; axis < 3; axis++) {
+	sum[axis] *= BEACON_BEARING_SCALE;
+    }
+    magnitude = beacon_sqrt((int64_t)sum[0] * sum[0] + (int64_t)sum[1] * sum[1] + (int64_t)sum[2] * sum[2]);
+
+    for (axis = 0; axis < 3; axis++) {
+	bearing[axis] = (magnitude > 0) ? (1000 * sum[axis] + (int32_t)magnitude / 2) / (int32_t)magnitude : 0;
+    }
+
+    return strongestFace;
+}
+
+/**@brief Runs a batch of one face's raw ambient samples through the Goertzel
+ * filters.
+ *
+ * Each sample costs one multiplication for the window, and one multiplication,
+ * one shift and three additions per filter, so the cost per sample is fixed,
+ * and a block's results are computed once per BEACON_BLOCK_LENGTH samples.
+ */
+void beacon_processSamples(uint8_t faceNum, const uint8_t *samples, uint8_t count) {
+    beaconFace_t *p_face;
+    int32_t x, s0;
+    uint8_t i, b;
+
+    if (!running || (faceNum < 1) || (faceNum > 6)) {
+	return;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    for (i = 0; i < count; i++) {
+	/* Until the first block is complete, the first sample stands in for
+	 * its mean. */
+	if ((p_face->n == 0) && (p_face->blocks == 0)) {
+	    p_face->dc = samples[i];
+	}
+
+	x = (int32_t)samples[i] - p_face->dc;
+	x *= (p_face->n < BEACON_BLOCK_LENGTH / 2) ? window[p_face->n] : window[BEACON_BLOCK_LENGTH - 1 - p_face->n];
+	x = (x + 128) >> 8;
+	p_face->sum += samples[i];
+
+	for (b = 0; b < BEACON_BIN_COUNT; b++) {
+	    s0 = x + ((coeffs[b] * p_face->s1[b]) >> BEACON_COEFF_SHIFT) - p_face->s2[b];
+	    p_face->s2[b] = p_face->s1[b];
+	    p_face->s1[b] = s0;
+	}
+
+	if (++p_face->n == BEACON_BLOCK_LENGTH) {
+	    beacon_endBlock(p_face);
+	}
+    }
+}
+
+/**@brief Checks whether a bin lies within BEACON_FLICKER_GUARD_BINS of DC or
+ * of a harmonic of 100 or 120 Hz flicker, as it appears after sampling.
+ */
+bool beacon_isNearFlicker(uint8_t bin) {
+    static const uint8_t mains_hz[] = {100, 120};
+    uint16_t f_hz;
+    uint8_t m, k;
+
+    if (bin <= BEACON_FLICKER_GUARD_BINS) {
+	return true;
+    }
+
+    for (m = 0; m < sizeof(mains_hz); m++) {
+	for (k = 1; k <= BEACON_FLICKER_HARMONICS; k++) {
+	    f_hz = (k * mains_hz[m]) % BEACON_SAMPLE_RATE_HZ;
+	    if (f_hz > BEACON_SAMPLE_RATE_HZ / 2) {
+		f_hz = BEACON_SAMPLE_RATE_HZ - f_hz;
+	    }
+
+	    if (abs((int16_t)bin - f_hz / BEACON_BIN_WIDTH_HZ) <= BEACON_FLICKER_GUARD_BINS) {
+		return true;
+	    }
+	}
+    }
+
+    return false;
+}
+
+void beacon_setBin(beaconBin_t index, uint8_t bin) {
+    coeffs[index] = lroundf(2.0f * cosf(2.0f * (float)M_PI * bin / BEACON_BLOCK_LENGTH) * (1 << BEACON_COEFF_SHIFT));
+}
+
+void beacon_endBlock(beaconFace_t *p_face) {
+    int64_t power;
+    uint32_t noise;
+    uint8_t b;
+
+    /* A sinusoid of amplitude A leaves power (A * N / 4)^2 in its bin after
+     * the window, and the 8-bit samples are scaled by 4 to match the 10-bit
+     * light levels. */
+    for (b = 0; b < BEACON_BIN_COUNT; b++) {
+	power = (int64_t)p_face->s1[b] * p_face->s1[b] + (int64_t)p_face->s2[b] * p_face->s2[b] -
+	    (((int64_t)coeffs[b] * p_face->s1[b] * p_face->s2[b]) >> BEACON_COEFF_SHIFT);
+	if (power < 0) {
+	    power = 0;
+	} else if (power > UINT32_MAX) {
+	    power = UINT32_MAX;
+	}
+
+	p_face->amplitude[b] = (16 * beacon_sqrt((uint32_t)power) + BEACON_BLOCK_LENGTH / 2) / BEACON_BLOCK_LENGTH;
+	p_face->s1[b] = 0;
+	p_face->s2[b] = 0;
+    }
+
+    p_face->dc = (p_face->sum + BEACON_BLOCK_LENGTH / 2) / BEACON_BLOCK_LENGTH;
+    p_face->sum = 0;
+    p_face->n = 0;
+    p_face->blocks++;
+
+    /* Comparing amplitudes, the power ratio becomes its square root. */
+    noise = (p_face->amplitude[BEACON_BIN_NOISE_LOW] > p_face->amplitude[BEACON_BIN_NOISE_HIGH]) ?
+	p_face->amplitude[BEACON_BIN_NOISE_LOW] : p_face->amplitude[BEACON_BIN_NOISE_HIGH];
+
+    if ((p_face->amplitude[BEACON_BIN_SIGNAL] >= BEACON_MIN_SIGNAL) &&
+	    (p_face->amplitude[BEACON_BIN_SIGNAL] * p_face->amplitude[BEACON_BIN_SIGNAL] >= BEACON_SNR * noise * noise)) {
+	p_face->misses = 0;
+	if (!p_face->detected && (++p_face->hits >= BEACON_DETECT_BLOCKS)) {
+	    p_face->detected = true;
+	}
+    } else {
+	p_face->hits = 0;
+	if (p_face->detected && (++p_face->misses >= BEACON_LOSS_BLOCKS)) {
+	    p_face->detected = false;
+	}
+    }
+}
+
+uint32_t beacon_sqrt(uint64_t x) {
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+
+    while (bit > x) {
+	bit >>= 2;
+    }
+
+    while (bit != 0) {
+	if (x >= root + bit) {
+	    x -= root + bit;
+	    root = (root >> 1) + bit;
+	} else {
+	    root >>= 1;
+	}
+	bit >>= 2;
+    }
+
+    return root;
+}
@@ -0,0 +1,49 @@
+/*
+ * beacon.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef BEACON_H_
+#define BEACON_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Rate at which the faceboards fill their ambient sample buffers */
+#define BEACON_SAMPLE_RATE_HZ		500
+
+/* The samples from each face are analyzed in blocks of this length (200 ms),
+ * so the filters' bins are 5 Hz apart.  Mains flicker at 100 and 120 Hz and
+ * its harmonics (folded back below the Nyquist frequency) falls on bins of its
+ * own, and beacon frequencies within BEACON_FLICKER_GUARD_BINS of them are
+ * refused. */
+#define BEACON_BLOCK_LENGTH		100
+#define BEACON_BIN_WIDTH_HZ		(BEACON_SAMPLE_RATE_HZ / BEACON_BLOCK_LENGTH)
+#define BEACON_FLICKER_GUARD_BINS	2
+
+#define BEACON_DEFAULT_FREQUENCY_HZ	40
+#define BEACON_MIN_FREQUENCY_HZ		30
+#define BEACON_MAX_FREQUENCY_HZ		180
+
+typedef struct {
+    bool detected;
+    /* Amplitude of the beacon's blinking, and of the flicker at 100 and 120
+     * Hz, in the same units as the ambient light level (0-1023) */
+    uint16_t signal;
+    uint16_t noise;
+    uint16_t flicker;
+    uint16_t blocks;
+} beaconFaceStatus_t;
+
+bool beacon_start(uint16_t frequency_hz);
+void beacon_stop(void);
+bool beacon_isRunning(void);
+uint16_t beacon_getFrequency(void);
+
+bool beacon_getFaceStatus(uint8_t faceNum, beaconFaceStatus_t *p_status);
+uint8_t beacon_getBearing(int16_t bearing[3]);
+
+void beacon_processSamples(uint8_t faceNum, const uint8_t *samples, uint8_t count);
+
+#endif /* BEACON_H_ */
@@ -21,6 +21,7 @@
 #include "a4960.h"
 #include "freqcntr.h"
 #include "power.h"
+#include "thermal.h"
 #include "motionEvent.h"
 #include "bldc.h"
 
@@ -70,6 +71,7 @@ static bool needToReconfigure = false;
 static uint32_t startTime_rtcTicks;
 
 static uint16_t setSpeed_rpm;
+static uint16_t measuredSpeed_rpm = 0;
 //static bool bldcRunning = false;
 //static bool accelModeActive = false;
 //static bool brakeModeActive = false;
@@ -363,6 +365,9 @@ bool bldc_setMaxCurrent_mA(uint16_t iLimit_mA) {
     uint32_t vref_mV, bldciref_mV;
     uint32_t onPeriod;
 
+    /* As the module warms, the motor is given less current. */
+    iLimit_mA = thermal_derate(iLimit_mA);
+
     /* Calculate the voltage that we want at the A4960's REF pin.  See page 18
      * of the A4960 datasheet for an explanation. */
     vref_mV = (iLimit_mA * BLDC_ISENSE_GAIN * BLDC_RSENSE_MILLIOHMS) / 1000;
@@ -374,14 +379,19 @@ bool bldc_setMaxCurrent_mA(uint16_t iLimit_mA) {
 
     /* From the desired DC voltage at the input of the resistor divider, we
      * calculate the necessary on period knowing the total period of the
-     * PWM generator and that the reference voltage is 3.3V.*/
-    onPeriod = (bldciref_mV * pwm_getPeriod()) / 3300;
-
-    if (onPeriod > pwm_getPeriod()) {
+     * PWM generator and that the reference voltage is 3.3V.  One count of the
+     * PWM generator is roughly 10mA of motor current, so we keep
+     * PWM_DITHER_BITS of fraction and let the PWM module dither the on
+     * period from one call to the next.  Because the speed control loop
+     * calls this function every iteration, the average current has a much
+     * finer resolution than a single count. */
+    onPeriod = ((bldciref_mV * pwm_getPeriod()) << PWM_DITHER_BITS) / 3300;
+
+    if (onPeriod > (pwm_getPeriod() << PWM_DITHER_BITS)) {
 	return false;
     }
 
-    if (!pwm_setOnPeriod(BLDCIREF_PWM_CHNL, onPeriod)) {
+    if (!pwm_setOnPeriodDithered(BLDCIREF_PWM_CHNL, onPeriod)) {
 	return false;
     }
 
@@ -453,6 +463,7 @@ bool bldc_setSpeed(uint16_t speed_rpm, bool reverse, uint16_t brakeTime_ms,
     success &= bldc_start(reverse);
 
     bldcModeCurrent = BLDC_MODE_CONSTANT_SPEED;
+    measuredSpeed_rpm = 0;
 
     app_timer_cnt_get(&startTime_rtcTicks);
 
@@ -544,6 +555,17 @@ bool bldc_getReverseDirections() {
     return directionsReversed;
 }
 
+/**@brief Returns the flywheel speed last measured by the speed control loop,
+ * or 0 if the motor is not running in constant speed mode.
+ */
+uint16_t bldc_getSpeed_rpm() {
+    if (!power_getVBATSWState() || (bldcModeCurrent != BLDC_MODE_CONSTANT_SPEED)) {
+	return 0;
+    }
+
+    return measuredSpeed_rpm;
+}
+
 bool bldc_translateDirection(bool reverse) {
     if (directionsReversed) {
 	return (!reverse);
@@ -778,6 +800,7 @@ void bldc_speedControlLoop(bool reinit, bldcMode_t bldcModeTimerStart) {
 
     /* Then we translate this frequency into the RPM of the motor */
     actual_rpm = (freqcntr_getFreq_Hz() * 60) / 42;
+    measuredSpeed_rpm = actual_rpm;
 
     /* Subtract the actual speed from the set point speed to find the raw RPM
      * error. */
@@ -32,6 +32,7 @@ bool bldc_setMaxCurrent_mA(uint16_t mA);
 
 bool bldc_setSpeed(uint16_t speed_rpm, bool reverse, uint16_t brakeTime_ms, app_sched_event_handler_t bldcEventHandler);
 bool bldc_setAccel(uint16_t accel_mA, uint16_t time_ms, bool reverse, app_sched_event_handler_t bldcEventHandler);
+uint16_t bldc_getSpeed_rpm(void);
 
 void bldc_setReverseDirections(bool reverse);
 bool bldc_getReverseDirections(void);
@@ -23,6 +23,7 @@
 #include "ble_stack_handler_types.h"
 
 #include "softdevice_handler.h"
+#include "pstorage.h"
 
 
 #include "global.h"
@@ -30,6 +31,7 @@
 #include "led.h"
 #include "ble_vns.h"
 #include "ble_sps.h"
+#include "irdfu.h"
 #include "bleApp.h"
 
 #define SEC_PARAM_TIMEOUT               30                                          /**< Timeout for Pairing Request or Security Request (in seconds). */
@@ -62,6 +64,7 @@ static bool advertisingEnabled = true;
 static char deviceName[BLE_GAP_DEVNAME_MAX_LEN + 1] = "BLE SPP 67:6F:C7";
 
 static void bleApp_evtDispatch(ble_evt_t * p_ble_evt);
+static void bleApp_sysEvtDispatch(uint32_t sys_evt);
 static void bleApp_onEvt(ble_evt_t * p_ble_evt);
 static void bleApp_onConnParamsEvt(ble_conn_params_evt_t * p_evt);
 static void bleApp_connParamsErrorHandler(uint32_t nrf_error);
@@ -77,6 +80,14 @@ void bleApp_stackInit() {
 
     err_code = softdevice_ble_evt_handler_set(bleApp_evtDispatch);
     APP_ERROR_CHECK(err_code);
+
+    err_code = softdevice_sys_evt_handler_set(bleApp_sysEvtDispatch);
+    APP_ERROR_CHECK(err_code);
+
+    /* Persistent storage (e.g. of the brake profiles) relies on the
+     * SoftDevice for flash access. */
+    err_code = pstorage_init();
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -99,6 +110,19 @@ void bleApp_evtDispatch(ble_evt_t * p_ble_evt) {
 }
 
 
+/**@brief Dispatches a system event (e.g. the completion of a flash
+ * operation) to all modules with a system event handler.
+ *
+ * @param[in]   sys_evt     System event.
+ */
+void bleApp_sysEvtDispatch(uint32_t sys_evt) {
+    /* Only one flash operation runs at a time, and each module ignores the
+     * events for operations it did not start. */
+    pstorage_sys_event_handler(sys_evt);
+    irdfu_onSysEvt(sys_evt);
+}
+
+
 /**@brief Application's BLE Stack event handler.
  *
  * @param[in]   p_ble_evt   Bluetooth stack event.
@@ -207,7 +231,7 @@ void bleApp_servicesInit() {
     uint32_t err_code;
 
     ble_vns_init_t vns_init;
-    vns_init.version = 0x0100;
+    vns_init.version = FIRMWARE_VERSION;
     err_code = ble_vns_init(&m_vns, &vns_init);
     APP_ERROR_CHECK(err_code);
 
@@ -0,0 +1,351 @@
+/*
+ * brakeprofile.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrf_error.h"
+#include "app_error.h"
+#include "pstorage.h"
+#include "crc16.h"
+
+#include "global.h"
+#include "bldc.h"
+#include "power.h"
+#include "irdfu.h"
+#include "mechbrake.h"
+#include "brakeprofile.h"
+
+/* Changed whenever the layout of brakeProfile_t changes, so that profiles
+ * stored by older firmware are replaced by the defaults. */
+#define BRAKEPROFILE_STORE_VERSION	1
+
+typedef struct {
+    uint16_t version;
+    uint16_t crc;
+    brakeProfile_t profiles[BRAKEPROFILE_COUNT];
+} brakeProfileStore_t;
+
+/* Forward rolls at the speeds and brake settings which have worked for the
+ * light tracker, and a harder and two gentler alternatives. */
+static const brakeProfile_t defaultProfiles[BRAKEPROFILE_COUNT] = {
+    {"roll", 6000, BRAKEPROFILE_DEFAULT_BATTERY_MV, 1, false, 100, 0, {{3000, 40}}},
+    {"jump", 12000, BRAKEPROFILE_DEFAULT_BATTERY_MV, 1, false, 100, 0, {{3000, 60}}},
+    {"pivot", 4000, BRAKEPROFILE_DEFAULT_BATTERY_MV, 2, false, 100, 0, {{2000, 30}, {1000, 20}}},
+    {"soft", 5000, BRAKEPROFILE_DEFAULT_BATTERY_MV, 2, false, 100, 0, {{1500, 20}, {3000, 30}}},
+};
+
+static bool initialized = false;
+
+/* pstorage writes straight from this buffer, so it is only modified while no
+ * save is in progress. */
+static brakeProfileStore_t store __attribute__((aligned(4)));
+static pstorage_handle_t storeHandle;
+
+static bool loaded = false;
+static bool saving = false;
+static uint8_t unsavedChanges = 0;
+static uint16_t saves = 0;
+static uint16_t saveFailures = 0;
+
+static brakeProfileStats_t stats[BRAKEPROFILE_COUNT];
+
+static uint16_t brakeprofile_getScale_percent(uint16_t actual, uint16_t nominal);
+static void brakeprofile_pstorageHandler(pstorage_handle_t *p_handle, uint8_t op_code, uint32_t result,
+	uint8_t *p_data, uint32_t data_len);
+
+/**@brief Registers the profiles' block of flash and loads them from it, or
+ * falls back on the defaults if no valid profiles were stored.  Must be
+ * called once, after the SoftDevice and pstorage have been initialized.
+ */
+void brakeprofile_init() {
+    uint32_t err_code;
+    pstorage_module_param_t param;
+
+    if (initialized) {
+	return;
+    }
+
+    param.block_size = sizeof(store);
+    param.block_count = 1;
+    param.cb = brakeprofile_pstorageHandler;
+
+    err_code = pstorage_register(&param, &storeHandle);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pstorage_load((uint8_t *)&store, &storeHandle, sizeof(store), 0);
+    APP_ERROR_CHECK(err_code);
+
+    loaded = (store.version == BRAKEPROFILE_STORE_VERSION) &&
+	(store.crc == crc16_compute((const uint8_t *)store.profiles, sizeof(store.profiles), NULL));
+
+    if (!loaded) {
+	store.version = BRAKEPROFILE_STORE_VERSION;
+	memcpy(store.profiles, defaultProfiles, sizeof(store.profiles));
+    }
+
+    initialized = true;
+}
+
+bool brakeprofile_get(uint8_t id, brakeProfile_t *p_profile) {
+    if (!initialized || (id >= BRAKEPROFILE_COUNT)) {
+	return false;
+    }
+
+    memcpy(p_profile, &store.profiles[id], sizeof(brakeProfile_t));
+
+    return true;
+}
+
+/**@brief Replaces a profile in RAM.  The change is kept across resets only
+ * once brakeprofile_save() has been called.
+ */
+bool brakeprofile_set(uint8_t id, const brakeProfile_t *p_profile) {
+    if (!initialized || saving || (id >= BRAKEPROFILE_COUNT) ||
+	    (p_profile->stepCount == 0) || (p_profile->stepCount > BRAKEPROFILE_MAX_STEPS) ||
+	    (p_profile->scale_percent < BRAKEPROFILE_MIN_SCALE_PERCENT) ||
+	    (p_profile->scale_percent > BRAKEPROFILE_MAX_SCALE_PERCENT)) {
+	return false;
+    }
+
+    memcpy(&store.profiles[id], p_profile, sizeof(brakeProfile_t));
+    store.profiles[id].name[BRAKEPROFILE_NAME_LENGTH - 1] = '\0';
+
+    return true;
+}
+
+/**@brief Enables or disables the adaptive scaling of a profile's current.
+ * Disabling it also returns the scaling to 100%.
+ */
+bool brakeprofile_setAdaptive(uint8_t id, bool adaptive) {
+    if (!initialized || saving || (id >= BRAKEPROFILE_COUNT)) {
+	return false;
+    }
+
+    store.profiles[id].adaptive = adaptive;
+    if (!adaptive) {
+	store.profiles[id].scale_percent = 100;
+    }
+
+    return true;
+}
+
+void brakeprofile_restoreDefaults() {
+    if (!initialized || saving) {
+	return;
+    }
+
+    memcpy(store.profiles, defaultProfiles, sizeof(store.profiles));
+}
+
+/**@brief Starts writing the profiles to flash.  Returns false if the write
+ * could not be started, e.g. because a firmware update is writing to flash.
+ */
+bool brakeprofile_save() {
+    uint32_t err_code;
+
+    if (!initialized || saving || irdfu_isFlashBusy()) {
+	return false;
+    }
+
+    store.crc = crc16_compute((const uint8_t *)store.profiles, sizeof(store.profiles), NULL);
+
+    err_code = pstorage_update(&storeHandle, (uint8_t *)&store, sizeof(store), 0);
+    if (err_code != NRF_SUCCESS) {
+	saveFailures++;
+	return false;
+    }
+
+    saving = true;
+    unsavedChanges = 0;
+
+    return true;
+}
+
+/**@brief Fills in the coil current steps with which to brake using the given
+ * profile.
+ *
+ * The current of each step is scaled by the flywheel speed measured by the
+ * speed controller relative to the profile's speed, since the brake must take
+ * up the flywheel's momentum, and by the profile's adaptive scaling.  Current
+ * beyond BRAKEPROFILE_MAX_CURRENT_MA is made up for by a longer step.  Step
+ * times are scaled by the profile's battery voltage relative to the present
+ * one, as the coil current takes longer to build up from a lower voltage.
+ *
+ * Must be called before the flywheel is stopped.
+ *
+ * @param[in] id        Profile ID.
+ * @param[in] reverse   True to negate the currents for a reverse roll.
+ * @param[out] steps    Steps to pass to mechbrake_actuate().
+ * @param[in] maxSteps  Size of steps.
+ *
+ * @return The number of steps filled in, or 0 if the profile does not exist.
+ */
+uint8_t brakeprofile_getSteps(uint8_t id, bool reverse, coilCurrentStep_t *steps, uint8_t maxSteps) {
+    const brakeProfile_t *p_profile;
+    uint16_t speed_rpm, battery_mV;
+    uint32_t currentScale_percent, timeScale_percent;
+    uint32_t current_mA, time_ms;
+    uint8_t i, stepCount;
+
+    if (!initialized || (id >= BRAKEPROFILE_COUNT)) {
+	return 0;
+    }
+
+    p_profile = &store.profiles[id];
+
+    speed_rpm = bldc_getSpeed_rpm();
+    battery_mV = power_getBatteryPackVoltage_mV();
+
+    currentScale_percent = (brakeprofile_getScale_percent(speed_rpm, p_profile->speed_rpm) *
+	    (uint32_t)p_profile->scale_percent) / 100;
+    timeScale_percent = brakeprofile_getScale_percent(p_profile->battery_mV, battery_mV);
+
+    stepCount = (p_profile->stepCount < maxSteps) ? p_profile->stepCount : maxSteps;
+
+    for (i = 0; i < stepCount; i++) {
+	current_mA = (abs(p_profile->steps[i].current_mA) * currentScale_percent) / 100;
+	time_ms = (p_profile->steps[i].time_ms * timeScale_percent) / 100;
+
+	if (current_mA > BRAKEPROFILE_MAX_CURRENT_MA) {
+	    time_ms = (time_ms * current_mA) / BRAKEPROFILE_MAX_CURRENT_MA;
+	    current_mA = BRAKEPROFILE_MAX_CURRENT_MA;
+	}
+
+	if (time_ms > BRAKEPROFILE_MAX_TIME_MS) {
+	    time_ms = BRAKEPROFILE_MAX_TIME_MS;
+	}
+
+	if ((p_profile->steps[i].current_mA < 0) != reverse) {
+	    steps[i].current_mA = -(int16_t)current_mA;
+	} else {
+	    steps[i].current_mA = (int16_t)current_mA;
+	}
+	steps[i].time_ms = time_ms;
+    }
+
+    stats[id].uses++;
+    stats[id].lastSpeed_rpm = speed_rpm;
+    stats[id].lastBattery_mV = battery_mV;
+
+    return stepCount;
+}
+
+/**@brief Reports how a roll braked with the given profile turned out, as
+ * observed by the faceboard IMU.  An adaptive profile brakes harder after a
+ * roll which failed to tip the module, and more gently after one which
+ * tumbled it over two faces.
+ */
+void brakeprofile_reportOutcome(uint8_t id, brakeProfileOutcome_t outcome) {
+    brakeProfile_t *p_profile;
+    int16_t scale_percent;
+
+    if (!initialized || (id >= BRAKEPROFILE_COUNT)) {
+	return;
+    }
+
+    p_profile = &store.profiles[id];
+
+    switch (outcome) {
+    case BRAKEPROFILE_OUTCOME_NO_TIP:
+	stats[id].noTips++;
+	scale_percent = p_profile->scale_percent + BRAKEPROFILE_ADAPT_STEP_PERCENT;
+	break;
+    case BRAKEPROFILE_OUTCOME_TUMBLED:
+	stats[id].tumbles++;
+	scale_percent = p_profile->scale_percent - BRAKEPROFILE_ADAPT_STEP_PERCENT;
+	break;
+    default:
+	stats[id].tips++;
+	return;
+    }
+
+    /* The outcome is not learnt from while the profiles are being written. */
+    if (!p_profile->adaptive || saving) {
+	return;
+    }
+
+    if (scale_percent < BRAKEPROFILE_MIN_SCALE_PERCENT) {
+	scale_percent = BRAKEPROFILE_MIN_SCALE_PERCENT;
+    } else if (scale_percent > BRAKEPROFILE_MAX_SCALE_PERCENT) {
+	scale_percent = BRAKEPROFILE_MAX_SCALE_PERCENT;
+    }
+
+    if (scale_percent == p_profile->scale_percent) {
+	return;
+    }
+
+    p_profile->scale_percent = scale_percent;
+
+    if (++unsavedChanges >= BRAKEPROFILE_AUTOSAVE_CHANGES) {
+	brakeprofile_save();
+    }
+}
+
+bool brakeprofile_getStats(uint8_t id, brakeProfileStats_t *p_stats) {
+    if (id >= BRAKEPROFILE_COUNT) {
+	return false;
+    }
+
+    memcpy(p_stats, &stats[id], sizeof(brakeProfileStats_t));
+
+    return true;
+}
+
+void brakeprofile_getStatus(brakeProfileStatus_t *p_status) {
+    p_status->loaded = loaded;
+    p_status->saving = saving;
+    p_status->unsavedChanges = unsavedChanges;
+    p_status->saves = saves;
+    p_status->saveFailures = saveFailures;
+}
+
+void brakeprofile_clearStats() {
+    memset(stats, 0, sizeof(stats));
+    saves = 0;
+    saveFailures = 0;
+}
+
+/**@brief Returns 100 times actual / nominal, limited to the range from
+ * BRAKEPROFILE_MIN_SCALE_PERCENT to BRAKEPROFILE_MAX_SCALE_PERCENT, or 100 if
+ * either is unknown.
+ */
+uint16_t brakeprofile_getScale_percent(uint16_t actual, uint16_t nominal) {
+    uint32_t scale_percent;
+
+    if ((actual == 0) || (nominal == 0)) {
+	return 100;
+    }
+
+    scale_percent = (100 * (uint32_t)actual) / nominal;
+
+    if (scale_percent < BRAKEPROFILE_MIN_SCALE_PERCENT) {
+	return BRAKEPROFILE_MIN_SCALE_PERCENT;
+    } else if (scale_percent > BRAKEPROFILE_MAX_SCALE_PERCENT) {
+	return BRAKEPROFILE_MAX_SCALE_PERCENT;
+    }
+
+    return scale_percent;
+}
+
+void brakeprofile_pstorageHandler(pstorage_handle_t *p_handle, uint8_t op_code, uint32_t result,
+	uint8_t *p_data, uint32_t data_len) {
+    if (op_code != PSTORAGE_UPDATE_OP_CODE) {
+	return;
+    }
+
+    saving = false;
+
+    if (result == NRF_SUCCESS) {
+	saves++;
+    } else {
+	/* Try again with the next adaptive change */
+	saveFailures++;
+	unsavedChanges = BRAKEPROFILE_AUTOSAVE_CHANGES - 1;
+    }
+}
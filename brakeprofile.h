@@ -0,0 +1,101 @@
+/*
+ * brakeprofile.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef BRAKEPROFILE_H_
+#define BRAKEPROFILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_scheduler.h"
+
+#include "mechbrake.h"
+
+#define BRAKEPROFILE_COUNT		4
+#define BRAKEPROFILE_MAX_STEPS		4
+#define BRAKEPROFILE_NAME_LENGTH	8
+
+/* Passed in place of a profile ID to use explicit brake parameters */
+#define BRAKEPROFILE_NONE		0xFF
+
+/* The battery pack voltage (four cells in series) for which a new profile's
+ * step times are meant */
+#define BRAKEPROFILE_DEFAULT_BATTERY_MV	14800
+
+/* Limits of the scaling applied to a profile's current for the measured
+ * flywheel speed, and of the adaptive scaling learnt from its outcomes, in
+ * percent */
+#define BRAKEPROFILE_MIN_SCALE_PERCENT	50
+#define BRAKEPROFILE_MAX_SCALE_PERCENT	200
+
+/* Amount by which an adaptive profile's scaling changes after a roll which
+ * failed to tip the module or which tumbled it over two faces */
+#define BRAKEPROFILE_ADAPT_STEP_PERCENT	5
+
+/* Adaptive changes are saved to flash after this many, so as not to wear it
+ * out */
+#define BRAKEPROFILE_AUTOSAVE_CHANGES	8
+
+#define BRAKEPROFILE_MAX_CURRENT_MA	3500
+#define BRAKEPROFILE_MAX_TIME_MS	500
+
+typedef enum {
+    BRAKEPROFILE_OUTCOME_NO_TIP,
+    BRAKEPROFILE_OUTCOME_TIPPED,
+    BRAKEPROFILE_OUTCOME_TUMBLED
+} brakeProfileOutcome_t;
+
+/* Stored in flash, so new fields must be added in place of the reserved
+ * byte or with a new BRAKEPROFILE_STORE_VERSION. */
+typedef struct {
+    char name[BRAKEPROFILE_NAME_LENGTH];
+    /* Flywheel speed at which the profile is to be used, and the battery
+     * pack voltage for which its step times are meant */
+    uint16_t speed_rpm;
+    uint16_t battery_mV;
+    uint8_t stepCount;
+    bool adaptive;
+    uint8_t scale_percent;
+    uint8_t reserved;
+    /* Currents are for a forward roll, and are negated for a reverse one */
+    coilCurrentStep_t steps[BRAKEPROFILE_MAX_STEPS];
+} brakeProfile_t;
+
+typedef struct {
+    uint16_t uses;
+    uint16_t noTips;
+    uint16_t tips;
+    uint16_t tumbles;
+    /* Flywheel speed and battery voltage for which the profile's steps were
+     * last scaled */
+    uint16_t lastSpeed_rpm;
+    uint16_t lastBattery_mV;
+} brakeProfileStats_t;
+
+typedef struct {
+    bool loaded;
+    bool saving;
+    uint8_t unsavedChanges;
+    uint16_t saves;
+    uint16_t saveFailures;
+} brakeProfileStatus_t;
+
+void brakeprofile_init(void);
+
+bool brakeprofile_get(uint8_t id, brakeProfile_t *p_profile);
+bool brakeprofile_set(uint8_t id, const brakeProfile_t *p_profile);
+bool brakeprofile_setAdaptive(uint8_t id, bool adaptive);
+void brakeprofile_restoreDefaults(void);
+bool brakeprofile_save(void);
+
+uint8_t brakeprofile_getSteps(uint8_t id, bool reverse, coilCurrentStep_t *steps, uint8_t maxSteps);
+void brakeprofile_reportOutcome(uint8_t id, brakeProfileOutcome_t outcome);
+
+bool brakeprofile_getStats(uint8_t id, brakeProfileStats_t *p_stats);
+void brakeprofile_getStatus(brakeProfileStatus_t *p_status);
+void brakeprofile_clearStats(void);
+
+#endif /* BRAKEPROFILE_H_ */
@@ -29,11 +29,26 @@
 #include "power.h"
 #include "db.h"
 #include "fb.h"
+#include "irtx.h"
+#include "neighbor.h"
+#include "timesync.h"
+#include "rpc.h"
+#include "xfer.h"
+#include "group.h"
+#include "irlink.h"
+#include "leader.h"
+#include "gradient.h"
+#include "irdfu.h"
+#include "light.h"
+#include "beacon.h"
+#include "proximity.h"
+#include "thermal.h"
 #include "bldc.h"
 #include "sma.h"
 #include "freqcntr.h"
 #include "cmdline.h"
 #include "mechbrake.h"
+#include "brakeprofile.h"
 #include "motionEvent.h"
 #include "mpu6050.h"
 #include "imu.h"
@@ -56,6 +71,7 @@ static void cmdBLDCSpeed(const char *args);
 static void cmdBLDCStop(const char *args);
 /* Brake commands */
 static void cmdSimpleBrake(const char *args);
+static void cmdBrakeProfile(const char *args);
 static void cmdBrake(const char *args);
 /* SMA commands */
 static void cmdSMA(const char *args);
@@ -77,6 +93,28 @@ static void cmdFBRxAmbient(const char *args);
 static void cmdFBRxAmbientCount(const char *args);
 static void cmdFBRxEnable(const char *args);
 static void cmdFBSleep(const char *args);
+/* IR communication commands */
+static void cmdIRTx(const char *args);
+static void cmdIRTxStats(const char *args);
+static void cmdNeighbors(const char *args);
+static void cmdNeighborMap(const char *args);
+static void cmdClusterTime(const char *args);
+static void cmdAt(const char *args);
+static void cmdRPC(const char *args);
+static void cmdXfer(const char *args);
+static void cmdXferStats(const char *args);
+static void cmdGroup(const char *args);
+static void cmdMulticast(const char *args);
+static void cmdIRLink(const char *args);
+static void cmdLeader(const char *args);
+static void cmdGradient(const char *args);
+static void cmdFWUp(const char *args);
+static void cmdLight(const char *args);
+static void cmdBeacon(const char *args);
+static void cmdProximity(const char *args);
+static void cmdDB(const char *args);
+static void cmdTemp(const char *args);
+static void cmdADC(const char *args);
 /* IMU commands */
 static void cmdIMUSelect(const char *args);
 static void cmdIMUInit(const char *args);
@@ -90,6 +128,7 @@ static void cmdBLEMACAddr(const char *args);
 /* Motion commands */
 static void cmdChangePlane(const char *args);
 static void cmdInertialActuation(const char *args);
+static void cmdLightTracker(const char *args);
 /* Parasite board commands */
 static void cmdParasiteOn(const char *args);
 static void cmdParasiteOff(const char *args);
@@ -110,6 +149,7 @@ static const char cmdBLDCRPMStr[] = "bldcrpm";
 static const char cmdSMAStr[] = "sma";
 /* Mechanical brake commands */
 static const char cmdSimpleBrakeStr[] = "brake";
+static const char cmdBrakeProfileStr[] = "bprof";
 /* LED commands */
 static const char cmdLEDStr[] = "led";
 /* Faceboard commands */
@@ -128,6 +168,28 @@ static const char cmdFBRxAmbientStr[] = "fbrxamb";
 static const char cmdFBRxAmbientCountStr[] = "fbrxambcnt";
 static const char cmdFBRxEnableStr[] = "fbrxen";
 static const char cmdFBSleepStr[] = "fbsleep";
+/* IR communication commands */
+static const char cmdIRTxStr[] = "irtx";
+static const char cmdIRTxStatsStr[] = "irtxstat";
+static const char cmdNeighborsStr[] = "nbr";
+static const char cmdNeighborMapStr[] = "nbrmap";
+static const char cmdClusterTimeStr[] = "ctime";
+static const char cmdAtStr[] = "at";
+static const char cmdRPCStr[] = "rpc";
+static const char cmdXferStr[] = "xfer";
+static const char cmdXferStatsStr[] = "xferstat";
+static const char cmdGroupStr[] = "group";
+static const char cmdMulticastStr[] = "mcast";
+static const char cmdIRLinkStr[] = "irlink";
+static const char cmdLeaderStr[] = "leader";
+static const char cmdGradientStr[] = "gradient";
+static const char cmdFWUpStr[] = "fwup";
+static const char cmdLightStr[] = "light";
+static const char cmdBeaconStr[] = "beacon";
+static const char cmdProximityStr[] = "prox";
+static const char cmdDBStr[] = "db";
+static const char cmdTempStr[] = "temp";
+static const char cmdADCStr[] = "adc";
 /* IMU commands */
 static const char cmdIMUSelectStr[] = "imuselect";
 static const char cmdIMUInitStr[] = "imuinit";
@@ -142,6 +204,7 @@ static const char cmdEmptyStr[] = "";
 /* Motion commands */
 static const char cmdChangePlaneStr[] = "cp";
 static const char cmdInertialActuationStr[] = "ia";
+static const char cmdLightTrackerStr[] = "track";
 /* Parasite board commands */
 static const char cmdParasiteOnStr[] = "espon";
 static const char cmdParasiteOffStr[] = "espoff";
@@ -163,6 +226,7 @@ static cmdFcnPair_t cmdTable[] = {
     {cmdSMAStr, cmdSMA },
     /* Mechanical brake commands */
     {cmdSimpleBrakeStr, cmdSimpleBrake},
+    {cmdBrakeProfileStr, cmdBrakeProfile},
     /* LED commands */
     {cmdLEDStr, cmdLED },
     /* Faceboard commands */
@@ -181,6 +245,28 @@ static cmdFcnPair_t cmdTable[] = {
     {cmdFBRxAmbientCountStr, cmdFBRxAmbientCount},
     {cmdFBRxAmbientStr, cmdFBRxAmbient},
     {cmdFBSleepStr, cmdFBSleep},
+    /* IR communication commands */
+    {cmdIRTxStr, cmdIRTx},
+    {cmdIRTxStatsStr, cmdIRTxStats},
+    {cmdNeighborsStr, cmdNeighbors},
+    {cmdNeighborMapStr, cmdNeighborMap},
+    {cmdClusterTimeStr, cmdClusterTime},
+    {cmdAtStr, cmdAt},
+    {cmdRPCStr, cmdRPC},
+    {cmdXferStr, cmdXfer},
+    {cmdXferStatsStr, cmdXferStats},
+    {cmdGroupStr, cmdGroup},
+    {cmdMulticastStr, cmdMulticast},
+    {cmdIRLinkStr, cmdIRLink},
+    {cmdLeaderStr, cmdLeader},
+    {cmdGradientStr, cmdGradient},
+    {cmdFWUpStr, cmdFWUp},
+    {cmdLightStr, cmdLight},
+    {cmdBeaconStr, cmdBeacon},
+    {cmdProximityStr, cmdProximity},
+    {cmdDBStr, cmdDB},
+    {cmdTempStr, cmdTemp},
+    {cmdADCStr, cmdADC},
     /* IMU commands */
     {cmdIMUSelectStr, cmdIMUSelect},
     {cmdIMUInitStr, cmdIMUInit},
@@ -194,6 +280,7 @@ static cmdFcnPair_t cmdTable[] = {
     /* Motion commands */
     {cmdChangePlaneStr, cmdChangePlane },
     {cmdInertialActuationStr, cmdInertialActuation },
+    {cmdLightTrackerStr, cmdLightTracker },
     /* Parasite board commands */
     {cmdParasiteOnStr, cmdParasiteOn},
     {cmdParasiteOffStr, cmdParasiteOff},
@@ -204,6 +291,9 @@ static cmdFcnPair_t cmdTable[] = {
 /* Callbacks for printing status info after command completion */
 static void cmdMotionPrimitiveHandler(void *p_event_data, uint16_t event_size);
 static void cmdMotionEventHandler(void *p_event_data, uint16_t event_size);
+static void cmdLightEventHandler(void *p_event_data, uint16_t event_size);
+static void cmdProximityEventHandler(void *p_event_data, uint16_t event_size);
+static void cmdDBCompletionHandler(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength);
 
 void commands_init() {
     cmdline_loadCmds(cmdTable);
@@ -250,7 +340,37 @@ void cmdVersion(const char *args) {
 /* Power management commands */
 /*****************************/
 void cmdVBat(const char *args) {
-    power_printBatteryVoltages();
+    char str[80];
+    unsigned int maxAge_ms;
+    power_batteryStats_t stats;
+    int nArgs;
+
+    nArgs = sscanf(args, "%10s %u", str, &maxAge_ms);
+
+    if (nArgs == -1) {
+	power_printBatteryVoltages();
+    } else if (strncmp(str, "stat", 4) == 0) {
+	power_getBatteryStats(&stats);
+	snprintf(str, sizeof(str), "Battery scans: %u blocking, %u background, cell reads: %u\r\n",
+		 stats.blockingScans, stats.backgroundScans, stats.cellReads);
+	app_uart_put_string(str);
+	snprintf(str, sizeof(str), "Charge updates: %u, last: %u scans/%u cell reads, max: %u scans\r\n",
+		 stats.chargeUpdates, stats.lastUpdateScans, stats.lastUpdateCellReads, stats.maxUpdateScans);
+	app_uart_put_string(str);
+    } else if (strncmp(str, "clear", 5) == 0) {
+	power_clearBatteryStats();
+	app_uart_put_string("Battery statistics cleared\r\n");
+    } else if (strncmp(str, "maxage", 6) == 0) {
+	if ((nArgs == 2) && !power_setBatterySnapshotMaxAge_ms(maxAge_ms)) {
+	    snprintf(str, sizeof(str), "Maximum age must be %u to %ums\r\n",
+		     POWER_BATTERY_SNAPSHOT_MIN_MAX_AGE_MS, POWER_BATTERY_SNAPSHOT_MAX_MAX_AGE_MS);
+	    app_uart_put_string(str);
+	    return;
+	}
+	snprintf(str, sizeof(str), "Battery snapshot maximum age: %ums\r\n",
+		 power_getBatterySnapshotMaxAge_ms());
+	app_uart_put_string(str);
+    }
 }
 
 void cmdCharge(const char *args) {
@@ -384,10 +504,11 @@ void cmdBLDCStop(const char *args) {
 /****************/
 void cmdSMA(const char *args) {
     int nArgs;
-    char str[32];
+    char str[80];
     unsigned int uintTemp;
 
     smaState_t smaState;
+    smaStatus_t smaStatus;
 
     nArgs = sscanf(args, "%20s %u", str, &uintTemp);
 
@@ -411,7 +532,34 @@ void cmdSMA(const char *args) {
 	return;
     }
 
-    if (strncmp(str, "retractcurrent", 14) == 0) {
+    if ((nArgs == 1) && (strncmp(str, "stat", 4) == 0)) {
+	sma_getStatus(&smaStatus);
+	snprintf(str, sizeof(str), "SMA drive: %umA (%u/%u), hold remaining: %ums\r\n",
+		 smaStatus.driveCurrent_mA, smaStatus.onPeriod, smaStatus.period,
+		 smaStatus.holdTimeRemaining_ms);
+	app_uart_put_string(str);
+	snprintf(str, sizeof(str), "SMA actuations: %u, timer wake-ups: %u\r\n",
+		 smaStatus.actuations, smaStatus.timerWakeups);
+	app_uart_put_string(str);
+	snprintf(str, sizeof(str), "SMA model: %s, wire %d.%dC%s, clamps: %u\r\n",
+		 smaStatus.modelEnabled ? "on" : "off",
+		 smaStatus.wireTemp_tenthDegC / 10, abs(smaStatus.wireTemp_tenthDegC % 10),
+		 smaStatus.modelSettled ? " (settled)" : "", smaStatus.modelClamps);
+	app_uart_put_string(str);
+	snprintf(str, sizeof(str), "SMA last retract: %ums, recovery: %ums\r\n",
+		 smaStatus.retractTime_ms, smaStatus.recoveryTime_ms);
+	app_uart_put_string(str);
+    } else if ((nArgs == 1) && (strncmp(str, "clear", 5) == 0)) {
+	sma_clearStats();
+	app_uart_put_string("SMA statistics cleared\r\n");
+    } else if (strncmp(str, "model", 5) == 0) {
+	if (nArgs == 2) {
+	    sma_setModelEnabled(uintTemp != 0);
+	}
+	snprintf(str, sizeof(str), "SMA thermal model is %s\r\n",
+		 sma_isModelEnabled() ? "on" : "off");
+	app_uart_put_string(str);
+    } else if (strncmp(str, "retractcurrent", 14) == 0) {
 	if (nArgs == 2) {
 	    if (sma_setRetractCurrent_mA(uintTemp)) {
 		snprintf(str, sizeof(str),
@@ -430,12 +578,28 @@ void cmdSMA(const char *args) {
 		snprintf(str, sizeof(str), "SMA retract time set to %ums\r\n",
 			 sma_getRetractTime_ms());
 		app_uart_put_string(str);
+	    } else {
+		app_uart_put_string("SMA retract time out of range\r\n");
 	    }
 	} else {
 	    snprintf(str, sizeof(str), "SMA retract time is %ums\r\n",
 		     sma_getRetractTime_ms());
 	    app_uart_put_string(str);
 	}
+    } else if (strncmp(str, "recoverytime", 12) == 0) {
+	if (nArgs == 2) {
+	    if (sma_setRecoveryTime_ms(uintTemp)) {
+		snprintf(str, sizeof(str), "SMA recovery time set to %ums\r\n",
+			 sma_getRecoveryTime_ms());
+		app_uart_put_string(str);
+	    } else {
+		app_uart_put_string("SMA recovery time out of range\r\n");
+	    }
+	} else {
+	    snprintf(str, sizeof(str), "SMA recovery time is %ums\r\n",
+		     sma_getRecoveryTime_ms());
+	    app_uart_put_string(str);
+	}
     } else if (strncmp(str, "holdcurrent", 11) == 0) {
 	if (nArgs == 2) {
 	    if (sma_setHoldCurrent_mA(uintTemp)) {
@@ -448,6 +612,18 @@ void cmdSMA(const char *args) {
 		     sma_getHoldCurrent_mA());
 	    app_uart_put_string(str);
 	}
+    } else if (strncmp(str, "releasecurrent", 14) == 0) {
+	if (nArgs == 2) {
+	    if (sma_setReleaseCurrent_mA(uintTemp)) {
+		snprintf(str, sizeof(str), "SMA release current set to %umA\r\n",
+			 sma_getReleaseCurrent_mA());
+		app_uart_put_string(str);
+	    }
+	} else {
+	    snprintf(str, sizeof(str), "SMA release current is %umA\r\n",
+		     sma_getReleaseCurrent_mA());
+	    app_uart_put_string(str);
+	}
     } else if ((nArgs == 2) && (strncmp(str, "retract", 7) == 0)) {
 	if (sma_retract(uintTemp, cmdMotionPrimitiveHandler)) {
 	    snprintf(str, sizeof(str),
@@ -465,10 +641,67 @@ void cmdSMA(const char *args) {
 /* Mechanical brake commands */
 /*****************************/
 void cmdSimpleBrake(const char *args) {
-    char str[5];
+    char str[6];
+    char dirStr[2];
     unsigned int params[2];
     uint16_t current_mA, time_ms;
     coilCurrentStep_t step;
+    coilCurrentStep_t steps[BRAKEPROFILE_MAX_STEPS];
+    uint8_t stepCount;
+    int nArgs;
+    mechbrakeStats_t stats;
+    uint16_t settleTime_ms;
+    uint8_t imuReads;
+    char statStr[120];
+
+    /* brake stat [clear] */
+    if ((sscanf(args, "%5s", str) == 1) && (strcmp(str, "stat") == 0)) {
+	if ((sscanf(args, "%5s %5s", str, statStr) == 2) && (strcmp(statStr, "clear") == 0)) {
+	    mechbrake_clearStats();
+	}
+
+	mechbrake_getStats(&stats);
+	snprintf(statStr, sizeof(statStr), "%u actuations%s, %u failures, %u timeouts, %lu status reads\r\n",
+		stats.actuations, stats.active ? " (active)" : "", stats.failures, stats.timeouts,
+		(unsigned long)stats.polls);
+	app_uart_put_string(statStr);
+	snprintf(statStr, sizeof(statStr), "Last: steps %u ms, completion confirmed after %u ms with %u reads\r\n",
+		stats.lastExpected_ms, stats.lastCompletion_ms, stats.lastPolls);
+	app_uart_put_string(statStr);
+
+	motionEvent_getLastSettle(&settleTime_ms, &imuReads);
+	snprintf(statStr, sizeof(statStr), "Last e-brake plane change: stable %u ms after e-brake, %u IMU reads\r\n",
+		settleTime_ms, imuReads);
+	app_uart_put_string(statStr);
+	return;
+    }
+
+    if ((nArgs = sscanf(args, "%5s %u %1s", str, &params[0], dirStr)) < 2) {
+	return;
+    }
+
+    if (strncmp(str, "p", 1) == 0) {
+	/* The profile is scaled for the flywheel speed, so must be read before
+	 * the motor is stopped. */
+	stepCount = 0;
+	if (params[0] < BRAKEPROFILE_COUNT) {
+	    stepCount = brakeprofile_getSteps(params[0], (nArgs == 3) && (dirStr[0] == 'r'),
+					      steps, BRAKEPROFILE_MAX_STEPS);
+	}
+	if (stepCount == 0) {
+	    app_uart_put_string("No such brake profile\r\n");
+	    return;
+	}
+
+	bldc_setSpeed(0, false, 0, NULL );
+
+	if (mechbrake_actuate(stepCount, steps, cmdMotionPrimitiveHandler)) {
+	    app_uart_put_string("Activating mechanical brake...\r\n");
+	} else {
+	    db_sleep(true);
+	}
+	return;
+    }
 
     if (sscanf(args, "%5s %u %u", str, &params[0], &params[1]) < 2) {
 	return;
@@ -504,12 +737,161 @@ void cmdSimpleBrake(const char *args) {
     }
 }
 
+void cmdBrakeProfile(const char *args) {
+    char actionStr[9];
+    char nameStr[BRAKEPROFILE_NAME_LENGTH];
+    unsigned int id, speed_rpm;
+    int currents_mA[BRAKEPROFILE_MAX_STEPS];
+    unsigned int times_ms[BRAKEPROFILE_MAX_STEPS];
+    int nArgs;
+    uint8_t i, first, last;
+    brakeProfile_t profile;
+    brakeProfileStats_t stats;
+    brakeProfileStatus_t status;
+    char str[100];
+
+    /* bprof [save | defaults | clear] */
+    nArgs = sscanf(args, "%8s", actionStr);
+    first = 0;
+    last = BRAKEPROFILE_COUNT - 1;
+
+    if ((nArgs == 1) && (strcmp(actionStr, "save") == 0)) {
+	if (brakeprofile_save()) {
+	    app_uart_put_string("Saving brake profiles...\r\n");
+	} else {
+	    app_uart_put_string("Flash busy, try again\r\n");
+	}
+	return;
+    } else if ((nArgs == 1) && (strcmp(actionStr, "defaults") == 0)) {
+	brakeprofile_restoreDefaults();
+    } else if ((nArgs == 1) && (strcmp(actionStr, "clear") == 0)) {
+	brakeprofile_clearStats();
+    } else if ((nArgs == 1) && (sscanf(args, "%u %8s", &id, actionStr) >= 1)) {
+	/* bprof <id> [set <speed> <current> <time> [<current> <time> ...] |
+	 *             name <name> | adapt on|off] */
+	if (id >= BRAKEPROFILE_COUNT) {
+	    app_uart_put_string("No such brake profile\r\n");
+	    return;
+	}
+	first = last = id;
+
+	nArgs = sscanf(args, "%u %8s", &id, actionStr);
+	brakeprofile_get(id, &profile);
+
+	if ((nArgs == 2) && (strcmp(actionStr, "set") == 0)) {
+	    nArgs = sscanf(args, "%u %8s %u %d %u %d %u %d %u %d %u", &id, actionStr, &speed_rpm,
+			   &currents_mA[0], &times_ms[0], &currents_mA[1], &times_ms[1],
+			   &currents_mA[2], &times_ms[2], &currents_mA[3], &times_ms[3]);
+	    if ((nArgs < 5) || ((nArgs - 3) % 2 != 0)) {
+		return;
+	    }
+
+	    profile.speed_rpm = speed_rpm;
+	    profile.battery_mV = power_getBatteryPackVoltage_mV();
+	    if (profile.battery_mV == 0) {
+		profile.battery_mV = BRAKEPROFILE_DEFAULT_BATTERY_MV;
+	    }
+	    profile.stepCount = (nArgs - 3) / 2;
+	    profile.scale_percent = 100;
+	    for (i = 0; i < profile.stepCount; i++) {
+		profile.steps[i].current_mA = currents_mA[i];
+		profile.steps[i].time_ms = times_ms[i];
+	    }
+	} else if ((nArgs == 2) && (strcmp(actionStr, "name") == 0)) {
+	    if (sscanf(args, "%u %8s %7s", &id, actionStr, nameStr) != 3) {
+		return;
+	    }
+	    strncpy(profile.name, nameStr, BRAKEPROFILE_NAME_LENGTH);
+	} else if ((nArgs == 2) && (strcmp(actionStr, "adapt") == 0)) {
+	    if (sscanf(args, "%u %8s %3s", &id, actionStr, nameStr) != 3) {
+		return;
+	    }
+	    profile.adaptive = (strcmp(nameStr, "on") == 0);
+	    if (!profile.adaptive) {
+		profile.scale_percent = 100;
+	    }
+	}
+
+	if ((nArgs == 2) && !brakeprofile_set(id, &profile)) {
+	    app_uart_put_string("Brake profile not changed\r\n");
+	}
+    }
+
+    for (id = first; id <= last; id++) {
+	brakeprofile_get(id, &profile);
+	brakeprofile_getStats(id, &stats);
+
+	snprintf(str, sizeof(str), "%u %s: %u rpm at %u mV,", id, profile.name, profile.speed_rpm, profile.battery_mV);
+	app_uart_put_string(str);
+	for (i = 0; i < profile.stepCount; i++) {
+	    snprintf(str, sizeof(str), " %d mA/%u ms", profile.steps[i].current_mA, profile.steps[i].time_ms);
+	    app_uart_put_string(str);
+	}
+	if (profile.adaptive) {
+	    snprintf(str, sizeof(str), ", adaptive (%u%%)\r\n", profile.scale_percent);
+	} else {
+	    snprintf(str, sizeof(str), "\r\n");
+	}
+	app_uart_put_string(str);
+
+	if (stats.uses > 0) {
+	    snprintf(str, sizeof(str), "  %u uses (last at %u rpm, %u mV): %u tipped, %u did not tip, %u tumbled\r\n",
+		    stats.uses, stats.lastSpeed_rpm, stats.lastBattery_mV, stats.tips, stats.noTips, stats.tumbles);
+	    app_uart_put_string(str);
+	}
+    }
+
+    brakeprofile_getStatus(&status);
+    snprintf(str, sizeof(str), "%s; %u unsaved adaptive changes%s; %u saves, %u failures\r\n",
+	    status.loaded ? "Loaded from flash" : "Defaults", status.unsavedChanges,
+	    status.saving ? ", saving" : "", status.saves, status.saveFailures);
+    app_uart_put_string(str);
+}
+
 /****************/
 /* LED Commands */
 /****************/
 void cmdLED(const char *args) {
-    char str[50];
+    char str[80];
     unsigned int ledNum, ledState;
+    unsigned int durations[LED_MAX_SEGMENTS];
+    led_segment_t segments[LED_MAX_SEGMENTS];
+    led_status_t status;
+    int nArgs;
+    uint8_t i;
+
+    if (strncmp(args, "stat", 4) == 0) {
+	led_getStatus(&status);
+	snprintf(str, sizeof(str), "LED timer: %s, wake-ups: %u, transitions: %u\r\n",
+		 status.timerRunning ? "running" : "stopped", status.timerWakeups, status.transitions);
+	app_uart_put_string(str);
+	snprintf(str, sizeof(str), "LED duty (0.1%%): %lu %lu %lu\r\n",
+		 (unsigned long)led_getDutyCycle_permille(LED_RED),
+		 (unsigned long)led_getDutyCycle_permille(LED_GREEN),
+		 (unsigned long)led_getDutyCycle_permille(LED_BLUE));
+	app_uart_put_string(str);
+	return;
+    } else if (strncmp(args, "clear", 5) == 0) {
+	led_clearStats();
+	app_uart_put_string("LED statistics cleared\r\n");
+	return;
+    }
+
+    /* "led <n> p <on ms> <off ms> ..." sets a custom pattern of alternating
+     * on and off segments. */
+    nArgs = sscanf(args, "%u p %u %u %u %u %u %u %u %u", &ledNum, &durations[0], &durations[1],
+		   &durations[2], &durations[3], &durations[4], &durations[5], &durations[6], &durations[7]);
+    if (nArgs >= 2) {
+	for (i = 0; i < nArgs - 1; i++) {
+	    segments[i].on = ((i % 2) == 0);
+	    segments[i].duration_ms = durations[i];
+	}
+	if (led_setPattern(ledNum, segments, nArgs - 1)) {
+	    snprintf(str, sizeof(str), "Led %u pattern set (%u segments)\r\n", ledNum, nArgs - 1);
+	    app_uart_put_string(str);
+	}
+	return;
+    }
 
     if (sscanf(args, "%u %u", &ledNum, &ledState) != 2) {
 	return;
@@ -1099,131 +1481,963 @@ void cmdFBSleep(const char *args) {
     }
 }
 
-/****************/
-/* IMU commands */
-/****************/
-
-void cmdIMUSelect(const char *args) {
-    int nArgs;
-    char imuStr[2];
+/*****************************/
+/* IR communication commands */
+/*****************************/
+void cmdIRTx(const char *args) {
+    unsigned int faceNum;
+    char priorityStr[2];
+    char txData[MAX_CMDSTR_LEN];
+    irtxPriority_t priority;
     char str[100];
 
-    nArgs = sscanf(args, "%1s", imuStr);
+    if (sscanf(args, "%u %1s %[^\t\n]", &faceNum, priorityStr, txData) != 3) {
+	return;
+    }
 
-    if (nArgs == 1) {
-	if ((imuStr[0] == 'c') || (imuStr[0] == 'C')) {
-	    mpu6050_setAddress(MPU6050_I2C_ADDR_CENTRAL);
-	} else if ((imuStr[0] == 'f') || (imuStr[0] == 'F')) {
-	    mpu6050_setAddress(MPU6050_I2C_ADDR_FACE);
+    if (faceNum > 6) {
+	return;
+    }
+
+    if (priorityStr[0] == 'c') {
+	priority = IRTX_PRIORITY_CONTROL;
+    } else if (priorityStr[0] == 'b') {
+	priority = IRTX_PRIORITY_BULK;
+    } else {
+	return;
+    }
+
+    if (irtx_queueString(faceNum, priority, txData)) {
+	snprintf(str, sizeof(str), "Queued %u bytes for IR transmission\r\n", (unsigned int)strlen(txData));
+    } else {
+	snprintf(str, sizeof(str), "Insufficient IR transmit queue space\r\n");
+    }
+
+    app_uart_put_string(str);
+}
+
+void cmdIRTxStats(const char *args) {
+    unsigned int faceNum;
+    irtxStats_t stats;
+    char clearStr[6];
+    char macStr[4];
+    char str[140];
+
+    if ((sscanf(args, "%5s", clearStr) == 1) && (strncmp(clearStr, "clear", 5) == 0)) {
+	irtx_clearStats();
+	app_uart_put_string("IR transmit statistics cleared\r\n");
+	return;
+    }
+
+    if (sscanf(args, "mac %3s", macStr) == 1) {
+	if (strncmp(macStr, "on", 3) == 0) {
+	    irtx_setMACEnabled(true);
+	} else if (strncmp(macStr, "off", 3) == 0) {
+	    irtx_setMACEnabled(false);
+	} else {
+	    app_uart_put_string("Usage: irtxstat [clear | mac on|off]\r\n");
+	    return;
 	}
     }
 
-    snprintf(str, sizeof(str), "Active IMU: %s\r\n", mpu6050_getName());
+    snprintf(str, sizeof(str), "Medium access %s, %u slots of %u ms, %lu drain timer wake-ups\r\n",
+	    irtx_isMACEnabled() ? "on" : "off", IRTX_MAC_SLOT_COUNT, IRTX_MAC_SLOT_MS,
+	    (unsigned long)irtx_getTimerWakeups());
     app_uart_put_string(str);
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	irtx_getStats(faceNum, &stats);
+	snprintf(str, sizeof(str), "Face %u: slot %u, %lu bytes in %lu chunks, %u queued, %u dropped, %u full, %u errors, %u busy, %u backoffs\r\n",
+		faceNum, irtx_getSlot(faceNum), (unsigned long)stats.bytesSent, (unsigned long)stats.chunksSent,
+		stats.messagesQueued, stats.messagesDropped, stats.bufferFullCount, stats.twiErrorCount,
+		stats.carrierBusyCount, stats.backoffCount);
+	app_uart_put_string(str);
+    }
 }
 
-void cmdIMUInit(const char *args) {
-    bool mpu6050Initialized;
-    bool dmpInitialized;
+void cmdNeighbors(const char *args) {
+    uint8_t faceNum;
+    neighbor_t neighbor;
+    uint32_t age_ms;
     char str[100];
 
-    snprintf(str, sizeof(str), "Re-initializing %s IMU...\r\n", mpu6050_getName());
+    snprintf(str, sizeof(str), "Node ID: %04x\r\n", getNodeID());
     app_uart_put_string(str);
 
-    mpu6050Initialized = imu_init();
-    dmpInitialized = imu_initDMP();
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if (neighbor_get(faceNum, &neighbor)) {
+	    age_ms = curr_time_ms() - neighbor.lastSeen_ms;
+	    snprintf(str, sizeof(str), "Face %u: %04x (face %u), quality %u%%, seen %lu ms ago, gravity (%d, %d, %d)\r\n",
+		    faceNum, neighbor.id, neighbor.face, neighbor.quality_percent, (unsigned long)age_ms,
+		    neighbor.gravity[0], neighbor.gravity[1], neighbor.gravity[2]);
+	} else {
+	    snprintf(str, sizeof(str), "Face %u: none\r\n", faceNum);
+	}
+	app_uart_put_string(str);
+    }
 
-    if (mpu6050Initialized) {
-	app_uart_put_string("  MPU-6050: OK\r\n");
-    } else {
-    	app_uart_put_string("  MPU-6050: Fail\r\n");
+    snprintf(str, sizeof(str), "Map responses dropped: %u\r\n", neighbor_getMapFramesDropped());
+    app_uart_put_string(str);
+}
+
+void cmdNeighborMap(const char *args) {
+    char targetStr[5];
+    unsigned int target = NEIGHBOR_MAP_TARGET_ALL;
+
+    /* nbrmap [id] */
+    if ((sscanf(args, "%4s", targetStr) == 1) && (sscanf(targetStr, "%x", &target) != 1)) {
+	app_uart_put_string("Invalid module ID\r\n");
+	return;
     }
 
-    if (dmpInitialized) {
-    	app_uart_put_string("  DMP: OK\r\n");
-    } else {
-    	app_uart_put_string("  DMP: Fail\r\n");
+    if (!neighbor_startMapQuery(target)) {
+	app_uart_put_string("Neighbor discovery is not running\r\n");
     }
 }
 
-void cmdIMUGravityInt(const char *args) {
-  char str[200];
-  vector16_t v16;
+void cmdClusterTime(const char *args) {
+    timesyncStatus_t status;
+    char str[100];
 
-  if (!imu_getGravity16(&v16)) {
-    snprintf(str, sizeof(str), "FAILED\r\n");
+    timesync_getStatus(&status);
+
+    snprintf(str, sizeof(str), "Cluster time: %lu ms (%s)\r\n", (unsigned long)timesync_getClusterTime_ms(),
+	    status.synchronized ? "synchronized" : "not synchronized");
     app_uart_put_string(str);
-    return;
-  }
 
-  snprintf(str, sizeof(str), "imugravityi: %d %d %d\r\n", v16.x, v16.y, v16.z);
-  app_uart_put_string(str);
+    if (status.parentFace == 0) {
+	snprintf(str, sizeof(str), "Root: %04x (this module), %u command(s) scheduled\r\n",
+		status.rootID, timesync_getScheduledCount());
+    } else {
+	snprintf(str, sizeof(str), "Root: %04x, %u hop(s) via face %u, %u command(s) scheduled\r\n",
+		status.rootID, status.hops, status.parentFace, timesync_getScheduledCount());
+    }
+    app_uart_put_string(str);
+
+    snprintf(str, sizeof(str), "Offset: %ld ms, skew: %d ppm, last RTT: %lu ms, last sync: %lu ms ago\r\n",
+	    (long)status.offset_ms, (int)status.skew_ppm, (unsigned long)status.lastRTT_ms,
+	    (unsigned long)status.lastSyncAge_ms);
+    app_uart_put_string(str);
 }
 
-void cmdIMUGravityFloat(const char *args) {
-  char str[200];
-  vectorFloat_t gravity;
+void cmdAt(const char *args) {
+    unsigned long time_ms;
+    int cmdStart = 0;
+    bool relative = false;
+    char str[100];
 
-  if (!imu_getGravityFloat(&gravity)) {
-    snprintf(str, sizeof(str), "FAILED\r\n");
-    app_uart_put_string(str);
-    return;
-  }
+    /* at [+]<clusterTime_ms> <command> */
+    while (*args == ' ') {
+	args++;
+    }
 
-  snprintf(str, sizeof(str), "imugravityf: %f %f %f\r\n", gravity.x, gravity.y, gravity.z);
-  app_uart_put_string(str);
-}
+    if (*args == '+') {
+	relative = true;
+	args++;
+    }
 
-void cmdIMUGravity(const char *args) {
-    char str[200];
-    vector16_t v16;
+    if (sscanf(args, "%lu %n", &time_ms, &cmdStart) != 1) {
+	return;
+    }
 
-    if (!imu_getGravity16(&v16)) {
-	snprintf(str, sizeof(str), "Failed to read gravity vector from %s IMU\r\n", mpu6050_getName());
-	app_uart_put_string(str);
+    if (cmdStart == 0) {
 	return;
     }
 
-    snprintf(str, sizeof(str), "Gravity vector (int) of %s IMU: [%d %d %d]\r\n", mpu6050_getName(), v16.x, v16.y, v16.z);
+    if (strncmp(&args[cmdStart], "cancel", 6) == 0) {
+	timesync_cancelScheduled();
+	app_uart_put_string("Cancelled all scheduled commands\r\n");
+	return;
+    }
+
+    if (relative) {
+	time_ms += timesync_getClusterTime_ms();
+    }
+
+    if (timesync_scheduleCommand((uint32_t)time_ms, &args[cmdStart])) {
+	snprintf(str, sizeof(str), "Scheduled \"%s\" at cluster time %lu ms\r\n", &args[cmdStart], time_ms);
+    } else {
+	snprintf(str, sizeof(str), "Failed to schedule command\r\n");
+    }
     app_uart_put_string(str);
+}
 
-#if (1)
-    uint8_t i;
-    vectorFloat_t gravity;
-    float angleDiff;
+/**@brief Prints each response to a call made with the "rpc" command, one
+ * line at a time, prefixed by the ID of the responding module.
+ */
+static void cmdRPCCallback(uint8_t callID, uint16_t responder, rpcStatus_t status, const char *output) {
+    char str[24];
+    char line[RPC_MAX_OUTPUT_LEN + 1];
+    const char *p_line;
+    const char *p_end;
+    size_t len;
+
+    if ((status == RPC_STATUS_TIMEOUT) && (responder == RPC_TARGET_ALL)) {
+	snprintf(str, sizeof(str), "RPC %u done\r\n", callID);
+	app_uart_put_string(str);
+	return;
+    }
 
-    if (!imu_getGravityFloat(&gravity)) {
+    snprintf(str, sizeof(str), "[%04x] ", responder);
+
+    if ((status != RPC_STATUS_OK) && (status != RPC_STATUS_TRUNCATED)) {
+	app_uart_put_string(str);
+	app_uart_put_string(rpc_getStatusString(status));
+	app_uart_put_string("\r\n");
 	return;
     }
 
-    snprintf(str, sizeof(str), "Gravity vector (float) of %s IMU: [%f %f %f]\r\n", mpu6050_getName(), gravity.x, gravity.y, gravity.z);
-    app_uart_put_string(str);
+    for (p_line = output; ; p_line = p_end + 1) {
+	p_end = strchr(p_line, '\n');
+	len = (p_end != NULL) ? (size_t)(p_end - p_line) : strlen(p_line);
+	if (len >= sizeof(line)) {
+	    len = sizeof(line) - 1;
+	}
+	memcpy(line, p_line, len);
+	line[len] = '\0';
 
-    for (i=0; i<3; i++) {
-	angleDiff = fabs(imu_getVectorFloatAngle(&gravity, &frameAlignmentVectorsFloat[i]));
+	app_uart_put_string(str);
+	app_uart_put_string(line);
+	app_uart_put_string("\r\n");
 
-	snprintf(str, sizeof(str), "Angle between gravity vector (%s IMU) and [%f %f %f]: %f degrees\r\n",
-		 mpu6050_getName(),
-		 frameAlignmentVectorsFloat[i].x, frameAlignmentVectorsFloat[i].y, frameAlignmentVectorsFloat[i].z,
-		 angleDiff);
+	if (p_end == NULL) {
+	    break;
+	}
+    }
+
+    if (status == RPC_STATUS_TRUNCATED) {
 	app_uart_put_string(str);
+	app_uart_put_string("(output truncated)\r\n");
     }
-#endif
 }
 
-/****************/
-/* BLE Commands */
-/****************/
+void cmdRPC(const char *args) {
+    char targetStr[5];
+    unsigned int target;
+    int cmdStart = 0;
+    uint8_t callID;
+    char str[48];
 
-void cmdBLEDiscon(const char *args) {
-    uint32_t err_code;
+    /* rpc <target|all> <command> */
+    if ((sscanf(args, "%4s %n", targetStr, &cmdStart) != 1) || (cmdStart == 0)) {
+	app_uart_put_string("Usage: rpc <id|all> <command>\r\n");
+	return;
+    }
 
-    if (m_sps.conn_handle == BLE_CONN_HANDLE_INVALID) {
-	app_uart_put_string("BLE not connected\r\n");
+    if (strcmp(targetStr, "all") == 0) {
+	target = RPC_TARGET_ALL;
+    } else if (sscanf(targetStr, "%x", &target) != 1) {
+	app_uart_put_string("Invalid module ID\r\n");
 	return;
     }
 
-    app_uart_put_string("BLE disconnecting\r\n");
+    if (rpc_call(target, &args[cmdStart], RPC_DEFAULT_TIMEOUT_MS, cmdRPCCallback, &callID)) {
+	snprintf(str, sizeof(str), "RPC %u sent\r\n", callID);
+    } else {
+	snprintf(str, sizeof(str), "Failed to send RPC\r\n");
+    }
+    app_uart_put_string(str);
+}
+
+static void cmdXferCallback(uint8_t faceNum, const xferResult_t *p_result) {
+    char str[100];
+    unsigned long bytesPerSec = 0;
+
+    if (!p_result->success) {
+	snprintf(str, sizeof(str), "Transfer on face %u failed after %lu ms\r\n", faceNum, (unsigned long)p_result->elapsed_ms);
+	app_uart_put_string(str);
+	return;
+    }
+
+    if (p_result->elapsed_ms > 0) {
+	bytesPerSec = 1000UL * p_result->numBytes / p_result->elapsed_ms;
+    }
+
+    snprintf(str, sizeof(str), "Sent %u bytes on face %u in %lu ms (%lu bytes/s), %u of %u fragments retransmitted\r\n",
+	    p_result->numBytes, faceNum, (unsigned long)p_result->elapsed_ms, bytesPerSec,
+	    p_result->fragmentsRetransmitted, p_result->fragmentsSent);
+    app_uart_put_string(str);
+}
+
+void cmdXfer(const char *args) {
+    /* The start of the application's vector table, defined by the startup
+     * code, gives us a payload in flash that costs no RAM. */
+    extern const uint8_t __Vectors[];
+    unsigned int faceNum;
+    unsigned int numBytes = XFER_MAX_SIZE;
+    char str[60];
+
+    /* xfer <face> [bytes] */
+    if (sscanf(args, "%u %u", &faceNum, &numBytes) < 1) {
+	app_uart_put_string("Usage: xfer <face> [bytes]\r\n");
+	return;
+    }
+
+    if ((numBytes == 0) || (numBytes > XFER_MAX_SIZE)) {
+	snprintf(str, sizeof(str), "Transfer size must be between 1 and %u bytes\r\n", XFER_MAX_SIZE);
+	app_uart_put_string(str);
+	return;
+    }
+
+    if (xfer_send(faceNum, __Vectors, numBytes, cmdXferCallback)) {
+	snprintf(str, sizeof(str), "Sending %u bytes on face %u\r\n", numBytes, faceNum);
+    } else {
+	snprintf(str, sizeof(str), "Failed to start transfer\r\n");
+    }
+    app_uart_put_string(str);
+}
+
+void cmdXferStats(const char *args) {
+    xferStats_t stats;
+    char clearStr[6];
+    char str[100];
+
+    if ((sscanf(args, "%5s", clearStr) == 1) && (strncmp(clearStr, "clear", 5) == 0)) {
+	xfer_clearStats();
+	app_uart_put_string("Transfer statistics cleared\r\n");
+	return;
+    }
+
+    xfer_getStats(&stats);
+
+    snprintf(str, sizeof(str), "Sent: %u transfers (%lu bytes), %u failed, %u fragments (%u retransmitted)\r\n",
+	    stats.transfersSent, (unsigned long)stats.bytesSent, stats.transfersFailed,
+	    stats.fragmentsSent, stats.fragmentsRetransmitted);
+    app_uart_put_string(str);
+
+    snprintf(str, sizeof(str), "Received: %u transfers (%lu bytes), %u fragments, %u CRC errors, %u overflows\r\n",
+	    stats.transfersReceived, (unsigned long)stats.bytesReceived, stats.fragmentsReceived,
+	    stats.crcErrors, stats.rxOverflows);
+    app_uart_put_string(str);
+}
+
+void cmdGroup(const char *args) {
+    char actionStr[6];
+    char groupStr[4];
+    unsigned int group;
+    groupStats_t stats;
+    int nArgs;
+    char str[100];
+
+    /* group [join <n> | leave <n|all> | clear] */
+    nArgs = sscanf(args, "%5s %3s", actionStr, groupStr);
+
+    if ((nArgs == 1) && (strcmp(actionStr, "clear") == 0)) {
+	group_clearStats();
+	app_uart_put_string("Group statistics cleared\r\n");
+	return;
+    } else if ((nArgs == 2) && (strcmp(actionStr, "leave") == 0) && (strcmp(groupStr, "all") == 0)) {
+	group_leaveAll();
+    } else if (nArgs == 2) {
+	if ((sscanf(groupStr, "%u", &group) != 1) || (group >= GROUP_COUNT)) {
+	    snprintf(str, sizeof(str), "Groups are numbered 0 to %u\r\n", GROUP_COUNT - 1);
+	    app_uart_put_string(str);
+	    return;
+	}
+
+	if (strcmp(actionStr, "join") == 0) {
+	    group_join(group);
+	} else if (strcmp(actionStr, "leave") == 0) {
+	    group_leave(group);
+	} else {
+	    app_uart_put_string("Usage: group [join <n> | leave <n|all> | clear]\r\n");
+	    return;
+	}
+    } else if (nArgs > 0) {
+	app_uart_put_string("Usage: group [join <n> | leave <n|all> | clear]\r\n");
+	return;
+    }
+
+    snprintf(str, sizeof(str), "Member of groups (bitmap): %04x\r\n", group_getMembership());
+    app_uart_put_string(str);
+
+    for (group = 0; group < GROUP_COUNT; group++) {
+	group_getStats(group, &stats);
+	if (!group_isMember(1 << group) && (stats.sent == 0) && (stats.delivered == 0) && (stats.relayed == 0)) {
+	    continue;
+	}
+
+	snprintf(str, sizeof(str), "Group %u%s: %u sent, %u delivered, %u relayed\r\n", group,
+		group_isMember(1 << group) ? " (member)" : "", stats.sent, stats.delivered, stats.relayed);
+	app_uart_put_string(str);
+    }
+}
+
+void cmdMulticast(const char *args) {
+    char groupsStr[40];
+    const char *p_group;
+    unsigned int group;
+    uint16_t groupMask = 0x0000;
+    int cmdStart = 0;
+
+    /* mcast <n[,n...]|all> <command> */
+    if ((sscanf(args, "%39s %n", groupsStr, &cmdStart) != 1) || (cmdStart == 0)) {
+	app_uart_put_string("Usage: mcast <n[,n...]|all> <command>\r\n");
+	return;
+    }
+
+    if (strcmp(groupsStr, "all") == 0) {
+	groupMask = GROUP_MASK_ALL;
+    } else {
+	for (p_group = groupsStr; p_group != NULL; p_group = strchr(p_group, ',')) {
+	    if (*p_group == ',') {
+		p_group++;
+	    }
+
+	    if ((sscanf(p_group, "%u", &group) != 1) || (group >= GROUP_COUNT)) {
+		app_uart_put_string("Invalid group\r\n");
+		return;
+	    }
+
+	    groupMask |= (1 << group);
+	}
+    }
+
+    if (!group_sendCommand(groupMask, &args[cmdStart])) {
+	app_uart_put_string("Failed to send multicast\r\n");
+    }
+}
+
+void cmdIRLink(const char *args) {
+    char probeStr[6];
+    unsigned int faceNum = 0;
+    irlinkStatus_t status;
+    char str[120];
+
+    /* irlink [probe [face]] */
+    if ((sscanf(args, "%5s %u", probeStr, &faceNum) >= 1) && (strcmp(probeStr, "probe") == 0)) {
+	if ((faceNum <= 6) && irlink_startProbe(faceNum)) {
+	    app_uart_put_string("Probing IR link(s)\r\n");
+	} else {
+	    app_uart_put_string("No neighbor to probe\r\n");
+	}
+	return;
+    }
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	irlink_getStatus(faceNum, &status);
+	snprintf(str, sizeof(str), "Face %u: quality %u%%, %u frames (%u corrupt, %u duplicate), ambient %u +/- %u, ",
+		faceNum, status.quality_percent, status.framesReceived, status.framesCorrupt, status.duplicates,
+		status.ambient, status.noise);
+	app_uart_put_string(str);
+
+	if (status.probing) {
+	    snprintf(str, sizeof(str), "probing\r\n");
+	} else if (status.txLEDs == 0x00) {
+	    snprintf(str, sizeof(str), "not probed\r\n");
+	} else {
+	    snprintf(str, sizeof(str), "LEDs %c%c%c%c (%u%% delivered)\r\n",
+		    (status.txLEDs & 0x01) ? '1' : '-', (status.txLEDs & 0x02) ? '2' : '-',
+		    (status.txLEDs & 0x04) ? '3' : '-', (status.txLEDs & 0x08) ? '4' : '-',
+		    status.probeDelivery_percent);
+	}
+	app_uart_put_string(str);
+    }
+}
+
+void cmdLeader(const char *args) {
+    char actionStr[6];
+    leaderStatus_t status;
+    char str[120];
+
+    /* leader [elect|clear] */
+    if (sscanf(args, "%5s", actionStr) == 1) {
+	if (strcmp(actionStr, "elect") == 0) {
+	    leader_startElection();
+	    app_uart_put_string("Starting election\r\n");
+	    return;
+	} else if (strcmp(actionStr, "clear") == 0) {
+	    leader_clearStats();
+	}
+    }
+
+    leader_getStatus(&status);
+
+    if (!status.haveLeader) {
+	snprintf(str, sizeof(str), "No leader (epoch %u)\r\n", status.epoch);
+    } else if (leader_isLeader()) {
+	snprintf(str, sizeof(str), "Leader: %04x (self), epoch %u\r\n", status.leaderID, status.epoch);
+    } else {
+	snprintf(str, sizeof(str), "Leader: %04x, epoch %u, %u hops, last heartbeat %lu ms ago\r\n",
+		status.leaderID, status.epoch, status.hops, (unsigned long)status.lastHeartbeatAge_ms);
+    }
+    app_uart_put_string(str);
+
+    snprintf(str, sizeof(str), "Converged in %lu ms; %u elections, %u leader changes, %u heartbeats sent, %u relayed\r\n",
+	    (unsigned long)status.convergence_ms, status.electionsStarted, status.leaderChanges,
+	    status.heartbeatsSent, status.heartbeatsRelayed);
+    app_uart_put_string(str);
+}
+
+void cmdGradient(const char *args) {
+    char actionStr[6];
+    char seedStr[4];
+    gradientStatus_t status;
+    uint8_t faceNum;
+    char str[120];
+
+    /* gradient [seed on|off | clear] */
+    if (sscanf(args, "%5s %3s", actionStr, seedStr) >= 1) {
+	if ((strcmp(actionStr, "seed") == 0) && (strcmp(seedStr, "on") == 0)) {
+	    gradient_setSeed(true);
+	} else if ((strcmp(actionStr, "seed") == 0) && (strcmp(seedStr, "off") == 0)) {
+	    gradient_setSeed(false);
+	} else if (strcmp(actionStr, "clear") == 0) {
+	    gradient_clearStats();
+	}
+    }
+
+    gradient_getStatus(&status);
+
+    if (status.isSeed) {
+	snprintf(str, sizeof(str), "Seed, refresh %u\r\n", status.seq);
+    } else if (status.hops == GRADIENT_INFINITY) {
+	snprintf(str, sizeof(str), "No seed reachable\r\n");
+    } else {
+	snprintf(str, sizeof(str), "%u hops from seed %04x via face %u, refresh %u\r\n",
+		status.hops, status.seedID, status.parentFace, status.seq);
+    }
+    app_uart_put_string(str);
+
+    app_uart_put_string("Neighbors:");
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if (status.neighborHops[faceNum - 1] == GRADIENT_INFINITY) {
+	    snprintf(str, sizeof(str), " %u:-", faceNum);
+	} else {
+	    snprintf(str, sizeof(str), " %u:%u", faceNum, status.neighborHops[faceNum - 1]);
+	}
+	app_uart_put_string(str);
+    }
+
+    snprintf(str, sizeof(str), "\r\nLast changed %lu ms ago; %u changes, %u updates sent, %u received, %u rejected\r\n",
+	    (unsigned long)status.lastChangeAge_ms, status.changes, status.updatesSent,
+	    status.updatesReceived, status.updatesRejected);
+    app_uart_put_string(str);
+}
+
+void cmdFWUp(const char *args) {
+    char actionStr[9];
+    char autoStr[5];
+    int nArgs;
+    irdfuStatus_t status;
+    char str[150];
+
+    /* fwup [start [auto] | stop | activate | clear] */
+    nArgs = sscanf(args, "%8s %4s", actionStr, autoStr);
+    if (nArgs >= 1) {
+	if (strcmp(actionStr, "start") == 0) {
+	    if (!irdfu_startOffering((nArgs == 2) && (strcmp(autoStr, "auto") == 0))) {
+		app_uart_put_string("Image too large to send over IR\r\n");
+		return;
+	    }
+	} else if (strcmp(actionStr, "stop") == 0) {
+	    irdfu_stop();
+	} else if (strcmp(actionStr, "activate") == 0) {
+	    app_uart_put_string("Activating staged firmware...\r\n");
+	    nrf_delay_ms(10);
+	    if (!irdfu_activate()) {
+		app_uart_put_string("No newer firmware staged\r\n");
+	    }
+	    return;
+	} else if (strcmp(actionStr, "clear") == 0) {
+	    irdfu_clearStats();
+	}
+    }
+
+    irdfu_getStatus(&status);
+
+    snprintf(str, sizeof(str), "Running: version %04x, %lu bytes, CRC %04x\r\n",
+	    status.runningVersion, (unsigned long)status.runningSize, status.runningCRC);
+    app_uart_put_string(str);
+
+    if (status.staged) {
+	snprintf(str, sizeof(str), "Staged: version %04x, %lu bytes, CRC %04x, %u/%u pages%s%s\r\n",
+		status.stagedVersion, (unsigned long)status.stagedSize, status.stagedCRC,
+		status.pagesDone, status.pagesTotal, status.stagedComplete ? ", complete" : "",
+		status.stagedAutoActivate ? ", auto-activate" : "");
+    } else {
+	snprintf(str, sizeof(str), "Staged: none\r\n");
+    }
+    app_uart_put_string(str);
+
+    snprintf(str, sizeof(str), "%s; receiving on face %u, sending on face %u\r\n",
+	    status.offering ? "Offering" : "Not offering", status.rxFace, status.txFace);
+    app_uart_put_string(str);
+
+    snprintf(str, sizeof(str), "Chunks: %u sent, %u received, %u rejected; %u pages written, %u CRC errors, %u resumes, %u flash errors\r\n",
+	    status.chunksSent, status.chunksReceived, status.chunksRejected, status.pagesWritten,
+	    status.pageCRCErrors, status.resumes, status.flashErrors);
+    app_uart_put_string(str);
+}
+
+void cmdLight(const char *args) {
+    char actionStr[7];
+    unsigned int arg1, arg2;
+    int nArgs;
+    uint8_t faceNum;
+    lightStatus_t status;
+    char str[150];
+
+    /* light [start [interval] | stop | thresh <face> <level> | clear] */
+    nArgs = sscanf(args, "%6s %u %u", actionStr, &arg1, &arg2);
+    if (nArgs >= 1) {
+	if (strcmp(actionStr, "start") == 0) {
+	    if (!light_start((nArgs >= 2) ? arg1 : LIGHT_DEFAULT_INTERVAL_MS)) {
+		snprintf(str, sizeof(str), "Interval must be at least %u ms\r\n", LIGHT_MIN_INTERVAL_MS);
+		app_uart_put_string(str);
+		return;
+	    }
+	} else if (strcmp(actionStr, "stop") == 0) {
+	    light_stop();
+	} else if ((strcmp(actionStr, "thresh") == 0) && (nArgs == 3)) {
+	    if (!light_setThreshold(arg1, arg2, cmdLightEventHandler)) {
+		app_uart_put_string("Invalid face\r\n");
+		return;
+	    }
+	} else if (strcmp(actionStr, "clear") == 0) {
+	    light_clearStats();
+	}
+    }
+
+    if (light_isRunning()) {
+	snprintf(str, sizeof(str), "Sampling every %u ms\r\n", light_getInterval());
+    } else {
+	snprintf(str, sizeof(str), "Not sampling\r\n");
+    }
+    app_uart_put_string(str);
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	light_getStatus(faceNum, &status);
+	if (status.count == 0) {
+	    snprintf(str, sizeof(str), "Face %u: no samples, %u errors\r\n", faceNum, status.twiErrorCount);
+	} else {
+	    snprintf(str, sizeof(str), "Face %u: latest %u, min %u, max %u, mean %u, filtered %u, threshold %u; %u batch reads, %u single reads, %u errors\r\n",
+		    faceNum, status.latest, status.min, status.max, status.mean, status.filtered,
+		    status.threshold, status.batchReads, status.singleReads, status.twiErrorCount);
+	}
+	app_uart_put_string(str);
+    }
+}
+
+void cmdBeacon(const char *args) {
+    char actionStr[6];
+    unsigned int frequency_hz;
+    int nArgs;
+    uint8_t faceNum;
+    beaconFaceStatus_t status;
+    int16_t bearing[3];
+    char str[120];
+
+    /* beacon [start [frequency] | stop] */
+    nArgs = sscanf(args, "%5s %u", actionStr, &frequency_hz);
+    if (nArgs >= 1) {
+	if (strcmp(actionStr, "start") == 0) {
+	    if (!beacon_start((nArgs >= 2) ? frequency_hz : BEACON_DEFAULT_FREQUENCY_HZ)) {
+		snprintf(str, sizeof(str), "Frequency must be a multiple of %u Hz from %u to %u Hz, away from mains flicker\r\n",
+			BEACON_BIN_WIDTH_HZ, BEACON_MIN_FREQUENCY_HZ, BEACON_MAX_FREQUENCY_HZ);
+		app_uart_put_string(str);
+		return;
+	    }
+	} else if (strcmp(actionStr, "stop") == 0) {
+	    beacon_stop();
+	}
+    }
+
+    if (!beacon_isRunning()) {
+	app_uart_put_string("Not looking for a beacon\r\n");
+	return;
+    }
+
+    snprintf(str, sizeof(str), "Looking for a beacon at %u Hz\r\n", beacon_getFrequency());
+    app_uart_put_string(str);
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	beacon_getFaceStatus(faceNum, &status);
+	snprintf(str, sizeof(str), "Face %u: %s, signal %u, noise %u, flicker %u; %u blocks\r\n", faceNum,
+		status.detected ? "detected" : "not detected", status.signal, status.noise, status.flicker, status.blocks);
+	app_uart_put_string(str);
+    }
+
+    faceNum = beacon_getBearing(bearing);
+    if (faceNum == 0) {
+	app_uart_put_string("No bearing\r\n");
+    } else {
+	snprintf(str, sizeof(str), "Bearing: (%d, %d, %d), strongest on face %u\r\n", bearing[0], bearing[1], bearing[2], faceNum);
+	app_uart_put_string(str);
+    }
+}
+
+void cmdProximity(const char *args) {
+    char actionStr[7];
+    unsigned int arg;
+    int nArgs;
+    uint8_t faceNum;
+    proximityStatus_t status;
+    char str[150];
+
+    /* prox [start [interval] | stop | thresh <level> | clear] */
+    nArgs = sscanf(args, "%6s %u", actionStr, &arg);
+    if (nArgs >= 1) {
+	if (strcmp(actionStr, "start") == 0) {
+	    if (!proximity_start((nArgs >= 2) ? arg : PROXIMITY_DEFAULT_INTERVAL_MS)) {
+		snprintf(str, sizeof(str), "Interval must be at least %u ms\r\n", PROXIMITY_MIN_INTERVAL_MS);
+		app_uart_put_string(str);
+		return;
+	    }
+	} else if (strcmp(actionStr, "stop") == 0) {
+	    proximity_stop();
+	} else if ((strcmp(actionStr, "thresh") == 0) && (nArgs == 2)) {
+	    proximity_setThreshold(arg, cmdProximityEventHandler);
+	} else if (strcmp(actionStr, "clear") == 0) {
+	    proximity_clearStats();
+	}
+    }
+
+    if (proximity_isRunning()) {
+	snprintf(str, sizeof(str), "Scanning every %u ms, threshold %u\r\n", proximity_getInterval(), proximity_getThreshold());
+    } else {
+	snprintf(str, sizeof(str), "Not scanning, threshold %u\r\n", proximity_getThreshold());
+    }
+    app_uart_put_string(str);
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	proximity_getStatus(faceNum, &status);
+	if (!status.valid) {
+	    snprintf(str, sizeof(str), "Face %u: not scanned, %u skipped, %u errors\r\n", faceNum, status.skipped, status.twiErrorCount);
+	} else {
+	    snprintf(str, sizeof(str), "Face %u: %s, proximity %u (off %u, on %u); %u scans, %u skipped, %u errors\r\n",
+		    faceNum, status.blocked ? "blocked" : "clear", status.proximity, status.off, status.on,
+		    status.scans, status.skipped, status.twiErrorCount);
+	}
+	app_uart_put_string(str);
+    }
+}
+
+void cmdDB(const char *args) {
+    char actionStr[6];
+    unsigned int red, green, blue;
+    int nArgs;
+    dbStats_t stats;
+    char str[150];
+
+    /* db [temp | led <r> <g> <b> | clear] */
+    nArgs = sscanf(args, "%5s %u %u %u", actionStr, &red, &green, &blue);
+    if (nArgs >= 1) {
+	if (strcmp(actionStr, "temp") == 0) {
+	    if (!db_requestTemp(cmdDBCompletionHandler)) {
+		app_uart_put_string("Daughterboard queue full\r\n");
+	    }
+	} else if ((strcmp(actionStr, "led") == 0) && (nArgs == 4)) {
+	    if (!db_requestLEDs(red != 0, green != 0, blue != 0, cmdDBCompletionHandler)) {
+		app_uart_put_string("Daughterboard queue full\r\n");
+	    }
+	} else if (strcmp(actionStr, "clear") == 0) {
+	    db_clearStats();
+	}
+    }
+
+    db_getStats(&stats);
+    snprintf(str, sizeof(str), "Daughterboard queue %s: %u requests, %u coalesced, %u polls, %u failures, %u timeouts, %u TWI errors, %u overflows\r\n",
+	    db_isIdle() ? "idle" : "busy", stats.requests, stats.coalesced, stats.polls, stats.failures, stats.timeouts,
+	    stats.twiErrorCount, stats.overflows);
+    app_uart_put_string(str);
+
+    snprintf(str, sizeof(str), "Expected latency: temperature %u ms, LEDs %u ms\r\n",
+	    db_getLatency(DB_TEMPERATURE_CMD), db_getLatency(DB_LED_CMD));
+    app_uart_put_string(str);
+}
+
+void cmdADC(const char *args) {
+    char actionStr[6];
+    int nArgs;
+    adcStats_t stats;
+    char str[100];
+
+    /* adc [clear] */
+    nArgs = sscanf(args, "%5s", actionStr);
+    if ((nArgs == 1) && (strcmp(actionStr, "clear") == 0)) {
+	adc_clearStats();
+    }
+
+    adc_getStats(&stats);
+
+    snprintf(str, sizeof(str), "ADC: %u sequences, %lu conversions, %u dropped, %u blocking waits%s\r\n",
+	    stats.sequences, (unsigned long)stats.conversions, stats.dropped, stats.blockingWaits,
+	    adc_isBusy() ? " (busy)" : "");
+    app_uart_put_string(str);
+}
+
+void cmdTemp(const char *args) {
+    char actionStr[6];
+    int nArgs;
+    thermalStatus_t status;
+    int16_t history[THERMAL_HISTORY_LENGTH];
+    uint8_t count, i;
+    char str[150];
+
+    /* temp [clear] */
+    nArgs = sscanf(args, "%5s", actionStr);
+    if ((nArgs == 1) && (strcmp(actionStr, "clear") == 0)) {
+	thermal_clearStats();
+    }
+
+    thermal_getStatus(&status);
+
+    if (status.interval_ms == 0) {
+	snprintf(str, sizeof(str), "Not sampling (idle); %u samples, %u failures\r\n", status.samples, status.failures);
+    } else {
+	snprintf(str, sizeof(str), "Sampling every %u ms; %u samples, %u failures\r\n",
+		status.interval_ms, status.samples, status.failures);
+    }
+    app_uart_put_string(str);
+
+    if (!status.valid) {
+	app_uart_put_string("No recent temperature\r\n");
+	return;
+    }
+
+    snprintf(str, sizeof(str), "Temperature: %d.%d C (latest %d.%d C, %lu ms ago)%s%s, derating %u%%\r\n",
+	    status.filtered_tenthDegC / 10, abs(status.filtered_tenthDegC % 10),
+	    status.latest_tenthDegC / 10, abs(status.latest_tenthDegC % 10), (unsigned long)status.age_ms,
+	    status.overtemp ? ", OVERTEMP" : "", status.undertemp ? ", UNDERTEMP" : "", status.derating_percent);
+    app_uart_put_string(str);
+
+    count = thermal_getHistory(history, THERMAL_HISTORY_LENGTH);
+    app_uart_put_string("History:");
+    for (i = 0; i < count; i++) {
+	snprintf(str, sizeof(str), " %d.%d", history[i] / 10, abs(history[i] % 10));
+	app_uart_put_string(str);
+    }
+    snprintf(str, sizeof(str), " (min %d.%d, max %d.%d)\r\n", status.min_tenthDegC / 10, abs(status.min_tenthDegC % 10),
+	    status.max_tenthDegC / 10, abs(status.max_tenthDegC % 10));
+    app_uart_put_string(str);
+}
+
+/****************/
+/* IMU commands */
+/****************/
+
+void cmdIMUSelect(const char *args) {
+    int nArgs;
+    char imuStr[2];
+    char str[100];
+
+    nArgs = sscanf(args, "%1s", imuStr);
+
+    if (nArgs == 1) {
+	if ((imuStr[0] == 'c') || (imuStr[0] == 'C')) {
+	    mpu6050_setAddress(MPU6050_I2C_ADDR_CENTRAL);
+	} else if ((imuStr[0] == 'f') || (imuStr[0] == 'F')) {
+	    mpu6050_setAddress(MPU6050_I2C_ADDR_FACE);
+	}
+    }
+
+    snprintf(str, sizeof(str), "Active IMU: %s\r\n", mpu6050_getName());
+    app_uart_put_string(str);
+}
+
+void cmdIMUInit(const char *args) {
+    bool mpu6050Initialized;
+    bool dmpInitialized;
+    char str[100];
+
+    snprintf(str, sizeof(str), "Re-initializing %s IMU...\r\n", mpu6050_getName());
+    app_uart_put_string(str);
+
+    mpu6050Initialized = imu_init();
+    dmpInitialized = imu_initDMP();
+
+    if (mpu6050Initialized) {
+	app_uart_put_string("  MPU-6050: OK\r\n");
+    } else {
+    	app_uart_put_string("  MPU-6050: Fail\r\n");
+    }
+
+    if (dmpInitialized) {
+    	app_uart_put_string("  DMP: OK\r\n");
+    } else {
+    	app_uart_put_string("  DMP: Fail\r\n");
+    }
+}
+
+void cmdIMUGravityInt(const char *args) {
+  char str[200];
+  vector16_t v16;
+
+  if (!imu_getGravity16(&v16)) {
+    snprintf(str, sizeof(str), "FAILED\r\n");
+    app_uart_put_string(str);
+    return;
+  }
+
+  snprintf(str, sizeof(str), "imugravityi: %d %d %d\r\n", v16.x, v16.y, v16.z);
+  app_uart_put_string(str);
+}
+
+void cmdIMUGravityFloat(const char *args) {
+  char str[200];
+  vectorFloat_t gravity;
+
+  if (!imu_getGravityFloat(&gravity)) {
+    snprintf(str, sizeof(str), "FAILED\r\n");
+    app_uart_put_string(str);
+    return;
+  }
+
+  snprintf(str, sizeof(str), "imugravityf: %f %f %f\r\n", gravity.x, gravity.y, gravity.z);
+  app_uart_put_string(str);
+}
+
+void cmdIMUGravity(const char *args) {
+    char str[200];
+    vector16_t v16;
+
+    if (!imu_getGravity16(&v16)) {
+	snprintf(str, sizeof(str), "Failed to read gravity vector from %s IMU\r\n", mpu6050_getName());
+	app_uart_put_string(str);
+	return;
+    }
+
+    snprintf(str, sizeof(str), "Gravity vector (int) of %s IMU: [%d %d %d]\r\n", mpu6050_getName(), v16.x, v16.y, v16.z);
+    app_uart_put_string(str);
+
+#if (1)
+    uint8_t i;
+    vectorFloat_t gravity;
+    float angleDiff;
+
+    if (!imu_getGravityFloat(&gravity)) {
+	return;
+    }
+
+    snprintf(str, sizeof(str), "Gravity vector (float) of %s IMU: [%f %f %f]\r\n", mpu6050_getName(), gravity.x, gravity.y, gravity.z);
+    app_uart_put_string(str);
+
+    for (i=0; i<3; i++) {
+	angleDiff = fabs(imu_getVectorFloatAngle(&gravity, &frameAlignmentVectorsFloat[i]));
+
+	snprintf(str, sizeof(str), "Angle between gravity vector (%s IMU) and [%f %f %f]: %f degrees\r\n",
+		 mpu6050_getName(),
+		 frameAlignmentVectorsFloat[i].x, frameAlignmentVectorsFloat[i].y, frameAlignmentVectorsFloat[i].z,
+		 angleDiff);
+	app_uart_put_string(str);
+    }
+#endif
+}
+
+/****************/
+/* BLE Commands */
+/****************/
+
+void cmdBLEDiscon(const char *args) {
+    uint32_t err_code;
+
+    if (m_sps.conn_handle == BLE_CONN_HANDLE_INVALID) {
+	app_uart_put_string("BLE not connected\r\n");
+	return;
+    }
+
+    app_uart_put_string("BLE disconnecting\r\n");
     err_code = sd_ble_gap_disconnect(m_sps.conn_handle,
 				     BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
     APP_ERROR_CHECK(err_code);
@@ -1325,6 +2539,17 @@ void cmdInertialActuation(const char *args) {
     bool reverse;
     bool eBrake, accel;
     bool accelReverse = false;
+    unsigned int profileID;
+
+    /* ia p <profile> [f|r] */
+    if (((nArg = sscanf(args, "%1s %u %1s", dirStr, &profileID, eBrakeAccelStr)) >= 2) && (dirStr[0] == 'p')) {
+	reverse = (nArg == 3) && (eBrakeAccelStr[0] == 'r');
+	if ((profileID < BRAKEPROFILE_COUNT) &&
+		motionEvent_startProfileInertialActuation(profileID, reverse, cmdMotionEventHandler)) {
+	    app_uart_put_string("Starting inertial actuation...\r\n");
+	}
+	return;
+    }
 
     if ((nArg = sscanf(args, "%1s %u %u %u %1s %u %1s", dirStr, &bldcSpeed_rpm,
 		       &brakeCurrent_mA, &brakeTime_ms,
@@ -1368,6 +2593,67 @@ void cmdInertialActuation(const char *args) {
     }
 }
 
+void cmdLightTracker(const char *args) {
+    int nArg;
+    char typeStr[5];
+    unsigned int bldcSpeed_rpm_f, brakeCurrent_mA_f, brakeTime_ms_f;
+    unsigned int bldcSpeed_rpm_r, brakeCurrent_mA_r, brakeTime_ms_r;
+    unsigned int threshold;
+    unsigned int maxSteps = 10;
+    char profileStr[2];
+    unsigned int profileID_f, profileID_r;
+
+    if ((sscanf(args, "%4s", typeStr) == 1) && (strcmp(typeStr, "stop") == 0)) {
+	motionEvent_stopLightTracker();
+	app_uart_put_string("Stopping light tracker\r\n");
+	return;
+    }
+
+    /* track <s|a> p <profileF> <profileR> <threshold> [maxSteps] */
+    if ((sscanf(args, "%1s %1s %u %u %u %u", typeStr, profileStr, &profileID_f, &profileID_r,
+		&threshold, &maxSteps) >= 5) && (profileStr[0] == 'p')) {
+	if (((typeStr[0] != 's') && (typeStr[0] != 'a')) ||
+		(profileID_f >= BRAKEPROFILE_COUNT) || (profileID_r >= BRAKEPROFILE_COUNT)) {
+	    return;
+	}
+
+	if (maxSteps > UINT8_MAX) {
+	    maxSteps = UINT8_MAX;
+	}
+
+	if (motionEvent_startProfileLightTracker(typeStr[0] == 's', profileID_f, profileID_r,
+						 threshold, maxSteps, cmdMotionEventHandler)) {
+	    app_uart_put_string("Starting light tracker...\r\n");
+	} else {
+	    app_uart_put_string("Light tracker already running\r\n");
+	}
+	return;
+    }
+
+    if ((nArg = sscanf(args, "%1s %u %u %u %u %u %u %u %u", typeStr,
+		       &bldcSpeed_rpm_f, &brakeCurrent_mA_f, &brakeTime_ms_f,
+		       &bldcSpeed_rpm_r, &brakeCurrent_mA_r, &brakeTime_ms_r,
+		       &threshold, &maxSteps)) < 8) {
+	return;
+    }
+
+    if ((typeStr[0] != 's') && (typeStr[0] != 'a')) {
+	return;
+    }
+
+    if (maxSteps > UINT8_MAX) {
+	maxSteps = UINT8_MAX;
+    }
+
+    if (motionEvent_startLightTracker(typeStr[0] == 's', bldcSpeed_rpm_f, brakeCurrent_mA_f, brakeTime_ms_f,
+				      bldcSpeed_rpm_r, brakeCurrent_mA_r, brakeTime_ms_r,
+				      threshold, maxSteps, cmdMotionEventHandler)) {
+	app_uart_put_string("Starting light tracker...\r\n");
+    } else {
+	app_uart_put_string("Light tracker already running\r\n");
+    }
+}
+
 /****************************/
 /*  Parasite board commands */
 /****************************/
@@ -1473,7 +2759,57 @@ void cmdMotionEventHandler(void *p_event_data, uint16_t event_size) {
     case MOTION_EVENT_INERTIAL_ACTUATION_FAILURE:
 	app_uart_put_string("Inertial actuation failure\r\n");
 	break;
+    case MOTION_EVENT_LIGHT_TRACKER_COMPLETE:
+	app_uart_put_string("Light tracker reached light gradient threshold\r\n");
+	break;
+    case MOTION_EVENT_LIGHT_TRACKER_STEP_LIMIT:
+	app_uart_put_string("Light tracker reached step limit\r\n");
+	break;
+    case MOTION_EVENT_LIGHT_TRACKER_OFF_PLANE:
+	app_uart_put_string("Light tracker stopped: light is across the plane of motion\r\n");
+	break;
+    case MOTION_EVENT_LIGHT_TRACKER_FAILURE:
+	app_uart_put_string("Light tracker failure\r\n");
+	break;
     default:
 	app_uart_put_string("Motion event not recognized\r\n");
     }
 }
+
+void cmdLightEventHandler(void *p_event_data, uint16_t event_size) {
+    lightEvent_t event;
+    char str[60];
+
+    event = *(lightEvent_t *) p_event_data;
+
+    snprintf(str, sizeof(str), "Face %u light %s threshold (%u)\r\n", event.faceNum,
+	    event.rising ? "rose above" : "fell below", event.level);
+    app_uart_put_string(str);
+}
+
+void cmdDBCompletionHandler(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength) {
+    int16_t temperature_tenthDegC;
+    char str[60];
+
+    if (!success) {
+	snprintf(str, sizeof(str), "Daughterboard command 0x%02X failed\r\n", cmd);
+    } else if ((cmd == DB_TEMPERATURE_CMD) && (responseLength >= 2)) {
+	temperature_tenthDegC = response[0] | (response[1] << 8);
+	snprintf(str, sizeof(str), "Daughterboard temperature: %d.%d C\r\n",
+		temperature_tenthDegC / 10, abs(temperature_tenthDegC % 10));
+    } else {
+	snprintf(str, sizeof(str), "Daughterboard command 0x%02X complete\r\n", cmd);
+    }
+    app_uart_put_string(str);
+}
+
+void cmdProximityEventHandler(void *p_event_data, uint16_t event_size) {
+    proximityEvent_t event;
+    char str[50];
+
+    event = *(proximityEvent_t *) p_event_data;
+
+    snprintf(str, sizeof(str), "Face %u %s (%u)\r\n", event.faceNum,
+	    event.blocked ? "blocked" : "clear", event.level);
+    app_uart_put_string(str);
+}
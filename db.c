@@ -12,11 +12,61 @@
 #include "nrf51.h"
 #include "nrf51_bitfields.h"
 
+#include "app_error.h"
+#include "app_timer.h"
+
+#include "global.h"
 #include "util.h"
 #include "twi_master_config.h"
 #include "twi_master.h"
 #include "db.h"
 
+/* Number of commands whose response latency is remembered */
+#define DB_LATENCY_ENTRIES			4
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t requestLength;
+    uint8_t request[DB_MAX_REQUEST_LENGTH];
+    uint8_t responseLength;
+    uint16_t timeout_ms;
+    uint8_t handlerCount;
+    dbCompletionHandler_t handlers[DB_MAX_HANDLERS];
+} dbRequest_t;
+
+typedef struct {
+    uint8_t cmd;
+    uint16_t latency_ms;
+} dbLatency_t;
+
+static bool initialized = false;
+static app_timer_id_t db_timerID = TIMER_NULL;
+static bool timerRunning = false;
+
+/* The request at the head of the queue is the one in flight, if any.  The
+ * daughterboard only works on one command at a time. */
+static dbRequest_t queue[DB_QUEUE_LENGTH];
+static uint8_t queueHead = 0;
+static uint8_t queueCount = 0;
+static bool inFlight = false;
+static bool suspended = false;
+
+static uint32_t sentTime_rtcTicks;
+static uint16_t pollInterval_ms;
+
+static dbLatency_t latencies[DB_LATENCY_ENTRIES];
+static uint8_t nextLatencyEntry = 0;
+
+static dbStats_t stats;
+
+static void db_timerHandler(void *p_context);
+static void db_startTimer(uint16_t interval_ms);
+static void db_kick(void);
+static uint16_t db_step(void);
+static void db_complete(bool success, const uint8_t *response);
+static uint32_t db_getElapsedTime(void);
+static void db_updateLatency(uint8_t cmd, uint16_t measured_ms);
+
 void db_reset() {
     NRF_TWI1->ENABLE = TWI_ENABLE_ENABLE_Disabled << TWI_ENABLE_ENABLE_Pos;
 
@@ -33,6 +83,8 @@ void db_reset() {
 bool db_sleep(bool sleepEnabled) {
     uint8_t twiBuf[2];
 
+    db_flush();
+
     twi_master_init();
 
     twiBuf[0] = DB_SLEEP_CMD;
@@ -48,8 +100,10 @@ bool db_sleep(bool sleepEnabled) {
     }
 
     /* After sending a sleep command, we do not attempt to read a response
-     * because doing so will wake-up the daughterboard processor. */
+     * because doing so will wake-up the daughterboard processor.  For the
+     * same reason, queued requests are held while it sleeps. */
     twi_master_deinit();
+    db_suspend(sleepEnabled);
     return true;
 }
 
@@ -58,6 +112,8 @@ bool db_getVersion(char *verStr, uint8_t verStrSize) {
     uint32_t time_ms;
     char *strPtr;
 
+    db_flush();
+
     twi_master_init();
 
     twiBuf[0] = DB_VERSION_CMD;
@@ -110,6 +166,8 @@ bool db_getTemp(int16_t *temperature_tenthDegC) {
     uint8_t twiBuf[4];
     uint32_t time_ms;
 
+    db_flush();
+
     twi_master_init();
 
     twiBuf[0] = DB_TEMPERATURE_CMD;
@@ -150,6 +208,8 @@ bool db_setLEDs(bool redOn, bool greenOn, bool blueOn) {
     uint8_t twiBuf[2];
     uint32_t time_ms;
 
+    db_flush();
+
     twi_master_init();
 
     twiBuf[0] = DB_LED_CMD;
@@ -198,3 +258,406 @@ bool db_setLEDs(bool redOn, bool greenOn, bool blueOn) {
     twi_master_deinit();
     return false;
 }
+
+void db_init() {
+    uint32_t err_code;
+
+    if (db_timerID == TIMER_NULL) {
+	err_code = app_timer_create(&db_timerID, APP_TIMER_MODE_SINGLE_SHOT, db_timerHandler);
+	APP_ERROR_CHECK(err_code);
+    }
+
+    initialized = true;
+    suspended = false;
+}
+
+/**@brief Stops the transaction engine.  Requests which have not completed
+ * are failed.
+ */
+void db_deinit() {
+    uint32_t err_code;
+
+    if (!initialized) {
+	return;
+    }
+
+    err_code = app_timer_stop(db_timerID);
+    APP_ERROR_CHECK(err_code);
+    timerRunning = false;
+
+    /* Handlers cannot queue new requests from here on. */
+    initialized = false;
+
+    while (queueCount > 0) {
+	db_complete(false, NULL);
+    }
+}
+
+/**@brief Queues a request for the daughterboard without waiting for it.
+ *
+ * The request is written to the daughterboard when it reaches the head of the
+ * queue, and the daughterboard is then polled from a timer, first after the
+ * time that the same command last took to complete, and then at increasing
+ * intervals, until it echoes the command code or the timeout expires.
+ *
+ * A request for a command which is already queued shares that request instead
+ * of taking a place in the queue.  If the queued request has not yet been
+ * sent, its data is replaced, so that, e.g., only the latest of several LED
+ * settings is sent.  A request which is in flight is only shared if its data
+ * is the same.
+ *
+ * @param[in] cmd             Command code.
+ * @param[in] requestLength   Number of data bytes following the command code.
+ * @param[in] request         Data bytes.
+ * @param[in] responseLength  Number of data bytes expected in the response,
+ *                            following the command code and status byte.
+ * @param[in] timeout_ms      Time allowed for the daughterboard to respond.
+ * @param[in] handler         Handler called on completion, or NULL.
+ *
+ * @return False if the engine is not initialized, the request is too long, or
+ *         the queue is full.
+ */
+bool db_request(uint8_t cmd, uint8_t requestLength, const uint8_t *request, uint8_t responseLength,
+	uint16_t timeout_ms, dbCompletionHandler_t handler) {
+    dbRequest_t *p_request;
+    bool sameRequest;
+    uint8_t i, h;
+
+    if (!initialized || (requestLength > DB_MAX_REQUEST_LENGTH) || (responseLength > DB_MAX_RESPONSE_LENGTH)) {
+	return false;
+    }
+
+    for (i = 0; i < queueCount; i++) {
+	p_request = &queue[(queueHead + i) % DB_QUEUE_LENGTH];
+	if ((p_request->cmd != cmd) || (p_request->responseLength != responseLength)) {
+	    continue;
+	}
+
+	sameRequest = (p_request->requestLength == requestLength) &&
+		((requestLength == 0) || (memcmp(p_request->request, request, requestLength) == 0));
+	if ((i == 0) && inFlight && !sameRequest) {
+	    continue;
+	}
+
+	for (h = 0; h < p_request->handlerCount; h++) {
+	    if (p_request->handlers[h] == handler) {
+		break;
+	    }
+	}
+	if ((h == p_request->handlerCount) && (handler != NULL)) {
+	    if (p_request->handlerCount == DB_MAX_HANDLERS) {
+		continue;
+	    }
+	    p_request->handlers[p_request->handlerCount++] = handler;
+	}
+
+	if (!sameRequest) {
+	    p_request->requestLength = requestLength;
+	    memcpy(p_request->request, request, requestLength);
+	}
+	if (timeout_ms > p_request->timeout_ms) {
+	    p_request->timeout_ms = timeout_ms;
+	}
+
+	stats.coalesced++;
+	return true;
+    }
+
+    if (queueCount == DB_QUEUE_LENGTH) {
+	stats.overflows++;
+	return false;
+    }
+
+    p_request = &queue[(queueHead + queueCount) % DB_QUEUE_LENGTH];
+    p_request->cmd = cmd;
+    p_request->requestLength = requestLength;
+    memcpy(p_request->request, request, requestLength);
+    p_request->responseLength = responseLength;
+    p_request->timeout_ms = timeout_ms;
+    p_request->handlerCount = 0;
+    if (handler != NULL) {
+	p_request->handlers[p_request->handlerCount++] = handler;
+    }
+    queueCount++;
+
+    stats.requests++;
+
+    db_kick();
+
+    return true;
+}
+
+/**@brief Requests the daughterboard's temperature.  The response holds the
+ * temperature in tenths of a degree Celsius, least significant byte first.
+ */
+bool db_requestTemp(dbCompletionHandler_t handler) {
+    return db_request(DB_TEMPERATURE_CMD, 0, NULL, 2, DB_TEMPERATURE_TIMEOUT_MS, handler);
+}
+
+bool db_requestLEDs(bool redOn, bool greenOn, bool blueOn, dbCompletionHandler_t handler) {
+    uint8_t leds = 0x00;
+
+    if (redOn) {
+	leds |= 0x01;
+    }
+
+    if (greenOn) {
+	leds |= 0x02;
+    }
+
+    if (blueOn) {
+	leds |= 0x04;
+    }
+
+    return db_request(DB_LED_CMD, 1, &leds, 0, DB_LED_TIMEOUT_MS, handler);
+}
+
+/**@brief Completes the request in flight (if any), waiting for it with
+ * delay_ms().
+ *
+ * The blocking functions above call this first, so that their exchanges with
+ * the daughterboard are not interleaved with a queued request's.  The other
+ * queued requests are sent from the timer once the caller has returned to the
+ * scheduler, which bounds the time spent blocked here by a single request's
+ * timeout (see SCHED_QUEUE_SIZE in main.c).  It must not be called from a
+ * completion handler.
+ */
+void db_flush() {
+    uint32_t err_code;
+    uint16_t wait_ms;
+
+    if (!initialized) {
+	return;
+    }
+
+    if (timerRunning) {
+	err_code = app_timer_stop(db_timerID);
+	APP_ERROR_CHECK(err_code);
+	timerRunning = false;
+    }
+
+    while (inFlight && ((wait_ms = db_step()) != 0) && inFlight) {
+	delay_ms(wait_ms);
+    }
+
+    db_kick();
+}
+
+/**@brief Holds back queued requests (after any in flight has completed) while
+ * another module, such as the mechanical brake, is exchanging data with the
+ * daughterboard itself.
+ */
+void db_suspend(bool suspend) {
+    suspended = suspend;
+
+    if (!suspended) {
+	db_kick();
+    }
+}
+
+bool db_isIdle() {
+    return (queueCount == 0);
+}
+
+/**@brief Returns the time which the given command is expected to take, as
+ * learned from previous requests.
+ */
+uint16_t db_getLatency(uint8_t cmd) {
+    uint8_t i;
+
+    for (i = 0; i < DB_LATENCY_ENTRIES; i++) {
+	if ((latencies[i].cmd == cmd) && (latencies[i].latency_ms > 0)) {
+	    return latencies[i].latency_ms;
+	}
+    }
+
+    return DB_POLL_FIRST_INTERVAL_MS;
+}
+
+void db_getStats(dbStats_t *p_stats) {
+    *p_stats = stats;
+}
+
+void db_clearStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+void db_timerHandler(void *p_context) {
+    uint16_t wait_ms;
+
+    if (!initialized || !timerRunning) {
+	return;
+    }
+
+    timerRunning = false;
+
+    wait_ms = db_step();
+    if (wait_ms != 0) {
+	db_startTimer(wait_ms);
+    }
+}
+
+void db_startTimer(uint16_t interval_ms) {
+    uint32_t err_code;
+    uint32_t ticks = APP_TIMER_TICKS(interval_ms, APP_TIMER_PRESCALER);
+
+    if (ticks < APP_TIMER_MIN_TIMEOUT_TICKS) {
+	ticks = APP_TIMER_MIN_TIMEOUT_TICKS;
+    }
+
+    err_code = app_timer_start(db_timerID, ticks, NULL);
+    APP_ERROR_CHECK(err_code);
+
+    timerRunning = true;
+}
+
+/**@brief Starts the engine if it has requests waiting.  The first step is
+ * taken from the timer, so that a request made from a completion handler does
+ * not re-enter the engine.
+ */
+void db_kick() {
+    if (initialized && !timerRunning && !suspended && (queueCount > 0)) {
+	db_startTimer(0);
+    }
+}
+
+/**@brief Sends the request at the head of the queue, or polls for its
+ * response if it has already been sent.
+ *
+ * @return Time until the next step, or 0 if there is nothing to do.
+ */
+uint16_t db_step() {
+    uint8_t twiBuf[2 + DB_MAX_RESPONSE_LENGTH];
+    dbRequest_t *p_request;
+    uint32_t elapsed_ms;
+    uint16_t latency_ms;
+    bool rxSuccess;
+
+    if (queueCount == 0) {
+	return 0;
+    }
+
+    p_request = &queue[queueHead];
+
+    if (!inFlight) {
+	if (suspended) {
+	    return 0;
+	}
+
+	twiBuf[0] = p_request->cmd;
+	memcpy(&twiBuf[1], p_request->request, p_request->requestLength);
+
+	twi_master_init();
+	rxSuccess = twi_master_transfer((DB_TWI_ADDR << 1), twiBuf, 1 + p_request->requestLength, true);
+	twi_master_deinit();
+
+	if (!rxSuccess) {
+	    stats.twiErrorCount++;
+	    db_complete(false, NULL);
+	    return (queueCount > 0) ? DB_POLL_INTERVAL_MS : 0;
+	}
+
+	app_timer_cnt_get(&sentTime_rtcTicks);
+	inFlight = true;
+	pollInterval_ms = DB_POLL_INTERVAL_MS;
+
+	/* Poll a little before the command is expected to complete, so that the
+	 * estimate can shrink as well as grow. */
+	latency_ms = db_getLatency(p_request->cmd);
+	latency_ms -= latency_ms / 4;
+	if (latency_ms < DB_POLL_FIRST_INTERVAL_MS) {
+	    latency_ms = DB_POLL_FIRST_INTERVAL_MS;
+	}
+
+	return latency_ms;
+    }
+
+    twi_master_init();
+    rxSuccess = twi_master_transfer((DB_TWI_ADDR << 1) | TWI_READ_BIT, twiBuf, 2 + p_request->responseLength, true);
+    twi_master_deinit();
+
+    stats.polls++;
+    elapsed_ms = db_getElapsedTime();
+
+    /* The daughterboard echoes the command code in the first byte once it
+     * has processed the command, and a second byte of 0x01 on success.  It
+     * may not acknowledge reads while it is busy. */
+    if (rxSuccess && (twiBuf[0] == p_request->cmd)) {
+	db_updateLatency(p_request->cmd, elapsed_ms);
+	if (twiBuf[1] != 0x01) {
+	    stats.failures++;
+	}
+	db_complete(twiBuf[1] == 0x01, &twiBuf[2]);
+	return (queueCount > 0) ? 1 : 0;
+    }
+
+    if (!rxSuccess) {
+	stats.twiErrorCount++;
+    }
+
+    if (elapsed_ms >= p_request->timeout_ms) {
+	stats.timeouts++;
+	db_complete(false, NULL);
+	return (queueCount > 0) ? 1 : 0;
+    }
+
+    latency_ms = pollInterval_ms;
+    if (latency_ms > p_request->timeout_ms - elapsed_ms) {
+	latency_ms = p_request->timeout_ms - elapsed_ms;
+    }
+
+    pollInterval_ms += pollInterval_ms / 2;
+    if (pollInterval_ms > DB_POLL_MAX_INTERVAL_MS) {
+	pollInterval_ms = DB_POLL_MAX_INTERVAL_MS;
+    }
+
+    return latency_ms;
+}
+
+/**@brief Removes the request at the head of the queue and passes its result
+ * to its handlers.
+ */
+void db_complete(bool success, const uint8_t *response) {
+    dbRequest_t request;
+    uint8_t h;
+
+    request = queue[queueHead];
+    queueHead = (queueHead + 1) % DB_QUEUE_LENGTH;
+    queueCount--;
+    inFlight = false;
+
+    for (h = 0; h < request.handlerCount; h++) {
+	request.handlers[h](request.cmd, success, success ? response : NULL, success ? request.responseLength : 0);
+    }
+}
+
+uint32_t db_getElapsedTime() {
+    uint32_t currentTime_rtcTicks;
+
+    app_timer_cnt_get(&currentTime_rtcTicks);
+
+    return ((0x00FFFFFF & (currentTime_rtcTicks - sentTime_rtcTicks)) * USEC_PER_APP_TIMER_TICK) / 1000;
+}
+
+void db_updateLatency(uint8_t cmd, uint16_t measured_ms) {
+    int16_t error_ms;
+    uint8_t i;
+
+    for (i = 0; i < DB_LATENCY_ENTRIES; i++) {
+	if ((latencies[i].cmd == cmd) && (latencies[i].latency_ms > 0)) {
+	    /* The estimate moves a quarter of the way to each measurement, but
+	     * by at least 1 ms, so that it does not get stuck above the actual
+	     * latency. */
+	    error_ms = (int16_t)measured_ms - (int16_t)latencies[i].latency_ms;
+	    latencies[i].latency_ms += (error_ms >= 0) ? (error_ms + 3) / 4 : (error_ms - 3) / 4;
+	    if (latencies[i].latency_ms == 0) {
+		latencies[i].latency_ms = 1;
+	    }
+	    return;
+	}
+    }
+
+    latencies[nextLatencyEntry].cmd = cmd;
+    latencies[nextLatencyEntry].latency_ms = (measured_ms > 0) ? measured_ms : 1;
+    nextLatencyEntry = (nextLatencyEntry + 1) % DB_LATENCY_ENTRIES;
+}
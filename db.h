@@ -8,6 +8,9 @@
 #ifndef DB_H_
 #define DB_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #define DB_TWI_ADDR					0x2A
 
 #define DB_LED_CMD					0x62
@@ -18,6 +21,7 @@
 
 #define DB_POLL_FIRST_INTERVAL_MS	5
 #define DB_POLL_INTERVAL_MS			5
+#define DB_POLL_MAX_INTERVAL_MS		20
 
 #define DB_LED_TIMEOUT_MS			50
 #define DB_SLEEP_TIMEOUT_MS			50
@@ -25,6 +29,43 @@
 #define DB_BRAKE_TIMEOUT_MS			1000
 #define DB_TEMPERATURE_TIMEOUT_MS	50
 
+/* Requests queued for the daughterboard at once, and callers which can share
+ * one request */
+#define DB_QUEUE_LENGTH				4
+#define DB_MAX_HANDLERS				3
+
+#define DB_MAX_REQUEST_LENGTH		2
+#define DB_MAX_RESPONSE_LENGTH		32
+
+/* Called from the scheduler when a queued request completes.  The response
+ * excludes the echoed command code and status byte, and is only valid for
+ * the duration of the call. */
+typedef void (*dbCompletionHandler_t)(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength);
+
+typedef struct {
+    uint16_t requests;
+    uint16_t coalesced;
+    uint16_t polls;
+    uint16_t failures;
+    uint16_t timeouts;
+    uint16_t twiErrorCount;
+    uint16_t overflows;
+} dbStats_t;
+
+void db_init(void);
+void db_deinit(void);
+
+bool db_request(uint8_t cmd, uint8_t requestLength, const uint8_t *request, uint8_t responseLength,
+	uint16_t timeout_ms, dbCompletionHandler_t handler);
+bool db_requestTemp(dbCompletionHandler_t handler);
+bool db_requestLEDs(bool redOn, bool greenOn, bool blueOn, dbCompletionHandler_t handler);
+void db_flush(void);
+void db_suspend(bool suspend);
+bool db_isIdle(void);
+uint16_t db_getLatency(uint8_t cmd);
+void db_getStats(dbStats_t *p_stats);
+void db_clearStats(void);
+
 void db_reset(void);
 bool db_sleep(bool sleepEnabled);
 bool db_getVersion(char *verStr, uint8_t verStrSize);
@@ -223,7 +223,7 @@ bool fb_sendToTxBuffer(uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes)
     uint8_t twiBuf[128];
     bool success = true;
 
-    if (faceNum > 6) {
+    if ((faceNum > 6) || (numBytes > FB_TX_MAX_BYTES)) {
 	return false;
     }
 
@@ -231,10 +231,10 @@ bool fb_sendToTxBuffer(uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes)
 
     twiBuf[0]  = FB_REGISTER_ADDR_TX_BUF;
     // pad message as there is a tendency to drop the first few characters
-    twiBuf[1] = twiBuf[2] = twiBuf[3] = 0xB7;
-    memcpy(&twiBuf[4], bytes, numBytes);
+    twiBuf[1] = twiBuf[2] = twiBuf[3] = FB_TX_PAD_BYTE;
+    memcpy(&twiBuf[1 + FB_TX_PAD_BYTES], bytes, numBytes);
 
-    success &= twi_master_transfer((faceNum << 1), twiBuf, 4 + numBytes, true);
+    success &= twi_master_transfer((faceNum << 1), twiBuf, 1 + FB_TX_PAD_BYTES + numBytes, true);
 
     twi_master_deinit();
 
@@ -245,7 +245,7 @@ bool fb_queueToTxBuffer(uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes)
     uint8_t twiBuf[128];
     bool success = true;
 
-    if (faceNum > 6) {
+    if ((faceNum > 6) || (numBytes > FB_TX_MAX_BYTES)) {
 	return false;
     }
 
@@ -253,10 +253,10 @@ bool fb_queueToTxBuffer(uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes)
 
     twiBuf[0] = FB_REGISTER_ADDR_TX_MSG_BUF;
     // pad message as there is a tendency to drop the first few characters
-    twiBuf[1] = twiBuf[2] = twiBuf[3] = 0xB7;
-    memcpy(&twiBuf[4], bytes, numBytes);
+    twiBuf[1] = twiBuf[2] = twiBuf[3] = FB_TX_PAD_BYTE;
+    memcpy(&twiBuf[1 + FB_TX_PAD_BYTES], bytes, numBytes);
 
-    success &= twi_master_transfer((faceNum << 1), twiBuf, 4 + numBytes, true);
+    success &= twi_master_transfer((faceNum << 1), twiBuf, 1 + FB_TX_PAD_BYTES + numBytes, true);
 
     twi_master_deinit();
 
@@ -28,6 +28,13 @@
 #define FB_REGISTER_ADDR_TX_MSG_CONTROL				0x34
 #define FB_REGISTER_ADDR_TX_MSG_BUF					0x35
 
+/* Every write to a transmit buffer is preceded by this many padding bytes
+ * (which also consume space in the faceboard's buffer, and are transmitted),
+ * so at most FB_TX_MAX_BYTES of data can be written in a single transfer. */
+#define FB_TX_PAD_BYTES								3
+#define FB_TX_PAD_BYTE								0xB7
+#define FB_TX_MAX_BYTES								124
+
 #define FB_REGISTER_ADDR_RX_BUF						0x40
 #define FB_REGISTER_ADDR_RX_CONSUMED_COUNT			0x41
 #define FB_REGISTER_ADDR_RX_FLUSH					0x42
@@ -155,6 +155,38 @@ bool fifo_peek(const fifo_t *p_fifo, uint8_t *data, fifoSize_t *dataLen) {
     return true;
 }
 
+bool fifo_peekAt(const fifo_t *p_fifo, fifoSize_t offset, uint8_t *data, fifoSize_t *dataLen) {
+    fifoSize_t i;
+    fifoSize_t usedSpace;
+    fifoSize_t peekPtr;
+
+    usedSpace = fifo_getUsedSpace(p_fifo);
+
+    /* If the caller asks for data beginning at or beyond the last byte in the
+     * FIFO, there is nothing to copy. */
+    if (offset >= usedSpace) {
+	*dataLen = 0;
+	return false;
+    }
+
+    if (*dataLen == 0) {
+	return true;
+    }
+
+    /* Like fifo_peek(), except that we start copying 'offset' bytes past the
+     * oldest element in the FIFO. */
+    peekPtr = (p_fifo->outPtr + offset) % p_fifo->dataSize;
+
+    for (i=0; (i<*dataLen) && (offset+i<usedSpace); i++) {
+	data[i] = p_fifo->p_data[peekPtr];
+	peekPtr = (peekPtr + 1) % p_fifo->dataSize;
+    }
+
+    *dataLen = i;
+
+    return true;
+}
+
 bool fifo_discard(fifo_t *p_fifo, fifoSize_t *dataLen) {
     fifoSize_t i;
 
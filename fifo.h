@@ -28,6 +28,7 @@ fifoSize_t fifo_getFreeSpace(const fifo_t *p_fifo);
 bool fifo_push(fifo_t *p_fifo, const uint8_t *data, const fifoSize_t *dataLen);
 bool fifo_pop(fifo_t *p_fifo, uint8_t *data, fifoSize_t *dataLen);
 bool fifo_peek(const fifo_t *p_fifo, uint8_t *data, fifoSize_t *dataLen);
+bool fifo_peekAt(const fifo_t *p_fifo, fifoSize_t offset, uint8_t *data, fifoSize_t *dataLen);
 bool fifo_discard(fifo_t *p_fifo, fifoSize_t *dataLen);
 bool fifo_purge(fifo_t *p_fifo);
 
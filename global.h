@@ -11,6 +11,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define FIRMWARE_VERSION                0x0100                                      /**< Firmware version, reported by the version number service.  Modules only accept firmware over IR whose version is higher than their own. */
+
 #define APP_ADV_INTERVAL                64                                          /**< The advertising interval (in units of 0.625 ms. This value corresponds to 40 ms). */
 #define APP_ADV_TIMEOUT_IN_SECONDS      0                                         	/**< The advertising timeout (in units of seconds). */
 
@@ -27,7 +29,7 @@
 #define MAX_CONN_PARAMS_UPDATE_COUNT    3                                           /**< Number of attempts before giving up the connection parameter negotiation. */
 
 #define APP_TIMER_PRESCALER             9                                           /**< Value of the RTC1 PRESCALER register. */
-#define APP_TIMER_MAX_TIMERS            8                                          /**< Maximum number of simultaneously created timers. */
+#define APP_TIMER_MAX_TIMERS            14                                         /**< Maximum number of simultaneously created timers. */
 #define APP_TIMER_OP_QUEUE_SIZE         1/*5*/                                      /**< Size of timer operation queues. */
 
 #define USEC_PER_APP_TIMER_TICK			((uint32_t)ROUNDED_DIV((APP_TIMER_PRESCALER + 1) * (uint64_t)1000000, (uint64_t)APP_TIMER_CLOCK_FREQ))
@@ -55,6 +57,16 @@
 #define PWM_CH1_MATCH_PPI_CHENCLR_MASK	(PPI_CHENCLR_CH4_Msk)
 #define PWM_CH1_MATCH_PPI_CHEN_MASK		(PPI_CHEN_CH4_Msk)
 
+#define PWM_CH2_RESET_PPI_CHANNEL		(0)
+#define PWM_CH2_RESET_PPI_CHENSET_MASK	(PPI_CHENSET_CH0_Msk)
+#define PWM_CH2_RESET_PPI_CHENCLR_MASK	(PPI_CHENCLR_CH0_Msk)
+#define PWM_CH2_RESET_PPI_CHEN_MASK		(PPI_CHEN_CH0_Msk)
+
+#define PWM_CH2_MATCH_PPI_CHANNEL		(6)
+#define PWM_CH2_MATCH_PPI_CHENSET_MASK	(PPI_CHENSET_CH6_Msk)
+#define PWM_CH2_MATCH_PPI_CHENCLR_MASK	(PPI_CHENCLR_CH6_Msk)
+#define PWM_CH2_MATCH_PPI_CHEN_MASK		(PPI_CHEN_CH6_Msk)
+
 #define	TWI_MASTER_PPI_CHANNEL			(5)
 #define TWI_MASTER_PPI_CHENSET_MASK		PPI_CHENSET_CH5_Msk
 #define TWI_MASTER_PPI_CHENCLR_MASK		PPI_CHENCLR_CH5_Msk
@@ -67,6 +79,7 @@
 
 #define PWM_CH0_GPIOTE_CHANNEL			(0)
 #define PWM_CH1_GPIOTE_CHANNEL			(1)
+#define PWM_CH2_GPIOTE_CHANNEL			(2)
 #define FREQCNTR_GPIOTE_CHANNEL			(3)
 
 #endif /* GLOBAL_H_ */
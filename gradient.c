@@ -0,0 +1,400 @@
+/*
+ * gradient.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "util.h"
+#include "irtx.h"
+#include "message.h"
+#include "gradient.h"
+
+/* Every module advertises its hop count to the nearest seed to its neighbors
+ * whenever that count changes, and takes one more than the smallest count
+ * advertised to it.  Seeds refresh the gradient periodically by advertising
+ * a new sequence number, which spreads through the cluster and keeps the
+ * neighbors' entries from expiring. */
+#define GRADIENT_REFRESH_INTERVAL_MS	10000
+#define GRADIENT_TIMEOUT_MS		(3 * GRADIENT_REFRESH_INTERVAL_MS + 2000)
+
+/* Successive advertisements from a module are spaced at least this far
+ * apart, so that a burst of changes (e.g. while the gradient settles after a
+ * seed appears) costs only one message to each neighbor. */
+#define GRADIENT_MIN_UPDATE_SPACING_MS	250
+
+/* Number of seeds for which a feasibility distance is kept */
+#define GRADIENT_MAX_SEEDS		4
+
+typedef struct {
+    bool valid;
+    uint16_t seedID;
+    uint16_t seq;
+    uint8_t hops;
+    uint32_t lastHeard_ms;
+} gradientEntry_t;
+
+typedef struct {
+    bool valid;
+    uint16_t seedID;
+    uint16_t seq;
+    uint8_t hops;
+} gradientFD_t;
+
+static bool initialized = false;
+
+/* Whether this module is a seed persists through sleep. */
+static bool isSeed = false;
+static uint16_t seedSeq = 0;
+
+static uint16_t seedID;
+static uint16_t seq;
+static uint8_t hops = GRADIENT_INFINITY;
+static uint8_t parentFace;
+
+/* Feasibility distances: for each seed that we have followed, the smallest
+ * hop count we have had for its latest sequence number.  Within a sequence
+ * number, we only accept a neighbor whose count is below it, which prevents
+ * the counts from counting up in a loop (as they would when a seed
+ * disappears) until the seed's next refresh arrives.  They are kept for
+ * every recent seed rather than just the current one, as otherwise a module
+ * which has lost one seed could follow the stale counts of another around a
+ * loop, and then those of the first again. */
+static gradientFD_t fds[GRADIENT_MAX_SEEDS];
+static uint8_t fdNext;
+
+static gradientEntry_t entries[6];
+
+static bool updatePending;
+static uint32_t lastUpdate_ms;
+static uint32_t nextRefresh_ms;
+static uint32_t lastChange_ms;
+
+static uint16_t changes = 0;
+static uint16_t updatesSent = 0;
+static uint16_t updatesReceived = 0;
+static uint16_t updatesRejected = 0;
+
+static gradientFD_t *gradient_findFD(uint16_t id);
+static void gradient_updateFD(uint16_t newSeedID, uint16_t newSeq, uint8_t newHops);
+static bool gradient_isFeasible(const gradientEntry_t *p_entry);
+static void gradient_recompute(void);
+static void gradient_sendUpdate(void);
+
+void gradient_init() {
+    uint32_t now_ms = curr_time_ms();
+
+    memset(entries, 0, sizeof(entries));
+
+    hops = GRADIENT_INFINITY;
+    parentFace = 0;
+    memset(fds, 0, sizeof(fds));
+
+    updatePending = false;
+    lastUpdate_ms = now_ms - GRADIENT_MIN_UPDATE_SPACING_MS;
+    nextRefresh_ms = now_ms;
+    lastChange_ms = now_ms;
+
+    initialized = true;
+
+    gradient_recompute();
+}
+
+void gradient_deinit() {
+    initialized = false;
+}
+
+void gradient_tick() {
+    uint32_t now_ms;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    if (isSeed && ((int32_t)(now_ms - nextRefresh_ms) >= 0)) {
+	seedSeq++;
+	nextRefresh_ms = now_ms + GRADIENT_REFRESH_INTERVAL_MS;
+    }
+
+    /* Expire neighbors we have not heard from */
+    gradient_recompute();
+
+    if (updatePending && (now_ms - lastUpdate_ms >= GRADIENT_MIN_UPDATE_SPACING_MS)) {
+	gradient_sendUpdate();
+    }
+}
+
+bool gradient_processMessage(uint8_t faceNum, const char *msg) {
+    unsigned int sender, msgSeedID, msgSeq, msgHops;
+    gradientEntry_t *p_entry;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "grd;", 4) != 0) {
+	return false;
+    }
+
+    if (!initialized) {
+	return true;
+    }
+
+    /* Update: grd;<sender>;<seed>;<seq>;<hops> */
+    if (sscanf(msg, "grd;%x;%x;%u;%u", &sender, &msgSeedID, &msgSeq, &msgHops) != 4) {
+	return true;
+    }
+
+    if (sender == getNodeID()) {
+	return true;
+    }
+
+    updatesReceived++;
+
+    p_entry = &entries[faceNum - 1];
+    p_entry->valid = true;
+    p_entry->seedID = msgSeedID;
+    p_entry->seq = msgSeq;
+    p_entry->hops = (msgHops < GRADIENT_MAX_HOPS) ? msgHops : GRADIENT_INFINITY;
+    p_entry->lastHeard_ms = curr_time_ms();
+
+    if (!isSeed && (p_entry->hops < GRADIENT_MAX_HOPS - 1) && !gradient_isFeasible(p_entry)) {
+	updatesRejected++;
+    }
+
+    gradient_recompute();
+
+    if (updatePending && (curr_time_ms() - lastUpdate_ms >= GRADIENT_MIN_UPDATE_SPACING_MS)) {
+	gradient_sendUpdate();
+    }
+
+    return true;
+}
+
+/**@brief Makes this module a seed (hop count 0) of the gradient, or stops it
+ * from being one.  The gradient as a whole measures the distance to the
+ * nearest seed.
+ */
+void gradient_setSeed(bool seed) {
+    if (seed == isSeed) {
+	return;
+    }
+
+    isSeed = seed;
+
+    /* Start refreshing straight away */
+    nextRefresh_ms = curr_time_ms();
+    seedSeq++;
+
+    if (initialized) {
+	gradient_recompute();
+    }
+}
+
+bool gradient_isSeed() {
+    return isSeed;
+}
+
+/**@brief Returns the number of hops to the nearest seed, or GRADIENT_INFINITY
+ * if no seed is reachable.
+ */
+uint8_t gradient_getHops() {
+    return initialized ? hops : GRADIENT_INFINITY;
+}
+
+/**@brief Returns the hop count last advertised by the neighbor on the given
+ * face, or GRADIENT_INFINITY if there is none.  Comparing these with
+ * gradient_getHops() tells which faces lead towards or away from a seed.
+ */
+uint8_t gradient_getNeighborHops(uint8_t faceNum) {
+    gradientEntry_t *p_entry;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return GRADIENT_INFINITY;
+    }
+
+    p_entry = &entries[faceNum - 1];
+    if (!p_entry->valid || (curr_time_ms() - p_entry->lastHeard_ms > GRADIENT_TIMEOUT_MS)) {
+	return GRADIENT_INFINITY;
+    }
+
+    return p_entry->hops;
+}
+
+void gradient_getStatus(gradientStatus_t *p_status) {
+    uint8_t faceNum;
+
+    p_status->isSeed = isSeed;
+    p_status->hops = gradient_getHops();
+    p_status->seedID = seedID;
+    p_status->seq = seq;
+    p_status->parentFace = parentFace;
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	p_status->neighborHops[faceNum - 1] = gradient_getNeighborHops(faceNum);
+    }
+    p_status->lastChangeAge_ms = curr_time_ms() - lastChange_ms;
+    p_status->changes = changes;
+    p_status->updatesSent = updatesSent;
+    p_status->updatesReceived = updatesReceived;
+    p_status->updatesRejected = updatesRejected;
+}
+
+void gradient_clearStats() {
+    changes = 0;
+    updatesSent = 0;
+    updatesReceived = 0;
+    updatesRejected = 0;
+}
+
+gradientFD_t *gradient_findFD(uint16_t id) {
+    uint8_t i;
+
+    for (i = 0; i < GRADIENT_MAX_SEEDS; i++) {
+	if (fds[i].valid && (fds[i].seedID == id)) {
+	    return &fds[i];
+	}
+    }
+
+    return NULL;
+}
+
+void gradient_updateFD(uint16_t newSeedID, uint16_t newSeq, uint8_t newHops) {
+    gradientFD_t *p_fd = gradient_findFD(newSeedID);
+    uint8_t i;
+
+    if (p_fd == NULL) {
+	/* Use a free slot, or else the oldest one */
+	for (i = 0; (i < GRADIENT_MAX_SEEDS) && fds[i].valid; i++);
+	if (i == GRADIENT_MAX_SEEDS) {
+	    i = fdNext;
+	    fdNext = (fdNext + 1) % GRADIENT_MAX_SEEDS;
+	}
+
+	p_fd = &fds[i];
+	p_fd->valid = true;
+	p_fd->seedID = newSeedID;
+	p_fd->seq = newSeq;
+	p_fd->hops = newHops;
+    } else if ((int16_t)(newSeq - p_fd->seq) > 0) {
+	p_fd->seq = newSeq;
+	p_fd->hops = newHops;
+    } else if (newHops < p_fd->hops) {
+	p_fd->hops = newHops;
+    }
+}
+
+bool gradient_isFeasible(const gradientEntry_t *p_entry) {
+    gradientFD_t *p_fd = gradient_findFD(p_entry->seedID);
+    int16_t seqDiff;
+
+    if (p_fd == NULL) {
+	/* A seed we have not followed is only worth following if it is
+	 * closer */
+	return ((hops == GRADIENT_INFINITY) || (p_entry->hops + 1 < hops));
+    }
+
+    seqDiff = (int16_t)(p_entry->seq - p_fd->seq);
+
+    return ((seqDiff > 0) || ((seqDiff == 0) && (p_entry->hops < p_fd->hops)));
+}
+
+/**@brief Chooses the best of our neighbors' advertisements and updates our
+ * own hop count from it, scheduling an advertisement if it has changed.
+ */
+void gradient_recompute() {
+    uint32_t now_ms = curr_time_ms();
+    gradientEntry_t *p_entry;
+    gradientEntry_t *p_best = NULL;
+    uint8_t bestFace = 0;
+    uint16_t newSeedID, newSeq;
+    uint8_t newHops;
+    uint8_t faceNum;
+
+    if (isSeed) {
+	newSeedID = getNodeID();
+	newSeq = seedSeq;
+	newHops = 0;
+    } else {
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    p_entry = &entries[faceNum - 1];
+
+	    if (p_entry->valid && (now_ms - p_entry->lastHeard_ms > GRADIENT_TIMEOUT_MS)) {
+		p_entry->valid = false;
+	    }
+
+	    if (!p_entry->valid || (p_entry->hops >= GRADIENT_MAX_HOPS - 1)) {
+		continue;
+	    }
+
+	    if (!gradient_isFeasible(p_entry)) {
+		continue;
+	    }
+
+	    if ((p_best == NULL) || (p_entry->hops < p_best->hops) ||
+		    ((p_entry->hops == p_best->hops) && ((int16_t)(p_entry->seq - p_best->seq) > 0))) {
+		p_best = p_entry;
+		bestFace = faceNum;
+	    }
+	}
+
+	if (p_best != NULL) {
+	    newSeedID = p_best->seedID;
+	    newSeq = p_best->seq;
+	    newHops = p_best->hops + 1;
+	} else if (hops == GRADIENT_INFINITY) {
+	    /* Still unconnected; once every neighbor has expired, forget the
+	     * old seeds, so that they are accepted again with any sequence
+	     * number (e.g. after they have reset). */
+	    for (faceNum = 1; (faceNum <= 6) && !entries[faceNum - 1].valid; faceNum++);
+	    if (faceNum > 6) {
+		memset(fds, 0, sizeof(fds));
+	    }
+	    return;
+	} else {
+	    /* Our route to the seed has been lost or has become longer, and
+	     * no neighbor offers a route that is certain not to lead back
+	     * through us.  Retract our count until the seed refreshes. */
+	    newSeedID = seedID;
+	    newSeq = seq;
+	    newHops = GRADIENT_INFINITY;
+	}
+    }
+
+    if (newHops != GRADIENT_INFINITY) {
+	gradient_updateFD(newSeedID, newSeq, newHops);
+    }
+
+    parentFace = bestFace;
+
+    if ((newSeedID != seedID) || (newSeq != seq) || (newHops != hops)) {
+	if ((newSeedID != seedID) || (newHops != hops)) {
+	    changes++;
+	    lastChange_ms = now_ms;
+	}
+
+	seedID = newSeedID;
+	seq = newSeq;
+	hops = newHops;
+	updatePending = true;
+    }
+}
+
+void gradient_sendUpdate() {
+    char str[32];
+
+    /* Update: grd;<sender>;<seed>;<seq>;<hops> */
+    snprintf(str, sizeof(str), "grd;%04x;%04x;%u;%u|", getNodeID(), seedID, seq, hops);
+    message_sendToAllBut(0, IRTX_PRIORITY_CONTROL, str);
+
+    updatePending = false;
+    lastUpdate_ms = curr_time_ms();
+    updatesSent++;
+}
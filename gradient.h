@@ -0,0 +1,50 @@
+/*
+ * gradient.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef GRADIENT_H_
+#define GRADIENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Hop count of a module which is not connected to any seed */
+#define GRADIENT_INFINITY		0xFF
+#define GRADIENT_MAX_HOPS		64
+
+typedef struct {
+    bool isSeed;
+    /* Hops to the nearest seed, or GRADIENT_INFINITY */
+    uint8_t hops;
+    uint16_t seedID;
+    /* Sequence number of the seed's latest refresh that has reached us */
+    uint16_t seq;
+    /* Face (1-6) towards the seed, or 0 if we are the seed or have none */
+    uint8_t parentFace;
+    /* Hop counts last advertised by the neighbor on each face */
+    uint8_t neighborHops[6];
+    uint32_t lastChangeAge_ms;
+    uint16_t changes;
+    uint16_t updatesSent;
+    uint16_t updatesReceived;
+    /* Updates from neighbors which were ignored because they could have
+     * formed a loop */
+    uint16_t updatesRejected;
+} gradientStatus_t;
+
+void gradient_init(void);
+void gradient_deinit(void);
+void gradient_tick(void);
+
+bool gradient_processMessage(uint8_t faceNum, const char *msg);
+
+void gradient_setSeed(bool seed);
+bool gradient_isSeed(void);
+uint8_t gradient_getHops(void);
+uint8_t gradient_getNeighborHops(uint8_t faceNum);
+void gradient_getStatus(gradientStatus_t *p_status);
+void gradient_clearStats(void);
+
+#endif /* GRADIENT_H_ */
@@ -0,0 +1,158 @@
+/*
+ * group.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "util.h"
+#include "cmdline.h"
+#include "irtx.h"
+#include "message.h"
+#include "group.h"
+
+static bool initialized = false;
+
+/* Group membership is deliberately left untouched by group_init() and
+ * group_deinit() so that it survives sleep, during which the messaging layer
+ * is shut down. */
+static uint16_t membership = 0x0000;
+
+static groupStats_t stats[GROUP_COUNT];
+static uint8_t multicastID = 0;
+
+void group_init() {
+    initialized = true;
+}
+
+void group_deinit() {
+    initialized = false;
+}
+
+bool group_join(uint8_t group) {
+    if (group >= GROUP_COUNT) {
+	return false;
+    }
+
+    membership |= (1 << group);
+    return true;
+}
+
+bool group_leave(uint8_t group) {
+    if (group >= GROUP_COUNT) {
+	return false;
+    }
+
+    membership &= ~(1 << group);
+    return true;
+}
+
+void group_leaveAll() {
+    membership = 0x0000;
+}
+
+uint16_t group_getMembership() {
+    return membership;
+}
+
+/**@brief Returns whether we belong to any of the groups in the bitmap. */
+bool group_isMember(uint16_t groupMask) {
+    return ((membership & groupMask) != 0x0000);
+}
+
+/**@brief Sends a command to every module in the cluster which belongs to at
+ * least one of the given groups.  If we are a member ourselves, the command is
+ * also executed here.
+ */
+bool group_sendCommand(uint16_t groupMask, const char *cmd) {
+    char str[GROUP_MAX_CMD_LEN + 24];
+    uint8_t group;
+
+    if (!initialized || (groupMask == 0x0000) || (strlen(cmd) > GROUP_MAX_CMD_LEN) || (strchr(cmd, '|') != NULL)) {
+	return false;
+    }
+
+    multicastID++;
+
+    /* Multicast: mcst;<origin>;<id>;<groups>;<command> */
+    snprintf(str, sizeof(str), "mcst;%04x;%u;%04x;%s|", getNodeID(), multicastID, groupMask, cmd);
+    message_sendToAllBut(0, IRTX_PRIORITY_BULK, str);
+
+    for (group = 0; group < GROUP_COUNT; group++) {
+	if (groupMask & (1 << group)) {
+	    stats[group].sent++;
+	    if (membership & (1 << group)) {
+		stats[group].delivered++;
+	    }
+	}
+    }
+
+    if (group_isMember(groupMask)) {
+	cmdLine_execCmd(cmd);
+    }
+
+    return true;
+}
+
+bool group_getStats(uint8_t group, groupStats_t *p_stats) {
+    if (group >= GROUP_COUNT) {
+	return false;
+    }
+
+    *p_stats = stats[group];
+    return true;
+}
+
+void group_clearStats() {
+    memset(stats, 0, sizeof(stats));
+}
+
+bool group_processMessage(uint8_t faceNum, const char *msg) {
+    unsigned int origin, id, groupMask;
+    int cmdStart = 0;
+    uint8_t group;
+    char str[128];
+
+    if ((faceNum < 1) || (faceNum > 6) || (strncmp(msg, "mcst;", 5) != 0)) {
+	return false;
+    }
+
+    if (!initialized) {
+	return true;
+    }
+
+    if (sscanf(msg, "mcst;%x;%u;%x;%n", &origin, &id, &groupMask, &cmdStart) != 3) {
+	return true;
+    }
+
+    /* Drop our own multicasts when they are reflected back to us, and any
+     * which have already reached us by another path. */
+    if ((cmdStart == 0) || (origin == getNodeID()) || !message_recordFlood('m', origin, id, faceNum)) {
+	return true;
+    }
+
+    /* Every module passes the multicast on, whether or not it is a member,
+     * so that it reaches members on the far side of non-members. */
+    snprintf(str, sizeof(str), "%s|", msg);
+    message_sendToAllBut(faceNum, IRTX_PRIORITY_BULK, str);
+
+    for (group = 0; group < GROUP_COUNT; group++) {
+	if (groupMask & (1 << group)) {
+	    stats[group].relayed++;
+	    if (membership & (1 << group)) {
+		stats[group].delivered++;
+	    }
+	}
+    }
+
+    if (group_isMember(groupMask)) {
+	cmdLine_execCmd(&msg[cmdStart]);
+    }
+
+    return true;
+}
@@ -0,0 +1,45 @@
+/*
+ * group.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef GROUP_H_
+#define GROUP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Groups are numbered 0 to GROUP_COUNT-1, and sets of groups are represented
+ * as bitmaps with bit n set for group n. */
+#define GROUP_COUNT			16
+#define GROUP_MASK_ALL			0xFFFF
+
+#define GROUP_MAX_CMD_LEN		64
+
+typedef struct {
+    /* Multicasts to this group which originated here */
+    uint16_t sent;
+    /* Multicasts to this group which were executed here */
+    uint16_t delivered;
+    /* Multicasts to this group which were passed on to our neighbors */
+    uint16_t relayed;
+} groupStats_t;
+
+void group_init(void);
+void group_deinit(void);
+
+bool group_processMessage(uint8_t faceNum, const char *msg);
+
+bool group_join(uint8_t group);
+bool group_leave(uint8_t group);
+void group_leaveAll(void);
+uint16_t group_getMembership(void);
+bool group_isMember(uint16_t groupMask);
+
+bool group_sendCommand(uint16_t groupMask, const char *cmd);
+
+bool group_getStats(uint8_t group, groupStats_t *p_stats);
+void group_clearStats(void);
+
+#endif /* GROUP_H_ */
@@ -244,6 +244,17 @@ const vectorFloat_t frameAlignmentVectorsFloat[3] = {
     {0.707107f, 0.707107f, 0.0f},
 };
 
+/* Outward normals of faces 1-6 in the frame of the faceboard IMU, which is
+ * fixed to the module's frame.  Opposite faces have opposite normals. */
+const int8_t frameFaceNormals[6][3] = {
+    { 0,  0,  1},
+    { 1,  0,  0},
+    { 0,  1,  0},
+    {-1,  0,  0},
+    { 0, -1,  0},
+    { 0,  0, -1}
+};
+
 static bool imuInitialized[2] = {false, false};
 static bool dmpInitialized[2] = {false, false};
 
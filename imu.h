@@ -42,6 +42,7 @@ typedef struct {
 } vectorFloat_t;
 
 extern const vectorFloat_t frameAlignmentVectorsFloat[3];
+extern const int8_t frameFaceNormals[6][3];
 
 bool imu_init();
 bool imu_initDMP(void);
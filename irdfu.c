@@ -0,0 +1,816 @@
+/*
+ * irdfu.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nrf_sdm.h"
+
+#include "crc16.h"
+
+#include "global.h"
+#include "util.h"
+#include "irtx.h"
+#include "message.h"
+#include "xfer.h"
+#include "irdfu.h"
+
+/* A module with an image to give away offers it to its neighbors at regular
+ * intervals.  It stops offering once no neighbor has asked it for a chunk for
+ * a long time, so that a cluster which is up to date falls silent again. */
+#define IRDFU_OFFER_INTERVAL_MS		20000
+#define IRDFU_OFFER_JITTER_MS		2000
+#define IRDFU_OFFER_IDLE_TIMEOUT_MS	600000
+
+/* The receiver asks for one chunk at a time, and asks again if the chunk
+ * has not arrived in time.  After too many attempts it gives up on the
+ * sender, and resumes with whichever neighbor offers the image next. */
+#define IRDFU_REQUEST_TIMEOUT_MS	4000
+#define IRDFU_MAX_RETRIES		5
+
+/* Modules which were told to activate the image automatically do so once
+ * they have had it for this long without any neighbor asking for it. */
+#define IRDFU_AUTO_ACTIVATE_IDLE_MS	60000
+
+#define IRDFU_STATE_MAGIC		0x4D424653
+#define IRDFU_NO_PAGE			0xFF
+#define IRDFU_NO_CHUNK			0xFFFF
+
+/* Layout of the state page.  Words which record progress are erased
+ * (0xFFFFFFFF) until the corresponding step has finished, and are then
+ * written to zero, so that each is written only once between erasures. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t crc;
+    uint32_t autoActivate;
+    uint32_t complete;
+    uint32_t pageDone[IRDFU_MAX_PAGES];
+} irdfuState_t;
+
+#define IRDFU_HEADER_WORDS		5
+
+typedef enum {
+    IRDFU_FLASH_IDLE,
+    IRDFU_FLASH_ERASE_STATE,
+    IRDFU_FLASH_WRITE_HEADER,
+    IRDFU_FLASH_ERASE_PAGE,
+    IRDFU_FLASH_WRITE_CHUNK,
+    IRDFU_FLASH_MARK_PAGE,
+    IRDFU_FLASH_MARK_COMPLETE,
+    IRDFU_FLASH_DISCARD
+} irdfuFlashOp_t;
+
+/* Linker symbols marking the end of the running image */
+extern uint32_t __etext;
+extern uint32_t __data_start__;
+extern uint32_t __data_end__;
+
+static const irdfuState_t *p_state = (const irdfuState_t *)IRDFU_STATE_PAGE_ADDR;
+
+static bool initialized = false;
+
+static uint32_t runningSize = 0;
+static uint16_t runningCRC;
+static bool runningCRCValid = false;
+
+/* Offering: either the image staged in bank 1 or the running image */
+static bool offering = false;
+static bool offerFromStaged;
+static bool offerAutoActivate;
+static uint32_t nextOffer_ms;
+static uint32_t lastServed_ms;
+
+/* Sending a chunk.  Only one face is served at a time; requests which
+ * arrive meanwhile are remembered (one per face) and served in turn. */
+static uint8_t txFace = 0;
+static uint8_t txBuf[4 + IRDFU_CHUNK_SIZE];
+static uint16_t pendingChunks[6];
+
+/* Receiving an image */
+static bool rxActive = false;
+static uint8_t rxFace;
+static uint16_t rxSenderID;
+static uint16_t rxChunk;
+static uint16_t rxChunkBytes;
+static uint32_t rxRequest_ms;
+static uint8_t rxRetries;
+static uint8_t openPage = IRDFU_NO_PAGE;
+static uint16_t pageCRC;
+
+static irdfuFlashOp_t flashOp = IRDFU_FLASH_IDLE;
+static uint32_t writeBuf[IRDFU_CHUNK_SIZE / 4];
+static uint32_t zeroWord = 0;
+
+static uint32_t stagedComplete_ms;
+
+static uint16_t chunksSent = 0;
+static uint16_t chunksReceived = 0;
+static uint16_t chunksRejected = 0;
+static uint16_t pagesWritten = 0;
+static uint16_t pageCRCErrors = 0;
+static uint16_t resumes = 0;
+static uint16_t flashErrors = 0;
+
+static bool irdfu_isStateValid(void);
+static bool irdfu_isStagedComplete(void);
+static uint8_t irdfu_getNumPages(uint32_t size);
+static uint16_t irdfu_getChunkBytes(uint32_t size, uint16_t chunk);
+static uint8_t irdfu_getPagesDone(void);
+static uint16_t irdfu_getRunningCRC(void);
+static bool irdfu_getOffer(const uint8_t **pp_image, uint16_t *p_version, uint32_t *p_size, uint16_t *p_crc);
+static void irdfu_sendOffer(void);
+static void irdfu_processOffer(uint8_t faceNum, const char *msg);
+static void irdfu_processRequest(uint8_t faceNum, const char *msg);
+static bool irdfu_sendChunk(uint8_t faceNum, uint16_t chunk);
+static void irdfu_txCallback(uint8_t faceNum, const xferResult_t *p_result);
+static void irdfu_rxHandler(uint8_t faceNum, uint16_t senderID, const uint8_t *data, uint16_t numBytes);
+static void irdfu_requestNext(void);
+static bool irdfu_startFlashOp(irdfuFlashOp_t op);
+static void irdfu_flashDone(irdfuFlashOp_t op);
+static void irdfu_flashFailed(irdfuFlashOp_t op);
+static void irdfu_copyImage(uint32_t size, uint16_t crc) __attribute__((section(".ramfunc"), noinline, long_call));
+
+void irdfu_init() {
+    uint32_t now_ms = curr_time_ms();
+    uint8_t faceNum;
+
+    runningSize = (uint32_t)&__etext + ((uint32_t)&__data_end__ - (uint32_t)&__data_start__) - IRDFU_BANK_0_START;
+    runningSize = (runningSize + 3) & ~0x03;
+
+    /* A complete image in the staging area which is no older than the one
+     * we are running (including the one we were just updated with) is
+     * offered to our neighbors. */
+    if (irdfu_isStagedComplete() && ((uint16_t)p_state->version >= FIRMWARE_VERSION)) {
+	offering = true;
+	offerFromStaged = true;
+	offerAutoActivate = (p_state->autoActivate != 0);
+    }
+
+    nextOffer_ms = now_ms + (rand() % IRDFU_OFFER_JITTER_MS);
+    lastServed_ms = now_ms;
+    stagedComplete_ms = now_ms;
+
+    rxActive = false;
+    txFace = 0;
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	pendingChunks[faceNum - 1] = IRDFU_NO_CHUNK;
+    }
+    openPage = IRDFU_NO_PAGE;
+
+    xfer_setRxHandler(irdfu_rxHandler);
+
+    initialized = true;
+}
+
+void irdfu_deinit() {
+    /* Any transfer in progress resumes when we wake */
+    rxActive = false;
+    initialized = false;
+}
+
+void irdfu_tick() {
+    uint32_t now_ms;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    if (offering) {
+	if (now_ms - lastServed_ms > IRDFU_OFFER_IDLE_TIMEOUT_MS) {
+	    offering = false;
+	} else if ((int32_t)(now_ms - nextOffer_ms) >= 0) {
+	    irdfu_sendOffer();
+	    nextOffer_ms = now_ms + IRDFU_OFFER_INTERVAL_MS + (rand() % IRDFU_OFFER_JITTER_MS);
+	}
+    }
+
+    if (rxActive && (flashOp == IRDFU_FLASH_IDLE) && (now_ms - rxRequest_ms > IRDFU_REQUEST_TIMEOUT_MS)) {
+	if (++rxRetries > IRDFU_MAX_RETRIES) {
+	    rxActive = false;
+	} else {
+	    irdfu_requestNext();
+	}
+    }
+
+    if (offering && offerFromStaged && offerAutoActivate && (txFace == 0) &&
+	    ((uint16_t)p_state->version > FIRMWARE_VERSION) &&
+	    (now_ms - lastServed_ms > IRDFU_AUTO_ACTIVATE_IDLE_MS) &&
+	    (now_ms - stagedComplete_ms > IRDFU_AUTO_ACTIVATE_IDLE_MS)) {
+	app_uart_put_string("Activating firmware received over IR\r\n");
+	irdfu_activate();
+    }
+}
+
+bool irdfu_processMessage(uint8_t faceNum, const char *msg) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "fwo;", 4) == 0) {
+	irdfu_processOffer(faceNum, msg);
+    } else if (strncmp(msg, "fwn;", 4) == 0) {
+	irdfu_processRequest(faceNum, msg);
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+/**@brief Handles SoftDevice system events, which report the completion of
+ * the flash operations we start.
+ */
+void irdfu_onSysEvt(uint32_t sysEvt) {
+    irdfuFlashOp_t op = flashOp;
+
+    if (op == IRDFU_FLASH_IDLE) {
+	return;
+    }
+
+    if (sysEvt == NRF_EVT_FLASH_OPERATION_SUCCESS) {
+	flashOp = IRDFU_FLASH_IDLE;
+	irdfu_flashDone(op);
+    } else if (sysEvt == NRF_EVT_FLASH_OPERATION_ERROR) {
+	flashOp = IRDFU_FLASH_IDLE;
+	flashErrors++;
+	irdfu_flashFailed(op);
+    }
+}
+
+/**@brief Checks whether one of our flash operations is in progress.  The
+ * SoftDevice runs one flash operation at a time and reports its completion to
+ * every module with a system event handler, so other modules writing flash
+ * (i.e. through pstorage) must not start while this is true.
+ */
+bool irdfu_isFlashBusy() {
+    return (flashOp != IRDFU_FLASH_IDLE);
+}
+
+/**@brief Starts offering the running image to our neighbors.
+ *
+ * @param[in] autoActivate  Whether modules which receive the image should
+ *                          activate it by themselves once they have passed
+ *                          it on.
+ *
+ * @return false if the running image does not fit in the staging area.
+ */
+bool irdfu_startOffering(bool autoActivate) {
+    if (!initialized || (runningSize > IRDFU_MAX_IMAGE_SIZE)) {
+	return false;
+    }
+
+    irdfu_getRunningCRC();
+
+    offering = true;
+    offerFromStaged = false;
+    offerAutoActivate = autoActivate;
+    lastServed_ms = curr_time_ms();
+    nextOffer_ms = lastServed_ms;
+
+    return true;
+}
+
+/**@brief Stops offering and receiving images, and discards any image in the
+ * staging area.
+ */
+void irdfu_stop() {
+    offering = false;
+    rxActive = false;
+
+    if (irdfu_isStateValid() && (flashOp == IRDFU_FLASH_IDLE)) {
+	irdfu_startFlashOp(IRDFU_FLASH_DISCARD);
+    }
+}
+
+/**@brief Replaces the running image with the staged one and resets.  The
+ * bootloader supplied with the SDK only activates bank 1 at the end of its
+ * own DFU sessions, so we copy the image ourselves, from RAM with the
+ * SoftDevice disabled, and record its size and CRC in the bootloader
+ * settings.  Should the copy be interrupted, the CRC will not match and the
+ * bootloader will wait for a BLE DFU session instead.
+ *
+ * @return false if there is no complete staged image newer than ours.
+ */
+bool irdfu_activate() {
+    uint32_t size;
+    uint16_t crc;
+
+    if (!irdfu_isStagedComplete() || ((uint16_t)p_state->version <= FIRMWARE_VERSION) ||
+	    (flashOp != IRDFU_FLASH_IDLE)) {
+	return false;
+    }
+
+    size = p_state->size;
+    crc = (uint16_t)p_state->crc;
+
+    if (crc16_compute((const uint8_t *)IRDFU_BANK_1_START, size, NULL) != crc) {
+	return false;
+    }
+
+    sd_softdevice_disable();
+    __disable_irq();
+
+    irdfu_copyImage(size, crc);
+
+    return true;
+}
+
+void irdfu_getStatus(irdfuStatus_t *p_status) {
+    p_status->runningVersion = FIRMWARE_VERSION;
+    p_status->runningSize = runningSize;
+    p_status->runningCRC = irdfu_getRunningCRC();
+
+    p_status->staged = irdfu_isStateValid();
+    p_status->stagedComplete = irdfu_isStagedComplete();
+    if (p_status->staged) {
+	p_status->stagedAutoActivate = (p_state->autoActivate != 0);
+	p_status->stagedVersion = (uint16_t)p_state->version;
+	p_status->stagedSize = p_state->size;
+	p_status->stagedCRC = (uint16_t)p_state->crc;
+	p_status->pagesDone = irdfu_getPagesDone();
+	p_status->pagesTotal = irdfu_getNumPages(p_state->size);
+    } else {
+	p_status->stagedAutoActivate = false;
+	p_status->stagedVersion = 0;
+	p_status->stagedSize = 0;
+	p_status->stagedCRC = 0;
+	p_status->pagesDone = 0;
+	p_status->pagesTotal = 0;
+    }
+
+    p_status->rxFace = rxActive ? rxFace : 0;
+    p_status->txFace = txFace;
+    p_status->offering = offering;
+    p_status->chunksSent = chunksSent;
+    p_status->chunksReceived = chunksReceived;
+    p_status->chunksRejected = chunksRejected;
+    p_status->pagesWritten = pagesWritten;
+    p_status->pageCRCErrors = pageCRCErrors;
+    p_status->resumes = resumes;
+    p_status->flashErrors = flashErrors;
+}
+
+void irdfu_clearStats() {
+    chunksSent = 0;
+    chunksReceived = 0;
+    chunksRejected = 0;
+    pagesWritten = 0;
+    pageCRCErrors = 0;
+    resumes = 0;
+    flashErrors = 0;
+}
+
+bool irdfu_isStateValid() {
+    return ((p_state->magic == IRDFU_STATE_MAGIC) && (p_state->size > 0) &&
+	    (p_state->size <= IRDFU_MAX_IMAGE_SIZE));
+}
+
+bool irdfu_isStagedComplete() {
+    return (irdfu_isStateValid() && (p_state->complete == 0));
+}
+
+uint8_t irdfu_getNumPages(uint32_t size) {
+    return (uint8_t)((size + IRDFU_PAGE_SIZE - 1) / IRDFU_PAGE_SIZE);
+}
+
+uint16_t irdfu_getChunkBytes(uint32_t size, uint16_t chunk) {
+    uint32_t offset = (uint32_t)chunk * IRDFU_CHUNK_SIZE;
+
+    if (offset >= size) {
+	return 0;
+    }
+
+    return (size - offset < IRDFU_CHUNK_SIZE) ? (uint16_t)(size - offset) : IRDFU_CHUNK_SIZE;
+}
+
+/**@brief Returns the number of leading pages of the staged image which have
+ * been written and verified.
+ */
+uint8_t irdfu_getPagesDone() {
+    uint8_t numPages = irdfu_getNumPages(p_state->size);
+    uint8_t page;
+
+    for (page = 0; (page < numPages) && (p_state->pageDone[page] == 0); page++);
+
+    return page;
+}
+
+uint16_t irdfu_getRunningCRC() {
+    if (!runningCRCValid && (runningSize <= IRDFU_MAX_IMAGE_SIZE)) {
+	runningCRC = crc16_compute((const uint8_t *)IRDFU_BANK_0_START, runningSize, NULL);
+	runningCRCValid = true;
+    }
+
+    return runningCRC;
+}
+
+bool irdfu_getOffer(const uint8_t **pp_image, uint16_t *p_version, uint32_t *p_size, uint16_t *p_crc) {
+    if (!offering) {
+	return false;
+    }
+
+    if (offerFromStaged) {
+	if (!irdfu_isStagedComplete()) {
+	    return false;
+	}
+	*pp_image = (const uint8_t *)IRDFU_BANK_1_START;
+	*p_version = (uint16_t)p_state->version;
+	*p_size = p_state->size;
+	*p_crc = (uint16_t)p_state->crc;
+    } else {
+	*pp_image = (const uint8_t *)IRDFU_BANK_0_START;
+	*p_version = FIRMWARE_VERSION;
+	*p_size = runningSize;
+	*p_crc = irdfu_getRunningCRC();
+    }
+
+    return true;
+}
+
+void irdfu_sendOffer() {
+    const uint8_t *p_image;
+    uint16_t version, crc;
+    uint32_t size;
+    char str[48];
+
+    if (!irdfu_getOffer(&p_image, &version, &size, &crc)) {
+	return;
+    }
+
+    /* Offer: fwo;<sender>;<version>;<size>;<crc>;<auto> */
+    snprintf(str, sizeof(str), "fwo;%04x;%04x;%lu;%04x;%u|", getNodeID(), version,
+	    (unsigned long)size, crc, offerAutoActivate ? 1 : 0);
+    message_sendToAllBut(0, IRTX_PRIORITY_CONTROL, str);
+}
+
+void irdfu_processOffer(uint8_t faceNum, const char *msg) {
+    unsigned int sender, version, crc, autoActivate;
+    unsigned long size;
+    uint32_t now_ms = curr_time_ms();
+
+    if (!initialized || rxActive || (flashOp != IRDFU_FLASH_IDLE)) {
+	return;
+    }
+
+    if (sscanf(msg, "fwo;%x;%x;%lu;%x;%u", &sender, &version, &size, &crc, &autoActivate) != 5) {
+	return;
+    }
+
+    /* Only strictly newer images are accepted, so that an image cannot be
+     * passed back and forth between modules which already run it. */
+    if ((version <= FIRMWARE_VERSION) || (size == 0) || (size > IRDFU_MAX_IMAGE_SIZE) || ((size & 0x03) != 0)) {
+	return;
+    }
+
+    /* The staging area must not overlap the code that is running */
+    if (IRDFU_BANK_0_START + runningSize > IRDFU_BANK_1_START) {
+	return;
+    }
+
+    rxFace = faceNum;
+    rxSenderID = sender;
+    rxRetries = 0;
+    openPage = IRDFU_NO_PAGE;
+
+    if (irdfu_isStateValid() && (p_state->version == version) && (p_state->size == size) &&
+	    (p_state->crc == crc)) {
+	if (p_state->complete == 0) {
+	    return;
+	}
+
+	/* Pick up where we left off with this image */
+	resumes++;
+	rxActive = true;
+	irdfu_requestNext();
+    } else if (irdfu_isStateValid() && (p_state->version >= version)) {
+	/* We are already staging another build of the same version, or a
+	 * newer one */
+	return;
+    } else {
+	writeBuf[0] = IRDFU_STATE_MAGIC;
+	writeBuf[1] = version;
+	writeBuf[2] = size;
+	writeBuf[3] = crc;
+	writeBuf[4] = autoActivate ? 1 : 0;
+
+	rxActive = true;
+	rxRequest_ms = now_ms;
+	if (!irdfu_startFlashOp(IRDFU_FLASH_ERASE_STATE)) {
+	    rxActive = false;
+	}
+    }
+}
+
+void irdfu_processRequest(uint8_t faceNum, const char *msg) {
+    unsigned int receiver, crc, chunk;
+    const uint8_t *p_image;
+    uint16_t version, offerCRC;
+    uint32_t size;
+
+    if (!initialized) {
+	return;
+    }
+
+    /* Request: fwn;<receiver>;<crc>;<chunk> */
+    if (sscanf(msg, "fwn;%x;%x;%u", &receiver, &crc, &chunk) != 3) {
+	return;
+    }
+
+    if (!irdfu_getOffer(&p_image, &version, &size, &offerCRC) || (crc != offerCRC) ||
+	    (irdfu_getChunkBytes(size, chunk) == 0)) {
+	return;
+    }
+
+    lastServed_ms = curr_time_ms();
+
+    if ((txFace != 0) || !irdfu_sendChunk(faceNum, chunk)) {
+	pendingChunks[faceNum - 1] = chunk;
+    }
+}
+
+bool irdfu_sendChunk(uint8_t faceNum, uint16_t chunk) {
+    const uint8_t *p_image;
+    uint16_t version, offerCRC, numBytes;
+    uint32_t size;
+
+    if (xfer_isBusy(faceNum) || !irdfu_getOffer(&p_image, &version, &size, &offerCRC)) {
+	return false;
+    }
+
+    numBytes = irdfu_getChunkBytes(size, chunk);
+    if (numBytes == 0) {
+	return false;
+    }
+
+    txBuf[0] = chunk & 0xFF;
+    txBuf[1] = (chunk >> 8) & 0xFF;
+    txBuf[2] = offerCRC & 0xFF;
+    txBuf[3] = (offerCRC >> 8) & 0xFF;
+    memcpy(&txBuf[4], &p_image[(uint32_t)chunk * IRDFU_CHUNK_SIZE], numBytes);
+
+    if (!xfer_send(faceNum, txBuf, 4 + numBytes, irdfu_txCallback)) {
+	return false;
+    }
+
+    txFace = faceNum;
+    chunksSent++;
+
+    return true;
+}
+
+void irdfu_txCallback(uint8_t faceNum, const xferResult_t *p_result) {
+    uint8_t i;
+    uint16_t chunk;
+
+    /* Failed chunks are requested again by the receiver.  Serve whichever
+     * face has been waiting, starting after this one. */
+    txFace = 0;
+
+    for (i = 1; i <= 6; i++) {
+	faceNum = (faceNum % 6) + 1;
+	chunk = pendingChunks[faceNum - 1];
+	if (chunk != IRDFU_NO_CHUNK) {
+	    pendingChunks[faceNum - 1] = IRDFU_NO_CHUNK;
+	    if (irdfu_sendChunk(faceNum, chunk)) {
+		break;
+	    }
+	}
+    }
+}
+
+void irdfu_rxHandler(uint8_t faceNum, uint16_t senderID, const uint8_t *data, uint16_t numBytes) {
+    uint16_t chunk, crc;
+    uint8_t page;
+
+    /* Payloads from other users of the transfer service are ignored */
+    if (!rxActive || (faceNum != rxFace) || (senderID != rxSenderID) || (numBytes < 4)) {
+	return;
+    }
+
+    chunk = data[0] | (data[1] << 8);
+    crc = data[2] | (data[3] << 8);
+
+    if ((crc != p_state->crc) || (chunk != rxChunk) || (numBytes - 4 != rxChunkBytes) ||
+	    (flashOp != IRDFU_FLASH_IDLE)) {
+	chunksRejected++;
+	return;
+    }
+
+    memcpy(writeBuf, &data[4], rxChunkBytes);
+
+    /* The first chunk of a page erases it, which also discards anything left
+     * from an earlier, interrupted attempt at the page. */
+    page = chunk / IRDFU_CHUNKS_PER_PAGE;
+    if (page != openPage) {
+	openPage = page;
+	irdfu_startFlashOp(IRDFU_FLASH_ERASE_PAGE);
+    } else {
+	irdfu_startFlashOp(IRDFU_FLASH_WRITE_CHUNK);
+    }
+}
+
+/**@brief Asks the sender for the next chunk we need, or verifies the image
+ * once every page has been written.
+ */
+void irdfu_requestNext() {
+    uint8_t page = irdfu_getPagesDone();
+    char str[32];
+
+    if (!rxActive) {
+	return;
+    }
+
+    if (page >= irdfu_getNumPages(p_state->size)) {
+	/* Every page is in place; check the image as a whole */
+	if (crc16_compute((const uint8_t *)IRDFU_BANK_1_START, p_state->size, NULL) == p_state->crc) {
+	    irdfu_startFlashOp(IRDFU_FLASH_MARK_COMPLETE);
+	} else {
+	    irdfu_startFlashOp(IRDFU_FLASH_DISCARD);
+	}
+	rxActive = false;
+	return;
+    }
+
+    if (page != openPage) {
+	openPage = IRDFU_NO_PAGE;
+	rxChunk = page * IRDFU_CHUNKS_PER_PAGE;
+    }
+    rxChunkBytes = irdfu_getChunkBytes(p_state->size, rxChunk);
+
+    /* Request: fwn;<receiver>;<crc>;<chunk> */
+    snprintf(str, sizeof(str), "fwn;%04x;%04x;%u|", getNodeID(), (uint16_t)p_state->crc, rxChunk);
+    irtx_queueString(rxFace, IRTX_PRIORITY_CONTROL, str);
+
+    rxRequest_ms = curr_time_ms();
+}
+
+bool irdfu_startFlashOp(irdfuFlashOp_t op) {
+    uint32_t err_code;
+
+    switch (op) {
+    case IRDFU_FLASH_ERASE_STATE:
+    case IRDFU_FLASH_DISCARD:
+	err_code = sd_flash_page_erase(IRDFU_STATE_PAGE_ADDR / IRDFU_PAGE_SIZE);
+	break;
+    case IRDFU_FLASH_WRITE_HEADER:
+	err_code = sd_flash_write((uint32_t *)IRDFU_STATE_PAGE_ADDR, writeBuf, IRDFU_HEADER_WORDS);
+	break;
+    case IRDFU_FLASH_ERASE_PAGE:
+	err_code = sd_flash_page_erase(IRDFU_BANK_1_START / IRDFU_PAGE_SIZE + openPage);
+	break;
+    case IRDFU_FLASH_WRITE_CHUNK:
+	err_code = sd_flash_write((uint32_t *)(IRDFU_BANK_1_START + (uint32_t)rxChunk * IRDFU_CHUNK_SIZE),
+		writeBuf, rxChunkBytes / 4);
+	break;
+    case IRDFU_FLASH_MARK_PAGE:
+	err_code = sd_flash_write((uint32_t *)&p_state->pageDone[openPage], &zeroWord, 1);
+	break;
+    case IRDFU_FLASH_MARK_COMPLETE:
+	err_code = sd_flash_write((uint32_t *)&p_state->complete, &zeroWord, 1);
+	break;
+    default:
+	return false;
+    }
+
+    if (err_code != NRF_SUCCESS) {
+	flashErrors++;
+	irdfu_flashFailed(op);
+	return false;
+    }
+
+    flashOp = op;
+    return true;
+}
+
+void irdfu_flashDone(irdfuFlashOp_t op) {
+    uint16_t pageBytes;
+
+    switch (op) {
+    case IRDFU_FLASH_ERASE_STATE:
+	irdfu_startFlashOp(IRDFU_FLASH_WRITE_HEADER);
+	break;
+    case IRDFU_FLASH_WRITE_HEADER:
+	irdfu_requestNext();
+	break;
+    case IRDFU_FLASH_ERASE_PAGE:
+	irdfu_startFlashOp(IRDFU_FLASH_WRITE_CHUNK);
+	break;
+    case IRDFU_FLASH_WRITE_CHUNK:
+	chunksReceived++;
+	rxRetries = 0;
+
+	/* Keep a CRC of the data we were sent for this page, and once the
+	 * page is full compare it with what actually reached the flash. */
+	if (rxChunk % IRDFU_CHUNKS_PER_PAGE == 0) {
+	    pageCRC = crc16_compute((const uint8_t *)writeBuf, rxChunkBytes, NULL);
+	} else {
+	    pageCRC = crc16_compute((const uint8_t *)writeBuf, rxChunkBytes, &pageCRC);
+	}
+	rxChunk++;
+
+	if ((rxChunk % IRDFU_CHUNKS_PER_PAGE == 0) || (irdfu_getChunkBytes(p_state->size, rxChunk) == 0)) {
+	    pageBytes = (uint16_t)((uint32_t)rxChunk * IRDFU_CHUNK_SIZE - (uint32_t)openPage * IRDFU_PAGE_SIZE);
+	    if (pageBytes > p_state->size - (uint32_t)openPage * IRDFU_PAGE_SIZE) {
+		pageBytes = (uint16_t)(p_state->size - (uint32_t)openPage * IRDFU_PAGE_SIZE);
+	    }
+
+	    if (crc16_compute((const uint8_t *)(IRDFU_BANK_1_START + (uint32_t)openPage * IRDFU_PAGE_SIZE),
+		    pageBytes, NULL) == pageCRC) {
+		irdfu_startFlashOp(IRDFU_FLASH_MARK_PAGE);
+		break;
+	    }
+
+	    pageCRCErrors++;
+	    openPage = IRDFU_NO_PAGE;
+	}
+	irdfu_requestNext();
+	break;
+    case IRDFU_FLASH_MARK_PAGE:
+	pagesWritten++;
+	openPage = IRDFU_NO_PAGE;
+	irdfu_requestNext();
+	break;
+    case IRDFU_FLASH_MARK_COMPLETE:
+	/* Pass the image on */
+	offering = true;
+	offerFromStaged = true;
+	offerAutoActivate = (p_state->autoActivate != 0);
+	stagedComplete_ms = curr_time_ms();
+	lastServed_ms = stagedComplete_ms;
+	nextOffer_ms = stagedComplete_ms;
+	break;
+    default:
+	break;
+    }
+}
+
+void irdfu_flashFailed(irdfuFlashOp_t op) {
+    switch (op) {
+    case IRDFU_FLASH_ERASE_STATE:
+    case IRDFU_FLASH_WRITE_HEADER:
+	rxActive = false;
+	break;
+    case IRDFU_FLASH_ERASE_PAGE:
+    case IRDFU_FLASH_WRITE_CHUNK:
+    case IRDFU_FLASH_MARK_PAGE:
+	/* Start the page again; the request times out and is repeated */
+	openPage = IRDFU_NO_PAGE;
+	break;
+    default:
+	break;
+    }
+}
+
+/**@brief Copies the staged image into bank 0, records it in the bootloader
+ * settings and resets.  This runs from RAM with interrupts disabled, since
+ * it overwrites the code which called it, and so must not call any other
+ * function.
+ */
+void irdfu_copyImage(uint32_t size, uint16_t crc) {
+    const uint32_t *p_src = (const uint32_t *)IRDFU_BANK_1_START;
+    volatile uint32_t *p_dst = (volatile uint32_t *)IRDFU_BANK_0_START;
+    volatile uint32_t *p_settings = (volatile uint32_t *)IRDFU_BOOTLOADER_SETTINGS_ADDR;
+    uint32_t offset, i;
+
+    for (offset = 0; offset < size; offset += IRDFU_PAGE_SIZE) {
+	NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Een << NVMC_CONFIG_WEN_Pos);
+	NRF_NVMC->ERASEPAGE = IRDFU_BANK_0_START + offset;
+	while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+
+	NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos);
+	for (i = offset / 4; (i < (offset + IRDFU_PAGE_SIZE) / 4) && (i < size / 4); i++) {
+	    p_dst[i] = p_src[i];
+	    while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+	}
+    }
+
+    /* Bootloader settings (bootloader_settings_t, as laid out by
+     * bin/appendBootloaderSettings.sh): bank 0 holds a valid application
+     * with the given CRC and size, and bank 1 holds nothing. */
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Een << NVMC_CONFIG_WEN_Pos);
+    NRF_NVMC->ERASEPAGE = IRDFU_BOOTLOADER_SETTINGS_ADDR;
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos);
+    p_settings[0] = 0x0000FF01 | ((uint32_t)crc << 16);
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+    p_settings[2] = size;
+    while (NRF_NVMC->READY == NVMC_READY_READY_Busy);
+
+    NRF_NVMC->CONFIG = (NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos);
+
+    SCB->AIRCR = (0x5FA << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+    while (1);
+}
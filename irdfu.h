@@ -0,0 +1,74 @@
+/*
+ * irdfu.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef IRDFU_H_
+#define IRDFU_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Flash layout shared with the bootloader (see dfu_types.h in the SDK).  The
+ * application runs from bank 0, and images received over IR are staged in
+ * bank 1.  The staging area stops short of the pages reserved for pstorage
+ * below the bootloader, and its last page records the progress of the
+ * transfer so that it can resume after an interruption. */
+#define IRDFU_PAGE_SIZE			0x400
+#define IRDFU_BANK_0_START		0x00020000
+#define IRDFU_BANK_1_START		0x0002E000
+#define IRDFU_STATE_PAGE_ADDR		0x0003B000
+#define IRDFU_MAX_IMAGE_SIZE		(IRDFU_STATE_PAGE_ADDR - IRDFU_BANK_1_START)
+#define IRDFU_MAX_PAGES			(IRDFU_MAX_IMAGE_SIZE / IRDFU_PAGE_SIZE)
+#define IRDFU_BOOTLOADER_SETTINGS_ADDR	0x0003FC00
+
+/* Images are sent in chunks of this many bytes, each of which is a single
+ * CRC-checked transfer (see xfer.h). */
+#define IRDFU_CHUNK_SIZE		128
+#define IRDFU_CHUNKS_PER_PAGE		(IRDFU_PAGE_SIZE / IRDFU_CHUNK_SIZE)
+
+typedef struct {
+    /* Image currently running from bank 0 */
+    uint16_t runningVersion;
+    uint32_t runningSize;
+    uint16_t runningCRC;
+    /* Image in the staging area, if any */
+    bool staged;
+    bool stagedComplete;
+    bool stagedAutoActivate;
+    uint16_t stagedVersion;
+    uint32_t stagedSize;
+    uint16_t stagedCRC;
+    uint8_t pagesDone;
+    uint8_t pagesTotal;
+    /* Face from which we are receiving an image, or 0 */
+    uint8_t rxFace;
+    /* Face to which we are sending a chunk, or 0 */
+    uint8_t txFace;
+    bool offering;
+    uint16_t chunksSent;
+    uint16_t chunksReceived;
+    uint16_t chunksRejected;
+    uint16_t pagesWritten;
+    uint16_t pageCRCErrors;
+    uint16_t resumes;
+    uint16_t flashErrors;
+} irdfuStatus_t;
+
+void irdfu_init(void);
+void irdfu_deinit(void);
+void irdfu_tick(void);
+
+bool irdfu_processMessage(uint8_t faceNum, const char *msg);
+void irdfu_onSysEvt(uint32_t sysEvt);
+bool irdfu_isFlashBusy(void);
+
+bool irdfu_startOffering(bool autoActivate);
+void irdfu_stop(void);
+bool irdfu_activate(void);
+
+void irdfu_getStatus(irdfuStatus_t *p_status);
+void irdfu_clearStats(void);
+
+#endif /* IRDFU_H_ */
@@ -0,0 +1,442 @@
+/*
+ * irlink.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "util.h"
+#include "fb.h"
+#include "irtx.h"
+#include "message.h"
+#include "neighbor.h"
+#include "irlink.h"
+
+/* The quality estimate moves 1/IRLINK_QUALITY_GAIN of the way towards 100%
+ * for each intact frame and towards 0% for each corrupt or duplicated one. */
+#define IRLINK_QUALITY_GAIN		8
+#define IRLINK_QUALITY_INITIAL_PERCENT	100
+
+/* One face's ambient light level is sampled every interval, so each face is
+ * sampled every six intervals.  The mean and noise estimates are filtered
+ * with a gain of 1/IRLINK_AMBIENT_GAIN and kept with 4 fractional bits. */
+#define IRLINK_AMBIENT_INTERVAL_MS	1000
+#define IRLINK_AMBIENT_GAIN		8
+
+/* A probe sends a burst of frames with each candidate LED selection, fewest
+ * LEDs first, and keeps the first selection with which enough of them are
+ * received by the neighbor. */
+#define IRLINK_PROBE_FRAMES		10
+#define IRLINK_PROBE_THRESHOLD_PERCENT	90
+#define IRLINK_PROBE_TIMEOUT_MS		1500
+#define IRLINK_PROBE_FAST_POLL_MS	1000
+
+/* A face is probed again when a different neighbor appears on it, or, no
+ * more often than the minimum interval, when the quality of its link or its
+ * ambient noise has become markedly worse than when it was last probed. */
+#define IRLINK_REPROBE_QUALITY_PERCENT	60
+#define IRLINK_REPROBE_MIN_INTERVAL_MS	60000
+
+typedef struct {
+    uint16_t framesReceived;
+    uint16_t framesCorrupt;
+    uint16_t duplicates;
+    uint8_t quality_percent;
+    int32_t ambient16;
+    uint16_t noise16;
+    bool ambientValid;
+
+    /* Results of the last probe */
+    bool probed;
+    uint16_t probedNeighborID;
+    uint16_t probedNoise16;
+    uint32_t probed_ms;
+    uint8_t probeDelivery_percent;
+
+    /* Probe frames received from the neighbor on this face */
+    uint16_t rxProbeSenderID;
+    uint8_t rxProbeID;
+    uint8_t rxProbeLEDs;
+    uint8_t rxProbeCount;
+} irlinkFace_t;
+
+/* Candidate LED selections, in the order in which they are tried */
+static const uint8_t probePatterns[] = {
+    0x01, 0x02, 0x04, 0x08,
+    0x03, 0x05, 0x06, 0x09, 0x0A, 0x0C,
+    0x07, 0x0B, 0x0D, 0x0E,
+    IRTX_LEDS_ALL
+};
+
+static bool initialized = false;
+
+static irlinkFace_t faces[6];
+
+static uint8_t probeRequests = 0x00;
+static uint8_t probeFace = 0;
+static uint8_t probeIndex;
+static uint8_t probeID = 0;
+static uint8_t probeFramesQueued;
+static bool probeWaiting;
+static uint32_t probeSent_ms;
+
+static uint8_t ambientFace = 1;
+static uint32_t lastAmbient_ms;
+
+static void irlink_sampleAmbient(uint8_t faceNum);
+static void irlink_checkReprobe(uint8_t faceNum, uint32_t now_ms);
+static void irlink_runProbe(uint32_t now_ms);
+static void irlink_finishPattern(uint8_t received);
+static void irlink_processProbe(uint8_t faceNum, const char *msg);
+static void irlink_processProbeStatus(uint8_t faceNum, const char *msg);
+static void irlink_processProbeResult(uint8_t faceNum, const char *msg);
+
+void irlink_init() {
+    uint8_t i;
+
+    for (i = 0; i < 6; i++) {
+	memset(&faces[i], 0, sizeof(irlinkFace_t));
+	faces[i].quality_percent = IRLINK_QUALITY_INITIAL_PERCENT;
+    }
+
+    /* The LED selections chosen by earlier probes remain in effect (they are
+     * kept by irtx), but they will be re-probed once the neighbors have been
+     * rediscovered. */
+    probeRequests = 0x00;
+    probeFace = 0;
+    lastAmbient_ms = curr_time_ms();
+
+    initialized = true;
+}
+
+void irlink_deinit() {
+    initialized = false;
+}
+
+void irlink_tick() {
+    uint32_t now_ms;
+    uint8_t faceNum;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    if (now_ms - lastAmbient_ms >= IRLINK_AMBIENT_INTERVAL_MS) {
+	lastAmbient_ms = now_ms;
+
+	irlink_sampleAmbient(ambientFace);
+	ambientFace = (ambientFace % 6) + 1;
+
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    irlink_checkReprobe(faceNum, now_ms);
+	}
+    }
+
+    irlink_runProbe(now_ms);
+}
+
+bool irlink_processMessage(uint8_t faceNum, const char *msg) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "lqp;", 4) == 0) {
+	irlink_processProbe(faceNum, msg);
+    } else if (strncmp(msg, "lqs;", 4) == 0) {
+	irlink_processProbeStatus(faceNum, msg);
+    } else if (strncmp(msg, "lqr;", 4) == 0) {
+	irlink_processProbeResult(faceNum, msg);
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+/**@brief Records the arrival of a frame (a '|'-terminated message) on a face.
+ *
+ * @param[in] intact  false if any of the frame's characters were discarded
+ *                    or it overflowed the receive buffer.
+ */
+void irlink_recordFrame(uint8_t faceNum, bool intact) {
+    irlinkFace_t *p_face;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return;
+    }
+
+    p_face = &faces[faceNum-1];
+    p_face->framesReceived++;
+
+    if (intact) {
+	p_face->quality_percent += (100 - p_face->quality_percent + IRLINK_QUALITY_GAIN - 1) / IRLINK_QUALITY_GAIN;
+    } else {
+	p_face->framesCorrupt++;
+	p_face->quality_percent -= (p_face->quality_percent + IRLINK_QUALITY_GAIN - 1) / IRLINK_QUALITY_GAIN;
+    }
+}
+
+/**@brief Records that a frame was received for a second time on a face, which
+ * means that its sender did not learn of the first copy's arrival.
+ */
+void irlink_recordDuplicate(uint8_t faceNum) {
+    irlinkFace_t *p_face;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return;
+    }
+
+    p_face = &faces[faceNum-1];
+    p_face->duplicates++;
+    p_face->quality_percent -= (p_face->quality_percent + IRLINK_QUALITY_GAIN - 1) / IRLINK_QUALITY_GAIN;
+}
+
+/**@brief Requests that the LEDs used by a face (or, for face 0, by every face
+ * with a neighbor) be chosen by probing the link.
+ */
+bool irlink_startProbe(uint8_t faceNum) {
+    neighbor_t neighbor;
+    uint8_t face;
+
+    if (!initialized || (faceNum > 6)) {
+	return false;
+    }
+
+    for (face = 1; face <= 6; face++) {
+	if (((faceNum == 0) || (face == faceNum)) && neighbor_get(face, &neighbor)) {
+	    probeRequests |= (1 << (face - 1));
+	}
+    }
+
+    return (probeRequests != 0x00);
+}
+
+bool irlink_getStatus(uint8_t faceNum, irlinkStatus_t *p_status) {
+    irlinkFace_t *p_face;
+    neighbor_t neighbor;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    /* Frames lost altogether never reach us to be counted, but the gaps they
+     * leave in the neighbor's beacon sequence numbers do. */
+    p_status->quality_percent = p_face->quality_percent;
+    if (neighbor_get(faceNum, &neighbor) && (neighbor.quality_percent < p_status->quality_percent)) {
+	p_status->quality_percent = neighbor.quality_percent;
+    }
+
+    p_status->framesReceived = p_face->framesReceived;
+    p_status->framesCorrupt = p_face->framesCorrupt;
+    p_status->duplicates = p_face->duplicates;
+    p_status->ambient = (p_face->ambient16 + 8) / 16;
+    p_status->noise = (p_face->noise16 + 8) / 16;
+    p_status->txLEDs = p_face->probed ? irtx_getTxLEDs(faceNum) : 0x00;
+    p_status->probeDelivery_percent = p_face->probeDelivery_percent;
+    p_status->probing = (probeFace == faceNum);
+
+    return true;
+}
+
+void irlink_sampleAmbient(uint8_t faceNum) {
+    irlinkFace_t *p_face = &faces[faceNum-1];
+    int16_t ambient;
+    int32_t deviation16;
+
+    ambient = fb_getAmbientLight(faceNum);
+    if (ambient < 0) {
+	return;
+    }
+
+    if (!p_face->ambientValid) {
+	p_face->ambient16 = 16 * (int32_t)ambient;
+	p_face->noise16 = 0;
+	p_face->ambientValid = true;
+	return;
+    }
+
+    p_face->ambient16 += (16 * (int32_t)ambient - p_face->ambient16) / IRLINK_AMBIENT_GAIN;
+    deviation16 = labs(16 * (int32_t)ambient - p_face->ambient16);
+    p_face->noise16 += (deviation16 - (int32_t)p_face->noise16) / IRLINK_AMBIENT_GAIN;
+}
+
+void irlink_checkReprobe(uint8_t faceNum, uint32_t now_ms) {
+    irlinkFace_t *p_face = &faces[faceNum-1];
+    irlinkStatus_t status;
+    neighbor_t neighbor;
+
+    if (!neighbor_get(faceNum, &neighbor) || (probeRequests & (1 << (faceNum - 1))) || (probeFace == faceNum)) {
+	return;
+    }
+
+    if (!p_face->probed || (neighbor.id != p_face->probedNeighborID)) {
+	probeRequests |= (1 << (faceNum - 1));
+	return;
+    }
+
+    if (now_ms - p_face->probed_ms < IRLINK_REPROBE_MIN_INTERVAL_MS) {
+	return;
+    }
+
+    irlink_getStatus(faceNum, &status);
+    if ((status.quality_percent < IRLINK_REPROBE_QUALITY_PERCENT) ||
+	(p_face->noise16 > 2 * p_face->probedNoise16 + 16)) {
+	probeRequests |= (1 << (faceNum - 1));
+    }
+}
+
+/**@brief Advances the probe state machine.  Only one face is probed at a
+ * time, and the LEDs are only changed once the face's transmit queue is empty
+ * so that the probe frames are the ones sent with the candidate selection.
+ * The frames are queued as space in the control queue allows.
+ */
+void irlink_runProbe(uint32_t now_ms) {
+    char str[32];
+
+    if (probeFace == 0) {
+	if (probeRequests == 0x00) {
+	    return;
+	}
+
+	for (probeFace = 1; !(probeRequests & (1 << (probeFace - 1))); probeFace++);
+	probeRequests &= ~(1 << (probeFace - 1));
+
+	probeID++;
+	probeIndex = 0;
+	probeFramesQueued = 0;
+	probeWaiting = false;
+    }
+
+    message_requestFastPoll(probeFace, IRLINK_PROBE_FAST_POLL_MS);
+
+    if (probeWaiting) {
+	if (now_ms - probeSent_ms > IRLINK_PROBE_TIMEOUT_MS) {
+	    /* Neither the probe status nor its result made it across */
+	    irlink_finishPattern(0);
+	}
+	return;
+    }
+
+    if (probeFramesQueued == 0) {
+	if (!irtx_isIdle(probeFace)) {
+	    return;
+	}
+
+	irtx_setTxLEDs(probeFace, probePatterns[probeIndex]);
+    }
+
+    /* Probe: lqp;<sender>;<probeID>;<leds>;<index> */
+    while (probeFramesQueued < IRLINK_PROBE_FRAMES) {
+	snprintf(str, sizeof(str), "lqp;%04x;%u;%u;%u|", getNodeID(), probeID, probePatterns[probeIndex], probeFramesQueued);
+	if (irtx_getQueueFreeSpace(probeFace, IRTX_PRIORITY_CONTROL) < strlen(str)) {
+	    return;
+	}
+	irtx_queueString(probeFace, IRTX_PRIORITY_CONTROL, str);
+	probeFramesQueued++;
+    }
+
+    /* Probe status: lqs;<sender>;<probeID>;<leds> */
+    snprintf(str, sizeof(str), "lqs;%04x;%u;%u|", getNodeID(), probeID, probePatterns[probeIndex]);
+    if (irtx_getQueueFreeSpace(probeFace, IRTX_PRIORITY_CONTROL) < strlen(str)) {
+	return;
+    }
+    irtx_queueString(probeFace, IRTX_PRIORITY_CONTROL, str);
+
+    probeWaiting = true;
+    probeSent_ms = now_ms;
+}
+
+/**@brief Accepts the current candidate LED selection if enough of its probe
+ * frames were received, and otherwise moves on to the next candidate.  If no
+ * candidate is good enough, all of the LEDs are used.
+ */
+void irlink_finishPattern(uint8_t received) {
+    irlinkFace_t *p_face = &faces[probeFace-1];
+    neighbor_t neighbor;
+    uint8_t delivery_percent;
+
+    probeWaiting = false;
+    probeFramesQueued = 0;
+
+    delivery_percent = (100 * (uint16_t)received) / IRLINK_PROBE_FRAMES;
+
+    if ((delivery_percent < IRLINK_PROBE_THRESHOLD_PERCENT) &&
+	(probeIndex + 1 < sizeof(probePatterns) / sizeof(probePatterns[0]))) {
+	probeIndex++;
+	return;
+    }
+
+    irtx_setTxLEDs(probeFace, probePatterns[probeIndex]);
+
+    p_face->probed = true;
+    p_face->probedNeighborID = neighbor_get(probeFace, &neighbor) ? neighbor.id : 0x0000;
+    p_face->probedNoise16 = p_face->noise16;
+    p_face->probed_ms = curr_time_ms();
+    p_face->probeDelivery_percent = delivery_percent;
+
+    probeFace = 0;
+}
+
+void irlink_processProbe(uint8_t faceNum, const char *msg) {
+    irlinkFace_t *p_face = &faces[faceNum-1];
+    unsigned int senderID, id, leds, index;
+
+    if (sscanf(msg, "lqp;%x;%u;%u;%u", &senderID, &id, &leds, &index) != 4) {
+	return;
+    }
+
+    if ((senderID != p_face->rxProbeSenderID) || (id != p_face->rxProbeID) || (leds != p_face->rxProbeLEDs)) {
+	p_face->rxProbeSenderID = senderID;
+	p_face->rxProbeID = id;
+	p_face->rxProbeLEDs = leds;
+	p_face->rxProbeCount = 0;
+    }
+
+    p_face->rxProbeCount++;
+
+    message_requestFastPoll(faceNum, IRLINK_PROBE_FAST_POLL_MS);
+}
+
+void irlink_processProbeStatus(uint8_t faceNum, const char *msg) {
+    irlinkFace_t *p_face = &faces[faceNum-1];
+    unsigned int senderID, id, leds;
+    uint8_t count = 0;
+    char str[32];
+
+    if (sscanf(msg, "lqs;%x;%u;%u", &senderID, &id, &leds) != 3) {
+	return;
+    }
+
+    if ((senderID == p_face->rxProbeSenderID) && (id == p_face->rxProbeID) && (leds == p_face->rxProbeLEDs)) {
+	count = p_face->rxProbeCount;
+    }
+
+    /* Probe result: lqr;<sender>;<probeID>;<leds>;<count> */
+    snprintf(str, sizeof(str), "lqr;%04x;%u;%u;%u|", senderID, id, leds, count);
+    irtx_queueString(faceNum, IRTX_PRIORITY_CONTROL, str);
+}
+
+void irlink_processProbeResult(uint8_t faceNum, const char *msg) {
+    unsigned int senderID, id, leds, count;
+
+    if (sscanf(msg, "lqr;%x;%u;%u;%u", &senderID, &id, &leds, &count) != 4) {
+	return;
+    }
+
+    if (!initialized || (faceNum != probeFace) || !probeWaiting || (senderID != getNodeID()) ||
+	(id != probeID) || (leds != probePatterns[probeIndex])) {
+	return;
+    }
+
+    irlink_finishPattern((count > IRLINK_PROBE_FRAMES) ? IRLINK_PROBE_FRAMES : count);
+}
@@ -0,0 +1,42 @@
+/*
+ * irlink.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef IRLINK_H_
+#define IRLINK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    /* Estimated percentage of frames on this link which arrive intact */
+    uint8_t quality_percent;
+    uint16_t framesReceived;
+    uint16_t framesCorrupt;
+    uint16_t duplicates;
+    /* Mean ambient light level and its mean absolute deviation */
+    uint16_t ambient;
+    uint16_t noise;
+    /* LEDs selected by the last probe (bit n for LED n+1), or 0 if the face
+     * has not been probed */
+    uint8_t txLEDs;
+    /* Percentage of probe frames delivered using the selected LEDs */
+    uint8_t probeDelivery_percent;
+    bool probing;
+} irlinkStatus_t;
+
+void irlink_init(void);
+void irlink_deinit(void);
+void irlink_tick(void);
+
+bool irlink_processMessage(uint8_t faceNum, const char *msg);
+
+void irlink_recordFrame(uint8_t faceNum, bool intact);
+void irlink_recordDuplicate(uint8_t faceNum);
+
+bool irlink_startProbe(uint8_t faceNum);
+bool irlink_getStatus(uint8_t faceNum, irlinkStatus_t *p_status);
+
+#endif /* IRLINK_H_ */
@@ -0,0 +1,608 @@
+/*
+ * irtx.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_error.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "util.h"
+#include "fifo.h"
+#include "fb.h"
+#include "neighbor.h"
+#include "timesync.h"
+#include "irtx.h"
+
+#define IRTX_DRAIN_INTERVAL_MS		20
+
+/* After a face finds the channel busy, or sees a collision, it waits a random
+ * number of frames, up to 2^n for the n-th consecutive failure, before it
+ * tries again. */
+#define IRTX_MAC_MAX_BACKOFF_EXP	4
+
+/* The neighbor is taken to be transmitting if we have seen bytes arrive from
+ * it within this long.  While a face has data waiting, its receive count is
+ * sampled on every drain, so this covers the time between two samples. */
+#define IRTX_CARRIER_HOLD_MS		(2 * IRTX_DRAIN_INTERVAL_MS)
+
+static bool initialized = false;
+
+/* The drain timer is single-shot, and only runs while data is queued, so that
+ * an idle module is not woken every IRTX_DRAIN_INTERVAL_MS. */
+static app_timer_id_t irtx_timerID = TIMER_NULL;
+static bool timerRunning = false;
+static uint32_t timerWakeups;
+
+static uint8_t controlQueueData[6][IRTX_CONTROL_QUEUE_SIZE];
+static uint8_t bulkQueueData[6][IRTX_BULK_QUEUE_SIZE];
+static fifo_t txQueues[6][IRTX_PRIORITY_COUNT];
+
+/* Messages are never interleaved on the IR link, so once we have started
+ * sending a message, we remember its priority and how many of its bytes
+ * remain so that the rest of it is sent before anything else. */
+static irtxPriority_t currentPriority[6];
+static uint8_t currentRemaining[6];
+
+/* The IR LEDs with which each face should transmit, and those that were last
+ * selected on its faceboard.  The table is kept through sleep, but it is
+ * re-applied afterwards, since the faceboards may have forgotten it. */
+static uint8_t txLEDs[6] = {IRTX_LEDS_DEFAULT};
+static uint8_t appliedLEDs[6];
+
+static irtxStats_t stats[6];
+
+static bool macEnabled = true;
+static uint8_t backoffExp[6];
+static uint32_t backoffUntil_ms[6];
+/* Receive buffer count at the last carrier sense on each face, and the last
+ * time at which bytes were seen arriving on it */
+static uint8_t lastRxCount[6];
+static uint32_t lastRxActivity_ms[6];
+
+static void irtx_timerHandler(void *p_context);
+static void irtx_startTimer(void);
+static bool irtx_drain(uint8_t faceNum, bool scheduled);
+static bool irtx_mayStart(uint8_t faceNum);
+static uint32_t irtx_hash(uint32_t x);
+
+void irtx_init() {
+    uint32_t err_code;
+    uint8_t faceNum;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	fifo_init(&txQueues[faceNum-1][IRTX_PRIORITY_CONTROL], controlQueueData[faceNum-1], IRTX_CONTROL_QUEUE_SIZE);
+	fifo_init(&txQueues[faceNum-1][IRTX_PRIORITY_BULK], bulkQueueData[faceNum-1], IRTX_BULK_QUEUE_SIZE);
+	currentRemaining[faceNum-1] = 0;
+	appliedLEDs[faceNum-1] = IRTX_LEDS_DEFAULT;
+	backoffExp[faceNum-1] = 0;
+	backoffUntil_ms[faceNum-1] = curr_time_ms();
+	lastRxCount[faceNum-1] = 0;
+	lastRxActivity_ms[faceNum-1] = curr_time_ms() - IRTX_CARRIER_HOLD_MS;
+    }
+
+    if (irtx_timerID == TIMER_NULL) {
+	err_code = app_timer_create(&irtx_timerID, APP_TIMER_MODE_SINGLE_SHOT, irtx_timerHandler);
+	APP_ERROR_CHECK(err_code);
+    }
+
+    initialized = true;
+
+    if (!irtx_isIdle(0)) {
+	irtx_startTimer();
+    }
+}
+
+void irtx_deinit() {
+    uint32_t err_code;
+
+    if (!initialized) {
+	return;
+    }
+
+    if (irtx_timerID != TIMER_NULL) {
+	err_code = app_timer_stop(irtx_timerID);
+	APP_ERROR_CHECK(err_code);
+	timerRunning = false;
+    }
+
+    /* Anything still queued is discarded. */
+    irtx_flush(0);
+
+    initialized = false;
+}
+
+bool irtx_queue(uint8_t faceNum, irtxPriority_t priority, uint8_t numBytes, const uint8_t *bytes) {
+    uint8_t face, firstFace, lastFace;
+    fifoSize_t len;
+
+    if ((faceNum > 6) || (priority >= IRTX_PRIORITY_COUNT)) {
+	return false;
+    }
+
+    if (!initialized) {
+	irtx_init();
+    }
+
+    /* As with the faceboard functions, a face number of 0 sends the message
+     * from all faces. */
+    if (faceNum == 0) {
+	firstFace = 1;
+	lastFace = 6;
+    } else {
+	firstFace = lastFace = faceNum;
+    }
+
+    /* A message is either queued in its entirety on every requested face or
+     * not at all, so that the receiver never sees a truncated message. */
+    for (face = firstFace; face <= lastFace; face++) {
+	if (fifo_getFreeSpace(&txQueues[face-1][priority]) < 1 + numBytes) {
+	    stats[face-1].messagesDropped++;
+	    return false;
+	}
+    }
+
+    for (face = firstFace; face <= lastFace; face++) {
+	len = 1;
+	fifo_push(&txQueues[face-1][priority], &numBytes, &len);
+	len = numBytes;
+	fifo_push(&txQueues[face-1][priority], bytes, &len);
+	stats[face-1].messagesQueued++;
+    }
+
+    irtx_startTimer();
+
+    return true;
+}
+
+bool irtx_queueString(uint8_t faceNum, irtxPriority_t priority, const char *str) {
+    size_t len;
+
+    len = strlen(str);
+    if (len > UINT8_MAX) {
+	return false;
+    }
+
+    return irtx_queue(faceNum, priority, (uint8_t)len, (const uint8_t *)str);
+}
+
+uint16_t irtx_getQueueFreeSpace(uint8_t faceNum, irtxPriority_t priority) {
+    fifoSize_t freeSpace;
+
+    if ((faceNum < 1) || (faceNum > 6) || (priority >= IRTX_PRIORITY_COUNT)) {
+	return 0;
+    }
+
+    /* Account for the length byte that accompanies each message */
+    freeSpace = fifo_getFreeSpace(&txQueues[faceNum-1][priority]);
+    if (freeSpace < 1) {
+	return 0;
+    }
+
+    return freeSpace - 1;
+}
+
+bool irtx_isIdle(uint8_t faceNum) {
+    uint8_t face;
+    irtxPriority_t priority;
+
+    if (faceNum > 6) {
+	return true;
+    }
+
+    for (face = 1; face <= 6; face++) {
+	if ((faceNum != 0) && (face != faceNum)) {
+	    continue;
+	}
+
+	for (priority = 0; priority < IRTX_PRIORITY_COUNT; priority++) {
+	    if (fifo_getUsedSpace(&txQueues[face-1][priority]) > 0) {
+		return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+void irtx_flush(uint8_t faceNum) {
+    uint8_t face;
+    irtxPriority_t priority;
+
+    for (face = 1; face <= 6; face++) {
+	if ((faceNum != 0) && (face != faceNum)) {
+	    continue;
+	}
+
+	for (priority = 0; priority < IRTX_PRIORITY_COUNT; priority++) {
+	    fifo_purge(&txQueues[face-1][priority]);
+	}
+
+	currentRemaining[face-1] = 0;
+    }
+}
+
+/**@brief Selects the IR LEDs (bit n for LED n+1) with which a face transmits
+ * from now on.  The selection is sent to the faceboard before the face's next
+ * write to its transmit buffer.
+ */
+bool irtx_setTxLEDs(uint8_t faceNum, uint8_t ledMask) {
+    if ((faceNum < 1) || (faceNum > 6) || (ledMask > IRTX_LEDS_ALL)) {
+	return false;
+    }
+
+    txLEDs[faceNum-1] = ledMask;
+
+    return true;
+}
+
+uint8_t irtx_getTxLEDs(uint8_t faceNum) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return IRTX_LEDS_DEFAULT;
+    }
+
+    return txLEDs[faceNum-1];
+}
+
+/**@brief Enables or disables medium access control.  While it is disabled,
+ * queued messages are written to the faceboards as soon as there is room for
+ * them, whatever the neighbors are doing.
+ */
+void irtx_setMACEnabled(bool enabled) {
+    macEnabled = enabled;
+}
+
+bool irtx_isMACEnabled() {
+    return macEnabled;
+}
+
+/**@brief Returns the slot (0 to IRTX_MAC_SLOT_COUNT - 1) in which the given
+ * face may start transmitting.
+ *
+ * The slot is derived from our node ID and the face number.  Once the
+ * neighbor on the face is known, both ends of the link derive the same pair of
+ * slots from their IDs and faces, and the module with the lower ID takes the
+ * first of them, so that the two never start transmitting at once.
+ */
+uint8_t irtx_getSlot(uint8_t faceNum) {
+    neighbor_t neighbor;
+    uint32_t key;
+    uint8_t pair;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return 0;
+    }
+
+    if (!neighbor_get(faceNum, &neighbor) || (neighbor.id == getNodeID())) {
+	return irtx_hash(((uint32_t)getNodeID() << 8) | faceNum) % IRTX_MAC_SLOT_COUNT;
+    }
+
+    if (getNodeID() < neighbor.id) {
+	key = ((uint32_t)getNodeID() << 16) ^ ((uint32_t)faceNum << 12) ^ ((uint32_t)neighbor.face << 8) ^ neighbor.id;
+    } else {
+	key = ((uint32_t)neighbor.id << 16) ^ ((uint32_t)neighbor.face << 12) ^ ((uint32_t)faceNum << 8) ^ getNodeID();
+    }
+
+    pair = irtx_hash(key) % (IRTX_MAC_SLOT_COUNT / 2);
+
+    return 2 * pair + ((getNodeID() < neighbor.id) ? 0 : 1);
+}
+
+/**@brief Tells carrier sense that the messaging layer has just read bytes
+ * from the given face's receive buffer, which both shows that the neighbor
+ * has been transmitting and resets the buffer's count.
+ */
+void irtx_noteReceived(uint8_t faceNum) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return;
+    }
+
+    lastRxCount[faceNum-1] = 0;
+    lastRxActivity_ms[faceNum-1] = curr_time_ms();
+}
+
+/**@brief Carrier sense: returns whether the neighbor on the given face is
+ * transmitting, i.e. whether the faceboard's receive count has risen since we
+ * last looked, or the messaging layer has read bytes from it, within the last
+ * IRTX_CARRIER_HOLD_MS.
+ *
+ * This only works while the receiver is enabled; if the count cannot be read,
+ * only the bytes read by the messaging layer are seen.
+ */
+bool irtx_isReceiving(uint8_t faceNum) {
+    uint32_t now_ms;
+    uint8_t count;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    now_ms = curr_time_ms();
+
+    if (fb_getRxBufferConsumedCount(faceNum, &count)) {
+	if (count > lastRxCount[faceNum-1]) {
+	    lastRxActivity_ms[faceNum-1] = now_ms;
+	}
+	lastRxCount[faceNum-1] = count;
+    }
+
+    return (now_ms - lastRxActivity_ms[faceNum-1] < IRTX_CARRIER_HOLD_MS);
+}
+
+/**@brief Makes the given face wait a random number of frames before it next
+ * starts a message.  The wait grows with each consecutive failure.
+ *
+ * This is called when the channel is found busy, and by the receive path when
+ * a corrupted frame suggests that our transmissions collided with the
+ * neighbor's.
+ */
+void irtx_backoff(uint8_t faceNum) {
+    uint8_t frames;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return;
+    }
+
+    if (backoffExp[faceNum-1] < IRTX_MAC_MAX_BACKOFF_EXP) {
+	backoffExp[faceNum-1]++;
+    }
+
+    frames = 1 + (rand() % (1 << backoffExp[faceNum-1]));
+    backoffUntil_ms[faceNum-1] = curr_time_ms() + (uint32_t)frames * IRTX_MAC_FRAME_MS;
+    stats[faceNum-1].backoffCount++;
+}
+
+bool irtx_getStats(uint8_t faceNum, irtxStats_t *p_stats) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    *p_stats = stats[faceNum-1];
+
+    return true;
+}
+
+void irtx_clearStats() {
+    memset(stats, 0, sizeof(stats));
+    timerWakeups = 0;
+}
+
+/**@brief Returns how often the drain timer has fired since the statistics
+ * were last cleared.
+ */
+uint32_t irtx_getTimerWakeups() {
+    return timerWakeups;
+}
+
+/**@brief Starts the drain timer, unless it is already running. */
+void irtx_startTimer() {
+    uint32_t err_code;
+
+    if (timerRunning || (irtx_timerID == TIMER_NULL)) {
+	return;
+    }
+
+    err_code = app_timer_start(irtx_timerID, APP_TIMER_TICKS(IRTX_DRAIN_INTERVAL_MS, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+    timerRunning = true;
+}
+
+void irtx_timerHandler(void *p_context) {
+    uint8_t faceNum;
+
+    timerRunning = false;
+    timerWakeups++;
+
+    /* Timer handlers are executed from the scheduler, so the queues are only
+     * ever drained from the main context and never while another module is
+     * in the middle of a TWI transfer. */
+    if (!initialized) {
+	return;
+    }
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	irtx_drain(faceNum, true);
+    }
+
+    /* Data that is still queued, whether for lack of room on the faceboard
+     * or because its face is backing off or waiting for its slot, is retried
+     * on the next firing.  Once every face is idle, the timer stays off until
+     * irtx_queue() adds more. */
+    if (!irtx_isIdle(0)) {
+	irtx_startTimer();
+    }
+}
+
+/**@brief Writes as much of the given face's queued data to its faceboard as
+ * the faceboard currently has room for.
+ *
+ * The queues are drained periodically, subject to medium access control, but
+ * a caller that wants a message to leave immediately (e.g. to time-stamp its
+ * transmission) may call this directly after queueing the message.  Such
+ * writes bypass medium access control, so they only start control messages;
+ * bulk data waits for the face's slot rather than ride along and keep the
+ * channel busy while the neighbor answers the urgent message.  The answer
+ * usually bypasses medium access control too, so the face then leaves the
+ * channel to the neighbor for a frame.
+ */
+bool irtx_drainFace(uint8_t faceNum) {
+    uint32_t until_ms;
+
+    if (!irtx_drain(faceNum, false)) {
+	return false;
+    }
+
+    until_ms = curr_time_ms() + IRTX_MAC_FRAME_MS;
+    if ((int32_t)(until_ms - backoffUntil_ms[faceNum-1]) > 0) {
+	backoffUntil_ms[faceNum-1] = until_ms;
+    }
+
+    return true;
+}
+
+/**@brief Decides whether a face may start a new message now.  It must be the
+ * face's slot, any backoff must have expired, and the neighbor must not be
+ * transmitting to us.
+ *
+ * Slots are timed by cluster time once it is synchronized, so that both ends
+ * of a link agree on them.  Until then, each module uses its own clock, and
+ * the slots merely limit the time for which a face may start transmitting.
+ */
+bool irtx_mayStart(uint8_t faceNum) {
+    uint32_t now_ms, t_ms;
+    bool busy;
+
+    now_ms = curr_time_ms();
+    if ((int32_t)(now_ms - backoffUntil_ms[faceNum-1]) < 0) {
+	return false;
+    }
+
+    /* The carrier is sensed on every drain, not just in our slot, so that old
+     * traffic is not mistaken for current activity. */
+    busy = irtx_isReceiving(faceNum);
+
+    t_ms = timesync_isSynchronized() ? timesync_getClusterTime_ms() : now_ms;
+    if ((t_ms / IRTX_MAC_SLOT_MS) % IRTX_MAC_SLOT_COUNT != irtx_getSlot(faceNum)) {
+	return false;
+    }
+
+    if (busy) {
+	stats[faceNum-1].carrierBusyCount++;
+	irtx_backoff(faceNum);
+	return false;
+    }
+
+    return true;
+}
+
+bool irtx_drain(uint8_t faceNum, bool scheduled) {
+    uint8_t chunk[FB_TX_MAX_BYTES];
+    fifoSize_t consumed[IRTX_PRIORITY_COUNT];
+    fifoSize_t len;
+    uint8_t bytesAvailable, room, chunkLen;
+    uint8_t msgLen;
+    uint8_t remaining;
+    irtxPriority_t priority, p;
+    irtxPriority_t priorityLimit = scheduled ? IRTX_PRIORITY_COUNT : IRTX_PRIORITY_BULK;
+
+    if ((faceNum < 1) || (faceNum > 6) || !initialized) {
+	return false;
+    }
+
+    if (irtx_isIdle(faceNum)) {
+	return true;
+    }
+
+    /* A message that has been started is always finished, but new messages
+     * wait for the face's turn. */
+    if (scheduled && macEnabled && (currentRemaining[faceNum-1] == 0) && !irtx_mayStart(faceNum)) {
+	return true;
+    }
+
+    if (!fb_getTxBufferAvailableCount(faceNum, &bytesAvailable)) {
+	stats[faceNum-1].twiErrorCount++;
+	return false;
+    }
+
+    /* The padding that precedes each write occupies space in the faceboard's
+     * buffer, too.  If there is no room for any data beyond the padding, we
+     * wait for the faceboard to transmit what it already has. */
+    if (bytesAvailable <= FB_TX_PAD_BYTES) {
+	stats[faceNum-1].bufferFullCount++;
+	return true;
+    }
+
+    room = bytesAvailable - FB_TX_PAD_BYTES;
+    if (room > FB_TX_MAX_BYTES) {
+	room = FB_TX_MAX_BYTES;
+    }
+
+    /* Fill the chunk by peeking into the queues so that nothing is removed
+     * from them until the faceboard has accepted the data. */
+    for (priority = 0; priority < IRTX_PRIORITY_COUNT; priority++) {
+	consumed[priority] = 0;
+    }
+
+    priority = currentPriority[faceNum-1];
+    remaining = currentRemaining[faceNum-1];
+    chunkLen = 0;
+
+    while (chunkLen < room) {
+	if (remaining == 0) {
+	    /* Start the highest priority message that is waiting */
+	    for (priority = 0; priority < priorityLimit; priority++) {
+		if (fifo_getUsedSpace(&txQueues[faceNum-1][priority]) > consumed[priority]) {
+		    break;
+		}
+	    }
+
+	    if (priority == priorityLimit) {
+		break;
+	    }
+
+	    len = 1;
+	    fifo_peekAt(&txQueues[faceNum-1][priority], consumed[priority], &msgLen, &len);
+	    consumed[priority] += len;
+	    remaining = msgLen;
+	    continue;
+	}
+
+	len = room - chunkLen;
+	if (len > remaining) {
+	    len = remaining;
+	}
+
+	fifo_peekAt(&txQueues[faceNum-1][priority], consumed[priority], &chunk[chunkLen], &len);
+	consumed[priority] += len;
+	chunkLen += len;
+	remaining -= len;
+    }
+
+    if ((chunkLen > 0) && (txLEDs[faceNum-1] != IRTX_LEDS_DEFAULT) && (txLEDs[faceNum-1] != appliedLEDs[faceNum-1])) {
+	if (!fb_setIRTxLEDs(faceNum, txLEDs[faceNum-1] & 0x01, txLEDs[faceNum-1] & 0x02,
+		txLEDs[faceNum-1] & 0x04, txLEDs[faceNum-1] & 0x08)) {
+	    stats[faceNum-1].twiErrorCount++;
+	    return false;
+	}
+	appliedLEDs[faceNum-1] = txLEDs[faceNum-1];
+    }
+
+    if ((chunkLen > 0) && !fb_sendToTxBuffer(faceNum, chunkLen, chunk)) {
+	stats[faceNum-1].twiErrorCount++;
+	if (scheduled) {
+	    irtx_backoff(faceNum);
+	}
+	return false;
+    }
+
+    for (p = 0; p < IRTX_PRIORITY_COUNT; p++) {
+	fifo_discard(&txQueues[faceNum-1][p], &consumed[p]);
+    }
+
+    if (remaining > 0) {
+	currentPriority[faceNum-1] = priority;
+    }
+    currentRemaining[faceNum-1] = remaining;
+
+    if (chunkLen > 0) {
+	stats[faceNum-1].bytesSent += chunkLen;
+	stats[faceNum-1].chunksSent++;
+	backoffExp[faceNum-1] = 0;
+    }
+
+    return true;
+}
+
+/**@brief Mixes the bits of a key so that similar keys give unrelated slots. */
+uint32_t irtx_hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x45D9F3B;
+    x ^= x >> 16;
+    return x;
+}
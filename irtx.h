@@ -0,0 +1,71 @@
+/*
+ * irtx.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef IRTX_H_
+#define IRTX_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Size, in bytes, of the software transmit queues kept for each face.  Each
+ * queued message also occupies one byte of queue space for its length. */
+#define IRTX_CONTROL_QUEUE_SIZE		64
+#define IRTX_BULK_QUEUE_SIZE		128
+
+/* Transmit LED selection (bit n for LED n+1) meaning that the faceboard's own
+ * selection should be left alone */
+#define IRTX_LEDS_DEFAULT		0x00
+#define IRTX_LEDS_ALL			0x0F
+
+typedef enum {
+    IRTX_PRIORITY_CONTROL = 0,
+    IRTX_PRIORITY_BULK,
+    IRTX_PRIORITY_COUNT
+} irtxPriority_t;
+
+/* Medium access: time is divided into frames of IRTX_MAC_SLOT_COUNT slots,
+ * and a face only starts new messages in its own slot. */
+#define IRTX_MAC_SLOT_MS		40
+#define IRTX_MAC_SLOT_COUNT		4
+#define IRTX_MAC_FRAME_MS		(IRTX_MAC_SLOT_MS * IRTX_MAC_SLOT_COUNT)
+
+typedef struct {
+    uint32_t bytesSent;
+    uint32_t chunksSent;
+    uint16_t messagesQueued;
+    uint16_t messagesDropped;
+    uint16_t bufferFullCount;
+    uint16_t twiErrorCount;
+    /* Times the face found its neighbor transmitting when its slot came */
+    uint16_t carrierBusyCount;
+    uint16_t backoffCount;
+} irtxStats_t;
+
+void irtx_init(void);
+void irtx_deinit(void);
+
+bool irtx_queue(uint8_t faceNum, irtxPriority_t priority, uint8_t numBytes, const uint8_t *bytes);
+bool irtx_queueString(uint8_t faceNum, irtxPriority_t priority, const char *str);
+uint16_t irtx_getQueueFreeSpace(uint8_t faceNum, irtxPriority_t priority);
+bool irtx_isIdle(uint8_t faceNum);
+bool irtx_drainFace(uint8_t faceNum);
+void irtx_flush(uint8_t faceNum);
+
+void irtx_setMACEnabled(bool enabled);
+bool irtx_isMACEnabled(void);
+uint8_t irtx_getSlot(uint8_t faceNum);
+void irtx_noteReceived(uint8_t faceNum);
+bool irtx_isReceiving(uint8_t faceNum);
+void irtx_backoff(uint8_t faceNum);
+
+bool irtx_setTxLEDs(uint8_t faceNum, uint8_t ledMask);
+uint8_t irtx_getTxLEDs(uint8_t faceNum);
+
+bool irtx_getStats(uint8_t faceNum, irtxStats_t *p_stats);
+void irtx_clearStats(void);
+uint32_t irtx_getTimerWakeups(void);
+
+#endif /* IRTX_H_ */
@@ -0,0 +1,324 @@
+/*
+ * leader.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrf_delay.h"
+
+#include "global.h"
+#include "util.h"
+#include "irtx.h"
+#include "message.h"
+#include "leader.h"
+
+/* The leader floods a heartbeat through the cluster at a fixed interval.  If
+ * no heartbeat arrives for the timeout, the leader is presumed to have
+ * failed. */
+#define LEADER_HEARTBEAT_INTERVAL_MS	4000
+#define LEADER_TIMEOUT_MS		(3 * LEADER_HEARTBEAT_INTERVAL_MS + 3000)
+#define LEADER_MAX_HOPS			32
+
+/* Before a module which has lost its leader starts an election, it waits a
+ * random time, so that usually only one module starts the new epoch and the
+ * rest simply respond to it.  After booting, modules listen for an existing
+ * leader before standing themselves. */
+#define LEADER_ELECTION_JITTER_MS	1000
+#define LEADER_STARTUP_DELAY_MS		(2 * LEADER_HEARTBEAT_INTERVAL_MS)
+
+/* A leader which learns of a rival in its own epoch answers with an early
+ * heartbeat, but no more often than this. */
+#define LEADER_MIN_HEARTBEAT_SPACING_MS	1000
+
+/* Time allowed for a resignation to leave the faceboards before they sleep */
+#define LEADER_RESIGN_DELAY_MS		50
+
+static bool initialized = false;
+
+/* The epoch persists through sleep, so that a module which wakes does not
+ * disrupt the cluster by starting an election in an epoch long past. */
+static uint16_t epoch = 0;
+static uint16_t leaderID;
+static bool haveLeader = false;
+static uint8_t hops;
+
+static uint32_t lastHeartbeat_ms;
+static uint32_t nextHeartbeat_ms;
+static uint8_t heartbeatSeq = 0;
+
+static bool electionPending;
+static uint32_t electionDeadline_ms;
+static uint32_t epochStart_ms;
+static uint32_t convergence_ms = 0;
+
+static uint16_t electionsStarted = 0;
+static uint16_t leaderChanges = 0;
+static uint16_t heartbeatsSent = 0;
+static uint16_t heartbeatsRelayed = 0;
+
+static void leader_scheduleElection(uint32_t delay_ms);
+static void leader_setLeader(uint16_t newLeaderID, uint8_t newHops);
+static void leader_sendHeartbeat(void);
+static void leader_processHeartbeat(uint8_t faceNum, const char *msg);
+static void leader_processResignation(uint8_t faceNum, const char *msg);
+
+void leader_init() {
+    uint32_t now_ms = curr_time_ms();
+
+    /* Whatever we knew before sleeping is out of date, so we listen for the
+     * current leader (who may be us) before doing anything else. */
+    haveLeader = false;
+    lastHeartbeat_ms = now_ms;
+    nextHeartbeat_ms = now_ms;
+    epochStart_ms = now_ms;
+
+    initialized = true;
+
+    leader_scheduleElection(LEADER_STARTUP_DELAY_MS);
+}
+
+void leader_deinit() {
+    initialized = false;
+}
+
+void leader_tick() {
+    uint32_t now_ms;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    if (leader_isLeader()) {
+	if ((int32_t)(now_ms - nextHeartbeat_ms) >= 0) {
+	    leader_sendHeartbeat();
+	}
+	return;
+    }
+
+    if (haveLeader && !electionPending && (now_ms - lastHeartbeat_ms > LEADER_TIMEOUT_MS)) {
+	/* The leader has gone silent */
+	haveLeader = false;
+	leader_scheduleElection(0);
+    }
+
+    if (electionPending && ((int32_t)(now_ms - electionDeadline_ms) >= 0)) {
+	leader_startElection();
+    }
+}
+
+bool leader_processMessage(uint8_t faceNum, const char *msg) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "ldh;", 4) == 0) {
+	leader_processHeartbeat(faceNum, msg);
+    } else if (strncmp(msg, "ldr;", 4) == 0) {
+	leader_processResignation(faceNum, msg);
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+bool leader_isLeader() {
+    return (haveLeader && (leaderID == getNodeID()));
+}
+
+/**@brief Returns the ID of the current leader, or 0xFFFF if there is none. */
+uint16_t leader_getLeaderID() {
+    return haveLeader ? leaderID : 0xFFFF;
+}
+
+void leader_getStatus(leaderStatus_t *p_status) {
+    p_status->haveLeader = haveLeader;
+    p_status->leaderID = leaderID;
+    p_status->epoch = epoch;
+    p_status->hops = hops;
+    p_status->lastHeartbeatAge_ms = curr_time_ms() - lastHeartbeat_ms;
+    p_status->convergence_ms = convergence_ms;
+    p_status->electionsStarted = electionsStarted;
+    p_status->leaderChanges = leaderChanges;
+    p_status->heartbeatsSent = heartbeatsSent;
+    p_status->heartbeatsRelayed = heartbeatsRelayed;
+}
+
+void leader_clearStats() {
+    electionsStarted = 0;
+    leaderChanges = 0;
+    heartbeatsSent = 0;
+    heartbeatsRelayed = 0;
+}
+
+/**@brief Starts a new epoch with ourselves as the candidate.  Within an epoch,
+ * the module with the lowest ID wins, so every module that hears our
+ * candidacy either accepts it or, if its own ID is lower, stands against
+ * it.  The election settles once the lowest ID has flooded the cluster.
+ */
+void leader_startElection() {
+    if (!initialized) {
+	return;
+    }
+
+    epoch++;
+    epochStart_ms = curr_time_ms();
+    electionsStarted++;
+
+    leader_setLeader(getNodeID(), 0);
+    leader_sendHeartbeat();
+}
+
+/**@brief Hands over leadership before this module goes to sleep, so that the
+ * rest of the cluster elects a new leader immediately rather than waiting for
+ * our heartbeats to time out.  This must be called while the faceboards are
+ * still awake.
+ *
+ * @return true if a resignation was sent.
+ */
+bool leader_resign() {
+    char str[32];
+    uint8_t faceNum;
+
+    if (!initialized || !leader_isLeader()) {
+	return false;
+    }
+
+    /* Resignation: ldr;<leader>;<epoch>;<seq> */
+    snprintf(str, sizeof(str), "ldr;%04x;%u;%u|", getNodeID(), epoch, ++heartbeatSeq);
+    message_sendToAllBut(0, IRTX_PRIORITY_CONTROL, str);
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	irtx_drainFace(faceNum);
+    }
+    nrf_delay_ms(LEADER_RESIGN_DELAY_MS);
+
+    haveLeader = false;
+
+    return true;
+}
+
+void leader_scheduleElection(uint32_t delay_ms) {
+    electionPending = true;
+    electionDeadline_ms = curr_time_ms() + delay_ms + (rand() % LEADER_ELECTION_JITTER_MS);
+}
+
+void leader_setLeader(uint16_t newLeaderID, uint8_t newHops) {
+    if (!haveLeader || (newLeaderID != leaderID)) {
+	leaderChanges++;
+	convergence_ms = curr_time_ms() - epochStart_ms;
+    }
+
+    haveLeader = true;
+    leaderID = newLeaderID;
+    hops = newHops;
+    lastHeartbeat_ms = curr_time_ms();
+    electionPending = false;
+}
+
+void leader_sendHeartbeat() {
+    char str[32];
+
+    heartbeatSeq++;
+    heartbeatsSent++;
+
+    lastHeartbeat_ms = curr_time_ms();
+    nextHeartbeat_ms = lastHeartbeat_ms + LEADER_HEARTBEAT_INTERVAL_MS;
+
+    /* Heartbeat: ldh;<leader>;<epoch>;<seq>;<hops> */
+    snprintf(str, sizeof(str), "ldh;%04x;%u;%u;0|", getNodeID(), epoch, heartbeatSeq);
+    message_sendToAllBut(0, IRTX_PRIORITY_CONTROL, str);
+}
+
+void leader_processHeartbeat(uint8_t faceNum, const char *msg) {
+    unsigned int id, msgEpoch, seq, msgHops;
+    int16_t epochDiff;
+    char str[32];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "ldh;%x;%u;%u;%u", &id, &msgEpoch, &seq, &msgHops) != 4) {
+	return;
+    }
+
+    /* Ignore our own heartbeats, and copies of heartbeats that have already
+     * reached us by another path. */
+    if ((id == getNodeID()) || !message_recordFlood('l', id, seq, faceNum)) {
+	return;
+    }
+
+    epochDiff = (int16_t)(msgEpoch - epoch);
+
+    if (epochDiff < 0) {
+	/* Stale heartbeat from an earlier epoch */
+	return;
+    }
+
+    if (epochDiff > 0) {
+	/* A new epoch has begun.  We join it, standing as a candidate
+	 * ourselves if we would beat the module which started it. */
+	epoch = msgEpoch;
+	epochStart_ms = curr_time_ms();
+	haveLeader = false;
+
+	if (getNodeID() < id) {
+	    leader_setLeader(getNodeID(), 0);
+	    leader_sendHeartbeat();
+	    return;
+	}
+    } else if (haveLeader && (id > leaderID)) {
+	/* A losing candidate in the current epoch.  If we are the winner, we
+	 * remind the cluster of that straight away. */
+	if (leader_isLeader() && (curr_time_ms() - lastHeartbeat_ms > LEADER_MIN_HEARTBEAT_SPACING_MS)) {
+	    leader_sendHeartbeat();
+	}
+	return;
+    } else if (!haveLeader && (getNodeID() < id)) {
+	leader_setLeader(getNodeID(), 0);
+	leader_sendHeartbeat();
+	return;
+    }
+
+    leader_setLeader(id, msgHops + 1);
+
+    if (msgHops + 1 < LEADER_MAX_HOPS) {
+	snprintf(str, sizeof(str), "ldh;%04x;%u;%u;%u|", id, msgEpoch, seq, msgHops + 1);
+	message_sendToAllBut(faceNum, IRTX_PRIORITY_CONTROL, str);
+	heartbeatsRelayed++;
+    }
+}
+
+void leader_processResignation(uint8_t faceNum, const char *msg) {
+    unsigned int id, msgEpoch, seq;
+    char str[32];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "ldr;%x;%u;%u", &id, &msgEpoch, &seq) != 3) {
+	return;
+    }
+
+    if ((id == getNodeID()) || !message_recordFlood('l', id, seq, faceNum)) {
+	return;
+    }
+
+    snprintf(str, sizeof(str), "%s|", msg);
+    message_sendToAllBut(faceNum, IRTX_PRIORITY_CONTROL, str);
+
+    if (haveLeader && (id == leaderID) && (msgEpoch == epoch)) {
+	haveLeader = false;
+	leader_scheduleElection(0);
+    }
+}
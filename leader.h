@@ -0,0 +1,42 @@
+/*
+ * leader.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef LEADER_H_
+#define LEADER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    bool haveLeader;
+    uint16_t leaderID;
+    uint16_t epoch;
+    /* Hops to the leader, as counted by its last heartbeat */
+    uint8_t hops;
+    uint32_t lastHeartbeatAge_ms;
+    /* Time from the start of the current epoch until the leader was last
+     * changed, i.e. how long the last election took to settle here */
+    uint32_t convergence_ms;
+    uint16_t electionsStarted;
+    uint16_t leaderChanges;
+    uint16_t heartbeatsSent;
+    uint16_t heartbeatsRelayed;
+} leaderStatus_t;
+
+void leader_init(void);
+void leader_deinit(void);
+void leader_tick(void);
+
+bool leader_processMessage(uint8_t faceNum, const char *msg);
+
+bool leader_isLeader(void);
+uint16_t leader_getLeaderID(void);
+void leader_getStatus(leaderStatus_t *p_status);
+void leader_startElection(void);
+bool leader_resign(void);
+void leader_clearStats(void);
+
+#endif /* LEADER_H_ */
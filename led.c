@@ -5,6 +5,8 @@
  *      Author: kwgilpin
  */
 
+#include <string.h>
+
 #include "nrf_gpio.h"
 #include "nrf_assert.h"
 
@@ -15,14 +17,40 @@
 #include "pins.h"
 #include "led.h"
 
-#define COUNT_PERIOD	20
+/* Transitions due within this many RTC ticks of each other are made together,
+ * so that LEDs blinking out of phase share wake-ups. */
+#define LED_MERGE_TICKS		APP_TIMER_TICKS(10, APP_TIMER_PRESCALER)
+
+typedef struct {
+    led_segment_t segments[LED_MAX_SEGMENTS];
+    uint8_t segmentCount;
+    uint8_t segmentIndex;
+    /* RTC time at which the current segment ends.  Unused for a pattern with
+     * a single segment. */
+    uint32_t nextChange_rtcTicks;
+} led_pattern_t;
+
+static const led_segment_t offSegments[] = {{false, 0}};
+static const led_segment_t onSegments[] = {{true, 0}};
+static const led_segment_t slowFlashSegments[] = {{true, 1000}, {false, 1000}};
+static const led_segment_t fastFlashSegments[] = {{true, 200}, {false, 200}};
+static const led_segment_t singleBlinkSegments[] = {{true, 100}, {false, 900}};
+static const led_segment_t doubleBlinkSegments[] = {{true, 100}, {false, 100}, {true, 100}, {false, 700}};
 
 app_timer_id_t ledTimerID = TIMER_NULL;
 
 static uint8_t led_pin_number[LED_COUNT] = {LED_RED_PIN_NO, LED_GREEN_PIN_NO, LED_BLUE_PIN_NO};
 static led_state_t led_state[LED_COUNT];
+static led_pattern_t led_pattern[LED_COUNT];
 static bool initialized = false;
 
+static bool timerRunning = false;
+static uint16_t timerWakeups = 0;
+static uint16_t transitions = 0;
+
+static void led_startPattern(uint8_t led, const led_segment_t *segments, uint8_t segmentCount);
+static void led_schedule(void);
+static bool led_isDue(uint32_t currentTime_rtcTicks, uint32_t time_rtcTicks);
 static void led_timerHandler(void *p_context);
 
 void led_init() {
@@ -33,18 +61,18 @@ void led_init() {
 	nrf_gpio_pin_clear(led_pin_number[led]);
 	nrf_gpio_cfg_output(led_pin_number[led]);
 	led_state[led] = LED_STATE_OFF;
+	led_startPattern(led, offSegments, 1);
     }
 
 
-    /* Create a timer which will be used to flash the LEDs */
+    /* Create a timer which will be used to flash the LEDs.  It is only
+     * started when a pattern has a transition coming up. */
     if (ledTimerID == TIMER_NULL) {
-	err_code = app_timer_create(&ledTimerID, APP_TIMER_MODE_REPEATED, led_timerHandler);
+	err_code = app_timer_create(&ledTimerID, APP_TIMER_MODE_SINGLE_SHOT, led_timerHandler);
 	APP_ERROR_CHECK(err_code);
     }
 
-    /* Start the timer which controls the LEDs */
-    err_code = app_timer_start(ledTimerID, APP_TIMER_TICKS(100, APP_TIMER_PRESCALER), NULL);
-    APP_ERROR_CHECK(err_code);
+    timerRunning = false;
 
     initialized = true;
 }
@@ -62,9 +90,11 @@ void led_deinit(void) {
 	APP_ERROR_CHECK(err_code);
     }
 
+    timerRunning = false;
+
     for (led=0; led<LED_COUNT; led++) {
 	led_state[led] = LED_STATE_OFF;
-	nrf_gpio_pin_clear(led_pin_number[led]);
+	led_startPattern(led, offSegments, 1);
     }
 
     initialized = false;
@@ -74,7 +104,7 @@ void led_setAllOff() {
     uint32_t i;
 
     for (i=0; i<LED_COUNT; i++) {
-	led_state[i] = LED_STATE_OFF;
+	led_setState(i, LED_STATE_OFF);
     }
 }
 
@@ -82,17 +112,68 @@ void led_setAllOn() {
     uint32_t i;
 
     for (i=0; i<LED_COUNT; i++) {
-	led_state[i] = LED_STATE_ON;
+	led_setState(i, LED_STATE_ON);
     }
 }
 
+/**@brief Sets one of the predefined patterns.  Setting the state which an LED
+ * already has does nothing, so that callers which repeatedly set the same
+ * state do not restart its pattern.
+ */
 bool led_setState(uint8_t led, led_state_t state) {
-    if ((led < LED_COUNT) && (LED_STATE_IS_VALID(state))) {
-	led_state[led] = state;
+    if ((led >= LED_COUNT) || (!LED_STATE_IS_VALID(state))) {
+	return false;
+    }
+
+    if (state == led_state[led]) {
 	return true;
     }
 
-    return false;
+    led_state[led] = state;
+
+    if (state == LED_STATE_ON) {
+	led_startPattern(led, onSegments, 1);
+    } else if (state == LED_STATE_SLOW_FLASH) {
+	led_startPattern(led, slowFlashSegments, sizeof(slowFlashSegments) / sizeof(led_segment_t));
+    } else if (state == LED_STATE_FAST_FLASH) {
+	led_startPattern(led, fastFlashSegments, sizeof(fastFlashSegments) / sizeof(led_segment_t));
+    } else if (state == LED_STATE_SINGLE_BLINK) {
+	led_startPattern(led, singleBlinkSegments, sizeof(singleBlinkSegments) / sizeof(led_segment_t));
+    } else if (state == LED_STATE_DOUBLE_BLINK) {
+	led_startPattern(led, doubleBlinkSegments, sizeof(doubleBlinkSegments) / sizeof(led_segment_t));
+    } else {
+	led_startPattern(led, offSegments, 1);
+    }
+
+    led_schedule();
+
+    return true;
+}
+
+/**@brief Sets a custom pattern of up to LED_MAX_SEGMENTS segments, which
+ * starts with the first segment immediately.  Unless the pattern has a single
+ * segment, each segment must last at least LED_MIN_SEGMENT_MS.
+ */
+bool led_setPattern(uint8_t led, const led_segment_t *segments, uint8_t segmentCount) {
+    uint8_t i;
+
+    if ((led >= LED_COUNT) || (segmentCount == 0) || (segmentCount > LED_MAX_SEGMENTS)) {
+	return false;
+    }
+
+    if (segmentCount > 1) {
+	for (i = 0; i < segmentCount; i++) {
+	    if (segments[i].duration_ms < LED_MIN_SEGMENT_MS) {
+		return false;
+	    }
+	}
+    }
+
+    led_state[led] = LED_STATE_PATTERN;
+    led_startPattern(led, segments, segmentCount);
+    led_schedule();
+
+    return true;
 }
 
 led_state_t led_getState(uint8_t led) {
@@ -103,73 +184,184 @@ led_state_t led_getState(uint8_t led) {
     return LED_STATE_OFF;
 }
 
+/**@brief Returns the fraction of the time, in thousandths, for which the LED's
+ * pattern holds it on.
+ */
+uint32_t led_getDutyCycle_permille(uint8_t led) {
+    led_pattern_t *p_pattern;
+    uint32_t on_ms = 0;
+    uint32_t total_ms = 0;
+    uint8_t i;
+
+    if (led >= LED_COUNT) {
+	return 0;
+    }
+
+    p_pattern = &led_pattern[led];
+
+    if (p_pattern->segmentCount == 1) {
+	return p_pattern->segments[0].on ? 1000 : 0;
+    }
+
+    for (i = 0; i < p_pattern->segmentCount; i++) {
+	total_ms += p_pattern->segments[i].duration_ms;
+	if (p_pattern->segments[i].on) {
+	    on_ms += p_pattern->segments[i].duration_ms;
+	}
+    }
+
+    if (total_ms == 0) {
+	return 0;
+    }
+
+    return (on_ms * 1000) / total_ms;
+}
 
 uint32_t led_getDutyCycle_percent(uint8_t led) {
-    if (led < LED_COUNT) {
-	if (led_state[led] == LED_STATE_OFF) {
-	    return 0;
-	} else if (led_state[led] == LED_STATE_ON) {
-	    return 100;
-	} else if (led_state[led] == LED_STATE_SLOW_FLASH) {
-	    return 50;
-	} else if (led_state[led] == LED_STATE_FAST_FLASH) {
-	    return 50;
-	} else if (led_state[led] == LED_STATE_SINGLE_BLINK) {
-	    return 10;
-	} else if (led_state[led] == LED_STATE_DOUBLE_BLINK) {
-	    return 20;
+    return (led_getDutyCycle_permille(led) + 5) / 10;
+}
+
+void led_getStatus(led_status_t *p_status) {
+    p_status->timerRunning = timerRunning;
+    p_status->timerWakeups = timerWakeups;
+    p_status->transitions = transitions;
+}
+
+void led_clearStats() {
+    timerWakeups = 0;
+    transitions = 0;
+}
+
+void led_startPattern(uint8_t led, const led_segment_t *segments, uint8_t segmentCount) {
+    led_pattern_t *p_pattern = &led_pattern[led];
+    uint32_t currentTime_rtcTicks;
+
+    memcpy(p_pattern->segments, segments, segmentCount * sizeof(led_segment_t));
+    p_pattern->segmentCount = segmentCount;
+    p_pattern->segmentIndex = 0;
+
+    if (segmentCount > 1) {
+	app_timer_cnt_get(&currentTime_rtcTicks);
+	p_pattern->nextChange_rtcTicks = 0x00FFFFFF &
+		(currentTime_rtcTicks + APP_TIMER_TICKS(segments[0].duration_ms, APP_TIMER_PRESCALER));
+    }
+
+    if (segments[0].on) {
+	nrf_gpio_pin_set(led_pin_number[led]);
+    } else {
+	nrf_gpio_pin_clear(led_pin_number[led]);
+    }
+}
+
+/**@brief Arms the single-shot LED timer for the earliest coming transition of
+ * any LED, or leaves it stopped if every LED is steady.
+ *
+ * The app_error_handler() uses the LEDs, so errors from the timer are ignored
+ * here rather than passed to APP_ERROR_CHECK(), which could recurse.
+ */
+void led_schedule() {
+    uint32_t currentTime_rtcTicks;
+    uint32_t delay_rtcTicks;
+    uint32_t minDelay_rtcTicks = 0;
+    bool pending = false;
+    uint8_t led;
+
+    if (!initialized || (ledTimerID == TIMER_NULL)) {
+	return;
+    }
+
+    app_timer_cnt_get(&currentTime_rtcTicks);
+
+    for (led = 0; led < LED_COUNT; led++) {
+	if (led_pattern[led].segmentCount <= 1) {
+	    continue;
+	}
+
+	if (led_isDue(currentTime_rtcTicks, led_pattern[led].nextChange_rtcTicks)) {
+	    delay_rtcTicks = 0;
 	} else {
-	    return 0;
+	    delay_rtcTicks = 0x00FFFFFF & (led_pattern[led].nextChange_rtcTicks - currentTime_rtcTicks);
+	}
+
+	if (!pending || (delay_rtcTicks < minDelay_rtcTicks)) {
+	    minDelay_rtcTicks = delay_rtcTicks;
+	    pending = true;
 	}
     }
 
-    return 0;
+    /* Until the timer is stopped, starting it again has no effect. */
+    if (timerRunning) {
+	app_timer_stop(ledTimerID);
+	timerRunning = false;
+    }
+
+    if (!pending) {
+	return;
+    }
+
+    if (minDelay_rtcTicks < APP_TIMER_MIN_TIMEOUT_TICKS) {
+	minDelay_rtcTicks = APP_TIMER_MIN_TIMEOUT_TICKS;
+    }
+
+    if (app_timer_start(ledTimerID, minDelay_rtcTicks, NULL) == NRF_SUCCESS) {
+	timerRunning = true;
+    }
 }
 
+/**@brief Returns whether the given time has passed, or will within
+ * LED_MERGE_TICKS.  Times more than half of the 24-bit RTC range away are
+ * taken to be in the past.
+ */
+bool led_isDue(uint32_t currentTime_rtcTicks, uint32_t time_rtcTicks) {
+    return (0x00FFFFFF & (currentTime_rtcTicks + LED_MERGE_TICKS - time_rtcTicks)) < 0x00800000;
+}
+
+/**@brief Called at the end of a pattern segment.  Advances every LED whose
+ * segment has ended and re-arms the timer for the next transition, so the CPU
+ * is only woken when an LED actually changes, and not at all while every LED
+ * is steady.
+ */
 void led_timerHandler(void *p_context) {
-    static uint32_t count = 0;
-    uint32_t adjCount;
-    uint32_t led;
+    uint32_t currentTime_rtcTicks;
+    led_pattern_t *p_pattern;
+    uint8_t led;
+    uint8_t steps;
 
-    count = (count + 1) % COUNT_PERIOD;
+    timerRunning = false;
+    timerWakeups++;
 
-    for (led=0; led<LED_COUNT; led++) {
-	adjCount = (count + 3*led) % COUNT_PERIOD;
-
-	if (led_state[led] == LED_STATE_OFF) {
-	    nrf_gpio_pin_clear(led_pin_number[led]);
-	} else if (led_state[led] == LED_STATE_ON) {
-	    nrf_gpio_pin_set(led_pin_number[led]);
-	} else if (led_state[led] == LED_STATE_SLOW_FLASH) {
-	    if ((adjCount >> 1) < (COUNT_PERIOD / 4)) {
-		nrf_gpio_pin_set(led_pin_number[led]);
-	    } else {
-		nrf_gpio_pin_clear(led_pin_number[led]);
-	    }
-	} else if (led_state[led] == LED_STATE_FAST_FLASH) {
-	    if (adjCount >> 1 & 0x01) {
-		nrf_gpio_pin_set(led_pin_number[led]);
-	    } else {
-		nrf_gpio_pin_clear(led_pin_number[led]);
-	    }
-	} else if (led_state[led] == LED_STATE_SINGLE_BLINK) {
-	    if (adjCount % (COUNT_PERIOD / 2) == 0) {
-		nrf_gpio_pin_set(led_pin_number[led]);
-	    } else {
-		nrf_gpio_pin_clear(led_pin_number[led]);
+    app_timer_cnt_get(&currentTime_rtcTicks);
+
+    for (led = 0; led < LED_COUNT; led++) {
+	p_pattern = &led_pattern[led];
+
+	if (p_pattern->segmentCount <= 1) {
+	    continue;
+	}
+
+	steps = 0;
+	while (led_isDue(currentTime_rtcTicks, p_pattern->nextChange_rtcTicks)) {
+	    p_pattern->segmentIndex = (p_pattern->segmentIndex + 1) % p_pattern->segmentCount;
+
+	    /* If the pattern has fallen behind by more than a whole cycle, it
+	     * is restarted from the present time rather than caught up. */
+	    if (++steps > p_pattern->segmentCount) {
+		p_pattern->nextChange_rtcTicks = currentTime_rtcTicks;
 	    }
-	} else if (led_state[led] == LED_STATE_DOUBLE_BLINK) {
-	    if ((adjCount % (COUNT_PERIOD / 2) == 0) || (adjCount % (COUNT_PERIOD / 2) == 2)) {
+
+	    p_pattern->nextChange_rtcTicks = 0x00FFFFFF & (p_pattern->nextChange_rtcTicks +
+		    APP_TIMER_TICKS(p_pattern->segments[p_pattern->segmentIndex].duration_ms, APP_TIMER_PRESCALER));
+	}
+
+	if (steps > 0) {
+	    if (p_pattern->segments[p_pattern->segmentIndex].on) {
 		nrf_gpio_pin_set(led_pin_number[led]);
 	    } else {
 		nrf_gpio_pin_clear(led_pin_number[led]);
 	    }
-	} else {
-	    /* If the state is unknown, set the state to OFF */
-	    led_state[led] = LED_STATE_OFF;
-	    nrf_gpio_pin_clear(led_pin_number[led]);
+	    transitions++;
 	}
     }
-}
-
 
+    led_schedule();
+}
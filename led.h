@@ -25,19 +25,44 @@ typedef enum {
 	LED_STATE_SLOW_FLASH,
 	LED_STATE_FAST_FLASH,
 	LED_STATE_SINGLE_BLINK,
-	LED_STATE_DOUBLE_BLINK
+	LED_STATE_DOUBLE_BLINK,
+	/* Set with led_setPattern() rather than led_setState() */
+	LED_STATE_PATTERN
 } led_state_t;
 
 #define LED_STATE_IS_VALID(s)	((s == LED_STATE_OFF) || (s == LED_STATE_ON) || \
 								 (s == LED_STATE_SLOW_FLASH) || (s == LED_STATE_FAST_FLASH) || \
 								 (s == LED_STATE_SINGLE_BLINK) || (s == LED_STATE_DOUBLE_BLINK))
 
+/* Each LED follows a pattern: a repeating sequence of segments which hold the
+ * LED on or off for a duration.  A pattern with a single segment holds the LED
+ * steady, and its duration is ignored. */
+#define LED_MAX_SEGMENTS		8
+#define LED_MIN_SEGMENT_MS		20
+
+typedef struct {
+	bool on;
+	uint16_t duration_ms;
+} led_segment_t;
+
+typedef struct {
+	/* Whether the LED timer is armed for a coming transition */
+	bool timerRunning;
+	uint16_t timerWakeups;
+	uint16_t transitions;
+} led_status_t;
+
 void led_init(void);
 void led_deinit(void);
 void led_setAllOff(void);
 void led_setAllOn(void);
 bool led_setState(uint8_t led, led_state_t state);
+bool led_setPattern(uint8_t led, const led_segment_t *segments, uint8_t segmentCount);
 led_state_t led_getState(uint8_t led);
+uint32_t led_getDutyCycle_permille(uint8_t led);
 uint32_t led_getDutyCycle_percent(uint8_t led);
 
+void led_getStatus(led_status_t *p_status);
+void led_clearStats(void);
+
 #endif /* LED_H_ */
@@ -0,0 +1,395 @@
+/*
+ * light.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_scheduler.h"
+
+#include "global.h"
+#include "fb.h"
+#include "light.h"
+
+/* The filtered level tracks new samples with a gain of 1/LIGHT_FILTER_GAIN
+ * and is kept with 4 fractional bits. */
+#define LIGHT_FILTER_GAIN		4
+
+/* A threshold is crossed when the filtered level moves this far beyond it, so
+ * that a level hovering around the threshold does not produce a stream of
+ * events. */
+#define LIGHT_THRESHOLD_HYSTERESIS	8
+
+/* Most samples that are read from a faceboard's ambient buffer at once */
+#define LIGHT_BATCH_MAX_SAMPLES		16
+
+typedef struct {
+    uint16_t history[LIGHT_HISTORY_LENGTH];
+    uint8_t head;
+    uint8_t count;
+    int32_t filtered16;
+    uint16_t threshold;
+    bool above;
+    uint16_t batchReads;
+    uint16_t singleReads;
+    uint16_t twiErrorCount;
+} lightFace_t;
+
+static bool initialized = false;
+
+static app_timer_id_t light_timerID = TIMER_NULL;
+
+/* Sampling continues after the module wakes if it was running when the module
+ * went to sleep. */
+static bool running = false;
+static uint16_t interval_ms = LIGHT_DEFAULT_INTERVAL_MS;
+
+static lightFace_t faces[6];
+static app_sched_event_handler_t eventHandler = NULL;
+static lightSampleHandler_t sampleHandler = NULL;
+
+static void light_timerHandler(void *p_context);
+static void light_sampleFace(uint8_t faceNum);
+static void light_addSample(uint8_t faceNum, uint16_t sample);
+
+void light_init() {
+    uint32_t err_code;
+
+    if (light_timerID == TIMER_NULL) {
+	err_code = app_timer_create(&light_timerID, APP_TIMER_MODE_REPEATED, light_timerHandler);
+	APP_ERROR_CHECK(err_code);
+    }
+
+    initialized = true;
+
+    if (running) {
+	running = false;
+	light_start(interval_ms);
+    }
+}
+
+void light_deinit() {
+    uint32_t err_code;
+    uint8_t faceNum;
+
+    if (!initialized) {
+	return;
+    }
+
+    err_code = app_timer_stop(light_timerID);
+    APP_ERROR_CHECK(err_code);
+
+    /* The light will have changed by the time we wake. */
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	faces[faceNum-1].head = 0;
+	faces[faceNum-1].count = 0;
+    }
+
+    initialized = false;
+}
+
+/**@brief Starts sampling the ambient light on all six faces.
+ *
+ * The faceboards' light sensors only operate while their receivers are
+ * enabled, which the messaging layer does at start-up.
+ *
+ * @param[in] newInterval_ms   Time between samples of each face.
+ */
+bool light_start(uint16_t newInterval_ms) {
+    uint32_t err_code;
+
+    if (!initialized || (newInterval_ms < LIGHT_MIN_INTERVAL_MS)) {
+	return false;
+    }
+
+    if (running) {
+	err_code = app_timer_stop(light_timerID);
+	APP_ERROR_CHECK(err_code);
+    }
+
+    interval_ms = newInterval_ms;
+
+    err_code = app_timer_start(light_timerID, APP_TIMER_TICKS(interval_ms, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+
+    running = true;
+
+    return true;
+}
+
+void light_stop() {
+    uint32_t err_code;
+
+    if (initialized && running) {
+	err_code = app_timer_stop(light_timerID);
+	APP_ERROR_CHECK(err_code);
+    }
+
+    running = false;
+}
+
+bool light_isRunning() {
+    return running;
+}
+
+uint16_t light_getInterval() {
+    return interval_ms;
+}
+
+/**@brief Returns the most recent sample from the given face (0-1023), or -1
+ * if none has been taken since sampling began.
+ */
+int16_t light_getLatest(uint8_t faceNum) {
+    lightFace_t *p_face;
+
+    if ((faceNum < 1) || (faceNum > 6) || (faces[faceNum-1].count == 0)) {
+	return -1;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    return p_face->history[(p_face->head + LIGHT_HISTORY_LENGTH - 1) % LIGHT_HISTORY_LENGTH];
+}
+
+int16_t light_getMin(uint8_t faceNum) {
+    lightFace_t *p_face;
+    uint16_t min;
+    uint8_t i;
+
+    if ((faceNum < 1) || (faceNum > 6) || (faces[faceNum-1].count == 0)) {
+	return -1;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    min = UINT16_MAX;
+    for (i = 0; i < p_face->count; i++) {
+	if (p_face->history[i] < min) {
+	    min = p_face->history[i];
+	}
+    }
+
+    return min;
+}
+
+int16_t light_getMax(uint8_t faceNum) {
+    lightFace_t *p_face;
+    uint16_t max;
+    uint8_t i;
+
+    if ((faceNum < 1) || (faceNum > 6) || (faces[faceNum-1].count == 0)) {
+	return -1;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    max = 0;
+    for (i = 0; i < p_face->count; i++) {
+	if (p_face->history[i] > max) {
+	    max = p_face->history[i];
+	}
+    }
+
+    return max;
+}
+
+int16_t light_getMean(uint8_t faceNum) {
+    lightFace_t *p_face;
+    uint32_t sum;
+    uint8_t i;
+
+    if ((faceNum < 1) || (faceNum > 6) || (faces[faceNum-1].count == 0)) {
+	return -1;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    sum = 0;
+    for (i = 0; i < p_face->count; i++) {
+	sum += p_face->history[i];
+    }
+
+    return (sum + p_face->count / 2) / p_face->count;
+}
+
+/**@brief Returns the exponentially filtered light level of the given face, or
+ * -1 if it has not been sampled.
+ */
+int16_t light_getFiltered(uint8_t faceNum) {
+    if ((faceNum < 1) || (faceNum > 6) || (faces[faceNum-1].count == 0)) {
+	return -1;
+    }
+
+    return (faces[faceNum-1].filtered16 + 8) / 16;
+}
+
+/**@brief Registers a handler which receives every batch of raw samples read
+ * from the faceboards, or removes it if NULL.  It is called from the sampling
+ * timer, i.e. from the scheduler.
+ */
+void light_setSampleHandler(lightSampleHandler_t handler) {
+    sampleHandler = handler;
+}
+
+/**@brief Sets the level at which crossings of the given face's filtered light
+ * level are reported.
+ *
+ * @param[in] faceNum          Face (1-6), or 0 for all faces.
+ * @param[in] level            Threshold (0-1023), or 0 to stop reporting.
+ * @param[in] newEventHandler  Handler to which a lightEvent_t is passed through
+ *                             the scheduler on each crossing.  It is shared
+ *                             by all faces.
+ */
+bool light_setThreshold(uint8_t faceNum, uint16_t level, app_sched_event_handler_t newEventHandler) {
+    uint8_t face;
+
+    if (faceNum > 6) {
+	return false;
+    }
+
+    for (face = 1; face <= 6; face++) {
+	if ((faceNum != 0) && (face != faceNum)) {
+	    continue;
+	}
+
+	faces[face-1].threshold = level;
+	faces[face-1].above = (light_getFiltered(face) > (int16_t)level);
+    }
+
+    eventHandler = newEventHandler;
+
+    return true;
+}
+
+bool light_getStatus(uint8_t faceNum, lightStatus_t *p_status) {
+    lightFace_t *p_face;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    p_status->count = p_face->count;
+    p_status->latest = light_getLatest(faceNum);
+    p_status->min = light_getMin(faceNum);
+    p_status->max = light_getMax(faceNum);
+    p_status->mean = light_getMean(faceNum);
+    p_status->filtered = light_getFiltered(faceNum);
+    p_status->threshold = p_face->threshold;
+    p_status->batchReads = p_face->batchReads;
+    p_status->singleReads = p_face->singleReads;
+    p_status->twiErrorCount = p_face->twiErrorCount;
+
+    return true;
+}
+
+void light_clearStats() {
+    uint8_t faceNum;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	faces[faceNum-1].batchReads = 0;
+	faces[faceNum-1].singleReads = 0;
+	faces[faceNum-1].twiErrorCount = 0;
+    }
+}
+
+void light_timerHandler(void *p_context) {
+    uint8_t faceNum;
+
+    /* Timer handlers are executed from the scheduler, so the faceboards are
+     * never read while another module is in the middle of a TWI transfer. */
+    if (!initialized || !running) {
+	return;
+    }
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	light_sampleFace(faceNum);
+    }
+}
+
+/**@brief Collects whatever new samples are available from one face.
+ *
+ * The faceboard keeps its own buffer of recent samples, one byte (the eight
+ * most significant bits of the 10-bit reading) per sample.  If it holds any
+ * samples, we read them all in one transfer; otherwise, we fall back on a
+ * single full-resolution reading.
+ */
+void light_sampleFace(uint8_t faceNum) {
+    uint8_t samples[LIGHT_BATCH_MAX_SAMPLES];
+    uint8_t count, i;
+    int16_t ambient;
+
+    if (fb_getRxAmbientBufferConsumedCount(faceNum, &count) && (count > 0)) {
+	if (count > LIGHT_BATCH_MAX_SAMPLES) {
+	    count = LIGHT_BATCH_MAX_SAMPLES;
+	}
+
+	if (fb_getRxAmbientBuffer(faceNum, count, samples)) {
+	    faces[faceNum-1].batchReads++;
+	    for (i = 0; i < count; i++) {
+		light_addSample(faceNum, (uint16_t)samples[i] << 2);
+	    }
+	    if (sampleHandler != NULL) {
+		sampleHandler(faceNum, samples, count);
+	    }
+	    return;
+	}
+    }
+
+    ambient = fb_getAmbientLight(faceNum);
+    if (ambient < 0) {
+	faces[faceNum-1].twiErrorCount++;
+	return;
+    }
+
+    faces[faceNum-1].singleReads++;
+    light_addSample(faceNum, ambient);
+}
+
+void light_addSample(uint8_t faceNum, uint16_t sample) {
+    uint32_t err_code;
+    lightFace_t *p_face = &faces[faceNum-1];
+    lightEvent_t event;
+    int16_t filtered;
+
+    p_face->history[p_face->head] = sample;
+    p_face->head = (p_face->head + 1) % LIGHT_HISTORY_LENGTH;
+
+    if (p_face->count == 0) {
+	p_face->filtered16 = 16 * (int32_t)sample;
+	p_face->above = (sample > p_face->threshold);
+    } else {
+	p_face->filtered16 += (16 * (int32_t)sample - p_face->filtered16) / LIGHT_FILTER_GAIN;
+    }
+
+    if (p_face->count < LIGHT_HISTORY_LENGTH) {
+	p_face->count++;
+    }
+
+    if ((p_face->threshold == 0) || (eventHandler == NULL)) {
+	return;
+    }
+
+    filtered = light_getFiltered(faceNum);
+
+    if (!p_face->above && (filtered > p_face->threshold + LIGHT_THRESHOLD_HYSTERESIS)) {
+	p_face->above = true;
+    } else if (p_face->above && (filtered + LIGHT_THRESHOLD_HYSTERESIS < p_face->threshold)) {
+	p_face->above = false;
+    } else {
+	return;
+    }
+
+    event.faceNum = faceNum;
+    event.rising = p_face->above;
+    event.level = filtered;
+
+    err_code = app_sched_event_put(&event, sizeof(event), eventHandler);
+    APP_ERROR_CHECK(err_code);
+}
@@ -0,0 +1,70 @@
+/*
+ * light.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef LIGHT_H_
+#define LIGHT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_scheduler.h"
+
+/* Number of samples kept for each face, from which the minimum, maximum and
+ * mean are computed */
+#define LIGHT_HISTORY_LENGTH		16
+
+#define LIGHT_DEFAULT_INTERVAL_MS	100
+#define LIGHT_MIN_INTERVAL_MS		20
+
+/* Threshold crossings are reported to the handler given to
+ * light_setThreshold() through the scheduler. */
+typedef struct {
+    uint8_t faceNum;
+    /* True if the filtered level rose above the threshold, false if it fell
+     * below it */
+    bool rising;
+    uint16_t level;
+} lightEvent_t;
+
+/* Handler given the raw samples read in each batch from a faceboard's ambient
+ * buffer, one byte (the eight most significant bits of the reading) per
+ * sample, for modules which process the sample stream itself */
+typedef void (*lightSampleHandler_t)(uint8_t faceNum, const uint8_t *samples, uint8_t count);
+
+typedef struct {
+    /* Number of samples in the history (at most LIGHT_HISTORY_LENGTH) */
+    uint8_t count;
+    uint16_t latest;
+    uint16_t min;
+    uint16_t max;
+    uint16_t mean;
+    uint16_t filtered;
+    uint16_t threshold;
+    uint16_t batchReads;
+    uint16_t singleReads;
+    uint16_t twiErrorCount;
+} lightStatus_t;
+
+void light_init(void);
+void light_deinit(void);
+
+bool light_start(uint16_t interval_ms);
+void light_stop(void);
+bool light_isRunning(void);
+uint16_t light_getInterval(void);
+
+int16_t light_getLatest(uint8_t faceNum);
+int16_t light_getMin(uint8_t faceNum);
+int16_t light_getMax(uint8_t faceNum);
+int16_t light_getMean(uint8_t faceNum);
+int16_t light_getFiltered(uint8_t faceNum);
+
+void light_setSampleHandler(lightSampleHandler_t handler);
+bool light_setThreshold(uint8_t faceNum, uint16_t level, app_sched_event_handler_t eventHandler);
+bool light_getStatus(uint8_t faceNum, lightStatus_t *p_status);
+void light_clearStats(void);
+
+#endif /* LIGHT_H_ */
@@ -56,6 +56,12 @@
 #include "uart.h"
 #include "db.h"
 #include "fb.h"
+#include "irtx.h"
+#include "message.h"
+#include "leader.h"
+#include "light.h"
+#include "proximity.h"
+#include "brakeprofile.h"
 #include "adc.h"
 #include "pwm.h"
 #include "freqcntr.h"
@@ -93,7 +99,25 @@
 // YOUR_JOB: Modify these according to requirements (e.g. if other event types are to pass through
 //           the scheduler).
 #define SCHED_MAX_EVENT_DATA_SIZE       sizeof(app_timer_event_t)                   /**< Maximum size of scheduler events. Note that scheduler BLE stack events do not contain any data, as the events are being pulled from the stack in the event handler. */
-#define SCHED_QUEUE_SIZE                12                                          /**< Maximum number of events in the scheduler queue. */
+/* Maximum number of events in the scheduler queue.  Every timer expiry and
+ * many interrupts queue an event, and the queue must hold all that can arrive
+ * while one handler blocks (a full queue is a fatal error).  The longest
+ * blocking call made from a handler is a blocking daughterboard exchange,
+ * which may first wait for a queued request in flight (db_flush()): 2 x
+ * (DB_POLL_FIRST_INTERVAL_MS + 50 ms timeout) = 110 ms.  leader_resign()
+ * (50 ms) and adc_waitIdle() (one ADC sequence) are shorter.  In 110 ms, at
+ * most 110/P + 1 events arrive from each repeated timer of period P:
+ *   message fast poll (10 ms)                         12
+ *   irtx drain (20 ms)                                 6
+ *   light sampling (LIGHT_MIN_INTERVAL_MS, 20 ms)      6
+ *   bldc speed control (20 ms)                         6
+ *   power (200 ms), motion check (1000 ms)             2 x 1
+ * plus one from each of the 7 single-shot timers (db, led, timesync, sma,
+ * mechbrake, motionEvent, proximity), one ADC sequence event, and one
+ * SoftDevice event per 10 ms connection interval (12), for 52 in all.  The
+ * rest leaves room for the motion events that handlers queue themselves.
+ * Each entry takes SCHED_MAX_EVENT_DATA_SIZE + 8 = 16 bytes of RAM. */
+#define SCHED_QUEUE_SIZE                56
 
 static bool sleepRequested = false;
 static uint32_t sleepTime_sec = 600;
@@ -402,6 +426,12 @@ int main(void) {
     pwm_init();
     spi_init();
     power_init();
+    db_init();
+    irtx_init();
+    message_init();
+    light_init();
+    proximity_init();
+    brakeprofile_init();
     commands_init();
 
     bleApp_gapParamsInit();
@@ -647,7 +677,12 @@ void main_powerManage() {
 	pwm_init();
 	spi_init();
 	power_init();
+	db_init();
 	bldc_init();
+	irtx_init();
+	message_init();
+	light_init();
+	proximity_init();
 
 	mpu6050_setAddress(MPU6050_I2C_ADDR_CENTRAL);
 	imu_enableSleepMode();
@@ -694,6 +729,10 @@ void main_powerManage() {
 	    /* Ensure that the daughterboard is in sleep mode */
 	    db_sleep(true);
 
+	    /* Hand over leadership of the cluster while the faceboards can
+	     * still transmit */
+	    leader_resign();
+
 	    /* Put all faceboards to sleep, too */
 	    fb_sleep(0, true);
 
@@ -730,7 +769,12 @@ void main_powerManage() {
 	    pwm_deinit();
 	    spi_deinit();
 	    power_deinit();
+	    db_deinit();
 	    bldc_deinit();
+	    proximity_deinit();
+	    light_deinit();
+	    message_deinit();
+	    irtx_deinit();
 	}
 
 	sleeping = true;
@@ -18,6 +18,11 @@
 #include "db.h"
 #include "mechbrake.h"
 
+/* The daughterboard is not polled while it runs the brake steps.  A single
+ * read is made this long after the steps should have finished, and only if
+ * the brake has not finished by then is the daughterboard polled again, every
+ * MECHBRAKE_POLL_INTERVAL_MS. */
+#define MECHBRAKE_COMPLETION_MARGIN_MS	5
 #define MECHBRAKE_POLL_INTERVAL_MS	5
 
 static bool initialized = false;
@@ -27,16 +32,27 @@ static bool brakeActive = false;
 static app_sched_event_handler_t eventHandler = NULL;
 
 static uint32_t startTime_rtcTicks;
+static uint32_t expectedInterval_ms;
 static uint32_t timeoutInterval_ms;
 static app_timer_id_t mechbrake_timerID = TIMER_NULL;
 
+static uint16_t actuations = 0;
+static uint16_t failures = 0;
+static uint16_t timeouts = 0;
+static uint32_t polls = 0;
+static uint8_t lastPolls = 0;
+static uint16_t lastExpected_ms = 0;
+static uint16_t lastCompletion_ms = 0;
+
 static void mechbrake_timerHandler(void *p_context);
+static void mechbrake_startTimer(uint32_t delay_ms);
+static void mechbrake_finish(motionPrimitive_t motionPrimitive);
 
 bool mechbrake_init() {
     uint32_t err_code;
 
     if (mechbrake_timerID == TIMER_NULL) {
-	err_code = app_timer_create(&mechbrake_timerID, APP_TIMER_MODE_REPEATED, mechbrake_timerHandler);
+	err_code = app_timer_create(&mechbrake_timerID, APP_TIMER_MODE_SINGLE_SHOT, mechbrake_timerHandler);
 	APP_ERROR_CHECK(err_code);
     }
 
@@ -79,7 +95,7 @@ bool mechbrake_actuate(uint8_t stepCount, const coilCurrentStep_t *steps, app_sc
     twiBuf[0] = DB_BRAKE_CMD;
     twiBuf[1] = stepCount;
 
-    timeoutInterval_ms = 0;
+    expectedInterval_ms = 0;
 
     for (i=0; i<stepCount; i++) {
 	if (mechbrake_getReverseDirections()) {
@@ -93,81 +109,106 @@ bool mechbrake_actuate(uint8_t stepCount, const coilCurrentStep_t *steps, app_sc
 	twiBuf[(4*i) + 4] = (steps[i].time_ms >> 0) & 0xFF;
 	twiBuf[(4*i) + 5] = (steps[i].time_ms >> 8) & 0xFF;
 
-	timeoutInterval_ms += steps[i].time_ms;
+	expectedInterval_ms += steps[i].time_ms;
     }
 
     /* To account for some imprecision (in both the timer system and the
-     * daughterboard processor) we allow an extra 25ms for the mechanical
+     * daughterboard processor) we allow an extra 100ms for the mechanical
      * braking action to run to completion. */
-    timeoutInterval_ms += 100;
+    timeoutInterval_ms = expectedInterval_ms + 100;
 
     eventHandler = brakeCompleteEventHandler;
 
+    /* The daughterboard only works on one command at a time, so queued
+     * requests wait until the brake has finished. */
+    db_flush();
+    db_suspend(true);
+
     twi_master_init();
 
     if (!twi_master_transfer((DB_TWI_ADDR << 1), twiBuf, 2 + (4*stepCount), true)) {
 	twi_master_deinit();
+	db_suspend(false);
 	return false;
     }
 
-    err_code = app_timer_start(mechbrake_timerID, APP_TIMER_TICKS(MECHBRAKE_POLL_INTERVAL_MS, APP_TIMER_PRESCALER), NULL);
-    APP_ERROR_CHECK(err_code);
-
     err_code = app_timer_cnt_get(&startTime_rtcTicks);
     APP_ERROR_CHECK(err_code);
 
+    mechbrake_startTimer(expectedInterval_ms + MECHBRAKE_COMPLETION_MARGIN_MS);
+
     brakeActive = true;
+    actuations++;
+    lastPolls = 0;
+    lastExpected_ms = expectedInterval_ms;
 
     twi_master_deinit();
     return true;
 }
 
+/**@brief Checks whether the daughterboard has finished the brake steps.
+ * Called once when the steps should have finished, and then every
+ * MECHBRAKE_POLL_INTERVAL_MS until the daughterboard reports completion or
+ * the brake times out.
+ */
 void mechbrake_timerHandler(void *p_context) {
-    uint32_t err_code;
     bool rxSuccess;
     uint8_t twiBuf[2];
     uint32_t currentTime_rtcTicks;
     uint32_t elapsedTime_ms;
-    motionPrimitive_t motionPrimitive;
 
-    twi_master_init();
+    if (!brakeActive) {
+	return;
+    }
 
+    twi_master_init();
     rxSuccess = twi_master_transfer((DB_TWI_ADDR << 1) | TWI_READ_BIT, twiBuf, 2, true);
-    if (rxSuccess && (twiBuf[0] == DB_BRAKE_CMD) && (twiBuf[1] == 0x01)) {
-	app_timer_stop(mechbrake_timerID);
+    twi_master_deinit();
 
-	if (eventHandler != NULL) {
-	    motionPrimitive = MOTION_PRIMITIVE_MECHBRAKE_SUCCESS;
-	    err_code = app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
-	    APP_ERROR_CHECK(err_code);
-	}
-	brakeActive = false;
-    } else if (rxSuccess && (twiBuf[0] == DB_BRAKE_CMD) && (twiBuf[1] != 0x01)) {
-	app_timer_stop(mechbrake_timerID);
+    polls++;
+    if (lastPolls < UINT8_MAX) {
+	lastPolls++;
+    }
 
-	if (eventHandler != NULL) {
-	    motionPrimitive = MOTION_PRIMITIVE_MECHBRAKE_FAILURE;
-	    err_code = app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
-	    APP_ERROR_CHECK(err_code);
-	}
-	brakeActive = false;
+    app_timer_cnt_get(&currentTime_rtcTicks);
+    elapsedTime_ms = ((0x00FFFFFF & (currentTime_rtcTicks - startTime_rtcTicks)) * USEC_PER_APP_TIMER_TICK) / 1000;
+
+    if (rxSuccess && (twiBuf[0] == DB_BRAKE_CMD) && (twiBuf[1] == 0x01)) {
+	lastCompletion_ms = elapsedTime_ms;
+	mechbrake_finish(MOTION_PRIMITIVE_MECHBRAKE_SUCCESS);
+    } else if (rxSuccess && (twiBuf[0] == DB_BRAKE_CMD) && (twiBuf[1] != 0x01)) {
+	failures++;
+	mechbrake_finish(MOTION_PRIMITIVE_MECHBRAKE_FAILURE);
+    } else if (elapsedTime_ms > timeoutInterval_ms) {
+	timeouts++;
+	mechbrake_finish(MOTION_PRIMITIVE_MECHBRAKE_TIMEOUT);
     } else {
-	app_timer_cnt_get(&currentTime_rtcTicks);
-	elapsedTime_ms = ((0x00FFFFFF & (currentTime_rtcTicks - startTime_rtcTicks)) * USEC_PER_APP_TIMER_TICK) / 1000;
-
-	if (elapsedTime_ms > timeoutInterval_ms) {
-	    app_timer_stop(mechbrake_timerID);
-
-	    if (eventHandler != NULL) {
-		motionPrimitive = MOTION_PRIMITIVE_MECHBRAKE_TIMEOUT;
-		err_code = app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
-		APP_ERROR_CHECK(err_code);
-	    }
-	    brakeActive = false;
-	}
+	mechbrake_startTimer(MECHBRAKE_POLL_INTERVAL_MS);
     }
+}
 
-    twi_master_deinit();
+void mechbrake_startTimer(uint32_t delay_ms) {
+    uint32_t err_code;
+    uint32_t ticks = APP_TIMER_TICKS(delay_ms, APP_TIMER_PRESCALER);
+
+    if (ticks < APP_TIMER_MIN_TIMEOUT_TICKS) {
+	ticks = APP_TIMER_MIN_TIMEOUT_TICKS;
+    }
+
+    err_code = app_timer_start(mechbrake_timerID, ticks, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+void mechbrake_finish(motionPrimitive_t motionPrimitive) {
+    uint32_t err_code;
+
+    brakeActive = false;
+    db_suspend(false);
+
+    if (eventHandler != NULL) {
+	err_code = app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
+	APP_ERROR_CHECK(err_code);
+    }
 }
 
 void mechbrake_setReverseDirections(bool reverse) {
@@ -178,3 +219,21 @@ bool mechbrake_getReverseDirections() {
     return directionsReversed;
 }
 
+void mechbrake_getStats(mechbrakeStats_t *p_stats) {
+    p_stats->active = brakeActive;
+    p_stats->actuations = actuations;
+    p_stats->failures = failures;
+    p_stats->timeouts = timeouts;
+    p_stats->polls = polls;
+    p_stats->lastPolls = lastPolls;
+    p_stats->lastExpected_ms = lastExpected_ms;
+    p_stats->lastCompletion_ms = lastCompletion_ms;
+}
+
+void mechbrake_clearStats() {
+    actuations = 0;
+    failures = 0;
+    timeouts = 0;
+    polls = 0;
+}
+
@@ -16,11 +16,28 @@ typedef struct {
 	uint16_t time_ms;
 } coilCurrentStep_t;
 
+typedef struct {
+	bool active;
+	uint16_t actuations;
+	uint16_t failures;
+	uint16_t timeouts;
+	/* Reads of the daughterboard's brake status, in all and for the last
+	 * actuation */
+	uint32_t polls;
+	uint8_t lastPolls;
+	/* Sum of the last actuation's step times, and the time after which its
+	 * completion was confirmed */
+	uint16_t lastExpected_ms;
+	uint16_t lastCompletion_ms;
+} mechbrakeStats_t;
+
 
 bool mechbrake_init(void);
 void mechbrake_deinit(void);
 bool mechbrake_actuate(uint8_t stepCount, const coilCurrentStep_t *steps, app_sched_event_handler_t brakeCompleteEventHandler);
 void mechbrake_setReverseDirections(bool reverse);
 bool mechbrake_getReverseDirections(void);
+void mechbrake_getStats(mechbrakeStats_t *p_stats);
+void mechbrake_clearStats(void);
 
 #endif /* MECHBRAKE_H_ */
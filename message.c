@@ -4,16 +4,73 @@
 #include "app_timer.h"
 
 #include "fb.h"
+#include "irtx.h"
 #include "util.h"
 #include "global.h"
 #include "cmdline.h"
+#include "neighbor.h"
+#include "timesync.h"
+#include "rpc.h"
+#include "xfer.h"
+#include "group.h"
+#include "irlink.h"
+#include "leader.h"
+#include "gradient.h"
+#include "irdfu.h"
 
 #include "message.h"
 
+#define MESSAGE_POLL_INTERVAL_MS	1000
+/* Faces which a service expects to receive a time-critical message on are
+ * polled at this faster rate for a short while. */
+#define MESSAGE_FAST_POLL_INTERVAL_MS	10
+/* While a service waits for a message that it time-stamps to the
+ * millisecond, all of the fast-polled faces are polled at this rate. */
+#define MESSAGE_PRECISE_POLL_INTERVAL_MS	2
+/* A face on which bytes arrive is also polled quickly for this long, so that
+ * a burst of messages (e.g. nbrmap responses being relayed) is read before it
+ * overflows the faceboard's receive buffer. */
+#define MESSAGE_RX_FAST_POLL_MS		200
+
 app_timer_id_t messageTimerID = TIMER_NULL;
 
 static bool initialized = false;
 
+/* Messages which flood through the cluster are identified by their type, the
+ * module which originated them, and an ID chosen by that module.  We remember
+ * the face on which each arrived first so that duplicates can be dropped.  A
+ * duplicate can arrive as late as a flood takes to cross the cluster, and in
+ * that time an election may flood a heartbeat from every module, so the cache
+ * has an entry for each module of a 3x3x3 cluster, with room to spare. */
+#define MESSAGE_FLOOD_CACHE_SIZE	32
+
+/* Floods whose replies retrace the flood's path back to the originator (rpc
+ * calls and nbrmap queries) are remembered separately, so that other floods
+ * cannot evict a path while replies are still on their way.  These queries
+ * come from a host, one or two at a time. */
+#define MESSAGE_ROUTE_CACHE_SIZE	4
+
+typedef struct {
+    char type;
+    uint16_t origin;
+    uint8_t id;
+    uint8_t faceNum;
+} messageFlood_t;
+
+static messageFlood_t floodCache[MESSAGE_FLOOD_CACHE_SIZE];
+static uint8_t floodCacheIndex = 0;
+static messageFlood_t routeCache[MESSAGE_ROUTE_CACHE_SIZE];
+static uint8_t routeCacheIndex = 0;
+
+static uint8_t fastPollFaces = 0x00;
+static uint32_t fastPollEnd_ms;
+static bool precisePoll = false;
+static uint32_t precisePollEnd_ms;
+static uint32_t lastFullPoll_ms;
+static uint32_t rxTime_ms;
+
+static void message_startTimer(uint32_t interval_ms);
+
 static void message_timeoutHandler(void *p_context);
 
 void message_init() {
@@ -24,8 +81,23 @@ void message_init() {
 	APP_ERROR_CHECK(err_code);
     }
 
-    err_code = app_timer_start(messageTimerID, APP_TIMER_TICKS(1000, APP_TIMER_PRESCALER), NULL);
-    APP_ERROR_CHECK(err_code);
+    /* The receivers must be enabled before we can hear our neighbors */
+    fb_setRxEnable(0, true);
+
+    fastPollFaces = 0x00;
+    precisePoll = false;
+    lastFullPoll_ms = curr_time_ms();
+    message_startTimer(MESSAGE_POLL_INTERVAL_MS);
+
+    neighbor_init();
+    timesync_init();
+    rpc_init();
+    xfer_init();
+    group_init();
+    irlink_init();
+    leader_init();
+    gradient_init();
+    irdfu_init();
 
     initialized = true;
 }
@@ -42,19 +114,192 @@ void message_deinit() {
 	APP_ERROR_CHECK(err_code);
     }
 
+    neighbor_deinit();
+    timesync_deinit();
+    rpc_deinit();
+    xfer_deinit();
+    group_deinit();
+    irlink_deinit();
+    leader_deinit();
+    gradient_deinit();
+    irdfu_deinit();
+
     initialized = false;
 }
 
+void message_startTimer(uint32_t interval_ms) {
+    uint32_t err_code;
+
+    /* Timer handlers run from the scheduler, so the stop operation has been
+     * processed before we ask for the timer to be started again. */
+    err_code = app_timer_stop(messageTimerID);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_start(messageTimerID, APP_TIMER_TICKS(interval_ms, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Temporarily polls the receive buffer of the given face much faster.
+ *
+ * Services which time-stamp received messages call this when they expect a
+ * message so that the delay between its arrival and its time-stamp is small.
+ *
+ * @param[in] faceNum       Face (1-6) to poll quickly, or 0 for all faces.
+ * @param[in] duration_ms   How long to keep polling quickly.
+ */
+void message_requestFastPoll(uint8_t faceNum, uint32_t duration_ms) {
+    uint32_t end_ms;
+
+    if (!initialized || (faceNum > 6)) {
+	return;
+    }
+
+    end_ms = curr_time_ms() + duration_ms;
+    if ((fastPollFaces == 0x00) || ((int32_t)(end_ms - fastPollEnd_ms) > 0)) {
+	fastPollEnd_ms = end_ms;
+    }
+
+    if (fastPollFaces == 0x00) {
+	message_startTimer(MESSAGE_FAST_POLL_INTERVAL_MS);
+    }
+
+    fastPollFaces |= (faceNum == 0) ? 0x3F : (1 << (faceNum - 1));
+}
+
+/**@brief Polls the receive buffer of the given face faster still for a short
+ * while.
+ *
+ * The time-stamp of a message read by a fast poll can be late by up to the
+ * fast poll interval, and as the modules' poll timers keep the same phase,
+ * that error does not average out.  Services which need time-stamps to the
+ * millisecond call this while they wait for a message.
+ *
+ * @param[in] faceNum       Face (1-6) to poll precisely, or 0 for all faces.
+ * @param[in] duration_ms   How long to keep polling precisely.
+ */
+void message_requestPrecisePoll(uint8_t faceNum, uint32_t duration_ms) {
+    uint32_t end_ms;
+
+    if (!initialized || (faceNum > 6)) {
+	return;
+    }
+
+    message_requestFastPoll(faceNum, duration_ms);
+
+    end_ms = curr_time_ms() + duration_ms;
+    if (!precisePoll || ((int32_t)(end_ms - precisePollEnd_ms) > 0)) {
+	precisePollEnd_ms = end_ms;
+    }
+
+    if (!precisePoll) {
+	precisePoll = true;
+	message_startTimer(MESSAGE_PRECISE_POLL_INTERVAL_MS);
+    }
+}
+
+static uint8_t message_findFlood(const messageFlood_t *cache, uint8_t cacheSize,
+	char type, uint16_t origin, uint8_t id) {
+    uint8_t i;
+
+    for (i = 0; i < cacheSize; i++) {
+	if ((cache[i].faceNum != 0) && (cache[i].type == type) &&
+	    (cache[i].origin == origin) && (cache[i].id == id)) {
+	    return cache[i].faceNum;
+	}
+    }
+
+    return 0;
+}
+
+static bool message_addFlood(messageFlood_t *cache, uint8_t cacheSize, uint8_t *p_index,
+	char type, uint16_t origin, uint8_t id, uint8_t faceNum) {
+    if (message_findFlood(cache, cacheSize, type, origin, id) != 0) {
+	return false;
+    }
+
+    cache[*p_index].type = type;
+    cache[*p_index].origin = origin;
+    cache[*p_index].id = id;
+    cache[*p_index].faceNum = faceNum;
+    *p_index = (*p_index + 1) % cacheSize;
+
+    return true;
+}
+
+/**@brief Records that a flooded message arrived on the given face.
+ *
+ * @return false if the message has already been seen (and should be dropped).
+ */
+bool message_recordFlood(char type, uint16_t origin, uint8_t id, uint8_t faceNum) {
+    return message_addFlood(floodCache, MESSAGE_FLOOD_CACHE_SIZE, &floodCacheIndex, type, origin, id, faceNum);
+}
+
+/**@brief Records that a flooded query, whose replies return along the path
+ * that it took, arrived on the given face.
+ *
+ * @return false if the query has already been seen (and should be dropped).
+ */
+bool message_recordRoute(char type, uint16_t origin, uint8_t id, uint8_t faceNum) {
+    return message_addFlood(routeCache, MESSAGE_ROUTE_CACHE_SIZE, &routeCacheIndex, type, origin, id, faceNum);
+}
+
+/**@brief Returns the face (1-6) on which a query recorded by
+ * message_recordRoute() first arrived, or 0 if it is unknown.
+ */
+uint8_t message_getRouteFace(char type, uint16_t origin, uint8_t id) {
+    return message_findFlood(routeCache, MESSAGE_ROUTE_CACHE_SIZE, type, origin, id);
+}
+
+/**@brief Queues a message on every face except one (e.g. the face on which it
+ * arrived).
+ */
+void message_sendToAllBut(uint8_t exceptFaceNum, irtxPriority_t priority, const char *str) {
+    uint8_t faceNum;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if (faceNum != exceptFaceNum) {
+	    irtx_queueString(faceNum, priority, str);
+	}
+    }
+}
+
+/**@brief Returns the time, according to curr_time_ms(), at which the message
+ * currently being processed was read from its faceboard.
+ */
+uint32_t message_getRxTime_ms() {
+    return rxTime_ms;
+}
+
 void message_timeoutHandler(void *p_context) {
     static char buffer[6][128];
     static short bufferLen[6];
+    /* Whether any of the current message's characters have been lost */
+    static bool corrupt[6];
 
     // read as many bytes as we can; split at '\n'
     // keep buffer; once '|' is seen, parse message
     uint8_t count;
     uint8_t rxData[100];
+    uint32_t now_ms;
+    bool fullPoll;
+
+    if (!initialized) {
+	return;
+    }
+
+    /* While fast polling, only the requested faces are polled on every tick,
+     * and the rest continue to be polled at the normal interval. */
+    now_ms = curr_time_ms();
+    fullPoll = (now_ms - lastFullPoll_ms + MESSAGE_FAST_POLL_INTERVAL_MS / 2 >= MESSAGE_POLL_INTERVAL_MS);
+    if (fullPoll) {
+	lastFullPoll_ms = now_ms;
+    }
 
     for (int faceNum = 0; faceNum <= 5; faceNum++) {		
+	if (!fullPoll && !(fastPollFaces & (1 << faceNum))) {
+	    continue;
+	}
+
 	if (fb_getRxBufferConsumedCount(faceNum + 1, &count)) {
 	    if (count == 0) {
 		continue;
@@ -64,35 +309,102 @@ void message_timeoutHandler(void *p_context) {
 	    }
 
 	    fb_receiveFromRxBuffer(faceNum + 1, count, rxData);
+	    rxTime_ms = curr_time_ms();
+	    irtx_noteReceived(faceNum + 1);
+	    message_requestFastPoll(faceNum + 1, MESSAGE_RX_FAST_POLL_MS);
 	    for (int i = 0; i < count; i++) {
 		short len = bufferLen[faceNum];
 		if (rxData[i] > 0x7F) {
+		    /* The faceboards pad every write with FB_TX_PAD_BYTE,
+		     * which is skipped wherever it arrives: between frames,
+		     * or inside a frame that was written in several chunks.
+		     * Any other such byte inside a frame means that
+		     * characters have been lost. */
+		    if ((rxData[i] != FB_TX_PAD_BYTE) && (len != 0)) {
+			corrupt[faceNum] = true;
+		    }
 		    continue;
 		}
 		if ((char) rxData[i] == '|') {
 		    // message has been received, send it for processing
 		    buffer[faceNum][len] = '\0';
-		    process_message(buffer[faceNum]);
+		    irlink_recordFrame(faceNum + 1, !corrupt[faceNum]);
+		    if (corrupt[faceNum]) {
+			/* Most likely our neighbor's frame collided with one
+			 * of ours, so we give the channel to the neighbor.
+			 * The frame has lost characters (possibly including
+			 * the '|' of the frame before it), so it is dropped
+			 * rather than misread. */
+			irtx_backoff(faceNum + 1);
+		    } else {
+			process_message(faceNum + 1, buffer[faceNum]);
+		    }
 
 		    bufferLen[faceNum] = 0;
+		    corrupt[faceNum] = false;
 		} else {
 		    buffer[faceNum][len] = (char) rxData[i];
 		    bufferLen[faceNum] = (len + 1) % 128;
+		    if (bufferLen[faceNum] == 0) {
+			corrupt[faceNum] = true;
+		    }
 		}
 	    }
 	}
     }
+
+    /* Fast polling never ends before precise polling, which it covers. */
+    if (precisePoll && ((int32_t)(now_ms - precisePollEnd_ms) >= 0)) {
+	precisePoll = false;
+	if ((int32_t)(now_ms - fastPollEnd_ms) < 0) {
+	    message_startTimer(MESSAGE_FAST_POLL_INTERVAL_MS);
+	}
+    }
+
+    if ((fastPollFaces != 0x00) && ((int32_t)(now_ms - fastPollEnd_ms) >= 0)) {
+	fastPollFaces = 0x00;
+	message_startTimer(MESSAGE_POLL_INTERVAL_MS);
+    }
+
+    /* Give the services built on top of the messaging layer a chance to run
+     * their periodic tasks. */
+    neighbor_tick();
+    timesync_tick();
+    rpc_tick();
+    xfer_tick();
+    irlink_tick();
+    leader_tick();
+    gradient_tick();
+    irdfu_tick();
 }
 
 /**@brief Process message and execute command
  *
  * Messages are formatted:
  *		<type>;<sender MAC>+<sender count>;<command>
+ *
+ * Messages belonging to one of the network services (whose types are
+ * distinct from those handled here) are passed to that service instead.
+ *
+ * @param[in] faceNum   Face (1-6) on which the message was received.
+ * @param[in] msg       '|'-stripped, null-terminated message text.
  */
-void process_message(char *msg) {
+void process_message(uint8_t faceNum, char *msg) {
     static int msg_cnt = 0;
     char macaddr[13];
     char recaddr[13];
+
+    if (neighbor_processMessage(faceNum, msg) ||
+	timesync_processMessage(faceNum, msg) ||
+	rpc_processMessage(faceNum, msg) ||
+	xfer_processMessage(faceNum, msg) ||
+	group_processMessage(faceNum, msg) ||
+	irlink_processMessage(faceNum, msg) ||
+	leader_processMessage(faceNum, msg) ||
+	gradient_processMessage(faceNum, msg) ||
+	irdfu_processMessage(faceNum, msg)) {
+	return;
+    }
     
     MACaddress(macaddr);
     macaddr[12] = '\0';
@@ -100,6 +412,9 @@ void process_message(char *msg) {
     app_uart_put_string(msg);
     app_uart_put_string("\r\n");
     char *token = strtok(msg, ";");
+    if (token == NULL) {
+	return;
+    }
     if (strcmp(token, "sendcmd") == 0) {
 	token = strtok(NULL, ";");
 	strncpy(recaddr, token, sizeof(recaddr));
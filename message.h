@@ -1,9 +1,23 @@
 #ifndef MESSAGE_H_
 #define MESSAGE_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "irtx.h"
+
 void message_init(void);
 void message_deinit(void);
 
-void process_message(char *msg);
+void message_requestFastPoll(uint8_t faceNum, uint32_t duration_ms);
+void message_requestPrecisePoll(uint8_t faceNum, uint32_t duration_ms);
+uint32_t message_getRxTime_ms(void);
+
+bool message_recordFlood(char type, uint16_t origin, uint8_t id, uint8_t faceNum);
+bool message_recordRoute(char type, uint16_t origin, uint8_t id, uint8_t faceNum);
+uint8_t message_getRouteFace(char type, uint16_t origin, uint8_t id);
+void message_sendToAllBut(uint8_t exceptFaceNum, irtxPriority_t priority, const char *str);
+
+void process_message(uint8_t faceNum, char *msg);
 
 #endif /* MESSAGE_H_ */
\ No newline at end of file
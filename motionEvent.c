@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 
 #include "app_scheduler.h"
@@ -17,16 +19,26 @@
 #include "mpu6050.h"
 #include "sma.h"
 #include "mechbrake.h"
+#include "brakeprofile.h"
 #include "bldc.h"
 #include "imu.h"
 #include "util.h"
 #include "fb.h"
+#include "light.h"
 #include "motionEvent.h"
 
 #define DEBUG_MOTION_EVENTS			1
 
 #define AXIS_ALIGNMENT_ERROR_DEG	10.00f
 
+/* After each roll, the light tracker waits for the module to come to rest
+ * before it reads the IMU and light sensors again.  A module which fails to
+ * tip over this many times in a row gives up. */
+#define LIGHT_TRACKER_SETTLE_TIME_MS	1500
+#define LIGHT_TRACKER_MAX_FAILED_ROLLS	3
+/* Readings averaged per face when the light sampling service is not running */
+#define LIGHT_TRACKER_LIGHT_SAMPLES	4
+
 static bool initialized = false;
 
 static app_timer_id_t timerID = TIMER_NULL;
@@ -68,15 +80,52 @@ static bool inertialActuationEBrake;
 static bool inertialActuationAccel;
 static uint16_t inertialActuationEBrakeAccelStartDelay_ms;
 static bool inertialActuationAccelReverse;
+/* Brake profile used in place of the brake current and time, if any */
+static uint8_t inertialActuationProfileID = BRAKEPROFILE_NONE;
+
+/* These module-level variables must be set when tracking light.  The roll
+ * parameters are indexed by direction: 0 for forward and 1 for reverse. */
+static bool lightTrackerActive = false;
+static bool lightTrackerSeek;
+static uint16_t lightTrackerSpeed_rpm[2];
+static uint16_t lightTrackerBrakeCurrent_mA[2];
+static uint16_t lightTrackerBrakeTime_ms[2];
+static uint8_t lightTrackerProfileID[2];
+static uint16_t lightTrackerThreshold;
+static uint8_t lightTrackerMaxSteps;
+static uint8_t lightTrackerSteps;
+static uint8_t lightTrackerFailedRolls;
+/* The lateral face towards which a forward roll tips the module, or 0 until
+ * the first roll has revealed it */
+static uint8_t lightTrackerFrontFace;
+static uint8_t lightTrackerBottomFace;
+static bool lightTrackerReverse;
+/* Whether the last roll was towards the light, rather than one made to learn
+ * which way a forward roll goes */
+static bool lightTrackerDecided;
+static app_sched_event_handler_t lightTrackerEventHandler;
 
 /* These module-level variables are used to check for actuator stabilization */
 static vectorFloat_t gravityCurrent;
 static vectorFloat_t gravityNew;
+/* Time at which the e-brake was last released, and the IMU reads made since
+ * then while waiting for the central actuator to stabilize */
+static uint32_t settleStartTime_rtcTicks;
+static uint8_t settleChecks;
+static uint16_t lastSettleTime_ms = 0;
+static uint8_t lastSettleChecks = 0;
 
 static void accelPlaneChangePrimitiveHandler(void *p_event_data, uint16_t event_size);
 static void accelBrakePlaneChangePrimitiveHandler(void *p_event_data, uint16_t event_size);
 static void ebrakePlaneChangePrimitiveHandler(void *p_event_data, uint16_t event_size);
 static void inertialActuationPrimitiveHandler(void *p_event_data, uint16_t event_size);
+static void lightTrackerPrimitiveHandler(void *p_event_data, uint16_t event_size);
+static void lightTrackerRollEventHandler(void *p_event_data, uint16_t event_size);
+static void lightTracker_step(void);
+static void lightTracker_finish(motionEvent_t motionEvent);
+static bool lightTracker_getBottomFace(uint8_t *bottomFace);
+static uint8_t lightTracker_getOppositeFace(uint8_t faceNum);
+static int16_t lightTracker_getLight(uint8_t faceNum);
 
 bool motionEvent_init() {
     uint32_t err_code;
@@ -246,6 +295,7 @@ void ebrakePlaneChangePrimitiveHandler(void *p_event_data, uint16_t event_size)
     bool flywheelFrameAligned;
     unsigned int alignmentAxisIndex;
     float gyroMag;
+    uint32_t currentTime_rtcTicks;
 
     char str[100];
     float axisAngles[3];
@@ -355,6 +405,8 @@ void ebrakePlaneChangePrimitiveHandler(void *p_event_data, uint16_t event_size)
 	break;
     case MOTION_PRIMITIVE_BLDC_COASTING:
 	app_uart_put_debug("E-brake released\r\n", DEBUG_MOTION_EVENTS);
+	app_timer_cnt_get(&settleStartTime_rtcTicks);
+	settleChecks = 0;
 
 	if (tapBreak && tapCount < 3) {
 	    motionEvent_delay(250, ebrakePlaneChangePrimitiveHandler);
@@ -386,13 +438,21 @@ void ebrakePlaneChangePrimitiveHandler(void *p_event_data, uint16_t event_size)
 
 	/* Check that the accelerometer readings have stabilized. */
 	imu_getGravityFloat(&gravityNew);
+	if (settleChecks < UINT8_MAX) {
+	    settleChecks++;
+	}
 	if (fabs(gravityNew.x - gravityCurrent.x) < 0.03 &&
 	    fabs(gravityNew.y - gravityCurrent.y) < 0.03 &&
 	    fabs(gravityNew.z - gravityCurrent.z) < 0.03) {	
 	    /* Central actuator is not moving, so we read the gravity vector
 	     * from the IMU and check whether it is 1) aligned with one of the
 	     * cube's faces, and 2) aligned with a the correct face. */
-	    app_uart_put_debug("Central actuator has stabilized\r\n", DEBUG_MOTION_EVENTS);
+	    app_timer_cnt_get(&currentTime_rtcTicks);
+	    lastSettleTime_ms = ((0x00FFFFFF & (currentTime_rtcTicks - settleStartTime_rtcTicks)) * USEC_PER_APP_TIMER_TICK) / 1000;
+	    lastSettleChecks = settleChecks;
+	    snprintf(str, sizeof(str), "Central actuator has stabilized (%u ms after e-brake, %u IMU reads)\r\n",
+		     lastSettleTime_ms, lastSettleChecks);
+	    app_uart_put_debug(str, DEBUG_MOTION_EVENTS);
 			
 	    if (!motionEvent_getFlywheelFrameAligned(&flywheelFrameAligned, &alignmentAxisIndex)) {
 		app_uart_put_debug("Failed to determine whether flywheel and frame are aligned\r\n", DEBUG_MOTION_EVENTS);
@@ -503,6 +563,7 @@ bool motionEvent_startInertialActuation(uint16_t bldcSpeed_rpm,
     inertialActuationAccel = accel;
     inertialActuationEBrakeAccelStartDelay_ms = eBrakeAccelStartDelay_ms;
     inertialActuationAccelReverse = accelReverse;
+    inertialActuationProfileID = BRAKEPROFILE_NONE;
 
     eventHandler = motionEventHandler;
 
@@ -515,25 +576,56 @@ bool motionEvent_startInertialActuation(uint16_t bldcSpeed_rpm,
     return true;
 }
 
+/**@brief Performs an inertial actuation braked according to one of the
+ * stored brake profiles, at the profile's flywheel speed.  The brake current
+ * is scaled for the flywheel speed actually reached and the battery voltage.
+ */
+bool motionEvent_startProfileInertialActuation(uint8_t profileID, bool reverse,
+					       app_sched_event_handler_t motionEventHandler) {
+    brakeProfile_t profile;
+
+    if (!brakeprofile_get(profileID, &profile)) {
+	return false;
+    }
+
+    if (!motionEvent_startInertialActuation(profile.speed_rpm, 0, 0, reverse, false, false, 0, false,
+					    motionEventHandler)) {
+	return false;
+    }
+
+    inertialActuationProfileID = profileID;
+
+    return true;
+}
+
 void inertialActuationPrimitiveHandler(void *p_event_data, uint16_t event_size) {
     uint32_t err_code;
     motionPrimitive_t motionPrimitive;
     motionEvent_t motionEvent;
-    coilCurrentStep_t coilCurrentStep;
+    coilCurrentStep_t coilCurrentSteps[BRAKEPROFILE_MAX_STEPS];
+    uint8_t stepCount;
 
     motionPrimitive = *(motionPrimitive_t *)p_event_data;
 
     switch(motionPrimitive) {
     case MOTION_PRIMITIVE_BLDC_STABLE:
     case MOTION_PRIMITIVE_BLDC_TIMEOUT:
-	if (inertialActuationReverse) {
-	    coilCurrentStep.current_mA = -inertialActuationBrakeCurrent_mA;
+	/* The profile is scaled for the flywheel speed, so must be read
+	 * before the flywheel is stopped. */
+	if (inertialActuationProfileID != BRAKEPROFILE_NONE) {
+	    stepCount = brakeprofile_getSteps(inertialActuationProfileID, inertialActuationReverse,
+					      coilCurrentSteps, BRAKEPROFILE_MAX_STEPS);
 	} else {
-	    coilCurrentStep.current_mA = inertialActuationBrakeCurrent_mA;
+	    if (inertialActuationReverse) {
+		coilCurrentSteps[0].current_mA = -inertialActuationBrakeCurrent_mA;
+	    } else {
+		coilCurrentSteps[0].current_mA = inertialActuationBrakeCurrent_mA;
+	    }
+	    coilCurrentSteps[0].time_ms = inertialActuationBrakeTime_ms;
+	    stepCount = 1;
 	}
-	coilCurrentStep.time_ms = inertialActuationBrakeTime_ms;
 	bldc_setSpeed(0, false, 0, NULL);
-	mechbrake_actuate(1, &coilCurrentStep, inertialActuationPrimitiveHandler);
+	mechbrake_actuate(stepCount, coilCurrentSteps, inertialActuationPrimitiveHandler);
 	break;
 #if (0)
     case MOTION_PRIMITIVE_BLDC_TIMEOUT:
@@ -582,6 +674,362 @@ void inertialActuationPrimitiveHandler(void *p_event_data, uint16_t event_size)
     }
 }
 
+/**@brief Rolls the module towards (or away from) the brightest light, one
+ * inertial actuation at a time.
+ *
+ * Before each roll, the faceboard IMU tells us which face is on the ground,
+ * and so which four faces are lateral.  A roll about the flywheel tips the
+ * module onto one of two opposite lateral faces; which one a forward roll
+ * picks is learnt from the first roll, and is then tracked as the module
+ * tumbles.  The tracker rolls forward or in reverse according to which of
+ * these two faces sees more light, and stops once the difference between them
+ * falls below the threshold, once it has rolled past the light, when the light
+ * lies across the plane in which the module can roll, or after the given
+ * number of rolls.
+ *
+ * @param[in] type         True to seek light, false to avoid it.
+ * @param[in] threshold    Difference in light level (0-1023) between the front
+ *                         and back faces below which the tracker stops.
+ * @param[in] maxSteps     Most rolls to make.
+ * @param[in] motionEventHandler  Handler to which the outcome (one of the
+ *                         MOTION_EVENT_LIGHT_TRACKER_* events) is passed.
+ */
+bool motionEvent_startLightTracker(bool type, uint16_t bldcSpeed_rpm_f, uint16_t brakeCurrent_mA_f, uint16_t brakeTime_ms_f,
+				   uint16_t bldcSpeed_rpm_r, uint16_t brakeCurrent_mA_r, uint16_t brakeTime_ms_r,
+				   uint16_t threshold, uint8_t maxSteps, app_sched_event_handler_t motionEventHandler) {
+    uint32_t err_code;
+    motionPrimitive_t motionPrimitive;
+
+    if (lightTrackerActive) {
+	return false;
+    }
+
+    lightTrackerSeek = type;
+    lightTrackerSpeed_rpm[0] = bldcSpeed_rpm_f;
+    lightTrackerBrakeCurrent_mA[0] = brakeCurrent_mA_f;
+    lightTrackerBrakeTime_ms[0] = brakeTime_ms_f;
+    lightTrackerSpeed_rpm[1] = bldcSpeed_rpm_r;
+    lightTrackerBrakeCurrent_mA[1] = brakeCurrent_mA_r;
+    lightTrackerBrakeTime_ms[1] = brakeTime_ms_r;
+    lightTrackerProfileID[0] = BRAKEPROFILE_NONE;
+    lightTrackerProfileID[1] = BRAKEPROFILE_NONE;
+    lightTrackerThreshold = threshold;
+    lightTrackerMaxSteps = maxSteps;
+
+    lightTrackerSteps = 0;
+    lightTrackerFailedRolls = 0;
+    lightTrackerFrontFace = 0;
+    lightTrackerBottomFace = 0;
+    lightTrackerDecided = false;
+
+    lightTrackerEventHandler = motionEventHandler;
+    lightTrackerActive = true;
+
+    motionPrimitive = MOTION_PRIMITIVE_START_SEQUENCE;
+    err_code = app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), lightTrackerPrimitiveHandler);
+    APP_ERROR_CHECK(err_code);
+
+    return true;
+}
+
+/**@brief Tracks light like motionEvent_startLightTracker(), rolling forward
+ * and in reverse with the given brake profiles.  The outcome of each roll, as
+ * seen by the faceboard IMU, is reported to the profile it used, so that an
+ * adaptive profile learns how hard to brake.
+ */
+bool motionEvent_startProfileLightTracker(bool type, uint8_t profileID_f, uint8_t profileID_r,
+					  uint16_t threshold, uint8_t maxSteps,
+					  app_sched_event_handler_t motionEventHandler) {
+    brakeProfile_t profile;
+
+    if (!brakeprofile_get(profileID_f, &profile) || !brakeprofile_get(profileID_r, &profile)) {
+	return false;
+    }
+
+    if (!motionEvent_startLightTracker(type, 0, 0, 0, 0, 0, 0, threshold, maxSteps, motionEventHandler)) {
+	return false;
+    }
+
+    lightTrackerProfileID[0] = profileID_f;
+    lightTrackerProfileID[1] = profileID_r;
+
+    return true;
+}
+
+/**@brief Returns how long the central actuator took to stabilize after the
+ * e-brake was last released in a plane change, and the number of IMU reads
+ * made to find out.
+ */
+void motionEvent_getLastSettle(uint16_t *settleTime_ms, uint8_t *imuReads) {
+    *settleTime_ms = lastSettleTime_ms;
+    *imuReads = lastSettleChecks;
+}
+
+/**@brief Stops the light tracker after the roll in progress, if any. */
+void motionEvent_stopLightTracker() {
+    lightTrackerActive = false;
+}
+
+void lightTrackerPrimitiveHandler(void *p_event_data, uint16_t event_size) {
+    motionPrimitive_t motionPrimitive;
+
+    motionPrimitive = *(motionPrimitive_t *)p_event_data;
+
+    switch (motionPrimitive) {
+    case MOTION_PRIMITIVE_START_SEQUENCE:
+    case MOTION_PRIMITIVE_TIMER_EXPIRED:
+	lightTracker_step();
+	break;
+    default:
+	break;
+    }
+}
+
+void lightTrackerRollEventHandler(void *p_event_data, uint16_t event_size) {
+    motionEvent_t motionEvent;
+
+    motionEvent = *(motionEvent_t *)p_event_data;
+
+    switch (motionEvent) {
+    case MOTION_EVENT_INERTIAL_ACTUATION_COMPLETE:
+	motionEvent_delay(LIGHT_TRACKER_SETTLE_TIME_MS, lightTrackerPrimitiveHandler);
+	break;
+    case MOTION_EVENT_INERTIAL_ACTUATION_FAILURE:
+	lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_FAILURE);
+	break;
+    default:
+	break;
+    }
+}
+
+void lightTracker_step() {
+    uint8_t bottomFace, topFace, backFace;
+    uint8_t faceNum, brightFace;
+    int16_t light[6];
+    int16_t gradient, sideGradient;
+    bool tipped = false;
+    bool reverse;
+    uint8_t profileID;
+    char str[100];
+
+    if (!lightTrackerActive) {
+	return;
+    }
+
+    if (!lightTracker_getBottomFace(&bottomFace)) {
+	app_uart_put_debug("Light tracker failed to read faceboard IMU\r\n", DEBUG_MOTION_EVENTS);
+	lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_FAILURE);
+	return;
+    }
+    topFace = lightTracker_getOppositeFace(bottomFace);
+
+    /* Work out where the last roll left us.  A module which rolls forward
+     * lands on its front face and its old top face becomes its new front
+     * face; one which rolls in reverse lands on its back face and its old
+     * bottom face becomes its new front face. */
+    if (lightTrackerBottomFace != 0) {
+	profileID = lightTrackerProfileID[lightTrackerReverse ? 1 : 0];
+	tipped = (bottomFace != lightTrackerBottomFace);
+	if (!tipped) {
+	    app_uart_put_debug("Light tracker roll did not tip the module\r\n", DEBUG_MOTION_EVENTS);
+	    brakeprofile_reportOutcome(profileID, BRAKEPROFILE_OUTCOME_NO_TIP);
+	    if (++lightTrackerFailedRolls >= LIGHT_TRACKER_MAX_FAILED_ROLLS) {
+		lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_FAILURE);
+		return;
+	    }
+	} else if (bottomFace == lightTracker_getOppositeFace(lightTrackerBottomFace)) {
+	    /* The module tumbled too far to tell how it rolled. */
+	    brakeprofile_reportOutcome(profileID, BRAKEPROFILE_OUTCOME_TUMBLED);
+	    lightTrackerFrontFace = 0;
+	    lightTrackerFailedRolls = 0;
+	} else {
+	    brakeprofile_reportOutcome(profileID, BRAKEPROFILE_OUTCOME_TIPPED);
+	    lightTrackerFrontFace = lightTrackerReverse ? lightTrackerBottomFace : lightTracker_getOppositeFace(lightTrackerBottomFace);
+	    lightTrackerFailedRolls = 0;
+	}
+    }
+
+    /* Compare the light seen by the lateral faces.  For a module avoiding
+     * light, the darkest face is the most attractive, so the levels are
+     * inverted. */
+    brightFace = 0;
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if ((faceNum == bottomFace) || (faceNum == topFace)) {
+	    continue;
+	}
+
+	light[faceNum-1] = lightTracker_getLight(faceNum);
+	if (light[faceNum-1] < 0) {
+	    lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_FAILURE);
+	    return;
+	}
+	if (!lightTrackerSeek) {
+	    light[faceNum-1] = 1023 - light[faceNum-1];
+	}
+
+	if ((brightFace == 0) || (light[faceNum-1] > light[brightFace-1])) {
+	    brightFace = faceNum;
+	}
+    }
+
+    if (lightTrackerFrontFace != 0) {
+	backFace = lightTracker_getOppositeFace(lightTrackerFrontFace);
+	gradient = light[lightTrackerFrontFace-1] - light[backFace-1];
+    } else {
+	/* Until we know which way a forward roll goes, we roll forward if any
+	 * lateral face is markedly brighter than the one opposite it.  This
+	 * need not be the brightest face: when avoiding light, both the face
+	 * opposite the light and those beside it are dark. */
+	gradient = 0;
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    if ((faceNum == bottomFace) || (faceNum == topFace)) {
+		continue;
+	    }
+
+	    backFace = lightTracker_getOppositeFace(faceNum);
+	    if (light[faceNum-1] - light[backFace-1] > gradient) {
+		gradient = light[faceNum-1] - light[backFace-1];
+	    }
+	}
+    }
+
+    snprintf(str, sizeof(str), "Light tracker step %u: bottom face %u, front face %u, gradient %d\r\n",
+	     lightTrackerSteps, bottomFace, lightTrackerFrontFace, gradient);
+    app_uart_put_debug(str, DEBUG_MOTION_EVENTS);
+
+    if ((lightTrackerFrontFace != 0) && (brightFace != lightTrackerFrontFace) &&
+	(brightFace != lightTracker_getOppositeFace(lightTrackerFrontFace))) {
+	/* The light is stronger across the plane in which we roll than along
+	 * it, and only a plane change can take us there. */
+	sideGradient = light[brightFace-1] - light[lightTracker_getOppositeFace(brightFace)-1];
+	if ((sideGradient >= (int16_t)lightTrackerThreshold) && (sideGradient > abs(gradient))) {
+	    lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_OFF_PLANE);
+	    return;
+	}
+    }
+
+    if (abs(gradient) < lightTrackerThreshold) {
+	lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_COMPLETE);
+	return;
+    }
+
+    /* If the light is now behind us, we have just rolled past it, and
+     * rolling back would only take us past it again. */
+    reverse = (lightTrackerFrontFace != 0) && (gradient < 0);
+    if (lightTrackerDecided && tipped && (lightTrackerFrontFace != 0) && (reverse != lightTrackerReverse)) {
+	lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_COMPLETE);
+	return;
+    }
+
+    if (lightTrackerSteps >= lightTrackerMaxSteps) {
+	lightTracker_finish(MOTION_EVENT_LIGHT_TRACKER_STEP_LIMIT);
+	return;
+    }
+
+    lightTrackerSteps++;
+    lightTrackerBottomFace = bottomFace;
+    lightTrackerReverse = reverse;
+    lightTrackerDecided = (lightTrackerFrontFace != 0);
+
+    profileID = lightTrackerProfileID[lightTrackerReverse ? 1 : 0];
+    if (profileID != BRAKEPROFILE_NONE) {
+	motionEvent_startProfileInertialActuation(profileID, lightTrackerReverse, lightTrackerRollEventHandler);
+	return;
+    }
+
+    motionEvent_startInertialActuation(lightTrackerSpeed_rpm[lightTrackerReverse ? 1 : 0],
+				       lightTrackerBrakeCurrent_mA[lightTrackerReverse ? 1 : 0],
+				       lightTrackerBrakeTime_ms[lightTrackerReverse ? 1 : 0],
+				       lightTrackerReverse, false, false, 0, false, lightTrackerRollEventHandler);
+}
+
+void lightTracker_finish(motionEvent_t motionEvent) {
+    uint32_t err_code;
+
+    lightTrackerActive = false;
+
+    if (lightTrackerEventHandler != NULL) {
+	err_code = app_sched_event_put(&motionEvent, sizeof(motionEvent), lightTrackerEventHandler);
+	APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Finds the face resting on the ground, i.e. the one whose normal
+ * points most nearly along gravity.  The DMP's gravity vector points up, away
+ * from the ground, as the accelerometer sees it.
+ */
+bool lightTracker_getBottomFace(uint8_t *bottomFace) {
+    vectorFloat_t gravity;
+    uint8_t oldAddress;
+    uint8_t faceNum;
+    float projection, minProjection;
+    bool success;
+
+    oldAddress = mpu6050_getAddress();
+    mpu6050_setAddress(MPU6050_I2C_ADDR_FACE);
+    success = imu_getGravityFloat(&gravity);
+    mpu6050_setAddress(oldAddress);
+
+    if (!success) {
+	return false;
+    }
+
+    /* A reading that is not a number matches no face. */
+    *bottomFace = 0;
+    minProjection = 2.0f;
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	projection = frameFaceNormals[faceNum-1][0] * gravity.x +
+	    frameFaceNormals[faceNum-1][1] * gravity.y +
+	    frameFaceNormals[faceNum-1][2] * gravity.z;
+
+	if (projection < minProjection) {
+	    minProjection = projection;
+	    *bottomFace = faceNum;
+	}
+    }
+
+    return (*bottomFace != 0);
+}
+
+uint8_t lightTracker_getOppositeFace(uint8_t faceNum) {
+    uint8_t face;
+
+    for (face = 1; face <= 6; face++) {
+	if ((frameFaceNormals[face-1][0] == -frameFaceNormals[faceNum-1][0]) &&
+	    (frameFaceNormals[face-1][1] == -frameFaceNormals[faceNum-1][1]) &&
+	    (frameFaceNormals[face-1][2] == -frameFaceNormals[faceNum-1][2])) {
+	    return face;
+	}
+    }
+
+    return faceNum;
+}
+
+/**@brief Returns the light level (0-1023) seen by a face, or -1 on error.
+ * While the light sampling service is running, its filtered level is used
+ * and the faceboard is not read at all.
+ */
+int16_t lightTracker_getLight(uint8_t faceNum) {
+    int32_t sum;
+    int16_t ambient;
+    uint8_t i;
+
+    if (light_isRunning() && (light_getFiltered(faceNum) >= 0)) {
+	return light_getFiltered(faceNum);
+    }
+
+    sum = 0;
+    for (i = 0; i < LIGHT_TRACKER_LIGHT_SAMPLES; i++) {
+	ambient = fb_getAmbientLight(faceNum);
+	if (ambient < 0) {
+	    return -1;
+	}
+	sum += ambient;
+    }
+
+    return (sum + LIGHT_TRACKER_LIGHT_SAMPLES / 2) / LIGHT_TRACKER_LIGHT_SAMPLES;
+}
+
 bool motionEvent_getFlywheelFrameAligned(bool *flywheelFrameAligned, unsigned int *axisIndex) {
     uint8_t i;
     vectorFloat_t gravity;
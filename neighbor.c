@@ -0,0 +1,457 @@
+/*
+ * neighbor.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "global.h"
+#include "util.h"
+#include "mpu6050.h"
+#include "imu.h"
+#include "irtx.h"
+#include "message.h"
+#include "irlink.h"
+#include "neighbor.h"
+
+/* Beacons are sent at the minimum interval whenever the topology changes.
+ * Each time a beacon is sent without the topology having changed, the
+ * interval doubles until it reaches the maximum. */
+#define NEIGHBOR_BEACON_INTERVAL_MIN_SEC	2
+#define NEIGHBOR_BEACON_INTERVAL_MAX_SEC	32
+#define NEIGHBOR_BEACON_JITTER_MS		500
+
+/* A neighbor is forgotten once it has missed this many of its beacons.  The
+ * additional slack covers the delay introduced by polling the receivers. */
+#define NEIGHBOR_EXPIRY_INTERVALS		3
+#define NEIGHBOR_EXPIRY_SLACK_MS		2000
+
+/* The quality estimate moves 1/NEIGHBOR_QUALITY_GAIN of the way towards 100%
+ * for each received beacon and towards 0% for each missed beacon. */
+#define NEIGHBOR_QUALITY_GAIN			4
+#define NEIGHBOR_QUALITY_INITIAL_PERCENT	50
+
+/* Map responses carry at most this many table entries each, so that a module
+ * with a full table sends it in several frames which each fit comfortably in
+ * the bulk transmit queue alongside the responses being relayed through it. */
+#define NEIGHBOR_MAP_ENTRIES_PER_FRAME		3
+
+/* Every module answers a map query after a random delay of up to this long,
+ * and only once its parent's bulk queue has drained, so that the responses
+ * of a large cluster do not all converge on the modules near the origin at
+ * once.  The faces are polled quickly for a while longer to receive the
+ * responses of modules further away. */
+#define NEIGHBOR_MAP_RESPONSE_WINDOW_MS		8000
+#define NEIGHBOR_MAP_FAST_POLL_MS		8000
+
+static bool initialized = false;
+
+static neighbor_t neighbors[6];
+
+static bool topologyChanged;
+static uint8_t beaconSeq;
+static uint8_t beaconInterval_sec;
+static uint32_t lastBeacon_ms;
+static uint32_t nextBeacon_ms;
+
+static uint8_t queryID = 0;
+static uint16_t mapFramesDropped = 0;
+
+/* The map query that we have yet to answer, if any */
+static bool responsePending = false;
+static uint16_t responseOrigin;
+static uint8_t responseQueryID;
+static uint8_t responseFace;
+static uint32_t responseDue_ms;
+
+static void neighbor_sendBeacons(void);
+static void neighbor_processBeacon(uint8_t faceNum, const char *msg);
+static void neighbor_processQuery(uint8_t faceNum, const char *msg);
+static void neighbor_processResponse(uint8_t faceNum, const char *msg);
+static void neighbor_sendResponse(void);
+static uint8_t neighbor_formatEntries(char *str, uint8_t strSize, uint8_t *p_faceNum, uint8_t maxCount);
+
+void neighbor_init() {
+    uint8_t faceNum;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	neighbors[faceNum-1].present = false;
+    }
+
+    /* Seed the beacon jitter with our ID so that neighbors which boot
+     * together do not keep beaconing in lockstep. */
+    srand(getNodeID());
+
+    beaconInterval_sec = NEIGHBOR_BEACON_INTERVAL_MIN_SEC;
+    lastBeacon_ms = curr_time_ms();
+    nextBeacon_ms = lastBeacon_ms;
+    topologyChanged = true;
+    responsePending = false;
+
+    initialized = true;
+}
+
+void neighbor_deinit() {
+    initialized = false;
+}
+
+void neighbor_tick() {
+    uint32_t now_ms;
+    uint32_t expiry_ms;
+    uint8_t faceNum;
+    neighbor_t *p_neighbor;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    /* The free space excludes the length byte of the next message, so the
+     * parent's bulk queue is empty when one byte short of its size is free. */
+    if (responsePending && ((int32_t)(now_ms - responseDue_ms) >= 0) &&
+	    (irtx_getQueueFreeSpace(responseFace, IRTX_PRIORITY_BULK) >= IRTX_BULK_QUEUE_SIZE - 1)) {
+	neighbor_sendResponse();
+    }
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	p_neighbor = &neighbors[faceNum-1];
+
+	if (!p_neighbor->present) {
+	    continue;
+	}
+
+	expiry_ms = NEIGHBOR_EXPIRY_INTERVALS * 1000 * (uint32_t)p_neighbor->interval_sec + NEIGHBOR_EXPIRY_SLACK_MS;
+	if (now_ms - p_neighbor->lastSeen_ms > expiry_ms) {
+	    p_neighbor->present = false;
+	    topologyChanged = true;
+	}
+    }
+
+    /* A change in topology resets the beacon interval, but we never beacon
+     * more often than the minimum interval. */
+    if (topologyChanged) {
+	topologyChanged = false;
+	beaconInterval_sec = NEIGHBOR_BEACON_INTERVAL_MIN_SEC;
+	nextBeacon_ms = lastBeacon_ms + 1000 * NEIGHBOR_BEACON_INTERVAL_MIN_SEC;
+    }
+
+    if ((int32_t)(now_ms - nextBeacon_ms) < 0) {
+	return;
+    }
+
+    neighbor_sendBeacons();
+
+    lastBeacon_ms = now_ms;
+    nextBeacon_ms = now_ms + 1000 * (uint32_t)beaconInterval_sec + (rand() % NEIGHBOR_BEACON_JITTER_MS);
+
+    if (beaconInterval_sec < NEIGHBOR_BEACON_INTERVAL_MAX_SEC) {
+	beaconInterval_sec *= 2;
+    }
+}
+
+void neighbor_sendBeacons() {
+    char str[40];
+    uint8_t faceNum;
+    uint8_t oldAddress;
+    vectorFloat_t gravity;
+
+    /* The faceboard IMU is fixed to the frame, so its gravity vector gives
+     * the orientation of the whole module. */
+    oldAddress = mpu6050_getAddress();
+    mpu6050_setAddress(MPU6050_I2C_ADDR_FACE);
+    if (!imu_getGravityFloat(&gravity)) {
+	gravity.x = gravity.y = gravity.z = 0.0f;
+    }
+    mpu6050_setAddress(oldAddress);
+
+    beaconSeq++;
+
+    /* Beacon: nbr;<id>;<face>;<seq>;<interval>;<gx>;<gy>;<gz> */
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	snprintf(str, sizeof(str), "nbr;%04x;%u;%u;%u;%d;%d;%d|",
+		getNodeID(), faceNum, beaconSeq, beaconInterval_sec,
+		(int)(gravity.x * 100.0f), (int)(gravity.y * 100.0f), (int)(gravity.z * 100.0f));
+	irtx_queueString(faceNum, IRTX_PRIORITY_CONTROL, str);
+    }
+}
+
+bool neighbor_processMessage(uint8_t faceNum, const char *msg) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "nbr;", 4) == 0) {
+	neighbor_processBeacon(faceNum, msg);
+    } else if (strncmp(msg, "nbrq;", 5) == 0) {
+	neighbor_processQuery(faceNum, msg);
+    } else if (strncmp(msg, "nbrr;", 5) == 0) {
+	neighbor_processResponse(faceNum, msg);
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+void neighbor_processBeacon(uint8_t faceNum, const char *msg) {
+    unsigned int id, face, seq, interval_sec;
+    int gx, gy, gz;
+    uint8_t missed;
+    neighbor_t *p_neighbor;
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "nbr;%x;%u;%u;%u;%d;%d;%d", &id, &face, &seq, &interval_sec, &gx, &gy, &gz) != 7) {
+	return;
+    }
+
+    /* Ignore our own beacons reflected back to us */
+    if ((id == getNodeID()) || (face < 1) || (face > 6)) {
+	return;
+    }
+
+    p_neighbor = &neighbors[faceNum-1];
+
+    if (!p_neighbor->present || (p_neighbor->id != id) || (p_neighbor->face != face)) {
+	p_neighbor->present = true;
+	p_neighbor->id = id;
+	p_neighbor->face = face;
+	p_neighbor->quality_percent = NEIGHBOR_QUALITY_INITIAL_PERCENT;
+	topologyChanged = true;
+    } else if ((uint8_t)seq == p_neighbor->lastSeq) {
+	/* Duplicate beacon */
+	irlink_recordDuplicate(faceNum);
+	return;
+    } else {
+	/* Every gap in the sequence numbers is a beacon that we missed */
+	missed = (uint8_t)(seq - p_neighbor->lastSeq - 1);
+	while ((missed-- > 0) && (p_neighbor->quality_percent > 0)) {
+	    p_neighbor->quality_percent -= (p_neighbor->quality_percent + NEIGHBOR_QUALITY_GAIN - 1) / NEIGHBOR_QUALITY_GAIN;
+	}
+	p_neighbor->quality_percent += (100 - p_neighbor->quality_percent + NEIGHBOR_QUALITY_GAIN - 1) / NEIGHBOR_QUALITY_GAIN;
+    }
+
+    p_neighbor->lastSeq = seq;
+    p_neighbor->interval_sec = interval_sec;
+    p_neighbor->lastSeen_ms = curr_time_ms();
+    p_neighbor->gravity[0] = gx;
+    p_neighbor->gravity[1] = gy;
+    p_neighbor->gravity[2] = gz;
+}
+
+bool neighbor_get(uint8_t faceNum, neighbor_t *p_neighbor) {
+    if ((faceNum < 1) || (faceNum > 6) || !neighbors[faceNum-1].present) {
+	return false;
+    }
+
+    *p_neighbor = neighbors[faceNum-1];
+
+    return true;
+}
+
+uint8_t neighbor_getCount() {
+    uint8_t faceNum;
+    uint8_t count = 0;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if (neighbors[faceNum-1].present) {
+	    count++;
+	}
+    }
+
+    return count;
+}
+
+/**@brief Formats the neighbor table as a comma-separated list of
+ * <ourFace>:<neighborID>:<neighborFace> entries.
+ *
+ * @return Number of neighbors in the list.
+ */
+uint8_t neighbor_formatTable(char *str, uint8_t strSize) {
+    uint8_t faceNum = 1;
+
+    return neighbor_formatEntries(str, strSize, &faceNum, 6);
+}
+
+/**@brief Formats up to maxCount entries of the neighbor table, starting with
+ * the given face, and advances the face past them (and past any faces without
+ * a neighbor that follow), so that it exceeds 6 once the table is complete.
+ *
+ * @return Number of neighbors in the list.
+ */
+uint8_t neighbor_formatEntries(char *str, uint8_t strSize, uint8_t *p_faceNum, uint8_t maxCount) {
+    uint8_t count = 0;
+    int len = 0;
+
+    str[0] = '\0';
+
+    for (; (*p_faceNum <= 6) && (count < maxCount); (*p_faceNum)++) {
+	if (!neighbors[*p_faceNum-1].present) {
+	    continue;
+	}
+
+	if (len < strSize) {
+	    len += snprintf(&str[len], strSize - len, "%s%u:%04x:%u", (count > 0) ? "," : "",
+		    *p_faceNum, neighbors[*p_faceNum-1].id, neighbors[*p_faceNum-1].face);
+	}
+	count++;
+    }
+
+    while ((*p_faceNum <= 6) && !neighbors[*p_faceNum-1].present) {
+	(*p_faceNum)++;
+    }
+
+    return count;
+}
+
+/**@brief Returns how many map response frames this module has had to drop,
+ * either its own or ones it was relaying, because its transmit queue was full.
+ */
+uint16_t neighbor_getMapFramesDropped() {
+    return mapFramesDropped;
+}
+
+/**@brief Starts collecting an adjacency map of the whole cluster.
+ *
+ * The query floods outwards from this module.  Every module remembers the
+ * face on which it first heard the query and returns its neighbor table (and
+ * those of modules further away) on that face, so the responses converge on
+ * this module, where they are printed.
+ *
+ * Responses are not acknowledged, so a response lost on the way (e.g. to a
+ * full transmit queue) is simply missing from the map.  A query for a single
+ * module fills such a gap without involving the rest of the cluster.
+ *
+ * @param[in] target    Node ID of the only module which should answer, or
+ *                      NEIGHBOR_MAP_TARGET_ALL.
+ */
+bool neighbor_startMapQuery(uint16_t target) {
+    char str[32];
+    char table[64];
+
+    if (!initialized) {
+	return false;
+    }
+
+    queryID++;
+
+    if ((target == NEIGHBOR_MAP_TARGET_ALL) || (target == getNodeID())) {
+	neighbor_formatTable(table, sizeof(table));
+	snprintf(str, sizeof(str), "%04x: ", getNodeID());
+	app_uart_put_string(str);
+	app_uart_put_string(table);
+	app_uart_put_string("\r\n");
+
+	if (target == getNodeID()) {
+	    return true;
+	}
+    }
+
+    /* Query: nbrq;<origin>;<query ID>;<target> */
+    snprintf(str, sizeof(str), "nbrq;%04x;%u;%04x|", getNodeID(), queryID, target);
+    message_sendToAllBut(0, IRTX_PRIORITY_CONTROL, str);
+    message_requestFastPoll(0, NEIGHBOR_MAP_FAST_POLL_MS);
+
+    return true;
+}
+
+void neighbor_processQuery(uint8_t faceNum, const char *msg) {
+    unsigned int origin, qid, target;
+    char str[32];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "nbrq;%x;%u;%x", &origin, &qid, &target) != 3) {
+	return;
+    }
+
+    /* Only answer each query once */
+    if ((origin == getNodeID()) || !message_recordRoute('n', origin, qid, faceNum)) {
+	return;
+    }
+
+    snprintf(str, sizeof(str), "%s|", msg);
+    message_sendToAllBut(faceNum, IRTX_PRIORITY_CONTROL, str);
+    message_requestFastPoll(0, NEIGHBOR_MAP_FAST_POLL_MS);
+
+    if ((target != NEIGHBOR_MAP_TARGET_ALL) && (target != getNodeID())) {
+	return;
+    }
+
+    /* A query that we have not answered yet is superseded by the new one */
+    responsePending = true;
+    responseOrigin = origin;
+    responseQueryID = qid;
+    responseFace = faceNum;
+    responseDue_ms = curr_time_ms() + (rand() % NEIGHBOR_MAP_RESPONSE_WINDOW_MS);
+}
+
+/**@brief Returns our neighbor table towards the origin of the pending map
+ * query.
+ *
+ * A full table does not fit in one control message, so the table is
+ * returned in several frames on the bulk queue, leaving the control queue
+ * free for the time-critical services.
+ */
+void neighbor_sendResponse() {
+    uint8_t tableFace = 1;
+    char table[32];
+    char str[64];
+
+    responsePending = false;
+
+    do {
+	neighbor_formatEntries(table, sizeof(table), &tableFace, NEIGHBOR_MAP_ENTRIES_PER_FRAME);
+	snprintf(str, sizeof(str), "nbrr;%04x;%u;%04x;%s|", responseOrigin, responseQueryID, getNodeID(), table);
+	if (!irtx_queueString(responseFace, IRTX_PRIORITY_BULK, str)) {
+	    mapFramesDropped++;
+	}
+    } while (tableFace <= 6);
+}
+
+void neighbor_processResponse(uint8_t faceNum, const char *msg) {
+    unsigned int origin, qid, id;
+    int tableStart = 0;
+    uint8_t parentFace;
+    char str[96];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "nbrr;%x;%u;%x;%n", &origin, &qid, &id, &tableStart) != 3) {
+	return;
+    }
+
+    if (origin == getNodeID()) {
+	if (qid == queryID) {
+	    message_requestFastPoll(0, NEIGHBOR_MAP_FAST_POLL_MS);
+	    snprintf(str, sizeof(str), "%04x: ", id);
+	    app_uart_put_string(str);
+	    app_uart_put_string(&msg[tableStart]);
+	    app_uart_put_string("\r\n");
+	}
+	return;
+    }
+
+    /* Pass the response one step closer to the module which asked, and keep
+     * polling quickly for as long as responses keep arriving */
+    parentFace = message_getRouteFace('n', origin, qid);
+    if (parentFace != 0) {
+	message_requestFastPoll(0, NEIGHBOR_MAP_FAST_POLL_MS);
+	snprintf(str, sizeof(str), "%s|", msg);
+	if (!irtx_queueString(parentFace, IRTX_PRIORITY_BULK, str)) {
+	    mapFramesDropped++;
+	}
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * neighbor.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef NEIGHBOR_H_
+#define NEIGHBOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    bool present;
+    uint16_t id;
+    /* The neighbor's face (1-6) which is in contact with our face */
+    uint8_t face;
+    /* Percentage of the neighbor's beacons which we have received */
+    uint8_t quality_percent;
+    uint32_t lastSeen_ms;
+    uint8_t lastSeq;
+    /* The neighbor's advertised beacon interval */
+    uint8_t interval_sec;
+    /* The neighbor's gravity vector, in hundredths of g, in its own frame */
+    int8_t gravity[3];
+} neighbor_t;
+
+/* Target of a map query that every module answers */
+#define NEIGHBOR_MAP_TARGET_ALL		0xFFFF
+
+void neighbor_init(void);
+void neighbor_deinit(void);
+void neighbor_tick(void);
+
+bool neighbor_processMessage(uint8_t faceNum, const char *msg);
+
+bool neighbor_get(uint8_t faceNum, neighbor_t *p_neighbor);
+uint8_t neighbor_getCount(void);
+uint8_t neighbor_formatTable(char *str, uint8_t strSize);
+bool neighbor_startMapQuery(uint16_t target);
+uint16_t neighbor_getMapFramesDropped(void);
+
+#endif /* NEIGHBOR_H_ */
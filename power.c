@@ -22,6 +22,7 @@
 #include "pwm.h"
 #include "led.h"
 #include "bleApp.h"
+#include "thermal.h"
 #include "power.h"
 
 #define CELL_CHARGED_THRESHOLD_MV			4200	/* Stop charging as soon as all cells rise to this voltage, really they should never rise over 4.2V and we should halt charging when the current falls sufficiently. */
@@ -53,6 +54,17 @@
 #define LED1_CURRENT_UA						2600
 #define LED2_CURRENT_UA						1200
 
+/* VIN, the charge current, and one step of a battery cell scan are sampled in
+ * the background, from the ADC interrupt, every time the power timer fires.  A
+ * full scan takes 8 steps (two per cell) and, once complete, replaces the
+ * battery snapshot.  Background VIN and charge current readings older than
+ * this are not used; a blocking conversion is made instead. */
+#define BACKGROUND_VIN_MAX_AGE_MS			500
+
+#define BACKGROUND_VIN_SAMPLES				32
+#define BACKGROUND_ICHARGE_SAMPLES			8
+#define BACKGROUND_CELL_SAMPLES				32
+
 static power_chargeState_t chargeState = POWER_CHARGESTATE_STANDBY;
 static power_chargeError_t chargeError = POWER_CHARGEERROR_NOERROR;
 static bool chargeTimerRunning = false;
@@ -68,6 +80,44 @@ static bool initialized = false;
 static app_timer_id_t powerTimerID = TIMER_NULL;
 void power_timerHandler(void *p_context);
 
+static adcSequence_t backgroundSequence;
+static uint16_t backgroundVIn_mV;
+static uint16_t backgroundChargeCurrent_mA;
+static uint32_t backgroundTime_rtcTicks;
+static bool backgroundValid = false;
+
+/* The cell scan step sampled by the sequence in progress: the cell is
+ * (step / 2) + 1 and odd steps measure the offset plus one fifth of the cell
+ * voltage.  */
+static uint8_t backgroundCellStep = 0;
+static uint16_t backgroundCellOffset_mV;
+static uint16_t backgroundCell_mV[4];
+/* Cells measured so far in the present background scan, and when the first
+ * of them was */
+static uint8_t backgroundCellsMeasured = 0x00;
+static uint32_t backgroundScanTime_rtcTicks;
+
+static power_batterySnapshot_t batterySnapshot = {false};
+static uint16_t batterySnapshotMaxAge_ms = POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS;
+
+static uint16_t blockingScans = 0;
+static uint16_t backgroundScans = 0;
+static uint16_t cellReads = 0;
+static uint16_t chargeUpdates = 0;
+static uint8_t lastUpdateScans = 0;
+static uint8_t maxUpdateScans = 0;
+static uint8_t lastUpdateCellReads = 0;
+
+static void power_startBackgroundSampling(void);
+static void power_backgroundHandler(adcSequence_t *p_sequence);
+static bool power_isBackgroundFresh(bool valid, uint32_t time_rtcTicks, uint32_t maxAge_ms);
+static void power_selectCellOutput(uint8_t batNum, bool offsetPlusFifth);
+static void power_releaseCellOutput(void);
+static uint16_t power_measureCell_mV(uint8_t batNum);
+static void power_setBatterySnapshot(const uint16_t *cell_mV, uint32_t time_rtcTicks);
+static void power_refreshBatterySnapshot(uint32_t maxAge_ms);
+static const power_batterySnapshot_t *power_getFreshBatterySnapshot(void);
+
 /* These flags are set when VIN is removed while the charger is still active.
  * When this happens, the 3.3V rail can dip sufficiently to reset the BLDC
  * controller and possibly the IMU.  */
@@ -91,6 +141,21 @@ bool power_init() {
 		APP_ERROR_CHECK(err_code);
 	}
 
+	/* The background sequence converts VIN, the charge current, and the
+	 * output of the Lipo protection IC, in that order.  Each time the timer
+	 * fires, the protection IC's output is switched to the next step of a
+	 * cell scan before the sequence is started, and the first two channels
+	 * take ~2.7ms to convert, so the output has well over the 1ms that it
+	 * needs to settle before it is sampled. */
+	backgroundSequence.channelCount = 3;
+	backgroundSequence.channels[0] = VINSENSE_ADC_CHNL;
+	backgroundSequence.samples[0] = BACKGROUND_VIN_SAMPLES;
+	backgroundSequence.channels[1] = ICHARGE_ADC_CHNL;
+	backgroundSequence.samples[1] = BACKGROUND_ICHARGE_SAMPLES;
+	backgroundSequence.channels[2] = LIPROVBATOUT_ADC_CHNL;
+	backgroundSequence.samples[2] = BACKGROUND_CELL_SAMPLES;
+	backgroundSequence.handler = power_backgroundHandler;
+
 	/* Start timer which manages battery charging.  It will fire every 200 ms. */
 	err_code = app_timer_start(powerTimerID, APP_TIMER_TICKS(200, APP_TIMER_PRESCALER), NULL);
 	APP_ERROR_CHECK(err_code);
@@ -417,109 +482,251 @@ bool power_getDebug() {
 }
 
 uint16_t power_getVIn_mV() {
+	if (power_isBackgroundFresh(backgroundValid, backgroundTime_rtcTicks, BACKGROUND_VIN_MAX_AGE_MS)) {
+		return backgroundVIn_mV;
+	}
+
 	/* VIN is divided by 2 with a resistor divider pair, so we multiply by 2 in
 	 * order to return the correct voltage. */
 	return 2 * adc_avg_mV(VINSENSE_ADC_CHNL, 32);
 }
 
 uint16_t power_getBatteryVoltage_mV(uint8_t batNum) {
-	uint16_t offset_mV;
-	uint16_t offsetPlusFifthActual_mV;
-	uint16_t actual_mV;
-
 	/* Return 0 if the battery number is invalid.  Valid numbers are 1...4. */
 	if ((batNum <= 0) || (batNum >= 5)) {
 		return 0;
 	}
 
-	/* Note: the way that the S-8243B numbers the batteries is exactly opposite
-	 * what the schematic calls them, i.e. battery 1 according to the S-8243B
-	 * is labeled battery 4 on the schematic. */
+	cellReads++;
+
+	return power_getFreshBatterySnapshot()->cell_mV[batNum - 1];
+}
 
-	if (batNum == 1) {
-		/* CTL3 Low, CTL4 High */
-		nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
-		nrf_gpio_pin_clear(LIPROCTL3_PIN_NO);
-		nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
-		nrf_gpio_pin_set(LIPROCTL4_PIN_NO);
-	} else if (batNum == 2) {
-		/* CTL3 floating, CTL4 floating, with input buffers disabled */
-	    NRF_GPIO->PIN_CNF[LIPROCTL3_PIN_NO] =
-	    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
-	    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
-	    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
-	    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-	    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
-	    NRF_GPIO->PIN_CNF[LIPROCTL4_PIN_NO] =
-	    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
-	    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
-	    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
-	    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-	    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
-	} else if (batNum == 3) {
-		/* CTL3 High, CTL4 Low */
-		nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
-		nrf_gpio_pin_set(LIPROCTL3_PIN_NO);
-		nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
-		nrf_gpio_pin_clear(LIPROCTL4_PIN_NO);
-	} else if (batNum == 4) {
-		/* CTL3 High, CTL4 High */
-		nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
-		nrf_gpio_pin_set(LIPROCTL3_PIN_NO);
-		nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
-		nrf_gpio_pin_set(LIPROCTL4_PIN_NO);
+/**@brief Copies the battery snapshot into p_snapshot, first scanning all four
+ * cells if the snapshot is older than maxAge_ms.
+ */
+void power_getBatterySnapshot(power_batterySnapshot_t *p_snapshot, uint32_t maxAge_ms) {
+	power_refreshBatterySnapshot(maxAge_ms);
+	*p_snapshot = batterySnapshot;
+}
+
+/**@brief Sets the maximum age of the battery snapshot.  Ages outside
+ * [POWER_BATTERY_SNAPSHOT_MIN_MAX_AGE_MS, POWER_BATTERY_SNAPSHOT_MAX_MAX_AGE_MS]
+ * are rejected.
+ */
+bool power_setBatterySnapshotMaxAge_ms(uint32_t maxAge_ms) {
+	if ((maxAge_ms < POWER_BATTERY_SNAPSHOT_MIN_MAX_AGE_MS) ||
+		(maxAge_ms > POWER_BATTERY_SNAPSHOT_MAX_MAX_AGE_MS)) {
+		return false;
 	}
 
-	nrf_delay_ms(1);
+	batterySnapshotMaxAge_ms = maxAge_ms;
+	return true;
+}
 
-	offset_mV = adc_avg_mV(LIPROVBATOUT_ADC_CHNL, 32);
+uint16_t power_getBatterySnapshotMaxAge_ms() {
+	return batterySnapshotMaxAge_ms;
+}
+
+void power_getBatteryStats(power_batteryStats_t *p_stats) {
+	p_stats->blockingScans = blockingScans;
+	p_stats->backgroundScans = backgroundScans;
+	p_stats->cellReads = cellReads;
+	p_stats->chargeUpdates = chargeUpdates;
+	p_stats->lastUpdateScans = lastUpdateScans;
+	p_stats->maxUpdateScans = maxUpdateScans;
+	p_stats->lastUpdateCellReads = lastUpdateCellReads;
+	p_stats->maxAge_ms = batterySnapshotMaxAge_ms;
+}
+
+void power_clearBatteryStats() {
+	blockingScans = 0;
+	backgroundScans = 0;
+	cellReads = 0;
+	chargeUpdates = 0;
+	lastUpdateScans = 0;
+	maxUpdateScans = 0;
+	lastUpdateCellReads = 0;
+}
+
+/**@brief Returns the battery snapshot, first scanning all four cells if it is
+ * older than the configured maximum age.
+ */
+const power_batterySnapshot_t *power_getFreshBatterySnapshot() {
+	power_refreshBatterySnapshot(batterySnapshotMaxAge_ms);
+	return &batterySnapshot;
+}
+
+/**@brief Scans all four cells with blocking conversions if the battery
+ * snapshot is older than maxAge_ms.
+ */
+void power_refreshBatterySnapshot(uint32_t maxAge_ms) {
+	uint8_t batNum;
+	uint16_t cell_mV[4];
+	uint32_t rtcTicks;
 
-	if (batNum == 1) {
-		/* CTL3 Low, CTL4 floating (with input buffer disabled) */
-		nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
-		nrf_gpio_pin_clear(LIPROCTL3_PIN_NO);
-	    NRF_GPIO->PIN_CNF[LIPROCTL4_PIN_NO] =
-	    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
-	    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
-	    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
-	    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-	    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
-	} else if (batNum == 2) {
-		/* CTL3 floating (with input buffer disabled), CTL4 Low */
-	    NRF_GPIO->PIN_CNF[LIPROCTL3_PIN_NO] =
-	    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
-	    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
-	    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
-	    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-	    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
-		nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
-		nrf_gpio_pin_clear(LIPROCTL4_PIN_NO);
-	} else if (batNum == 3) {
-		/* CTL3 floating (with input buffer disabled), CTL4 High */
-	    NRF_GPIO->PIN_CNF[LIPROCTL3_PIN_NO] =
-	    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
-	    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
-	    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
-	    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-	    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
-		nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
-		nrf_gpio_pin_set(LIPROCTL4_PIN_NO);
-	} else if (batNum == 4) {
-		/* CTL3 High, CTL4 floating (with input buffer disabled) */
-		nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
-		nrf_gpio_pin_set(LIPROCTL3_PIN_NO);
-	    NRF_GPIO->PIN_CNF[LIPROCTL4_PIN_NO] =
-	    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
-	    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
-	    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
-	    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-	    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
+	if (power_isBackgroundFresh(batterySnapshot.valid, batterySnapshot.time_rtcTicks, maxAge_ms)) {
+		return;
+	}
+
+	app_timer_cnt_get(&rtcTicks);
+
+	for (batNum = 1; batNum <= 4; batNum++) {
+		cell_mV[batNum - 1] = power_measureCell_mV(batNum);
 	}
 
+	power_setBatterySnapshot(cell_mV, rtcTicks);
+	blockingScans++;
+}
+
+/**@brief Replaces the battery snapshot with the given cell voltages, unless the
+ * snapshot is already more recent (a blocking scan may have been made while
+ * a background scan was under way).
+ */
+void power_setBatterySnapshot(const uint16_t *cell_mV, uint32_t time_rtcTicks) {
+	uint8_t i;
+
+	if (batterySnapshot.valid &&
+			((0x00FFFFFF & (time_rtcTicks - batterySnapshot.time_rtcTicks)) >= 0x00800000)) {
+		return;
+	}
+
+	batterySnapshot.min_mV = UINT16_MAX;
+	batterySnapshot.max_mV = 0;
+	batterySnapshot.pack_mV = 0;
+
+	for (i = 0; i < 4; i++) {
+		batterySnapshot.cell_mV[i] = cell_mV[i];
+		if (cell_mV[i] < batterySnapshot.min_mV) {
+			batterySnapshot.min_mV = cell_mV[i];
+		}
+		if (cell_mV[i] > batterySnapshot.max_mV) {
+			batterySnapshot.max_mV = cell_mV[i];
+		}
+		batterySnapshot.pack_mV += cell_mV[i];
+	}
+
+	batterySnapshot.time_rtcTicks = time_rtcTicks;
+	batterySnapshot.valid = true;
+}
+
+/**@brief Measures one cell with blocking conversions, which takes ~5ms.
+ */
+uint16_t power_measureCell_mV(uint8_t batNum) {
+	uint16_t offset_mV;
+	uint16_t offsetPlusFifthActual_mV;
+	uint16_t actual_mV;
+
+	/* The background sequence may be sampling the protection IC's output, so
+	 * we must not switch it until the ADC is idle. */
+	adc_waitIdle();
+
+	power_selectCellOutput(batNum, false);
 	nrf_delay_ms(1);
+	offset_mV = adc_avg_mV(LIPROVBATOUT_ADC_CHNL, 32);
 
+	power_selectCellOutput(batNum, true);
+	nrf_delay_ms(1);
 	offsetPlusFifthActual_mV = adc_avg_mV(LIPROVBATOUT_ADC_CHNL, 32);
 
+	power_releaseCellOutput();
+
+	/* Subtract the offset voltage and multiply by five to arrive at the actual
+	 * battery voltage. This comes from the Seiko datasheet. */
+	actual_mV = (offsetPlusFifthActual_mV - offset_mV) * 5;
+
+	return actual_mV;
+}
+
+/**@brief Configures the Lipo protection IC's CTL3 and CTL4 inputs so that its
+ * VBATOUT output is either the offset voltage for the given cell or the offset
+ * plus one fifth of the cell's voltage.  The output needs 1ms to settle.
+ */
+void power_selectCellOutput(uint8_t batNum, bool offsetPlusFifth) {
+	/* Note: the way that the S-8243B numbers the batteries is exactly opposite
+	 * what the schematic calls them, i.e. battery 1 according to the S-8243B
+	 * is labeled battery 4 on the schematic. */
+
+	if (!offsetPlusFifth) {
+		if (batNum == 1) {
+			/* CTL3 Low, CTL4 High */
+			nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
+			nrf_gpio_pin_clear(LIPROCTL3_PIN_NO);
+			nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
+			nrf_gpio_pin_set(LIPROCTL4_PIN_NO);
+		} else if (batNum == 2) {
+			/* CTL3 floating, CTL4 floating, with input buffers disabled */
+		    NRF_GPIO->PIN_CNF[LIPROCTL3_PIN_NO] =
+		    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
+		    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
+		    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
+		    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+		    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
+		    NRF_GPIO->PIN_CNF[LIPROCTL4_PIN_NO] =
+		    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
+		    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
+		    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
+		    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+		    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
+		} else if (batNum == 3) {
+			/* CTL3 High, CTL4 Low */
+			nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
+			nrf_gpio_pin_set(LIPROCTL3_PIN_NO);
+			nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
+			nrf_gpio_pin_clear(LIPROCTL4_PIN_NO);
+		} else if (batNum == 4) {
+			/* CTL3 High, CTL4 High */
+			nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
+			nrf_gpio_pin_set(LIPROCTL3_PIN_NO);
+			nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
+			nrf_gpio_pin_set(LIPROCTL4_PIN_NO);
+		}
+	} else {
+		if (batNum == 1) {
+			/* CTL3 Low, CTL4 floating (with input buffer disabled) */
+			nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
+			nrf_gpio_pin_clear(LIPROCTL3_PIN_NO);
+		    NRF_GPIO->PIN_CNF[LIPROCTL4_PIN_NO] =
+		    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
+		    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
+		    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
+		    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+		    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
+		} else if (batNum == 2) {
+			/* CTL3 floating (with input buffer disabled), CTL4 Low */
+		    NRF_GPIO->PIN_CNF[LIPROCTL3_PIN_NO] =
+		    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
+		    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
+		    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
+		    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+		    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
+			nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
+			nrf_gpio_pin_clear(LIPROCTL4_PIN_NO);
+		} else if (batNum == 3) {
+			/* CTL3 floating (with input buffer disabled), CTL4 High */
+		    NRF_GPIO->PIN_CNF[LIPROCTL3_PIN_NO] =
+		    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
+		    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
+		    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
+		    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+		    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
+			nrf_gpio_cfg_output(LIPROCTL4_PIN_NO);
+			nrf_gpio_pin_set(LIPROCTL4_PIN_NO);
+		} else if (batNum == 4) {
+			/* CTL3 High, CTL4 floating (with input buffer disabled) */
+			nrf_gpio_cfg_output(LIPROCTL3_PIN_NO);
+			nrf_gpio_pin_set(LIPROCTL3_PIN_NO);
+		    NRF_GPIO->PIN_CNF[LIPROCTL4_PIN_NO] =
+		    		(GPIO_PIN_CNF_SENSE_Disabled << GPIO_PIN_CNF_SENSE_Pos) |
+		    		(GPIO_PIN_CNF_DRIVE_S0S1 << GPIO_PIN_CNF_DRIVE_Pos) |
+		    		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
+		    		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+		    		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
+		}
+	}
+}
+
+void power_releaseCellOutput() {
 	/* Return both control lines to their high impedance states with the nRF's
 	 * input buffers disabled to reduce current consumption. */
     NRF_GPIO->PIN_CNF[LIPROCTL3_PIN_NO] =
@@ -534,58 +741,30 @@ uint16_t power_getBatteryVoltage_mV(uint8_t batNum) {
     		(GPIO_PIN_CNF_PULL_Disabled << GPIO_PIN_CNF_PULL_Pos) |
     		(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
     		(GPIO_PIN_CNF_DIR_Input << GPIO_PIN_CNF_DIR_Pos);
-
-	/* Subtract the offset voltage and multiply by five to arrive at the actual
-	 * battery voltage. This comes from the Seiko datasheet. */
-	actual_mV = (offsetPlusFifthActual_mV - offset_mV) * 5;
-
-	return actual_mV;
 }
 
 uint16_t power_getBatteryVoltageMin_mV() {
-	uint8_t batNum;
-	uint16_t mV;
-	uint16_t minVoltage_mV = UINT16_MAX;
-
-	for (batNum = 1; batNum <= 4; batNum++) {
-		mV = power_getBatteryVoltage_mV(batNum);
-		if (mV < minVoltage_mV) {
-			minVoltage_mV = mV;
-		}
-	}
-
-	return minVoltage_mV;
+	cellReads += 4;
+	return power_getFreshBatterySnapshot()->min_mV;
 }
 
 uint16_t power_getBatteryVoltageMax_mV() {
-	uint8_t batNum;
-	uint16_t mV;
-	uint16_t maxVoltage_mV = 0;
-
-	for (batNum = 1; batNum <= 4; batNum++) {
-		mV = power_getBatteryVoltage_mV(batNum);
-		if (mV > maxVoltage_mV) {
-			maxVoltage_mV = mV;
-		}
-	}
-
-	return maxVoltage_mV;
+	cellReads += 4;
+	return power_getFreshBatterySnapshot()->max_mV;
 }
 
 uint16_t power_getBatteryPackVoltage_mV() {
-	int i;
-	uint16_t accumVoltage = 0;
-
-	for (i=1; i<=4; i++) {
-		accumVoltage += power_getBatteryVoltage_mV(i);
-	}
-
-	return accumVoltage;
+	cellReads += 4;
+	return power_getFreshBatterySnapshot()->pack_mV;
 }
 
 uint16_t power_getChargeCurrent_mA() {
 	uint16_t rawVoltage_mV;
 
+	if (power_isBackgroundFresh(backgroundValid, backgroundTime_rtcTicks, BACKGROUND_VIN_MAX_AGE_MS)) {
+		return backgroundChargeCurrent_mA;
+	}
+
 	rawVoltage_mV = adc_avg_mV(ICHARGE_ADC_CHNL, 8);
 
 	/* The charge current is sensed by measuring the voltage across a 0.33 Ohm
@@ -609,7 +788,7 @@ uint16_t power_getEstimatedCurrentConsumption_mA() {
 	}
 
 	for (led = 0; led < 3; led++) {
-		uA += (led_getDutyCycle_percent(led) * ledCurrent_uA[led]) / 100;
+		uA += (led_getDutyCycle_permille(led) * ledCurrent_uA[led]) / 1000;
 	}
 
 	return uA / 1000;
@@ -640,15 +819,92 @@ bool power_isCellOvervoltage() {
 }
 
 bool power_isUndertemp() {
-	return false;
+	return thermal_isUndertemp();
 }
 
 bool power_isOvertemp() {
-	return false;
+	return thermal_isOvertemp();
 }
 
 void power_timerHandler(void *p_contex) {
+		thermal_update();
 		power_updateChargeState(false);
+		power_startBackgroundSampling();
+}
+
+/**@brief Starts the background ADC sequence unless the previous one is still
+ * waiting to be handled.
+ */
+void power_startBackgroundSampling() {
+	if (backgroundSequence.busy) {
+		return;
+	}
+
+	power_selectCellOutput((backgroundCellStep / 2) + 1, (backgroundCellStep % 2) == 1);
+
+	if (!adc_startSequence(&backgroundSequence)) {
+		power_releaseCellOutput();
+	}
+}
+
+/**@brief Called through the scheduler once the background sequence has been
+ * converted.
+ */
+void power_backgroundHandler(adcSequence_t *p_sequence) {
+	uint8_t batNum;
+	uint32_t rtcTicks;
+
+	app_timer_cnt_get(&rtcTicks);
+
+	/* VIN is divided by 2 with a resistor divider pair.  See
+	 * power_getChargeCurrent_mA() for the conversion of the charge current. */
+	backgroundVIn_mV = 2 * p_sequence->results_mV[0];
+	backgroundChargeCurrent_mA = (3 * p_sequence->results_mV[1]) / 50;
+	backgroundTime_rtcTicks = rtcTicks;
+	backgroundValid = true;
+
+	/* The protection IC's output was sampled by the time the sequence
+	 * finished (blocking cell measurements wait for the ADC to be idle before
+	 * switching it), so the output can be released now. */
+	power_releaseCellOutput();
+
+	batNum = (backgroundCellStep / 2) + 1;
+
+	if ((backgroundCellStep % 2) == 0) {
+		backgroundCellOffset_mV = p_sequence->results_mV[2];
+	} else {
+		backgroundCell_mV[batNum - 1] = (p_sequence->results_mV[2] - backgroundCellOffset_mV) * 5;
+
+		if (batNum == 1) {
+			backgroundCellsMeasured = 0x01;
+			backgroundScanTime_rtcTicks = rtcTicks;
+		} else {
+			backgroundCellsMeasured |= (0x01 << (batNum - 1));
+		}
+
+		/* Once all four cells have been measured in this scan, they replace
+		 * the battery snapshot. */
+		if ((batNum == 4) && (backgroundCellsMeasured == 0x0F)) {
+			power_setBatterySnapshot(backgroundCell_mV, backgroundScanTime_rtcTicks);
+			backgroundScans++;
+		}
+	}
+
+	backgroundCellStep = (backgroundCellStep + 1) % 8;
+}
+
+bool power_isBackgroundFresh(bool valid, uint32_t time_rtcTicks, uint32_t maxAge_ms) {
+	uint32_t rtcTicks;
+	uint32_t age_ms;
+
+	if (!valid) {
+		return false;
+	}
+
+	app_timer_cnt_get(&rtcTicks);
+	age_ms = ((0x00FFFFFF & (rtcTicks - time_rtcTicks)) * (uint64_t)USEC_PER_APP_TIMER_TICK) / 1000;
+
+	return (age_ms <= maxAge_ms);
 }
 
 void power_updateChargeState(bool forceUpdate) {
@@ -657,6 +913,8 @@ void power_updateChargeState(bool forceUpdate) {
 	uint8_t shorts = 0x00;
 	uint8_t batNum;
 	uint16_t minVoltage_mV, maxVoltage_mV;
+	power_batterySnapshot_t snapshot;
+	uint16_t scansBefore, cellReadsBefore;
 	bool updateAgain = false;
 	uint32_t currentTime_rtcTicks, elapsedTime_rtcTicks;
 
@@ -712,6 +970,9 @@ void power_updateChargeState(bool forceUpdate) {
 		return;
 	}
 
+	scansBefore = blockingScans;
+	cellReadsBefore = cellReads;
+
 	/* Unless the updateAgain flag is set, we only execute this do loop once.
 	 * We typically set the updateAgain flag when switching states so that the
 	 * actions of the new state are carried about before returning to the
@@ -727,9 +988,13 @@ void power_updateChargeState(bool forceUpdate) {
 		 * state is changed, we will re-set this flag. */
 		updateAgain = false;
 
-		/* Find the lowest and highest voltages among all four cells. */
-		minVoltage_mV = power_getBatteryVoltageMin_mV();
-		maxVoltage_mV = power_getBatteryVoltageMax_mV();
+		/* Find the lowest and highest voltages among all four cells.  The
+		 * cell voltages are scanned at most once here; everything below
+		 * (including the over- and under-voltage checks) reads the same
+		 * snapshot. */
+		power_getBatterySnapshot(&snapshot, batterySnapshotMaxAge_ms);
+		minVoltage_mV = snapshot.min_mV;
+		maxVoltage_mV = snapshot.max_mV;
 
 		/* Check for errors and jump to the ERROR state if any are found. */
 		if (power_isCellOvervoltage() &&
@@ -853,13 +1118,14 @@ void power_updateChargeState(bool forceUpdate) {
 				/* Set the charger's output current limit to 0.1*C plus
 				 * whatever we estimate the processor and other circuitry to be
 				 * consuming.*/
-				power_setChargerCurrentLimit_mA(PRECHARGE_CURRENT_MA +
+				power_setChargerCurrentLimit_mA(thermal_derate(PRECHARGE_CURRENT_MA) +
 						power_getEstimatedCurrentConsumption_mA());
 			} else {
 				/* If we are not precharging, we set the current to the maximum
 				 * value which does not harm the charger.  This limit is lower
-				 * than the approved charge rate for the batteries. */
-				power_setChargerCurrentLimit_mA(CHARGE_CURRENT_MAX_MA);
+				 * than the approved charge rate for the batteries.  As the
+				 * module warms, the current is reduced. */
+				power_setChargerCurrentLimit_mA(thermal_derate(CHARGE_CURRENT_MAX_MA));
 			}
 
 			/* Turning on the charger IC starts the flow of current. */
@@ -890,14 +1156,13 @@ void power_updateChargeState(bool forceUpdate) {
 			 * imbalance threshold. If one is, we will short a resistor across its
 			 * terminals to reduce its charge rate. */
 			for (batNum = 1; batNum <= 4; batNum++) {
-				if (power_getBatteryVoltage_mV(batNum) > minVoltage_mV + MAXIMUM_IMBALANCE_MV) {
+				if (snapshot.cell_mV[batNum - 1] > minVoltage_mV + MAXIMUM_IMBALANCE_MV) {
 					shorts |= (0x01 << (batNum-1));
 				}
 			}
 
-			/* If the fact that we resampled all battery voltages resulted in
-			 * enough variation to short all discharge switches, keep them all
-			 * open. */
+			/* If the cell voltages varied enough to short all discharge
+			 * switches, keep them all open. */
 			if (shorts == 0x0F) {
 				shorts = 0x00;
 			}
@@ -960,7 +1225,7 @@ void power_updateChargeState(bool forceUpdate) {
 			 * imbalance threshold. If one is, we will short a resistor across its
 			 * terminals to speed it discharge. */
 			for (batNum = 1; batNum <= 4; batNum++) {
-				if (power_getBatteryVoltage_mV(batNum) > minVoltage_mV + MAXIMUM_IMBALANCE_MV) {
+				if (snapshot.cell_mV[batNum - 1] > minVoltage_mV + MAXIMUM_IMBALANCE_MV) {
 					shorts |= (0x01 << (batNum-1));
 				}
 			}
@@ -987,6 +1252,16 @@ void power_updateChargeState(bool forceUpdate) {
 			/* Fast-flash the LED to indicate a problem */
 			led_setState(LED_GREEN, LED_STATE_FAST_FLASH);
 
+			/* A temperature error clears itself once the temperature has
+			 * returned far enough into the safe range. */
+			if (((chargeError == POWER_CHARGEERROR_OVERTEMP) && !power_isOvertemp()) ||
+					((chargeError == POWER_CHARGEERROR_UNDERTEMP) && !power_isUndertemp())) {
+				chargeState = POWER_CHARGESTATE_STANDBY;
+				chargeError = POWER_CHARGEERROR_NOERROR;
+				updateAgain = true;
+				break;
+			}
+
 			/* In the error state, we wait for the supply voltage to the
 			 * charger IC to be removed.  Once it has been, we set the
 			 * chargingVoltageRemoved flag.  We use this way as a way to
@@ -1015,6 +1290,13 @@ void power_updateChargeState(bool forceUpdate) {
 		}
 	} while (updateAgain);
 
+	chargeUpdates++;
+	lastUpdateScans = blockingScans - scansBefore;
+	lastUpdateCellReads = cellReads - cellReadsBefore;
+	if (lastUpdateScans > maxUpdateScans) {
+		maxUpdateScans = lastUpdateScans;
+	}
+
 	if (debug) {
 		power_printDebugInfo();
 	}
@@ -1030,6 +1312,7 @@ void power_printDebugInfo() {
 	unsigned int chargerCurrent_mA, estShuntCurrent_mA, batteryCurrent_mA;
 
 	unsigned int cell1_mV, cell2_mV, cell3_mV, cell4_mV, pack_mV, input_mV;
+	power_batterySnapshot_t snapshot;
 	char cell1ShortedStr[4], cell2ShortedStr[4], cell3ShortedStr[4], cell4ShortedStr[4];
 
 	char line[100];
@@ -1084,11 +1367,12 @@ void power_printDebugInfo() {
 		batteryCurrent_mA = 0;
 	}
 
-	cell1_mV = power_getBatteryVoltage_mV(1);
-	cell2_mV = power_getBatteryVoltage_mV(2);
-	cell3_mV = power_getBatteryVoltage_mV(3);
-	cell4_mV = power_getBatteryVoltage_mV(4);
-	pack_mV = power_getBatteryPackVoltage_mV();
+	power_getBatterySnapshot(&snapshot, batterySnapshotMaxAge_ms);
+	cell1_mV = snapshot.cell_mV[0];
+	cell2_mV = snapshot.cell_mV[1];
+	cell3_mV = snapshot.cell_mV[2];
+	cell4_mV = snapshot.cell_mV[3];
+	pack_mV = snapshot.pack_mV;
 	input_mV = power_getVIn_mV();
 
 	if (power_getDischargeSwitches() & 0x01) {
@@ -1157,14 +1441,24 @@ void power_printVIn() {
 
 void power_printBatteryVoltages() {
 	int i;
-	uint16_t mV;
-	char str[30];
+	power_batterySnapshot_t snapshot;
+	uint32_t rtcTicks;
+	uint32_t age_ms;
+	char str[60];
+
+	power_getBatterySnapshot(&snapshot, batterySnapshotMaxAge_ms);
 
 	for (i=1; i<=4; i++) {
-		mV = power_getBatteryVoltage_mV(i);
-		snprintf(str, sizeof(str), "Battery %u: %dmV\r\n", i, mV);
+		snprintf(str, sizeof(str), "Battery %u: %dmV\r\n", i, snapshot.cell_mV[i - 1]);
 		app_uart_put_string(str);
 	}
+
+	app_timer_cnt_get(&rtcTicks);
+	age_ms = ((0x00FFFFFF & (rtcTicks - snapshot.time_rtcTicks)) * (uint64_t)USEC_PER_APP_TIMER_TICK) / 1000;
+
+	snprintf(str, sizeof(str), "Pack: %umV (min %umV, max %umV), age %lums\r\n",
+			snapshot.pack_mV, snapshot.min_mV, snapshot.max_mV, (unsigned long)age_ms);
+	app_uart_put_string(str);
 }
 
 void power_printChargeCurrent() {
@@ -30,6 +30,41 @@ typedef enum {
 	POWER_CHARGEERROR_TIMEOUT
 } power_chargeError_t;
 
+/* The cell voltages from a single scan of all four cells, which the battery
+ * voltage accessors share until it is older than the configured maximum
+ * age.  Cells are not worth rescanning more often than every 100 ms, and a
+ * snapshot much older than the 1.6 s background refresh would hide a sagging
+ * battery from the charger and the SMA. */
+#define POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS	3000
+#define POWER_BATTERY_SNAPSHOT_MIN_MAX_AGE_MS		100
+#define POWER_BATTERY_SNAPSHOT_MAX_MAX_AGE_MS		5000
+
+typedef struct {
+	bool valid;
+	uint16_t cell_mV[4];
+	uint16_t min_mV;
+	uint16_t max_mV;
+	uint16_t pack_mV;
+	/* RTC time at which the first cell of the scan was measured */
+	uint32_t time_rtcTicks;
+} power_batterySnapshot_t;
+
+typedef struct {
+	/* Blocking scans, and scans completed by the background sampling */
+	uint16_t blockingScans;
+	uint16_t backgroundScans;
+	/* Cell voltages read from the snapshot (a pack, minimum or maximum voltage
+	 * counts as four), each of which used to be a separate measurement */
+	uint16_t cellReads;
+	/* Full updates of the charge state machine, and the blocking scans and
+	 * cell reads made by the last one and the most made by any one */
+	uint16_t chargeUpdates;
+	uint8_t lastUpdateScans;
+	uint8_t maxUpdateScans;
+	uint8_t lastUpdateCellReads;
+	uint16_t maxAge_ms;
+} power_batteryStats_t;
+
 typedef enum {
 	VBATSW_SUPERUSER = 0,
 	VBATSW_USER_SMA,
@@ -69,6 +104,11 @@ uint16_t power_getBatteryVoltage_mV(uint8_t batNum);
 uint16_t power_getBatteryVoltageMin_mV(void);
 uint16_t power_getBatteryVoltageMax_mV(void);
 uint16_t power_getBatteryPackVoltage_mV(void);
+void power_getBatterySnapshot(power_batterySnapshot_t *p_snapshot, uint32_t maxAge_ms);
+bool power_setBatterySnapshotMaxAge_ms(uint32_t maxAge_ms);
+uint16_t power_getBatterySnapshotMaxAge_ms(void);
+void power_getBatteryStats(power_batteryStats_t *p_stats);
+void power_clearBatteryStats(void);
 
 uint16_t power_getChargeCurrent_mA(void);
 uint16_t power_getEstimatedCurrentConsumption_mA(void);
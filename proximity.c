@@ -0,0 +1,381 @@
+/*
+ * proximity.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_scheduler.h"
+
+#include "global.h"
+#include "fb.h"
+#include "irtx.h"
+#include "proximity.h"
+
+/* The faces are scanned in pairs of opposite faces, whose LEDs point away
+ * from each other's sensors. */
+#define PROXIMITY_GROUP_COUNT		3
+
+/* The proximity tracks new readings with a gain of 1/PROXIMITY_FILTER_GAIN
+ * and is kept with 4 fractional bits. */
+#define PROXIMITY_FILTER_GAIN		2
+
+#define PROXIMITY_HYSTERESIS		8
+
+typedef struct {
+    bool valid;
+    bool pulsed;
+    uint16_t off;
+    uint16_t on;
+    int16_t reflected;
+    int32_t proximity16;
+    bool blocked;
+    uint16_t scans;
+    uint16_t skipped;
+    uint16_t twiErrorCount;
+} proximityFace_t;
+
+static const uint8_t groupFaces[PROXIMITY_GROUP_COUNT][2] = {{1, 6}, {2, 4}, {3, 5}};
+
+static bool initialized = false;
+
+static app_timer_id_t proximity_timerID = TIMER_NULL;
+
+static bool running = false;
+static uint16_t interval_ms = PROXIMITY_DEFAULT_INTERVAL_MS;
+static uint16_t threshold = PROXIMITY_DEFAULT_THRESHOLD;
+
+/* Scanning alternates between reading a group's faces with their LEDs off
+ * and turning them on, and reading them again with their LEDs on and turning
+ * them off. */
+static uint8_t group = 0;
+static bool pulsing = false;
+
+static proximityFace_t faces[6];
+static app_sched_event_handler_t eventHandler = NULL;
+
+static void proximity_timerHandler(void *p_context);
+static void proximity_startTimer(uint16_t delay_ms);
+static void proximity_pulseGroup(void);
+static void proximity_readGroup(void);
+static void proximity_ledsOff(void);
+static void proximity_addReading(uint8_t faceNum, uint16_t on);
+
+void proximity_init() {
+    uint32_t err_code;
+
+    if (proximity_timerID == TIMER_NULL) {
+	err_code = app_timer_create(&proximity_timerID, APP_TIMER_MODE_SINGLE_SHOT, proximity_timerHandler);
+	APP_ERROR_CHECK(err_code);
+    }
+
+    initialized = true;
+
+    if (running) {
+	running = false;
+	proximity_start(interval_ms);
+    }
+}
+
+void proximity_deinit() {
+    uint32_t err_code;
+    uint8_t faceNum;
+
+    if (!initialized) {
+	return;
+    }
+
+    err_code = app_timer_stop(proximity_timerID);
+    APP_ERROR_CHECK(err_code);
+
+    proximity_ledsOff();
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	faces[faceNum-1].valid = false;
+	faces[faceNum-1].blocked = false;
+    }
+
+    initialized = false;
+}
+
+/**@brief Starts scanning all six faces for nearby objects.
+ *
+ * Each face's IR LEDs are pulsed in turn, and the light reflected back into
+ * its ambient light sensor measured.  Like the light sampling service, this
+ * needs the faceboards' receivers to be enabled.
+ *
+ * @param[in] newInterval_ms   Time between scans of each face.
+ */
+bool proximity_start(uint16_t newInterval_ms) {
+    uint32_t err_code;
+
+    if (!initialized || (newInterval_ms < PROXIMITY_MIN_INTERVAL_MS)) {
+	return false;
+    }
+
+    if (running) {
+	err_code = app_timer_stop(proximity_timerID);
+	APP_ERROR_CHECK(err_code);
+	proximity_ledsOff();
+    }
+
+    interval_ms = newInterval_ms;
+    group = 0;
+    running = true;
+
+    proximity_startTimer(interval_ms / PROXIMITY_GROUP_COUNT);
+
+    return true;
+}
+
+void proximity_stop() {
+    uint32_t err_code;
+
+    if (initialized && running) {
+	err_code = app_timer_stop(proximity_timerID);
+	APP_ERROR_CHECK(err_code);
+	proximity_ledsOff();
+    }
+
+    running = false;
+}
+
+bool proximity_isRunning() {
+    return running;
+}
+
+uint16_t proximity_getInterval() {
+    return interval_ms;
+}
+
+/**@brief Returns the filtered amount of IR light reflected back into the
+ * given face (0-1023), or -1 if it has not been scanned.
+ */
+int16_t proximity_get(uint8_t faceNum) {
+    if ((faceNum < 1) || (faceNum > 6) || !faces[faceNum-1].valid) {
+	return -1;
+    }
+
+    return (faces[faceNum-1].proximity16 + 8) / 16;
+}
+
+/**@brief Checks whether something is close in front of the given face.  Faces
+ * are never blocked while scanning is stopped.
+ */
+bool proximity_isBlocked(uint8_t faceNum) {
+    if ((faceNum < 1) || (faceNum > 6) || !running) {
+	return false;
+    }
+
+    return faces[faceNum-1].blocked;
+}
+
+/**@brief Sets the level of reflected light above which a face is blocked.
+ *
+ * @param[in] level            Threshold (1-1023).
+ * @param[in] newEventHandler  Handler to which a proximityEvent_t is passed
+ *                             through the scheduler whenever a face becomes
+ *                             blocked or clear, or NULL.
+ */
+void proximity_setThreshold(uint16_t level, app_sched_event_handler_t newEventHandler) {
+    threshold = level;
+    eventHandler = newEventHandler;
+}
+
+uint16_t proximity_getThreshold() {
+    return threshold;
+}
+
+bool proximity_getStatus(uint8_t faceNum, proximityStatus_t *p_status) {
+    proximityFace_t *p_face;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    p_face = &faces[faceNum-1];
+
+    p_status->valid = p_face->valid;
+    p_status->off = p_face->off;
+    p_status->on = p_face->on;
+    p_status->reflected = p_face->reflected;
+    p_status->proximity = p_face->valid ? proximity_get(faceNum) : 0;
+    p_status->blocked = p_face->blocked;
+    p_status->scans = p_face->scans;
+    p_status->skipped = p_face->skipped;
+    p_status->twiErrorCount = p_face->twiErrorCount;
+
+    return true;
+}
+
+void proximity_clearStats() {
+    uint8_t faceNum;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	faces[faceNum-1].scans = 0;
+	faces[faceNum-1].skipped = 0;
+	faces[faceNum-1].twiErrorCount = 0;
+    }
+}
+
+void proximity_timerHandler(void *p_context) {
+    /* Timer handlers are executed from the scheduler, so the faceboards are
+     * never accessed while another module is in the middle of a TWI
+     * transfer. */
+    if (!initialized || !running) {
+	return;
+    }
+
+    if (!pulsing) {
+	proximity_pulseGroup();
+    } else {
+	proximity_readGroup();
+    }
+}
+
+void proximity_startTimer(uint16_t delay_ms) {
+    uint32_t err_code;
+    uint32_t ticks = APP_TIMER_TICKS(delay_ms, APP_TIMER_PRESCALER);
+
+    if (ticks < APP_TIMER_MIN_TIMEOUT_TICKS) {
+	ticks = APP_TIMER_MIN_TIMEOUT_TICKS;
+    }
+
+    err_code = app_timer_start(proximity_timerID, ticks, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Takes the LED-off readings of the current group's faces, and turns
+ * their LEDs on.
+ *
+ * A face with a message queued for transmission is skipped, as the pulse
+ * would corrupt the message.
+ */
+void proximity_pulseGroup() {
+    uint8_t i, faceNum;
+    int16_t ambient;
+
+    for (i = 0; i < 2; i++) {
+	faceNum = groupFaces[group][i];
+	faces[faceNum-1].pulsed = false;
+
+	if (!irtx_isIdle(faceNum)) {
+	    faces[faceNum-1].skipped++;
+	    continue;
+	}
+
+	ambient = fb_getAmbientLight(faceNum);
+	if ((ambient < 0) || !fb_setIRManualLEDs(faceNum, true, true, true, true)) {
+	    faces[faceNum-1].twiErrorCount++;
+	    continue;
+	}
+
+	faces[faceNum-1].off = ambient;
+	faces[faceNum-1].pulsed = true;
+	pulsing = true;
+    }
+
+    if (pulsing) {
+	proximity_startTimer(PROXIMITY_SETTLE_MS);
+    } else {
+	group = (group + 1) % PROXIMITY_GROUP_COUNT;
+	proximity_startTimer(interval_ms / PROXIMITY_GROUP_COUNT);
+    }
+}
+
+/**@brief Takes the LED-on readings of the current group's faces, turns their
+ * LEDs off, and moves on to the next group.
+ */
+void proximity_readGroup() {
+    uint8_t i, faceNum;
+    int16_t ambient;
+
+    for (i = 0; i < 2; i++) {
+	faceNum = groupFaces[group][i];
+	if (!faces[faceNum-1].pulsed) {
+	    continue;
+	}
+
+	ambient = fb_getAmbientLight(faceNum);
+	if (!fb_setIRManualLEDs(faceNum, false, false, false, false) || (ambient < 0)) {
+	    faces[faceNum-1].twiErrorCount++;
+	}
+	faces[faceNum-1].pulsed = false;
+
+	if (ambient >= 0) {
+	    proximity_addReading(faceNum, ambient);
+	}
+    }
+
+    pulsing = false;
+    group = (group + 1) % PROXIMITY_GROUP_COUNT;
+
+    proximity_startTimer(interval_ms / PROXIMITY_GROUP_COUNT - PROXIMITY_SETTLE_MS);
+}
+
+void proximity_ledsOff() {
+    uint8_t faceNum;
+
+    if (!pulsing) {
+	return;
+    }
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if (faces[faceNum-1].pulsed) {
+	    fb_setIRManualLEDs(faceNum, false, false, false, false);
+	    faces[faceNum-1].pulsed = false;
+	}
+    }
+
+    pulsing = false;
+}
+
+void proximity_addReading(uint8_t faceNum, uint16_t on) {
+    uint32_t err_code;
+    proximityFace_t *p_face = &faces[faceNum-1];
+    proximityEvent_t event;
+    int16_t reflected, level;
+
+    /* A change in the ambient light between the two readings can make the
+     * difference negative. */
+    reflected = (int16_t)on - p_face->off;
+    if (reflected < 0) {
+	reflected = 0;
+    }
+
+    p_face->on = on;
+    p_face->reflected = reflected;
+    p_face->scans++;
+
+    if (!p_face->valid) {
+	p_face->proximity16 = 16 * (int32_t)reflected;
+	p_face->valid = true;
+    } else {
+	p_face->proximity16 += (16 * (int32_t)reflected - p_face->proximity16) / PROXIMITY_FILTER_GAIN;
+    }
+
+    level = proximity_get(faceNum);
+
+    if (!p_face->blocked && (level > threshold + PROXIMITY_HYSTERESIS)) {
+	p_face->blocked = true;
+    } else if (p_face->blocked && (level + PROXIMITY_HYSTERESIS < threshold)) {
+	p_face->blocked = false;
+    } else {
+	return;
+    }
+
+    if (eventHandler == NULL) {
+	return;
+    }
+
+    event.faceNum = faceNum;
+    event.blocked = p_face->blocked;
+    event.level = level;
+
+    err_code = app_sched_event_put(&event, sizeof(event), eventHandler);
+    APP_ERROR_CHECK(err_code);
+}
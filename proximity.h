@@ -0,0 +1,63 @@
+/*
+ * proximity.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef PROXIMITY_H_
+#define PROXIMITY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_scheduler.h"
+
+/* Time for a full scan of all six faces */
+#define PROXIMITY_DEFAULT_INTERVAL_MS	300
+#define PROXIMITY_MIN_INTERVAL_MS	60
+
+/* Time the IR LEDs are left on before the ambient light sensor is read */
+#define PROXIMITY_SETTLE_MS		4
+
+/* Reflected light (0-1023) above which a face is considered blocked */
+#define PROXIMITY_DEFAULT_THRESHOLD	40
+
+/* Changes in whether a face is blocked are reported to the handler given to
+ * proximity_setThreshold() through the scheduler. */
+typedef struct {
+    uint8_t faceNum;
+    bool blocked;
+    uint16_t level;
+} proximityEvent_t;
+
+typedef struct {
+    bool valid;
+    /* Ambient light readings with the IR LEDs off and on, their difference,
+     * and the filtered difference */
+    uint16_t off;
+    uint16_t on;
+    int16_t reflected;
+    uint16_t proximity;
+    bool blocked;
+    uint16_t scans;
+    uint16_t skipped;
+    uint16_t twiErrorCount;
+} proximityStatus_t;
+
+void proximity_init(void);
+void proximity_deinit(void);
+
+bool proximity_start(uint16_t interval_ms);
+void proximity_stop(void);
+bool proximity_isRunning(void);
+uint16_t proximity_getInterval(void);
+
+int16_t proximity_get(uint8_t faceNum);
+bool proximity_isBlocked(uint8_t faceNum);
+
+void proximity_setThreshold(uint16_t level, app_sched_event_handler_t eventHandler);
+uint16_t proximity_getThreshold(void);
+bool proximity_getStatus(uint8_t faceNum, proximityStatus_t *p_status);
+void proximity_clearStats(void);
+
+#endif /* PROXIMITY_H_ */
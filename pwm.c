@@ -17,6 +17,7 @@
 #include "nrf_gpiote.h"
 #include "nrf_sdm.h"
 #include "nrf_assert.h"
+#include "nrf_delay.h"
 
 #include "app_util.h"
 #include "app_error.h"
@@ -25,20 +26,41 @@
 #include "pins.h"
 #include "pwm.h"
 
-#define CHANNEL_COUNT	2
+#define CHANNEL_COUNT	3
 
 #define PWM0_PIN_NO		PRECHRGEN_PIN_NO
 #define PWM1_PIN_NO		BLDCIREF_PIN_NO
+#define PWM2_PIN_NO		SMAPWM_PIN_NO
 
 /* This is the period, in counts, of the PWM output.  Each individual channel
  * can have an on-time period anywhere between 0 and this number, inclusive.*/
 #define PERIOD	512
 
+/* Length of one period in microseconds, rounded up, given that TIMER2 counts
+ * at 16MHz */
+#define PERIOD_US	((PERIOD + 15) / 16)
+
 static bool initialized = false;
+static bool timerRunning = false;
+
+/* While greater than 0, changes to the on-periods are saved but not applied
+ * to the outputs until pwm_endUpdate() is called. */
+static unsigned int batchDepth = 0;
+static bool updatePending = false;
+
+static uint32_t onPeriods[CHANNEL_COUNT] = {0, 0, 0};
+static uint32_t pwmPinNos[CHANNEL_COUNT] = {PWM0_PIN_NO, PWM1_PIN_NO, PWM2_PIN_NO};
+static uint32_t pwmGPIOTEChnls[CHANNEL_COUNT] = {PWM_CH0_GPIOTE_CHANNEL, PWM_CH1_GPIOTE_CHANNEL, PWM_CH2_GPIOTE_CHANNEL};
+
+/* Whether each channel's GPIOTE block is presently configured to toggle its
+ * output, i.e. whether its on-period is strictly between 0 and PERIOD */
+static bool toggling[CHANNEL_COUNT] = {false, false, false};
+
+/* Fraction of a count, with PWM_DITHER_BITS bits, carried from one call to
+ * pwm_setOnPeriodDithered() to the next */
+static uint32_t ditherResidues[CHANNEL_COUNT] = {0, 0, 0};
 
-static uint32_t onPeriods[CHANNEL_COUNT] = {0, 0};
-static uint32_t pwmPinNos[CHANNEL_COUNT] = {PWM0_PIN_NO, PWM1_PIN_NO};
-static uint32_t pwmGPIOTEChnls[CHANNEL_COUNT] = {PWM_CH0_GPIOTE_CHANNEL, PWM_CH1_GPIOTE_CHANNEL};
+static void pwm_update(void);
 
 void pwm_init() {
 	uint32_t err_code;
@@ -72,7 +94,7 @@ void pwm_init() {
 	/* CC[0] is used to set the period of the PWM */
 	NRF_TIMER2->CC[0] = PERIOD;
 
-	/* Un-configure GPIO task/event blocks 0 and 1.  As soon as the
+	/* Un-configure GPIO task/event blocks 0, 1 and 2.  As soon as the
 	 * the duty cycle of a PWM channel is set to something other than 0, the
 	 * code must configure the corresponding task/event block as a task which
 	 * toggles the GPIO pin in response to each incoming event.  Setting the
@@ -81,6 +103,7 @@ void pwm_init() {
 	 * or low explicitly) so the PWM outputs would not behave correctly. */
 	nrf_gpiote_unconfig(PWM_CH0_GPIOTE_CHANNEL);
 	nrf_gpiote_unconfig(PWM_CH1_GPIOTE_CHANNEL);
+	nrf_gpiote_unconfig(PWM_CH2_GPIOTE_CHANNEL);
 
 	/* Set the PWM pins to 0 until they are turned on. */
 	nrf_gpio_pin_clear(PWM0_PIN_NO);
@@ -89,6 +112,9 @@ void pwm_init() {
 	nrf_gpio_pin_clear(PWM1_PIN_NO);
 	nrf_gpio_cfg_output(PWM1_PIN_NO);
 
+	nrf_gpio_pin_clear(PWM2_PIN_NO);
+	nrf_gpio_cfg_output(PWM2_PIN_NO);
+
 	/* Compare match on channel 0 is used to reset the counter to 0. */
 	NRF_TIMER2->SHORTS = (TIMER_SHORTS_COMPARE0_CLEAR_Enabled << TIMER_SHORTS_COMPARE0_CLEAR_Pos);
 
@@ -99,9 +125,9 @@ void pwm_init() {
 
 	/* Configure programmable peripheral interconnects to connect TIMER2
 	 * compare events to GPIO tasks.  Compare events on channel 0 toggle all
-	 * PWM pins.  Compare events on channels 1 and 2 each toggle their
+	 * PWM pins.  Compare events on channels 1, 2 and 3 each toggle their
 	 * respective PWM output pins.  That is, each output pin is toggled by
-	 * both a channel 0 compare event and a channel 1 or 2 compare event.*/
+	 * both a channel 0 compare event and a channel 1, 2 or 3 compare event.*/
 	if (softdevice_enabled) {
 		err_code = sd_ppi_channel_assign(PWM_CH0_RESET_PPI_CHANNEL,
 				&(NRF_TIMER2->EVENTS_COMPARE[0]),
@@ -123,10 +149,21 @@ void pwm_init() {
 				&(NRF_GPIOTE->TASKS_OUT[PWM_CH1_GPIOTE_CHANNEL]));
 		APP_ERROR_CHECK(err_code);
 
+		err_code = sd_ppi_channel_assign(PWM_CH2_RESET_PPI_CHANNEL,
+				&(NRF_TIMER2->EVENTS_COMPARE[0]),
+				&(NRF_GPIOTE->TASKS_OUT[PWM_CH2_GPIOTE_CHANNEL]));
+		APP_ERROR_CHECK(err_code);
+
+		err_code = sd_ppi_channel_assign(PWM_CH2_MATCH_PPI_CHANNEL,
+				&(NRF_TIMER2->EVENTS_COMPARE[3]),
+				&(NRF_GPIOTE->TASKS_OUT[PWM_CH2_GPIOTE_CHANNEL]));
+		APP_ERROR_CHECK(err_code);
+
 		/* Enable PPI channels */
 		err_code = sd_ppi_channel_enable_set(
 				PWM_CH0_RESET_PPI_CHEN_MASK | PWM_CH0_MATCH_PPI_CHEN_MASK |
-				PWM_CH1_RESET_PPI_CHEN_MASK | PWM_CH1_MATCH_PPI_CHEN_MASK );
+				PWM_CH1_RESET_PPI_CHEN_MASK | PWM_CH1_MATCH_PPI_CHEN_MASK |
+				PWM_CH2_RESET_PPI_CHEN_MASK | PWM_CH2_MATCH_PPI_CHEN_MASK );
 		APP_ERROR_CHECK(err_code);
 	} else {
 		NRF_PPI->CH[PWM_CH0_RESET_PPI_CHANNEL].EEP = (uint32_t)&(NRF_TIMER2->EVENTS_COMPARE[0]);
@@ -141,14 +178,24 @@ void pwm_init() {
 		NRF_PPI->CH[PWM_CH1_MATCH_PPI_CHANNEL].EEP = (uint32_t)&(NRF_TIMER2->EVENTS_COMPARE[2]);
 		NRF_PPI->CH[PWM_CH1_MATCH_PPI_CHANNEL].TEP = (uint32_t)&(NRF_GPIOTE->TASKS_OUT[PWM_CH1_GPIOTE_CHANNEL]);
 
+		NRF_PPI->CH[PWM_CH2_RESET_PPI_CHANNEL].EEP = (uint32_t)&(NRF_TIMER2->EVENTS_COMPARE[0]);
+		NRF_PPI->CH[PWM_CH2_RESET_PPI_CHANNEL].TEP = (uint32_t)&(NRF_GPIOTE->TASKS_OUT[PWM_CH2_GPIOTE_CHANNEL]);
+
+		NRF_PPI->CH[PWM_CH2_MATCH_PPI_CHANNEL].EEP = (uint32_t)&(NRF_TIMER2->EVENTS_COMPARE[3]);
+		NRF_PPI->CH[PWM_CH2_MATCH_PPI_CHANNEL].TEP = (uint32_t)&(NRF_GPIOTE->TASKS_OUT[PWM_CH2_GPIOTE_CHANNEL]);
+
 		/* Enable PPI channels */
 		NRF_PPI->CHENSET =
 				PWM_CH0_RESET_PPI_CHENSET_MASK | PWM_CH0_MATCH_PPI_CHENSET_MASK |
-				PWM_CH1_RESET_PPI_CHENSET_MASK | PWM_CH1_MATCH_PPI_CHENSET_MASK;
+				PWM_CH1_RESET_PPI_CHENSET_MASK | PWM_CH1_MATCH_PPI_CHENSET_MASK |
+				PWM_CH2_RESET_PPI_CHENSET_MASK | PWM_CH2_MATCH_PPI_CHENSET_MASK;
 	}
 
 	/* Note, we do not start the timer counting here.  There is no point given
-	 * that both output channels initially have an on period of 0. */
+	 * that all output channels initially have an on period of 0. */
+	timerRunning = false;
+	batchDepth = 0;
+	updatePending = false;
 
 	initialized = true;
 }
@@ -173,12 +220,14 @@ void pwm_deinit() {
 	if (softdevice_enabled) {
 		err_code = sd_ppi_channel_enable_clr(
 				PWM_CH0_RESET_PPI_CHEN_MASK | PWM_CH0_MATCH_PPI_CHEN_MASK |
-				PWM_CH1_RESET_PPI_CHEN_MASK | PWM_CH1_MATCH_PPI_CHEN_MASK );
+				PWM_CH1_RESET_PPI_CHEN_MASK | PWM_CH1_MATCH_PPI_CHEN_MASK |
+				PWM_CH2_RESET_PPI_CHEN_MASK | PWM_CH2_MATCH_PPI_CHEN_MASK );
 		APP_ERROR_CHECK(err_code);
 	} else {
 		NRF_PPI->CHENCLR =
 				PWM_CH0_RESET_PPI_CHENCLR_MASK | PWM_CH0_MATCH_PPI_CHENCLR_MASK |
-				PWM_CH1_RESET_PPI_CHENCLR_MASK | PWM_CH1_MATCH_PPI_CHENCLR_MASK;
+				PWM_CH1_RESET_PPI_CHENCLR_MASK | PWM_CH1_MATCH_PPI_CHENCLR_MASK |
+				PWM_CH2_RESET_PPI_CHENCLR_MASK | PWM_CH2_MATCH_PPI_CHENCLR_MASK;
 	}
 
 
@@ -188,16 +237,17 @@ void pwm_deinit() {
 		nrf_gpiote_unconfig(pwmGPIOTEChnls[i]);
 		nrf_gpio_pin_clear(pwmPinNos[i]);
 		onPeriods[i] = 0;
+		toggling[i] = false;
+		ditherResidues[i] = 0;
 	}
 
+	timerRunning = false;
+
 	initialized = false;
 }
 
 
 bool pwm_setOnPeriod(unsigned int channel, uint32_t onPeriod) {
-	int i;
-	bool timerNeeded = false;
-
 	/* Verify that the PWM system has been initialized */
 	if (!initialized) {
 		return false;
@@ -212,47 +262,172 @@ bool pwm_setOnPeriod(unsigned int channel, uint32_t onPeriod) {
 		return false;
 	}
 
+	/* An exact on-period discards any fraction left over from dithering. */
+	ditherResidues[channel] = 0;
+
+	/* If the on-period is not changing, there is no reason to touch the
+	 * hardware. */
+	if (onPeriods[channel] == onPeriod) {
+		return true;
+	}
+
 	/* Save a copy of the new on-time period */
 	onPeriods[channel] = onPeriod;
 
-	/* Stop and then clear the timer while we update the capture registers.
-	 * This is necessary because the registers are not double-buffered and the
-	 * fact that we cannot read the current value of the counter, so we do not
-	 * know whether the output should initially be set or cleared.  Remember,
-	 * each match simply toggles the output, so we much get the initial state of
-	 * the output set correctly or else the period will be inverted. */
+	/* In the middle of a batch update, the new on-period is applied together
+	 * with the others when pwm_endUpdate() is called. */
+	if (batchDepth > 0) {
+		updatePending = true;
+		return true;
+	}
+
+	pwm_update();
+
+	return true;
+}
+
+/**@brief Sets a channel's on-period with PWM_DITHER_BITS bits of fraction.
+ *
+ * The hardware can only produce whole counts, so each call rounds the
+ * requested on-period up or down and carries the rounding error into the
+ * next call (first-order error diffusion).  A caller which updates the
+ * on-period periodically, like the BLDC speed control loop, therefore gets an
+ * average on-period with 1/2^PWM_DITHER_BITS count resolution without any
+ * additional interrupts.
+ */
+bool pwm_setOnPeriodDithered(unsigned int channel, uint32_t onPeriod_dithered) {
+	uint32_t sum;
+	uint32_t onPeriod;
+	uint32_t residue;
+
+	if (!initialized || (channel >= CHANNEL_COUNT)) {
+		return false;
+	}
+
+	if (onPeriod_dithered > (PERIOD << PWM_DITHER_BITS)) {
+		return false;
+	}
+
+	sum = onPeriod_dithered + ditherResidues[channel];
+	onPeriod = sum >> PWM_DITHER_BITS;
+	residue = sum - (onPeriod << PWM_DITHER_BITS);
+
+	if (onPeriod > PERIOD) {
+		onPeriod = PERIOD;
+		residue = 0;
+	}
+
+	if (!pwm_setOnPeriod(channel, onPeriod)) {
+		return false;
+	}
+
+	ditherResidues[channel] = residue;
+
+	return true;
+}
+
+/**@brief Starts a batch update.  Until the matching call to pwm_endUpdate(),
+ * calls to pwm_setOnPeriod() and pwm_setOnPeriodDithered() only record the
+ * new on-periods.  Batches may be nested.
+ */
+void pwm_beginUpdate() {
+	batchDepth++;
+}
+
+/**@brief Ends a batch update, applying all of the on-periods changed since
+ * pwm_beginUpdate() at the same period boundary.
+ */
+bool pwm_endUpdate() {
+	if (batchDepth > 0) {
+		batchDepth--;
+	}
+
+	if (!initialized) {
+		return false;
+	}
+
+	if ((batchDepth == 0) && updatePending) {
+		pwm_update();
+	}
+
+	return true;
+}
+
+/**@brief Applies the saved on-periods to the outputs.
+ *
+ * The compare registers are not double-buffered and each match simply toggles
+ * its output, so the registers can only safely be changed while the timer is
+ * stopped.  Stopping the timer wherever it happens to be would truncate the
+ * current period of every channel and produce a runt pulse (and a current
+ * spike on the BLDC IREF input).  Instead, if the timer
+ * is running, we let it run to the end of the current period and stop there
+ * (by adding a COMPARE0_STOP short), at which point the CC[0] match has just
+ * toggled every PWM output high, exactly as at the start of a period.  Because
+ * the period is only PERIOD_US long, we simply poll for the CC[0] event rather
+ * than using an interrupt.  The only effect on the waveform is that the first
+ * period after the update is stretched by the few microseconds it takes to
+ * notice the event and re-program the registers.  (Waiting out a whole
+ * PERIOD_US instead would hold every output high for the rest of that time,
+ * adding up to a period of on-time at each update.)
+ */
+void pwm_update() {
+	int i;
+	bool timerNeeded = false;
+	uint32_t wait_us;
+
+	if (timerRunning) {
+		NRF_TIMER2->SHORTS = (TIMER_SHORTS_COMPARE0_CLEAR_Enabled << TIMER_SHORTS_COMPARE0_CLEAR_Pos) |
+				(TIMER_SHORTS_COMPARE0_STOP_Enabled << TIMER_SHORTS_COMPARE0_STOP_Pos);
+
+		/* The event is cleared after the short is set, so that it is only seen
+		 * once the timer has stopped.  If the period ends in between, the
+		 * wait is simply the longest one. */
+		NRF_TIMER2->EVENTS_COMPARE[0] = 0;
+		for (wait_us = 0; !NRF_TIMER2->EVENTS_COMPARE[0] && (wait_us <= PERIOD_US); wait_us++) {
+			nrf_delay_us(1);
+		}
+	}
+
+	/* The timer should already be stopped at 0, but we make sure. */
 	NRF_TIMER2->TASKS_STOP = 1;
 	NRF_TIMER2->TASKS_CLEAR = 1;
+	NRF_TIMER2->SHORTS = (TIMER_SHORTS_COMPARE0_CLEAR_Enabled << TIMER_SHORTS_COMPARE0_CLEAR_Pos);
 
 	for (i=0; i<CHANNEL_COUNT; i++) {
-		/* We iterate over all channels because we must force all channels with
-		 * an on-period great than 0 to initially drive their outputs high
-		 * given that we just reset the counter to 0.  */
 		if (onPeriods[i] == 0) {
 			/* If the requested on-period is 0, we disable the GPIOTE channel
 			 * which toggles the corresponding output and instead set the
 			 * output permanently low. */
 			nrf_gpiote_unconfig(pwmGPIOTEChnls[i]);
 			nrf_gpio_pin_clear(pwmPinNos[i]);
+			toggling[i] = false;
 		} else if (onPeriods[i] == PERIOD) {
 			/* If the requested on-period is equal to the overall waveform
 			 * period, we disable the GPIOTE channel which toggles the output
 			 * and instead set the output permanently high. */
 			nrf_gpiote_unconfig(pwmGPIOTEChnls[i]);
 			nrf_gpio_pin_set(pwmPinNos[i]);
+			toggling[i] = false;
 		} else {
 			/* If the requested on-period is somewhere in between 0 and the
 			 * overall period, we set the corresponding capture/compare
-			 * register to hold the period.  We then enable the corresponding
-			 * GPIOTE channel to toggle on each match event.  With the counter
-			 * at 0, the PWM output will initially be high and will remain so
-			 * until the counter matches CC[channel+1] at which point the
-			 * output will be toggled low.  Then, when the counter matches
-			 * CC[0], the counter will be reset to 0 and the output will again
-			 * be toggled high. */
+			 * register to hold the period.  With the counter at 0, the PWM
+			 * output will initially be high and will remain so until the
+			 * counter matches CC[channel+1] at which point the output will be
+			 * toggled low.  Then, when the counter matches CC[0], the counter
+			 * will be reset to 0 and the output will again be toggled high. */
 			NRF_TIMER2->CC[i+1] = onPeriods[i];
-			nrf_gpiote_task_config(pwmGPIOTEChnls[i], pwmPinNos[i],
-					NRF_GPIOTE_POLARITY_TOGGLE, NRF_GPIOTE_INITIAL_VALUE_HIGH);
+
+			/* A channel which was already toggling was left high by the CC[0]
+			 * match at the end of the last period, so only a channel which
+			 * was previously held at 0 or 100% needs its GPIOTE channel
+			 * (re-)configured to start high. */
+			if (!toggling[i]) {
+				nrf_gpiote_task_config(pwmGPIOTEChnls[i], pwmPinNos[i],
+						NRF_GPIOTE_POLARITY_TOGGLE, NRF_GPIOTE_INITIAL_VALUE_HIGH);
+				toggling[i] = true;
+			}
+
 			/* If one of the channels has a period between 0 and 100%, we
 			 * actually need to start the timer.  Otherwise, the timer is just
 			 * burning extra current, so we'll keep it off. */
@@ -260,21 +435,18 @@ bool pwm_setOnPeriod(unsigned int channel, uint32_t onPeriod) {
 		}
 	}
 
-	/* Have re-initialized all PWM channels, we restart the counter. Note that
-	 * each time we change any channel's period, we do cause a glitch on the
-	 * other channels.  This is acceptable given that we only intend that these
-	 * PWM outputs to be low-pass filtered to generate analog voltage levels.
-	 * Note that we only actually start the timer if one of the channels has
+	/* Note that we only actually start the timer if one of the channels has
 	 * a period somewhere between, but not including 0 and 100%. */
 	if (timerNeeded) {
 		NRF_TIMER2->TASKS_START = 1;
 	}
 
-	return true;
+	timerRunning = timerNeeded;
+	updatePending = false;
 }
 
 uint32_t pwm_getOnPeriod(unsigned int channel) {
-	if (!initialized || (channel > 1)) {
+	if (!initialized || (channel >= CHANNEL_COUNT)) {
 		return 0;
 	}
 
@@ -13,10 +13,18 @@
 
 #define PRECHRGEN_PWM_CHNL	0
 #define BLDCIREF_PWM_CHNL	1
+#define SMA_PWM_CHNL		2
+
+/* Number of fractional bits in the on-period passed to
+ * pwm_setOnPeriodDithered() */
+#define PWM_DITHER_BITS		4
 
 void pwm_init(void);
 void pwm_deinit(void);
 bool pwm_setOnPeriod(unsigned int channel, uint32_t onPeriod);
+bool pwm_setOnPeriodDithered(unsigned int channel, uint32_t onPeriod_dithered);
+void pwm_beginUpdate(void);
+bool pwm_endUpdate(void);
 uint32_t pwm_getOnPeriod(unsigned int channel);
 uint32_t pwm_getPeriod(void);
 
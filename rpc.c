@@ -0,0 +1,329 @@
+/*
+ * rpc.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "global.h"
+#include "util.h"
+#include "cmdline.h"
+#include "irtx.h"
+#include "message.h"
+#include "neighbor.h"
+#include "rpc.h"
+
+/* Requests and responses are not time-critical, and responses carrying
+ * command output are long, so both travel in the bulk queues. */
+#define RPC_PRIORITY			IRTX_PRIORITY_BULK
+
+typedef struct {
+    bool active;
+    uint8_t callID;
+    uint16_t target;
+    uint32_t deadline_ms;
+    rpcCallback_t callback;
+} rpcCall_t;
+
+static bool initialized = false;
+
+static rpcCall_t calls[RPC_MAX_PENDING_CALLS];
+static uint8_t nextCallID = 0;
+
+static void rpc_send(uint8_t exceptFaceNum, uint16_t target, const char *str);
+static void rpc_processRequest(uint8_t faceNum, const char *msg);
+static void rpc_processResponse(uint8_t faceNum, const char *msg);
+static void rpc_execute(uint8_t faceNum, uint16_t origin, uint8_t callID, const char *cmd);
+
+void rpc_init() {
+    uint8_t i;
+
+    for (i = 0; i < RPC_MAX_PENDING_CALLS; i++) {
+	calls[i].active = false;
+    }
+
+    initialized = true;
+}
+
+void rpc_deinit() {
+    initialized = false;
+}
+
+void rpc_tick() {
+    uint32_t now_ms;
+    uint8_t i;
+    rpcCall_t call;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    for (i = 0; i < RPC_MAX_PENDING_CALLS; i++) {
+	if (!calls[i].active || ((int32_t)(now_ms - calls[i].deadline_ms) < 0)) {
+	    continue;
+	}
+
+	/* Free the slot before calling back so that the callback may start a
+	 * new call. */
+	call = calls[i];
+	calls[i].active = false;
+
+	if (call.callback != NULL) {
+	    call.callback(call.callID, call.target, RPC_STATUS_TIMEOUT, "");
+	}
+    }
+}
+
+/**@brief Executes a command-line command on another module (or on every
+ * other module) and returns its output through the callback.
+ *
+ * @param[in]  target      ID of the module which should execute the command,
+ *                         or RPC_TARGET_ALL.
+ * @param[in]  cmd         Command to execute, as typed on the command line.
+ * @param[in]  timeout_ms  Time to wait for a response (or, for
+ *                         RPC_TARGET_ALL, to collect responses).
+ * @param[in]  callback    Function called with each response.
+ * @param[out] p_callID    ID of the call (may be NULL).
+ *
+ * @return false if the call could not be started.
+ */
+bool rpc_call(uint16_t target, const char *cmd, uint32_t timeout_ms, rpcCallback_t callback, uint8_t *p_callID) {
+    char str[RPC_MAX_CMD_LEN + 24];
+    uint8_t i;
+
+    if (!initialized || (target == getNodeID()) || (strlen(cmd) > RPC_MAX_CMD_LEN) || (strchr(cmd, '|') != NULL)) {
+	return false;
+    }
+
+    for (i = 0; i < RPC_MAX_PENDING_CALLS; i++) {
+	if (!calls[i].active) {
+	    break;
+	}
+    }
+
+    if (i == RPC_MAX_PENDING_CALLS) {
+	return false;
+    }
+
+    nextCallID++;
+
+    calls[i].active = true;
+    calls[i].callID = nextCallID;
+    calls[i].target = target;
+    calls[i].deadline_ms = curr_time_ms() + timeout_ms;
+    calls[i].callback = callback;
+
+    /* Request: rpcq;<origin>;<target>;<callID>;<command> */
+    snprintf(str, sizeof(str), "rpcq;%04x;%04x;%u;%s|", getNodeID(), target, nextCallID, cmd);
+    rpc_send(0, target, str);
+
+    if (p_callID != NULL) {
+	*p_callID = nextCallID;
+    }
+
+    return true;
+}
+
+/**@brief Stops waiting for responses to a call without calling back. */
+void rpc_cancel(uint8_t callID) {
+    uint8_t i;
+
+    for (i = 0; i < RPC_MAX_PENDING_CALLS; i++) {
+	if (calls[i].active && (calls[i].callID == callID)) {
+	    calls[i].active = false;
+	}
+    }
+}
+
+const char *rpc_getStatusString(rpcStatus_t status) {
+    switch (status) {
+    case RPC_STATUS_OK:
+	return "ok";
+    case RPC_STATUS_UNKNOWN_CMD:
+	return "unknown command";
+    case RPC_STATUS_TRUNCATED:
+	return "output truncated";
+    case RPC_STATUS_BUSY:
+	return "busy";
+    case RPC_STATUS_TIMEOUT:
+	return "timeout";
+    default:
+	return "error";
+    }
+}
+
+bool rpc_processMessage(uint8_t faceNum, const char *msg) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "rpcq;", 5) == 0) {
+	rpc_processRequest(faceNum, msg);
+    } else if (strncmp(msg, "rpcr;", 5) == 0) {
+	rpc_processResponse(faceNum, msg);
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+/**@brief Sends a request towards its target.  If the target is one of our
+ * neighbors, the request is sent only on the face in contact with it.
+ * Otherwise, it is flooded on every face except the one on which it arrived.
+ */
+void rpc_send(uint8_t exceptFaceNum, uint16_t target, const char *str) {
+    neighbor_t neighbor;
+    uint8_t faceNum;
+
+    if (target != RPC_TARGET_ALL) {
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    if (neighbor_get(faceNum, &neighbor) && (neighbor.id == target)) {
+		irtx_queueString(faceNum, RPC_PRIORITY, str);
+		return;
+	    }
+	}
+    }
+
+    message_sendToAllBut(exceptFaceNum, RPC_PRIORITY, str);
+}
+
+void rpc_processRequest(uint8_t faceNum, const char *msg) {
+    unsigned int origin, target, callID;
+    int cmdStart = 0;
+    char str[128];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "rpcq;%x;%x;%u;%n", &origin, &target, &callID, &cmdStart) != 3) {
+	return;
+    }
+
+    /* Each request is handled once, no matter how many paths it takes to
+     * reach us.  The face on which it first arrived is remembered so that
+     * responses can retrace its path. */
+    if ((cmdStart == 0) || (origin == getNodeID()) || !message_recordRoute('r', origin, callID, faceNum)) {
+	return;
+    }
+
+    if (target != getNodeID()) {
+	snprintf(str, sizeof(str), "%s|", msg);
+	rpc_send(faceNum, target, str);
+    }
+
+    if ((target == getNodeID()) || (target == RPC_TARGET_ALL)) {
+	rpc_execute(faceNum, origin, callID, &msg[cmdStart]);
+    }
+}
+
+/**@brief Executes a command on behalf of another module, capturing
+ * everything that it prints, and sends the output back on the face from which
+ * the request came.
+ */
+void rpc_execute(uint8_t faceNum, uint16_t origin, uint8_t callID, const char *cmd) {
+    char output[RPC_MAX_OUTPUT_LEN + 1];
+    char str[RPC_MAX_OUTPUT_LEN + 24];
+    rpcStatus_t status;
+    bool overflowed;
+    uint16_t i, len;
+
+    if (!app_uart_capture_start(output, sizeof(output))) {
+	status = RPC_STATUS_BUSY;
+	output[0] = '\0';
+    } else {
+	if (!cmdLine_execCmd(cmd)) {
+	    status = RPC_STATUS_UNKNOWN_CMD;
+	} else {
+	    status = RPC_STATUS_OK;
+	}
+
+	app_uart_capture_stop(&overflowed);
+	if (overflowed && (status == RPC_STATUS_OK)) {
+	    status = RPC_STATUS_TRUNCATED;
+	}
+    }
+
+    /* The output must not contain the message terminator or characters
+     * which the IR receivers discard.  Carriage returns are dropped, and only
+     * the '\n' of each line ending is sent. */
+    for (i = 0, len = 0; output[i] != '\0'; i++) {
+	if (output[i] == '\r') {
+	    continue;
+	} else if (output[i] == '|') {
+	    output[len++] = '/';
+	} else if ((uint8_t)output[i] > 0x7F) {
+	    output[len++] = '?';
+	} else {
+	    output[len++] = output[i];
+	}
+    }
+
+    while ((len > 0) && (output[len-1] == '\n')) {
+	len--;
+    }
+    output[len] = '\0';
+
+    /* Response: rpcr;<origin>;<callID>;<responder>;<status>;<output> */
+    snprintf(str, sizeof(str), "rpcr;%04x;%u;%04x;%u;%s|", origin, callID, getNodeID(), status, output);
+    irtx_queueString(faceNum, RPC_PRIORITY, str);
+}
+
+void rpc_processResponse(uint8_t faceNum, const char *msg) {
+    unsigned int origin, callID, responder, status;
+    int outputStart = 0;
+    uint8_t i, parentFace;
+    rpcCall_t call;
+    char str[128];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "rpcr;%x;%u;%x;%u;%n", &origin, &callID, &responder, &status, &outputStart) != 4) {
+	return;
+    }
+
+    if (outputStart == 0) {
+	return;
+    }
+
+    if (origin != getNodeID()) {
+	/* Pass the response one step closer to the module which called */
+	parentFace = message_getRouteFace('r', origin, callID);
+	if (parentFace != 0) {
+	    snprintf(str, sizeof(str), "%s|", msg);
+	    irtx_queueString(parentFace, RPC_PRIORITY, str);
+	}
+	return;
+    }
+
+    for (i = 0; i < RPC_MAX_PENDING_CALLS; i++) {
+	if (!calls[i].active || (calls[i].callID != callID)) {
+	    continue;
+	}
+
+	if ((calls[i].target != RPC_TARGET_ALL) && (calls[i].target != responder)) {
+	    continue;
+	}
+
+	/* A call to a single module completes with its response, while a call
+	 * to every module keeps collecting responses until it times out. */
+	call = calls[i];
+	if (call.target != RPC_TARGET_ALL) {
+	    calls[i].active = false;
+	}
+
+	if (call.callback != NULL) {
+	    call.callback(callID, responder, (rpcStatus_t)status, &msg[outputStart]);
+	}
+	return;
+    }
+}
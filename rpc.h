@@ -0,0 +1,59 @@
+/*
+ * rpc.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef RPC_H_
+#define RPC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Target ID which addresses every module in the cluster */
+#define RPC_TARGET_ALL			0xFFFF
+
+#define RPC_MAX_CMD_LEN			64
+#define RPC_MAX_OUTPUT_LEN		96
+#define RPC_MAX_PENDING_CALLS		4
+
+/* Messages wait up to one polling interval at every hop in each direction */
+#define RPC_DEFAULT_TIMEOUT_MS		8000
+
+typedef enum {
+    RPC_STATUS_OK = 0,
+    /* The remote module does not recognize the command */
+    RPC_STATUS_UNKNOWN_CMD,
+    /* The command ran, but its output was too long to return in full */
+    RPC_STATUS_TRUNCATED,
+    /* The remote module was already capturing output and could not run the
+     * command */
+    RPC_STATUS_BUSY,
+    /* No (further) responses arrived before the call's timeout */
+    RPC_STATUS_TIMEOUT
+} rpcStatus_t;
+
+/**@brief Called once for each response to a call, and once more with
+ * RPC_STATUS_TIMEOUT when a call to RPC_TARGET_ALL finishes collecting
+ * responses or when a call to a single module goes unanswered.
+ *
+ * @param[in] callID     ID returned by rpc_call().
+ * @param[in] responder  ID of the responding module (or the call's target on
+ *                       timeout).
+ * @param[in] status     Outcome of the call on the responding module.
+ * @param[in] output     Null-terminated output of the command, in which lines
+ *                       are separated by '\n'.
+ */
+typedef void (*rpcCallback_t)(uint8_t callID, uint16_t responder, rpcStatus_t status, const char *output);
+
+void rpc_init(void);
+void rpc_deinit(void);
+void rpc_tick(void);
+
+bool rpc_processMessage(uint8_t faceNum, const char *msg);
+
+bool rpc_call(uint16_t target, const char *cmd, uint32_t timeout_ms, rpcCallback_t callback, uint8_t *p_callID);
+void rpc_cancel(uint8_t callID);
+const char *rpc_getStatusString(rpcStatus_t status);
+
+#endif /* RPC_H_ */
@@ -10,15 +10,16 @@
 #include <stddef.h>
 
 #include "nordic_common.h"
-#include "nrf_delay.h"
-#include "nrf_gpio.h"
 #include "app_timer.h"
 
 #include "global.h"
 #include "pins.h"
 #include "util.h"
 #include "power.h"
+#include "pwm.h"
 #include "motionEvent.h"
+#include "thermal.h"
+#include "smamodel.h"
 #include "sma.h"
 
 #define SMA_DEBUG	0
@@ -27,13 +28,44 @@
 
 #define RETRACT_CURRENT_DEFAULT_MA		1200
 #define HOLD_CURRENT_DEFAULT_MA			700
+#define RELEASE_CURRENT_DEFAULT_MA		0
 
 #define RETRACT_TIME_DEFAULT_MS			2000
+#define RETRACT_TIME_MIN_MS				300
 #define RETRACT_TIME_MAX_MS				2500
 #define	HOLD_TIME_MAX_MS				8000
-#define RECOVERY_TIME_MS				3000
-
-#define TIMER_PERIOD_MS					50
+#define RECOVERY_TIME_DEFAULT_MS		3000
+#define RECOVERY_TIME_MIN_MS			500
+#define RECOVERY_TIME_MAX_MS			10000
+
+/* The wire is heated this far past its austenite finish temperature, and
+ * cooled this far below its martensite finish temperature, so that it has
+ * fully transformed even if it heats or cools more slowly than the model
+ * (the margins cover a spread of about 15% in the wire's parameters). */
+#define MODEL_RETRACT_MARGIN_TENTHDEGC	150
+#define MODEL_RECOVERY_MARGIN_TENTHDEGC	100
+
+/* The hold current is limited so that, by the model, the wire never settles
+ * hotter than this, which keeps it below 150 C allowing for the same
+ * spread. */
+#define MODEL_MAX_TEMP_TENTHDEGC		1350
+
+/* When the ambient temperature or the battery voltage is unknown, the model
+ * assumes the worst case: a cold module and a weak battery while heating (so
+ * that the wire is never under-heated), and a hot module and a full battery
+ * otherwise (so that the wire is never thought cooler than it is).  The
+ * battery voltage is measured before the SMA draws current, so it is reduced
+ * by the expected sag while heating. */
+#define MODEL_COLD_AMBIENT_TENTHDEGC	0
+#define MODEL_HOT_AMBIENT_TENTHDEGC		450
+#define MODEL_MIN_BATTERY_MV			12000
+#define MODEL_MAX_BATTERY_MV			16800
+#define MODEL_BATTERY_SAG_MV			500
+
+/* After the SMA has extended, the model keeps tracking the wire until it is
+ * within this of the ambient temperature, and is then considered settled. */
+#define MODEL_SETTLED_TENTHDEGC			20
+#define MODEL_SETTLE_MAX_MS				(10 * SMAMODEL_TIME_CONSTANT_MS)
 
 static bool initialized = false;
 static smaState_t smaState;
@@ -42,20 +74,46 @@ static uint32_t retractStartTime_rtcTicks = 0;
 
 static uint32_t retractCurrent_mA = RETRACT_CURRENT_DEFAULT_MA;
 static uint32_t holdCurrent_mA = HOLD_CURRENT_DEFAULT_MA;
+static uint32_t releaseCurrent_mA = RELEASE_CURRENT_DEFAULT_MA;
 
-static uint32_t retractPWMOnTime_ms;
-static uint32_t retractPWMOffTime_ms;
-static uint32_t holdPWMOnTime_ms;
-static uint32_t holdPWMOffTime_ms;
+/* The current presently being driven through the SMA */
+static uint32_t driveCurrent_mA = 0;
 
 static uint32_t retractTime_ms = RETRACT_TIME_DEFAULT_MS;
+static uint32_t recoveryTime_ms = RECOVERY_TIME_DEFAULT_MS;
 static uint32_t holdTime_ms;
 
+/* Retract and recovery times chosen for the present actuation */
+static uint32_t activeRetractTime_ms = RETRACT_TIME_DEFAULT_MS;
+static uint32_t activeRecoveryTime_ms = RECOVERY_TIME_DEFAULT_MS;
+
+static bool modelEnabled = true;
+static smaModel_t model;
+static uint32_t modelTime_rtcTicks;
+static bool modelSettled = true;
+static bool modelSettling = false;
+/* Battery pack voltage measured at the start of the present actuation */
+static uint16_t modelBattery_mV = 0;
+
+static uint16_t actuations = 0;
+static uint16_t timerWakeups = 0;
+static uint16_t modelClamps = 0;
+
 static app_sched_event_handler_t eventHandler;
 
 
 static bool sma_init(void);
 static void sma_deinit(void);
+static void sma_setDriveCurrent_mA(uint32_t current_mA);
+static void sma_startTimer(uint32_t time_ms);
+static uint16_t sma_getModelBattery_mV(bool heating);
+static int16_t sma_getModelAmbient_tenthDegC(bool heating);
+static uint16_t sma_getDuty_permille(uint32_t current_mA);
+static void sma_updateModel(void);
+static uint32_t sma_planRetractTime_ms(void);
+static uint32_t sma_planRecoveryTime_ms(void);
+static uint32_t sma_getHoldDriveCurrent_mA(void);
+static void sma_startSettling(void);
 
 static app_timer_id_t sma_timerID = TIMER_NULL;
 static void sma_timerHandler(void *p_context);
@@ -67,9 +125,6 @@ bool sma_init() {
 		return true;
 	}
 
-	nrf_gpio_pin_clear(SMAPWM_PIN_NO);
-	nrf_gpio_cfg_output(SMAPWM_PIN_NO);
-
 	if (sma_timerID == TIMER_NULL) {
 		/* If the timer has not yet been created, create it now. At the moment,
 		 * the SDK does not provide a way to destroy a timer, so we set the
@@ -79,9 +134,9 @@ bool sma_init() {
 		APP_ERROR_CHECK(err_code);
 	}
 
-    smaState = SMA_STATE_EXTENDED;
+	smaState = SMA_STATE_EXTENDED;
 
-    initialized = true;
+	initialized = true;
 
 	return true;
 }
@@ -98,13 +153,206 @@ void sma_deinit() {
 	}
 
 	/* Disable the SMA controller */
-	nrf_gpio_pin_clear(SMAPWM_PIN_NO);
+	sma_setDriveCurrent_mA(0);
 
 	smaState = SMA_STATE_EXTENDED;
 
 	initialized = false;
 }
 
+/**@brief Sets the duty cycle of the hardware PWM channel which drives the SMA
+ * controller so that the average current through the SMA is current_mA.
+ *
+ * The PWM output is generated by TIMER2, PPI and GPIOTE (see pwm.c), so once
+ * set, the duty cycle is maintained without any further involvement from the
+ * CPU.  If the PWM module has been de-initialized (i.e. while sleeping), the
+ * SMA output is already held low and the request is ignored.
+ */
+void sma_setDriveCurrent_mA(uint32_t current_mA) {
+	uint32_t period;
+
+	if (current_mA > MAX_CURRENT_MA) {
+		current_mA = MAX_CURRENT_MA;
+	}
+
+	/* Account for the heat delivered at the old current before changing
+	 * it. */
+	sma_updateModel();
+
+	driveCurrent_mA = current_mA;
+
+	period = pwm_getPeriod();
+	pwm_setOnPeriod(SMA_PWM_CHNL, (current_mA * period + MAX_CURRENT_MA / 2) / MAX_CURRENT_MA);
+}
+
+/**@brief Starts the SMA timer so that it expires at the end of the current
+ * phase (retracting, holding, or extending).  The timer only marks phase
+ * boundaries; the PWM waveform itself is generated in hardware.
+ */
+void sma_startTimer(uint32_t time_ms) {
+	uint32_t err_code;
+	uint32_t ticks;
+
+	ticks = APP_TIMER_TICKS(time_ms, APP_TIMER_PRESCALER);
+	if (ticks < APP_TIMER_MIN_TIMEOUT_TICKS) {
+		ticks = APP_TIMER_MIN_TIMEOUT_TICKS;
+	}
+
+	err_code = app_timer_start(sma_timerID, ticks, NULL);
+	APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Returns the battery pack voltage to use in the thermal model, falling
+ * back to the worst case if it was not measured or is implausible.
+ */
+uint16_t sma_getModelBattery_mV(bool heating) {
+	if ((modelBattery_mV < MODEL_MIN_BATTERY_MV) || (modelBattery_mV > MODEL_MAX_BATTERY_MV)) {
+		return heating ? MODEL_MIN_BATTERY_MV : MODEL_MAX_BATTERY_MV;
+	}
+
+	if (heating) {
+		return modelBattery_mV - MODEL_BATTERY_SAG_MV;
+	}
+
+	return modelBattery_mV;
+}
+
+/**@brief Returns the ambient temperature to use in the thermal model.  This is
+ * the daughterboard temperature if it is known, and the worst case otherwise.
+ */
+int16_t sma_getModelAmbient_tenthDegC(bool heating) {
+	if (thermal_isValid()) {
+		return thermal_getTemp_tenthDegC();
+	}
+
+	return heating ? MODEL_COLD_AMBIENT_TENTHDEGC : MODEL_HOT_AMBIENT_TENTHDEGC;
+}
+
+uint16_t sma_getDuty_permille(uint32_t current_mA) {
+	return (current_mA * 1000) / MAX_CURRENT_MA;
+}
+
+/**@brief Advances the thermal model of the wire to the present time, assuming
+ * that driveCurrent_mA has been applied since the last update.  This is only
+ * called when the drive changes, so it costs no additional wake-ups.
+ */
+void sma_updateModel() {
+	uint32_t rtcTicks;
+	uint32_t elapsedTime_ms;
+	bool heating;
+
+	if (modelSettled) {
+		return;
+	}
+
+	app_timer_cnt_get(&rtcTicks);
+	elapsedTime_ms = ((0x00FFFFFF & (rtcTicks - modelTime_rtcTicks)) * (uint64_t)USEC_PER_APP_TIMER_TICK) / 1000;
+	modelTime_rtcTicks = rtcTicks;
+
+	heating = (smaState == SMA_STATE_RETRACTING);
+	smamodel_advance(&model, elapsedTime_ms, sma_getDuty_permille(driveCurrent_mA),
+			sma_getModelBattery_mV(heating), sma_getModelAmbient_tenthDegC(heating));
+}
+
+/**@brief Returns the time for which to drive the retract current: the time the
+ * model predicts the wire takes to heat past its austenite finish temperature,
+ * clamped to [RETRACT_TIME_MIN_MS, RETRACT_TIME_MAX_MS].  A wire that is still
+ * warm from a previous actuation needs less time.
+ */
+uint32_t sma_planRetractTime_ms() {
+	uint32_t time_ms;
+
+	if (!modelEnabled) {
+		return retractTime_ms;
+	}
+
+	time_ms = smamodel_getTimeToReach_ms(&model,
+			SMAMODEL_AUSTENITE_FINISH_TENTHDEGC + MODEL_RETRACT_MARGIN_TENTHDEGC,
+			sma_getDuty_permille(retractCurrent_mA), sma_getModelBattery_mV(true),
+			sma_getModelAmbient_tenthDegC(true), RETRACT_TIME_MAX_MS);
+
+	if (time_ms == SMAMODEL_UNREACHABLE) {
+		modelClamps++;
+		return RETRACT_TIME_MAX_MS;
+	} else if (time_ms < RETRACT_TIME_MIN_MS) {
+		return RETRACT_TIME_MIN_MS;
+	}
+
+	return time_ms;
+}
+
+/**@brief Returns the time the model predicts the wire takes to cool below its
+ * martensite finish temperature at the release current, after which it may be
+ * actuated again.  Clamped to [RECOVERY_TIME_MIN_MS, RECOVERY_TIME_MAX_MS]: in
+ * a hot module the wire may need longer than the default fixed recovery time.
+ */
+uint32_t sma_planRecoveryTime_ms() {
+	uint32_t time_ms;
+
+	if (!modelEnabled) {
+		return recoveryTime_ms;
+	}
+
+	time_ms = smamodel_getTimeToReach_ms(&model,
+			SMAMODEL_MARTENSITE_FINISH_TENTHDEGC - MODEL_RECOVERY_MARGIN_TENTHDEGC,
+			sma_getDuty_permille(releaseCurrent_mA), sma_getModelBattery_mV(false),
+			sma_getModelAmbient_tenthDegC(false), RECOVERY_TIME_MAX_MS);
+
+	if (time_ms == SMAMODEL_UNREACHABLE) {
+		modelClamps++;
+		return RECOVERY_TIME_MAX_MS;
+	} else if (time_ms < RECOVERY_TIME_MIN_MS) {
+		return RECOVERY_TIME_MIN_MS;
+	}
+
+	return time_ms;
+}
+
+/**@brief Returns the hold current, limited so that the wire never settles
+ * above MODEL_MAX_TEMP_TENTHDEGC however long it is held.
+ */
+uint32_t sma_getHoldDriveCurrent_mA() {
+	uint32_t maxCurrent_mA;
+
+	if (!modelEnabled) {
+		return holdCurrent_mA;
+	}
+
+	maxCurrent_mA = ((uint32_t)smamodel_getMaxDuty_permille(MODEL_MAX_TEMP_TENTHDEGC,
+			sma_getModelBattery_mV(false), sma_getModelAmbient_tenthDegC(false)) * MAX_CURRENT_MA) / 1000;
+
+	if (holdCurrent_mA > maxCurrent_mA) {
+		modelClamps++;
+		return maxCurrent_mA;
+	}
+
+	return holdCurrent_mA;
+}
+
+/**@brief Starts the SMA timer so that it expires when the model predicts that
+ * the wire has cooled to within MODEL_SETTLED_TENTHDEGC of the ambient
+ * temperature.
+ */
+void sma_startSettling() {
+	int16_t ambient_tenthDegC;
+	uint32_t time_ms;
+
+	ambient_tenthDegC = sma_getModelAmbient_tenthDegC(false);
+
+	if (smamodel_getTemp_tenthDegC(&model) <= ambient_tenthDegC + MODEL_SETTLED_TENTHDEGC) {
+		time_ms = 0;
+	} else {
+		time_ms = smamodel_getTimeToReach_ms(&model, ambient_tenthDegC + MODEL_SETTLED_TENTHDEGC, 0,
+				sma_getModelBattery_mV(false), ambient_tenthDegC, MODEL_SETTLE_MAX_MS);
+		if (time_ms == SMAMODEL_UNREACHABLE) {
+			time_ms = MODEL_SETTLE_MAX_MS;
+		}
+	}
+
+	modelSettling = true;
+	sma_startTimer(time_ms);
+}
+
 bool sma_setRetractCurrent_mA(uint16_t current_mA) {
 	if (current_mA > MAX_CURRENT_MA) {
 		return false;
@@ -131,8 +379,29 @@ uint16_t sma_getHoldCurrent_mA() {
 	return holdCurrent_mA;
 }
 
-bool sma_setRetractTime_ms(uint16_t time_ms) {
-	if (retractTime_ms > RETRACT_TIME_MAX_MS) {
+/**@brief Sets the current driven through the SMA while it recovers after
+ * being released.  A small current slows the cooling of the wire so that it
+ * extends more gently.  It may not exceed the hold current.
+ */
+bool sma_setReleaseCurrent_mA(uint16_t current_mA) {
+	if (current_mA > holdCurrent_mA) {
+		return false;
+	}
+
+	releaseCurrent_mA = current_mA;
+	return true;
+}
+
+uint16_t sma_getReleaseCurrent_mA() {
+	return releaseCurrent_mA;
+}
+
+/**@brief Sets the fixed retract time, which is only used while the thermal
+ * model is disabled.  Times outside [RETRACT_TIME_MIN_MS, RETRACT_TIME_MAX_MS]
+ * are rejected.
+ */
+bool sma_setRetractTime_ms(uint32_t time_ms) {
+	if ((time_ms < RETRACT_TIME_MIN_MS) || (time_ms > RETRACT_TIME_MAX_MS)) {
 		return false;
 	}
 
@@ -144,12 +413,39 @@ uint16_t sma_getRetractTime_ms() {
 	return retractTime_ms;
 }
 
+/**@brief Sets the fixed recovery time, which is only used while the thermal
+ * model is disabled.  Times outside [RECOVERY_TIME_MIN_MS,
+ * RECOVERY_TIME_MAX_MS] are rejected.
+ */
+bool sma_setRecoveryTime_ms(uint32_t time_ms) {
+	if ((time_ms < RECOVERY_TIME_MIN_MS) || (time_ms > RECOVERY_TIME_MAX_MS)) {
+		return false;
+	}
+
+	recoveryTime_ms = time_ms;
+	return true;
+}
+
+uint16_t sma_getRecoveryTime_ms() {
+	return recoveryTime_ms;
+}
+
+/**@brief Enables or disables the thermal model.  While disabled, the SMA is
+ * driven for the fixed retract time and recovers for the fixed recovery time.
+ */
+void sma_setModelEnabled(bool enabled) {
+	modelEnabled = enabled;
+}
+
+bool sma_isModelEnabled() {
+	return modelEnabled;
+}
+
 smaState_t sma_getState(void) {
 	return smaState;
 }
 
 bool sma_retract(uint16_t hold_ms, app_sched_event_handler_t smaEventHandler){
-	uint32_t err_code;
 	motionPrimitive_t motionPrimitive;
 
 	if (hold_ms > HOLD_TIME_MAX_MS) {
@@ -171,7 +467,8 @@ bool sma_retract(uint16_t hold_ms, app_sched_event_handler_t smaEventHandler){
 		return true;
 	} if (smaState == SMA_STATE_RETRACTING) {
 		/* If the SMA is already retracting, we simply update the hold time and
-		 * the callback before returning. */
+		 * the callback before returning.  The hold timer is only started once
+		 * the retract time expires, so the new hold time takes effect then. */
 		holdTime_ms = hold_ms;
 		eventHandler = smaEventHandler;
 		return true;
@@ -184,33 +481,49 @@ bool sma_retract(uint16_t hold_ms, app_sched_event_handler_t smaEventHandler){
 	holdTime_ms = hold_ms;
 	eventHandler = smaEventHandler;
 
+	/* If the model is still tracking the wire as it cools after the last
+	 * actuation, the timer is running and must be stopped before it can be
+	 * restarted. */
+	if (modelSettling) {
+		app_timer_stop(sma_timerID);
+		modelSettling = false;
+	}
+
 	/* We take care of automatically initializing the SMA controller when a
 	 * caller attempts to use it. */
 	sma_init();
 
+	/* Measure the battery before the SMA loads it.  A wire which has settled
+	 * is at the ambient temperature; otherwise it is still warm from the last
+	 * actuation, and the model carries on from where it was.  Without a known
+	 * ambient temperature, the model has assumed a hot module while the wire
+	 * cooled, so it cannot be relied upon to shorten the heating time and is
+	 * started again from a cold wire. */
+	modelBattery_mV = power_getBatteryPackVoltage_mV();
+	if (modelSettled || !thermal_isValid()) {
+		smamodel_reset(&model, sma_getModelAmbient_tenthDegC(true));
+		app_timer_cnt_get(&modelTime_rtcTicks);
+		modelSettled = false;
+	} else {
+		sma_updateModel();
+	}
+
 	/* Supply power to the SMA circuitry */
 	power_setVBATSWState(VBATSW_USER_SMA, true);
 
-	/* Calculate the PWM on-times while both retracting and holding the SMA */
-	retractPWMOnTime_ms = (retractCurrent_mA * TIMER_PERIOD_MS) / MAX_CURRENT_MA;
-	retractPWMOffTime_ms = TIMER_PERIOD_MS - retractPWMOnTime_ms;
-
-	holdPWMOnTime_ms = (holdCurrent_mA * TIMER_PERIOD_MS) / MAX_CURRENT_MA;
-	holdPWMOffTime_ms = TIMER_PERIOD_MS - holdPWMOnTime_ms;
-
 	smaState = SMA_STATE_RETRACTING;
+	actuations++;
 
 	/* Record the time at which we start retracting the SMA */
 	app_timer_cnt_get(&retractStartTime_rtcTicks);
 
-	/* Start the timer which for the on-portion of the PWM period.  When it
-	 * expired, we will turn the SMA off. */
-	err_code = app_timer_start(sma_timerID,
-			APP_TIMER_TICKS(retractPWMOnTime_ms, APP_TIMER_PRESCALER), NULL);
-	APP_ERROR_CHECK(err_code);
+	/* The timer next expires when the SMA has finished retracting and should
+	 * switch to the holding duty cycle. */
+	activeRetractTime_ms = sma_planRetractTime_ms();
+	sma_startTimer(activeRetractTime_ms);
 
 	/* Turn the SMA on */
-	nrf_gpio_pin_set(SMAPWM_PIN_NO);
+	sma_setDriveCurrent_mA(retractCurrent_mA);
 
 	return true;
 }
@@ -220,12 +533,15 @@ uint16_t sma_getHoldTimeRemaining_ms() {
 	uint32_t elapsedTime_ms;
 
 	app_timer_cnt_get(&rtcTicks);
-	elapsedTime_ms = ((0x00FFFFFF & (rtcTicks - retractStartTime_rtcTicks)) * USEC_PER_APP_TIMER_TICK) / 1000;
+	elapsedTime_ms = ((0x00FFFFFF & (rtcTicks - retractStartTime_rtcTicks)) * (uint64_t)USEC_PER_APP_TIMER_TICK) / 1000;
 
 	if (smaState == SMA_STATE_RETRACTING) {
 		return holdTime_ms;
 	} else if (smaState == SMA_STATE_HOLDING) {
-		return holdTime_ms - (elapsedTime_ms - retractTime_ms);
+		if (elapsedTime_ms >= activeRetractTime_ms + holdTime_ms) {
+			return 0;
+		}
+		return holdTime_ms - (elapsedTime_ms - activeRetractTime_ms);
 	} else {
 		return 0;
 	}
@@ -254,6 +570,10 @@ bool sma_extend(app_sched_event_handler_t smaEventHandler) {
 
 	/* If we reach this point, the SMA must have been retracting or holding. */
 
+	/* Bring the model up to date before the state changes, since the state
+	 * determines the assumptions the model makes. */
+	sma_updateModel();
+
 	/* Update our state to reflect that we are now allowing the SMA to
 	 * recover/extend. */
 	smaState = SMA_STATE_EXTENDING;
@@ -263,121 +583,98 @@ bool sma_extend(app_sched_event_handler_t smaEventHandler) {
 	err_code = app_timer_stop(sma_timerID);
 	APP_ERROR_CHECK(err_code);
 
+	/* Reduce the SMA current to the release current (normally 0) thereby
+	 * allowing the SMA to cool down and extend to its resting length. */
+	sma_setDriveCurrent_mA(releaseCurrent_mA);
 
-	/* Re-start the timer after configuring it to expire after the SMA's
-	 * recovery time. */
-	err_code = app_timer_start(sma_timerID,
-			APP_TIMER_TICKS(RECOVERY_TIME_MS, APP_TIMER_PRESCALER), NULL);
-	APP_ERROR_CHECK(err_code);
-
-	/* Disable the SMA controller thereby allowing the SMA to cool down and
-	 * extend to its resting length. */
-	nrf_gpio_pin_clear(SMAPWM_PIN_NO);
+	/* Re-start the timer after configuring it to expire once the model
+	 * predicts that the wire has cooled. */
+	activeRecoveryTime_ms = sma_planRecoveryTime_ms();
+	sma_startTimer(activeRecoveryTime_ms);
 
 	return true;
 }
 
+void sma_getStatus(smaStatus_t *p_status) {
+	p_status->state = smaState;
+	p_status->driveCurrent_mA = driveCurrent_mA;
+	p_status->onPeriod = pwm_getOnPeriod(SMA_PWM_CHNL);
+	p_status->period = pwm_getPeriod();
+	p_status->holdTimeRemaining_ms = sma_getHoldTimeRemaining_ms();
+	p_status->actuations = actuations;
+	p_status->timerWakeups = timerWakeups;
+
+	sma_updateModel();
+	p_status->modelEnabled = modelEnabled;
+	p_status->modelSettled = modelSettled;
+	p_status->wireTemp_tenthDegC = modelSettled ?
+			sma_getModelAmbient_tenthDegC(false) : smamodel_getTemp_tenthDegC(&model);
+	p_status->retractTime_ms = activeRetractTime_ms;
+	p_status->recoveryTime_ms = activeRecoveryTime_ms;
+	p_status->modelClamps = modelClamps;
+}
+
+void sma_clearStats() {
+	actuations = 0;
+	timerWakeups = 0;
+	modelClamps = 0;
+}
+
+/**@brief Called once at the end of each phase of an actuation: when the retract
+ * time expires, when the hold time expires, when the recovery time expires,
+ * and once more when the thermal model has settled.  The PWM waveform in
+ * between is generated entirely in hardware, so a complete actuation costs
+ * only these four wake-ups.
+ */
 void sma_timerHandler(void *p_context) {
 	UNUSED_PARAMETER(p_context);
 
-	uint32_t err_code;
-	uint32_t rtcTicks;
-	uint32_t elapsedTime_ms;
-	uint32_t pwmOnTime_ms, pwmOffTime_ms;
 	motionPrimitive_t motionPrimitive;
 
-	/* Calculate the time in milliseconds (by dividing RTC ticks by 32.378)
-	 * since we began retracting the SMA. We mask the high-order byte of the
-	 * subtraction result because app_timer_cnt_get only returns a 24-bit
-	 * result. */
-	app_timer_cnt_get(&rtcTicks);
-	elapsedTime_ms = ((0x00FFFFFF & (rtcTicks - retractStartTime_rtcTicks)) * USEC_PER_APP_TIMER_TICK) / 1000;
-
-
-	if ((smaState == SMA_STATE_RETRACTING) || (smaState == SMA_STATE_HOLDING)) {
-		if (elapsedTime_ms >= retractTime_ms + holdTime_ms) {
-			/* If we were holding but now the hold time has expired, we
-			 * update our state and then queue an event that will be processed
-			 * by the app_sched_execute() function in main() loop. */
-			if (smaState == SMA_STATE_HOLDING) {
-				smaState = SMA_STATE_EXTENDING;
-				if (eventHandler != NULL) {
-					motionPrimitive = MOTION_PRIMITIVE_SMA_EXTENDING;
-					app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
-				}
-			}
-
-			/* Restart the timer so that it will expire after the recovery
-			 * period. */
-			err_code = app_timer_start(sma_timerID,
-					APP_TIMER_TICKS(RECOVERY_TIME_MS, APP_TIMER_PRESCALER), NULL);
-			APP_ERROR_CHECK(err_code);
-
-			/* Stop driving current through the SMA */
-			nrf_gpio_pin_clear(SMAPWM_PIN_NO);
-			return;
-		} else if (elapsedTime_ms > retractTime_ms) {
-			/* If we were retracting but now the retract time has expired, we
-			 * update our state and then queue an event that will be processed
-			 * by the app_sched_execute() function in main() loop. */
-			if (smaState == SMA_STATE_RETRACTING) {
-				smaState = SMA_STATE_HOLDING;
-				if (eventHandler != NULL) {
-					motionPrimitive = MOTION_PRIMITIVE_SMA_RETRACTED;
-					app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
-				}
-			}
-
-			/* Switch to using the holding duty cycle to PWM the SMA */
-			pwmOnTime_ms = holdPWMOnTime_ms;
-			pwmOffTime_ms = holdPWMOffTime_ms;
-		} else {
-			/* If are still retracting, continue to use the retracting duty
-			 * cycle to PWM the SMA. */
-			pwmOnTime_ms = retractPWMOnTime_ms;
-			pwmOffTime_ms = retractPWMOffTime_ms;
+	timerWakeups++;
+
+	/* Bring the model up to date before the state changes */
+	sma_updateModel();
+
+	if (smaState == SMA_STATE_RETRACTING) {
+		/* The retract time has expired, so we update our state and then queue
+		 * an event that will be processed by the app_sched_execute() function
+		 * in main() loop. */
+		smaState = SMA_STATE_HOLDING;
+		if (eventHandler != NULL) {
+			motionPrimitive = MOTION_PRIMITIVE_SMA_RETRACTED;
+			app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
 		}
 
-		/* If we reach this point, we know that we need to continue, PWM-ing
-		 * the SMA. */
-
-		if (nrf_gpio_pin_read(SMAPWM_PIN_NO)) {
-			/* If the PWM output is currently high, we just finished the on-
-			 * interval, so now we need to disable the SMA driver for the
-			 * remainder of this period. */
-			if (pwmOffTime_ms > 0) {
-				/* If the PWM duty cycle is not 100%, we set the PWM timer to
-				 * expire after the off-interval. */
-				err_code = app_timer_start(sma_timerID,
-						APP_TIMER_TICKS(pwmOffTime_ms, APP_TIMER_PRESCALER), NULL);
-				APP_ERROR_CHECK(err_code);
-
-				/* Finally, we turn off the SMA controller */
-				nrf_gpio_pin_clear(SMAPWM_PIN_NO);
-			} else {
-				/* Otherwise, the PWM duty cycle is 100%, so we restart the
-				 * timer with the same on-time as the interval that just
-				 * expired (which is the same as the overall PWM period) and
-				 * we leave the SMA on. */
-				err_code = app_timer_start(sma_timerID,
-						APP_TIMER_TICKS(pwmOnTime_ms, APP_TIMER_PRESCALER), NULL);
-				APP_ERROR_CHECK(err_code);
-			}
-		} else {
-			/* If the SMA is currently off, we are starting a new PWM
-			 * period so we need to turn the SMA on for the calculated
-			 * on-interval. */
-			err_code = app_timer_start(sma_timerID,
-					APP_TIMER_TICKS(pwmOnTime_ms, APP_TIMER_PRESCALER), NULL);
-			APP_ERROR_CHECK(err_code);
-
-			nrf_gpio_pin_set(SMAPWM_PIN_NO);
+		/* Switch to using the holding duty cycle to PWM the SMA until the
+		 * hold time expires. */
+		sma_setDriveCurrent_mA(sma_getHoldDriveCurrent_mA());
+		sma_startTimer(holdTime_ms);
+	} else if (smaState == SMA_STATE_HOLDING) {
+		/* The hold time has expired, so we update our state and then queue an
+		 * event that will be processed by the app_sched_execute() function in
+		 * main() loop. */
+		smaState = SMA_STATE_EXTENDING;
+		if (eventHandler != NULL) {
+			motionPrimitive = MOTION_PRIMITIVE_SMA_EXTENDING;
+			app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), eventHandler);
 		}
+
+		/* Drop to the release current and restart the timer so that it will
+		 * expire after the recovery period. */
+		sma_setDriveCurrent_mA(releaseCurrent_mA);
+		activeRecoveryTime_ms = sma_planRecoveryTime_ms();
+		sma_startTimer(activeRecoveryTime_ms);
+	} else if ((smaState == SMA_STATE_EXTENDED) && modelSettling) {
+		/* The wire has cooled to the ambient temperature, so the model need
+		 * not track it any longer. */
+		modelSettling = false;
+		modelSettled = true;
+		sma_deinit();
 	} else if (smaState == SMA_STATE_EXTENDING) {
-		/* When setting the SMA state to EXTENDING above, we configured the
-		 * timer to expire when the recovery time had elapsed.  Presumably,
-		 * that has brought us here, which means that the SMA is fully
-		 * extended. Since the SMA is already off, all we need to do is to
+		/* When setting the SMA state to EXTENDING, we configured the timer to
+		 * expire when the recovery time had elapsed.  Presumably, that has
+		 * brought us here, which means that the SMA is fully extended, so we
 		 * update the state of the controller. */
 		smaState = SMA_STATE_EXTENDED;
 		/* Just to be safe, we also stop the timer. */
@@ -389,8 +686,13 @@ void sma_timerHandler(void *p_context) {
 
 		/* Now that the SMA has completely extended, we disable the SMA
 		 * controller.  It will automatically be re-initializing the next
-		 * time the sma_retract() function is called.  */
-		sma_deinit();
+		 * time the sma_retract() function is called.  The wire may still be
+		 * warmer than its surroundings, though, so first the timer is used
+		 * once more to tell when the model has settled.  Until then, a new
+		 * actuation starts from the model's estimate of the wire
+		 * temperature. */
+		sma_setDriveCurrent_mA(0);
+		sma_startSettling();
 
 		/* If the caller has setup a callback to be executed once the SMA is
 		 * fully extended, we execute it here. */
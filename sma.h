@@ -20,13 +20,41 @@ typedef enum {
 	SMA_STATE_EXTENDING
 } smaState_t;
 
+typedef struct {
+	smaState_t state;
+	/* Average current presently driven through the SMA, and the hardware PWM
+	 * on-period and period (in TIMER2 counts) which produce it */
+	uint16_t driveCurrent_mA;
+	uint16_t onPeriod;
+	uint16_t period;
+	uint16_t holdTimeRemaining_ms;
+	uint16_t actuations;
+	/* Number of times the SMA timer has woken the CPU */
+	uint16_t timerWakeups;
+	/* Thermal model of the wire: its estimated temperature, the retract and
+	 * recovery times chosen for the last actuation, and the number of times
+	 * a time or the hold current was limited by a safety clamp */
+	bool modelEnabled;
+	bool modelSettled;
+	int16_t wireTemp_tenthDegC;
+	uint16_t retractTime_ms;
+	uint16_t recoveryTime_ms;
+	uint16_t modelClamps;
+} smaStatus_t;
+
 
 bool sma_setRetractCurrent_mA(uint16_t current_mA);
 uint16_t sma_getRetractCurrent_mA(void);
 bool sma_setHoldCurrent_mA(uint16_t current_mA);
 uint16_t sma_getHoldCurrent_mA(void);
-bool sma_setRetractTime_ms(uint16_t time_ms);
+bool sma_setReleaseCurrent_mA(uint16_t current_mA);
+uint16_t sma_getReleaseCurrent_mA(void);
+bool sma_setRetractTime_ms(uint32_t time_ms);
 uint16_t sma_getRetractTime_ms(void);
+bool sma_setRecoveryTime_ms(uint32_t time_ms);
+uint16_t sma_getRecoveryTime_ms(void);
+void sma_setModelEnabled(bool enabled);
+bool sma_isModelEnabled(void);
 
 smaState_t sma_getState(void);
 
@@ -34,5 +62,8 @@ bool sma_retract(uint16_t holdTime_ms, app_sched_event_handler_t smaEventHandler
 uint16_t sma_getHoldTimeRemaining_ms(void);
 bool sma_extend(app_sched_event_handler_t smaEventHandler);
 
+void sma_getStatus(smaStatus_t *p_status);
+void sma_clearStats(void);
+
 
 #endif /* SMA_H_ */
@@ -0,0 +1,135 @@
+/*
+ * smamodel.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "smamodel.h"
+
+static int32_t smamodel_getSteadyState_mDegC(uint16_t duty_permille, uint16_t battery_mV,
+	int16_t ambient_tenthDegC);
+static void smamodel_step(int32_t *p_temp_mDegC, int32_t steadyState_mDegC, uint32_t step_ms);
+
+/* This module has no dependencies on the hardware so that it can be built and
+ * tested on a host against a simulated wire. */
+
+void smamodel_reset(smaModel_t *p_model, int16_t ambient_tenthDegC) {
+    p_model->temp_mDegC = 100 * (int32_t)ambient_tenthDegC;
+}
+
+/**@brief Advances the model by elapsed_ms during which the wire was driven with
+ * the given duty cycle (0 to 1000).
+ */
+void smamodel_advance(smaModel_t *p_model, uint32_t elapsed_ms, uint16_t duty_permille,
+	uint16_t battery_mV, int16_t ambient_tenthDegC) {
+    int32_t steadyState_mDegC;
+    uint32_t step_ms;
+
+    steadyState_mDegC = smamodel_getSteadyState_mDegC(duty_permille, battery_mV, ambient_tenthDegC);
+
+    /* After ten time constants, the wire has settled to well within a
+     * thousandth of a degree, so there is no reason to keep integrating. */
+    if (elapsed_ms > 10 * SMAMODEL_TIME_CONSTANT_MS) {
+	p_model->temp_mDegC = steadyState_mDegC;
+	return;
+    }
+
+    while (elapsed_ms > 0) {
+	step_ms = (elapsed_ms < SMAMODEL_STEP_MS) ? elapsed_ms : SMAMODEL_STEP_MS;
+	smamodel_step(&p_model->temp_mDegC, steadyState_mDegC, step_ms);
+	elapsed_ms -= step_ms;
+    }
+}
+
+int16_t smamodel_getTemp_tenthDegC(const smaModel_t *p_model) {
+    return p_model->temp_mDegC / 100;
+}
+
+/**@brief Predicts how long the wire will take, from its present estimated
+ * temperature, to heat up to or cool down to the target temperature with the
+ * given drive.  Whether the wire heats or cools depends on the drive, not on
+ * the target: a wire which is already past the target in the direction it is
+ * heading reaches it at once.  Returns SMAMODEL_UNREACHABLE if that would take
+ * longer than maxTime_ms (or never happen).
+ */
+uint32_t smamodel_getTimeToReach_ms(const smaModel_t *p_model, int16_t target_tenthDegC,
+	uint16_t duty_permille, uint16_t battery_mV, int16_t ambient_tenthDegC, uint32_t maxTime_ms) {
+    int32_t temp_mDegC, target_mDegC, steadyState_mDegC;
+    bool heating;
+    uint32_t time_ms = 0;
+
+    temp_mDegC = p_model->temp_mDegC;
+    target_mDegC = 100 * (int32_t)target_tenthDegC;
+
+    steadyState_mDegC = smamodel_getSteadyState_mDegC(duty_permille, battery_mV, ambient_tenthDegC);
+    heating = (steadyState_mDegC > temp_mDegC);
+
+    if (heating ? (temp_mDegC >= target_mDegC) : (temp_mDegC <= target_mDegC)) {
+	return 0;
+    }
+
+    /* The temperature approaches the steady state exponentially, so it never
+     * reaches a target on the far side of the steady state. */
+    if (heating ? (steadyState_mDegC <= target_mDegC) : (steadyState_mDegC >= target_mDegC)) {
+	return SMAMODEL_UNREACHABLE;
+    }
+
+    while (heating ? (temp_mDegC < target_mDegC) : (temp_mDegC > target_mDegC)) {
+	if (time_ms >= maxTime_ms) {
+	    return SMAMODEL_UNREACHABLE;
+	}
+	smamodel_step(&temp_mDegC, steadyState_mDegC, SMAMODEL_STEP_MS);
+	time_ms += SMAMODEL_STEP_MS;
+    }
+
+    return time_ms;
+}
+
+/**@brief Returns the largest duty cycle (0 to 1000) at which the wire would
+ * settle no hotter than maxTemp_tenthDegC.
+ */
+uint16_t smamodel_getMaxDuty_permille(int16_t maxTemp_tenthDegC, uint16_t battery_mV,
+	int16_t ambient_tenthDegC) {
+    int32_t fullDriveRise_mDegC;
+    int32_t duty_permille;
+
+    if (maxTemp_tenthDegC <= ambient_tenthDegC) {
+	return 0;
+    }
+
+    fullDriveRise_mDegC = smamodel_getSteadyState_mDegC(1000, battery_mV, ambient_tenthDegC) -
+	    100 * (int32_t)ambient_tenthDegC;
+
+    duty_permille = (100 * (int32_t)(maxTemp_tenthDegC - ambient_tenthDegC)) / (fullDriveRise_mDegC / 1000);
+
+    return (duty_permille > 1000) ? 1000 : duty_permille;
+}
+
+int32_t smamodel_getSteadyState_mDegC(uint16_t duty_permille, uint16_t battery_mV,
+	int16_t ambient_tenthDegC) {
+    uint32_t voltageRatio_permille;
+    uint32_t power_permille;
+
+    if (duty_permille > 1000) {
+	duty_permille = 1000;
+    }
+
+    /* The heating power relative to 100% duty at the nominal battery
+     * voltage */
+    voltageRatio_permille = ((uint32_t)battery_mV * 1000) / SMAMODEL_NOMINAL_BATTERY_MV;
+    power_permille = (duty_permille * ((voltageRatio_permille * voltageRatio_permille) / 1000)) / 1000;
+
+    return 100 * (int32_t)ambient_tenthDegC +
+	    (int32_t)((SMAMODEL_FULL_DRIVE_RISE_TENTHDEGC * 100 / 1000) * power_permille);
+}
+
+/**@brief One explicit Euler step of dT/dt = (T_steadyState - T) / tau.  The
+ * step is short compared with the time constant, so the error is well under a
+ * degree over a full heating or cooling cycle.
+ */
+void smamodel_step(int32_t *p_temp_mDegC, int32_t steadyState_mDegC, uint32_t step_ms) {
+    *p_temp_mDegC += ((steadyState_mDegC - *p_temp_mDegC) * (int32_t)step_ms) / SMAMODEL_TIME_CONSTANT_MS;
+}
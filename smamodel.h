@@ -0,0 +1,52 @@
+/*
+ * smamodel.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef SMAMODEL_H_
+#define SMAMODEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Lumped thermal model of the SMA wire: a single heat capacity which is heated
+ * by the drive and cools towards the ambient temperature with the given time
+ * constant.  At 100% duty with the battery at its nominal voltage, the wire
+ * would settle SMAMODEL_FULL_DRIVE_RISE_TENTHDEGC above ambient.  The drive
+ * is pulse-width modulated, so the heating power is proportional to the duty
+ * cycle and to the square of the battery voltage. */
+#define SMAMODEL_TIME_CONSTANT_MS			1500
+#define SMAMODEL_FULL_DRIVE_RISE_TENTHDEGC	2000
+#define SMAMODEL_NOMINAL_BATTERY_MV			14800
+
+/* The wire has fully contracted once it is heated above its austenite finish
+ * temperature, and has returned to martensite (so that it can be stretched
+ * back out to its resting length) once it cools below its martensite finish
+ * temperature. */
+#define SMAMODEL_AUSTENITE_FINISH_TENTHDEGC		900
+#define SMAMODEL_MARTENSITE_FINISH_TENTHDEGC	550
+
+/* Integration step */
+#define SMAMODEL_STEP_MS					10
+
+/* Returned by smamodel_getTimeToReach_ms() when the target is not reached
+ * within the maximum time */
+#define SMAMODEL_UNREACHABLE				UINT32_MAX
+
+typedef struct {
+    /* Estimated wire temperature, in thousandths of a degree Celsius */
+    int32_t temp_mDegC;
+} smaModel_t;
+
+void smamodel_reset(smaModel_t *p_model, int16_t ambient_tenthDegC);
+void smamodel_advance(smaModel_t *p_model, uint32_t elapsed_ms, uint16_t duty_permille,
+	uint16_t battery_mV, int16_t ambient_tenthDegC);
+int16_t smamodel_getTemp_tenthDegC(const smaModel_t *p_model);
+
+uint32_t smamodel_getTimeToReach_ms(const smaModel_t *p_model, int16_t target_tenthDegC,
+	uint16_t duty_permille, uint16_t battery_mV, int16_t ambient_tenthDegC, uint32_t maxTime_ms);
+uint16_t smamodel_getMaxDuty_permille(int16_t maxTemp_tenthDegC, uint16_t battery_mV,
+	int16_t ambient_tenthDegC);
+
+#endif /* SMAMODEL_H_ */
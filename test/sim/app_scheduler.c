@@ -0,0 +1,89 @@
+/*
+ * app_scheduler.c
+ *
+ * Host implementation of the scheduler with a queue of fixed size, like the
+ * SDK's, which records how deep the queue became.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "app_scheduler.h"
+
+#include "simtimer.h"
+
+#define SIMSCHED_MAX_QUEUE_SIZE		64
+#define SIMSCHED_MAX_EVENT_DATA_SIZE	32
+
+typedef struct {
+    app_sched_event_handler_t handler;
+    uint16_t size;
+    uint8_t data[SIMSCHED_MAX_EVENT_DATA_SIZE];
+} simEvent_t;
+
+static simEvent_t queue[SIMSCHED_MAX_QUEUE_SIZE];
+static uint8_t queueSize = SIMSCHED_MAX_QUEUE_SIZE;
+static uint8_t head = 0;
+static uint8_t count = 0;
+static uint8_t maxDepth = 0;
+static uint32_t eventCount = 0;
+
+void simsched_setQueueSize(uint8_t size) {
+    queueSize = (size > SIMSCHED_MAX_QUEUE_SIZE) ? SIMSCHED_MAX_QUEUE_SIZE : size;
+    head = 0;
+    count = 0;
+    maxDepth = 0;
+    eventCount = 0;
+}
+
+uint8_t simsched_getMaxDepth() {
+    return maxDepth;
+}
+
+uint32_t simsched_getEventCount() {
+    return eventCount;
+}
+
+uint32_t app_sched_event_put(void *p_event_data, uint16_t event_size, app_sched_event_handler_t handler) {
+    simEvent_t *p_event;
+
+    if (event_size > SIMSCHED_MAX_EVENT_DATA_SIZE) {
+	return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    if (count >= queueSize) {
+	return NRF_ERROR_NO_MEM;
+    }
+
+    p_event = &queue[(head + count) % SIMSCHED_MAX_QUEUE_SIZE];
+    p_event->handler = handler;
+    p_event->size = event_size;
+    if (event_size > 0) {
+	memcpy(p_event->data, p_event_data, event_size);
+    }
+
+    count++;
+    eventCount++;
+    if (count > maxDepth) {
+	maxDepth = count;
+    }
+
+    return NRF_SUCCESS;
+}
+
+void app_sched_execute() {
+    simEvent_t event;
+
+    while (count > 0) {
+	event = queue[head];
+	head = (head + 1) % SIMSCHED_MAX_QUEUE_SIZE;
+	count--;
+
+	event.handler(event.data, event.size);
+    }
+}
+
+void simtimer_runScheduler() {
+    app_sched_execute();
+}
@@ -0,0 +1,193 @@
+/*
+ * app_timer.c
+ *
+ * Host implementation of the app_timer API on a simulated RTC.  Expired
+ * timers put their handlers on the scheduler queue, as they do on the modules
+ * (which initialize app_timer with the scheduler enabled).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_scheduler.h"
+
+#include "global.h"
+#include "simtimer.h"
+
+typedef struct {
+    bool allocated;
+    bool running;
+    app_timer_mode_t mode;
+    app_timer_timeout_handler_t handler;
+    uint32_t period_ticks;
+    uint64_t expiry_ticks;
+    void *p_context;
+} simTimer_t;
+
+static simTimer_t timers[APP_TIMER_MAX_TIMERS];
+static uint8_t timerCount = 0;
+static uint64_t now_ticks = 0;
+static simtimerAdvanceHandler_t advanceHandler = NULL;
+
+static void app_timer_timeoutEvent(void *p_event_data, uint16_t event_size);
+
+void simtimer_reset() {
+    memset(timers, 0, sizeof(timers));
+    timerCount = 0;
+    now_ticks = 0;
+}
+
+uint64_t simtimer_getTicks() {
+    return now_ticks;
+}
+
+uint8_t simtimer_getTimerCount() {
+    return timerCount;
+}
+
+bool simtimer_getNextExpiry(uint64_t *p_rtcTicks) {
+    bool found = false;
+    uint8_t i;
+
+    for (i = 0; i < timerCount; i++) {
+	if (timers[i].running && (!found || (timers[i].expiry_ticks < *p_rtcTicks))) {
+	    *p_rtcTicks = timers[i].expiry_ticks;
+	    found = true;
+	}
+    }
+
+    return found;
+}
+
+void simtimer_setAdvanceHandler(simtimerAdvanceHandler_t handler) {
+    advanceHandler = handler;
+}
+
+void simtimer_advance(uint64_t rtcTicks) {
+    uint64_t expiry_ticks = 0;
+    simTimer_t *p_timer;
+    uint8_t i, next;
+
+    if (rtcTicks < now_ticks) {
+	return;
+    }
+
+    if (advanceHandler != NULL) {
+	advanceHandler(rtcTicks);
+    }
+
+    /* Timers expire in order, each at its own time. */
+    for (;;) {
+	next = timerCount;
+	for (i = 0; i < timerCount; i++) {
+	    if (timers[i].running && (timers[i].expiry_ticks <= rtcTicks) &&
+		    ((next == timerCount) || (timers[i].expiry_ticks < expiry_ticks))) {
+		next = i;
+		expiry_ticks = timers[i].expiry_ticks;
+	    }
+	}
+
+	if (next == timerCount) {
+	    break;
+	}
+
+	p_timer = &timers[next];
+	now_ticks = p_timer->expiry_ticks;
+
+	if (p_timer->mode == APP_TIMER_MODE_REPEATED) {
+	    p_timer->expiry_ticks += p_timer->period_ticks;
+	} else {
+	    p_timer->running = false;
+	}
+
+	/* As in the SDK, a full scheduler queue is a fatal error. */
+	APP_ERROR_CHECK(app_sched_event_put(&p_timer, sizeof(p_timer), app_timer_timeoutEvent));
+    }
+
+    now_ticks = rtcTicks;
+}
+
+void simtimer_run(uint64_t rtcTicks) {
+    simtimer_advance(rtcTicks);
+    simtimer_runScheduler();
+}
+
+void app_timer_timeoutEvent(void *p_event_data, uint16_t event_size) {
+    simTimer_t *p_timer = *(simTimer_t **)p_event_data;
+
+    p_timer->handler(p_timer->p_context);
+}
+
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler) {
+    if ((p_timer_id == NULL) || (timeout_handler == NULL)) {
+	return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (timerCount >= APP_TIMER_MAX_TIMERS) {
+	return NRF_ERROR_NO_MEM;
+    }
+
+    timers[timerCount].allocated = true;
+    timers[timerCount].running = false;
+    timers[timerCount].mode = mode;
+    timers[timerCount].handler = timeout_handler;
+    *p_timer_id = timerCount++;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context) {
+    simTimer_t *p_timer;
+
+    if ((timer_id >= timerCount) || (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS)) {
+	return NRF_ERROR_INVALID_PARAM;
+    }
+
+    p_timer = &timers[timer_id];
+
+    /* The SDK ignores a start of a timer that is already running. */
+    if (p_timer->running) {
+	return NRF_SUCCESS;
+    }
+
+    p_timer->running = true;
+    p_timer->expiry_ticks = now_ticks + timeout_ticks;
+    p_timer->period_ticks = timeout_ticks;
+    p_timer->p_context = p_context;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id) {
+    if (timer_id >= timerCount) {
+	return NRF_ERROR_INVALID_PARAM;
+    }
+
+    timers[timer_id].running = false;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop_all() {
+    uint8_t i;
+
+    for (i = 0; i < timerCount; i++) {
+	timers[i].running = false;
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(uint32_t *p_ticks) {
+    *p_ticks = (uint32_t)(now_ticks & 0x00FFFFFF);
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff) {
+    *p_ticks_diff = 0x00FFFFFF & (ticks_to - ticks_from);
+
+    return NRF_SUCCESS;
+}
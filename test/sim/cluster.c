@@ -0,0 +1,630 @@
+/*
+ * cluster.c
+ *
+ * See cluster.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+
+#include "cube.h"
+#include "cluster.h"
+
+#ifndef CUBE_SO
+#define CUBE_SO				"cube.so"
+#endif
+
+/* Faceboard buffer sizes */
+#define CLUSTER_FB_TX_BUFFER_SIZE	128
+#define CLUSTER_FB_RX_BUFFER_SIZE	128
+#define CLUSTER_FB_TX_PAD_BYTES		3
+
+/* The faceboard puts this padding ahead of every write, and sends it like
+ * any other byte. */
+#define CLUSTER_PAD			0xB7
+
+#define CLUSTER_RTC_USEC_PER_TICK	(1000000.0 * 10 / 32768)
+
+typedef struct {
+    int16_t peerCube;
+    uint8_t peerFace;
+
+    uint8_t tx[CLUSTER_FB_TX_BUFFER_SIZE];
+    uint8_t txHead;
+    uint8_t txCount;
+    uint64_t txStart_us;
+
+    bool inFlight;
+    uint8_t flightByte;
+    uint64_t flightStart_us;
+    uint64_t flightEnd_us;
+    uint64_t prevEnd_us;
+
+    uint8_t rx[CLUSTER_FB_RX_BUFFER_SIZE];
+    uint8_t rxHead;
+    uint8_t rxCount;
+    bool rxEnabled;
+
+    clusterLinkStats_t stats;
+} clusterFace_t;
+
+typedef struct {
+    void *handle;
+    const cubeApi_t *p_api;
+    uint16_t nodeID;
+    bool running;
+    double skew_ppm;
+    double offset_us;
+    int flashFd;
+    uint8_t *flash;
+    clusterFace_t faces[6];
+} clusterCube_t;
+
+static clusterConfig_t config;
+static cubeHost_t host;
+static clusterCube_t cubes[CLUSTER_MAX_CUBES];
+static uint8_t cubeCount = 0;
+static int residentCube = -1;
+static uint64_t now_us = 0;
+static unsigned int randState;
+
+static bool cluster_fbSend(uint8_t cube, uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes);
+static bool cluster_fbGetTxAvailable(uint8_t cube, uint8_t faceNum, uint8_t *p_count);
+static bool cluster_fbReceive(uint8_t cube, uint8_t faceNum, uint8_t numBytes, uint8_t *bytes);
+static bool cluster_fbGetRxCount(uint8_t cube, uint8_t faceNum, uint8_t *p_count);
+static bool cluster_fbFlushRx(uint8_t cube, uint8_t faceNum);
+static bool cluster_fbSetRxEnable(uint8_t cube, uint8_t faceNum, bool enable);
+static int16_t cluster_fbGetAmbientLight(uint8_t cube, uint8_t faceNum);
+static void cluster_print(uint8_t cube, const char *str);
+static void cluster_command(uint8_t cube, const char *cmd);
+
+static double cluster_random(void) {
+    return (double)rand_r(&randState) / ((double)RAND_MAX + 1.0);
+}
+
+void cluster_getDefaultConfig(clusterConfig_t *p_config) {
+    memset(p_config, 0, sizeof(*p_config));
+    p_config->irByte_us = 1000;
+    p_config->irJitter_us = 500;
+    p_config->byteErrorRate = 0.0;
+    p_config->flashOp_us = 25000;
+    p_config->step_us = 50;
+    p_config->seed = 1;
+}
+
+static bool cluster_loadCube(clusterCube_t *p_cube) {
+    char path[] = "/tmp/cubeXXXXXX.so";
+    const cubeApi_t *(*getApi)(void);
+    FILE *src, *dst;
+    char buf[4096];
+    size_t n;
+    int fd;
+
+    /* The dynamic loader only loads a library once, so each module gets a
+     * copy of it under a different name. */
+    fd = mkstemps(path, 3);
+    if (fd < 0) {
+	return false;
+    }
+
+    src = fopen(CUBE_SO, "rb");
+    dst = fdopen(fd, "wb");
+    if ((src == NULL) || (dst == NULL)) {
+	fprintf(stderr, "cannot copy %s\n", CUBE_SO);
+	return false;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), src)) > 0) {
+	fwrite(buf, 1, n, dst);
+    }
+    fclose(src);
+    fclose(dst);
+
+    p_cube->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    unlink(path);
+    if (p_cube->handle == NULL) {
+	fprintf(stderr, "%s\n", dlerror());
+	return false;
+    }
+
+    getApi = (const cubeApi_t *(*)(void))dlsym(p_cube->handle, "cube_getApi");
+    if (getApi == NULL) {
+	return false;
+    }
+    p_cube->p_api = getApi();
+
+    /* Each module's flash is a separate memory file, which is mapped at the
+     * flash's real address while the module runs. */
+    p_cube->flashFd = memfd_create("cubeflash", 0);
+    if ((p_cube->flashFd < 0) || (ftruncate(p_cube->flashFd, CUBE_FLASH_SIZE) != 0)) {
+	return false;
+    }
+    p_cube->flash = mmap(NULL, CUBE_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, p_cube->flashFd, 0);
+    if (p_cube->flash == MAP_FAILED) {
+	return false;
+    }
+    memset(p_cube->flash, 0xFF, CUBE_FLASH_SIZE);
+
+    return true;
+}
+
+bool cluster_create(uint8_t count, const uint16_t *nodeIDs, const clusterConfig_t *p_config) {
+    uint8_t i, f;
+
+    if ((count == 0) || (count > CLUSTER_MAX_CUBES)) {
+	return false;
+    }
+
+    config = *p_config;
+    randState = config.seed;
+    now_us = 0;
+    residentCube = -1;
+
+    host.fbSend = cluster_fbSend;
+    host.fbGetTxAvailable = cluster_fbGetTxAvailable;
+    host.fbReceive = cluster_fbReceive;
+    host.fbGetRxCount = cluster_fbGetRxCount;
+    host.fbFlushRx = cluster_fbFlushRx;
+    host.fbSetRxEnable = cluster_fbSetRxEnable;
+    host.fbGetAmbientLight = cluster_fbGetAmbientLight;
+    host.print = cluster_print;
+    host.command = cluster_command;
+    host.flashOp_us = config.flashOp_us;
+
+    /* The stack's pseudo-random numbers come from the C library, which all
+     * of the modules share. */
+    srand(config.seed);
+
+    for (i = 0; i < count; i++) {
+	memset(&cubes[i], 0, sizeof(cubes[i]));
+	if (!cluster_loadCube(&cubes[i])) {
+	    return false;
+	}
+
+	cubes[i].nodeID = (nodeIDs != NULL) ? nodeIDs[i] : (uint16_t)(0x1000 + 0x0101 * i);
+	for (f = 0; f < 6; f++) {
+	    cubes[i].faces[f].peerCube = -1;
+	}
+
+	cubeCount = i + 1;
+	cluster_select(i);
+	cubes[i].p_api->attach(&host, i, cubes[i].nodeID);
+    }
+
+    return true;
+}
+
+void cluster_destroy() {
+    uint8_t i;
+
+    for (i = 0; i < cubeCount; i++) {
+	dlclose(cubes[i].handle);
+	munmap(cubes[i].flash, CUBE_FLASH_SIZE);
+	close(cubes[i].flashFd);
+    }
+
+    munmap((void *)(uintptr_t)CUBE_FLASH_START, CUBE_FLASH_SIZE);
+    residentCube = -1;
+    cubeCount = 0;
+}
+
+uint8_t cluster_getCount() {
+    return cubeCount;
+}
+
+uint16_t cluster_getNodeID(uint8_t cube) {
+    return cubes[cube].nodeID;
+}
+
+void cluster_setClock(uint8_t cube, double skew_ppm, double offset_us) {
+    cubes[cube].skew_ppm = skew_ppm;
+    cubes[cube].offset_us = offset_us;
+}
+
+double cluster_getLocalTime_us(uint8_t cube) {
+    return (double)now_us * (1.0 + cubes[cube].skew_ppm * 1e-6) + cubes[cube].offset_us;
+}
+
+static uint64_t cluster_getLocalTicks(uint8_t cube) {
+    double local_us = cluster_getLocalTime_us(cube);
+
+    return (local_us <= 0.0) ? 0 : (uint64_t)(local_us / CLUSTER_RTC_USEC_PER_TICK);
+}
+
+bool cluster_connect(uint8_t cubeA, uint8_t faceA, uint8_t cubeB, uint8_t faceB) {
+    if ((cubeA >= cubeCount) || (cubeB >= cubeCount) || (faceA < 1) || (faceA > 6) || (faceB < 1) || (faceB > 6)) {
+	return false;
+    }
+
+    cubes[cubeA].faces[faceA-1].peerCube = cubeB;
+    cubes[cubeA].faces[faceA-1].peerFace = faceB;
+    cubes[cubeB].faces[faceB-1].peerCube = cubeA;
+    cubes[cubeB].faces[faceB-1].peerFace = faceA;
+
+    return true;
+}
+
+void cluster_disconnect(uint8_t cube, uint8_t faceNum) {
+    clusterFace_t *p_face = &cubes[cube].faces[faceNum-1];
+
+    if (p_face->peerCube >= 0) {
+	cubes[p_face->peerCube].faces[p_face->peerFace-1].peerCube = -1;
+	p_face->peerCube = -1;
+    }
+}
+
+bool cluster_getPeer(uint8_t cube, uint8_t faceNum, uint8_t *p_peerCube, uint8_t *p_peerFace) {
+    clusterFace_t *p_face = &cubes[cube].faces[faceNum-1];
+
+    if (p_face->peerCube < 0) {
+	return false;
+    }
+
+    *p_peerCube = p_face->peerCube;
+    *p_peerFace = p_face->peerFace;
+
+    return true;
+}
+
+/**@brief Connects the modules in a straight line along x, in index order. */
+void cluster_connectChain() {
+    uint8_t i;
+
+    for (i = 0; i + 1 < cubeCount; i++) {
+	cluster_connect(i, CLUSTER_FACE_POS_X, i + 1, CLUSTER_FACE_NEG_X);
+    }
+}
+
+/**@brief Connects the modules as an nx by ny by nz block, in which module
+ * x + nx * (y + ny * z) sits at (x, y, z).
+ */
+void cluster_connectGrid(uint8_t nx, uint8_t ny, uint8_t nz) {
+    uint8_t x, y, z, i;
+
+    for (z = 0; z < nz; z++) {
+	for (y = 0; y < ny; y++) {
+	    for (x = 0; x < nx; x++) {
+		i = x + nx * (y + ny * z);
+		if (x + 1 < nx) {
+		    cluster_connect(i, CLUSTER_FACE_POS_X, i + 1, CLUSTER_FACE_NEG_X);
+		}
+		if (y + 1 < ny) {
+		    cluster_connect(i, CLUSTER_FACE_POS_Y, i + nx, CLUSTER_FACE_NEG_Y);
+		}
+		if (z + 1 < nz) {
+		    cluster_connect(i, CLUSTER_FACE_POS_Z, i + nx * ny, CLUSTER_FACE_NEG_Z);
+		}
+	    }
+	}
+    }
+}
+
+/**@brief Makes the given module's flash resident and brings its clock up to
+ * the present, so that it can be called into.
+ */
+void cluster_select(uint8_t cube) {
+    clusterCube_t *p_cube = &cubes[cube];
+    uint64_t ticks;
+
+    if (residentCube != cube) {
+	if (mmap((void *)(uintptr_t)CUBE_FLASH_START, CUBE_FLASH_SIZE, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, p_cube->flashFd, 0) == MAP_FAILED) {
+	    perror("mmap");
+	    abort();
+	}
+	residentCube = cube;
+    }
+
+    if (p_cube->p_api != NULL) {
+	ticks = cluster_getLocalTicks(cube);
+	if (ticks > p_cube->p_api->getTicks()) {
+	    p_cube->p_api->run(ticks);
+	}
+    }
+}
+
+void *cluster_getSymbol(uint8_t cube, const char *name) {
+    void *p_sym = dlsym(cubes[cube].handle, name);
+
+    if (p_sym == NULL) {
+	fprintf(stderr, "cube.so has no symbol %s\n", name);
+	abort();
+    }
+
+    return p_sym;
+}
+
+uint8_t *cluster_getFlash(uint8_t cube) {
+    return cubes[cube].flash;
+}
+
+void cluster_start(uint8_t cube) {
+    cluster_select(cube);
+    cubes[cube].p_api->start();
+    cubes[cube].running = true;
+}
+
+void cluster_startAll() {
+    uint8_t i;
+
+    for (i = 0; i < cubeCount; i++) {
+	cluster_start(i);
+    }
+}
+
+void cluster_stop(uint8_t cube) {
+    cluster_select(cube);
+    cubes[cube].p_api->stop();
+    cubes[cube].running = false;
+}
+
+uint64_t cluster_getTime_us() {
+    return now_us;
+}
+
+/* IR links */
+
+static void cluster_deliver(clusterFace_t *p_face) {
+    clusterFace_t *p_peer;
+    uint8_t byte = p_face->flightByte;
+
+    p_face->stats.bytesSent++;
+
+    if (p_face->peerCube < 0) {
+	return;
+    }
+
+    p_peer = &cubes[p_face->peerCube].faces[p_face->peerFace-1];
+
+    if (!p_peer->rxEnabled || (p_peer->rxCount >= CLUSTER_FB_RX_BUFFER_SIZE)) {
+	p_peer->stats.bytesLost++;
+	return;
+    }
+
+    /* The receiver is blinded by its own transmissions. */
+    if ((p_peer->inFlight && (p_peer->flightStart_us < p_face->flightEnd_us)) ||
+	    (p_peer->prevEnd_us > p_face->flightStart_us)) {
+	byte |= 0x80;
+	p_peer->stats.bytesCollided++;
+    } else if ((config.byteErrorRate > 0.0) && (cluster_random() < config.byteErrorRate)) {
+	byte |= 0x80;
+	p_peer->stats.bytesCorrupted++;
+    }
+
+    p_peer->rx[(p_peer->rxHead + p_peer->rxCount) % CLUSTER_FB_RX_BUFFER_SIZE] = byte;
+    p_peer->rxCount++;
+    p_peer->stats.bytesReceived++;
+}
+
+static void cluster_stepLinks() {
+    clusterFace_t *p_face;
+    uint8_t i, f, value;
+
+    for (i = 0; i < cubeCount; i++) {
+	for (f = 0; f < 6; f++) {
+	    p_face = &cubes[i].faces[f];
+
+	    if (p_face->inFlight && (p_face->flightEnd_us <= now_us)) {
+		p_face->inFlight = false;
+		p_face->prevEnd_us = p_face->flightEnd_us;
+		cluster_deliver(p_face);
+	    }
+
+	    while (!p_face->inFlight && (p_face->txCount > 0) && (p_face->txStart_us <= now_us)) {
+		value = p_face->tx[p_face->txHead];
+		p_face->txHead = (p_face->txHead + 1) % CLUSTER_FB_TX_BUFFER_SIZE;
+		p_face->txCount--;
+
+		p_face->inFlight = true;
+		p_face->flightByte = value;
+		/* Bytes follow each other without a gap. */
+		p_face->flightStart_us = (p_face->prevEnd_us + config.step_us > now_us) ? p_face->prevEnd_us : now_us;
+		p_face->flightEnd_us = p_face->flightStart_us + config.irByte_us;
+	    }
+	}
+    }
+}
+
+static clusterFace_t *cluster_getFace(uint8_t cube, uint8_t faceNum) {
+    if ((cube >= cubeCount) || (faceNum < 1) || (faceNum > 6)) {
+	return NULL;
+    }
+
+    return &cubes[cube].faces[faceNum-1];
+}
+
+bool cluster_fbSend(uint8_t cube, uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes) {
+    clusterFace_t *p_face = cluster_getFace(cube, faceNum);
+    uint16_t i;
+
+    if ((p_face == NULL) || (numBytes + CLUSTER_FB_TX_PAD_BYTES > CLUSTER_FB_TX_BUFFER_SIZE - p_face->txCount)) {
+	return false;
+    }
+
+    if (!p_face->inFlight && (p_face->txCount == 0)) {
+	p_face->txStart_us = now_us + (config.irJitter_us ? (uint64_t)(cluster_random() * config.irJitter_us) : 0);
+    }
+
+    for (i = 0; i < CLUSTER_FB_TX_PAD_BYTES + numBytes; i++) {
+	p_face->tx[(p_face->txHead + p_face->txCount) % CLUSTER_FB_TX_BUFFER_SIZE] =
+		(i < CLUSTER_FB_TX_PAD_BYTES) ? CLUSTER_PAD : bytes[i - CLUSTER_FB_TX_PAD_BYTES];
+	p_face->txCount++;
+    }
+
+    return true;
+}
+
+bool cluster_fbGetTxAvailable(uint8_t cube, uint8_t faceNum, uint8_t *p_count) {
+    clusterFace_t *p_face = cluster_getFace(cube, faceNum);
+
+    if (p_face == NULL) {
+	return false;
+    }
+
+    *p_count = CLUSTER_FB_TX_BUFFER_SIZE - p_face->txCount;
+
+    return true;
+}
+
+bool cluster_fbReceive(uint8_t cube, uint8_t faceNum, uint8_t numBytes, uint8_t *bytes) {
+    clusterFace_t *p_face = cluster_getFace(cube, faceNum);
+    uint8_t i;
+
+    if ((p_face == NULL) || (numBytes > p_face->rxCount)) {
+	return false;
+    }
+
+    for (i = 0; i < numBytes; i++) {
+	bytes[i] = p_face->rx[p_face->rxHead];
+	p_face->rxHead = (p_face->rxHead + 1) % CLUSTER_FB_RX_BUFFER_SIZE;
+	p_face->rxCount--;
+    }
+
+    return true;
+}
+
+bool cluster_fbGetRxCount(uint8_t cube, uint8_t faceNum, uint8_t *p_count) {
+    clusterFace_t *p_face = cluster_getFace(cube, faceNum);
+
+    if (p_face == NULL) {
+	return false;
+    }
+
+    *p_count = p_face->rxCount;
+
+    return true;
+}
+
+bool cluster_fbFlushRx(uint8_t cube, uint8_t faceNum) {
+    uint8_t f;
+
+    for (f = 1; f <= 6; f++) {
+	if ((faceNum == 0) || (faceNum == f)) {
+	    cubes[cube].faces[f-1].rxCount = 0;
+	}
+    }
+
+    return (faceNum <= 6);
+}
+
+bool cluster_fbSetRxEnable(uint8_t cube, uint8_t faceNum, bool enable) {
+    uint8_t f;
+
+    for (f = 1; f <= 6; f++) {
+	if ((faceNum == 0) || (faceNum == f)) {
+	    cubes[cube].faces[f-1].rxEnabled = enable;
+	}
+    }
+
+    return (faceNum <= 6);
+}
+
+int16_t cluster_fbGetAmbientLight(uint8_t cube, uint8_t faceNum) {
+    return (config.ambientLight != NULL) ? config.ambientLight(cube, faceNum) : 0;
+}
+
+void cluster_print(uint8_t cube, const char *str) {
+    if (config.print != NULL) {
+	config.print(cube, str);
+    }
+}
+
+void cluster_command(uint8_t cube, const char *cmd) {
+    if (config.command != NULL) {
+	config.command(cube, cmd);
+    }
+}
+
+void cluster_getLinkStats(uint8_t cube, uint8_t faceNum, clusterLinkStats_t *p_stats) {
+    *p_stats = cubes[cube].faces[faceNum-1].stats;
+}
+
+void cluster_getTotalLinkStats(clusterLinkStats_t *p_stats) {
+    const clusterLinkStats_t *p_face;
+    uint8_t i, f;
+
+    memset(p_stats, 0, sizeof(*p_stats));
+
+    for (i = 0; i < cubeCount; i++) {
+	for (f = 0; f < 6; f++) {
+	    p_face = &cubes[i].faces[f].stats;
+	    p_stats->bytesSent += p_face->bytesSent;
+	    p_stats->bytesReceived += p_face->bytesReceived;
+	    p_stats->bytesCollided += p_face->bytesCollided;
+	    p_stats->bytesCorrupted += p_face->bytesCorrupted;
+	    p_stats->bytesLost += p_face->bytesLost;
+	}
+    }
+}
+
+void cluster_clearLinkStats() {
+    uint8_t i, f;
+
+    for (i = 0; i < cubeCount; i++) {
+	for (f = 0; f < 6; f++) {
+	    memset(&cubes[i].faces[f].stats, 0, sizeof(clusterLinkStats_t));
+	}
+    }
+}
+
+/* Time */
+
+static void cluster_step() {
+    clusterCube_t *p_cube;
+    uint64_t ticks, next_ticks;
+    uint8_t i;
+
+    now_us += config.step_us;
+
+    cluster_stepLinks();
+
+    for (i = 0; i < cubeCount; i++) {
+	p_cube = &cubes[i];
+	if (!p_cube->running) {
+	    continue;
+	}
+
+	/* A module which has stalled (e.g. in nrf_delay_ms()) has a clock that
+	 * is ahead of the simulation until the simulation catches up. */
+	ticks = cluster_getLocalTicks(i);
+	if ((ticks <= p_cube->p_api->getTicks()) || !p_cube->p_api->getNextEvent(&next_ticks) || (next_ticks > ticks)) {
+	    continue;
+	}
+
+	cluster_select(i);
+    }
+}
+
+void cluster_run_ms(uint32_t ms) {
+    uint64_t end_us = now_us + 1000 * (uint64_t)ms;
+
+    while (now_us < end_us) {
+	cluster_step();
+    }
+}
+
+/**@brief Runs the simulation until the condition holds (checked every
+ * simulated millisecond) or the timeout expires.
+ *
+ * @return Whether the condition was met.
+ */
+bool cluster_runUntil(bool (*condition)(void), uint32_t timeout_ms) {
+    uint32_t t_ms;
+
+    for (t_ms = 0; t_ms < timeout_ms; t_ms++) {
+	if (condition()) {
+	    return true;
+	}
+	cluster_run_ms(1);
+    }
+
+    return condition();
+}
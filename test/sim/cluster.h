@@ -0,0 +1,103 @@
+/*
+ * cluster.h
+ *
+ * Simulator of a cluster of modules running the real messaging stack (see
+ * cube.h), connected face to face by simulated IR links.
+ *
+ * Each link carries one byte at a time in each direction.  A byte which is
+ * received while the receiving face is itself transmitting is corrupted (its
+ * top bit is set, which the messaging layer detects), as is a random
+ * fraction of all bytes if an error rate is configured.  Every module has its
+ * own clock, which may run fast or slow and start at any offset.
+ */
+
+#ifndef CLUSTER_H_
+#define CLUSTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CLUSTER_MAX_CUBES		64
+
+/* Faces of a module in the +x, +y and +z directions, and the faces opposite
+ * them, following frameFaceNormals in imu.c */
+#define CLUSTER_FACE_POS_X		2
+#define CLUSTER_FACE_NEG_X		4
+#define CLUSTER_FACE_POS_Y		3
+#define CLUSTER_FACE_NEG_Y		5
+#define CLUSTER_FACE_POS_Z		1
+#define CLUSTER_FACE_NEG_Z		6
+
+typedef struct {
+    /* Time taken to send one byte over IR */
+    uint32_t irByte_us;
+    /* A faceboard starts transmitting data written to it while idle after a
+     * random delay of up to this long. */
+    uint32_t irJitter_us;
+    /* Probability that any byte is corrupted in transit */
+    double byteErrorRate;
+    /* Duration of flash erase and write operations */
+    uint32_t flashOp_us;
+    /* Resolution of the simulation */
+    uint32_t step_us;
+    /* Seed for all of the simulation's randomness */
+    unsigned int seed;
+    /* Ambient light seen by each face (NULL for constant darkness) */
+    int16_t (*ambientLight)(uint8_t cube, uint8_t faceNum);
+    /* Called with every string printed by a module (NULL to discard) */
+    void (*print)(uint8_t cube, const char *str);
+    /* Called when a module executes a command from its command table */
+    void (*command)(uint8_t cube, const char *cmd);
+} clusterConfig_t;
+
+typedef struct {
+    uint32_t bytesSent;
+    uint32_t bytesReceived;
+    /* Received bytes which were corrupted by a collision or a random error */
+    uint32_t bytesCollided;
+    uint32_t bytesCorrupted;
+    /* Bytes lost because the receive buffer was full or disabled */
+    uint32_t bytesLost;
+} clusterLinkStats_t;
+
+void cluster_getDefaultConfig(clusterConfig_t *p_config);
+
+bool cluster_create(uint8_t count, const uint16_t *nodeIDs, const clusterConfig_t *p_config);
+void cluster_destroy(void);
+
+uint8_t cluster_getCount(void);
+uint16_t cluster_getNodeID(uint8_t cube);
+
+void cluster_setClock(uint8_t cube, double skew_ppm, double offset_us);
+double cluster_getLocalTime_us(uint8_t cube);
+
+bool cluster_connect(uint8_t cubeA, uint8_t faceA, uint8_t cubeB, uint8_t faceB);
+void cluster_disconnect(uint8_t cube, uint8_t faceNum);
+bool cluster_getPeer(uint8_t cube, uint8_t faceNum, uint8_t *p_peerCube, uint8_t *p_peerFace);
+void cluster_connectChain(void);
+void cluster_connectGrid(uint8_t nx, uint8_t ny, uint8_t nz);
+
+void cluster_start(uint8_t cube);
+void cluster_startAll(void);
+void cluster_stop(uint8_t cube);
+
+void cluster_run_ms(uint32_t ms);
+bool cluster_runUntil(bool (*condition)(void), uint32_t timeout_ms);
+uint64_t cluster_getTime_us(void);
+
+/* Calls into a module.  Everything the module does as a result happens at
+ * the current simulation time. */
+void *cluster_getSymbol(uint8_t cube, const char *name);
+void cluster_select(uint8_t cube);
+
+uint8_t *cluster_getFlash(uint8_t cube);
+
+void cluster_getLinkStats(uint8_t cube, uint8_t faceNum, clusterLinkStats_t *p_stats);
+void cluster_getTotalLinkStats(clusterLinkStats_t *p_stats);
+void cluster_clearLinkStats(void);
+
+/* Calls a function of a module's stack by name, with the module selected */
+#define CLUSTER_CALL(cube, type, name, ...)					\
+    (cluster_select(cube), ((type)cluster_getSymbol((cube), #name))(__VA_ARGS__))
+
+#endif /* CLUSTER_H_ */
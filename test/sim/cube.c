@@ -0,0 +1,336 @@
+/*
+ * cube.c
+ *
+ * The hardware of one simulated module, built into cube.so together with the
+ * real messaging stack.  Faceboard accesses are passed to the cluster
+ * simulator, while the clock, scheduler, console and flash are simulated
+ * here, so that every loaded copy of cube.so is an independent module.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrf.h"
+#include "nrf_soc.h"
+#include "nrf_sdm.h"
+#include "nrf_delay.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "util.h"
+#include "fb.h"
+#include "imu.h"
+#include "mpu6050.h"
+#include "cmdline.h"
+#include "irtx.h"
+#include "message.h"
+#include "irdfu.h"
+
+#include "simtimer.h"
+#include "cube.h"
+
+/* The running image, whose end irdfu.c takes from the linker's symbols, is
+ * 8 kB long.  The symbols are defined here rather than with --defsym, which
+ * has ld relocate some of them by the load address of cube.so and not
+ * others. */
+__asm__(".globl __etext\n.set __etext, 0x00021F00\n"
+	".globl __data_start__\n.set __data_start__, 0x20002000\n"
+	".globl __data_end__\n.set __data_end__, 0x20002100\n");
+
+NRF_NVMC_Type sim_NVMC = {1, 0, 0, 0};
+NRF_FICR_Type sim_FICR;
+SCB_Type sim_SCB;
+
+static const cubeHost_t *p_host;
+static uint8_t self;
+static uint16_t nodeID;
+
+static char *captureBuf = NULL;
+static uint16_t captureBufSize;
+static uint16_t captureLen;
+static bool captureOverflowed;
+
+static uint8_t mpuAddress = MPU6050_I2C_ADDR_CENTRAL;
+
+static bool flashBusy = false;
+static bool flashFailed;
+static uint64_t flashDone_ticks;
+
+static void cmdMark(const char *args);
+static void cmdEcho(const char *args);
+
+static const cmdFcnPair_t cmdTable[] = {
+    {"mark", cmdMark},
+    {"echo", cmdEcho},
+    {"", NULL}
+};
+
+static void cube_attach(const cubeHost_t *p_cubeHost, uint8_t index, uint16_t id) {
+    p_host = p_cubeHost;
+    self = index;
+    nodeID = id;
+    sim_FICR.DEVICEADDR[0] = id;
+
+    simtimer_reset();
+    simsched_setQueueSize(64);
+    cmdline_loadCmds(cmdTable);
+}
+
+static void cube_start() {
+    irtx_init();
+    message_init();
+}
+
+static void cube_stop() {
+    message_deinit();
+    irtx_deinit();
+}
+
+static void cube_run(uint64_t rtcTicks) {
+    simtimer_advance(rtcTicks);
+
+    if (flashBusy && (flashDone_ticks <= rtcTicks)) {
+	flashBusy = false;
+	irdfu_onSysEvt(flashFailed ? NRF_EVT_FLASH_OPERATION_ERROR : NRF_EVT_FLASH_OPERATION_SUCCESS);
+    }
+
+    simtimer_runScheduler();
+}
+
+static bool cube_getNextEvent(uint64_t *p_rtcTicks) {
+    bool found;
+
+    found = simtimer_getNextExpiry(p_rtcTicks);
+    if (flashBusy && (!found || (flashDone_ticks < *p_rtcTicks))) {
+	*p_rtcTicks = flashDone_ticks;
+	found = true;
+    }
+
+    return found;
+}
+
+const cubeApi_t *cube_getApi(void);
+
+const cubeApi_t *cube_getApi() {
+    static const cubeApi_t api = {
+	cube_attach,
+	cube_start,
+	cube_stop,
+	cube_run,
+	simtimer_getTicks,
+	cube_getNextEvent
+    };
+
+    return &api;
+}
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+    fprintf(stderr, "cube %u (%04x): error %lu at %s:%lu\n", self, nodeID,
+	    (unsigned long)error_code, (const char *)p_file_name, (unsigned long)line_num);
+    abort();
+}
+
+/* Console */
+
+uint32_t app_uart_put_string(const char *str) {
+    uint32_t i = 0;
+
+    if (captureBuf != NULL) {
+	while (str[i] != '\0') {
+	    if (captureLen + 1 >= captureBufSize) {
+		captureOverflowed = true;
+		break;
+	    }
+	    captureBuf[captureLen++] = str[i++];
+	}
+	captureBuf[captureLen] = '\0';
+	return NRF_SUCCESS;
+    }
+
+    p_host->print(self, str);
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_uart_put_debug(const char *str, bool debug) {
+    return debug ? app_uart_put_string(str) : NRF_SUCCESS;
+}
+
+bool app_uart_capture_start(char *buf, uint16_t bufSize) {
+    if ((captureBuf != NULL) || (buf == NULL) || (bufSize == 0)) {
+	return false;
+    }
+
+    captureBufSize = bufSize;
+    captureLen = 0;
+    captureOverflowed = false;
+    buf[0] = '\0';
+    captureBuf = buf;
+
+    return true;
+}
+
+uint16_t app_uart_capture_stop(bool *p_overflowed) {
+    if (p_overflowed != NULL) {
+	*p_overflowed = captureOverflowed;
+    }
+
+    captureBuf = NULL;
+
+    return captureLen;
+}
+
+void cmdMark(const char *args) {
+    p_host->command(self, "mark");
+}
+
+void cmdEcho(const char *args) {
+    app_uart_put_string(args);
+}
+
+/* Time */
+
+uint32_t curr_time() {
+    return (uint32_t)(simtimer_getTicks() & 0x00FFFFFF);
+}
+
+uint32_t curr_time_ms() {
+    return (uint32_t)((simtimer_getTicks() * (APP_TIMER_PRESCALER + 1) * 1000) / APP_TIMER_CLOCK_FREQ);
+}
+
+bool delay_ms(uint32_t ms) {
+    nrf_delay_ms(ms);
+    return true;
+}
+
+void nrf_delay_us(uint32_t volatile number_of_us) {
+    /* The RTC keeps running, and its interrupt keeps queueing timer events,
+     * while the module is busy waiting. */
+    simtimer_advance(simtimer_getTicks() + (uint64_t)(number_of_us / SIM_USEC_PER_TICK + 0.5));
+}
+
+void nrf_delay_ms(uint32_t volatile number_of_ms) {
+    nrf_delay_us(1000 * number_of_ms);
+}
+
+uint16_t getNodeID() {
+    return nodeID;
+}
+
+void MACaddress(char *addr) {
+    sprintf(addr, "00000000%04x", nodeID);
+}
+
+/* Orientation: every module stands upright. */
+
+bool mpu6050_setAddress(uint8_t address) {
+    mpuAddress = address;
+    return true;
+}
+
+uint8_t mpu6050_getAddress() {
+    return mpuAddress;
+}
+
+bool imu_getGravityFloat(vectorFloat_t *vf) {
+    vf->x = 0.0f;
+    vf->y = 0.0f;
+    vf->z = 1.0f;
+    return true;
+}
+
+/* Faceboards */
+
+bool fb_sendToTxBuffer(uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes) {
+    return p_host->fbSend(self, faceNum, numBytes, bytes);
+}
+
+bool fb_getTxBufferAvailableCount(uint8_t faceNum, uint8_t *bytesAvailable) {
+    return p_host->fbGetTxAvailable(self, faceNum, bytesAvailable);
+}
+
+bool fb_setIRTxLEDs(uint8_t faceNum, bool led1, bool led2, bool led3, bool led4) {
+    return (faceNum <= 6);
+}
+
+bool fb_receiveFromRxBuffer(uint8_t faceNum, uint8_t numBytes, uint8_t *bytes) {
+    return p_host->fbReceive(self, faceNum, numBytes, bytes);
+}
+
+bool fb_getRxBufferConsumedCount(uint8_t faceNum, uint8_t *bytesConsumed) {
+    return p_host->fbGetRxCount(self, faceNum, bytesConsumed);
+}
+
+bool fb_flushRxBuffer(uint8_t faceNum) {
+    return p_host->fbFlushRx(self, faceNum);
+}
+
+bool fb_setRxEnable(uint8_t faceNum, bool rxEnable) {
+    return p_host->fbSetRxEnable(self, faceNum, rxEnable);
+}
+
+int16_t fb_getAmbientLight(uint8_t faceNum) {
+    return p_host->fbGetAmbientLight(self, faceNum);
+}
+
+/* Flash.  The cluster simulator maps the running module's flash at its real
+ * address, so the stack's pointers into flash are valid while it runs.  As
+ * with the SoftDevice, an operation completes later with a system event. */
+
+static uint32_t cube_startFlashOp(void) {
+    if (flashBusy) {
+	return NRF_ERROR_BUSY;
+    }
+
+    flashBusy = true;
+    flashFailed = false;
+    flashDone_ticks = simtimer_getTicks() + 1 + (uint64_t)(p_host->flashOp_us / SIM_USEC_PER_TICK);
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_flash_write(uint32_t * const p_dst, uint32_t const * const p_src, uint32_t size) {
+    uint32_t err_code;
+    uint32_t i;
+
+    if (((uintptr_t)p_dst < CUBE_FLASH_START) || ((uintptr_t)(p_dst + size) > CUBE_FLASH_START + CUBE_FLASH_SIZE)) {
+	return NRF_ERROR_INVALID_PARAM;
+    }
+
+    err_code = cube_startFlashOp();
+    if (err_code != NRF_SUCCESS) {
+	return err_code;
+    }
+
+    /* Programming can only clear bits. */
+    for (i = 0; i < size; i++) {
+	p_dst[i] &= p_src[i];
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_flash_page_erase(uint32_t page_number) {
+    uint32_t err_code;
+    uint32_t addr = page_number * IRDFU_PAGE_SIZE;
+
+    if ((addr < CUBE_FLASH_START) || (addr + IRDFU_PAGE_SIZE > CUBE_FLASH_START + CUBE_FLASH_SIZE)) {
+	return NRF_ERROR_INVALID_PARAM;
+    }
+
+    err_code = cube_startFlashOp();
+    if (err_code != NRF_SUCCESS) {
+	return err_code;
+    }
+
+    memset((void *)(uintptr_t)addr, 0xFF, IRDFU_PAGE_SIZE);
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_softdevice_disable() {
+    return NRF_SUCCESS;
+}
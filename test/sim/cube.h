@@ -0,0 +1,47 @@
+/*
+ * cube.h
+ *
+ * Interface between the cluster simulator and one simulated module.  Each
+ * module is a separately loaded copy of cube.so, which contains the real
+ * messaging stack and its own copy of all of the stack's state.  The
+ * simulator provides the faceboards and the IR links between them.
+ */
+
+#ifndef CUBE_H_
+#define CUBE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    bool (*fbSend)(uint8_t cube, uint8_t faceNum, uint8_t numBytes, const uint8_t *bytes);
+    bool (*fbGetTxAvailable)(uint8_t cube, uint8_t faceNum, uint8_t *p_count);
+    bool (*fbReceive)(uint8_t cube, uint8_t faceNum, uint8_t numBytes, uint8_t *bytes);
+    bool (*fbGetRxCount)(uint8_t cube, uint8_t faceNum, uint8_t *p_count);
+    bool (*fbFlushRx)(uint8_t cube, uint8_t faceNum);
+    bool (*fbSetRxEnable)(uint8_t cube, uint8_t faceNum, bool enable);
+    int16_t (*fbGetAmbientLight)(uint8_t cube, uint8_t faceNum);
+    /* Console output of the module */
+    void (*print)(uint8_t cube, const char *str);
+    /* A command executed by the module's command line */
+    void (*command)(uint8_t cube, const char *cmd);
+    /* Flash operations complete this long after they are started */
+    uint32_t flashOp_us;
+} cubeHost_t;
+
+typedef struct {
+    void (*attach)(const cubeHost_t *p_host, uint8_t index, uint16_t nodeID);
+    void (*start)(void);
+    void (*stop)(void);
+    /* Advances the module's RTC and runs everything that became due. */
+    void (*run)(uint64_t rtcTicks);
+    uint64_t (*getTicks)(void);
+    bool (*getNextEvent)(uint64_t *p_rtcTicks);
+    /* The module's 128 kB of flash from IRDFU_BANK_0_START upwards */
+    uint8_t *(*getFlash)(void);
+} cubeApi_t;
+
+#define CUBE_FLASH_START		0x00020000
+#define CUBE_FLASH_SIZE			0x00020000
+
+#endif /* CUBE_H_ */
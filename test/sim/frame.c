@@ -0,0 +1,26 @@
+/*
+ * frame.c
+ *
+ * The module's frame, as defined in imu.c, for tests of modules which use it
+ * without the IMU.
+ */
+
+#include <stdint.h>
+
+#include "imu.h"
+
+const vectorFloat_t frameAlignmentVectorsFloat[3] = {
+    {0.0f, 0.0f, 1.0f},
+    {0.707107f, -0.707107f, 0.0f},
+    {0.707107f, 0.707107f, 0.0f},
+};
+
+/* Outward normals of faces 1-6 in the frame of the faceboard IMU */
+const int8_t frameFaceNormals[6][3] = {
+    { 0,  0,  1},
+    { 1,  0,  0},
+    { 0,  1,  0},
+    {-1,  0,  0},
+    { 0, -1,  0},
+    { 0,  0, -1}
+};
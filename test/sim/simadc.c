@@ -0,0 +1,232 @@
+/*
+ * simadc.c
+ *
+ * Host implementation of the ADC, and of the GPIO pin configuration, behind
+ * adc.c (see simadc.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include "nrf51.h"
+#include "nrf51_bitfields.h"
+#include "nrf_soc.h"
+#include "nrf_sdm.h"
+#include "app_util_platform.h"
+
+#include "simadc.h"
+
+/* Interval between ticks of the ADC's clock, on each of which a conversion
+ * that has been started completes (about the 68 us that a 10-bit conversion
+ * takes on the module) */
+#define SIMADC_TICK_US		50
+
+/* The inputs are divided by 3 and compared with the 1.2 V bandgap */
+#define SIMADC_FULL_SCALE_MV	3600
+#define SIMADC_MAX_RESULT	1023
+
+void ADC_IRQHandler(void);
+
+NRF_GPIO_Type sim_GPIO;
+
+static NRF_ADC_Type registers;
+static uint32_t inten;
+static bool irqEnabled;
+static bool converting;
+static uint32_t conversionConfig;
+static uint16_t inputs_mV[8];
+
+/* Set while the main code is inside sim_ADC() or a critical region, which
+ * the clock's signal must not interrupt */
+static volatile bool inAccess = false;
+static volatile uint8_t criticalNesting = 0;
+
+static bool clockStarted = false;
+
+static simadcStatus_t status;
+
+/**@brief Applies the register writes made since the last access. */
+static void simadc_update(void) {
+    if (registers.INTENSET != 0) {
+	inten |= registers.INTENSET;
+	registers.INTENSET = 0;
+    }
+
+    if (registers.INTENCLR != 0) {
+	inten &= ~registers.INTENCLR;
+	registers.INTENCLR = 0;
+    }
+
+    if (registers.TASKS_STOP != 0) {
+	registers.TASKS_STOP = 0;
+	converting = false;
+	registers.BUSY = 0;
+    }
+
+    if (registers.TASKS_START != 0) {
+	registers.TASKS_START = 0;
+	if (registers.ENABLE != ADC_ENABLE_ENABLE_Enabled) {
+	    status.startsWhileDisabled++;
+	} else if (!converting) {
+	    converting = true;
+	    conversionConfig = registers.CONFIG;
+	    registers.BUSY = 1;
+	}
+    }
+
+    if (converting && (registers.CONFIG != conversionConfig)) {
+	status.configChanges++;
+	conversionConfig = registers.CONFIG;
+    }
+}
+
+/**@brief A tick of the ADC's clock: completes the conversion in progress and
+ * raises the END interrupt. */
+static void simadc_tick(int signum) {
+    uint32_t psel;
+    uint8_t channel;
+
+    if (inAccess) {
+	return;
+    }
+
+    simadc_update();
+
+    if (converting) {
+	psel = (conversionConfig & ADC_CONFIG_PSEL_Msk) >> ADC_CONFIG_PSEL_Pos;
+	for (channel = 0; (channel < 7) && !(psel & (1 << channel)); channel++);
+
+	registers.RESULT = simadc_getResult(channel);
+	registers.BUSY = 0;
+	registers.EVENTS_END = 1;
+	converting = false;
+
+	status.conversions++;
+	if (status.logLength < SIMADC_LOG_LENGTH) {
+	    status.log[status.logLength++] = channel;
+	}
+    }
+
+    if ((registers.EVENTS_END != 0) && (inten & ADC_INTENSET_END_Msk) && irqEnabled && (criticalNesting == 0)) {
+	status.interrupts++;
+	ADC_IRQHandler();
+    }
+}
+
+NRF_ADC_Type *sim_ADC() {
+    bool wasInAccess = inAccess;
+
+    inAccess = true;
+    simadc_update();
+    inAccess = wasInAccess;
+
+    return &registers;
+}
+
+void simadc_reset() {
+    struct sigaction action;
+    struct itimerval timer;
+
+    inAccess = true;
+
+    memset(&registers, 0, sizeof(registers));
+    inten = 0;
+    irqEnabled = false;
+    converting = false;
+    memset(inputs_mV, 0, sizeof(inputs_mV));
+    memset(&status, 0, sizeof(status));
+    criticalNesting = 0;
+
+    inAccess = false;
+
+    if (clockStarted) {
+	return;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = simadc_tick;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGALRM, &action, NULL);
+
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = SIMADC_TICK_US;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_REAL, &timer, NULL);
+
+    clockStarted = true;
+}
+
+void simadc_setInput_mV(uint8_t channel, uint16_t mV) {
+    if (channel < 8) {
+	inputs_mV[channel] = mV;
+    }
+}
+
+/**@brief Returns the 10-bit result of a conversion of the given input. */
+uint16_t simadc_getResult(uint8_t channel) {
+    uint32_t raw;
+
+    if (channel >= 8) {
+	return 0;
+    }
+
+    raw = ((uint32_t)inputs_mV[channel] * SIMADC_MAX_RESULT + SIMADC_FULL_SCALE_MV / 2) / SIMADC_FULL_SCALE_MV;
+
+    return (raw > SIMADC_MAX_RESULT) ? SIMADC_MAX_RESULT : raw;
+}
+
+void simadc_getStatus(simadcStatus_t *p_status) {
+    inAccess = true;
+    *p_status = status;
+    inAccess = false;
+}
+
+void simadc_clearStatus() {
+    inAccess = true;
+    memset(&status, 0, sizeof(status));
+    inAccess = false;
+}
+
+void sim_criticalRegionEnter() {
+    criticalNesting++;
+}
+
+void sim_criticalRegionExit() {
+    criticalNesting--;
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn) {
+    if (IRQn == ADC_IRQn) {
+	irqEnabled = true;
+    }
+}
+
+uint32_t sd_softdevice_is_enabled(uint8_t *p_softdevice_enabled) {
+    *p_softdevice_enabled = 0;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_nvic_ClearPendingIRQ(IRQn_Type IRQn) {
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_nvic_SetPriority(IRQn_Type IRQn, nrf_app_irq_priority_t priority) {
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_nvic_EnableIRQ(IRQn_Type IRQn) {
+    NVIC_EnableIRQ(IRQn);
+    return NRF_SUCCESS;
+}
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+    fprintf(stderr, "error %lu at %s:%lu\n", (unsigned long)error_code, (const char *)p_file_name,
+	    (unsigned long)line_num);
+    abort();
+}
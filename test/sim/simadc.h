@@ -0,0 +1,49 @@
+/*
+ * simadc.h
+ *
+ * Simulation of the ADC behind adc.c, converting alongside the CPU.  The
+ * signal of an interval timer stands in for the ADC's clock: on each tick, a
+ * conversion which has been started completes and raises END, and if the END
+ * interrupt and the ADC IRQ are enabled, and no critical region holds it off,
+ * ADC_IRQHandler() runs from the signal handler, preempting the main code as
+ * the interrupt does on the module.  The busy-waits of adc.c, on BUSY and on a
+ * running sequence, therefore end as they would on the module.
+ *
+ * The registers are reached through sim_ADC(), which brings the simulation up
+ * to date before every access, so that TASKS_START, TASKS_STOP, INTENSET and
+ * INTENCLR take effect in the order in which they are written.  The input of
+ * every conversion is logged, and conversions started with the ADC disabled,
+ * or whose configuration changed before they completed, are counted.  Only
+ * the ADC, the NVIC and SoftDevice functions that adc.c calls, and the GPIO
+ * pin configuration are provided.
+ */
+
+#ifndef SIMADC_H_
+#define SIMADC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIMADC_LOG_LENGTH	256
+
+typedef struct {
+    uint32_t conversions;
+    uint32_t interrupts;
+    uint32_t startsWhileDisabled;
+    uint32_t configChanges;
+    /* The input (0 to 7) of each conversion, in order, up to the length of
+     * the log */
+    uint16_t logLength;
+    uint8_t log[SIMADC_LOG_LENGTH];
+} simadcStatus_t;
+
+/* Clears the ADC and its inputs, and starts its clock. */
+void simadc_reset(void);
+
+void simadc_setInput_mV(uint8_t channel, uint16_t mV);
+uint16_t simadc_getResult(uint8_t channel);
+
+void simadc_getStatus(simadcStatus_t *p_status);
+void simadc_clearStatus(void);
+
+#endif /* SIMADC_H_ */
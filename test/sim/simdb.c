@@ -0,0 +1,192 @@
+/*
+ * simdb.c
+ *
+ * Host implementation of the TWI master and delays used by db.c, on a
+ * simulated daughterboard (see simdb.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_error.h"
+#include "twi_master.h"
+
+#include "global.h"
+#include "util.h"
+#include "db.h"
+
+#include "simtimer.h"
+#include "simdb.h"
+
+NRF_TWI_Type sim_TWI1;
+NRF_GPIO_Type sim_GPIO;
+
+static simdbConfig_t config;
+static simdbStatus_t status;
+
+static bool twiInitialized = false;
+
+/* The command in progress (or last completed), with its data */
+static bool busy = false;
+static bool complete = false;
+static uint8_t command[1 + DB_MAX_REQUEST_LENGTH];
+static uint64_t completeTime_ticks;
+
+static double simdb_uniform(double min, double max) {
+    return min + (max - min) * rand() / RAND_MAX;
+}
+
+static void simdb_update(void) {
+    if (busy && (simtimer_getTicks() >= completeTime_ticks)) {
+	busy = false;
+	complete = true;
+    }
+}
+
+static void simdb_write(const uint8_t *data, uint8_t length) {
+    uint8_t cmd = data[0];
+
+    if (busy) {
+	status.overruns++;
+    }
+
+    memset(command, 0, sizeof(command));
+    memcpy(command, data, (length < sizeof(command)) ? length : sizeof(command));
+    status.lastCmd = cmd;
+    status.lastWrite_ticks = simtimer_getTicks();
+    status.lastLatency_ms = 0.0;
+    complete = false;
+    busy = false;
+
+    if (cmd == DB_SLEEP_CMD) {
+	/* A sleep command is not answered. */
+	status.asleep = (length > 1) && (data[1] != 0x00);
+	return;
+    }
+
+    if (cmd == DB_LED_CMD) {
+	status.leds = (length > 1) ? data[1] : 0x00;
+    }
+
+    if (config.maxLatency_ms[cmd] <= 0.0) {
+	busy = true;
+	completeTime_ticks = UINT64_MAX;
+	return;
+    }
+
+    status.lastLatency_ms = simdb_uniform(config.minLatency_ms[cmd], config.maxLatency_ms[cmd]);
+    completeTime_ticks = status.lastWrite_ticks + (uint64_t)(status.lastLatency_ms * 1000.0 / SIM_USEC_PER_TICK + 0.5);
+    busy = true;
+}
+
+static bool simdb_read(uint8_t *data, uint8_t length) {
+    memset(data, 0, length);
+
+    simdb_update();
+
+    if (busy && config.nackWhileBusy) {
+	status.nacks++;
+	return false;
+    }
+
+    if (!complete || (length < 2)) {
+	return true;
+    }
+
+    data[0] = command[0];
+    data[1] = (simdb_uniform(0.0, 1.0) < config.failRate) ? 0x00 : 0x01;
+
+    if ((command[0] == DB_TEMPERATURE_CMD) && (length >= 4)) {
+	data[2] = (uint16_t)config.temperature_tenthDegC & 0xFF;
+	data[3] = (uint16_t)config.temperature_tenthDegC >> 8;
+    } else if ((command[0] == DB_VERSION_CMD) && (length > 2)) {
+	strncpy((char *)&data[2], config.version, length - 2);
+	data[length - 1] = '\0';
+    }
+
+    return true;
+}
+
+void simdb_getDefaultConfig(simdbConfig_t *p_config) {
+    uint16_t cmd;
+
+    memset(p_config, 0, sizeof(*p_config));
+    for (cmd = 0; cmd < 256; cmd++) {
+	p_config->minLatency_ms[cmd] = DB_POLL_FIRST_INTERVAL_MS;
+	p_config->maxLatency_ms[cmd] = DB_POLL_FIRST_INTERVAL_MS;
+    }
+    p_config->temperature_tenthDegC = 231;
+    p_config->version = "DB 1.0";
+    p_config->seed = 1;
+}
+
+void simdb_init(const simdbConfig_t *p_config) {
+    config = *p_config;
+    srand(config.seed);
+
+    memset(&status, 0, sizeof(status));
+    busy = false;
+    complete = false;
+}
+
+void simdb_setLatency(uint8_t cmd, double minLatency_ms, double maxLatency_ms) {
+    config.minLatency_ms[cmd] = minLatency_ms;
+    config.maxLatency_ms[cmd] = maxLatency_ms;
+}
+
+void simdb_getStatus(simdbStatus_t *p_status) {
+    *p_status = status;
+}
+
+/* The TWI master */
+
+bool twi_master_init() {
+    twiInitialized = true;
+    return true;
+}
+
+void twi_master_deinit() {
+    twiInitialized = false;
+}
+
+bool twi_master_get_init() {
+    return twiInitialized;
+}
+
+bool twi_master_transfer(uint8_t address, uint8_t *data, uint8_t data_length, bool issue_stop_condition) {
+    if (!twiInitialized || ((address >> 1) != DB_TWI_ADDR) || (data_length == 0)) {
+	return false;
+    }
+
+    /* Any transfer wakes the daughterboard. */
+    if (status.asleep) {
+	status.wakeups++;
+	status.asleep = false;
+    }
+
+    if (address & TWI_READ_BIT) {
+	status.reads++;
+	return simdb_read(data, data_length);
+    }
+
+    status.writes++;
+    simdb_write(data, data_length);
+    return true;
+}
+
+/* Delays stall the module while the RTC, and the daughterboard, keep going. */
+
+bool delay_ms(uint32_t ms) {
+    simtimer_advance(simtimer_getTicks() + (uint64_t)(1000.0 * ms / SIM_USEC_PER_TICK + 0.5));
+    return true;
+}
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+    fprintf(stderr, "error %lu at %s:%lu\n", (unsigned long)error_code, (const char *)p_file_name,
+	    (unsigned long)line_num);
+    abort();
+}
@@ -0,0 +1,61 @@
+/*
+ * simdb.h
+ *
+ * Simulated daughterboard on the TWI bus, behind the interfaces that db.c
+ * uses: the TWI master and the delays.  Time is that of the simulated RTC
+ * (see simtimer.h).
+ *
+ * The daughterboard works on one command at a time.  A command written to it
+ * completes after a latency drawn at random from a range configured for its
+ * command code; until then, reads return a zero command code, or are not
+ * acknowledged at all.  Once complete, a read returns the command code, a
+ * status byte of 0x01 and the command's response.  Commands other than those
+ * listed in db.h are answered with zeros.
+ */
+
+#ifndef SIMDB_H_
+#define SIMDB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    /* Range of the time between a command's write and its completion, in
+     * milliseconds, for each command code (0 to never complete) */
+    double minLatency_ms[256];
+    double maxLatency_ms[256];
+    /* Whether reads are left unacknowledged while a command is in progress */
+    bool nackWhileBusy;
+    /* Probability that a completed command reports failure */
+    double failRate;
+    int16_t temperature_tenthDegC;
+    const char *version;
+    unsigned int seed;
+} simdbConfig_t;
+
+typedef struct {
+    uint32_t writes;
+    uint32_t reads;
+    uint32_t nacks;
+    /* Commands written while another was in progress, which the
+     * daughterboard would drop */
+    uint32_t overruns;
+    /* Commands written while asleep */
+    uint32_t wakeups;
+    uint8_t lastCmd;
+    /* Time at which the last command was written and its latency */
+    uint64_t lastWrite_ticks;
+    double lastLatency_ms;
+    uint8_t leds;
+    bool asleep;
+} simdbStatus_t;
+
+/* Every command takes 5 ms, as the blocking functions of db.c assume. */
+void simdb_getDefaultConfig(simdbConfig_t *p_config);
+void simdb_init(const simdbConfig_t *p_config);
+
+void simdb_setLatency(uint8_t cmd, double minLatency_ms, double maxLatency_ms);
+
+void simdb_getStatus(simdbStatus_t *p_status);
+
+#endif /* SIMDB_H_ */
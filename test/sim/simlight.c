@@ -0,0 +1,145 @@
+/*
+ * simlight.c
+ *
+ * Host implementation of the light sampling service's interface on synthetic
+ * ambient samples (see simlight.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "app_scheduler.h"
+
+#include "light.h"
+
+#include "simlight.h"
+
+#define SIMLIGHT_MAX_BATCH		255
+
+static simlightFace_t faces[6];
+static double beaconPhase[6];
+static double mainsPhase[6];
+
+static bool running = false;
+static uint16_t interval_ms = 100;
+static lightSampleHandler_t sampleHandler = NULL;
+
+/* Samples generated so far, and those of the current batch */
+static uint64_t sampleCount;
+static uint32_t batchTime_ms;
+
+static double simlight_noise(double stdDev) {
+    double u1, u2;
+
+    if (stdDev <= 0.0) {
+	return 0.0;
+    }
+
+    u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return stdDev * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static uint8_t simlight_getSample(uint8_t faceNum, double t) {
+    simlightFace_t *p_face = &faces[faceNum-1];
+    double level;
+
+    level = p_face->level + simlight_noise(p_face->noise);
+    if ((p_face->beacon_hz > 0.0) && (fmod(p_face->beacon_hz * t + beaconPhase[faceNum-1], 1.0) < 0.5)) {
+	level += p_face->beacon;
+    }
+    level += p_face->flicker * fabs(sin(2.0 * M_PI * (p_face->mains_hz * (1.0 + p_face->mainsDrift) * t +
+	    mainsPhase[faceNum-1])));
+
+    if (level < 0.0) {
+	return 0;
+    } else if (level > 255.0) {
+	return 255;
+    }
+
+    return (uint8_t)(level + 0.5);
+}
+
+void simlight_reset(unsigned int seed) {
+    uint8_t i;
+
+    srand(seed);
+    memset(faces, 0, sizeof(faces));
+    for (i = 0; i < 6; i++) {
+	beaconPhase[i] = (double)rand() / RAND_MAX;
+	mainsPhase[i] = (double)rand() / RAND_MAX;
+    }
+    sampleCount = 0;
+    batchTime_ms = 0;
+}
+
+void simlight_setFace(uint8_t faceNum, const simlightFace_t *p_face) {
+    if ((faceNum >= 1) && (faceNum <= 6)) {
+	faces[faceNum-1] = *p_face;
+    }
+}
+
+void simlight_run(uint32_t ms) {
+    uint8_t samples[6][SIMLIGHT_MAX_BATCH];
+    uint16_t count, i;
+    uint8_t faceNum;
+    double t;
+
+    for (batchTime_ms += ms; running && (batchTime_ms >= interval_ms); batchTime_ms -= interval_ms) {
+	count = (uint32_t)interval_ms * SIMLIGHT_SAMPLE_RATE_HZ / 1000;
+	if (count > SIMLIGHT_MAX_BATCH) {
+	    count = SIMLIGHT_MAX_BATCH;
+	}
+
+	for (i = 0; i < count; i++) {
+	    t = (double)(sampleCount + i) / SIMLIGHT_SAMPLE_RATE_HZ;
+	    for (faceNum = 1; faceNum <= 6; faceNum++) {
+		samples[faceNum-1][i] = simlight_getSample(faceNum, t);
+	    }
+	}
+	sampleCount += count;
+
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    if (sampleHandler != NULL) {
+		sampleHandler(faceNum, samples[faceNum-1], count);
+	    }
+	}
+    }
+
+    if (!running) {
+	batchTime_ms = 0;
+    }
+}
+
+/* The light sampling service */
+
+bool light_start(uint16_t newInterval_ms) {
+    if (newInterval_ms < LIGHT_MIN_INTERVAL_MS) {
+	return false;
+    }
+
+    interval_ms = newInterval_ms;
+    running = true;
+
+    return true;
+}
+
+void light_stop() {
+    running = false;
+}
+
+bool light_isRunning() {
+    return running;
+}
+
+uint16_t light_getInterval() {
+    return interval_ms;
+}
+
+void light_setSampleHandler(lightSampleHandler_t handler) {
+    sampleHandler = handler;
+}
@@ -0,0 +1,43 @@
+/*
+ * simlight.h
+ *
+ * Stand-in for the light sampling service which, while it runs, passes
+ * batches of synthetic raw ambient samples from each face to the sample
+ * handler, as the service does with the faceboards' ambient buffers.
+ *
+ * The light seen by each face is the sum of a steady level, a beacon
+ * blinking on and off, flicker from lamps on the mains (whose light peaks
+ * twice per mains cycle) and random noise.  Levels are in raw 8-bit samples.
+ */
+
+#ifndef SIMLIGHT_H_
+#define SIMLIGHT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Rate at which the faceboards fill their ambient sample buffers */
+#define SIMLIGHT_SAMPLE_RATE_HZ		500
+
+typedef struct {
+    double level;
+    /* Difference between the beacon on and off, and its blinking frequency */
+    double beacon;
+    double beacon_hz;
+    /* Peak of the flicker, the mains frequency (50 or 60 Hz), and how far
+     * the mains frequency is off, as a fraction */
+    double flicker;
+    double mains_hz;
+    double mainsDrift;
+    /* Standard deviation of the noise */
+    double noise;
+} simlightFace_t;
+
+void simlight_reset(unsigned int seed);
+void simlight_setFace(uint8_t faceNum, const simlightFace_t *p_face);
+
+/* Passes the samples of the given time to the sample handler, in batches at
+ * the interval with which the service was started. */
+void simlight_run(uint32_t ms);
+
+#endif /* SIMLIGHT_H_ */
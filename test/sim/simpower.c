@@ -0,0 +1,337 @@
+/*
+ * simpower.c
+ *
+ * Host implementation of the interfaces used by power.c on a simulated
+ * battery pack (see simpower.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrf51.h"
+#include "nrf51_bitfields.h"
+#include "nrf_gpio.h"
+#include "nrf_delay.h"
+#include "app_error.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "pins.h"
+#include "util.h"
+#include "adc.h"
+#include "pwm.h"
+#include "led.h"
+#include "bleApp.h"
+#include "thermal.h"
+
+#include "simtimer.h"
+#include "simpower.h"
+
+/* Offset voltage of the protection IC's output, which differs a little from
+ * cell to cell */
+#define SIMPOWER_OFFSET_MV		120
+
+#define SIMPOWER_PWM_PERIOD		512
+
+NRF_GPIO_Type sim_GPIO;
+
+static uint16_t cell_mV[4];
+static uint16_t vin_mV;
+static uint16_t chargeCurrent_mA;
+
+static uint32_t gpioOut;
+
+/* VBATOUT as it is now, as it was before the last change of selection, and
+ * when that change was made */
+static uint16_t vbatout_mV;
+static uint16_t previousVbatout_mV;
+static double selected_us;
+static bool fifthSelected;
+
+/* The CPU's clock, which runs ahead of the RTC by up to a tick, and the time
+ * at which the ADC finishes the sequence in progress */
+static double now_us;
+static double adcIdle_us;
+
+static simpowerStatus_t status;
+
+static void simpower_updateSelection(void);
+
+static void simpower_sync(void) {
+    double rtc_us = simtimer_getTicks() * SIM_USEC_PER_TICK;
+
+    if (rtc_us > now_us) {
+	now_us = rtc_us;
+    }
+}
+
+/**@brief Stalls the CPU for the given time.  The pins may have been
+ * reconfigured directly through PIN_CNF just before, so the selection is
+ * brought up to date first. */
+static void simpower_block(double us) {
+    simpower_updateSelection();
+    simpower_sync();
+    now_us += us;
+    status.blocking_ms += us / 1000.0;
+    simtimer_advance((uint64_t)(now_us / SIM_USEC_PER_TICK));
+}
+
+/**@brief Returns the level that an input of the protection IC sees: 0 for
+ * low, 1 for high or 2 for floating. */
+static uint8_t simpower_getCtl(uint32_t pinNo) {
+    if ((NRF_GPIO->PIN_CNF[pinNo] & GPIO_PIN_CNF_DIR_Msk) != (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos)) {
+	return 2;
+    }
+
+    return (gpioOut >> pinNo) & 0x01;
+}
+
+/**@brief Works out VBATOUT from CTL3 and CTL4 (see power_selectCellOutput()),
+ * noting the time if it has changed. */
+static void simpower_updateSelection(void) {
+    /* Cell whose offset, and cell whose offset plus one fifth, each
+     * combination of CTL3 (rows) and CTL4 (columns) selects */
+    static const uint8_t offsetCell[3][3] = {{0, 1, 0}, {3, 4, 0}, {0, 0, 2}};
+    static const uint8_t fifthCell[3][3] = {{0, 0, 1}, {0, 0, 4}, {2, 3, 0}};
+    uint8_t ctl3, ctl4, batNum;
+    uint16_t output_mV = 0;
+    bool fifth = false;
+
+    ctl3 = simpower_getCtl(LIPROCTL3_PIN_NO);
+    ctl4 = simpower_getCtl(LIPROCTL4_PIN_NO);
+
+    if ((batNum = offsetCell[ctl3][ctl4]) != 0) {
+	output_mV = SIMPOWER_OFFSET_MV + 2 * batNum;
+    } else if ((batNum = fifthCell[ctl3][ctl4]) != 0) {
+	output_mV = SIMPOWER_OFFSET_MV + 2 * batNum + cell_mV[batNum - 1] / 5;
+	fifth = true;
+    }
+
+    if (output_mV != vbatout_mV) {
+	simpower_sync();
+	previousVbatout_mV = vbatout_mV;
+	vbatout_mV = output_mV;
+	selected_us = now_us;
+    }
+    fifthSelected = fifth;
+}
+
+/**@brief Returns VBATOUT as sampled at the given time. */
+static uint16_t simpower_sampleVbatout(double at_us) {
+    if (at_us < selected_us + SIMPOWER_SETTLE_US) {
+	status.unsettledSamples++;
+	return previousVbatout_mV;
+    }
+
+    return vbatout_mV;
+}
+
+static uint16_t simpower_getChannel_mV(uint8_t channel, double at_us) {
+    switch (channel) {
+    case VINSENSE_ADC_CHNL:
+	return vin_mV / 2;
+    case ICHARGE_ADC_CHNL:
+	return (chargeCurrent_mA * 50) / 3;
+    case LIPROVBATOUT_ADC_CHNL:
+	return simpower_sampleVbatout(at_us);
+    default:
+	return 0;
+    }
+}
+
+void simpower_reset() {
+    memset(&sim_GPIO, 0, sizeof(sim_GPIO));
+    memset(cell_mV, 0, sizeof(cell_mV));
+    vin_mV = 0;
+    chargeCurrent_mA = 0;
+    gpioOut = 0;
+    vbatout_mV = 0;
+    previousVbatout_mV = 0;
+    selected_us = 0.0;
+    fifthSelected = false;
+    now_us = simtimer_getTicks() * SIM_USEC_PER_TICK;
+    adcIdle_us = now_us;
+    simpower_clearStatus();
+    simpower_updateSelection();
+}
+
+void simpower_setCells_mV(const uint16_t *newCell_mV) {
+    memcpy(cell_mV, newCell_mV, sizeof(cell_mV));
+    simpower_updateSelection();
+}
+
+void simpower_setVIn_mV(uint16_t newVIn_mV) {
+    vin_mV = newVIn_mV;
+}
+
+void simpower_setChargeCurrent_mA(uint16_t current_mA) {
+    chargeCurrent_mA = current_mA;
+}
+
+bool simpower_isChargerEnabled() {
+    return (gpioOut >> CHRGEN_PIN_NO) & 0x01;
+}
+
+void simpower_getStatus(simpowerStatus_t *p_status) {
+    *p_status = status;
+}
+
+void simpower_clearStatus() {
+    memset(&status, 0, sizeof(status));
+}
+
+/* GPIO */
+
+void nrf_gpio_cfg_output(uint32_t pin_number) {
+    NRF_GPIO->PIN_CNF[pin_number] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos);
+    simpower_updateSelection();
+}
+
+void nrf_gpio_pin_set(uint32_t pin_number) {
+    gpioOut |= (1UL << pin_number);
+    simpower_updateSelection();
+}
+
+void nrf_gpio_pin_clear(uint32_t pin_number) {
+    gpioOut &= ~(1UL << pin_number);
+    simpower_updateSelection();
+}
+
+/* ADC.  A blocking conversion stalls the CPU; a sequence converts its
+ * channels back-to-back while the CPU runs on, and its handler is queued
+ * straight away, since nothing else in the simulation needs the ADC in the
+ * meantime. */
+
+uint16_t adc_avg_mV(uint8_t channel, uint8_t nsamples) {
+    uint16_t result_mV;
+
+    adc_waitIdle();
+    simpower_updateSelection();
+
+    if ((channel == LIPROVBATOUT_ADC_CHNL) && fifthSelected) {
+	status.cellMeasurements++;
+    }
+
+    simpower_sync();
+    result_mV = simpower_getChannel_mV(channel, now_us);
+    simpower_block((double)nsamples * SIMPOWER_CONVERSION_US);
+
+    return result_mV;
+}
+
+uint16_t adc_read_mV(uint8_t channel) {
+    return adc_avg_mV(channel, 1);
+}
+
+static void simpower_sequenceEventHandler(void *p_event_data, uint16_t event_size) {
+    adcSequence_t *p_sequence = *(adcSequence_t **)p_event_data;
+
+    p_sequence->busy = false;
+    if (p_sequence->handler != NULL) {
+	p_sequence->handler(p_sequence);
+    }
+}
+
+bool adc_startSequence(adcSequence_t *p_sequence) {
+    double at_us;
+    uint8_t i;
+
+    if ((p_sequence == NULL) || p_sequence->busy || (p_sequence->channelCount == 0) ||
+	    (p_sequence->channelCount > ADC_SEQUENCE_MAX_CHANNELS)) {
+	return false;
+    }
+
+    simpower_updateSelection();
+    simpower_sync();
+    at_us = (adcIdle_us > now_us) ? adcIdle_us : now_us;
+
+    /* Each channel is sampled at the start of its conversions. */
+    for (i = 0; i < p_sequence->channelCount; i++) {
+	p_sequence->results_mV[i] = simpower_getChannel_mV(p_sequence->channels[i], at_us);
+	at_us += (double)p_sequence->samples[i] * SIMPOWER_CONVERSION_US;
+    }
+    adcIdle_us = at_us;
+
+    p_sequence->busy = true;
+    status.sequences++;
+    APP_ERROR_CHECK(app_sched_event_put(&p_sequence, sizeof(p_sequence), simpower_sequenceEventHandler));
+
+    return true;
+}
+
+bool adc_isBusy() {
+    simpower_sync();
+    return (adcIdle_us > now_us);
+}
+
+void adc_waitIdle() {
+    simpower_sync();
+    if (adcIdle_us > now_us) {
+	simpower_block(adcIdle_us - now_us);
+    }
+}
+
+/* Delays */
+
+void nrf_delay_us(uint32_t volatile number_of_us) {
+    simpower_block(number_of_us);
+}
+
+void nrf_delay_ms(uint32_t volatile number_of_ms) {
+    simpower_block(1000.0 * number_of_ms);
+}
+
+/* The rest of the module */
+
+bool led_setState(uint8_t led, led_state_t state) {
+    return true;
+}
+
+uint32_t led_getDutyCycle_permille(uint8_t led) {
+    return 0;
+}
+
+bool bleApp_isConnected() {
+    return false;
+}
+
+bool bleApp_isAdvertisingEnabled() {
+    return false;
+}
+
+void thermal_update() {
+}
+
+bool thermal_isOvertemp() {
+    return false;
+}
+
+bool thermal_isUndertemp() {
+    return false;
+}
+
+uint16_t thermal_derate(uint16_t value) {
+    return value;
+}
+
+uint32_t pwm_getPeriod() {
+    return SIMPOWER_PWM_PERIOD;
+}
+
+bool pwm_setOnPeriod(unsigned int channel, uint32_t onPeriod) {
+    return onPeriod <= SIMPOWER_PWM_PERIOD;
+}
+
+uint32_t app_uart_put_string(const char *str) {
+    return 0;
+}
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+    fprintf(stderr, "error %lu at %s:%lu\n", (unsigned long)error_code, (const char *)p_file_name,
+	    (unsigned long)line_num);
+    abort();
+}
@@ -0,0 +1,54 @@
+/*
+ * simpower.h
+ *
+ * Simulated battery pack and charger front end, behind the interfaces that
+ * power.c uses: the ADC, the GPIO pins which steer the Lipo protection IC's
+ * VBATOUT output, the delays, and the LED, thermal, PWM and BLE modules, which
+ * are reduced to stand-ins.  Time is that of the simulated RTC (see
+ * simtimer.h); blocking conversions and delays stall the CPU, and move the RTC
+ * forward, for as long as they would take on the module.
+ *
+ * The protection IC's CTL3 and CTL4 inputs, each driven low, driven high or
+ * left floating, select either the offset voltage of one cell or the offset
+ * plus one fifth of that cell's voltage on VBATOUT, which needs 1 ms to settle
+ * after the selection changes.  A sample taken before then sees the previous
+ * output.
+ */
+
+#ifndef SIMPOWER_H_
+#define SIMPOWER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Time for one 10-bit conversion */
+#define SIMPOWER_CONVERSION_US		68
+
+/* Time that VBATOUT needs to settle */
+#define SIMPOWER_SETTLE_US		1000
+
+typedef struct {
+    /* Blocking conversions of VBATOUT with one fifth of a cell selected, i.e.
+     * cell measurements made by the CPU rather than in the background */
+    uint32_t cellMeasurements;
+    /* Background sequences started */
+    uint32_t sequences;
+    /* Conversions of VBATOUT (blocking or in a sequence) before it settled */
+    uint32_t unsettledSamples;
+    /* Time the CPU spent in blocking conversions and delays */
+    double blocking_ms;
+} simpowerStatus_t;
+
+void simpower_reset(void);
+
+void simpower_setCells_mV(const uint16_t *cell_mV);
+void simpower_setVIn_mV(uint16_t vin_mV);
+void simpower_setChargeCurrent_mA(uint16_t current_mA);
+
+/* Returns whether the charger has been enabled through CHRGEN. */
+bool simpower_isChargerEnabled(void);
+
+void simpower_getStatus(simpowerStatus_t *p_status);
+void simpower_clearStatus(void);
+
+#endif /* SIMPOWER_H_ */
@@ -0,0 +1,300 @@
+/*
+ * simpwm.c
+ *
+ * Host implementation of TIMER2, PPI, GPIOTE and the GPIO pins, and of the
+ * delays, behind pwm.c (see simpwm.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "nrf51.h"
+#include "nrf51_bitfields.h"
+#include "nrf_gpio.h"
+#include "nrf_gpiote.h"
+#include "nrf_delay.h"
+#include "nrf_sdm.h"
+#include "nrf_soc.h"
+#include "app_timer.h"
+
+#include "global.h"
+
+#include "simtimer.h"
+#include "simpwm.h"
+
+#define PIN_COUNT		32
+#define GPIOTE_COUNT		4
+#define PPI_COUNT		16
+#define COMPARE_COUNT		4
+
+typedef struct {
+    bool level;
+    uint64_t lastChange_counts;
+    uint64_t windowStart_counts;
+    /* Whether the pin has risen since the statistics were cleared */
+    bool risen;
+    simpwmPinStats_t stats;
+} simpwmPin_t;
+
+NRF_TIMER_Type sim_TIMER2;
+NRF_GPIOTE_Type sim_GPIOTE;
+NRF_PPI_Type sim_PPI;
+
+static uint64_t now_counts = 0;
+static uint32_t counter = 0;
+static bool running = false;
+
+static bool gpioOut[PIN_COUNT];
+static bool gpioteConfigured[GPIOTE_COUNT];
+static uint8_t gpiotePins[GPIOTE_COUNT];
+static bool gpioteOut[GPIOTE_COUNT];
+
+static simpwmPin_t pins[PIN_COUNT];
+
+static uint64_t simpwm_ticksToCounts(uint64_t rtcTicks) {
+    return (rtcTicks * SIMPWM_CLOCK_HZ * (APP_TIMER_PRESCALER + 1)) / APP_TIMER_CLOCK_FREQ;
+}
+
+static uint64_t simpwm_countsToTicks(uint64_t counts) {
+    return (counts * APP_TIMER_CLOCK_FREQ) / ((uint64_t)SIMPWM_CLOCK_HZ * (APP_TIMER_PRESCALER + 1));
+}
+
+/**@brief Brings a pin's level up to date with its GPIO output and any GPIOTE
+ * block which drives it, and records the pulse which a change ends. */
+static void simpwm_updatePin(uint8_t pinNo) {
+    simpwmPin_t *p_pin = &pins[pinNo];
+    uint32_t pulse_counts;
+    bool level;
+    uint8_t g;
+
+    level = gpioOut[pinNo];
+    for (g = 0; g < GPIOTE_COUNT; g++) {
+	if (gpioteConfigured[g] && (gpiotePins[g] == pinNo)) {
+	    level = gpioteOut[g];
+	}
+    }
+
+    if (level == p_pin->level) {
+	return;
+    }
+
+    if (p_pin->level) {
+	p_pin->stats.high_counts += now_counts - p_pin->lastChange_counts;
+	if (p_pin->risen) {
+	    pulse_counts = now_counts - p_pin->lastChange_counts;
+	    if ((p_pin->stats.pulses == 0) || (pulse_counts < p_pin->stats.minPulse_counts)) {
+		p_pin->stats.minPulse_counts = pulse_counts;
+	    }
+	    if (pulse_counts > p_pin->stats.maxPulse_counts) {
+		p_pin->stats.maxPulse_counts = pulse_counts;
+	    }
+	    p_pin->stats.pulses++;
+	}
+    } else {
+	p_pin->risen = true;
+    }
+
+    p_pin->level = level;
+    p_pin->lastChange_counts = now_counts;
+}
+
+/**@brief Fires the compare event on the given channel, performing the tasks
+ * that it is connected to and the timer's shortcuts. */
+static void simpwm_compare(uint8_t cc) {
+    uint32_t eep = (uint32_t)&NRF_TIMER2->EVENTS_COMPARE[cc];
+    uint8_t ch, g;
+
+    NRF_TIMER2->EVENTS_COMPARE[cc] = 1;
+
+    for (ch = 0; ch < PPI_COUNT; ch++) {
+	if (!(NRF_PPI->CHEN & (1UL << ch)) || (NRF_PPI->CH[ch].EEP != eep)) {
+	    continue;
+	}
+	for (g = 0; g < GPIOTE_COUNT; g++) {
+	    if (gpioteConfigured[g] && (NRF_PPI->CH[ch].TEP == (uint32_t)&NRF_GPIOTE->TASKS_OUT[g])) {
+		gpioteOut[g] = !gpioteOut[g];
+		simpwm_updatePin(gpiotePins[g]);
+	    }
+	}
+    }
+
+    if (cc == 0) {
+	if (NRF_TIMER2->SHORTS & (TIMER_SHORTS_COMPARE0_CLEAR_Enabled << TIMER_SHORTS_COMPARE0_CLEAR_Pos)) {
+	    counter = 0;
+	}
+	if (NRF_TIMER2->SHORTS & (TIMER_SHORTS_COMPARE0_STOP_Enabled << TIMER_SHORTS_COMPARE0_STOP_Pos)) {
+	    running = false;
+	}
+    }
+}
+
+/**@brief Performs the tasks written since the last run, and then runs the
+ * timer up to the given time. */
+static void simpwm_run(uint64_t target_counts) {
+    uint32_t step, d;
+    uint8_t cc;
+
+    if (NRF_TIMER2->TASKS_STOP) {
+	running = false;
+    }
+    if (NRF_TIMER2->TASKS_CLEAR) {
+	counter = 0;
+    }
+    if (NRF_TIMER2->TASKS_START) {
+	running = true;
+    }
+    NRF_TIMER2->TASKS_STOP = 0;
+    NRF_TIMER2->TASKS_CLEAR = 0;
+    NRF_TIMER2->TASKS_START = 0;
+
+    NRF_PPI->CHEN = (NRF_PPI->CHEN | NRF_PPI->CHENSET) & ~NRF_PPI->CHENCLR;
+    NRF_PPI->CHENSET = 0;
+    NRF_PPI->CHENCLR = 0;
+
+    while (running && (now_counts < target_counts)) {
+	/* The next compare match, if any comes before the target */
+	step = 0;
+	for (cc = 0; cc < COMPARE_COUNT; cc++) {
+	    if (NRF_TIMER2->CC[cc] > counter) {
+		d = NRF_TIMER2->CC[cc] - counter;
+		if ((step == 0) || (d < step)) {
+		    step = d;
+		}
+	    }
+	}
+
+	if ((step == 0) || (now_counts + step > target_counts)) {
+	    counter += target_counts - now_counts;
+	    break;
+	}
+
+	now_counts += step;
+	counter += step;
+
+	/* CC[0] comes last, since it clears the counter. */
+	for (cc = COMPARE_COUNT; cc-- > 0; ) {
+	    if (NRF_TIMER2->CC[cc] == counter) {
+		simpwm_compare(cc);
+	    }
+	}
+    }
+
+    if (target_counts > now_counts) {
+	now_counts = target_counts;
+    }
+}
+
+static void simpwm_advanceHandler(uint64_t rtcTicks) {
+    simpwm_run(simpwm_ticksToCounts(rtcTicks));
+}
+
+void simpwm_reset() {
+    memset(&sim_TIMER2, 0, sizeof(sim_TIMER2));
+    memset(&sim_GPIOTE, 0, sizeof(sim_GPIOTE));
+    memset(&sim_PPI, 0, sizeof(sim_PPI));
+    memset(gpioOut, 0, sizeof(gpioOut));
+    memset(gpioteConfigured, 0, sizeof(gpioteConfigured));
+    memset(gpioteOut, 0, sizeof(gpioteOut));
+    memset(pins, 0, sizeof(pins));
+
+    now_counts = simpwm_ticksToCounts(simtimer_getTicks());
+    counter = 0;
+    running = false;
+
+    simtimer_setAdvanceHandler(simpwm_advanceHandler);
+}
+
+uint64_t simpwm_getTime() {
+    return now_counts;
+}
+
+bool simpwm_getPinLevel(uint8_t pinNo) {
+    return pins[pinNo].level;
+}
+
+void simpwm_getPinStats(uint8_t pinNo, simpwmPinStats_t *p_stats) {
+    simpwmPin_t *p_pin = &pins[pinNo];
+
+    simpwm_run(now_counts);
+
+    *p_stats = p_pin->stats;
+    p_stats->window_counts = now_counts - p_pin->windowStart_counts;
+    if (p_pin->level) {
+	p_stats->high_counts += now_counts - p_pin->lastChange_counts;
+    }
+}
+
+void simpwm_clearPinStats(uint8_t pinNo) {
+    simpwmPin_t *p_pin = &pins[pinNo];
+
+    simpwm_run(now_counts);
+
+    memset(&p_pin->stats, 0, sizeof(p_pin->stats));
+    p_pin->windowStart_counts = now_counts;
+    p_pin->lastChange_counts = now_counts;
+    p_pin->risen = false;
+}
+
+/* GPIO and GPIOTE */
+
+void nrf_gpio_cfg_output(uint32_t pin_number) {
+}
+
+void nrf_gpio_pin_set(uint32_t pin_number) {
+    gpioOut[pin_number] = true;
+    simpwm_updatePin(pin_number);
+}
+
+void nrf_gpio_pin_clear(uint32_t pin_number) {
+    gpioOut[pin_number] = false;
+    simpwm_updatePin(pin_number);
+}
+
+void nrf_gpiote_task_config(uint32_t channel_number, uint32_t pin_number, nrf_gpiote_polarity_t polarity,
+	nrf_gpiote_outinit_t initial_value) {
+    gpioteConfigured[channel_number] = true;
+    gpiotePins[channel_number] = pin_number;
+    gpioteOut[channel_number] = (initial_value == NRF_GPIOTE_INITIAL_VALUE_HIGH);
+    simpwm_updatePin(pin_number);
+}
+
+void nrf_gpiote_unconfig(uint32_t channel_number) {
+    gpioteConfigured[channel_number] = false;
+    simpwm_updatePin(gpiotePins[channel_number]);
+}
+
+/* The SoftDevice, which is enabled on the modules */
+
+uint32_t sd_softdevice_is_enabled(uint8_t *p_softdevice_enabled) {
+    *p_softdevice_enabled = 1;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ppi_channel_assign(uint8_t channel_num, const volatile void *evt_endpoint,
+	const volatile void *task_endpoint) {
+    NRF_PPI->CH[channel_num].EEP = (uint32_t)evt_endpoint;
+    NRF_PPI->CH[channel_num].TEP = (uint32_t)task_endpoint;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ppi_channel_enable_set(uint32_t channel_enable_set_msk) {
+    NRF_PPI->CHENSET |= channel_enable_set_msk;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ppi_channel_enable_clr(uint32_t channel_enable_clr_msk) {
+    NRF_PPI->CHENCLR |= channel_enable_clr_msk;
+    return NRF_SUCCESS;
+}
+
+/* A delay stalls the CPU while the peripherals, and the RTC, keep going. */
+
+void nrf_delay_us(uint32_t volatile number_of_us) {
+    simpwm_run(now_counts + (uint64_t)number_of_us * (SIMPWM_CLOCK_HZ / 1000000));
+    simtimer_advance(simpwm_countsToTicks(now_counts));
+}
+
+void nrf_delay_ms(uint32_t volatile number_of_ms) {
+    nrf_delay_us(1000 * number_of_ms);
+}
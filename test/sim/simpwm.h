@@ -0,0 +1,45 @@
+/*
+ * simpwm.h
+ *
+ * Simulation of the peripherals behind pwm.c: TIMER2, counting at 16 MHz
+ * alongside the simulated RTC, whose compare events are connected through
+ * PPI channels to GPIOTE tasks which toggle the pins.  The time that each
+ * pin spends high, and the lengths of its pulses, are recorded, so that the
+ * waveform which the firmware sets up can be checked count by count.
+ *
+ * The peripherals run whenever time moves on, with the registers as they are
+ * then; task registers written in between (e.g. TASKS_STOP, TASKS_CLEAR and
+ * TASKS_START, in that order) take effect together.  Only the SoftDevice's
+ * PPI functions, the registers, and the GPIO and GPIOTE functions that pwm.c
+ * uses are provided.
+ */
+
+#ifndef SIMPWM_H_
+#define SIMPWM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SIMPWM_CLOCK_HZ		16000000
+
+typedef struct {
+    /* Time since the statistics were cleared, and the time spent high */
+    uint64_t window_counts;
+    uint64_t high_counts;
+    /* High pulses which started and ended since the statistics were
+     * cleared, and the shortest and longest of them */
+    uint32_t pulses;
+    uint32_t minPulse_counts;
+    uint32_t maxPulse_counts;
+} simpwmPinStats_t;
+
+/* Clears the peripherals and connects them to the simulated RTC. */
+void simpwm_reset(void);
+
+uint64_t simpwm_getTime(void);
+bool simpwm_getPinLevel(uint8_t pinNo);
+
+void simpwm_getPinStats(uint8_t pinNo, simpwmPinStats_t *p_stats);
+void simpwm_clearPinStats(uint8_t pinNo);
+
+#endif /* SIMPWM_H_ */
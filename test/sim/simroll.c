@@ -0,0 +1,367 @@
+/*
+ * simroll.c
+ *
+ * Host implementation of the flywheel, brake, IMU and light sensor interfaces
+ * used by motionEvent.c, on a simulated module rolling over a grid (see
+ * simroll.h).  The other actuators are absent: requests to use them fail.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "app_scheduler.h"
+#include "app_error.h"
+
+#include "global.h"
+#include "mpu6050.h"
+#include "sma.h"
+#include "mechbrake.h"
+#include "brakeprofile.h"
+#include "bldc.h"
+#include "imu.h"
+#include "fb.h"
+#include "light.h"
+#include "motionEvent.h"
+
+#include "simroll.h"
+
+static simrollConfig_t config;
+
+/* The module's orientation maps its own frame (that of frameFaceNormals) to
+ * the world's, whose z axis points up. */
+static int8_t orientation[3][3];
+static int16_t posX, posY;
+
+static uint16_t flywheelSpeed_rpm;
+static bool flywheelReverse;
+static uint8_t imuAddress = MPU6050_I2C_ADDR_CENTRAL;
+
+static simrollStatus_t status;
+
+static void simroll_rotate(const int8_t *v, int8_t *p_result) {
+    uint8_t i;
+
+    for (i = 0; i < 3; i++) {
+	p_result[i] = orientation[i][0] * v[0] + orientation[i][1] * v[1] + orientation[i][2] * v[2];
+    }
+}
+
+static double simroll_noise(double stdDev) {
+    double u1, u2;
+
+    if (stdDev <= 0.0) {
+	return 0.0;
+    }
+
+    u1 = (rand() + 1.0) / (RAND_MAX + 2.0);
+    u2 = (rand() + 1.0) / (RAND_MAX + 2.0);
+
+    return stdDev * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+/**@brief Tips the module over its bottom edge on the side of the given
+ * horizontal direction, onto the neighboring cell. */
+static void simroll_tip(int8_t dx, int8_t dy) {
+    /* A quarter turn about k = up x d takes the top face to d. */
+    const int8_t k[3] = {-dy, dx, 0};
+    int8_t turn[3][3], result[3][3];
+    uint8_t i, j;
+
+    for (i = 0; i < 3; i++) {
+	for (j = 0; j < 3; j++) {
+	    turn[i][j] = k[i] * k[j];
+	}
+    }
+    turn[0][1] -= k[2];
+    turn[0][2] += k[1];
+    turn[1][0] += k[2];
+    turn[1][2] -= k[0];
+    turn[2][0] -= k[1];
+    turn[2][1] += k[0];
+
+    for (i = 0; i < 3; i++) {
+	for (j = 0; j < 3; j++) {
+	    result[i][j] = turn[i][0] * orientation[0][j] + turn[i][1] * orientation[1][j] + turn[i][2] * orientation[2][j];
+	}
+    }
+    memcpy(orientation, result, sizeof(orientation));
+
+    posX += dx;
+    posY += dy;
+}
+
+static uint8_t simroll_getBottomFace(void) {
+    int8_t normal[3];
+    uint8_t faceNum;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	simroll_rotate(frameFaceNormals[faceNum-1], normal);
+	if (normal[2] == -1) {
+	    return faceNum;
+	}
+    }
+
+    return 0;
+}
+
+/**@brief Rolls the module about its flywheel axis, if that is horizontal. */
+static void simroll_roll(bool reverse) {
+    int8_t axis[3];
+    int8_t dx, dy;
+    double r;
+
+    status.rolls++;
+
+    simroll_rotate(frameFaceNormals[config.flywheelFace-1], axis);
+    r = (double)rand() / RAND_MAX;
+    if ((axis[2] != 0) || (r < config.failRate)) {
+	status.rollsFailed++;
+	return;
+    }
+
+    /* A forward roll goes along the flywheel's axis crossed with up. */
+    dx = reverse ? -axis[1] : axis[1];
+    dy = reverse ? axis[0] : -axis[0];
+    simroll_tip(dx, dy);
+    if (r < config.failRate + config.tumbleRate) {
+	simroll_tip(dx, dy);
+	status.rollsTumbled++;
+    }
+}
+
+static void simroll_putEvent(motionPrimitive_t motionPrimitive, app_sched_event_handler_t handler) {
+    uint32_t err_code;
+
+    if (handler != NULL) {
+	err_code = app_sched_event_put(&motionPrimitive, sizeof(motionPrimitive), handler);
+	APP_ERROR_CHECK(err_code);
+    }
+}
+
+void simroll_getDefaultConfig(simrollConfig_t *p_config) {
+    memset(p_config, 0, sizeof(*p_config));
+    p_config->lightHeight = 1.5;
+    p_config->lightGain = 1500.0;
+    p_config->lightAmbient = 20.0;
+    p_config->flywheelFace = 2;
+    p_config->seed = 1;
+}
+
+void simroll_init(const simrollConfig_t *p_config) {
+    config = *p_config;
+    srand(config.seed);
+    memset(&status, 0, sizeof(status));
+    simroll_place(0, 0, 6, 0);
+}
+
+bool simroll_place(int16_t x, int16_t y, uint8_t bottomFace, uint8_t turns) {
+    static const uint8_t perms[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+    int8_t normal[3], axis[3];
+    uint8_t p, s, i, found = 0;
+    int8_t det;
+
+    /* Try the 24 orientations of a cube (the signed permutation matrices of
+     * determinant 1) until the right one turns up. */
+    for (p = 0; p < 6; p++) {
+	for (s = 0; s < 8; s++) {
+	    memset(orientation, 0, sizeof(orientation));
+	    for (i = 0; i < 3; i++) {
+		orientation[i][perms[p][i]] = (s & (1 << i)) ? -1 : 1;
+	    }
+	    det = orientation[0][0] * (orientation[1][1] * orientation[2][2] - orientation[1][2] * orientation[2][1]) -
+		orientation[0][1] * (orientation[1][0] * orientation[2][2] - orientation[1][2] * orientation[2][0]) +
+		orientation[0][2] * (orientation[1][0] * orientation[2][1] - orientation[1][1] * orientation[2][0]);
+	    if (det != 1) {
+		continue;
+	    }
+
+	    simroll_rotate(frameFaceNormals[bottomFace-1], normal);
+	    if ((normal[2] == -1) && (found++ == turns % 4)) {
+		posX = x;
+		posY = y;
+		simroll_rotate(frameFaceNormals[config.flywheelFace-1], axis);
+		return (axis[2] == 0);
+	    }
+	}
+    }
+
+    return false;
+}
+
+double simroll_getLightDistance() {
+    return hypot(posX - config.lightX, posY - config.lightY);
+}
+
+void simroll_getStatus(simrollStatus_t *p_status) {
+    int8_t axis[3];
+
+    simroll_rotate(frameFaceNormals[config.flywheelFace-1], axis);
+
+    status.x = posX;
+    status.y = posY;
+    status.bottomFace = simroll_getBottomFace();
+    status.forwardX = (axis[2] == 0) ? axis[1] : 0;
+    status.forwardY = (axis[2] == 0) ? -axis[0] : 0;
+    *p_status = status;
+}
+
+/* Flywheel */
+
+bool bldc_setSpeed(uint16_t speed_rpm, bool reverse, uint16_t brakeTime_ms, app_sched_event_handler_t bldcEventHandler) {
+    /* The speed that the flywheel had when it was stopped is kept for the
+     * brake, which is applied right after. */
+    if (speed_rpm > 0) {
+	flywheelSpeed_rpm = speed_rpm;
+	flywheelReverse = reverse;
+	simroll_putEvent(MOTION_PRIMITIVE_BLDC_STABLE, bldcEventHandler);
+    } else {
+	simroll_putEvent(MOTION_PRIMITIVE_BLDC_STOPPED, bldcEventHandler);
+    }
+
+    return true;
+}
+
+bool bldc_setAccel(uint16_t accel_mA, uint16_t time_ms, bool reverse, app_sched_event_handler_t bldcEventHandler) {
+    return false;
+}
+
+bool mechbrake_actuate(uint8_t stepCount, const coilCurrentStep_t *steps, app_sched_event_handler_t brakeCompleteEventHandler) {
+    if (flywheelSpeed_rpm > 0) {
+	simroll_roll(flywheelReverse);
+	flywheelSpeed_rpm = 0;
+    }
+
+    simroll_putEvent(MOTION_PRIMITIVE_MECHBRAKE_SUCCESS, brakeCompleteEventHandler);
+
+    return true;
+}
+
+/* SMA actuator (plane changes are not simulated) */
+
+smaState_t sma_getState() {
+    return SMA_STATE_EXTENDED;
+}
+
+bool sma_retract(uint16_t holdTime_ms, app_sched_event_handler_t smaEventHandler) {
+    return false;
+}
+
+uint16_t sma_getHoldTimeRemaining_ms() {
+    return 0;
+}
+
+bool sma_extend(app_sched_event_handler_t smaEventHandler) {
+    return false;
+}
+
+/* Brake profiles (none are stored) */
+
+bool brakeprofile_get(uint8_t id, brakeProfile_t *p_profile) {
+    return false;
+}
+
+uint8_t brakeprofile_getSteps(uint8_t id, bool reverse, coilCurrentStep_t *steps, uint8_t maxSteps) {
+    return 0;
+}
+
+void brakeprofile_reportOutcome(uint8_t id, brakeProfileOutcome_t outcome) {
+}
+
+/* IMUs.  Both see the module's frame; the DMP's gravity vector points up. */
+
+bool mpu6050_setAddress(uint8_t address) {
+    imuAddress = address;
+    return true;
+}
+
+uint8_t mpu6050_getAddress() {
+    return imuAddress;
+}
+
+bool imu_getGravityFloat(vectorFloat_t *vf) {
+    vf->x = orientation[2][0] + simroll_noise(config.gravityNoise);
+    vf->y = orientation[2][1] + simroll_noise(config.gravityNoise);
+    vf->z = orientation[2][2] + simroll_noise(config.gravityNoise);
+    return true;
+}
+
+bool imu_getGyrosFloat(vectorFloat_t *vf) {
+    vf->x = 0.0f;
+    vf->y = 0.0f;
+    vf->z = 0.0f;
+    return true;
+}
+
+float imu_getVectorFloatMagnitude(const vectorFloat_t *v) {
+    return sqrtf(v->x * v->x + v->y * v->y + v->z * v->z);
+}
+
+float imu_getVectorFloatAngle(const vectorFloat_t *v, const vectorFloat_t *u) {
+    float dot = v->x * u->x + v->y * u->y + v->z * u->z;
+
+    return acosf(dot / (imu_getVectorFloatMagnitude(v) * imu_getVectorFloatMagnitude(u))) * 180.0f / (float)M_PI;
+}
+
+/* Light: each face sees the lamp with a cosine falloff over the square of
+ * the distance from the face's center. */
+
+int16_t fb_getAmbientLight(uint8_t faceNum) {
+    int8_t normal[3];
+    double v[3], r, cosine, level;
+
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return -1;
+    }
+
+    simroll_rotate(frameFaceNormals[faceNum-1], normal);
+    v[0] = config.lightX - (posX + 0.5 * normal[0]);
+    v[1] = config.lightY - (posY + 0.5 * normal[1]);
+    v[2] = config.lightHeight - (0.5 + 0.5 * normal[2]);
+    r = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    cosine = (normal[0] * v[0] + normal[1] * v[1] + normal[2] * v[2]) / r;
+
+    level = config.lightAmbient + simroll_noise(config.lightNoise);
+    if (cosine > 0.0) {
+	level += config.lightGain * cosine / (r * r);
+    }
+
+    if (level < 0.0) {
+	return 0;
+    } else if (level > 1023.0) {
+	return 1023;
+    }
+
+    return (int16_t)(level + 0.5);
+}
+
+bool light_isRunning() {
+    return false;
+}
+
+int16_t light_getFiltered(uint8_t faceNum) {
+    return -1;
+}
+
+/* Console */
+
+uint32_t app_uart_put_string(const char *str) {
+    if (config.print != NULL) {
+	config.print(str);
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_uart_put_debug(const char *str, bool debug) {
+    return debug ? app_uart_put_string(str) : NRF_SUCCESS;
+}
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+    fprintf(stderr, "error %lu at %s:%lu\n", (unsigned long)error_code, (const char *)p_file_name,
+	    (unsigned long)line_num);
+    abort();
+}
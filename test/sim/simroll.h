@@ -0,0 +1,74 @@
+/*
+ * simroll.h
+ *
+ * Simulator of one module rolling from cell to cell of a flat grid in the
+ * light of a single lamp, behind the interfaces that the motion code uses:
+ * the flywheel, the mechanical brake and the faceboard's IMU and light
+ * sensor.  Lengths are in module widths, and the module's position is that
+ * of the cell it rests on.
+ *
+ * An inertial actuation (a flywheel spin ended by the brake) rolls the module
+ * about its flywheel axis onto the neighboring cell, forward or in reverse
+ * with the flywheel's direction, provided that the axis is horizontal.  A
+ * configurable fraction of rolls fail to tip the module, and another fraction
+ * tumble it over twice.
+ */
+
+#ifndef SIMROLL_H_
+#define SIMROLL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    /* Position of the lamp */
+    double lightX;
+    double lightY;
+    double lightHeight;
+    /* Reading of a face which squarely faces the lamp from a distance of
+     * one module width, and the reading of a face in the dark */
+    double lightGain;
+    double lightAmbient;
+    /* Standard deviation of the noise on each light and gravity reading */
+    double lightNoise;
+    double gravityNoise;
+    /* Probability that a roll leaves the module where it was, and that it
+     * tumbles the module over twice */
+    double failRate;
+    double tumbleRate;
+    /* Face whose normal is parallel to the flywheel's axis */
+    uint8_t flywheelFace;
+    /* Seed for all of the simulation's randomness */
+    unsigned int seed;
+    /* Called with every string printed by the module (NULL to discard) */
+    void (*print)(const char *str);
+} simrollConfig_t;
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    uint8_t bottomFace;
+    /* Direction in which a forward roll would take the module, or 0, 0 if
+     * its flywheel's axis is vertical */
+    int8_t forwardX;
+    int8_t forwardY;
+    uint16_t rolls;
+    uint16_t rollsFailed;
+    uint16_t rollsTumbled;
+} simrollStatus_t;
+
+void simroll_getDefaultConfig(simrollConfig_t *p_config);
+void simroll_init(const simrollConfig_t *p_config);
+
+/* Places the module on the given cell, resting on the given face and turned
+ * about the vertical by the given number of quarter turns.  Returns whether
+ * the flywheel's axis is then horizontal, i.e. whether the module can roll. */
+bool simroll_place(int16_t x, int16_t y, uint8_t bottomFace, uint8_t turns);
+
+/* Returns the distance along the ground from the module's cell to the point
+ * below the lamp. */
+double simroll_getLightDistance(void);
+
+void simroll_getStatus(simrollStatus_t *p_status);
+
+#endif /* SIMROLL_H_ */
@@ -0,0 +1,75 @@
+/*
+ * simsma.c
+ *
+ * Host implementation of the power and thermal interfaces used by sma.c (see
+ * simsma.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app_error.h"
+
+#include "power.h"
+#include "thermal.h"
+
+#include "simsma.h"
+
+static uint16_t battery_mV;
+static bool ambientValid;
+static int16_t ambient_tenthDegC;
+static bool vbatswUsers[VBATSW_MAX_USERS];
+
+void simsma_reset() {
+    uint8_t i;
+
+    battery_mV = 14800;
+    ambientValid = true;
+    ambient_tenthDegC = 250;
+    for (i = 0; i < VBATSW_MAX_USERS; i++) {
+	vbatswUsers[i] = false;
+    }
+}
+
+void simsma_setBattery_mV(uint16_t newBattery_mV) {
+    battery_mV = newBattery_mV;
+}
+
+void simsma_setAmbient_tenthDegC(bool valid, int16_t newAmbient_tenthDegC) {
+    ambientValid = valid;
+    ambient_tenthDegC = newAmbient_tenthDegC;
+}
+
+bool simsma_isPowered() {
+    return vbatswUsers[VBATSW_USER_SMA];
+}
+
+/* Power */
+
+void power_setVBATSWState(vbatswUser_t userID, bool enabled) {
+    if (userID < VBATSW_MAX_USERS) {
+	vbatswUsers[userID] = enabled;
+    }
+}
+
+uint16_t power_getBatteryPackVoltage_mV() {
+    return battery_mV;
+}
+
+/* Thermal */
+
+bool thermal_isValid() {
+    return ambientValid;
+}
+
+int16_t thermal_getTemp_tenthDegC() {
+    return ambient_tenthDegC;
+}
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t *p_file_name) {
+    fprintf(stderr, "error %lu at %s:%lu\n", (unsigned long)error_code, (const char *)p_file_name,
+	    (unsigned long)line_num);
+    abort();
+}
@@ -0,0 +1,28 @@
+/*
+ * simsma.h
+ *
+ * Stand-ins for the parts of the module, other than the PWM hardware (see
+ * simpwm.h), that sma.c relies on: the battery pack and the switched battery
+ * supply which powers the SMA controller, and the daughterboard's
+ * thermometer.
+ */
+
+#ifndef SIMSMA_H_
+#define SIMSMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void simsma_reset(void);
+
+/* Sets the battery pack voltage reported to sma.c (0 if unknown). */
+void simsma_setBattery_mV(uint16_t battery_mV);
+
+/* Sets the ambient temperature reported by the thermometer, or makes it
+ * unknown. */
+void simsma_setAmbient_tenthDegC(bool valid, int16_t ambient_tenthDegC);
+
+/* Returns whether the SMA has asked for the switched battery supply. */
+bool simsma_isPowered(void);
+
+#endif /* SIMSMA_H_ */
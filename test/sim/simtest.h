@@ -0,0 +1,29 @@
+/*
+ * simtest.h
+ *
+ * Checks and reporting shared by the host tests.
+ */
+
+#ifndef SIMTEST_H_
+#define SIMTEST_H_
+
+#include <stdio.h>
+
+static int simtest_failures = 0;
+
+#define SIMTEST_CHECK(COND, ...)						\
+    do {									\
+	if (!(COND)) {								\
+	    simtest_failures++;							\
+	    printf("FAIL %s:%d: ", __FILE__, __LINE__);				\
+	    printf(__VA_ARGS__);						\
+	    printf("\n");							\
+	}									\
+    } while (0)
+
+static inline int simtest_finish(void) {
+    printf("%s\n", (simtest_failures == 0) ? "PASSED" : "FAILED");
+    return (simtest_failures == 0) ? 0 : 1;
+}
+
+#endif /* SIMTEST_H_ */
@@ -0,0 +1,45 @@
+/*
+ * simtimer.h
+ *
+ * Control of the simulated RTC behind app_timer.c and of the simulated
+ * scheduler behind app_scheduler.c.
+ */
+
+#ifndef SIMTIMER_H_
+#define SIMTIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Length of one RTC tick with the prescaler that the firmware uses */
+#define SIM_USEC_PER_TICK		(1000000.0 * (APP_TIMER_PRESCALER + 1) / APP_TIMER_CLOCK_FREQ)
+
+void simtimer_reset(void);
+
+/* The RTC is kept as a 64-bit count; the timer API sees its low 24 bits. */
+uint64_t simtimer_getTicks(void);
+
+/* Moves the RTC forward (never back) and queues the handlers of the timers
+ * which expired on the way, as the RTC interrupt would.  Nothing is run. */
+void simtimer_advance(uint64_t rtcTicks);
+
+/* Runs the scheduler until its queue is empty, as the main loop would. */
+void simtimer_runScheduler(void);
+
+/* Equivalent to simtimer_advance() followed by simtimer_runScheduler() */
+void simtimer_run(uint64_t rtcTicks);
+
+/* Called whenever the RTC is about to move forward, with the time that it
+ * moves to, so that simulated peripherals with clocks of their own can keep
+ * up with it. */
+typedef void (*simtimerAdvanceHandler_t)(uint64_t rtcTicks);
+void simtimer_setAdvanceHandler(simtimerAdvanceHandler_t handler);
+
+bool simtimer_getNextExpiry(uint64_t *p_rtcTicks);
+uint8_t simtimer_getTimerCount(void);
+
+void simsched_setQueueSize(uint8_t size);
+uint8_t simsched_getMaxDepth(void);
+uint32_t simsched_getEventCount(void);
+
+#endif /* SIMTIMER_H_ */
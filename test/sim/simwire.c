@@ -0,0 +1,75 @@
+/*
+ * simwire.c
+ *
+ * Simulated SMA wire (see simwire.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "smamodel.h"
+
+#include "simwire.h"
+
+/* Integration step, much shorter than the time constant */
+#define SIMWIRE_STEP_MS		1.0
+
+static simwireConfig_t config;
+static double temp;
+static double austenite;
+
+void simwire_getDefaultConfig(simwireConfig_t *p_config) {
+    p_config->timeConstant_ms = SMAMODEL_TIME_CONSTANT_MS;
+    p_config->fullDriveRise = SMAMODEL_FULL_DRIVE_RISE_TENTHDEGC / 10.0;
+    p_config->nominalBattery_mV = SMAMODEL_NOMINAL_BATTERY_MV;
+    p_config->batterySag_mV = 300.0;
+    p_config->austeniteFinish = SMAMODEL_AUSTENITE_FINISH_TENTHDEGC / 10.0;
+    p_config->austeniteStart = p_config->austeniteFinish - 10.0;
+    p_config->martensiteFinish = SMAMODEL_MARTENSITE_FINISH_TENTHDEGC / 10.0;
+    p_config->martensiteStart = p_config->martensiteFinish + 10.0;
+}
+
+void simwire_init(const simwireConfig_t *p_config, double newTemp) {
+    config = *p_config;
+    temp = newTemp;
+    austenite = (temp >= config.austeniteFinish) ? 1.0 : 0.0;
+}
+
+static void simwire_updatePhase(void) {
+    double a;
+
+    if (temp > config.austeniteStart) {
+	a = (temp - config.austeniteStart) / (config.austeniteFinish - config.austeniteStart);
+	a = (a > 1.0) ? 1.0 : a;
+	austenite = (a > austenite) ? a : austenite;
+    }
+
+    if (temp < config.martensiteStart) {
+	a = (temp - config.martensiteFinish) / (config.martensiteStart - config.martensiteFinish);
+	a = (a < 0.0) ? 0.0 : a;
+	austenite = (a < austenite) ? a : austenite;
+    }
+}
+
+void simwire_advance(double elapsed_ms, double duty, double battery_mV, double ambient) {
+    double steadyState, step_ms, voltage_mV;
+
+    voltage_mV = (duty > 0.0) ? battery_mV - config.batterySag_mV : battery_mV;
+    steadyState = ambient + config.fullDriveRise * duty * pow(voltage_mV / config.nominalBattery_mV, 2.0);
+
+    while (elapsed_ms > 0.0) {
+	step_ms = (elapsed_ms < SIMWIRE_STEP_MS) ? elapsed_ms : SIMWIRE_STEP_MS;
+	temp = steadyState + (temp - steadyState) * exp(-step_ms / config.timeConstant_ms);
+	simwire_updatePhase();
+	elapsed_ms -= step_ms;
+    }
+}
+
+double simwire_getTemp() {
+    return temp;
+}
+
+double simwire_getAustenite() {
+    return austenite;
+}
@@ -0,0 +1,46 @@
+/*
+ * simwire.h
+ *
+ * Simulated SMA wire: a lumped heat capacity heated by the PWM drive from the
+ * battery and cooled towards the ambient temperature, like the model in
+ * smamodel.h but with its own parameters, so that a wire which is slower,
+ * weaker or hotter than the model assumes can be tried.  Its phase follows
+ * the temperature with hysteresis: it turns to austenite (contracts) between
+ * the austenite start and finish temperatures while heating, and back to
+ * martensite between the martensite start and finish temperatures while
+ * cooling.  Temperatures are in degrees Celsius.
+ */
+
+#ifndef SIMWIRE_H_
+#define SIMWIRE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    double timeConstant_ms;
+    /* Rise above ambient at 100% duty from a battery at the nominal voltage */
+    double fullDriveRise;
+    double nominalBattery_mV;
+    /* Drop in the battery's voltage while it drives the wire */
+    double batterySag_mV;
+    double austeniteStart;
+    double austeniteFinish;
+    double martensiteStart;
+    double martensiteFinish;
+} simwireConfig_t;
+
+/* The nominal wire of smamodel.h */
+void simwire_getDefaultConfig(simwireConfig_t *p_config);
+void simwire_init(const simwireConfig_t *p_config, double temp);
+
+/* Advances the wire by the given time, during which it was driven with the
+ * given duty (0 to 1). */
+void simwire_advance(double elapsed_ms, double duty, double battery_mV, double ambient);
+
+double simwire_getTemp(void);
+
+/* Fraction of the wire in austenite, i.e. contracted (0 to 1) */
+double simwire_getAustenite(void);
+
+#endif /* SIMWIRE_H_ */
@@ -0,0 +1,20 @@
+/*
+ * app_scheduler.h
+ *
+ * Host stand-in for the SDK header of the same name, implemented by
+ * sim/app_scheduler.c.
+ */
+
+#ifndef APP_SCHEDULER_H__
+#define APP_SCHEDULER_H__
+
+#include <stdint.h>
+
+#include "app_error.h"
+
+typedef void (*app_sched_event_handler_t)(void *p_event_data, uint16_t event_size);
+
+uint32_t app_sched_event_put(void *p_event_data, uint16_t event_size, app_sched_event_handler_t handler);
+void app_sched_execute(void);
+
+#endif /* APP_SCHEDULER_H__ */
@@ -0,0 +1,45 @@
+/*
+ * app_timer.h
+ *
+ * Host stand-in for the SDK header of the same name.  The API is implemented
+ * by sim/app_timer.c on a simulated RTC, with the same limits as the SDK: a
+ * 24-bit counter, a minimum timeout, and a start of a running timer being
+ * ignored.  Timer handlers are run through the simulated scheduler, as on
+ * the modules.
+ */
+
+#ifndef APP_TIMER_H__
+#define APP_TIMER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_error.h"
+#include "app_util.h"
+#include "app_scheduler.h"
+
+#define APP_TIMER_CLOCK_FREQ		32768
+#define APP_TIMER_MIN_TIMEOUT_TICKS	5
+
+#define APP_TIMER_TICKS(MS, PRESCALER)						\
+    ((uint32_t)ROUNDED_DIV((MS) * (uint64_t)APP_TIMER_CLOCK_FREQ, ((PRESCALER) + 1) * 1000))
+
+typedef uint32_t app_timer_id_t;
+
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+
+typedef enum {
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+#define TIMER_NULL			((app_timer_id_t)(0 - 1))
+
+uint32_t app_timer_create(app_timer_id_t *p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler);
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void *p_context);
+uint32_t app_timer_stop(app_timer_id_t timer_id);
+uint32_t app_timer_stop_all(void);
+uint32_t app_timer_cnt_get(uint32_t *p_ticks);
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from, uint32_t *p_ticks_diff);
+
+#endif /* APP_TIMER_H__ */
@@ -0,0 +1,12 @@
+/*
+ * app_util.h
+ *
+ * Host stand-in for the SDK header of the same name.
+ */
+
+#ifndef APP_UTIL_H__
+#define APP_UTIL_H__
+
+#include "nordic_common.h"
+
+#endif /* APP_UTIL_H__ */
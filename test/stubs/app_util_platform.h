@@ -0,0 +1,24 @@
+/*
+ * app_util_platform.h
+ *
+ * Host stand-in for the SDK header of the same name.  A critical region holds
+ * off the simulated interrupts (see simadc.h) until it ends.
+ */
+
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include <stdint.h>
+
+typedef enum {
+    APP_IRQ_PRIORITY_HIGH = 1,
+    APP_IRQ_PRIORITY_LOW = 3
+} app_irq_priority_t;
+
+void sim_criticalRegionEnter(void);
+void sim_criticalRegionExit(void);
+
+#define CRITICAL_REGION_ENTER()		{ sim_criticalRegionEnter();
+#define CRITICAL_REGION_EXIT()		sim_criticalRegionExit(); }
+
+#endif /* APP_UTIL_PLATFORM_H__ */
@@ -0,0 +1,18 @@
+/*
+ * ble.h
+ *
+ * Host stand-in for the SoftDevice header of the same name, so that modules
+ * which include the BLE services' headers build.  No BLE events are ever
+ * delivered.
+ */
+
+#ifndef BLE_H__
+#define BLE_H__
+
+#include <stdint.h>
+
+typedef struct {
+    uint16_t evt_id;
+} ble_evt_t;
+
+#endif /* BLE_H__ */
@@ -0,0 +1,19 @@
+/*
+ * ble_srv_common.h
+ *
+ * Host stand-in for the SDK header of the same name.
+ */
+
+#ifndef BLE_SRV_COMMON_H__
+#define BLE_SRV_COMMON_H__
+
+#include <stdint.h>
+
+typedef struct {
+    uint16_t value_handle;
+    uint16_t user_desc_handle;
+    uint16_t cccd_handle;
+    uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+#endif /* BLE_SRV_COMMON_H__ */
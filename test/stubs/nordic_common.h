@@ -0,0 +1,18 @@
+/*
+ * nordic_common.h
+ *
+ * Host stand-in for the SDK header of the same name.
+ */
+
+#ifndef NORDIC_COMMON_H__
+#define NORDIC_COMMON_H__
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+
+#define UNUSED_PARAMETER(X) (void)(X)
+
+#define ROUNDED_DIV(A, B) (((A) + ((B) / 2)) / (B))
+#define CEIL_DIV(A, B) (((A) - 1) / (B) + 1)
+
+#endif /* NORDIC_COMMON_H__ */
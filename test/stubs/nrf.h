@@ -0,0 +1,49 @@
+/*
+ * nrf.h
+ *
+ * Host stand-in for the device header.  Only the peripherals which the
+ * simulated modules touch are provided, each backed by an ordinary variable.
+ */
+
+#ifndef NRF_H
+#define NRF_H
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t READY;
+    volatile uint32_t CONFIG;
+    volatile uint32_t ERASEPAGE;
+    volatile uint32_t ERASEALL;
+} NRF_NVMC_Type;
+
+typedef struct {
+    volatile uint32_t DEVICEADDR[2];
+} NRF_FICR_Type;
+
+typedef struct {
+    volatile uint32_t AIRCR;
+} SCB_Type;
+
+extern NRF_NVMC_Type sim_NVMC;
+extern NRF_FICR_Type sim_FICR;
+extern SCB_Type sim_SCB;
+
+#define NRF_NVMC			(&sim_NVMC)
+#define NRF_FICR			(&sim_FICR)
+#define SCB				(&sim_SCB)
+
+#define SCB_AIRCR_VECTKEY_Pos		16
+#define SCB_AIRCR_SYSRESETREQ_Msk	(1UL << 2)
+
+#define NVMC_READY_READY_Busy		(0UL)
+#define NVMC_CONFIG_WEN_Pos		(0UL)
+#define NVMC_CONFIG_WEN_Ren		(0x00UL)
+#define NVMC_CONFIG_WEN_Wen		(0x01UL)
+#define NVMC_CONFIG_WEN_Een		(0x02UL)
+
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+static inline void NVIC_SystemReset(void) {}
+
+#endif /* NRF_H */
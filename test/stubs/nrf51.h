@@ -0,0 +1,99 @@
+/*
+ * nrf51.h
+ *
+ * Host stand-in for the device header, for modules which name the nRF51's
+ * peripherals directly.  Only the registers which they touch are provided,
+ * each backed by an ordinary variable.  Writes to the task registers take
+ * effect when the simulation behind them next runs (see simpwm.h).  The ADC
+ * is reached through a function, which runs its simulation before every
+ * access (see simadc.h).
+ */
+
+#ifndef NRF51_H
+#define NRF51_H
+
+#include <stdint.h>
+
+typedef enum {
+    ADC_IRQn = 7,
+    TIMER2_IRQn = 10
+} IRQn_Type;
+
+typedef struct {
+    volatile uint32_t ENABLE;
+} NRF_TWI_Type;
+
+typedef struct {
+    volatile uint32_t OUTSET;
+    volatile uint32_t OUTCLR;
+    volatile uint32_t IN;
+    volatile uint32_t DIRSET;
+    volatile uint32_t DIRCLR;
+    volatile uint32_t PIN_CNF[32];
+} NRF_GPIO_Type;
+
+typedef struct {
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t TASKS_COUNT;
+    volatile uint32_t TASKS_CLEAR;
+    volatile uint32_t TASKS_CAPTURE[4];
+    volatile uint32_t EVENTS_COMPARE[4];
+    volatile uint32_t SHORTS;
+    volatile uint32_t INTENSET;
+    volatile uint32_t INTENCLR;
+    volatile uint32_t MODE;
+    volatile uint32_t BITMODE;
+    volatile uint32_t PRESCALER;
+    volatile uint32_t CC[4];
+} NRF_TIMER_Type;
+
+typedef struct {
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t EVENTS_END;
+    volatile uint32_t INTENSET;
+    volatile uint32_t INTENCLR;
+    volatile uint32_t BUSY;
+    volatile uint32_t ENABLE;
+    volatile uint32_t CONFIG;
+    volatile uint32_t RESULT;
+} NRF_ADC_Type;
+
+typedef struct {
+    volatile uint32_t TASKS_OUT[4];
+    volatile uint32_t CONFIG[4];
+} NRF_GPIOTE_Type;
+
+typedef struct {
+    volatile uint32_t EEP;
+    volatile uint32_t TEP;
+} PPI_CH_Type;
+
+typedef struct {
+    volatile uint32_t CHEN;
+    volatile uint32_t CHENSET;
+    volatile uint32_t CHENCLR;
+    PPI_CH_Type CH[16];
+} NRF_PPI_Type;
+
+extern NRF_TWI_Type sim_TWI1;
+extern NRF_GPIO_Type sim_GPIO;
+extern NRF_TIMER_Type sim_TIMER2;
+extern NRF_GPIOTE_Type sim_GPIOTE;
+extern NRF_PPI_Type sim_PPI;
+NRF_ADC_Type *sim_ADC(void);
+
+#define NRF_TWI1			(&sim_TWI1)
+#define NRF_GPIO			(&sim_GPIO)
+#define NRF_TIMER2			(&sim_TIMER2)
+#define NRF_GPIOTE			(&sim_GPIOTE)
+#define NRF_PPI				(&sim_PPI)
+#define NRF_ADC				(sim_ADC())
+
+static inline void NVIC_DisableIRQ(IRQn_Type IRQn) {}
+static inline void NVIC_ClearPendingIRQ(IRQn_Type IRQn) {}
+static inline void NVIC_SetPriority(IRQn_Type IRQn, uint32_t priority) {}
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+
+#endif /* NRF51_H */
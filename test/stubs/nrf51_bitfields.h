@@ -0,0 +1,81 @@
+/*
+ * nrf51_bitfields.h
+ *
+ * Host stand-in for the device header of the same name, with the fields of
+ * the registers in nrf51.h.
+ */
+
+#ifndef NRF51_BITFIELDS_H
+#define NRF51_BITFIELDS_H
+
+#define TWI_ENABLE_ENABLE_Pos		(0UL)
+#define TWI_ENABLE_ENABLE_Disabled	(0x00UL)
+#define TWI_ENABLE_ENABLE_Enabled	(0x05UL)
+
+#define ADC_INTENSET_END_Pos		(0UL)
+#define ADC_INTENSET_END_Msk		(1UL << ADC_INTENSET_END_Pos)
+#define ADC_ENABLE_ENABLE_Pos		(0UL)
+#define ADC_ENABLE_ENABLE_Disabled	(0x00UL)
+#define ADC_ENABLE_ENABLE_Enabled	(0x01UL)
+#define ADC_CONFIG_RES_Pos		(0UL)
+#define ADC_CONFIG_RES_10bit		(0x02UL)
+#define ADC_CONFIG_INPSEL_Pos		(2UL)
+#define ADC_CONFIG_INPSEL_AnalogInputOneThirdPrescaling	(0x02UL)
+#define ADC_CONFIG_REFSEL_Pos		(5UL)
+#define ADC_CONFIG_REFSEL_VBG		(0x00UL)
+#define ADC_CONFIG_PSEL_Pos		(8UL)
+#define ADC_CONFIG_PSEL_Msk		(0xFFUL << ADC_CONFIG_PSEL_Pos)
+#define ADC_CONFIG_EXTREFSEL_Pos	(16UL)
+#define ADC_CONFIG_EXTREFSEL_None	(0UL)
+
+#define GPIO_PIN_CNF_DIR_Pos		(0UL)
+#define GPIO_PIN_CNF_DIR_Input		(0UL)
+#define GPIO_PIN_CNF_DIR_Output		(1UL)
+#define GPIO_PIN_CNF_DIR_Msk		(1UL << GPIO_PIN_CNF_DIR_Pos)
+#define GPIO_PIN_CNF_INPUT_Pos		(1UL)
+#define GPIO_PIN_CNF_INPUT_Disconnect	(1UL)
+#define GPIO_PIN_CNF_PULL_Pos		(2UL)
+#define GPIO_PIN_CNF_PULL_Disabled	(0UL)
+#define GPIO_PIN_CNF_DRIVE_Pos		(8UL)
+#define GPIO_PIN_CNF_DRIVE_S0S1		(0UL)
+#define GPIO_PIN_CNF_SENSE_Pos		(16UL)
+#define GPIO_PIN_CNF_SENSE_Disabled	(0UL)
+
+#define TIMER_SHORTS_COMPARE0_CLEAR_Pos		(0UL)
+#define TIMER_SHORTS_COMPARE0_CLEAR_Enabled	(1UL)
+#define TIMER_SHORTS_COMPARE0_STOP_Pos		(8UL)
+#define TIMER_SHORTS_COMPARE0_STOP_Enabled	(1UL)
+
+#define TIMER_INTENCLR_COMPARE0_Msk	(1UL << 16)
+#define TIMER_INTENCLR_COMPARE1_Msk	(1UL << 17)
+#define TIMER_INTENCLR_COMPARE2_Msk	(1UL << 18)
+#define TIMER_INTENCLR_COMPARE3_Msk	(1UL << 19)
+
+#define TIMER_MODE_MODE_Timer		(0UL)
+#define TIMER_BITMODE_BITMODE_32Bit	(3UL)
+
+#define PPI_CHEN_CH0_Msk		(1UL << 0)
+#define PPI_CHEN_CH1_Msk		(1UL << 1)
+#define PPI_CHEN_CH2_Msk		(1UL << 2)
+#define PPI_CHEN_CH3_Msk		(1UL << 3)
+#define PPI_CHEN_CH4_Msk		(1UL << 4)
+#define PPI_CHEN_CH5_Msk		(1UL << 5)
+#define PPI_CHEN_CH6_Msk		(1UL << 6)
+
+#define PPI_CHENSET_CH0_Msk		PPI_CHEN_CH0_Msk
+#define PPI_CHENSET_CH1_Msk		PPI_CHEN_CH1_Msk
+#define PPI_CHENSET_CH2_Msk		PPI_CHEN_CH2_Msk
+#define PPI_CHENSET_CH3_Msk		PPI_CHEN_CH3_Msk
+#define PPI_CHENSET_CH4_Msk		PPI_CHEN_CH4_Msk
+#define PPI_CHENSET_CH5_Msk		PPI_CHEN_CH5_Msk
+#define PPI_CHENSET_CH6_Msk		PPI_CHEN_CH6_Msk
+
+#define PPI_CHENCLR_CH0_Msk		PPI_CHEN_CH0_Msk
+#define PPI_CHENCLR_CH1_Msk		PPI_CHEN_CH1_Msk
+#define PPI_CHENCLR_CH2_Msk		PPI_CHEN_CH2_Msk
+#define PPI_CHENCLR_CH3_Msk		PPI_CHEN_CH3_Msk
+#define PPI_CHENCLR_CH4_Msk		PPI_CHEN_CH4_Msk
+#define PPI_CHENCLR_CH5_Msk		PPI_CHEN_CH5_Msk
+#define PPI_CHENCLR_CH6_Msk		PPI_CHEN_CH6_Msk
+
+#endif /* NRF51_BITFIELDS_H */
@@ -0,0 +1,13 @@
+/*
+ * nrf_assert.h
+ *
+ * Host stand-in for the SDK header of the same name.  Assertions are
+ * compiled out, as in the firmware's release build.
+ */
+
+#ifndef NRF_ASSERT_H_
+#define NRF_ASSERT_H_
+
+#define ASSERT(expr)
+
+#endif /* NRF_ASSERT_H_ */
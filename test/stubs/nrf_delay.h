@@ -0,0 +1,16 @@
+/*
+ * nrf_delay.h
+ *
+ * Host stand-in for the SDK header of the same name.  A delay stalls the
+ * simulated module, whose clock keeps running meanwhile.
+ */
+
+#ifndef NRF_DELAY_H__
+#define NRF_DELAY_H__
+
+#include <stdint.h>
+
+void nrf_delay_us(uint32_t volatile number_of_us);
+void nrf_delay_ms(uint32_t volatile number_of_ms);
+
+#endif /* NRF_DELAY_H__ */
@@ -0,0 +1,20 @@
+/*
+ * nrf_gpio.h
+ *
+ * Host stand-in for the SDK header of the same name.  The pins are those of
+ * the simulation that the test is linked with (see simpwm.h and simpower.h).
+ */
+
+#ifndef NRF_GPIO_H__
+#define NRF_GPIO_H__
+
+#include <stdint.h>
+
+#include "nrf51.h"
+#include "nrf51_bitfields.h"
+
+void nrf_gpio_cfg_output(uint32_t pin_number);
+void nrf_gpio_pin_set(uint32_t pin_number);
+void nrf_gpio_pin_clear(uint32_t pin_number);
+
+#endif /* NRF_GPIO_H__ */
@@ -0,0 +1,28 @@
+/*
+ * nrf_gpiote.h
+ *
+ * Host stand-in for the SDK header of the same name.  The task blocks are
+ * those of the simulated peripherals (see simpwm.h).
+ */
+
+#ifndef NRF_GPIOTE_H__
+#define NRF_GPIOTE_H__
+
+#include <stdint.h>
+
+typedef enum {
+    NRF_GPIOTE_POLARITY_LOTOHI = 1,
+    NRF_GPIOTE_POLARITY_HITOLO,
+    NRF_GPIOTE_POLARITY_TOGGLE
+} nrf_gpiote_polarity_t;
+
+typedef enum {
+    NRF_GPIOTE_INITIAL_VALUE_LOW = 0,
+    NRF_GPIOTE_INITIAL_VALUE_HIGH
+} nrf_gpiote_outinit_t;
+
+void nrf_gpiote_task_config(uint32_t channel_number, uint32_t pin_number, nrf_gpiote_polarity_t polarity,
+	nrf_gpiote_outinit_t initial_value);
+void nrf_gpiote_unconfig(uint32_t channel_number);
+
+#endif /* NRF_GPIOTE_H__ */
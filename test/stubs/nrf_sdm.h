@@ -0,0 +1,17 @@
+/*
+ * nrf_sdm.h
+ *
+ * Host stand-in for the SoftDevice header of the same name.
+ */
+
+#ifndef NRF_SDM_H__
+#define NRF_SDM_H__
+
+#include <stdint.h>
+
+#include "nrf_error.h"
+
+uint32_t sd_softdevice_disable(void);
+uint32_t sd_softdevice_is_enabled(uint8_t *p_softdevice_enabled);
+
+#endif /* NRF_SDM_H__ */
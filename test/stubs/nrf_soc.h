@@ -0,0 +1,47 @@
+/*
+ * nrf_soc.h
+ *
+ * Host stand-in for the SoftDevice header of the same name.  Flash operations
+ * are implemented by the simulation, which reports their completion through
+ * a later system event, as the SoftDevice does.
+ */
+
+#ifndef NRF_SOC_H__
+#define NRF_SOC_H__
+
+#include <stdint.h>
+
+#include "nrf_error.h"
+#include "nrf51.h"
+
+typedef enum {
+    NRF_APP_PRIORITY_HIGH = 1,
+    NRF_APP_PRIORITY_LOW = 3
+} nrf_app_irq_priority_t;
+
+enum NRF_SOC_EVTS {
+    NRF_EVT_HFCLKSTARTED,
+    NRF_EVT_POWER_FAILURE_WARNING,
+    NRF_EVT_FLASH_OPERATION_SUCCESS,
+    NRF_EVT_FLASH_OPERATION_ERROR,
+    NRF_EVT_RADIO_BLOCKED,
+    NRF_EVT_RADIO_CANCELED,
+    NRF_EVT_RADIO_SIGNAL_CALLBACK_INVALID_RETURN,
+    NRF_EVT_RADIO_SESSION_IDLE,
+    NRF_EVT_RADIO_SESSION_CLOSED,
+    NRF_EVT_NUMBER_OF_EVTS
+};
+
+uint32_t sd_flash_write(uint32_t * const p_dst, uint32_t const * const p_src, uint32_t size);
+uint32_t sd_flash_page_erase(uint32_t page_number);
+
+uint32_t sd_ppi_channel_assign(uint8_t channel_num, const volatile void *evt_endpoint,
+	const volatile void *task_endpoint);
+uint32_t sd_ppi_channel_enable_set(uint32_t channel_enable_set_msk);
+uint32_t sd_ppi_channel_enable_clr(uint32_t channel_enable_clr_msk);
+
+uint32_t sd_nvic_ClearPendingIRQ(IRQn_Type IRQn);
+uint32_t sd_nvic_SetPriority(IRQn_Type IRQn, nrf_app_irq_priority_t priority);
+uint32_t sd_nvic_EnableIRQ(IRQn_Type IRQn);
+
+#endif /* NRF_SOC_H__ */
@@ -0,0 +1,31 @@
+/*
+ * twi_master.h
+ *
+ * Host stand-in for the SDK's software TWI master.  Transfers reach the
+ * simulated devices on the bus rather than the pins, which are only written
+ * to when the bus is reset by hand.
+ */
+
+#ifndef TWI_MASTER_H
+#define TWI_MASTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nrf51.h"
+
+#define TWI_READ_BIT			(0x01)
+#define TWI_ISSUE_STOP			((bool)true)
+#define TWI_DONT_ISSUE_STOP		((bool)false)
+
+#define TWI_SCL_HIGH()		do { NRF_GPIO->OUTSET = (1UL << TWI_MASTER_CONFIG_CLOCK_PIN_NUMBER); } while(0)
+#define TWI_SCL_LOW()		do { NRF_GPIO->OUTCLR = (1UL << TWI_MASTER_CONFIG_CLOCK_PIN_NUMBER); } while(0)
+#define TWI_SCL_INPUT()		do { NRF_GPIO->DIRCLR = (1UL << TWI_MASTER_CONFIG_CLOCK_PIN_NUMBER); } while(0)
+#define TWI_SCL_OUTPUT()	do { NRF_GPIO->DIRSET = (1UL << TWI_MASTER_CONFIG_CLOCK_PIN_NUMBER); } while(0)
+
+bool twi_master_init(void);
+void twi_master_deinit(void);
+bool twi_master_get_init(void);
+bool twi_master_transfer(uint8_t address, uint8_t *data, uint8_t data_length, bool issue_stop_condition);
+
+#endif /* TWI_MASTER_H */
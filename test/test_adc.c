@@ -0,0 +1,305 @@
+/*
+ * test_adc.c
+ *
+ * The interrupt-driven conversion sequences of adc.c on a simulated ADC:
+ * whether each channel of a sequence is converted the requested number of
+ * times, in order, and its samples averaged; whether sequences started while
+ * another runs are queued and run in turn, including one which its handler
+ * restarts, with each handler called once through the scheduler; and whether
+ * a blocking read issued during a sequence waits for it, rather than
+ * reconfiguring the ADC under it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "adc.h"
+
+#include "simtimer.h"
+#include "simadc.h"
+#include "simtest.h"
+
+/* One count of the 10-bit result is about 3.5 mV. */
+#define MAX_ERROR_MV		4
+
+/* Time allowed for the queued sequences to finish */
+#define IDLE_TIMEOUT_MS		2000
+
+/* Sequences started by the queueing test, and the times that the restarted
+ * one runs */
+#define QUEUED_SEQUENCES	3
+#define RESTARTS		4
+
+static const uint16_t inputs_mV[8] = {150, 420, 960, 1330, 1875, 2210, 2790, 3300};
+
+static adcSequence_t *completions[16];
+static uint8_t completionCount;
+static uint8_t restartsLeft;
+
+static void sequenceHandler(adcSequence_t *p_sequence) {
+    if (completionCount < sizeof(completions) / sizeof(completions[0])) {
+	completions[completionCount] = p_sequence;
+    }
+    completionCount++;
+}
+
+/**@brief Restarts its sequence until restartsLeft runs out, as the power
+ * module's background sampling does. */
+static void restartHandler(adcSequence_t *p_sequence) {
+    sequenceHandler(p_sequence);
+
+    if (restartsLeft > 0) {
+	restartsLeft--;
+	SIMTEST_CHECK(adc_startSequence(p_sequence), "sequence not restarted from its handler");
+    }
+}
+
+static void setSequence(adcSequence_t *p_sequence, uint8_t channelCount, const uint8_t *channels,
+	const uint8_t *samples, adc_sequenceHandler_t handler) {
+    memset(p_sequence, 0, sizeof(*p_sequence));
+    p_sequence->channelCount = channelCount;
+    memcpy(p_sequence->channels, channels, channelCount);
+    memcpy(p_sequence->samples, samples, channelCount);
+    p_sequence->handler = handler;
+}
+
+/**@brief Waits for the queued sequences to finish and calls their handlers,
+ * until no handler starts another.  Returns false on a timeout. */
+static bool waitIdle(void) {
+    struct timespec start, now;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    do {
+	while (adc_isBusy()) {
+	    clock_gettime(CLOCK_MONOTONIC, &now);
+	    if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 > IDLE_TIMEOUT_MS) {
+		return false;
+	    }
+	}
+	simtimer_runScheduler();
+    } while (adc_isBusy());
+
+    return true;
+}
+
+/**@brief Checks that the simulated ADC converted the given sequence's
+ * channels, each as often as requested, from the given point in its log, and
+ * returns the point at which the sequence's conversions end. */
+static uint16_t checkConversions(const adcSequence_t *p_sequence, const simadcStatus_t *p_status, uint16_t index,
+	const char *name) {
+    uint8_t i, nsamples, s;
+
+    for (i = 0; i < p_sequence->channelCount; i++) {
+	nsamples = (p_sequence->samples[i] == 0) ? 1 : p_sequence->samples[i];
+	for (s = 0; s < nsamples; s++, index++) {
+	    if ((index >= p_status->logLength) || (p_status->log[index] != p_sequence->channels[i])) {
+		SIMTEST_CHECK(false, "%s: conversion %u of channel %u is missing", name, s + 1,
+			p_sequence->channels[i]);
+		return index;
+	    }
+	}
+    }
+
+    return index;
+}
+
+/**@brief Checks a finished sequence's averaged results against its inputs. */
+static void checkResults(const adcSequence_t *p_sequence, const char *name) {
+    uint8_t i, channel;
+
+    for (i = 0; i < p_sequence->channelCount; i++) {
+	channel = p_sequence->channels[i];
+	SIMTEST_CHECK(abs((int)p_sequence->results_mV[i] - (int)inputs_mV[channel]) <= MAX_ERROR_MV,
+		"%s: channel %u read as %u mV rather than %u mV", name, channel, p_sequence->results_mV[i],
+		inputs_mV[channel]);
+    }
+    SIMTEST_CHECK(!p_sequence->busy, "%s: still busy", name);
+}
+
+static void checkADCUse(const simadcStatus_t *p_status) {
+    SIMTEST_CHECK(p_status->startsWhileDisabled == 0, "%u conversions started with the ADC disabled",
+	    p_status->startsWhileDisabled);
+    SIMTEST_CHECK(p_status->configChanges == 0, "configuration changed during %u conversions",
+	    p_status->configChanges);
+}
+
+static void clearStats(void) {
+    adc_clearStats();
+    simadc_clearStatus();
+    completionCount = 0;
+}
+
+/**@brief A single sequence, whose channels are oversampled by different
+ * counts (0 counting as 1). */
+static void testOversampling(void) {
+    static const uint8_t channels[3] = {2, 5, 6};
+    static const uint8_t samples[3] = {0, 8, 32};
+    adcSequence_t sequence;
+    simadcStatus_t status;
+    adcStats_t stats;
+    uint16_t end;
+
+    printf("oversampling\n");
+
+    clearStats();
+    setSequence(&sequence, 3, channels, samples, sequenceHandler);
+    SIMTEST_CHECK(adc_startSequence(&sequence), "sequence refused");
+    SIMTEST_CHECK(!adc_startSequence(&sequence), "busy sequence accepted");
+    SIMTEST_CHECK(waitIdle(), "sequence did not finish");
+
+    simadc_getStatus(&status);
+    adc_getStats(&stats);
+
+    printf("  %lu conversions, %lu interrupts: %u, %u and %u mV\n", (unsigned long)status.conversions,
+	    (unsigned long)status.interrupts, sequence.results_mV[0], sequence.results_mV[1], sequence.results_mV[2]);
+
+    end = checkConversions(&sequence, &status, 0, "sequence");
+    SIMTEST_CHECK(end == status.logLength, "%u conversions rather than %u", status.logLength, end);
+    SIMTEST_CHECK(status.interrupts == status.conversions, "%lu interrupts for %lu conversions",
+	    (unsigned long)status.interrupts, (unsigned long)status.conversions);
+    SIMTEST_CHECK((stats.sequences == 1) && (stats.conversions == status.conversions) && (stats.dropped == 0),
+	    "%u sequences, %lu conversions, %u dropped", stats.sequences, (unsigned long)stats.conversions,
+	    stats.dropped);
+    SIMTEST_CHECK((completionCount == 1) && (completions[0] == &sequence), "handler called %u times",
+	    completionCount);
+    checkResults(&sequence, "sequence");
+    checkADCUse(&status);
+}
+
+/**@brief Sequences started while another is running, one of which restarts
+ * itself from its handler. */
+static void testQueue(void) {
+    static const uint8_t channels[QUEUED_SEQUENCES][3] = {{0, 1, 3}, {4, 7, 0}, {6, 2, 5}};
+    static const uint8_t samples[QUEUED_SEQUENCES][3] = {{16, 4, 2}, {1, 8, 3}, {2, 2, 2}};
+    static const char *names[QUEUED_SEQUENCES] = {"first", "second", "third"};
+    adcSequence_t sequences[QUEUED_SEQUENCES];
+    simadcStatus_t status;
+    adcStats_t stats;
+    uint16_t index;
+    uint8_t i;
+
+    printf("queued sequences\n");
+
+    clearStats();
+    restartsLeft = RESTARTS;
+    for (i = 0; i < QUEUED_SEQUENCES; i++) {
+	setSequence(&sequences[i], 3, channels[i], samples[i], (i == 1) ? restartHandler : sequenceHandler);
+	SIMTEST_CHECK(adc_startSequence(&sequences[i]), "%s sequence refused", names[i]);
+    }
+    SIMTEST_CHECK(waitIdle(), "sequences did not finish");
+
+    simadc_getStatus(&status);
+    adc_getStats(&stats);
+
+    printf("  %u sequences, %lu conversions, %u handler calls\n", stats.sequences,
+	    (unsigned long)status.conversions, completionCount);
+
+    /* The sequences run in the order in which they were started, and the
+     * restarted one then runs again each time its handler restarts it. */
+    index = 0;
+    for (i = 0; i < QUEUED_SEQUENCES; i++) {
+	index = checkConversions(&sequences[i], &status, index, names[i]);
+	SIMTEST_CHECK((i < completionCount) && (completions[i] == &sequences[i]), "%s handler out of order",
+		names[i]);
+	checkResults(&sequences[i], names[i]);
+    }
+    for (i = 0; i < RESTARTS; i++) {
+	index = checkConversions(&sequences[1], &status, index, "restarted");
+    }
+    SIMTEST_CHECK(index == status.logLength, "%u conversions rather than %u", status.logLength, index);
+    SIMTEST_CHECK((stats.sequences == QUEUED_SEQUENCES + RESTARTS) && (completionCount == stats.sequences),
+	    "%u sequences, %u handler calls", stats.sequences, completionCount);
+    SIMTEST_CHECK(stats.blockingWaits == 0, "%u blocking waits", stats.blockingWaits);
+    checkADCUse(&status);
+}
+
+/**@brief Blocking reads issued while a sequence runs, which must let it
+ * finish first. */
+static void testBlockingRead(void) {
+    static const uint8_t channels[3] = {1, 4, 6};
+    static const uint8_t samples[3] = {32, 32, 32};
+    adcSequence_t sequence;
+    simadcStatus_t status;
+    adcStats_t stats;
+    uint16_t read_mV, avg_mV, index;
+
+    printf("blocking reads during a sequence\n");
+
+    clearStats();
+    setSequence(&sequence, 3, channels, samples, sequenceHandler);
+    SIMTEST_CHECK(adc_startSequence(&sequence), "sequence refused");
+    read_mV = adc_read_mV(7);
+    SIMTEST_CHECK(!adc_isBusy(), "blocking read returned while a sequence was running");
+
+    SIMTEST_CHECK(adc_startSequence(&sequence) == false, "sequence restarted before its handler ran");
+    SIMTEST_CHECK(waitIdle(), "sequence did not finish");
+    SIMTEST_CHECK(adc_startSequence(&sequence), "sequence refused");
+    avg_mV = adc_avg_mV(3, 4);
+    SIMTEST_CHECK(waitIdle(), "sequence did not finish");
+
+    simadc_getStatus(&status);
+    adc_getStats(&stats);
+
+    printf("  channel 7 read as %u mV and channel 3 as %u mV; %u blocking waits, %lu interrupts for %lu "
+	    "conversions\n", read_mV, avg_mV, stats.blockingWaits, (unsigned long)status.interrupts,
+	    (unsigned long)status.conversions);
+
+    SIMTEST_CHECK(abs((int)read_mV - (int)inputs_mV[7]) <= MAX_ERROR_MV, "channel 7 read as %u mV", read_mV);
+    SIMTEST_CHECK(abs((int)avg_mV - (int)inputs_mV[3]) <= MAX_ERROR_MV, "channel 3 read as %u mV", avg_mV);
+
+    /* Each blocking read comes after all of the sequence's conversions, and
+     * the blocking conversions raise no interrupts. */
+    index = checkConversions(&sequence, &status, 0, "first run");
+    SIMTEST_CHECK((index < status.logLength) && (status.log[index] == 7), "blocking read of channel 7 misplaced");
+    index = checkConversions(&sequence, &status, index + 1, "second run");
+    SIMTEST_CHECK((index + 4 == status.logLength) && (memcmp(&status.log[index], "\3\3\3\3", 4) == 0),
+	    "blocking reads of channel 3 misplaced");
+    SIMTEST_CHECK(status.interrupts == 2 * 3 * 32, "%lu interrupts", (unsigned long)status.interrupts);
+    SIMTEST_CHECK(stats.blockingWaits == 2, "%u blocking waits", stats.blockingWaits);
+    checkResults(&sequence, "sequence");
+    checkADCUse(&status);
+}
+
+static void testInvalidSequences(void) {
+    static const uint8_t channels[3] = {0, 8, 1};
+    static const uint8_t samples[3] = {1, 1, 1};
+    adcSequence_t sequence;
+
+    printf("invalid sequences\n");
+
+    setSequence(&sequence, 0, channels, samples, sequenceHandler);
+    SIMTEST_CHECK(!adc_startSequence(&sequence), "sequence without channels accepted");
+    setSequence(&sequence, 2, channels, samples, sequenceHandler);
+    SIMTEST_CHECK(!adc_startSequence(&sequence), "sequence with channel 8 accepted");
+    sequence.channelCount = ADC_SEQUENCE_MAX_CHANNELS + 1;
+    SIMTEST_CHECK(!adc_startSequence(&sequence), "sequence with too many channels accepted");
+    SIMTEST_CHECK(!adc_startSequence(NULL), "no sequence accepted");
+    SIMTEST_CHECK(!adc_isBusy(), "ADC busy after invalid sequences");
+}
+
+int main(void) {
+    uint8_t channel;
+
+    simadc_reset();
+    for (channel = 0; channel < 8; channel++) {
+	simadc_setInput_mV(channel, inputs_mV[channel]);
+    }
+
+    adc_init();
+
+    testOversampling();
+    testQueue();
+    testBlockingRead();
+    testInvalidSequences();
+
+    return simtest_finish();
+}
@@ -0,0 +1,234 @@
+/*
+ * test_beacon.c
+ *
+ * The beacon detector of beacon.c on synthetic ambient samples: how reliably
+ * a beacon blinking at a few frequencies is detected within two seconds, by
+ * the size of its blinking, under lamps flickering at 100 or 120 Hz (whose
+ * frequency drifts with the mains); how often flicker alone is mistaken for
+ * a beacon; how well the bearing points at the beacon; and how long the
+ * filters take per sample.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "imu.h"
+#include "beacon.h"
+
+#include "simlight.h"
+#include "simtest.h"
+
+#define TRIALS			25
+#define TRIAL_TIME_MS		2000
+
+/* A room lit by lamps on the mains, seen by every face, in raw 8-bit
+ * samples (four light levels each) */
+#define ROOM_LEVEL		100.0
+#define FLICKER_LEVEL		15.0
+#define MAINS_DRIFT		0.01
+#define NOISE_LEVEL		0.5
+
+/* The beacon face's blinking, in raw samples */
+#define BEACON_LEVEL_COUNT	3
+static const double beaconLevels[BEACON_LEVEL_COUNT] = {1.0, 2.0, 4.0};
+
+/* A beacon blinking by four raw samples (16 light levels) or more is always
+ * found, and flicker alone is rarely taken for one. */
+#define MIN_DETECTION		0.9
+#define MAX_FALSE_DETECTION	0.05
+
+/* The bearing is computed from the faces which see the beacon, and is a unit
+ * vector scaled by 1000. */
+#define MAX_BEARING_ERROR_DEG	15.0
+#define MAX_BEARING_LENGTH_ERROR	5.0
+
+/* The filters' cost per sample is fixed.  On the development machine it is
+ * a few nanoseconds; this bound only catches a gross regression. */
+#define BENCH_SAMPLES		1000000
+#define BENCH_MAX_NS_PER_SAMPLE	500.0
+
+#define BEACON_FACE		2
+
+static unsigned int seed = 1;
+
+static void setRoom(double mains_hz, double beacon, double beacon_hz) {
+    simlightFace_t face;
+    uint8_t faceNum;
+
+    memset(&face, 0, sizeof(face));
+    face.level = ROOM_LEVEL;
+    face.flicker = FLICKER_LEVEL;
+    face.mains_hz = mains_hz;
+    face.noise = NOISE_LEVEL;
+
+    simlight_reset(seed++);
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	face.mainsDrift = MAINS_DRIFT * (2.0 * rand() / RAND_MAX - 1.0);
+	face.beacon = (faceNum == BEACON_FACE) ? beacon : 0.0;
+	face.beacon_hz = beacon_hz;
+	simlight_setFace(faceNum, &face);
+    }
+}
+
+/**@brief Looks for the beacon for the length of a trial, and returns the
+ * number of faces other than the beacon's which claim to see it. */
+static uint8_t runTrial(uint16_t frequency_hz, bool *p_detected) {
+    beaconFaceStatus_t status;
+    uint8_t faceNum, falseDetections = 0;
+
+    SIMTEST_CHECK(beacon_start(frequency_hz), "cannot look for a beacon at %u Hz", frequency_hz);
+    simlight_run(TRIAL_TIME_MS);
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	beacon_getFaceStatus(faceNum, &status);
+	if (faceNum == BEACON_FACE) {
+	    *p_detected = status.detected;
+	} else if (status.detected) {
+	    falseDetections++;
+	}
+    }
+
+    beacon_stop();
+
+    return falseDetections;
+}
+
+static void testDetection(uint16_t frequency_hz, double mains_hz) {
+    uint16_t detections[BEACON_LEVEL_COUNT] = {0};
+    uint16_t falseDetections = 0;
+    uint8_t level, trial;
+    bool detected;
+
+    for (level = 0; level < BEACON_LEVEL_COUNT; level++) {
+	for (trial = 0; trial < TRIALS; trial++) {
+	    setRoom(mains_hz, beaconLevels[level], frequency_hz);
+	    falseDetections += runTrial(frequency_hz, &detected);
+	    if (detected) {
+		detections[level]++;
+	    }
+	}
+    }
+
+    /* Without a beacon, the beacon's face may not see one either. */
+    for (trial = 0; trial < TRIALS; trial++) {
+	setRoom(mains_hz, 0.0, frequency_hz);
+	falseDetections += runTrial(frequency_hz, &detected);
+	if (detected) {
+	    falseDetections++;
+	}
+    }
+
+    printf("  %3u Hz beacon under %.0f Hz mains: detected %3.0f%%, %3.0f%%, %3.0f%% blinking by %.0f, %.0f, %.0f; "
+	    "flicker taken for a beacon %.1f%%\n", frequency_hz, mains_hz,
+	    100.0 * detections[0] / TRIALS, 100.0 * detections[1] / TRIALS, 100.0 * detections[2] / TRIALS,
+	    beaconLevels[0], beaconLevels[1], beaconLevels[2],
+	    100.0 * falseDetections / (TRIALS * (5 * BEACON_LEVEL_COUNT + 6)));
+
+    SIMTEST_CHECK(detections[BEACON_LEVEL_COUNT - 1] >= MIN_DETECTION * TRIALS,
+	    "%u Hz beacon detected in %u of %u trials", frequency_hz, detections[BEACON_LEVEL_COUNT - 1], TRIALS);
+    SIMTEST_CHECK(falseDetections <= MAX_FALSE_DETECTION * TRIALS * (5 * BEACON_LEVEL_COUNT + 6),
+	    "%u false detections at %u Hz", falseDetections, frequency_hz);
+}
+
+/**@brief Shines the beacon on two faces at once, as from a direction between
+ * them, and compares the bearing with that direction. */
+static void testBearing(void) {
+    const double direction[3] = {2.0 / sqrt(5.0), 1.0 / sqrt(5.0), 0.0};
+    simlightFace_t face;
+    int16_t bearing[3];
+    double length, error_deg;
+    uint8_t faceNum, strongest;
+
+    printf("bearing\n");
+
+    setRoom(50.0, 0.0, BEACON_DEFAULT_FREQUENCY_HZ);
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	memset(&face, 0, sizeof(face));
+	face.level = ROOM_LEVEL;
+	face.noise = NOISE_LEVEL;
+	face.beacon_hz = BEACON_DEFAULT_FREQUENCY_HZ;
+	face.beacon = 16.0 * (frameFaceNormals[faceNum-1][0] * direction[0] +
+		frameFaceNormals[faceNum-1][1] * direction[1] + frameFaceNormals[faceNum-1][2] * direction[2]);
+	if (face.beacon < 0.0) {
+	    face.beacon = 0.0;
+	}
+	simlight_setFace(faceNum, &face);
+    }
+
+    SIMTEST_CHECK(beacon_start(BEACON_DEFAULT_FREQUENCY_HZ), "cannot look for a beacon");
+    simlight_run(TRIAL_TIME_MS);
+    strongest = beacon_getBearing(bearing);
+    beacon_stop();
+
+    length = sqrt(bearing[0] * bearing[0] + bearing[1] * bearing[1] + bearing[2] * bearing[2]);
+    error_deg = (length > 0.0) ? acos((bearing[0] * direction[0] + bearing[1] * direction[1] +
+	    bearing[2] * direction[2]) / length) * 180.0 / M_PI : 180.0;
+    printf("  bearing (%d, %d, %d), %.1f degrees off, strongest on face %u\n", bearing[0], bearing[1], bearing[2],
+	    error_deg, strongest);
+    SIMTEST_CHECK(error_deg <= MAX_BEARING_ERROR_DEG, "bearing %.1f degrees off", error_deg);
+    SIMTEST_CHECK(fabs(length - 1000.0) <= MAX_BEARING_LENGTH_ERROR, "bearing of length %.0f", length);
+    SIMTEST_CHECK(strongest == 2, "beacon strongest on face %u", strongest);
+}
+
+static void testFrequencies(void) {
+    static const uint16_t refused_hz[] = {100, 120, 140, 200, 25, 42};
+    uint8_t i;
+
+    printf("beacon frequencies\n");
+
+    for (i = 0; i < sizeof(refused_hz) / sizeof(refused_hz[0]); i++) {
+	SIMTEST_CHECK(!beacon_start(refused_hz[i]), "beacon at %u Hz accepted", refused_hz[i]);
+	beacon_stop();
+    }
+    SIMTEST_CHECK(beacon_start(BEACON_DEFAULT_FREQUENCY_HZ), "default beacon frequency refused");
+    beacon_stop();
+}
+
+static void testBudget(void) {
+    static uint8_t samples[250];
+    struct timespec start, end;
+    double ns;
+    uint32_t n;
+    uint8_t i;
+
+    printf("filter cost\n");
+
+    for (i = 0; i < sizeof(samples); i++) {
+	samples[i] = ROOM_LEVEL + FLICKER_LEVEL * fabs(sin(2.0 * M_PI * 50.0 * i / SIMLIGHT_SAMPLE_RATE_HZ)) +
+	    rand() % 8;
+    }
+
+    SIMTEST_CHECK(beacon_start(BEACON_DEFAULT_FREQUENCY_HZ), "cannot look for a beacon");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < BENCH_SAMPLES; n += sizeof(samples)) {
+	beacon_processSamples(1 + n % 6, samples, sizeof(samples));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    beacon_stop();
+
+    ns = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / n;
+    printf("  %.1f ns per sample on this machine\n", ns);
+    SIMTEST_CHECK(ns <= BENCH_MAX_NS_PER_SAMPLE, "%.1f ns per sample", ns);
+}
+
+int main(void) {
+    static const uint16_t frequencies_hz[] = {40, 60, 80, 160};
+    uint8_t i;
+
+    printf("detection\n");
+    for (i = 0; i < sizeof(frequencies_hz) / sizeof(frequencies_hz[0]); i++) {
+	testDetection(frequencies_hz[i], 50.0);
+	testDetection(frequencies_hz[i], 60.0);
+    }
+
+    testBearing();
+    testFrequencies();
+    testBudget();
+
+    return simtest_finish();
+}
@@ -0,0 +1,404 @@
+/*
+ * test_db.c
+ *
+ * The daughterboard request queue of db.c against a simulated daughterboard
+ * whose commands take a random time to complete: how many polls a request
+ * costs, and how long after the daughterboard's answer its handler is called,
+ * by the range of the latency, compared with the blocking functions' polling;
+ * whether outstanding requests are coalesced; and how timeouts, refused
+ * reads, failures, a full queue, sleep and the blocking functions (which must
+ * not interleave their exchanges with a queued request's) are handled.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "db.h"
+
+#include "simtimer.h"
+#include "simdb.h"
+#include "simtest.h"
+
+#define REQUESTS		200
+
+/* Time allowed for the queue to empty */
+#define IDLE_TIMEOUT_MS		5000
+
+/* The queued requests poll no more often than the blocking functions, which
+ * poll every DB_POLL_INTERVAL_MS, and answer within a few milliseconds of the
+ * daughterboard. */
+#define MAX_MEAN_LATENESS_MS	5.0
+
+typedef struct {
+    uint16_t calls;
+    uint16_t successes;
+    uint8_t cmd;
+    uint8_t response[DB_MAX_RESPONSE_LENGTH];
+    uint8_t responseLength;
+    uint64_t time_ticks;
+} completion_t;
+
+static completion_t completions[3];
+
+static void recordCompletion(completion_t *p_completion, uint8_t cmd, bool success, const uint8_t *response,
+	uint8_t responseLength) {
+    p_completion->calls++;
+    if (success) {
+	p_completion->successes++;
+    }
+    p_completion->cmd = cmd;
+    p_completion->responseLength = responseLength;
+    if (response != NULL) {
+	memcpy(p_completion->response, response, responseLength);
+    }
+    p_completion->time_ticks = simtimer_getTicks();
+}
+
+static void handler0(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength) {
+    recordCompletion(&completions[0], cmd, success, response, responseLength);
+}
+
+static void handler1(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength) {
+    recordCompletion(&completions[1], cmd, success, response, responseLength);
+}
+
+static void handler2(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength) {
+    recordCompletion(&completions[2], cmd, success, response, responseLength);
+}
+
+static double ticksToMs(uint64_t ticks) {
+    return ticks * SIM_USEC_PER_TICK / 1000.0;
+}
+
+/**@brief Runs the timers and scheduler until the queue is empty, or for the
+ * given time if nothing is queued. */
+static bool runUntilIdle(uint32_t timeout_ms) {
+    uint64_t start_ticks, next_ticks;
+
+    start_ticks = simtimer_getTicks();
+    simtimer_runScheduler();
+    while (!db_isIdle() && simtimer_getNextExpiry(&next_ticks) &&
+	    (ticksToMs(next_ticks - start_ticks) < timeout_ms)) {
+	simtimer_run(next_ticks);
+    }
+
+    return db_isIdle();
+}
+
+static void runFor(uint32_t ms) {
+    uint64_t end_ticks, next_ticks;
+
+    end_ticks = simtimer_getTicks() + (uint64_t)(1000.0 * ms / SIM_USEC_PER_TICK);
+    simtimer_runScheduler();
+    while (simtimer_getNextExpiry(&next_ticks) && (next_ticks <= end_ticks)) {
+	simtimer_run(next_ticks);
+    }
+    simtimer_run(end_ticks);
+}
+
+static void reset(const simdbConfig_t *p_config) {
+    simdb_init(p_config);
+    memset(completions, 0, sizeof(completions));
+    db_clearStats();
+}
+
+static void testCompletion(void) {
+    simdbConfig_t config;
+    dbStats_t stats;
+    int16_t temperature;
+
+    printf("completion\n");
+
+    simdb_getDefaultConfig(&config);
+    reset(&config);
+
+    SIMTEST_CHECK(db_requestTemp(handler0), "temperature request refused");
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS), "temperature request never completed");
+    temperature = completions[0].response[0] | (completions[0].response[1] << 8);
+    printf("  temperature %d.%d C\n", temperature / 10, temperature % 10);
+    SIMTEST_CHECK((completions[0].calls == 1) && (completions[0].successes == 1), "%u calls, %u successful",
+	    completions[0].calls, completions[0].successes);
+    SIMTEST_CHECK((completions[0].cmd == DB_TEMPERATURE_CMD) && (completions[0].responseLength == 2),
+	    "response to command 0x%02x of %u bytes", completions[0].cmd, completions[0].responseLength);
+    SIMTEST_CHECK(temperature == config.temperature_tenthDegC, "temperature %d", temperature);
+
+    /* A daughterboard which reports failure */
+    config.failRate = 1.0;
+    reset(&config);
+    SIMTEST_CHECK(db_requestLEDs(true, false, true, handler0), "LED request refused");
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS), "LED request never completed");
+    db_getStats(&stats);
+    SIMTEST_CHECK((completions[0].calls == 1) && (completions[0].successes == 0), "%u calls, %u successful",
+	    completions[0].calls, completions[0].successes);
+    SIMTEST_CHECK(stats.failures == 1, "%lu failures counted", (unsigned long)stats.failures);
+
+    /* Requests which do not fit */
+    SIMTEST_CHECK(!db_request(0x10, DB_MAX_REQUEST_LENGTH + 1, completions[0].response, 0, 50, NULL),
+	    "overlong request accepted");
+    SIMTEST_CHECK(!db_request(0x10, 0, NULL, DB_MAX_RESPONSE_LENGTH + 1, 50, NULL), "overlong response accepted");
+}
+
+/**@brief Issues one request after another, each taking a random time within
+ * the given range, and reports the polls and delays that they cost. */
+static void testLatency(double minLatency_ms, double maxLatency_ms, bool nackWhileBusy) {
+    simdbConfig_t config;
+    simdbStatus_t status;
+    dbStats_t stats;
+    double lateness_ms = 0.0, worstLateness_ms = 0.0, d_ms;
+    uint32_t blockingReads, n;
+    int16_t temperature;
+
+    simdb_getDefaultConfig(&config);
+    config.nackWhileBusy = nackWhileBusy;
+    reset(&config);
+    simdb_setLatency(DB_TEMPERATURE_CMD, minLatency_ms, maxLatency_ms);
+
+    for (n = 0; n < REQUESTS; n++) {
+	SIMTEST_CHECK(db_requestTemp(handler0), "temperature request refused");
+	if (!runUntilIdle(IDLE_TIMEOUT_MS)) {
+	    SIMTEST_CHECK(false, "temperature request never completed");
+	    break;
+	}
+
+	simdb_getStatus(&status);
+	d_ms = ticksToMs(completions[0].time_ticks - status.lastWrite_ticks) - status.lastLatency_ms;
+	lateness_ms += d_ms;
+	if (d_ms > worstLateness_ms) {
+	    worstLateness_ms = d_ms;
+	}
+    }
+    db_getStats(&stats);
+
+    /* The same requests made with the blocking function */
+    simdb_getStatus(&status);
+    blockingReads = status.reads;
+    for (n = 0; n < REQUESTS; n++) {
+	SIMTEST_CHECK(db_getTemp(&temperature), "blocking temperature request failed");
+    }
+    simdb_getStatus(&status);
+    blockingReads = status.reads - blockingReads;
+
+    printf("  %2.0f-%2.0f ms%s: %.2f polls per request (%.2f blocking), answered %.1f ms late on average, "
+	    "%.1f at worst; latency learned %u ms\n", minLatency_ms, maxLatency_ms,
+	    nackWhileBusy ? ", reads refused while busy" : "", (double)stats.polls / REQUESTS,
+	    (double)blockingReads / REQUESTS, lateness_ms / REQUESTS, worstLateness_ms,
+	    db_getLatency(DB_TEMPERATURE_CMD));
+
+    SIMTEST_CHECK(completions[0].successes == REQUESTS, "%u of %u requests succeeded", completions[0].successes,
+	    REQUESTS);
+    SIMTEST_CHECK((stats.timeouts == 0) && (status.overruns == 0), "%lu timeouts, %lu overruns",
+	    (unsigned long)stats.timeouts, (unsigned long)status.overruns);
+    SIMTEST_CHECK(stats.polls <= blockingReads, "%lu polls, %lu by the blocking function",
+	    (unsigned long)stats.polls, (unsigned long)blockingReads);
+    SIMTEST_CHECK(lateness_ms / REQUESTS <= MAX_MEAN_LATENESS_MS, "answered %.1f ms late on average",
+	    lateness_ms / REQUESTS);
+    if (nackWhileBusy) {
+	SIMTEST_CHECK(stats.twiErrorCount > 0, "no refused reads counted");
+    }
+}
+
+/**@brief Queues several requests before the engine runs, and a different
+ * one while the first is in flight. */
+static void testCoalescing(void) {
+    simdbConfig_t config;
+    simdbStatus_t status;
+    dbStats_t stats;
+    uint64_t next_ticks;
+
+    printf("coalescing\n");
+
+    simdb_getDefaultConfig(&config);
+    reset(&config);
+    simdb_setLatency(DB_LED_CMD, 10.0, 10.0);
+
+    SIMTEST_CHECK(db_requestLEDs(true, false, false, handler0), "LED request refused");
+    SIMTEST_CHECK(db_requestLEDs(false, true, false, handler0), "LED request refused");
+    SIMTEST_CHECK(db_requestLEDs(false, false, true, handler1), "LED request refused");
+    SIMTEST_CHECK(db_requestTemp(handler2), "temperature request refused");
+    SIMTEST_CHECK(db_requestTemp(handler2), "temperature request refused");
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS), "requests never completed");
+
+    simdb_getStatus(&status);
+    db_getStats(&stats);
+    printf("  5 requests: %lu queued, %lu coalesced, %lu commands written\n", (unsigned long)stats.requests,
+	    (unsigned long)stats.coalesced, (unsigned long)status.writes);
+    SIMTEST_CHECK((stats.requests == 2) && (stats.coalesced == 3) && (status.writes == 2),
+	    "%lu queued, %lu coalesced, %lu written", (unsigned long)stats.requests,
+	    (unsigned long)stats.coalesced, (unsigned long)status.writes);
+    SIMTEST_CHECK(status.leds == 0x04, "LEDs 0x%02x rather than the last setting", status.leds);
+    SIMTEST_CHECK((completions[0].successes == 1) && (completions[1].successes == 1) &&
+	    (completions[2].successes == 1), "handlers called %u, %u and %u times", completions[0].successes,
+	    completions[1].successes, completions[2].successes);
+
+    /* A different setting cannot join a request which has been sent. */
+    reset(&config);
+    SIMTEST_CHECK(db_requestLEDs(true, false, false, handler0), "LED request refused");
+    simtimer_runScheduler();
+    if (simtimer_getNextExpiry(&next_ticks)) {
+	simtimer_run(next_ticks);
+    }
+    SIMTEST_CHECK(db_requestLEDs(true, false, false, handler1), "LED request refused");
+    SIMTEST_CHECK(db_requestLEDs(false, true, false, handler2), "LED request refused");
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS), "requests never completed");
+
+    simdb_getStatus(&status);
+    db_getStats(&stats);
+    printf("  while in flight: %lu queued, %lu coalesced, %lu commands written\n", (unsigned long)stats.requests,
+	    (unsigned long)stats.coalesced, (unsigned long)status.writes);
+    SIMTEST_CHECK((stats.requests == 2) && (stats.coalesced == 1) && (status.writes == 2),
+	    "%lu queued, %lu coalesced, %lu written", (unsigned long)stats.requests,
+	    (unsigned long)stats.coalesced, (unsigned long)status.writes);
+    SIMTEST_CHECK((status.leds == 0x02) && (status.overruns == 0), "LEDs 0x%02x, %lu overruns", status.leds,
+	    (unsigned long)status.overruns);
+}
+
+static void testTimeout(void) {
+    simdbConfig_t config;
+    simdbStatus_t status;
+    dbStats_t stats;
+    uint64_t start_ticks;
+    double elapsed_ms;
+
+    printf("timeout\n");
+
+    simdb_getDefaultConfig(&config);
+    config.maxLatency_ms[DB_TEMPERATURE_CMD] = 0.0;
+    reset(&config);
+
+    start_ticks = simtimer_getTicks();
+    SIMTEST_CHECK(db_requestTemp(handler0), "temperature request refused");
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS), "request never timed out");
+    elapsed_ms = ticksToMs(completions[0].time_ticks - start_ticks);
+    simdb_getStatus(&status);
+    db_getStats(&stats);
+
+    printf("  failed after %.1f ms and %lu polls\n", elapsed_ms, (unsigned long)stats.polls);
+    SIMTEST_CHECK((completions[0].calls == 1) && (completions[0].successes == 0), "%u calls, %u successful",
+	    completions[0].calls, completions[0].successes);
+    SIMTEST_CHECK(stats.timeouts == 1, "%lu timeouts counted", (unsigned long)stats.timeouts);
+    SIMTEST_CHECK((elapsed_ms >= DB_TEMPERATURE_TIMEOUT_MS) &&
+	    (elapsed_ms <= DB_TEMPERATURE_TIMEOUT_MS + DB_POLL_MAX_INTERVAL_MS), "timed out after %.1f ms",
+	    elapsed_ms);
+}
+
+static void testOverflow(void) {
+    simdbConfig_t config;
+    dbStats_t stats;
+    uint8_t cmd;
+
+    printf("full queue\n");
+
+    simdb_getDefaultConfig(&config);
+    reset(&config);
+
+    for (cmd = 0; cmd < DB_QUEUE_LENGTH; cmd++) {
+	SIMTEST_CHECK(db_request(0x10 + cmd, 0, NULL, 0, 50, handler0), "request %u refused", cmd);
+    }
+    SIMTEST_CHECK(!db_request(0x10 + DB_QUEUE_LENGTH, 0, NULL, 0, 50, handler1), "request to a full queue accepted");
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS), "requests never completed");
+
+    db_getStats(&stats);
+    printf("  %u of %u requests completed, %lu refused\n", completions[0].successes, DB_QUEUE_LENGTH + 1,
+	    (unsigned long)stats.overflows);
+    SIMTEST_CHECK(completions[0].successes == DB_QUEUE_LENGTH, "%u requests completed", completions[0].successes);
+    SIMTEST_CHECK((completions[1].calls == 0) && (stats.overflows == 1), "refused request completed");
+}
+
+/**@brief Calls the blocking functions while requests are queued, one of
+ * them in flight. */
+static void testBlocking(void) {
+    simdbConfig_t config;
+    simdbStatus_t status;
+    uint64_t next_ticks;
+    char version[16];
+    int16_t temperature;
+    bool success;
+
+    printf("blocking functions\n");
+
+    simdb_getDefaultConfig(&config);
+    reset(&config);
+    simdb_setLatency(DB_TEMPERATURE_CMD, 10.0, 10.0);
+
+    SIMTEST_CHECK(db_requestTemp(handler0), "temperature request refused");
+    SIMTEST_CHECK(db_requestLEDs(true, true, false, handler1), "LED request refused");
+    simtimer_runScheduler();
+    if (simtimer_getNextExpiry(&next_ticks)) {
+	simtimer_run(next_ticks);
+    }
+
+    success = db_getVersion(version, sizeof(version));
+    SIMTEST_CHECK(success && (strcmp(version, config.version) == 0), "version \"%s\"", success ? version : "");
+    SIMTEST_CHECK(completions[0].successes == 1, "request in flight not completed first");
+    SIMTEST_CHECK(db_getTemp(&temperature) && (temperature == config.temperature_tenthDegC), "temperature %d",
+	    temperature);
+    SIMTEST_CHECK(db_setLEDs(false, false, true), "LEDs not set");
+
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS), "queued request never completed");
+    simdb_getStatus(&status);
+    printf("  version \"%s\"; queued requests completed %u and %u times, %lu overruns\n", version,
+	    completions[0].successes, completions[1].successes, (unsigned long)status.overruns);
+    SIMTEST_CHECK(completions[1].successes == 1, "queued request not completed");
+    SIMTEST_CHECK(status.overruns == 0, "%lu commands written while another was in progress",
+	    (unsigned long)status.overruns);
+}
+
+/**@brief Puts the daughterboard to sleep with a request queued, which must
+ * wait for it to wake, and then stops the engine with a request queued. */
+static void testSleep(void) {
+    simdbConfig_t config;
+    simdbStatus_t status;
+
+    printf("sleep\n");
+
+    simdb_getDefaultConfig(&config);
+    reset(&config);
+
+    SIMTEST_CHECK(db_sleep(true), "daughterboard did not sleep");
+    SIMTEST_CHECK(db_requestTemp(handler0), "temperature request refused");
+    runFor(500);
+    simdb_getStatus(&status);
+    printf("  %lu transfers while asleep, %u requests completed\n", (unsigned long)status.wakeups,
+	    completions[0].calls);
+    SIMTEST_CHECK(status.asleep && (completions[0].calls == 0), "request sent to a sleeping daughterboard");
+
+    SIMTEST_CHECK(db_sleep(false), "daughterboard did not wake");
+    SIMTEST_CHECK(runUntilIdle(IDLE_TIMEOUT_MS) && (completions[0].successes == 1),
+	    "request not completed after waking");
+
+    SIMTEST_CHECK(db_requestTemp(handler1), "temperature request refused");
+    db_deinit();
+    SIMTEST_CHECK((completions[1].calls == 1) && (completions[1].successes == 0) && db_isIdle(),
+	    "request not failed when the engine stopped");
+    SIMTEST_CHECK(!db_requestTemp(handler1), "request accepted while stopped");
+    db_init();
+}
+
+int main(void) {
+    db_init();
+
+    testCompletion();
+
+    printf("adaptive polling\n");
+    testLatency(2.0, 4.0, false);
+    testLatency(5.0, 5.0, false);
+    testLatency(8.0, 12.0, false);
+    testLatency(15.0, 35.0, false);
+    testLatency(30.0, 45.0, false);
+    testLatency(15.0, 35.0, true);
+
+    testCoalescing();
+    testTimeout();
+    testOverflow();
+    testBlocking();
+    testSleep();
+
+    return simtest_finish();
+}
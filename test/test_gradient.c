@@ -0,0 +1,220 @@
+/*
+ * test_gradient.c
+ *
+ * The hop-count gradient in simulated chains and lattices: how long the
+ * counts take to settle on the true distance to the nearest seed after a seed
+ * appears or moves, how many updates that costs and how many a settled
+ * gradient costs to refresh, and whether the counts stay bounded (rather than
+ * counting to infinity) when the last seed disappears.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gradient.h"
+
+#include "cluster.h"
+#include "simtest.h"
+
+/* A change travels one hop per update, which is sent at most every 250 ms
+ * and read by the next module's poll within a second. */
+#define CONVERGE_TIME_MS	20000
+/* Without a seed, every count is retracted at the latest once the
+ * neighbors' entries expire (32 s after the seed's last refresh). */
+#define RETRACT_TIME_MS		45000
+/* Seeds refresh the gradient every 10 s. */
+#define STEADY_TIME_MS		60000
+#define REFRESH_INTERVAL_MS	10000
+
+#define MAX_SEEDS		2
+
+static uint8_t gridX, gridY;
+static uint8_t seeds[MAX_SEEDS];
+static uint8_t seedCount;
+static bool running[CLUSTER_MAX_CUBES];
+
+/* Largest finite hop count seen on any module since it was last cleared.
+ * While the gradient settles, a module may briefly count a longer path than
+ * the shortest, but never one longer than a path can be without a loop. */
+static uint8_t maxSeenHops;
+
+static uint8_t getDistance(uint8_t a, uint8_t b) {
+    return abs(a % gridX - b % gridX) + abs(a / gridX % gridY - b / gridX % gridY) +
+	    abs(a / (gridX * gridY) - b / (gridX * gridY));
+}
+
+/**@brief Returns the true hop count of the given module: its grid distance to
+ * the nearest running seed. */
+static uint8_t getExpectedHops(uint8_t cube) {
+    uint8_t hops = GRADIENT_INFINITY;
+    uint8_t i;
+
+    for (i = 0; i < seedCount; i++) {
+	if (running[seeds[i]] && (getDistance(cube, seeds[i]) < hops)) {
+	    hops = getDistance(cube, seeds[i]);
+	}
+    }
+
+    return hops;
+}
+
+static uint8_t getHops(uint8_t cube) {
+    return CLUSTER_CALL(cube, uint8_t (*)(void), gradient_getHops);
+}
+
+/**@brief Returns whether every running module has its true hop count, and
+ * records the largest count seen. */
+static bool allCorrect(void) {
+    bool correct = true;
+    uint8_t cube, hops;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (!running[cube]) {
+	    continue;
+	}
+
+	hops = getHops(cube);
+	if ((hops != GRADIENT_INFINITY) && (hops > maxSeenHops)) {
+	    maxSeenHops = hops;
+	}
+	if (hops != getExpectedHops(cube)) {
+	    correct = false;
+	}
+    }
+
+    return correct;
+}
+
+static void setSeed(uint8_t cube, bool seed) {
+    CLUSTER_CALL(cube, void (*)(bool), gradient_setSeed, seed);
+}
+
+static void getTotals(gradientStatus_t *p_total) {
+    gradientStatus_t status;
+    uint8_t cube;
+
+    memset(p_total, 0, sizeof(gradientStatus_t));
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (!running[cube]) {
+	    continue;
+	}
+
+	CLUSTER_CALL(cube, void (*)(gradientStatus_t *), gradient_getStatus, &status);
+	p_total->changes += status.changes;
+	p_total->updatesSent += status.updatesSent;
+	p_total->updatesReceived += status.updatesReceived;
+	p_total->updatesRejected += status.updatesRejected;
+    }
+}
+
+static void clearStats(void) {
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (running[cube]) {
+	    CLUSTER_CALL(cube, void (*)(void), gradient_clearStats);
+	}
+    }
+    cluster_clearLinkStats();
+    maxSeenHops = 0;
+}
+
+/**@brief Runs the cluster until every module has its true hop count, and
+ * reports the time and messages taken. */
+static bool runConvergence(const char *event, uint32_t timeout_ms) {
+    gradientStatus_t total;
+    clusterLinkStats_t stats;
+    uint64_t start_us = cluster_getTime_us();
+    bool ok;
+
+    ok = cluster_runUntil(allCorrect, timeout_ms);
+
+    getTotals(&total);
+    cluster_getTotalLinkStats(&stats);
+    printf("  %s: settled after %.1f s, %u changes, %u updates (%u rejected), %lu bytes, up to %u hops\n",
+	    event, (cluster_getTime_us() - start_us) / 1e6, total.changes, total.updatesSent,
+	    total.updatesRejected, (unsigned long)stats.bytesSent, maxSeenHops);
+    SIMTEST_CHECK(ok, "%s: hop counts incorrect after %lu s", event, (unsigned long)(timeout_ms / 1000));
+
+    return ok;
+}
+
+static void testGradient(const char *name, uint8_t nx, uint8_t ny, uint8_t nz) {
+    clusterConfig_t config;
+    gradientStatus_t total;
+    uint8_t far, cube;
+
+    printf("%s (%u modules)\n", name, nx * ny * nz);
+
+    cluster_getDefaultConfig(&config);
+    SIMTEST_CHECK(cluster_create(nx * ny * nz, NULL, &config), "cannot create the cluster");
+    cluster_connectGrid(nx, ny, nz);
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	running[cube] = true;
+    }
+    cluster_startAll();
+    cluster_run_ms(5000);
+
+    gridX = nx;
+    gridY = ny;
+    far = cluster_getCount() - 1;
+
+    /* A seed appears in one corner. */
+    clearStats();
+    seeds[0] = 0;
+    seedCount = 1;
+    setSeed(0, true);
+    if (!runConvergence("seed in a corner", CONVERGE_TIME_MS)) {
+	cluster_destroy();
+	return;
+    }
+
+    /* Once settled, each seed refresh costs one update per module. */
+    clearStats();
+    cluster_run_ms(STEADY_TIME_MS);
+    getTotals(&total);
+    printf("  settled: %.2f updates per module per refresh\n",
+	    (double)total.updatesSent / cluster_getCount() / (STEADY_TIME_MS / REFRESH_INTERVAL_MS));
+    SIMTEST_CHECK(allCorrect() && (total.changes == 0), "%u changes in a settled gradient", total.changes);
+    SIMTEST_CHECK(total.updatesSent <= 2 * cluster_getCount() * (STEADY_TIME_MS / REFRESH_INTERVAL_MS),
+	    "%u updates to refresh a settled gradient", total.updatesSent);
+
+    /* The seed moves to the opposite corner. */
+    clearStats();
+    setSeed(0, false);
+    seeds[0] = far;
+    setSeed(far, true);
+    runConvergence("seed moved", CONVERGE_TIME_MS);
+    SIMTEST_CHECK(maxSeenHops < cluster_getCount(), "hop count reached %u while the seed moved", maxSeenHops);
+
+    /* A second seed, in the old corner's neighbor */
+    clearStats();
+    seeds[1] = 1;
+    seedCount = 2;
+    setSeed(1, true);
+    runConvergence("second seed", CONVERGE_TIME_MS);
+
+    /* Both seeds stop being seeds; every count must be retracted without
+     * counting up. */
+    clearStats();
+    setSeed(1, false);
+    setSeed(far, false);
+    seedCount = 0;
+    runConvergence("seeds removed", RETRACT_TIME_MS);
+    SIMTEST_CHECK(maxSeenHops < cluster_getCount(), "hop count reached %u after the seeds were removed",
+	    maxSeenHops);
+
+    cluster_destroy();
+}
+
+int main(void) {
+    testGradient("chain", 8, 1, 1);
+    testGradient("3x3x3 lattice", 3, 3, 3);
+    testGradient("4x4x2 lattice", 4, 4, 2);
+
+    return simtest_finish();
+}
@@ -0,0 +1,279 @@
+/*
+ * test_irdfu.c
+ *
+ * Firmware propagation over IR in simulated chains and lattices: whether an
+ * image staged on one module reaches the staging area of every other module
+ * intact, how long that takes compared with the distance from the source,
+ * whether a transfer interrupted by sleep resumes where it stopped, and
+ * whether modules which have the image stop passing it around.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc16.h"
+
+#include "global.h"
+#include "irdfu.h"
+
+#include "cube.h"
+#include "cluster.h"
+#include "simtest.h"
+
+/* Four pages, the last of them partly filled and ending in a short chunk */
+#define IMAGE_SIZE		4000
+#define IMAGE_VERSION		(FIRMWARE_VERSION + 1)
+
+/* The state page as laid out by irdfu.c */
+#define STATE_MAGIC		0x4D424653
+#define STATE_WORD_MAGIC	0
+#define STATE_WORD_VERSION	1
+#define STATE_WORD_SIZE		2
+#define STATE_WORD_CRC		3
+#define STATE_WORD_AUTO		4
+#define STATE_WORD_COMPLETE	5
+#define STATE_WORD_PAGE_DONE	6
+
+/* Each hop receives the whole image before offering it on, and a module
+ * sends to one neighbor at a time, of which it may have up to three further
+ * from the source in a lattice. */
+#define HOP_TIME_MS		60000
+#define MAX_FANOUT		3
+/* Once every module has the image, it is no longer transferred. */
+#define QUIET_TIME_MS		60000
+/* A module sleeps in the middle of its transfer for this long. */
+#define SLEEP_TIME_MS		30000
+
+static uint8_t image[IMAGE_SIZE];
+static uint16_t imageCRC;
+
+static uint8_t gridX, gridY;
+static uint8_t source;
+static uint64_t doneTime_us[CLUSTER_MAX_CUBES];
+static uint64_t start_us;
+
+static void makeImage(void) {
+    uint16_t i;
+
+    for (i = 0; i < IMAGE_SIZE; i++) {
+	image[i] = rand() & 0xFF;
+    }
+    imageCRC = crc16_compute(image, IMAGE_SIZE, NULL);
+}
+
+/**@brief Places a complete image in the module's staging area, as if it had
+ * been received, so that the module offers it once it starts. */
+static void stageImage(uint8_t cube) {
+    uint8_t *p_flash = cluster_getFlash(cube);
+    uint32_t *p_state = (uint32_t *)&p_flash[IRDFU_STATE_PAGE_ADDR - CUBE_FLASH_START];
+    uint8_t page;
+
+    memcpy(&p_flash[IRDFU_BANK_1_START - CUBE_FLASH_START], image, IMAGE_SIZE);
+
+    p_state[STATE_WORD_MAGIC] = STATE_MAGIC;
+    p_state[STATE_WORD_VERSION] = IMAGE_VERSION;
+    p_state[STATE_WORD_SIZE] = IMAGE_SIZE;
+    p_state[STATE_WORD_CRC] = imageCRC;
+    p_state[STATE_WORD_AUTO] = 0;
+    p_state[STATE_WORD_COMPLETE] = 0;
+    for (page = 0; page < (IMAGE_SIZE + IRDFU_PAGE_SIZE - 1) / IRDFU_PAGE_SIZE; page++) {
+	p_state[STATE_WORD_PAGE_DONE + page] = 0;
+    }
+}
+
+static void getStatus(uint8_t cube, irdfuStatus_t *p_status) {
+    CLUSTER_CALL(cube, void (*)(irdfuStatus_t *), irdfu_getStatus, p_status);
+}
+
+/**@brief Returns whether the module has the image, complete and intact, in
+ * its staging area. */
+static bool hasImage(uint8_t cube) {
+    irdfuStatus_t status;
+
+    getStatus(cube, &status);
+
+    return (status.stagedComplete && (status.stagedVersion == IMAGE_VERSION) &&
+	    (status.stagedSize == IMAGE_SIZE) && (status.stagedCRC == imageCRC) &&
+	    (memcmp(&cluster_getFlash(cube)[IRDFU_BANK_1_START - CUBE_FLASH_START], image, IMAGE_SIZE) == 0));
+}
+
+/**@brief Returns whether every module has the image, and records when each
+ * got it. */
+static bool allHaveImage(void) {
+    bool all = true;
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (doneTime_us[cube] != 0) {
+	    continue;
+	}
+
+	if (hasImage(cube)) {
+	    doneTime_us[cube] = cluster_getTime_us() - start_us;
+	} else {
+	    all = false;
+	}
+    }
+
+    return all;
+}
+
+static uint8_t getDistance(uint8_t a, uint8_t b) {
+    return abs(a % gridX - b % gridX) + abs(a / gridX % gridY - b / gridX % gridY) +
+	    abs(a / (gridX * gridY) - b / (gridX * gridY));
+}
+
+static void getTotals(irdfuStatus_t *p_total) {
+    irdfuStatus_t status;
+    uint8_t cube;
+
+    memset(p_total, 0, sizeof(irdfuStatus_t));
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	getStatus(cube, &status);
+	p_total->chunksSent += status.chunksSent;
+	p_total->chunksReceived += status.chunksReceived;
+	p_total->chunksRejected += status.chunksRejected;
+	p_total->pagesWritten += status.pagesWritten;
+	p_total->pageCRCErrors += status.pageCRCErrors;
+	p_total->resumes += status.resumes;
+	p_total->flashErrors += status.flashErrors;
+    }
+}
+
+static void clearStats(void) {
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	CLUSTER_CALL(cube, void (*)(void), irdfu_clearStats);
+    }
+    cluster_clearLinkStats();
+}
+
+static bool createCluster(uint8_t nx, uint8_t ny, uint8_t nz, double byteErrorRate) {
+    clusterConfig_t config;
+
+    cluster_getDefaultConfig(&config);
+    config.byteErrorRate = byteErrorRate;
+    if (!cluster_create(nx * ny * nz, NULL, &config)) {
+	return false;
+    }
+    cluster_connectGrid(nx, ny, nz);
+
+    gridX = nx;
+    gridY = ny;
+    source = 0;
+    memset(doneTime_us, 0, sizeof(doneTime_us));
+    doneTime_us[source] = 1;
+
+    stageImage(source);
+
+    return true;
+}
+
+static void testPropagation(const char *name, uint8_t nx, uint8_t ny, uint8_t nz, double byteErrorRate) {
+    irdfuStatus_t total;
+    clusterLinkStats_t stats;
+    uint8_t cube, diameter = 0;
+    uint64_t last_us = 0;
+    bool ok;
+
+    printf("%s (%u modules)\n", name, nx * ny * nz);
+
+    SIMTEST_CHECK(createCluster(nx, ny, nz, byteErrorRate), "cannot create the cluster");
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (getDistance(source, cube) > diameter) {
+	    diameter = getDistance(source, cube);
+	}
+    }
+
+    cluster_startAll();
+    start_us = cluster_getTime_us();
+
+    ok = cluster_runUntil(allHaveImage, diameter * MAX_FANOUT * HOP_TIME_MS);
+
+    getTotals(&total);
+    cluster_getTotalLinkStats(&stats);
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (doneTime_us[cube] > last_us) {
+	    last_us = doneTime_us[cube];
+	}
+    }
+    printf("  image on every module after %.1f s (%.1f s per hop over %u hops)\n", last_us / 1e6,
+	    last_us / 1e6 / diameter, diameter);
+    printf("  %u chunks sent, %u received, %u rejected, %u page CRC errors, %lu bytes corrupted\n",
+	    total.chunksSent, total.chunksReceived, total.chunksRejected, total.pageCRCErrors,
+	    (unsigned long)stats.bytesCorrupted);
+    SIMTEST_CHECK(ok, "image missing or damaged after %u s", diameter * MAX_FANOUT * HOP_TIME_MS / 1000);
+
+    /* Each module only accepts an image newer than its own and not already
+     * staged, so the image is not sent back and forth. */
+    clearStats();
+    cluster_run_ms(QUIET_TIME_MS);
+    getTotals(&total);
+    SIMTEST_CHECK(total.chunksSent == 0, "%u chunks sent once every module had the image", total.chunksSent);
+
+    cluster_destroy();
+}
+
+/**@brief Returns whether the receiver has written half of the image and is
+ * between flash operations (the last of which would otherwise complete, and
+ * be counted, after it wakes). */
+static bool receiverHalfDone(void) {
+    irdfuStatus_t status;
+
+    getStatus(1, &status);
+
+    return (status.pagesDone >= status.pagesTotal / 2) && (status.pagesTotal > 0) &&
+	    !CLUSTER_CALL(1, bool (*)(void), irdfu_isFlashBusy);
+}
+
+static void testResume(void) {
+    irdfuStatus_t status;
+    uint8_t pagesBefore;
+    bool ok;
+
+    printf("transfer interrupted by sleep\n");
+
+    SIMTEST_CHECK(createCluster(3, 1, 1, 0.0), "cannot create the cluster");
+    cluster_startAll();
+    start_us = cluster_getTime_us();
+
+    ok = cluster_runUntil(receiverHalfDone, HOP_TIME_MS);
+    SIMTEST_CHECK(ok, "transfer to module %04x did not progress", cluster_getNodeID(1));
+
+    /* The receiver sleeps, and on waking continues with the page it was
+     * writing rather than starting over. */
+    getStatus(1, &status);
+    pagesBefore = status.pagesDone;
+    CLUSTER_CALL(1, void (*)(void), irdfu_clearStats);
+    cluster_stop(1);
+    cluster_run_ms(SLEEP_TIME_MS);
+    cluster_start(1);
+
+    ok = cluster_runUntil(allHaveImage, 2 * HOP_TIME_MS);
+    SIMTEST_CHECK(ok, "image missing or damaged after the interruption");
+
+    getStatus(1, &status);
+    printf("  %u of %u pages kept through sleep, %u written after waking, %u resumes\n", pagesBefore,
+	    status.pagesTotal, status.pagesWritten, status.resumes);
+    SIMTEST_CHECK(status.resumes >= 1, "transfer was not resumed");
+    SIMTEST_CHECK(status.pagesWritten == status.pagesTotal - pagesBefore, "%u pages written after waking",
+	    status.pagesWritten);
+
+    cluster_destroy();
+}
+
+int main(void) {
+    makeImage();
+
+    testPropagation("chain", 6, 1, 1, 0.0);
+    testPropagation("3x3x2 lattice", 3, 3, 2, 0.0);
+    testPropagation("chain with corrupted bytes", 4, 1, 1, 0.0005);
+    testResume();
+
+    return simtest_finish();
+}
@@ -0,0 +1,200 @@
+/*
+ * test_irtx.c
+ *
+ * Medium access on the IR links during broadcast storms in simulated
+ * lattices: every module repeatedly sends a burst of messages on all of its
+ * faces at the same moment, with the slotted medium access of irtx.c enabled
+ * and then disabled.  Measured are the fraction of received bytes that were
+ * corrupted by collisions, and how many of the messages arrived intact and
+ * how quickly (goodput).  Afterwards, how often the drain timer wakes the
+ * modules while they have little to send.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "irtx.h"
+
+#include "cluster.h"
+#include "simtest.h"
+
+/* Neighbors are found and cluster time (by which the slots are timed) is
+ * synchronized well within this. */
+#define SETTLE_TIME_MS		30000
+/* Every module sends a burst on all of its faces at once this often. */
+#define STORM_TIME_MS		30000
+#define BURST_INTERVAL_MS	1000
+#define BURST_MESSAGES		2
+/* Time allowed for the queues to empty after the last burst */
+#define DRAIN_TIME_MS		5000
+/* Time for which the cluster is left idle after the storm */
+#define IDLE_TIME_MS		60000
+
+/* With medium access, the two ends of a link never start at once, so only
+ * collisions with a neighbor's direct drains (e.g. time sync replies)
+ * remain. */
+#define MAX_COLLISION_RATE_MAC	0.02
+/* Nearly every message of the storm arrives, which is far from the case
+ * without medium access. */
+#define MIN_DELIVERY_MAC	0.95
+/* A timer repeating every 20 ms would wake each module 50 times a second;
+ * once idle, only the occasional beacon or sync message should. */
+#define MAX_IDLE_WAKEUPS_PER_S	5.0
+
+static uint32_t messagesOffered;
+static uint32_t messagesDelivered;
+static uint32_t bytesDelivered;
+
+static void printHandler(uint8_t cube, const char *str) {
+    if (strncmp(str, "storm;", 6) == 0) {
+	messagesDelivered++;
+	bytesDelivered += strlen(str) + 1;
+    }
+}
+
+static void setMACEnabled(bool enabled) {
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	CLUSTER_CALL(cube, void (*)(bool), irtx_setMACEnabled, enabled);
+    }
+}
+
+/**@brief Queues a burst of messages on every connected face of every module,
+ * all at the same instant. */
+static void sendBurst(uint16_t burst) {
+    char msg[32];
+    uint8_t cube, faceNum, peerCube, peerFace, i;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    if (!cluster_getPeer(cube, faceNum, &peerCube, &peerFace)) {
+		continue;
+	    }
+
+	    for (i = 0; i < BURST_MESSAGES; i++) {
+		snprintf(msg, sizeof(msg), "storm;%04x;%u;%u|", cluster_getNodeID(cube), burst, i);
+		if (CLUSTER_CALL(cube, bool (*)(uint8_t, irtxPriority_t, const char *), irtx_queueString,
+			faceNum, IRTX_PRIORITY_BULK, msg)) {
+		    messagesOffered++;
+		}
+	    }
+	}
+    }
+}
+
+/**@brief Returns the number of times that faces backed off on every module. */
+static uint32_t getBackoffs(void) {
+    irtxStats_t stats;
+    uint32_t backoffs = 0;
+    uint8_t cube, faceNum;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    CLUSTER_CALL(cube, bool (*)(uint8_t, irtxStats_t *), irtx_getStats, faceNum, &stats);
+	    backoffs += stats.backoffCount;
+	}
+    }
+
+    return backoffs;
+}
+
+static uint32_t getTimerWakeups(void) {
+    uint32_t wakeups = 0;
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	wakeups += CLUSTER_CALL(cube, uint32_t (*)(void), irtx_getTimerWakeups);
+    }
+
+    return wakeups;
+}
+
+static void clearStats(void) {
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	CLUSTER_CALL(cube, void (*)(void), irtx_clearStats);
+    }
+    cluster_clearLinkStats();
+    messagesOffered = 0;
+    messagesDelivered = 0;
+    bytesDelivered = 0;
+}
+
+/**@brief Runs a storm with medium access enabled or disabled, and returns
+ * the fraction of received bytes which collided and the fraction of the
+ * storm's messages which were delivered. */
+static bool runStorm(uint8_t nx, uint8_t ny, uint8_t nz, bool mac, double *p_collisionRate, double *p_delivery,
+	double *p_idleWakeups) {
+    clusterConfig_t config;
+    clusterLinkStats_t stats;
+    uint16_t burst;
+
+    cluster_getDefaultConfig(&config);
+    config.print = printHandler;
+    if (!cluster_create(nx * ny * nz, NULL, &config)) {
+	SIMTEST_CHECK(false, "cannot create the cluster");
+	return false;
+    }
+    cluster_connectGrid(nx, ny, nz);
+    cluster_startAll();
+    setMACEnabled(mac);
+    cluster_run_ms(SETTLE_TIME_MS);
+
+    clearStats();
+    for (burst = 0; burst < STORM_TIME_MS / BURST_INTERVAL_MS; burst++) {
+	sendBurst(burst);
+	cluster_run_ms(BURST_INTERVAL_MS);
+    }
+    cluster_run_ms(DRAIN_TIME_MS);
+
+    cluster_getTotalLinkStats(&stats);
+    *p_collisionRate = (stats.bytesReceived > 0) ? (double)stats.bytesCollided / stats.bytesReceived : 0.0;
+    *p_delivery = (messagesOffered > 0) ? (double)messagesDelivered / messagesOffered : 0.0;
+
+    printf("  medium access %s: %lu of %lu bytes collided (%.1f%%), %lu of %lu messages delivered (%.1f%%), "
+	    "goodput %.0f B/s, %lu backoffs\n", mac ? "on " : "off",
+	    (unsigned long)stats.bytesCollided, (unsigned long)stats.bytesReceived, 100.0 * *p_collisionRate,
+	    (unsigned long)messagesDelivered, (unsigned long)messagesOffered, 100.0 * *p_delivery,
+	    bytesDelivered * 1000.0 / (STORM_TIME_MS + DRAIN_TIME_MS), (unsigned long)getBackoffs());
+
+    clearStats();
+    cluster_run_ms(IDLE_TIME_MS);
+    *p_idleWakeups = getTimerWakeups() * 1000.0 / IDLE_TIME_MS / cluster_getCount();
+    printf("    idle: %.2f drain timer wake-ups per module per second\n", *p_idleWakeups);
+
+    cluster_destroy();
+
+    return true;
+}
+
+static void testStorm(const char *name, uint8_t nx, uint8_t ny, uint8_t nz) {
+    double collisionRateOn, deliveryOn, collisionRateOff, deliveryOff, idleWakeupsOn, idleWakeupsOff;
+
+    printf("%s (%u modules)\n", name, nx * ny * nz);
+
+    if (!runStorm(nx, ny, nz, false, &collisionRateOff, &deliveryOff, &idleWakeupsOff) ||
+	    !runStorm(nx, ny, nz, true, &collisionRateOn, &deliveryOn, &idleWakeupsOn)) {
+	return;
+    }
+
+    SIMTEST_CHECK(collisionRateOn <= MAX_COLLISION_RATE_MAC, "%.1f%% of bytes collided with medium access",
+	    100.0 * collisionRateOn);
+    SIMTEST_CHECK(collisionRateOn < collisionRateOff / 2, "medium access did not reduce collisions");
+    SIMTEST_CHECK(deliveryOn >= MIN_DELIVERY_MAC, "%.1f%% of messages delivered with medium access",
+	    100.0 * deliveryOn);
+    SIMTEST_CHECK(deliveryOn > deliveryOff, "medium access did not improve delivery");
+    SIMTEST_CHECK((idleWakeupsOn <= MAX_IDLE_WAKEUPS_PER_S) && (idleWakeupsOff <= MAX_IDLE_WAKEUPS_PER_S),
+	    "%.2f and %.2f drain timer wake-ups per module per second while idle", idleWakeupsOn, idleWakeupsOff);
+}
+
+int main(void) {
+    testStorm("chain", 4, 1, 1);
+    testStorm("3x3x3 lattice", 3, 3, 3);
+
+    return simtest_finish();
+}
@@ -0,0 +1,172 @@
+/*
+ * test_leader.c
+ *
+ * Leader election in simulated chains and lattices: how long a cluster takes
+ * to agree on the module with the lowest ID and how many heartbeats that
+ * costs, how soon a leader which drops out or goes to sleep is replaced, and
+ * whether it takes over again when it wakes.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leader.h"
+
+#include "cluster.h"
+#include "simtest.h"
+
+/* Modules listen for 8 s after booting before standing, and then the lowest
+ * ID must flood the cluster. */
+#define STARTUP_TIME_MS		30000
+/* A leader which falls silent is presumed failed after 15 s, and an election
+ * starts within another second. */
+#define FAILOVER_TIME_MS	30000
+/* A leader which resigns is replaced without waiting for that timeout. */
+#define RESIGN_TIME_MS		10000
+/* With nothing changing, the cluster stays with one leader for this long. */
+#define STABLE_TIME_MS		60000
+
+static bool running[CLUSTER_MAX_CUBES];
+static uint16_t expectedLeader;
+
+static void getStatus(uint8_t cube, leaderStatus_t *p_status) {
+    CLUSTER_CALL(cube, void (*)(leaderStatus_t *), leader_getStatus, p_status);
+}
+
+/**@brief Returns whether every running module follows the expected leader in
+ * the same epoch. */
+static bool allAgree(void) {
+    leaderStatus_t status;
+    uint16_t epoch = 0;
+    bool first = true;
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (!running[cube]) {
+	    continue;
+	}
+
+	getStatus(cube, &status);
+	if (!status.haveLeader || (status.leaderID != expectedLeader) || (!first && (status.epoch != epoch))) {
+	    return false;
+	}
+
+	epoch = status.epoch;
+	first = false;
+    }
+
+    return true;
+}
+
+static void clearStats(void) {
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (running[cube]) {
+	    CLUSTER_CALL(cube, void (*)(void), leader_clearStats);
+	}
+    }
+    cluster_clearLinkStats();
+}
+
+/**@brief Runs the cluster until it agrees on the expected leader, and reports
+ * the time and messages taken. */
+static bool runElection(const char *event, uint32_t timeout_ms) {
+    leaderStatus_t status;
+    clusterLinkStats_t stats;
+    uint32_t elections = 0, heartbeats = 0;
+    uint64_t start_us = cluster_getTime_us();
+    uint8_t cube, maxHops = 0;
+    bool ok;
+
+    ok = cluster_runUntil(allAgree, timeout_ms);
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (!running[cube]) {
+	    continue;
+	}
+
+	getStatus(cube, &status);
+	elections += status.electionsStarted;
+	heartbeats += status.heartbeatsSent + status.heartbeatsRelayed;
+	if (status.hops > maxHops) {
+	    maxHops = status.hops;
+	}
+    }
+    cluster_getTotalLinkStats(&stats);
+
+    printf("  %s: leader %04x after %.1f s, up to %u hops, %lu elections, %lu heartbeats, %lu bytes\n",
+	    event, expectedLeader, (cluster_getTime_us() - start_us) / 1e6, maxHops,
+	    (unsigned long)elections, (unsigned long)heartbeats, (unsigned long)stats.bytesSent);
+    SIMTEST_CHECK(ok, "%s: no agreement on leader %04x after %lu s", event, expectedLeader,
+	    (unsigned long)(timeout_ms / 1000));
+
+    return ok;
+}
+
+static void testElection(const char *name, uint8_t nx, uint8_t ny, uint8_t nz) {
+    clusterConfig_t config;
+    leaderStatus_t status;
+    uint16_t changes = 0;
+    uint8_t cube;
+
+    printf("%s (%u modules)\n", name, nx * ny * nz);
+
+    cluster_getDefaultConfig(&config);
+    SIMTEST_CHECK(cluster_create(nx * ny * nz, NULL, &config), "cannot create the cluster");
+    cluster_connectGrid(nx, ny, nz);
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	running[cube] = true;
+    }
+    cluster_startAll();
+
+    /* Module 0 has the lowest ID. */
+    expectedLeader = cluster_getNodeID(0);
+    if (!runElection("startup", STARTUP_TIME_MS)) {
+	cluster_destroy();
+	return;
+    }
+
+    /* Once settled, heartbeats alone flow and nobody changes leader. */
+    clearStats();
+    cluster_run_ms(STABLE_TIME_MS);
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	getStatus(cube, &status);
+	changes += status.leaderChanges + status.electionsStarted;
+    }
+    SIMTEST_CHECK(allAgree() && (changes == 0), "leader changed %u times in a settled cluster", changes);
+
+    /* The leader drops out without warning. */
+    clearStats();
+    cluster_stop(0);
+    running[0] = false;
+    expectedLeader = cluster_getNodeID(1);
+    runElection("leader removed", FAILOVER_TIME_MS);
+
+    /* The new leader goes to sleep, resigning first. */
+    clearStats();
+    SIMTEST_CHECK(CLUSTER_CALL(1, bool (*)(void), leader_resign), "leader %04x did not resign", expectedLeader);
+    cluster_stop(1);
+    running[1] = false;
+    expectedLeader = cluster_getNodeID(2);
+    runElection("leader asleep", RESIGN_TIME_MS);
+
+    /* The sleeping module wakes, and as its ID is lower, takes over again. */
+    clearStats();
+    cluster_start(1);
+    running[1] = true;
+    expectedLeader = cluster_getNodeID(1);
+    runElection("leader awake", STARTUP_TIME_MS);
+
+    cluster_destroy();
+}
+
+int main(void) {
+    testElection("chain", 8, 1, 1);
+    testElection("3x3x3 lattice", 3, 3, 3);
+
+    return simtest_finish();
+}
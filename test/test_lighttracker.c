@@ -0,0 +1,282 @@
+/*
+ * test_lighttracker.c
+ *
+ * The light tracker of motionEvent.c on a simulated module rolling over a
+ * grid under a lamp: from random starting orientations a few cells from the
+ * lamp, how close to it the tracker ends and how many rolls that takes, with
+ * and without failed rolls and noisy sensors; whether a module avoiding light
+ * gets away from it; and whether the tracker stops, rather than wander, when
+ * the lamp lies across the plane in which the module can roll or is beyond
+ * its step limit.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "motionEvent.h"
+
+#include "simtimer.h"
+#include "simroll.h"
+#include "simtest.h"
+
+#define TRIALS			50
+
+/* The flywheel is spun up and braked with these settings; the simulated
+ * module rolls whenever it brakes with its flywheel axis horizontal. */
+#define ROLL_SPEED_RPM		5000
+#define ROLL_BRAKE_CURRENT_MA	3000
+#define ROLL_BRAKE_TIME_MS	20
+
+/* Light level difference below which the module is close enough, well above
+ * the sensor noise */
+#define THRESHOLD		10
+#define MAX_STEPS		12
+
+/* Starting distances from the lamp, in cells */
+#define MIN_START_DISTANCE	2
+#define MAX_START_DISTANCE	4
+
+/* The tracker ends next to the lamp, having at worst rolled past it once. */
+#define MAX_MEDIAN_DISTANCE	1.0
+#define MAX_EXTRA_ROLLS		3
+
+/* Each roll takes the flywheel's spin and brake, which are instantaneous in
+ * the simulation, and then the module settles for 1.5 s. */
+#define TRACK_TIMEOUT_MS	60000
+
+static const char *outcomeNames[] = {
+    "complete", "step limit", "off plane", "failure"
+};
+
+static bool finished;
+static motionEvent_t outcome;
+
+static void trackerHandler(void *p_event_data, uint16_t event_size) {
+    outcome = *(motionEvent_t *)p_event_data;
+    finished = true;
+}
+
+/**@brief Runs the light tracker until it reports its outcome, which is
+ * returned as an index into outcomeNames (or -1 if it never finishes). */
+static int8_t track(bool seek, uint8_t maxSteps) {
+    uint64_t start_ticks, next_ticks;
+
+    finished = false;
+    if (!motionEvent_startLightTracker(seek, ROLL_SPEED_RPM, ROLL_BRAKE_CURRENT_MA, ROLL_BRAKE_TIME_MS,
+	    ROLL_SPEED_RPM, ROLL_BRAKE_CURRENT_MA, ROLL_BRAKE_TIME_MS, THRESHOLD, maxSteps, trackerHandler)) {
+	return -1;
+    }
+
+    start_ticks = simtimer_getTicks();
+    simtimer_runScheduler();
+    while (!finished && simtimer_getNextExpiry(&next_ticks) &&
+	    ((simtimer_getTicks() - start_ticks) * SIM_USEC_PER_TICK < TRACK_TIMEOUT_MS * 1000.0)) {
+	simtimer_run(next_ticks);
+    }
+
+    if (!finished) {
+	motionEvent_stopLightTracker();
+	return -1;
+    }
+
+    return outcome - MOTION_EVENT_LIGHT_TRACKER_COMPLETE;
+}
+
+/**@brief Places the module in a random orientation in which it can roll, on
+ * the given side of the lamp: along the line in which it rolls, or across it.
+ */
+static void placeRandomly(uint8_t distance, bool across) {
+    simrollStatus_t status;
+    uint8_t bottomFace, turns;
+    int8_t dx, dy, sign;
+
+    do {
+	bottomFace = 1 + rand() % 6;
+	turns = rand() % 4;
+    } while (!simroll_place(0, 0, bottomFace, turns));
+
+    simroll_getStatus(&status);
+    dx = across ? -status.forwardY : status.forwardX;
+    dy = across ? status.forwardX : status.forwardY;
+    sign = (rand() & 1) ? 1 : -1;
+
+    simroll_place(sign * dx * distance, sign * dy * distance, bottomFace, turns);
+}
+
+static void sortDistances(double *distances, uint8_t count) {
+    double d;
+    uint8_t i, j;
+
+    for (i = 1; i < count; i++) {
+	d = distances[i];
+	for (j = i; (j > 0) && (distances[j-1] > d); j--) {
+	    distances[j] = distances[j-1];
+	}
+	distances[j] = d;
+    }
+}
+
+/**@brief Tracks the lamp from many starting points along the plane of
+ * motion, and reports where the module ended up. */
+static void testSeek(const char *name, double failRate, double noise) {
+    simrollConfig_t config;
+    simrollStatus_t before, after;
+    double distances[TRIALS];
+    uint16_t outcomes[4] = {0};
+    uint32_t rolls = 0, extraRolls = 0, starts = 0;
+    uint8_t trial, distance;
+    int8_t result;
+
+    printf("%s\n", name);
+
+    simroll_getDefaultConfig(&config);
+    config.lightX = 0.3;
+    config.lightY = 0.2;
+    config.failRate = failRate;
+    config.lightNoise = noise;
+    config.gravityNoise = noise / 100.0;
+    simroll_init(&config);
+
+    for (trial = 0; trial < TRIALS; trial++) {
+	distance = MIN_START_DISTANCE + rand() % (MAX_START_DISTANCE - MIN_START_DISTANCE + 1);
+	placeRandomly(distance, false);
+	simroll_getStatus(&before);
+
+	result = track(true, MAX_STEPS);
+	SIMTEST_CHECK(result >= 0, "tracker did not finish");
+	if (result < 0) {
+	    continue;
+	}
+
+	simroll_getStatus(&after);
+	distances[trial] = simroll_getLightDistance();
+	outcomes[result]++;
+	rolls += after.rolls - before.rolls;
+	starts += distance;
+	if (after.rolls - before.rolls > distance + MAX_EXTRA_ROLLS) {
+	    extraRolls++;
+	}
+    }
+
+    sortDistances(distances, TRIALS);
+    printf("  from %.1f cells away on average: ended %.2f cells from the lamp (median), %.2f at worst, "
+	    "after %.1f rolls\n", (double)starts / TRIALS, distances[TRIALS / 2], distances[TRIALS - 1],
+	    (double)rolls / TRIALS);
+    printf("  %u complete, %u step limit, %u off plane, %u failed\n", outcomes[0], outcomes[1], outcomes[2],
+	    outcomes[3]);
+
+    SIMTEST_CHECK(distances[TRIALS / 2] <= MAX_MEDIAN_DISTANCE, "median distance from the lamp %.2f cells",
+	    distances[TRIALS / 2]);
+    SIMTEST_CHECK(outcomes[1] == 0, "%u trackers reached the step limit", outcomes[1]);
+    SIMTEST_CHECK(extraRolls <= TRIALS / 10, "%u trackers rolled more than %u times beyond the distance",
+	    extraRolls, MAX_EXTRA_ROLLS);
+    if (failRate == 0.0) {
+	SIMTEST_CHECK(outcomes[3] == 0, "%u trackers failed", outcomes[3]);
+    }
+}
+
+/**@brief Starts near the lamp and avoids it.  (A module right beside the
+ * lamp may first roll under it, where its lateral faces are all in the dark,
+ * so the modules start a little further away.) */
+static void testAvoid(void) {
+    simrollConfig_t config;
+    uint16_t fartherAway = 0;
+    uint8_t trial;
+
+    printf("avoiding light\n");
+
+    simroll_getDefaultConfig(&config);
+    config.lightNoise = 2.0;
+    simroll_init(&config);
+
+    for (trial = 0; trial < TRIALS; trial++) {
+	placeRandomly(MIN_START_DISTANCE, false);
+	SIMTEST_CHECK(track(false, MAX_STEPS) >= 0, "tracker did not finish");
+	if (simroll_getLightDistance() > MIN_START_DISTANCE) {
+	    fartherAway++;
+	}
+    }
+
+    printf("  %u of %u modules moved away from the lamp\n", fartherAway, TRIALS);
+    SIMTEST_CHECK(fartherAway >= TRIALS * 9 / 10, "%u of %u modules moved away", fartherAway, TRIALS);
+}
+
+/**@brief Places the lamp across the plane in which the module rolls, which
+ * the tracker must notice rather than roll back and forth. */
+static void testOffPlane(void) {
+    simrollConfig_t config;
+    simrollStatus_t before, after;
+    uint16_t offPlane = 0, manyRolls = 0;
+    uint8_t trial;
+    int8_t result;
+
+    printf("light across the plane of motion\n");
+
+    simroll_getDefaultConfig(&config);
+    config.lightNoise = 2.0;
+    simroll_init(&config);
+
+    for (trial = 0; trial < TRIALS; trial++) {
+	placeRandomly(MIN_START_DISTANCE + rand() % (MAX_START_DISTANCE - MIN_START_DISTANCE + 1), true);
+	simroll_getStatus(&before);
+	result = track(true, MAX_STEPS);
+	simroll_getStatus(&after);
+
+	if (result + MOTION_EVENT_LIGHT_TRACKER_COMPLETE == MOTION_EVENT_LIGHT_TRACKER_OFF_PLANE) {
+	    offPlane++;
+	}
+	/* The first roll, made to learn which way the module rolls, is the
+	 * only one needed. */
+	if (after.rolls - before.rolls > 1) {
+	    manyRolls++;
+	}
+    }
+
+    printf("  %u of %u trackers found the lamp off the plane, %u rolled more than once\n", offPlane, TRIALS,
+	    manyRolls);
+    SIMTEST_CHECK(offPlane >= TRIALS * 9 / 10, "%u of %u trackers found the lamp off the plane", offPlane, TRIALS);
+    SIMTEST_CHECK(manyRolls <= TRIALS / 10, "%u trackers rolled more than once", manyRolls);
+}
+
+/**@brief Places the lamp out of reach of the step limit. */
+static void testStepLimit(void) {
+    simrollConfig_t config;
+    simrollStatus_t before, after;
+    int8_t result;
+
+    printf("step limit\n");
+
+    simroll_getDefaultConfig(&config);
+    simroll_init(&config);
+
+    placeRandomly(8, false);
+    simroll_getStatus(&before);
+    result = track(true, 3);
+    simroll_getStatus(&after);
+
+    printf("  %s after %u rolls, %.1f cells from the lamp\n", (result >= 0) ? outcomeNames[result] : "unfinished",
+	    after.rolls - before.rolls, simroll_getLightDistance());
+    SIMTEST_CHECK(result + MOTION_EVENT_LIGHT_TRACKER_COMPLETE == MOTION_EVENT_LIGHT_TRACKER_STEP_LIMIT,
+	    "tracker did not stop at the step limit");
+    SIMTEST_CHECK(after.rolls - before.rolls == 3, "%u rolls with a limit of 3", after.rolls - before.rolls);
+}
+
+int main(void) {
+    motionEvent_init();
+
+    testSeek("seeking light", 0.0, 0.0);
+    testSeek("seeking light with noisy sensors", 0.0, 3.0);
+    testSeek("seeking light with 20% of rolls failing", 0.2, 3.0);
+    testAvoid();
+    testOffPlane();
+    testStepLimit();
+
+    return simtest_finish();
+}
@@ -0,0 +1,296 @@
+/*
+ * test_neighbor.c
+ *
+ * Neighbor discovery and the cluster map (nbrmap) in simulated chains and
+ * lattices: how long discovery takes, whether the map collected by one module
+ * matches the real topology (including modules with six neighbors), and how
+ * soon a departed neighbor is forgotten.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "neighbor.h"
+
+#include "cluster.h"
+#include "simtest.h"
+
+#define OUTPUT_SIZE		8192
+
+/* How long the origin waits for the responses to a query of the whole
+ * cluster, and for those to a query of a single module, and how many single
+ * queries it may make to fill the gaps in the map. */
+#define MAP_QUERY_TIME_MS	30000
+#define MAP_RETRY_TIME_MS	10000
+#define MAP_MAX_RETRIES		8
+
+typedef bool (*neighborGet_t)(uint8_t faceNum, neighbor_t *p_neighbor);
+
+static char output[OUTPUT_SIZE];
+static uint16_t outputLen;
+static uint8_t outputCube;
+
+static void printHandler(uint8_t cube, const char *str) {
+    size_t len = strlen(str);
+
+    if ((cube != outputCube) || (outputLen + len >= OUTPUT_SIZE)) {
+	return;
+    }
+
+    memcpy(&output[outputLen], str, len + 1);
+    outputLen += len;
+}
+
+/**@brief Returns whether every module's neighbor table matches the simulated
+ * topology. */
+static bool tablesAreCorrect(void) {
+    neighbor_t neighbor;
+    uint8_t cube, faceNum, peerCube, peerFace;
+    bool connected, present;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    connected = cluster_getPeer(cube, faceNum, &peerCube, &peerFace);
+	    present = CLUSTER_CALL(cube, neighborGet_t, neighbor_get, faceNum, &neighbor);
+
+	    if (connected != present) {
+		return false;
+	    }
+	    if (connected && ((neighbor.id != cluster_getNodeID(peerCube)) || (neighbor.face != peerFace))) {
+		return false;
+	    }
+	}
+    }
+
+    return true;
+}
+
+static int8_t findCube(uint16_t id) {
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	if (cluster_getNodeID(cube) == id) {
+	    return cube;
+	}
+    }
+
+    return -1;
+}
+
+/* The map printed by the origin of the queries, parsed into the neighbor
+ * (ID and face) reported for each face of each module */
+static uint16_t reportedID[CLUSTER_MAX_CUBES][6];
+static uint8_t reportedFace[CLUSTER_MAX_CUBES][6];
+static bool heard[CLUSTER_MAX_CUBES];
+
+static void parseMap(void) {
+    unsigned int id, face, nbrID, nbrFace;
+    char *line, *entry, *save1, *save2;
+    char buf[OUTPUT_SIZE];
+    int8_t index;
+
+    memset(reportedID, 0, sizeof(reportedID));
+    memset(reportedFace, 0, sizeof(reportedFace));
+    memset(heard, 0, sizeof(heard));
+
+    memcpy(buf, output, outputLen + 1);
+    for (line = strtok_r(buf, "\r\n", &save1); line != NULL; line = strtok_r(NULL, "\r\n", &save1)) {
+	if ((sscanf(line, "%x:", &id) != 1) || ((index = findCube(id)) < 0)) {
+	    continue;
+	}
+	heard[index] = true;
+
+	for (entry = strtok_r(strchr(line, ' '), " ,", &save2); entry != NULL; entry = strtok_r(NULL, " ,", &save2)) {
+	    if ((sscanf(entry, "%u:%x:%u", &face, &nbrID, &nbrFace) == 3) && (face >= 1) && (face <= 6)) {
+		reportedID[index][face-1] = nbrID;
+		reportedFace[index][face-1] = nbrFace;
+	    }
+	}
+    }
+}
+
+/**@brief Compares the map with the simulated topology.
+ *
+ * @return Number of modules for which a complete and correct table arrived.
+ */
+static uint8_t checkMap(bool report) {
+    uint8_t complete = 0;
+    uint8_t cube, faceNum, peerCube, peerFace;
+    bool correct;
+
+    parseMap();
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	correct = heard[cube];
+	for (faceNum = 1; correct && (faceNum <= 6); faceNum++) {
+	    if (cluster_getPeer(cube, faceNum, &peerCube, &peerFace)) {
+		correct = (reportedID[cube][faceNum-1] == cluster_getNodeID(peerCube)) &&
+			(reportedFace[cube][faceNum-1] == peerFace);
+	    } else {
+		correct = (reportedID[cube][faceNum-1] == 0);
+	    }
+	}
+
+	if (correct) {
+	    complete++;
+	} else if (report) {
+	    printf("  module %04x: %s\n", cluster_getNodeID(cube), heard[cube] ? "wrong table" : "no response");
+	}
+    }
+
+    return complete;
+}
+
+static bool mapIsComplete(void) {
+    return (checkMap(false) == cluster_getCount());
+}
+
+/**@brief Finds the modules whose tables are missing from the map, or only
+ * partly present, as a host would: every link appears in the tables of both
+ * of the modules that it joins.
+ *
+ * @return Number of modules found, whose IDs are stored in ids.
+ */
+static uint8_t findGaps(uint16_t *ids) {
+    uint8_t count = 0;
+    uint8_t cube, faceNum, nbrFace;
+    int8_t nbr;
+    bool found[CLUSTER_MAX_CUBES];
+
+    parseMap();
+    memset(found, 0, sizeof(found));
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	for (faceNum = 1; faceNum <= 6; faceNum++) {
+	    if ((reportedID[cube][faceNum-1] == 0) || ((nbr = findCube(reportedID[cube][faceNum-1])) < 0)) {
+		continue;
+	    }
+
+	    nbrFace = reportedFace[cube][faceNum-1];
+	    if (!heard[nbr] || (nbrFace < 1) || (nbrFace > 6) ||
+		    (reportedID[nbr][nbrFace-1] != cluster_getNodeID(cube))) {
+		if (!found[nbr]) {
+		    found[nbr] = true;
+		    ids[count++] = cluster_getNodeID(nbr);
+		}
+	    }
+	}
+    }
+
+    return count;
+}
+
+static uint16_t getMapDrops(void) {
+    uint16_t drops = 0;
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	drops += CLUSTER_CALL(cube, uint16_t (*)(void), neighbor_getMapFramesDropped);
+    }
+
+    return drops;
+}
+
+static void testMap(const char *name, uint8_t nx, uint8_t ny, uint8_t nz, uint8_t origin) {
+    clusterConfig_t config;
+    clusterLinkStats_t stats;
+    uint16_t gaps[CLUSTER_MAX_CUBES];
+    uint8_t gapCount, i;
+    uint8_t retries = 0;
+    uint64_t start_us;
+    bool ok;
+
+    printf("%s (%u modules)\n", name, nx * ny * nz);
+
+    cluster_getDefaultConfig(&config);
+    config.print = printHandler;
+    SIMTEST_CHECK(cluster_create(nx * ny * nz, NULL, &config), "cannot create the cluster");
+    cluster_connectGrid(nx, ny, nz);
+    cluster_startAll();
+
+    ok = cluster_runUntil(tablesAreCorrect, 30000);
+    SIMTEST_CHECK(ok, "neighbor tables incomplete after 30 s");
+    printf("  discovery complete after %.1f s\n", cluster_getTime_us() / 1e6);
+
+    /* Let the beacons back off before mapping, as in a settled cluster. */
+    cluster_run_ms(20000);
+    cluster_clearLinkStats();
+
+    outputCube = origin;
+    outputLen = 0;
+    output[0] = '\0';
+    start_us = cluster_getTime_us();
+    SIMTEST_CHECK(CLUSTER_CALL(origin, bool (*)(uint16_t), neighbor_startMapQuery, NEIGHBOR_MAP_TARGET_ALL),
+	    "cannot start the map query");
+
+    cluster_runUntil(mapIsComplete, MAP_QUERY_TIME_MS);
+    printf("  %u of %u modules mapped after %.2f s, %u responses dropped\n", checkMap(false), cluster_getCount(),
+	    (cluster_getTime_us() - start_us) / 1e6, getMapDrops());
+
+    /* Ask the modules which are missing from the map again, one by one. */
+    while (((gapCount = findGaps(gaps)) > 0) && (retries < MAP_MAX_RETRIES)) {
+	for (i = 0; i < gapCount; i++) {
+	    CLUSTER_CALL(origin, bool (*)(uint16_t), neighbor_startMapQuery, gaps[i]);
+	    cluster_run_ms(MAP_RETRY_TIME_MS);
+	    retries++;
+	}
+    }
+
+    ok = mapIsComplete();
+    SIMTEST_CHECK(ok, "map incomplete: %u of %u modules", checkMap(true), cluster_getCount());
+    cluster_getTotalLinkStats(&stats);
+    printf("  map complete after %.2f s and %u repeated queries, %lu bytes sent\n",
+	    (cluster_getTime_us() - start_us) / 1e6, retries, (unsigned long)stats.bytesSent);
+
+    cluster_destroy();
+}
+
+static void testExpiry(void) {
+    clusterConfig_t config;
+    neighbor_t neighbor;
+    uint64_t start_us;
+    bool goneA = false, goneB = false;
+    uint32_t t_ms;
+
+    printf("expiry of a departed neighbor\n");
+
+    cluster_getDefaultConfig(&config);
+    SIMTEST_CHECK(cluster_create(3, NULL, &config), "cannot create the cluster");
+    cluster_connectChain();
+    cluster_startAll();
+
+    /* Once the beacon interval has grown to its maximum of 32 s, a departed
+     * neighbor must be forgotten after at most three missed beacons. */
+    cluster_run_ms(200000);
+    SIMTEST_CHECK(tablesAreCorrect(), "neighbor tables incorrect before the separation");
+
+    cluster_disconnect(1, CLUSTER_FACE_POS_X);
+    start_us = cluster_getTime_us();
+
+    for (t_ms = 0; (t_ms < 150000) && !(goneA && goneB); t_ms += 100) {
+	cluster_run_ms(100);
+	goneA = !CLUSTER_CALL(1, neighborGet_t, neighbor_get, CLUSTER_FACE_POS_X, &neighbor);
+	goneB = !CLUSTER_CALL(2, neighborGet_t, neighbor_get, CLUSTER_FACE_NEG_X, &neighbor);
+    }
+
+    printf("  forgotten by both modules after %.1f s\n", (cluster_getTime_us() - start_us) / 1e6);
+    SIMTEST_CHECK(goneA && goneB, "departed neighbor still present after 150 s");
+    SIMTEST_CHECK(cluster_getTime_us() - start_us <= 3 * 32 * 1000000ULL + 2000000 + 1000000,
+	    "departed neighbor forgotten too late");
+    SIMTEST_CHECK(CLUSTER_CALL(0, neighborGet_t, neighbor_get, CLUSTER_FACE_POS_X, &neighbor),
+	    "unrelated neighbor forgotten");
+
+    cluster_destroy();
+}
+
+int main(void) {
+    testMap("chain", 8, 1, 1, 0);
+    testMap("3x3x3 lattice, mapped from a corner", 3, 3, 3, 0);
+    testMap("3x3x3 lattice, mapped from the center", 3, 3, 3, 13);
+    testExpiry();
+
+    return simtest_finish();
+}
@@ -0,0 +1,225 @@
+/*
+ * test_power.c
+ *
+ * The battery snapshot of power.c on a simulated battery pack: whether a scan
+ * of the four cells, blocking or in the background, reads them correctly and
+ * only once VBATOUT has settled; how many blocking cell measurements, and how
+ * much blocking time, each update of the charge state machine costs while the
+ * module charges and balances its cells, compared with the 20 measurements
+ * that an update used to make; and how the maximum age of the snapshot trades
+ * the two off.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "power.h"
+
+#include "simtimer.h"
+#include "simpower.h"
+#include "simtest.h"
+
+/* A cell is read as five times the difference of two millivolt samples, so
+ * it may be off by up to 5 mV. */
+#define MAX_CELL_ERROR_MV	5
+
+/* Before the snapshot, an update of the charge state machine read the
+ * minimum and maximum (four cells each), the over- and under-voltage checks
+ * (four cells each) and then each cell again for balancing, and each of the
+ * 20 cell measurements took two 1 ms settles and 2x32 conversions. */
+#define OLD_MEASUREMENTS_PER_UPDATE	20
+#define MEASUREMENT_MS		(2.0 + 64 * SIMPOWER_CONVERSION_US / 1000.0)
+
+/* The background sampling completes a scan every 8 firings of the 200 ms
+ * power timer. */
+#define BACKGROUND_SCAN_MS	1600
+
+/* Charging with VIN present, long enough for several updates of the charge
+ * state machine (one every 10 s) */
+#define CHARGE_TIME_MS		120000
+#define VIN_MV			5000
+
+/* Cells 1 to 3 are more than 15 mV above cell 4, so they are balanced by
+ * closing their discharge switches. */
+static const uint16_t imbalancedCells_mV[4] = {3710, 3740, 3760, 3690};
+
+/**@brief Runs the timers and the scheduler for the given time. */
+static void runFor(uint32_t ms) {
+    uint64_t end_ticks, next_ticks;
+
+    end_ticks = simtimer_getTicks() + APP_TIMER_TICKS(ms, APP_TIMER_PRESCALER);
+    while (simtimer_getNextExpiry(&next_ticks) && (next_ticks <= end_ticks)) {
+	simtimer_run(next_ticks);
+    }
+    simtimer_run(end_ticks);
+}
+
+/**@brief Checks the snapshot against the simulated cells. */
+static void checkSnapshot(const power_batterySnapshot_t *p_snapshot, const uint16_t *cell_mV, const char *scan) {
+    uint16_t min_mV = UINT16_MAX, max_mV = 0, pack_mV = 0;
+    uint8_t i;
+
+    SIMTEST_CHECK(p_snapshot->valid, "%s: snapshot invalid", scan);
+
+    for (i = 0; i < 4; i++) {
+	SIMTEST_CHECK(abs((int)p_snapshot->cell_mV[i] - (int)cell_mV[i]) <= MAX_CELL_ERROR_MV,
+		"%s: cell %u read as %u mV rather than %u mV", scan, i + 1, p_snapshot->cell_mV[i], cell_mV[i]);
+	min_mV = (p_snapshot->cell_mV[i] < min_mV) ? p_snapshot->cell_mV[i] : min_mV;
+	max_mV = (p_snapshot->cell_mV[i] > max_mV) ? p_snapshot->cell_mV[i] : max_mV;
+	pack_mV += p_snapshot->cell_mV[i];
+    }
+
+    SIMTEST_CHECK((p_snapshot->min_mV == min_mV) && (p_snapshot->max_mV == max_mV) &&
+	    (p_snapshot->pack_mV == pack_mV), "%s: min %u, max %u, pack %u mV from cells giving %u, %u, %u mV", scan,
+	    p_snapshot->min_mV, p_snapshot->max_mV, p_snapshot->pack_mV, min_mV, max_mV, pack_mV);
+}
+
+/**@brief A blocking scan, before the background sampling has completed one. */
+static void testBlockingScan(void) {
+    power_batterySnapshot_t snapshot;
+    simpowerStatus_t status;
+
+    printf("blocking scan\n");
+
+    simpower_clearStatus();
+    power_getBatterySnapshot(&snapshot, POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS);
+    simpower_getStatus(&status);
+
+    checkSnapshot(&snapshot, imbalancedCells_mV, "blocking scan");
+    printf("  %u, %u, %u, %u mV: %u cell measurements in %.1f ms\n", snapshot.cell_mV[0], snapshot.cell_mV[1],
+	    snapshot.cell_mV[2], snapshot.cell_mV[3], status.cellMeasurements, status.blocking_ms);
+    SIMTEST_CHECK(status.cellMeasurements == 4, "%u cell measurements", status.cellMeasurements);
+    SIMTEST_CHECK(status.unsettledSamples == 0, "%u samples before VBATOUT settled", status.unsettledSamples);
+}
+
+/**@brief Changes the cells, and waits for the background sampling to pick the
+ * change up, after which every reader is served from the snapshot. */
+static void testBackgroundScan(void) {
+    static const uint16_t cell_mV[4] = {3950, 3900, 3980, 3925};
+    power_batterySnapshot_t snapshot;
+    power_batteryStats_t stats;
+    simpowerStatus_t status;
+    uint16_t pack_mV, min_mV, max_mV, cells_mV[4];
+    uint8_t i;
+
+    printf("background scan\n");
+
+    simpower_setCells_mV(cell_mV);
+    power_clearBatteryStats();
+    simpower_clearStatus();
+    runFor(2 * BACKGROUND_SCAN_MS);
+
+    pack_mV = power_getBatteryPackVoltage_mV();
+    min_mV = power_getBatteryVoltageMin_mV();
+    max_mV = power_getBatteryVoltageMax_mV();
+    for (i = 0; i < 4; i++) {
+	cells_mV[i] = power_getBatteryVoltage_mV(i + 1);
+    }
+    power_printBatteryVoltages();
+    power_getBatterySnapshot(&snapshot, POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS);
+
+    power_getBatteryStats(&stats);
+    simpower_getStatus(&status);
+
+    checkSnapshot(&snapshot, cell_mV, "background scan");
+    SIMTEST_CHECK((pack_mV == snapshot.pack_mV) && (min_mV == snapshot.min_mV) && (max_mV == snapshot.max_mV) &&
+	    (cells_mV[0] == snapshot.cell_mV[0]) && (cells_mV[3] == snapshot.cell_mV[3]),
+	    "accessors disagree with the snapshot");
+    printf("  %u background scans from %u sequences in %u ms; %u cell reads from the snapshot, "
+	    "%u blocking scans, %u cell measurements\n", stats.backgroundScans, status.sequences,
+	    2 * BACKGROUND_SCAN_MS, stats.cellReads, stats.blockingScans, status.cellMeasurements);
+    SIMTEST_CHECK(stats.backgroundScans >= 1, "no background scan");
+    SIMTEST_CHECK((stats.blockingScans == 0) && (status.cellMeasurements == 0), "%u blocking scans",
+	    stats.blockingScans);
+    SIMTEST_CHECK(status.unsettledSamples == 0, "%u samples before VBATOUT settled", status.unsettledSamples);
+}
+
+/**@brief Charges with the given maximum age of the snapshot, and returns the
+ * blocking cell measurements per update of the charge state machine. */
+static double charge(uint16_t maxAge_ms) {
+    power_batteryStats_t stats;
+    simpowerStatus_t status;
+    double measurements;
+
+    SIMTEST_CHECK(power_setBatterySnapshotMaxAge_ms(maxAge_ms), "maximum age %u ms refused", maxAge_ms);
+
+    simpower_setCells_mV(imbalancedCells_mV);
+    simpower_setVIn_mV(VIN_MV);
+    runFor(BACKGROUND_SCAN_MS);
+    power_setChargeState(POWER_CHARGESTATE_STANDBY);
+
+    power_clearBatteryStats();
+    simpower_clearStatus();
+    runFor(CHARGE_TIME_MS);
+    power_getBatteryStats(&stats);
+    simpower_getStatus(&status);
+
+    measurements = (double)status.cellMeasurements / stats.chargeUpdates;
+    printf("  maximum age %4u ms: %u updates, %.1f cell measurements and %.1f ms blocking each (was %u, %.0f ms); "
+	    "at most %u scan per update\n", maxAge_ms, stats.chargeUpdates, measurements,
+	    status.blocking_ms / stats.chargeUpdates, OLD_MEASUREMENTS_PER_UPDATE,
+	    OLD_MEASUREMENTS_PER_UPDATE * MEASUREMENT_MS, stats.maxUpdateScans);
+
+    SIMTEST_CHECK(power_getChargeState() == POWER_CHARGESTATE_CHARGING, "charge state %u", power_getChargeState());
+    SIMTEST_CHECK(simpower_isChargerEnabled(), "charger not enabled");
+    SIMTEST_CHECK(power_getDischargeSwitches() == 0x07, "discharge switches 0x%02x rather than 0x07",
+	    power_getDischargeSwitches());
+    SIMTEST_CHECK(stats.maxUpdateScans <= 1, "%u scans in one update", stats.maxUpdateScans);
+    SIMTEST_CHECK(status.cellMeasurements == 4 * stats.blockingScans, "%u cell measurements for %u scans",
+	    status.cellMeasurements, stats.blockingScans);
+    SIMTEST_CHECK(status.unsettledSamples == 0, "%u samples before VBATOUT settled", status.unsettledSamples);
+
+    simpower_setVIn_mV(0);
+    runFor(BACKGROUND_SCAN_MS);
+
+    return measurements;
+}
+
+/**@brief With the snapshot allowed to be older than the background scan
+ * interval, updates never scan; with it shorter, each update scans once. */
+static void testChargeUpdates(void) {
+    double measurements;
+
+    printf("charge state machine\n");
+
+    measurements = charge(POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS);
+    SIMTEST_CHECK(measurements == 0.0, "%.1f cell measurements per update with a fresh snapshot", measurements);
+
+    measurements = charge(POWER_BATTERY_SNAPSHOT_MIN_MAX_AGE_MS);
+    SIMTEST_CHECK(measurements <= 4.0, "%.1f cell measurements per update", measurements);
+
+    power_setBatterySnapshotMaxAge_ms(POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS);
+}
+
+static void testMaxAge(void) {
+    printf("maximum age\n");
+
+    SIMTEST_CHECK(!power_setBatterySnapshotMaxAge_ms(POWER_BATTERY_SNAPSHOT_MIN_MAX_AGE_MS - 1) &&
+	    !power_setBatterySnapshotMaxAge_ms(POWER_BATTERY_SNAPSHOT_MAX_MAX_AGE_MS + 1) &&
+	    !power_setBatterySnapshotMaxAge_ms(70000), "maximum age out of range accepted");
+    SIMTEST_CHECK(power_getBatterySnapshotMaxAge_ms() == POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS,
+	    "maximum age changed to %u ms", power_getBatterySnapshotMaxAge_ms());
+    SIMTEST_CHECK(power_setBatterySnapshotMaxAge_ms(POWER_BATTERY_SNAPSHOT_MIN_MAX_AGE_MS) &&
+	    power_setBatterySnapshotMaxAge_ms(POWER_BATTERY_SNAPSHOT_MAX_MAX_AGE_MS), "maximum age in range refused");
+    power_setBatterySnapshotMaxAge_ms(POWER_BATTERY_SNAPSHOT_DEFAULT_MAX_AGE_MS);
+}
+
+int main(void) {
+    simpower_reset();
+    simpower_setCells_mV(imbalancedCells_mV);
+
+    power_init();
+
+    testBlockingScan();
+    testBackgroundScan();
+    testChargeUpdates();
+    testMaxAge();
+
+    return simtest_finish();
+}
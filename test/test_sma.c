@@ -0,0 +1,225 @@
+/*
+ * test_sma.c
+ *
+ * The SMA drive of sma.c on the hardware PWM channel of pwm.c, with TIMER2,
+ * PPI and GPIOTE simulated count by count: how closely the duty cycle on the
+ * SMA pin follows the retract, hold and release currents, alone and while the
+ * BLDC control loop updates its own channel every few milliseconds; whether
+ * those updates cut any of the SMA's pulses short; and how often the CPU is
+ * woken during an actuation, compared with the software PWM which toggled the
+ * pin from the timer every 25 ms.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "pins.h"
+#include "pwm.h"
+#include "motionEvent.h"
+#include "sma.h"
+
+#include "simtimer.h"
+#include "simpwm.h"
+#include "simsma.h"
+#include "simtest.h"
+
+/* Current which drives the SMA pin high all of the time (as in sma.c) */
+#define MAX_CURRENT_MA		1515
+
+#define HOLD_TIME_MS		3000
+
+/* The on-period is a whole number of counts of a 512-count period, so the
+ * duty is within half a count of that requested; the hardware must add
+ * nothing to that. */
+#define MAX_DUTY_ERROR		(0.5 / 512 + 1e-6)
+
+/* Interval and range of the BLDC control loop's updates to its channel */
+#define IREF_INTERVAL_MS	5
+#define IREF_MAX_ONPERIOD	400
+
+/* Each update to another channel stretches one of the SMA's pulses by the
+ * time that pwm.c takes to notice the end of the period, which it polls for
+ * every microsecond (16 counts). */
+#define MAX_STRETCH_COUNTS	16
+#define MAX_STRETCH_ERROR	((double)MAX_STRETCH_COUNTS / (IREF_INTERVAL_MS * (SIMPWM_CLOCK_HZ / 1000)))
+
+/* The old software PWM toggled the pin twice per 50 ms period. */
+#define SOFTWARE_PWM_PERIOD_MS	50
+
+/* Wake-ups per actuation: one at the end of each of the retract, hold and
+ * recovery phases, and one when the model has settled */
+#define ACTUATION_WAKEUPS	4
+
+static app_timer_id_t irefTimerID = TIMER_NULL;
+static uint32_t maxStretch_counts = 0;
+static uint16_t smaEvents = 0;
+
+static void smaEventHandler(void *p_event_data, uint16_t event_size) {
+    smaEvents++;
+}
+
+/**@brief Stands in for the BLDC control loop, which sets a new IREF on-period
+ * at every step. */
+static void irefTimerHandler(void *p_context) {
+    pwm_setOnPeriodDithered(BLDCIREF_PWM_CHNL, rand() % (IREF_MAX_ONPERIOD << PWM_DITHER_BITS));
+}
+
+/**@brief Runs the timers and scheduler until the SMA leaves its present
+ * state, and returns the SMA pin's statistics up to the moment before the
+ * timer handler which changed the state. */
+static void runPhase(simpwmPinStats_t *p_stats) {
+    smaState_t state = sma_getState();
+    uint64_t next_ticks;
+
+    simpwm_clearPinStats(SMAPWM_PIN_NO);
+
+    while (simtimer_getNextExpiry(&next_ticks)) {
+	simtimer_advance(next_ticks);
+	simpwm_getPinStats(SMAPWM_PIN_NO, p_stats);
+	simtimer_runScheduler();
+	if (sma_getState() != state) {
+	    break;
+	}
+    }
+}
+
+/**@brief Returns the duty on the SMA pin, and checks that no pulse was cut
+ * short, or stretched by more than maxStretch_counts. */
+static double getDuty(const simpwmPinStats_t *p_stats, uint16_t current_mA, const char *phase) {
+    uint32_t onPeriod = (current_mA * 512 + MAX_CURRENT_MA / 2) / MAX_CURRENT_MA;
+
+    if ((onPeriod > 0) && (onPeriod < 512)) {
+	SIMTEST_CHECK((p_stats->pulses > 0) && (p_stats->minPulse_counts == onPeriod) &&
+		(p_stats->maxPulse_counts <= onPeriod + maxStretch_counts),
+		"%s at %u mA: pulses of %u to %u counts rather than %u", phase, current_mA, p_stats->minPulse_counts,
+		p_stats->maxPulse_counts, onPeriod);
+    }
+
+    return (double)p_stats->high_counts / p_stats->window_counts;
+}
+
+/**@brief Performs one actuation with the given currents (and the model
+ * disabled, so that the phases have fixed lengths), and reports the largest
+ * difference between the duty on the SMA pin and the requested current. */
+static double actuate(uint16_t retract_mA, uint16_t hold_mA, uint16_t release_mA) {
+    simpwmPinStats_t stats;
+    double duty, error, maxError = 0.0;
+
+    SIMTEST_CHECK(sma_setRetractCurrent_mA(retract_mA) && sma_setHoldCurrent_mA(hold_mA) &&
+	    sma_setReleaseCurrent_mA(release_mA), "currents %u, %u, %u mA refused", retract_mA, hold_mA, release_mA);
+    SIMTEST_CHECK(sma_retract(HOLD_TIME_MS, smaEventHandler), "retract refused");
+
+    runPhase(&stats);
+    duty = getDuty(&stats, retract_mA, "retract");
+    error = fabs(duty - (double)retract_mA / MAX_CURRENT_MA);
+    maxError = (error > maxError) ? error : maxError;
+
+    runPhase(&stats);
+    duty = getDuty(&stats, hold_mA, "hold");
+    error = fabs(duty - (double)hold_mA / MAX_CURRENT_MA);
+    maxError = (error > maxError) ? error : maxError;
+
+    runPhase(&stats);
+    duty = getDuty(&stats, release_mA, "release");
+    error = fabs(duty - (double)release_mA / MAX_CURRENT_MA);
+    maxError = (error > maxError) ? error : maxError;
+
+    SIMTEST_CHECK(sma_getState() == SMA_STATE_EXTENDED, "SMA did not extend");
+    SIMTEST_CHECK(!simpwm_getPinLevel(SMAPWM_PIN_NO) && !simsma_isPowered(), "SMA left driven");
+
+    return maxError;
+}
+
+static void testDuty(bool irefUpdates) {
+    static const uint16_t currents_mA[][3] = {
+	{1200, 700, 0}, {1515, 1000, 100}, {1000, 300, 200}, {300, 150, 50}, {757, 757, 757}
+    };
+    uint32_t err_code;
+    double error, maxError = MAX_DUTY_ERROR;
+    uint8_t i;
+
+    printf("duty cycle%s\n", irefUpdates ? " with the BLDC IREF channel updated every 5 ms" : "");
+
+    if (irefUpdates) {
+	err_code = app_timer_start(irefTimerID, APP_TIMER_TICKS(IREF_INTERVAL_MS, APP_TIMER_PRESCALER), NULL);
+	APP_ERROR_CHECK(err_code);
+	maxStretch_counts = MAX_STRETCH_COUNTS;
+	maxError += MAX_STRETCH_ERROR;
+    }
+
+    for (i = 0; i < sizeof(currents_mA) / sizeof(currents_mA[0]); i++) {
+	error = actuate(currents_mA[i][0], currents_mA[i][1], currents_mA[i][2]);
+	printf("  retract %4u mA, hold %4u mA, release %3u mA: duty within %.3f%% of the current\n",
+		currents_mA[i][0], currents_mA[i][1], currents_mA[i][2], 100.0 * error);
+	SIMTEST_CHECK(error <= maxError, "duty %.3f%% off", 100.0 * error);
+    }
+
+    if (irefUpdates) {
+	err_code = app_timer_stop(irefTimerID);
+	APP_ERROR_CHECK(err_code);
+	pwm_setOnPeriod(BLDCIREF_PWM_CHNL, 0);
+	maxStretch_counts = 0;
+    }
+}
+
+/**@brief Performs an actuation with the thermal model, as in normal use, and
+ * counts the CPU's wake-ups until the model has settled. */
+static void testWakeups(void) {
+    smaStatus_t status;
+    uint32_t events;
+    uint64_t start_ticks, next_ticks;
+    double elapsed_ms;
+
+    printf("wake-ups\n");
+
+    sma_setModelEnabled(true);
+    sma_setRetractCurrent_mA(1200);
+    sma_setHoldCurrent_mA(700);
+    sma_setReleaseCurrent_mA(0);
+    sma_clearStats();
+    smaEvents = 0;
+
+    events = simsched_getEventCount();
+    start_ticks = simtimer_getTicks();
+    SIMTEST_CHECK(sma_retract(HOLD_TIME_MS, smaEventHandler), "retract refused");
+    while (simtimer_getNextExpiry(&next_ticks)) {
+	simtimer_run(next_ticks);
+    }
+    events = simsched_getEventCount() - events;
+    elapsed_ms = (simtimer_getTicks() - start_ticks) * SIM_USEC_PER_TICK / 1000.0;
+
+    sma_getStatus(&status);
+    printf("  retract %u ms, hold %u ms, recovery %u ms: %u timer wake-ups and %u events in %.1f s "
+	    "(software PWM: about %.0f)\n", status.retractTime_ms, HOLD_TIME_MS, status.recoveryTime_ms,
+	    status.timerWakeups, events, elapsed_ms / 1000.0,
+	    2.0 * (status.retractTime_ms + HOLD_TIME_MS + status.recoveryTime_ms) / SOFTWARE_PWM_PERIOD_MS);
+    SIMTEST_CHECK(status.timerWakeups == ACTUATION_WAKEUPS, "%u timer wake-ups", status.timerWakeups);
+    SIMTEST_CHECK(events == status.timerWakeups + smaEvents, "%u events for %u wake-ups and %u SMA events", events,
+	    status.timerWakeups, smaEvents);
+    SIMTEST_CHECK(status.modelSettled && (sma_getState() == SMA_STATE_EXTENDED), "actuation did not finish");
+}
+
+int main(void) {
+    uint32_t err_code;
+
+    simpwm_reset();
+    simsma_reset();
+    pwm_init();
+
+    err_code = app_timer_create(&irefTimerID, APP_TIMER_MODE_REPEATED, irefTimerHandler);
+    APP_ERROR_CHECK(err_code);
+
+    sma_setModelEnabled(false);
+    testDuty(false);
+    testDuty(true);
+    testWakeups();
+
+    return simtest_finish();
+}
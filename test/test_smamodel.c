@@ -0,0 +1,359 @@
+/*
+ * test_smamodel.c
+ *
+ * The thermal model of smamodel.c driving the SMA controller of sma.c, with
+ * the PWM hardware simulated as in test_sma.c and a simulated wire heated by
+ * the duty on the SMA pin: whether the wire has fully contracted when the
+ * retract time chosen by the model ends, and has fully returned to martensite
+ * when the recovery time ends, for wires which heat and cool faster or slower
+ * than the model assumes, at ambient temperatures and battery voltages across
+ * the module's range, known and unknown; how hot the wire gets; and how much
+ * shorter the actuation is than with the fixed retract and recovery times.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "app_scheduler.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "pins.h"
+#include "pwm.h"
+#include "motionEvent.h"
+#include "smamodel.h"
+#include "sma.h"
+
+#include "simtimer.h"
+#include "simpwm.h"
+#include "simsma.h"
+#include "simwire.h"
+#include "simtest.h"
+
+#define RETRACT_CURRENT_MA	1200
+#define HOLD_CURRENT_MA		700
+#define HOLD_TIME_MS		3000
+
+/* A hold long enough for the wire to settle at the hold current */
+#define LONG_HOLD_TIME_MS	8000
+
+/* Fixed times used while the model is disabled (the defaults in sma.c) */
+#define FIXED_RETRACT_TIME_MS	2000
+#define FIXED_RECOVERY_TIME_MS	3000
+
+/* The wires tried differ from the model's by this fraction in their time
+ * constant and in their rise at full drive.  The margins in sma.c cover about
+ * this much: at 12%, the slowest and weakest wire no longer contracts in a
+ * cold module. */
+#define WIRE_SPREAD		0.10
+
+/* The hold current is limited so that, by the model, the wire settles no
+ * hotter than 135 degrees; a wire which heats more strongly than the model
+ * assumes settles a little hotter. */
+#define MAX_WIRE_TEMP		150.0
+
+/* Step at which the wire follows the duty on the SMA pin */
+#define STEP_MS			10
+
+typedef struct {
+    double retractTime_ms;
+    double recoveryTime_ms;
+    double peakTemp;
+    /* Whether the retract time was limited by RETRACT_TIME_MAX_MS, in which
+     * case the wire may not have contracted */
+    bool retractClamped;
+    bool contracted;
+    bool martensite;
+} actuation_t;
+
+static double ambient;
+static double battery_mV;
+
+/**@brief Runs the timers, the scheduler and the wire for up to one step, and
+ * returns the time run.  The wire is driven with the duty on the SMA pin while
+ * the SMA has the switched battery supply. */
+static double step(void) {
+    simpwmPinStats_t stats;
+    uint64_t now_ticks, next_ticks;
+    double elapsed_ms, duty = 0.0;
+
+    now_ticks = simtimer_getTicks();
+    next_ticks = now_ticks + APP_TIMER_TICKS(STEP_MS, APP_TIMER_PRESCALER);
+    if (simtimer_getNextExpiry(&now_ticks) && (now_ticks < next_ticks)) {
+	next_ticks = now_ticks;
+    }
+
+    simtimer_advance(next_ticks);
+    simpwm_getPinStats(SMAPWM_PIN_NO, &stats);
+    simpwm_clearPinStats(SMAPWM_PIN_NO);
+    if (simsma_isPowered() && (stats.window_counts > 0)) {
+	duty = (double)stats.high_counts / stats.window_counts;
+    }
+
+    elapsed_ms = (double)stats.window_counts * 1000.0 / SIMPWM_CLOCK_HZ;
+    simwire_advance(elapsed_ms, duty, battery_mV, ambient);
+    simtimer_runScheduler();
+
+    return elapsed_ms;
+}
+
+/**@brief Runs until the SMA leaves its present state, and returns the time
+ * that took. */
+static double runPhase(double *p_peakTemp) {
+    smaState_t state = sma_getState();
+    double time_ms = 0.0;
+
+    while (sma_getState() == state) {
+	time_ms += step();
+	if (simwire_getTemp() > *p_peakTemp) {
+	    *p_peakTemp = simwire_getTemp();
+	}
+    }
+
+    return time_ms;
+}
+
+/**@brief Runs until the model has settled. */
+static void settle(void) {
+    uint64_t next_ticks;
+
+    while (simtimer_getNextExpiry(&next_ticks)) {
+	step();
+    }
+}
+
+/**@brief Performs one actuation, noting whether the wire had fully contracted
+ * at the end of the retract time and fully returned to martensite at the end
+ * of the recovery time. */
+static void actuate(uint16_t holdTime_ms, actuation_t *p_actuation) {
+    smaStatus_t status;
+    uint16_t clamps;
+    double holdTime;
+
+    p_actuation->peakTemp = simwire_getTemp();
+
+    sma_getStatus(&status);
+    clamps = status.modelClamps;
+    SIMTEST_CHECK(sma_retract(holdTime_ms, NULL), "retract refused");
+    sma_getStatus(&status);
+    p_actuation->retractClamped = (status.modelClamps != clamps);
+    p_actuation->retractTime_ms = runPhase(&p_actuation->peakTemp);
+    p_actuation->contracted = (simwire_getAustenite() >= 1.0);
+
+    holdTime = runPhase(&p_actuation->peakTemp);
+    SIMTEST_CHECK(fabs(holdTime - holdTime_ms) < STEP_MS, "held for %.0f ms rather than %u ms", holdTime,
+	    holdTime_ms);
+
+    p_actuation->recoveryTime_ms = runPhase(&p_actuation->peakTemp);
+    p_actuation->martensite = (simwire_getAustenite() <= 0.0);
+}
+
+/**@brief Sets up a wire whose time constant and rise at full drive differ from
+ * the model's by the given fractions, and the module's surroundings, which sma.c
+ * may or may not know. */
+static void setWire(double tauError, double riseError, double newAmbient, bool ambientKnown,
+	double newBattery_mV, bool batteryKnown) {
+    simwireConfig_t config;
+
+    ambient = newAmbient;
+    battery_mV = newBattery_mV;
+    simsma_setAmbient_tenthDegC(ambientKnown, (int16_t)(10.0 * ambient));
+    simsma_setBattery_mV(batteryKnown ? (uint16_t)battery_mV : 0);
+
+    simwire_getDefaultConfig(&config);
+    config.timeConstant_ms *= 1.0 + tauError;
+    config.fullDriveRise *= 1.0 + riseError;
+    simwire_init(&config, ambient);
+}
+
+/**@brief Checks that the wire had contracted, unless the retract current was
+ * too low to contract it within RETRACT_TIME_MAX_MS, and had returned to
+ * martensite.  Without the battery voltage or the ambient temperature, the
+ * retract time is planned for an empty battery in a cold module, so the wire
+ * may overheat on a full battery in a hot one; its peak temperature is only
+ * checked when both are known. */
+static void checkActuation(const actuation_t *p_actuation, const char *wire, bool surroundingsKnown) {
+    SIMTEST_CHECK(p_actuation->contracted || p_actuation->retractClamped,
+	    "%s wire at %.0f C, %.0f mV: not contracted after %.0f ms", wire, ambient, battery_mV,
+	    p_actuation->retractTime_ms);
+    SIMTEST_CHECK(p_actuation->martensite, "%s wire at %.0f C, %.0f mV: not martensite after %.0f ms", wire,
+	    ambient, battery_mV, p_actuation->recoveryTime_ms);
+    SIMTEST_CHECK(!surroundingsKnown || (p_actuation->peakTemp <= MAX_WIRE_TEMP), "%s wire at %.0f C, %.0f mV: %.1f C",
+	    wire, ambient, battery_mV, p_actuation->peakTemp);
+}
+
+/**@brief Actuates wires across the spread at each ambient temperature and
+ * battery voltage, known to sma.c, and reports the mean retract and recovery
+ * times. */
+static void testRange(void) {
+    static const double ambients[] = {0.0, 25.0, 40.0};
+    static const double batteries_mV[] = {12500.0, 14800.0, 16800.0};
+    static const double errors[][2] = {{0.0, 0.0}, {WIRE_SPREAD, -WIRE_SPREAD}, {-WIRE_SPREAD, WIRE_SPREAD},
+	    {WIRE_SPREAD, WIRE_SPREAD}, {-WIRE_SPREAD, -WIRE_SPREAD}};
+    static const char *wires[] = {"nominal", "slow weak", "fast strong", "slow strong", "fast weak"};
+    actuation_t actuation;
+    double retract_ms = 0.0, recovery_ms = 0.0, peakTemp = 0.0;
+    uint8_t a, b, w;
+    uint16_t n = 0;
+
+    printf("known surroundings\n");
+
+    for (a = 0; a < sizeof(ambients) / sizeof(ambients[0]); a++) {
+	for (b = 0; b < sizeof(batteries_mV) / sizeof(batteries_mV[0]); b++) {
+	    for (w = 0; w < sizeof(wires) / sizeof(wires[0]); w++) {
+		setWire(errors[w][0], errors[w][1], ambients[a], true, batteries_mV[b], true);
+		actuate(HOLD_TIME_MS, &actuation);
+		checkActuation(&actuation, wires[w], true);
+		settle();
+
+		if (w == 0) {
+		    printf("  %2.0f C, %5.0f mV: retract %4.0f ms, recovery %4.0f ms (nominal wire)\n", ambients[a],
+			    batteries_mV[b], actuation.retractTime_ms, actuation.recoveryTime_ms);
+		}
+
+		retract_ms += actuation.retractTime_ms;
+		recovery_ms += actuation.recoveryTime_ms;
+		peakTemp = (actuation.peakTemp > peakTemp) ? actuation.peakTemp : peakTemp;
+		n++;
+	    }
+	}
+    }
+
+    printf("  mean over %u actuations: retract %.0f ms, recovery %.0f ms (fixed: %u ms, %u ms); "
+	    "wire at most %.1f C\n", n, retract_ms / n, recovery_ms / n, FIXED_RETRACT_TIME_MS,
+	    FIXED_RECOVERY_TIME_MS, peakTemp);
+}
+
+/**@brief Actuates the wires at the ends of the spread, in the extremes of
+ * the ambient temperature and battery voltage, with the battery voltage, the
+ * ambient temperature or both unknown to sma.c, which must then assume the
+ * worst. */
+static void testUnknown(void) {
+    static const double ambients[] = {0.0, 40.0};
+    static const double batteries_mV[] = {12500.0, 16800.0};
+    static const char *unknowns[] = {"both", "battery", "ambient"};
+    actuation_t actuation;
+    double retract_ms, recovery_ms, peakTemp;
+    uint8_t a, b, known;
+
+    printf("unknown surroundings\n");
+
+    for (known = 0; known < 3; known++) {
+	retract_ms = 0.0;
+	recovery_ms = 0.0;
+	peakTemp = 0.0;
+
+	for (a = 0; a < sizeof(ambients) / sizeof(ambients[0]); a++) {
+	    for (b = 0; b < sizeof(batteries_mV) / sizeof(batteries_mV[0]); b++) {
+		setWire(WIRE_SPREAD, -WIRE_SPREAD, ambients[a], known == 1, batteries_mV[b], known == 2);
+		actuate(HOLD_TIME_MS, &actuation);
+		checkActuation(&actuation, "slow weak", false);
+		settle();
+		retract_ms += actuation.retractTime_ms;
+		recovery_ms += actuation.recoveryTime_ms;
+		peakTemp = (actuation.peakTemp > peakTemp) ? actuation.peakTemp : peakTemp;
+
+		setWire(-WIRE_SPREAD, WIRE_SPREAD, ambients[a], known == 1, batteries_mV[b], known == 2);
+		actuate(HOLD_TIME_MS, &actuation);
+		checkActuation(&actuation, "fast strong", false);
+		settle();
+		retract_ms += actuation.retractTime_ms;
+		recovery_ms += actuation.recoveryTime_ms;
+		peakTemp = (actuation.peakTemp > peakTemp) ? actuation.peakTemp : peakTemp;
+	    }
+	}
+
+	printf("  %-7s unknown: mean retract %4.0f ms, recovery %4.0f ms; wire at most %.1f C\n", unknowns[known],
+		retract_ms / 8, recovery_ms / 8, peakTemp);
+    }
+}
+
+/**@brief Holds the wire long enough to settle at the hold current, which the
+ * model must have limited. */
+static void testHoldClamp(void) {
+    actuation_t actuation;
+    smaStatus_t status;
+
+    printf("hold current\n");
+
+    sma_setHoldCurrent_mA(1515);
+    sma_clearStats();
+    setWire(-WIRE_SPREAD, WIRE_SPREAD, 40.0, true, 16800.0, true);
+    actuate(LONG_HOLD_TIME_MS, &actuation);
+    checkActuation(&actuation, "fast strong", true);
+    settle();
+    sma_setHoldCurrent_mA(HOLD_CURRENT_MA);
+
+    sma_getStatus(&status);
+    printf("  full hold current for %u ms: wire at most %.1f C, %u clamps\n", LONG_HOLD_TIME_MS,
+	    actuation.peakTemp, status.modelClamps);
+    SIMTEST_CHECK(status.modelClamps > 0, "hold current not clamped");
+}
+
+/**@brief Actuates again as soon as the SMA has extended, while the wire is
+ * still warm: the model should shorten the retract time, without the wire
+ * overheating. */
+static void testReactuation(void) {
+    actuation_t first, second;
+
+    printf("re-actuation\n");
+
+    setWire(0.0, 0.0, 25.0, true, 14800.0, true);
+    actuate(HOLD_TIME_MS, &first);
+    checkActuation(&first, "nominal", true);
+    actuate(HOLD_TIME_MS, &second);
+    checkActuation(&second, "nominal", true);
+    settle();
+
+    printf("  retract %.0f ms from cold, %.0f ms from %.0f ms after the first started\n", first.retractTime_ms,
+	    second.retractTime_ms, first.retractTime_ms + HOLD_TIME_MS + first.recoveryTime_ms);
+    SIMTEST_CHECK(second.retractTime_ms < first.retractTime_ms, "warm wire retracted for %.0f ms rather than %.0f ms",
+	    second.retractTime_ms, first.retractTime_ms);
+}
+
+/**@brief With the model disabled, the fixed times are used. */
+static void testFixed(void) {
+    actuation_t actuation;
+
+    printf("model disabled\n");
+
+    sma_setModelEnabled(false);
+    setWire(0.0, 0.0, 25.0, true, 14800.0, true);
+    actuate(HOLD_TIME_MS, &actuation);
+    checkActuation(&actuation, "nominal", true);
+    settle();
+    sma_setModelEnabled(true);
+
+    printf("  retract %.0f ms, recovery %.0f ms\n", actuation.retractTime_ms, actuation.recoveryTime_ms);
+    SIMTEST_CHECK(fabs(actuation.retractTime_ms - FIXED_RETRACT_TIME_MS) < 1.0, "retract %.0f ms",
+	    actuation.retractTime_ms);
+    SIMTEST_CHECK(fabs(actuation.recoveryTime_ms - FIXED_RECOVERY_TIME_MS) < 1.0, "recovery %.0f ms",
+	    actuation.recoveryTime_ms);
+}
+
+int main(void) {
+    simwireConfig_t config;
+
+    simpwm_reset();
+    simsma_reset();
+    pwm_init();
+
+    simwire_getDefaultConfig(&config);
+    simwire_init(&config, 25.0);
+
+    sma_setModelEnabled(true);
+    sma_setRetractCurrent_mA(RETRACT_CURRENT_MA);
+    sma_setHoldCurrent_mA(HOLD_CURRENT_MA);
+    sma_setReleaseCurrent_mA(0);
+
+    testRange();
+    testUnknown();
+    testHoldClamp();
+    testReactuation();
+    testFixed();
+
+    return simtest_finish();
+}
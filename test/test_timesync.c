@@ -0,0 +1,180 @@
+/*
+ * test_timesync.c
+ *
+ * Cluster time synchronization in simulated chains and lattices whose clocks
+ * run fast or slow and start at arbitrary times: how long every module takes
+ * to synchronize, how far each module's cluster time strays from the root's,
+ * and how closely a command scheduled for the same cluster time runs on all
+ * of the modules.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timesync.h"
+
+#include "cluster.h"
+#include "simtest.h"
+
+/* The 32 kHz crystals are specified to +/-20 ppm, but the RC oscillator
+ * which clocks a module before its crystal starts can be further off. */
+#define CLOCK_MAX_SKEW_PPM	40.0
+#define CLOCK_MAX_OFFSET_US	10000000.0
+
+#define SYNC_TIMEOUT_MS		120000
+#define SETTLE_TIME_MS		60000
+#define MEASURE_TIME_MS		60000
+
+/* Cluster times of different modules are compared at the same instant, each
+ * read to the millisecond.  Every hop adds the error of its own exchanges, so
+ * the allowance grows with the depth of the cluster. */
+#define SYNC_ERROR_BASE_MS	2
+#define SYNC_ERROR_PER_HOP_MS	1
+
+/* A scheduled command runs when it is due within the next millisecond, by a
+ * timer set in whole milliseconds. */
+#define MARK_RESOLUTION_MS	2
+
+/* How far ahead of the present the commands are scheduled */
+#define MARK_LEAD_MS		5000
+
+static uint64_t markTime_us[CLUSTER_MAX_CUBES];
+static bool marked[CLUSTER_MAX_CUBES];
+
+static void commandHandler(uint8_t cube, const char *cmd) {
+    if (strcmp(cmd, "mark") == 0) {
+	markTime_us[cube] = cluster_getTime_us();
+	marked[cube] = true;
+    }
+}
+
+/**@brief Returns whether every module is synchronized to the root (module 0,
+ * which has the lowest node ID).  Until it hears of a lower ID, a module is
+ * the root of its own cluster. */
+static bool allSynchronized(void) {
+    timesyncStatus_t status;
+    uint8_t cube;
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	CLUSTER_CALL(cube, void (*)(timesyncStatus_t *), timesync_getStatus, &status);
+	if (!status.synchronized || (status.rootID != cluster_getNodeID(0))) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+static uint32_t getClusterTime_ms(uint8_t cube) {
+    return CLUSTER_CALL(cube, uint32_t (*)(void), timesync_getClusterTime_ms);
+}
+
+/**@brief Returns the largest difference between a module's cluster time and
+ * the root's (module 0, which has the lowest node ID) at this instant. */
+static uint32_t getSyncError_ms(void) {
+    uint32_t rootTime_ms = getClusterTime_ms(0);
+    uint32_t maxError_ms = 0;
+    int32_t error_ms;
+    uint8_t cube;
+
+    for (cube = 1; cube < cluster_getCount(); cube++) {
+	error_ms = (int32_t)(getClusterTime_ms(cube) - rootTime_ms);
+	if ((uint32_t)abs(error_ms) > maxError_ms) {
+	    maxError_ms = abs(error_ms);
+	}
+    }
+
+    return maxError_ms;
+}
+
+static void testSync(const char *name, uint8_t nx, uint8_t ny, uint8_t nz) {
+    clusterConfig_t config;
+    timesyncStatus_t status;
+    uint32_t error_ms, maxError_ms = 0, allowed_ms;
+    uint32_t markTime_ms;
+    uint64_t first_us, last_us;
+    uint8_t cube, maxHops = 0;
+    uint32_t t_ms;
+    bool ok;
+
+    printf("%s (%u modules)\n", name, nx * ny * nz);
+
+    cluster_getDefaultConfig(&config);
+    config.command = commandHandler;
+    SIMTEST_CHECK(cluster_create(nx * ny * nz, NULL, &config), "cannot create the cluster");
+    cluster_connectGrid(nx, ny, nz);
+
+    srand(config.seed);
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	cluster_setClock(cube, CLOCK_MAX_SKEW_PPM * (2.0 * rand() / RAND_MAX - 1.0),
+		CLOCK_MAX_OFFSET_US * rand() / RAND_MAX);
+    }
+    cluster_startAll();
+
+    ok = cluster_runUntil(allSynchronized, SYNC_TIMEOUT_MS);
+    SIMTEST_CHECK(ok, "not synchronized after %u s", SYNC_TIMEOUT_MS / 1000);
+    printf("  synchronized after %.1f s\n", cluster_getTime_us() / 1e6);
+
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	CLUSTER_CALL(cube, void (*)(timesyncStatus_t *), timesync_getStatus, &status);
+	if (status.hops > maxHops) {
+	    maxHops = status.hops;
+	}
+    }
+
+    /* The skew estimates need a few resynchronization rounds to settle. */
+    cluster_run_ms(SETTLE_TIME_MS);
+
+    for (t_ms = 0; t_ms < MEASURE_TIME_MS; t_ms += 1000) {
+	cluster_run_ms(1000);
+	error_ms = getSyncError_ms();
+	if (error_ms > maxError_ms) {
+	    maxError_ms = error_ms;
+	}
+    }
+
+    allowed_ms = SYNC_ERROR_BASE_MS + SYNC_ERROR_PER_HOP_MS * maxHops;
+    printf("  up to %u hops, largest error %u ms\n", maxHops, maxError_ms);
+    SIMTEST_CHECK(maxError_ms <= allowed_ms, "cluster time differs by %u ms", maxError_ms);
+
+    /* The command reaches each module at a different time, as it would from
+     * a host, and runs when cluster time reaches the same value on all. */
+    memset(marked, 0, sizeof(marked));
+    markTime_ms = getClusterTime_ms(0) + MARK_LEAD_MS;
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	SIMTEST_CHECK(CLUSTER_CALL(cube, bool (*)(uint32_t, const char *), timesync_scheduleCommand, markTime_ms, "mark"),
+		"cannot schedule on module %04x", cluster_getNodeID(cube));
+	cluster_run_ms(20);
+    }
+    cluster_run_ms(MARK_LEAD_MS);
+
+    first_us = UINT64_MAX;
+    last_us = 0;
+    for (cube = 0; cube < cluster_getCount(); cube++) {
+	SIMTEST_CHECK(marked[cube], "module %04x did not run the scheduled command", cluster_getNodeID(cube));
+	if (marked[cube] && (markTime_us[cube] < first_us)) {
+	    first_us = markTime_us[cube];
+	}
+	if (marked[cube] && (markTime_us[cube] > last_us)) {
+	    last_us = markTime_us[cube];
+	}
+    }
+
+    if (last_us >= first_us) {
+	printf("  scheduled command ran within %.2f ms on all modules\n", (last_us - first_us) / 1000.0);
+	SIMTEST_CHECK(last_us - first_us <= (allowed_ms + MARK_RESOLUTION_MS) * 1000ULL, "scheduled command spread over %.2f ms",
+		(last_us - first_us) / 1000.0);
+    }
+
+    cluster_destroy();
+}
+
+int main(void) {
+    testSync("chain", 8, 1, 1);
+    testSync("3x3x3 lattice", 3, 3, 3);
+
+    return simtest_finish();
+}
@@ -0,0 +1,245 @@
+/*
+ * thermal.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_timer.h"
+
+#include "global.h"
+#include "db.h"
+#include "power.h"
+#include "thermal.h"
+
+/* The filtered temperature tracks new readings with a gain of
+ * 1/THERMAL_FILTER_GAIN. */
+#define THERMAL_FILTER_GAIN		4
+
+static bool valid = false;
+static bool pending = false;
+static int16_t latest_tenthDegC;
+/* Kept with 2 fractional bits */
+static int32_t filtered_tenthDegC_x4;
+static bool overtemp = false;
+static bool undertemp = false;
+
+static uint32_t lastRequestTime_rtcTicks;
+static uint32_t lastSampleTime_rtcTicks;
+static bool requested = false;
+
+static int16_t history[THERMAL_HISTORY_LENGTH];
+static uint8_t historyHead = 0;
+static uint8_t historyCount = 0;
+
+static uint16_t samples = 0;
+static uint16_t failures = 0;
+
+static uint16_t thermal_getInterval_ms(void);
+static uint32_t thermal_getElapsedTime_ms(uint32_t since_rtcTicks);
+static void thermal_tempHandler(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength);
+
+/**@brief Requests a new reading from the daughterboard if one is due.  Called
+ * from the charge management timer, every 200 ms.
+ *
+ * Readings are taken every THERMAL_CHARGING_INTERVAL_MS while the charge
+ * state machine is active (or in error), and every THERMAL_MOTOR_INTERVAL_MS while the
+ * motors are powered, which is when the module heats.  Otherwise, no readings
+ * are taken, because reading the temperature wakes the daughterboard.
+ */
+void thermal_update() {
+    uint16_t interval_ms;
+
+    /* A stale reading no longer counts, but an over- or undertemperature
+     * stays latched until a fresh reading clears it, so that charging does
+     * not resume if the daughterboard stops answering while the module is
+     * outside the safe range. */
+    if (valid && (thermal_getElapsedTime_ms(lastSampleTime_rtcTicks) > THERMAL_STALE_MS)) {
+	valid = false;
+    }
+
+    interval_ms = thermal_getInterval_ms();
+    if ((interval_ms == 0) || pending) {
+	return;
+    }
+
+    if (requested && (thermal_getElapsedTime_ms(lastRequestTime_rtcTicks) < interval_ms)) {
+	return;
+    }
+
+    if (db_requestTemp(thermal_tempHandler)) {
+	app_timer_cnt_get(&lastRequestTime_rtcTicks);
+	requested = true;
+	pending = true;
+    }
+}
+
+bool thermal_isValid() {
+    return valid;
+}
+
+/**@brief Returns the filtered daughterboard temperature in tenths of a degree
+ * Celsius.  Only meaningful if thermal_isValid().
+ */
+int16_t thermal_getTemp_tenthDegC() {
+    return (filtered_tenthDegC_x4 + 2) / 4;
+}
+
+bool thermal_isOvertemp() {
+    return overtemp;
+}
+
+bool thermal_isUndertemp() {
+    return undertemp;
+}
+
+/**@brief Returns the percentage of the full charge and motor currents which
+ * may be used at the present temperature.
+ */
+uint8_t thermal_getDerating_percent() {
+    int16_t temp_tenthDegC;
+
+    if (overtemp) {
+	return THERMAL_DERATE_MIN_PERCENT;
+    }
+
+    if (!valid) {
+	return 100;
+    }
+
+    temp_tenthDegC = thermal_getTemp_tenthDegC();
+
+    if (temp_tenthDegC >= THERMAL_OVERTEMP_TENTHDEGC) {
+	return THERMAL_DERATE_MIN_PERCENT;
+    }
+
+    if (temp_tenthDegC <= THERMAL_DERATE_START_TENTHDEGC) {
+	return 100;
+    }
+
+    return 100 - ((100 - THERMAL_DERATE_MIN_PERCENT) * (temp_tenthDegC - THERMAL_DERATE_START_TENTHDEGC)) /
+	    (THERMAL_OVERTEMP_TENTHDEGC - THERMAL_DERATE_START_TENTHDEGC);
+}
+
+uint16_t thermal_derate(uint16_t value) {
+    return ((uint32_t)value * thermal_getDerating_percent()) / 100;
+}
+
+/**@brief Copies up to maxCount of the most recent filtered temperatures,
+ * oldest first, and returns the number copied.
+ */
+uint8_t thermal_getHistory(int16_t *history_tenthDegC, uint8_t maxCount) {
+    uint8_t i, count;
+
+    count = (historyCount < maxCount) ? historyCount : maxCount;
+
+    for (i = 0; i < count; i++) {
+	history_tenthDegC[i] = history[(historyHead + THERMAL_HISTORY_LENGTH - count + i) % THERMAL_HISTORY_LENGTH];
+    }
+
+    return count;
+}
+
+void thermal_getStatus(thermalStatus_t *p_status) {
+    uint8_t i;
+
+    p_status->valid = valid;
+    p_status->latest_tenthDegC = latest_tenthDegC;
+    p_status->filtered_tenthDegC = thermal_getTemp_tenthDegC();
+    p_status->overtemp = overtemp;
+    p_status->undertemp = undertemp;
+    p_status->derating_percent = thermal_getDerating_percent();
+    p_status->interval_ms = thermal_getInterval_ms();
+    p_status->age_ms = (samples > 0) ? thermal_getElapsedTime_ms(lastSampleTime_rtcTicks) : 0;
+    p_status->samples = samples;
+    p_status->failures = failures;
+
+    p_status->min_tenthDegC = INT16_MAX;
+    p_status->max_tenthDegC = INT16_MIN;
+    for (i = 0; i < historyCount; i++) {
+	if (history[i] < p_status->min_tenthDegC) {
+	    p_status->min_tenthDegC = history[i];
+	}
+	if (history[i] > p_status->max_tenthDegC) {
+	    p_status->max_tenthDegC = history[i];
+	}
+    }
+}
+
+void thermal_clearStats() {
+    samples = 0;
+    failures = 0;
+}
+
+uint16_t thermal_getInterval_ms() {
+    power_chargeState_t chargeState;
+
+    if (power_getVBATSWState()) {
+	return THERMAL_MOTOR_INTERVAL_MS;
+    }
+
+    /* In the ERROR state, the readings tell when a temperature error has
+     * cleared. */
+    chargeState = power_getChargeState();
+    if ((chargeState == POWER_CHARGESTATE_MANUAL) || (chargeState == POWER_CHARGESTATE_PRECHARGE) ||
+	    (chargeState == POWER_CHARGESTATE_CHARGING) || (chargeState == POWER_CHARGESTATE_DISCHARGE) ||
+	    (chargeState == POWER_CHARGESTATE_ERROR)) {
+	return THERMAL_CHARGING_INTERVAL_MS;
+    }
+
+    return 0;
+}
+
+uint32_t thermal_getElapsedTime_ms(uint32_t since_rtcTicks) {
+    uint32_t currentTime_rtcTicks;
+
+    app_timer_cnt_get(&currentTime_rtcTicks);
+
+    return ((0x00FFFFFF & (currentTime_rtcTicks - since_rtcTicks)) * (uint64_t)USEC_PER_APP_TIMER_TICK) / 1000;
+}
+
+void thermal_tempHandler(uint8_t cmd, bool success, const uint8_t *response, uint8_t responseLength) {
+    int16_t temp_tenthDegC;
+
+    pending = false;
+
+    if (!success || (responseLength < 2)) {
+	failures++;
+	return;
+    }
+
+    temp_tenthDegC = response[0] | (response[1] << 8);
+
+    latest_tenthDegC = temp_tenthDegC;
+    app_timer_cnt_get(&lastSampleTime_rtcTicks);
+    samples++;
+
+    if (!valid) {
+	filtered_tenthDegC_x4 = 4 * (int32_t)temp_tenthDegC;
+	valid = true;
+    } else {
+	filtered_tenthDegC_x4 += (4 * (int32_t)temp_tenthDegC - filtered_tenthDegC_x4) / THERMAL_FILTER_GAIN;
+    }
+
+    temp_tenthDegC = thermal_getTemp_tenthDegC();
+
+    history[historyHead] = temp_tenthDegC;
+    historyHead = (historyHead + 1) % THERMAL_HISTORY_LENGTH;
+    if (historyCount < THERMAL_HISTORY_LENGTH) {
+	historyCount++;
+    }
+
+    if (!overtemp && (temp_tenthDegC >= THERMAL_OVERTEMP_TENTHDEGC)) {
+	overtemp = true;
+    } else if (overtemp && (temp_tenthDegC <= THERMAL_OVERTEMP_CLEAR_TENTHDEGC)) {
+	overtemp = false;
+    }
+
+    if (!undertemp && (temp_tenthDegC <= THERMAL_UNDERTEMP_TENTHDEGC)) {
+	undertemp = true;
+    } else if (undertemp && (temp_tenthDegC >= THERMAL_UNDERTEMP_CLEAR_TENTHDEGC)) {
+	undertemp = false;
+    }
+}
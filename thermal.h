@@ -0,0 +1,66 @@
+/*
+ * thermal.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef THERMAL_H_
+#define THERMAL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Time between temperature readings while charging and while the motors
+ * are powered.  Otherwise, the daughterboard is left asleep. */
+#define THERMAL_CHARGING_INTERVAL_MS	5000
+#define THERMAL_MOTOR_INTERVAL_MS		1000
+
+/* A reading older than this is no longer trusted */
+#define THERMAL_STALE_MS				30000
+
+#define THERMAL_HISTORY_LENGTH			16
+
+/* Temperatures, in tenths of a degree Celsius, at which charging stops and
+ * at which it may resume.  Lithium cells must not be charged outside of
+ * roughly 0 to 45 C. */
+#define THERMAL_OVERTEMP_TENTHDEGC			450
+#define THERMAL_OVERTEMP_CLEAR_TENTHDEGC	420
+#define THERMAL_UNDERTEMP_TENTHDEGC			0
+#define THERMAL_UNDERTEMP_CLEAR_TENTHDEGC	30
+
+/* Charge and motor currents are reduced linearly from the full value at
+ * this temperature to the minimum fraction at the overtemperature
+ * threshold. */
+#define THERMAL_DERATE_START_TENTHDEGC	380
+#define THERMAL_DERATE_MIN_PERCENT		25
+
+typedef struct {
+    bool valid;
+    int16_t latest_tenthDegC;
+    int16_t filtered_tenthDegC;
+    int16_t min_tenthDegC;
+    int16_t max_tenthDegC;
+    bool overtemp;
+    bool undertemp;
+    uint8_t derating_percent;
+    uint16_t interval_ms;
+    uint32_t age_ms;
+    uint16_t samples;
+    uint16_t failures;
+} thermalStatus_t;
+
+void thermal_update(void);
+
+bool thermal_isValid(void);
+int16_t thermal_getTemp_tenthDegC(void);
+bool thermal_isOvertemp(void);
+bool thermal_isUndertemp(void);
+
+uint8_t thermal_getDerating_percent(void);
+uint16_t thermal_derate(uint16_t value);
+
+uint8_t thermal_getHistory(int16_t *history_tenthDegC, uint8_t maxCount);
+void thermal_getStatus(thermalStatus_t *p_status);
+void thermal_clearStats(void);
+
+#endif /* THERMAL_H_ */
@@ -0,0 +1,631 @@
+/*
+ * timesync.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_error.h"
+#include "app_timer.h"
+
+#include "global.h"
+#include "util.h"
+#include "cmdline.h"
+#include "irtx.h"
+#include "message.h"
+#include "timesync.h"
+
+/* Every module advertises which root it is synchronized to, and how many hops
+ * away from that root it is, so that its neighbors can choose a parent.  The
+ * module with the lowest node ID in the cluster becomes the root, and cluster
+ * time is its clock. */
+#define TIMESYNC_ADVERTISE_INTERVAL_MS	10000
+#define TIMESYNC_ADVERTISE_JITTER_MS	1000
+#define TIMESYNC_ADVERTISE_MIN_SPACING_MS	1000
+#define TIMESYNC_PARENT_TIMEOUT_MS	(3 * TIMESYNC_ADVERTISE_INTERVAL_MS + 2000)
+#define TIMESYNC_MAX_HOPS		16
+
+/* A synchronization round consists of several request/response exchanges
+ * with the parent.  Only the exchange with the shortest round-trip time is
+ * used, as it is the one least affected by polling and queueing delays.  At
+ * about 1 byte/ms, the request and the response each spend 35 ms on the link
+ * and up to one fast poll interval in the receiver's buffer, so a round-trip
+ * time of up to 120 ms is accepted. */
+#define TIMESYNC_RESYNC_INTERVAL_MS	16000
+#define TIMESYNC_RETRY_INTERVAL_MS	2000
+#define TIMESYNC_EXCHANGES_PER_ROUND	6
+#define TIMESYNC_RESPONSE_TIMEOUT_MS	1500
+#define TIMESYNC_FAST_POLL_MS		1500
+#define TIMESYNC_MAX_RTT_MS		120
+
+/* An exchange delayed on either link waits in a queue on one side only, so
+ * its offset is off by half the delay.  A round is only used if its best
+ * round-trip time is within this margin of the lowest seen on the link to
+ * the parent; otherwise it is retried, and the reference is raised by the
+ * margin so that a lasting change in the link's delay is accepted in time. */
+#define TIMESYNC_RTT_MARGIN_MS		4
+
+/* Skew (relative clock rate) estimates are low-pass filtered.  Two 32 kHz
+ * crystals (+/-20 ppm, plus their drift with temperature) differ by well
+ * under 100 ppm, so a sample beyond that is mostly measurement noise: an
+ * offset error of 1 ms between rounds 16 s apart is already 60 ppm.  Samples
+ * are limited to that range before filtering. */
+#define TIMESYNC_SKEW_GAIN		4
+#define TIMESYNC_MAX_SKEW		0.0001f
+
+/* The timer used to execute scheduled commands never waits longer than this
+ * before re-evaluating the schedule against the latest clock estimate. */
+#define TIMESYNC_MAX_TIMER_DELAY_MS	60000
+
+typedef struct {
+    uint16_t rootID;
+    uint8_t hops;
+    bool synchronized;
+    uint32_t lastSeen_ms;
+} timesyncAdvert_t;
+
+typedef struct {
+    bool active;
+    uint32_t clusterTime_ms;
+    char cmd[MAX_CMDSTR_LEN];
+} timesyncScheduled_t;
+
+static bool initialized = false;
+
+static app_timer_id_t timesync_timerID = TIMER_NULL;
+static bool timerRunning = false;
+
+/* Clock model: cluster time = local + offset_ms + skew * (local - syncLocal_ms) */
+static int32_t offset_ms = 0;
+static float skew = 0.0f;
+static uint32_t syncLocal_ms = 0;
+
+static bool synchronized;
+static uint16_t rootID;
+static uint8_t hops;
+static uint8_t parentFace;
+
+static timesyncAdvert_t adverts[6];
+static bool advertChanged;
+static uint32_t lastAdvert_ms;
+static uint32_t nextAdvert_ms;
+
+static bool prevSampleValid;
+static int32_t prevSampleOffset_ms;
+static uint32_t prevSampleLocal_ms;
+static uint32_t lastSync_ms;
+static uint32_t lastRTT_ms;
+static uint32_t minRTT_ms;
+static uint32_t nextSync_ms;
+
+static bool exchangeActive = false;
+static uint8_t exchangeSeq = 0;
+static uint8_t exchangeCount;
+static uint32_t exchangeT1_ms;
+static uint32_t bestRTT_ms;
+static int32_t bestOffsetSum_ms;
+static uint8_t bestCount;
+static uint32_t bestLocal_ms;
+
+static timesyncScheduled_t scheduled[TIMESYNC_MAX_SCHEDULED];
+
+static int32_t timesync_skewCorrection(uint32_t local_ms);
+static uint32_t timesync_localToCluster(uint32_t local_ms);
+static uint32_t timesync_clusterToLocal(uint32_t cluster_ms);
+static void timesync_selectParent(uint32_t now_ms);
+static void timesync_sendAdverts(void);
+static void timesync_sendRequest(void);
+static void timesync_finishRound(uint32_t now_ms);
+static void timesync_applySample(int32_t sampleOffset_ms, uint32_t sampleLocal_ms);
+static void timesync_processAdvert(uint8_t faceNum, const char *msg);
+static void timesync_processRequest(uint8_t faceNum, const char *msg);
+static void timesync_processResponse(uint8_t faceNum, const char *msg);
+static void timesync_armTimer(void);
+static void timesync_timerHandler(void *p_context);
+
+void timesync_init() {
+    uint32_t err_code;
+    uint8_t faceNum;
+
+    if (timesync_timerID == TIMER_NULL) {
+	err_code = app_timer_create(&timesync_timerID, APP_TIMER_MODE_SINGLE_SHOT, timesync_timerHandler);
+	APP_ERROR_CHECK(err_code);
+    }
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	adverts[faceNum-1].lastSeen_ms = 0;
+	adverts[faceNum-1].synchronized = false;
+    }
+
+    /* Until we hear from a module with a lower ID, we are our own root. */
+    rootID = getNodeID();
+    hops = 0;
+    parentFace = 0;
+    synchronized = true;
+    prevSampleValid = false;
+    minRTT_ms = TIMESYNC_MAX_RTT_MS;
+    exchangeActive = false;
+
+    lastAdvert_ms = curr_time_ms();
+    nextAdvert_ms = lastAdvert_ms + TIMESYNC_ADVERTISE_MIN_SPACING_MS;
+    advertChanged = false;
+
+    initialized = true;
+
+    timesync_armTimer();
+}
+
+void timesync_deinit() {
+    uint32_t err_code;
+
+    if (!initialized) {
+	return;
+    }
+
+    if (timesync_timerID != TIMER_NULL) {
+	err_code = app_timer_stop(timesync_timerID);
+	APP_ERROR_CHECK(err_code);
+	timerRunning = false;
+    }
+
+    /* Our clock stops being comparable to the cluster's while we sleep */
+    timesync_cancelScheduled();
+
+    initialized = false;
+}
+
+void timesync_tick() {
+    uint32_t now_ms;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    timesync_selectParent(now_ms);
+
+    if (advertChanged && ((int32_t)(nextAdvert_ms - (lastAdvert_ms + TIMESYNC_ADVERTISE_MIN_SPACING_MS)) > 0)) {
+	nextAdvert_ms = lastAdvert_ms + TIMESYNC_ADVERTISE_MIN_SPACING_MS;
+    }
+    advertChanged = false;
+
+    if ((int32_t)(now_ms - nextAdvert_ms) >= 0) {
+	timesync_sendAdverts();
+	lastAdvert_ms = now_ms;
+	nextAdvert_ms = now_ms + TIMESYNC_ADVERTISE_INTERVAL_MS + (rand() % TIMESYNC_ADVERTISE_JITTER_MS);
+    }
+
+    if (exchangeActive) {
+	if (now_ms - exchangeT1_ms > TIMESYNC_RESPONSE_TIMEOUT_MS) {
+	    timesync_finishRound(now_ms);
+	}
+    } else if ((parentFace != 0) && ((int32_t)(now_ms - nextSync_ms) >= 0) && !irtx_isReceiving(parentFace)) {
+	/* The request bypasses medium access control, so a round only starts
+	 * while the parent is not transmitting to us. */
+	exchangeActive = true;
+	exchangeCount = 0;
+	bestRTT_ms = UINT32_MAX;
+	timesync_sendRequest();
+    }
+}
+
+bool timesync_processMessage(uint8_t faceNum, const char *msg) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "tsa;", 4) == 0) {
+	timesync_processAdvert(faceNum, msg);
+    } else if (strncmp(msg, "tsq;", 4) == 0) {
+	timesync_processRequest(faceNum, msg);
+    } else if (strncmp(msg, "tsr;", 4) == 0) {
+	timesync_processResponse(faceNum, msg);
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+uint32_t timesync_getClusterTime_ms() {
+    return timesync_localToCluster(curr_time_ms());
+}
+
+bool timesync_isSynchronized() {
+    return initialized && synchronized;
+}
+
+void timesync_getStatus(timesyncStatus_t *p_status) {
+    p_status->synchronized = timesync_isSynchronized();
+    p_status->rootID = rootID;
+    p_status->hops = hops;
+    p_status->parentFace = parentFace;
+    p_status->offset_ms = offset_ms;
+    p_status->skew_ppm = skew * 1.0e6f;
+    p_status->lastRTT_ms = lastRTT_ms;
+    p_status->lastSyncAge_ms = (parentFace == 0) ? 0 : curr_time_ms() - lastSync_ms;
+}
+
+/**@brief Executes a command-line command when cluster time reaches the given
+ * value.
+ *
+ * The command is executed by the local clock, which is continuously corrected
+ * towards cluster time, so modules which are given the same time and command
+ * execute it within a few milliseconds of each other.
+ */
+bool timesync_scheduleCommand(uint32_t clusterTime_ms, const char *cmd) {
+    uint8_t i;
+
+    if (!initialized || (strlen(cmd) >= MAX_CMDSTR_LEN)) {
+	return false;
+    }
+
+    for (i = 0; i < TIMESYNC_MAX_SCHEDULED; i++) {
+	if (!scheduled[i].active) {
+	    scheduled[i].clusterTime_ms = clusterTime_ms;
+	    strcpy(scheduled[i].cmd, cmd);
+	    scheduled[i].active = true;
+	    timesync_armTimer();
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+uint8_t timesync_getScheduledCount() {
+    uint8_t i;
+    uint8_t count = 0;
+
+    for (i = 0; i < TIMESYNC_MAX_SCHEDULED; i++) {
+	if (scheduled[i].active) {
+	    count++;
+	}
+    }
+
+    return count;
+}
+
+void timesync_cancelScheduled() {
+    uint8_t i;
+
+    for (i = 0; i < TIMESYNC_MAX_SCHEDULED; i++) {
+	scheduled[i].active = false;
+    }
+}
+
+/**@brief Returns the drift of the local clock since the last synchronization,
+ * rounded to the nearest millisecond rather than truncated, which would pull
+ * every module's cluster time towards its own clock. */
+int32_t timesync_skewCorrection(uint32_t local_ms) {
+    float drift_ms = skew * (float)(int32_t)(local_ms - syncLocal_ms);
+
+    return (int32_t)((drift_ms >= 0.0f) ? (drift_ms + 0.5f) : (drift_ms - 0.5f));
+}
+
+uint32_t timesync_localToCluster(uint32_t local_ms) {
+    return local_ms + offset_ms + timesync_skewCorrection(local_ms);
+}
+
+uint32_t timesync_clusterToLocal(uint32_t cluster_ms) {
+    uint32_t local_ms;
+
+    /* The skew correction is small, so one iteration of the inverse is
+     * accurate to well under a millisecond. */
+    local_ms = cluster_ms - offset_ms;
+    return cluster_ms - offset_ms - timesync_skewCorrection(local_ms);
+}
+
+void timesync_selectParent(uint32_t now_ms) {
+    uint8_t faceNum;
+    uint8_t bestFace = 0;
+    timesyncAdvert_t *p_advert;
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	p_advert = &adverts[faceNum-1];
+
+	if (!p_advert->synchronized || (now_ms - p_advert->lastSeen_ms > TIMESYNC_PARENT_TIMEOUT_MS) ||
+	    (p_advert->hops >= TIMESYNC_MAX_HOPS)) {
+	    continue;
+	}
+
+	if ((bestFace == 0) || (p_advert->rootID < adverts[bestFace-1].rootID) ||
+	    ((p_advert->rootID == adverts[bestFace-1].rootID) && (p_advert->hops < adverts[bestFace-1].hops))) {
+	    bestFace = faceNum;
+	}
+    }
+
+    if ((bestFace != 0) && (adverts[bestFace-1].rootID < getNodeID())) {
+	if (adverts[bestFace-1].rootID != rootID) {
+	    /* A different time base: start over. */
+	    rootID = adverts[bestFace-1].rootID;
+	    synchronized = false;
+	    prevSampleValid = false;
+	    skew = 0.0f;
+	    advertChanged = true;
+	}
+
+	if (hops != adverts[bestFace-1].hops + 1) {
+	    hops = adverts[bestFace-1].hops + 1;
+	    advertChanged = true;
+	}
+
+	if (parentFace != bestFace) {
+	    parentFace = bestFace;
+	    minRTT_ms = TIMESYNC_MAX_RTT_MS;
+	    exchangeActive = false;
+	    nextSync_ms = now_ms;
+	}
+    } else if (rootID != getNodeID()) {
+	/* Nobody offers a root with a lower ID than ours, so we become the
+	 * root.  We keep our clock model so that cluster time continues
+	 * smoothly from the last estimate of the previous root's clock. */
+	rootID = getNodeID();
+	hops = 0;
+	parentFace = 0;
+	synchronized = true;
+	exchangeActive = false;
+	advertChanged = true;
+    }
+}
+
+void timesync_sendAdverts() {
+    char str[32];
+
+    /* Advertisement: tsa;<id>;<root>;<hops>;<synchronized> */
+    snprintf(str, sizeof(str), "tsa;%04x;%04x;%u;%u|", getNodeID(), rootID, hops, synchronized ? 1 : 0);
+    irtx_queueString(0, IRTX_PRIORITY_CONTROL, str);
+}
+
+void timesync_sendRequest() {
+    char str[40];
+
+    exchangeSeq++;
+
+    /* The request has the same length as the response so that the time
+     * spent transmitting each is the same and cancels out of the estimate:
+     * tsq;<id>;<seq>;0000000000;0000000000 */
+    snprintf(str, sizeof(str), "tsq;%04x;%03u;%010lu;%010lu|", getNodeID(), exchangeSeq, 0UL, 0UL);
+    if (!irtx_queueString(parentFace, IRTX_PRIORITY_CONTROL, str)) {
+	timesync_finishRound(curr_time_ms());
+	return;
+    }
+
+    message_requestFastPoll(parentFace, TIMESYNC_FAST_POLL_MS);
+    message_requestPrecisePoll(parentFace, TIMESYNC_MAX_RTT_MS);
+
+    exchangeT1_ms = curr_time_ms();
+    irtx_drainFace(parentFace);
+}
+
+void timesync_finishRound(uint32_t now_ms) {
+    int32_t sampleOffset_ms;
+
+    exchangeActive = false;
+
+    if ((bestRTT_ms <= TIMESYNC_MAX_RTT_MS) && (bestRTT_ms > minRTT_ms + TIMESYNC_RTT_MARGIN_MS)) {
+	minRTT_ms += TIMESYNC_RTT_MARGIN_MS;
+	nextSync_ms = now_ms + TIMESYNC_RETRY_INTERVAL_MS;
+    } else if (bestRTT_ms <= TIMESYNC_MAX_RTT_MS) {
+	if (bestRTT_ms < minRTT_ms) {
+	    minRTT_ms = bestRTT_ms;
+	}
+	lastRTT_ms = bestRTT_ms;
+
+	/* Mean of the offsets, rounded to the nearest millisecond */
+	if (bestOffsetSum_ms >= 0) {
+	    sampleOffset_ms = (bestOffsetSum_ms + bestCount) / (2 * bestCount);
+	} else {
+	    sampleOffset_ms = (bestOffsetSum_ms - bestCount) / (2 * bestCount);
+	}
+	timesync_applySample(sampleOffset_ms, bestLocal_ms);
+	nextSync_ms = now_ms + TIMESYNC_RESYNC_INTERVAL_MS;
+    } else {
+	nextSync_ms = now_ms + TIMESYNC_RETRY_INTERVAL_MS;
+    }
+}
+
+void timesync_applySample(int32_t sampleOffset_ms, uint32_t sampleLocal_ms) {
+    float skewSample;
+    int32_t dt_ms;
+
+    /* The change in measured offset between consecutive rounds gives the
+     * rate at which our clock drifts relative to the parent's. */
+    dt_ms = (int32_t)(sampleLocal_ms - prevSampleLocal_ms);
+    if (synchronized && prevSampleValid && (dt_ms > 1000)) {
+	skewSample = (float)(sampleOffset_ms - prevSampleOffset_ms) / (float)dt_ms;
+	if (skewSample > TIMESYNC_MAX_SKEW) {
+	    skewSample = TIMESYNC_MAX_SKEW;
+	} else if (skewSample < -TIMESYNC_MAX_SKEW) {
+	    skewSample = -TIMESYNC_MAX_SKEW;
+	}
+	skew += (skewSample - skew) / TIMESYNC_SKEW_GAIN;
+    }
+
+    prevSampleValid = true;
+    prevSampleOffset_ms = sampleOffset_ms;
+    prevSampleLocal_ms = sampleLocal_ms;
+
+    offset_ms = sampleOffset_ms;
+    syncLocal_ms = sampleLocal_ms;
+    lastSync_ms = curr_time_ms();
+
+    if (!synchronized) {
+	synchronized = true;
+	advertChanged = true;
+    }
+
+    /* The local time at which scheduled commands should run has moved */
+    timesync_armTimer();
+}
+
+void timesync_processAdvert(uint8_t faceNum, const char *msg) {
+    unsigned int id, root, advertHops, advertSynchronized;
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "tsa;%x;%x;%u;%u", &id, &root, &advertHops, &advertSynchronized) != 4) {
+	return;
+    }
+
+    if (id == getNodeID()) {
+	return;
+    }
+
+    adverts[faceNum-1].rootID = root;
+    adverts[faceNum-1].hops = (advertHops > UINT8_MAX) ? UINT8_MAX : advertHops;
+    adverts[faceNum-1].synchronized = (advertSynchronized != 0);
+    adverts[faceNum-1].lastSeen_ms = curr_time_ms();
+}
+
+void timesync_processRequest(uint8_t faceNum, const char *msg) {
+    unsigned int id, seq;
+    uint32_t t2_ms;
+    char str[40];
+
+    if (!initialized || !synchronized) {
+	return;
+    }
+
+    if ((sscanf(msg, "tsq;%x;%u", &id, &seq) != 2) || (id == getNodeID())) {
+	return;
+    }
+
+    /* The rest of the exchanges in this round will follow quickly */
+    message_requestFastPoll(faceNum, TIMESYNC_FAST_POLL_MS);
+    message_requestPrecisePoll(faceNum, TIMESYNC_MAX_RTT_MS);
+
+    t2_ms = timesync_localToCluster(message_getRxTime_ms());
+
+    /* Response: tsr;<id>;<seq>;<receive time>;<transmit time> */
+    snprintf(str, sizeof(str), "tsr;%04x;%03u;%010lu;%010lu|", id, seq,
+	    (unsigned long)t2_ms, (unsigned long)timesync_getClusterTime_ms());
+    if (irtx_queueString(faceNum, IRTX_PRIORITY_CONTROL, str)) {
+	irtx_drainFace(faceNum);
+    }
+}
+
+void timesync_processResponse(uint8_t faceNum, const char *msg) {
+    unsigned int id, seq;
+    unsigned long t2_ms, t3_ms;
+    uint32_t t4_ms;
+    uint32_t rtt_ms;
+    int32_t offset2_ms;
+
+    if (!initialized || !exchangeActive || (faceNum != parentFace)) {
+	return;
+    }
+
+    if (sscanf(msg, "tsr;%x;%u;%lu;%lu", &id, &seq, &t2_ms, &t3_ms) != 4) {
+	return;
+    }
+
+    if ((id != getNodeID()) || ((uint8_t)seq != exchangeSeq)) {
+	return;
+    }
+
+    t4_ms = message_getRxTime_ms();
+
+    /* Standard two-way exchange: t1 and t4 are local times, and t2 and t3 are
+     * the parent's estimate of cluster time. */
+    rtt_ms = (t4_ms - exchangeT1_ms) - ((uint32_t)t3_ms - (uint32_t)t2_ms);
+    offset2_ms = (int32_t)((uint32_t)t2_ms - exchangeT1_ms) + (int32_t)((uint32_t)t3_ms - t4_ms);
+
+    /* The offset is twice the measured one until the end of the round: the
+     * exchanges with the lowest round-trip time are averaged, and halving each
+     * of them would bias the mean towards zero. */
+    if (rtt_ms < bestRTT_ms) {
+	bestRTT_ms = rtt_ms;
+	bestOffsetSum_ms = offset2_ms;
+	bestCount = 1;
+	bestLocal_ms = exchangeT1_ms + rtt_ms / 2;
+    } else if (rtt_ms == bestRTT_ms) {
+	bestOffsetSum_ms += offset2_ms;
+	bestCount++;
+    }
+
+    if (++exchangeCount < TIMESYNC_EXCHANGES_PER_ROUND) {
+	timesync_sendRequest();
+    } else {
+	timesync_finishRound(curr_time_ms());
+    }
+}
+
+void timesync_armTimer() {
+    uint32_t err_code;
+    uint32_t nowCluster_ms;
+    int32_t delay_ms;
+    int32_t earliest_ms = INT32_MAX;
+    uint8_t i;
+
+    if (!initialized) {
+	return;
+    }
+
+    if (timerRunning) {
+	err_code = app_timer_stop(timesync_timerID);
+	APP_ERROR_CHECK(err_code);
+	timerRunning = false;
+    }
+
+    nowCluster_ms = timesync_getClusterTime_ms();
+
+    for (i = 0; i < TIMESYNC_MAX_SCHEDULED; i++) {
+	if (scheduled[i].active && ((int32_t)(scheduled[i].clusterTime_ms - nowCluster_ms) < earliest_ms)) {
+	    earliest_ms = (int32_t)(scheduled[i].clusterTime_ms - nowCluster_ms);
+	    delay_ms = (int32_t)(timesync_clusterToLocal(scheduled[i].clusterTime_ms) - curr_time_ms());
+	}
+    }
+
+    if (earliest_ms == INT32_MAX) {
+	return;
+    }
+
+    if (delay_ms > TIMESYNC_MAX_TIMER_DELAY_MS) {
+	delay_ms = TIMESYNC_MAX_TIMER_DELAY_MS;
+    }
+
+    if (APP_TIMER_TICKS(delay_ms > 0 ? delay_ms : 0, APP_TIMER_PRESCALER) < APP_TIMER_MIN_TIMEOUT_TICKS) {
+	err_code = app_timer_start(timesync_timerID, APP_TIMER_MIN_TIMEOUT_TICKS, NULL);
+    } else {
+	err_code = app_timer_start(timesync_timerID, APP_TIMER_TICKS(delay_ms, APP_TIMER_PRESCALER), NULL);
+    }
+    APP_ERROR_CHECK(err_code);
+    timerRunning = true;
+}
+
+void timesync_timerHandler(void *p_context) {
+    uint32_t nowCluster_ms;
+    uint8_t i;
+    char cmd[MAX_CMDSTR_LEN];
+
+    timerRunning = false;
+
+    if (!initialized) {
+	return;
+    }
+
+    nowCluster_ms = timesync_getClusterTime_ms();
+
+    for (i = 0; i < TIMESYNC_MAX_SCHEDULED; i++) {
+	/* The timer has a resolution of about 0.3ms, so anything due within
+	 * the next millisecond is executed now. */
+	if (scheduled[i].active && ((int32_t)(scheduled[i].clusterTime_ms - nowCluster_ms) <= 1)) {
+	    /* The command may itself schedule another command, so we release
+	     * its slot before executing it. */
+	    strcpy(cmd, scheduled[i].cmd);
+	    scheduled[i].active = false;
+	    cmdLine_execCmd(cmd);
+	}
+    }
+
+    timesync_armTimer();
+}
@@ -0,0 +1,42 @@
+/*
+ * timesync.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef TIMESYNC_H_
+#define TIMESYNC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TIMESYNC_MAX_SCHEDULED		3
+
+typedef struct {
+    bool synchronized;
+    uint16_t rootID;
+    uint8_t hops;
+    /* Face (1-6) towards the root, or 0 if we are the root */
+    uint8_t parentFace;
+    int32_t offset_ms;
+    float skew_ppm;
+    /* Round-trip time of the exchange used for the last offset estimate */
+    uint32_t lastRTT_ms;
+    uint32_t lastSyncAge_ms;
+} timesyncStatus_t;
+
+void timesync_init(void);
+void timesync_deinit(void);
+void timesync_tick(void);
+
+bool timesync_processMessage(uint8_t faceNum, const char *msg);
+
+uint32_t timesync_getClusterTime_ms(void);
+bool timesync_isSynchronized(void);
+void timesync_getStatus(timesyncStatus_t *p_status);
+
+bool timesync_scheduleCommand(uint32_t clusterTime_ms, const char *cmd);
+uint8_t timesync_getScheduledCount(void);
+void timesync_cancelScheduled(void);
+
+#endif /* TIMESYNC_H_ */
@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include "nrf.h"
 #include "nrf_error.h"
 #include "app_timer.h"
 
@@ -21,10 +22,30 @@
 
 extern ble_sps_t m_sps;
 
+/* While output is being captured (e.g. to return the results of a command
+ * executed on behalf of another module), strings are appended to this buffer
+ * instead of being sent to the UART and BLE. */
+static char *captureBuf = NULL;
+static uint16_t captureBufSize;
+static uint16_t captureLen;
+static bool captureOverflowed;
+
 uint32_t app_uart_put_string(const char *str) {
     uint32_t i = 0;
     uint32_t err_code = NRF_SUCCESS;
 
+    if (captureBuf != NULL) {
+	while (str[i] != '\0') {
+	    if (captureLen + 1 >= captureBufSize) {
+		captureOverflowed = true;
+		break;
+	    }
+	    captureBuf[captureLen++] = str[i++];
+	}
+	captureBuf[captureLen] = '\0';
+	return NRF_SUCCESS;
+    }
+
 #if (ENABLE_BLE_COMMANDS == 1)
     if (ble_sps_getInitialized()) {
 	ble_sps_put_string(&m_sps, (const uint8_t *)str);
@@ -49,6 +70,37 @@ uint32_t app_uart_put_debug(const char *str, bool debug) {
     }
 }
 
+/**@brief Redirects app_uart_put_string() into the given buffer until
+ * app_uart_capture_stop() is called.  Captures cannot be nested.
+ */
+bool app_uart_capture_start(char *buf, uint16_t bufSize) {
+    if ((captureBuf != NULL) || (buf == NULL) || (bufSize == 0)) {
+	return false;
+    }
+
+    captureBufSize = bufSize;
+    captureLen = 0;
+    captureOverflowed = false;
+    buf[0] = '\0';
+    captureBuf = buf;
+
+    return true;
+}
+
+/**@brief Ends a capture started with app_uart_capture_start().
+ *
+ * @return Number of characters captured (excluding the null terminator).
+ */
+uint16_t app_uart_capture_stop(bool *p_overflowed) {
+    if (p_overflowed != NULL) {
+	*p_overflowed = captureOverflowed;
+    }
+
+    captureBuf = NULL;
+
+    return captureLen;
+}
+
 bool delay_ms(uint32_t ms) {
     uint32_t startTicks;
     uint32_t nowTicks;
@@ -101,6 +153,29 @@ uint32_t curr_time() {
     return nowTicks;
 }
 
+uint32_t curr_time_ms() {
+    static uint32_t lastTicks = 0;
+    static uint64_t totalTicks = 0;
+    uint32_t nowTicks;
+
+    /* Extend the 24-bit RTC into a 32-bit millisecond clock.  This is only
+     * correct if the function is called at least once per RTC overflow
+     * period (~85 minutes), which the periodic message polling guarantees. */
+    if (app_timer_cnt_get(&nowTicks) == NRF_SUCCESS) {
+	totalTicks += 0x00FFFFFF & (nowTicks - lastTicks);
+	lastTicks = nowTicks;
+    }
+
+    return (uint32_t)((totalTicks * (APP_TIMER_PRESCALER + 1) * 1000) / APP_TIMER_CLOCK_FREQ);
+}
+
+uint16_t getNodeID() {
+    /* The lower 16 bits of the factory-programmed device address (from which
+     * the BLE MAC address is also formed) identify this module to its
+     * neighbors. */
+    return (uint16_t)(NRF_FICR->DEVICEADDR[0] & 0xFFFF);
+}
+
 void MACaddress(char *addr) {
     uint32_t err_code;
     if (m_sps.conn_handle == BLE_CONN_HANDLE_INVALID) {
@@ -13,7 +13,12 @@
 
 uint32_t app_uart_put_string(const char *str);
 uint32_t app_uart_put_debug(const char *str, bool debug);
+bool app_uart_capture_start(char *buf, uint16_t bufSize);
+uint16_t app_uart_capture_stop(bool *p_overflowed);
 bool delay_ms(uint32_t ms);
+uint32_t curr_time(void);
+uint32_t curr_time_ms(void);
+uint16_t getNodeID(void);
 void MACaddress(char *addr);
 
 #endif /* UTIL_H_ */
@@ -0,0 +1,574 @@
+/*
+ * xfer.c
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crc16.h"
+
+#include "global.h"
+#include "util.h"
+#include "irtx.h"
+#include "message.h"
+#include "irlink.h"
+#include "xfer.h"
+
+/* After sending every outstanding fragment, the sender asks the receiver
+ * which fragments are still missing.  If no answer arrives, the question is
+ * repeated.  A transfer fails after this many consecutive rounds in which no
+ * further fragments get through. */
+#define XFER_STATUS_TIMEOUT_MS		1500
+#define XFER_MAX_RETRIES		5
+
+/* A partially received payload is discarded if no fragment or status request
+ * for it arrives within this time. */
+#define XFER_RX_TIMEOUT_MS		10000
+
+/* Both ends of an active transfer poll their receivers quickly so that the
+ * transfer is not limited by the normal polling interval. */
+#define XFER_FAST_POLL_MS		1000
+
+typedef enum {
+    XFER_TX_IDLE = 0,
+    XFER_TX_SENDING,
+    XFER_TX_WAITING
+} xferTxState_t;
+
+typedef struct {
+    xferTxState_t state;
+    const uint8_t *data;
+    uint16_t numBytes;
+    uint16_t crc;
+    uint8_t xferID;
+    uint8_t numFragments;
+    /* Fragments still to be sent in the current round */
+    uint8_t pending;
+    /* Fragments which the receiver last reported missing */
+    uint8_t missing;
+    uint8_t retries;
+    bool retransmitting;
+    uint32_t start_ms;
+    uint32_t statusSent_ms;
+    xferResult_t result;
+    xferTxCallback_t callback;
+} xferTx_t;
+
+typedef struct {
+    bool active;
+    bool complete;
+    uint8_t faceNum;
+    uint16_t senderID;
+    uint8_t xferID;
+    uint16_t numBytes;
+    uint16_t crc;
+    /* Fragments received so far */
+    uint8_t received;
+    uint32_t lastActivity_ms;
+    uint8_t data[XFER_MAX_SIZE];
+} xferRx_t;
+
+static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static bool initialized = false;
+
+static xferTx_t txs[6];
+static xferRx_t rxs[XFER_RX_SLOTS];
+static uint8_t nextXferID = 0;
+static xferRxHandler_t rxHandler = NULL;
+static xferStats_t stats;
+
+static void xfer_sendRound(uint8_t faceNum, uint32_t now_ms);
+static void xfer_sendStatusRequest(uint8_t faceNum, uint32_t now_ms);
+static void xfer_finish(uint8_t faceNum, bool success);
+static void xfer_processFragment(uint8_t faceNum, const char *msg);
+static void xfer_processStatusRequest(uint8_t faceNum, const char *msg);
+static void xfer_processAck(uint8_t faceNum, const char *msg);
+static xferRx_t *xfer_getRxSlot(uint8_t faceNum, uint16_t senderID, uint8_t xferID, uint16_t numBytes, uint16_t crc);
+static uint8_t xfer_getNumFragments(uint16_t numBytes);
+static uint8_t xfer_encode(const uint8_t *data, uint8_t numBytes, char *str);
+static bool xfer_decode(const char *str, uint8_t *data, uint8_t numBytes);
+
+void xfer_init() {
+    uint8_t i;
+
+    for (i = 0; i < 6; i++) {
+	txs[i].state = XFER_TX_IDLE;
+    }
+
+    for (i = 0; i < XFER_RX_SLOTS; i++) {
+	rxs[i].active = false;
+    }
+
+    initialized = true;
+}
+
+void xfer_deinit() {
+    uint8_t faceNum;
+
+    /* Let the owners of any outstanding transfers know that they failed */
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	if (txs[faceNum-1].state != XFER_TX_IDLE) {
+	    xfer_finish(faceNum, false);
+	}
+    }
+
+    initialized = false;
+}
+
+void xfer_tick() {
+    uint32_t now_ms;
+    uint8_t faceNum;
+    uint8_t i;
+    xferTx_t *p_tx;
+
+    if (!initialized) {
+	return;
+    }
+
+    now_ms = curr_time_ms();
+
+    for (i = 0; i < XFER_RX_SLOTS; i++) {
+	if (rxs[i].active && (now_ms - rxs[i].lastActivity_ms > XFER_RX_TIMEOUT_MS)) {
+	    rxs[i].active = false;
+	}
+    }
+
+    for (faceNum = 1; faceNum <= 6; faceNum++) {
+	p_tx = &txs[faceNum-1];
+
+	if (p_tx->state == XFER_TX_IDLE) {
+	    continue;
+	}
+
+	message_requestFastPoll(faceNum, XFER_FAST_POLL_MS);
+
+	if (p_tx->state == XFER_TX_SENDING) {
+	    xfer_sendRound(faceNum, now_ms);
+	} else if (now_ms - p_tx->statusSent_ms > XFER_STATUS_TIMEOUT_MS) {
+	    /* The status request or its answer was lost */
+	    if (++p_tx->retries > XFER_MAX_RETRIES) {
+		xfer_finish(faceNum, false);
+	    } else {
+		xfer_sendStatusRequest(faceNum, now_ms);
+	    }
+	}
+    }
+}
+
+/**@brief Starts sending a payload to the neighbor on the given face.
+ *
+ * The payload is not copied, so it must remain valid until the callback is
+ * called.  Only one transfer may be in progress on each face.
+ *
+ * @return false if the transfer could not be started.
+ */
+bool xfer_send(uint8_t faceNum, const uint8_t *data, uint16_t numBytes, xferTxCallback_t callback) {
+    xferTx_t *p_tx;
+
+    if (!initialized || (faceNum < 1) || (faceNum > 6) || (numBytes == 0) || (numBytes > XFER_MAX_SIZE)) {
+	return false;
+    }
+
+    p_tx = &txs[faceNum-1];
+    if (p_tx->state != XFER_TX_IDLE) {
+	return false;
+    }
+
+    p_tx->data = data;
+    p_tx->numBytes = numBytes;
+    p_tx->crc = crc16_compute(data, numBytes, NULL);
+    p_tx->xferID = ++nextXferID;
+    p_tx->numFragments = xfer_getNumFragments(numBytes);
+    p_tx->pending = (uint8_t)((1 << p_tx->numFragments) - 1);
+    p_tx->missing = p_tx->pending;
+    p_tx->retries = 0;
+    p_tx->retransmitting = false;
+    p_tx->start_ms = curr_time_ms();
+    p_tx->callback = callback;
+
+    memset(&p_tx->result, 0, sizeof(p_tx->result));
+    p_tx->result.numBytes = numBytes;
+
+    p_tx->state = XFER_TX_SENDING;
+
+    /* Get the first fragments on their way without waiting for the tick */
+    message_requestFastPoll(faceNum, XFER_FAST_POLL_MS);
+    xfer_sendRound(faceNum, p_tx->start_ms);
+
+    return true;
+}
+
+bool xfer_isBusy(uint8_t faceNum) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    return (txs[faceNum-1].state != XFER_TX_IDLE);
+}
+
+void xfer_abort(uint8_t faceNum) {
+    if (xfer_isBusy(faceNum)) {
+	xfer_finish(faceNum, false);
+    }
+}
+
+void xfer_setRxHandler(xferRxHandler_t handler) {
+    rxHandler = handler;
+}
+
+void xfer_getStats(xferStats_t *p_stats) {
+    *p_stats = stats;
+}
+
+void xfer_clearStats() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool xfer_processMessage(uint8_t faceNum, const char *msg) {
+    if ((faceNum < 1) || (faceNum > 6)) {
+	return false;
+    }
+
+    if (strncmp(msg, "xfd;", 4) == 0) {
+	xfer_processFragment(faceNum, msg);
+    } else if (strncmp(msg, "xfs;", 4) == 0) {
+	xfer_processStatusRequest(faceNum, msg);
+    } else if (strncmp(msg, "xfa;", 4) == 0) {
+	xfer_processAck(faceNum, msg);
+    } else {
+	return false;
+    }
+
+    return true;
+}
+
+/**@brief Queues as many of the round's outstanding fragments as the bulk
+ * transmit queue will hold, followed by a status request once all of them
+ * have been queued.
+ */
+void xfer_sendRound(uint8_t faceNum, uint32_t now_ms) {
+    xferTx_t *p_tx = &txs[faceNum-1];
+    char str[32 + (XFER_FRAGMENT_SIZE * 4 + 2) / 3];
+    uint8_t index;
+    uint16_t offset;
+    uint8_t len;
+    int headerLen;
+
+    for (index = 0; (index < p_tx->numFragments) && (p_tx->pending != 0x00); index++) {
+	if (!(p_tx->pending & (1 << index))) {
+	    continue;
+	}
+
+	offset = index * XFER_FRAGMENT_SIZE;
+	len = (p_tx->numBytes - offset > XFER_FRAGMENT_SIZE) ? XFER_FRAGMENT_SIZE : (p_tx->numBytes - offset);
+
+	/* Fragment: xfd;<sender>;<xferID>;<size>;<crc>;<index>;<base64 data> */
+	headerLen = snprintf(str, sizeof(str), "xfd;%04x;%u;%u;%04x;%u;", getNodeID(), p_tx->xferID,
+		p_tx->numBytes, p_tx->crc, index);
+	headerLen += xfer_encode(&p_tx->data[offset], len, &str[headerLen]);
+	str[headerLen++] = '|';
+	str[headerLen] = '\0';
+
+	if (irtx_getQueueFreeSpace(faceNum, IRTX_PRIORITY_BULK) < headerLen) {
+	    return;
+	}
+
+	irtx_queueString(faceNum, IRTX_PRIORITY_BULK, str);
+	p_tx->pending &= ~(1 << index);
+
+	p_tx->result.fragmentsSent++;
+	stats.fragmentsSent++;
+	if (p_tx->retransmitting) {
+	    p_tx->result.fragmentsRetransmitted++;
+	    stats.fragmentsRetransmitted++;
+	}
+    }
+
+    if (p_tx->pending == 0x00) {
+	xfer_sendStatusRequest(faceNum, now_ms);
+    }
+}
+
+void xfer_sendStatusRequest(uint8_t faceNum, uint32_t now_ms) {
+    xferTx_t *p_tx = &txs[faceNum-1];
+    char str[24];
+
+    /* The request travels in the bulk queue so that it cannot overtake the
+     * fragments which precede it. */
+    snprintf(str, sizeof(str), "xfs;%04x;%u|", getNodeID(), p_tx->xferID);
+    if (irtx_queueString(faceNum, IRTX_PRIORITY_BULK, str)) {
+	p_tx->state = XFER_TX_WAITING;
+	p_tx->statusSent_ms = now_ms;
+    }
+}
+
+void xfer_finish(uint8_t faceNum, bool success) {
+    xferTx_t *p_tx = &txs[faceNum-1];
+
+    p_tx->state = XFER_TX_IDLE;
+
+    p_tx->result.success = success;
+    p_tx->result.elapsed_ms = curr_time_ms() - p_tx->start_ms;
+
+    if (success) {
+	stats.transfersSent++;
+	stats.bytesSent += p_tx->numBytes;
+    } else {
+	stats.transfersFailed++;
+    }
+
+    if (p_tx->callback != NULL) {
+	p_tx->callback(faceNum, &p_tx->result);
+    }
+}
+
+void xfer_processFragment(uint8_t faceNum, const char *msg) {
+    unsigned int senderID, xferID, numBytes, crc, index;
+    int dataStart = 0;
+    uint8_t numFragments;
+    uint8_t len;
+    xferRx_t *p_rx;
+    char str[48];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "xfd;%x;%u;%u;%x;%u;%n", &senderID, &xferID, &numBytes, &crc, &index, &dataStart) != 5) {
+	return;
+    }
+
+    numFragments = xfer_getNumFragments(numBytes);
+    if ((dataStart == 0) || (numBytes == 0) || (numBytes > XFER_MAX_SIZE) || (index >= numFragments)) {
+	return;
+    }
+
+    message_requestFastPoll(faceNum, XFER_FAST_POLL_MS);
+
+    p_rx = xfer_getRxSlot(faceNum, senderID, xferID, numBytes, crc);
+    if (p_rx == NULL) {
+	stats.rxOverflows++;
+	return;
+    }
+
+    p_rx->lastActivity_ms = curr_time_ms();
+
+    if (p_rx->complete || (p_rx->received & (1 << index))) {
+	/* Duplicate fragment */
+	irlink_recordDuplicate(faceNum);
+	return;
+    }
+
+    len = (numBytes - index * XFER_FRAGMENT_SIZE > XFER_FRAGMENT_SIZE) ? XFER_FRAGMENT_SIZE : (numBytes - index * XFER_FRAGMENT_SIZE);
+    if (!xfer_decode(&msg[dataStart], &p_rx->data[index * XFER_FRAGMENT_SIZE], len)) {
+	return;
+    }
+
+    p_rx->received |= (1 << index);
+    stats.fragmentsReceived++;
+
+    if (p_rx->received != (uint8_t)((1 << numFragments) - 1)) {
+	return;
+    }
+
+    /* If the payload is corrupt, we have no way of knowing which fragment is
+     * to blame, so all of them must be sent again. */
+    if (crc16_compute(p_rx->data, p_rx->numBytes, NULL) != p_rx->crc) {
+	stats.crcErrors++;
+	p_rx->received = 0x00;
+	return;
+    }
+
+    p_rx->complete = true;
+    stats.transfersReceived++;
+    stats.bytesReceived += p_rx->numBytes;
+
+    if (rxHandler != NULL) {
+	rxHandler(faceNum, p_rx->senderID, p_rx->data, p_rx->numBytes);
+    } else {
+	snprintf(str, sizeof(str), "Received %u bytes from %04x on face %u\r\n", p_rx->numBytes, p_rx->senderID, faceNum);
+	app_uart_put_string(str);
+    }
+}
+
+void xfer_processStatusRequest(uint8_t faceNum, const char *msg) {
+    unsigned int senderID, xferID;
+    uint8_t missing = 0xFF;
+    uint8_t i;
+    char str[24];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "xfs;%x;%u", &senderID, &xferID) != 2) {
+	return;
+    }
+
+    /* If we know nothing of the transfer, every fragment is missing */
+    for (i = 0; i < XFER_RX_SLOTS; i++) {
+	if (rxs[i].active && (rxs[i].faceNum == faceNum) && (rxs[i].senderID == senderID) && (rxs[i].xferID == xferID)) {
+	    rxs[i].lastActivity_ms = curr_time_ms();
+	    missing = rxs[i].complete ? 0x00 : ~rxs[i].received;
+	    break;
+	}
+    }
+
+    /* Acknowledgment: xfa;<sender>;<xferID>;<missing fragment bitmap> */
+    snprintf(str, sizeof(str), "xfa;%04x;%u;%02x|", senderID, xferID, missing);
+    irtx_queueString(faceNum, IRTX_PRIORITY_CONTROL, str);
+}
+
+void xfer_processAck(uint8_t faceNum, const char *msg) {
+    unsigned int senderID, xferID, missing;
+    xferTx_t *p_tx = &txs[faceNum-1];
+
+    if (!initialized) {
+	return;
+    }
+
+    if (sscanf(msg, "xfa;%x;%u;%x", &senderID, &xferID, &missing) != 3) {
+	return;
+    }
+
+    if ((senderID != getNodeID()) || (p_tx->state != XFER_TX_WAITING) || (xferID != p_tx->xferID)) {
+	return;
+    }
+
+    missing &= (1 << p_tx->numFragments) - 1;
+
+    if (missing != p_tx->missing) {
+	p_tx->missing = missing;
+	p_tx->retries = 0;
+    }
+
+    if (missing == 0x00) {
+	xfer_finish(faceNum, true);
+    } else if (++p_tx->retries > XFER_MAX_RETRIES) {
+	xfer_finish(faceNum, false);
+    } else {
+	/* Selectively retransmit only the fragments which were lost */
+	p_tx->pending = missing;
+	p_tx->retransmitting = true;
+	p_tx->state = XFER_TX_SENDING;
+	xfer_sendRound(faceNum, curr_time_ms());
+    }
+}
+
+/**@brief Finds the reassembly buffer for a transfer, allocating one if
+ * necessary.  A new transfer from the same sender replaces its previous one,
+ * and otherwise free buffers are used before those holding completed
+ * transfers.
+ *
+ * @return NULL if every buffer is in use by another incomplete transfer.
+ */
+xferRx_t *xfer_getRxSlot(uint8_t faceNum, uint16_t senderID, uint8_t xferID, uint16_t numBytes, uint16_t crc) {
+    xferRx_t *p_rx = NULL;
+    uint8_t i;
+
+    for (i = 0; i < XFER_RX_SLOTS; i++) {
+	if (rxs[i].active && (rxs[i].faceNum == faceNum) && (rxs[i].senderID == senderID)) {
+	    if ((rxs[i].xferID == xferID) && (rxs[i].numBytes == numBytes) && (rxs[i].crc == crc)) {
+		return &rxs[i];
+	    }
+	    p_rx = &rxs[i];
+	    break;
+	}
+    }
+
+    for (i = 0; (p_rx == NULL) && (i < XFER_RX_SLOTS); i++) {
+	if (!rxs[i].active) {
+	    p_rx = &rxs[i];
+	}
+    }
+
+    for (i = 0; (p_rx == NULL) && (i < XFER_RX_SLOTS); i++) {
+	if (rxs[i].complete) {
+	    p_rx = &rxs[i];
+	}
+    }
+
+    if (p_rx == NULL) {
+	return NULL;
+    }
+
+    p_rx->active = true;
+    p_rx->complete = false;
+    p_rx->faceNum = faceNum;
+    p_rx->senderID = senderID;
+    p_rx->xferID = xferID;
+    p_rx->numBytes = numBytes;
+    p_rx->crc = crc;
+    p_rx->received = 0x00;
+
+    return p_rx;
+}
+
+uint8_t xfer_getNumFragments(uint16_t numBytes) {
+    return (numBytes + XFER_FRAGMENT_SIZE - 1) / XFER_FRAGMENT_SIZE;
+}
+
+/**@brief Encodes binary data as base64 (without padding), since the IR
+ * receivers only pass 7-bit characters and '|' terminates a message.
+ *
+ * @return Number of characters written, not including the null terminator.
+ */
+uint8_t xfer_encode(const uint8_t *data, uint8_t numBytes, char *str) {
+    uint16_t bits = 0;
+    uint8_t numBits = 0;
+    uint8_t len = 0;
+    uint8_t i;
+
+    for (i = 0; i < numBytes; i++) {
+	bits = (bits << 8) | data[i];
+	numBits += 8;
+	while (numBits >= 6) {
+	    numBits -= 6;
+	    str[len++] = base64[(bits >> numBits) & 0x3F];
+	}
+    }
+
+    if (numBits > 0) {
+	str[len++] = base64[(bits << (6 - numBits)) & 0x3F];
+    }
+
+    str[len] = '\0';
+
+    return len;
+}
+
+/**@brief Decodes exactly numBytes of base64-encoded data.
+ *
+ * @return false if the string is too short or contains invalid characters.
+ */
+bool xfer_decode(const char *str, uint8_t *data, uint8_t numBytes) {
+    uint16_t bits = 0;
+    uint8_t numBits = 0;
+    uint8_t len = 0;
+    const char *p_char;
+
+    while (len < numBytes) {
+	if (*str == '\0') {
+	    return false;
+	}
+
+	p_char = strchr(base64, *str++);
+	if (p_char == NULL) {
+	    return false;
+	}
+
+	bits = (bits << 6) | (p_char - base64);
+	numBits += 6;
+	if (numBits >= 8) {
+	    numBits -= 8;
+	    data[len++] = (bits >> numBits) & 0xFF;
+	}
+    }
+
+    return true;
+}
@@ -0,0 +1,65 @@
+/*
+ * xfer.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef XFER_H_
+#define XFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Payloads are split into fragments of this many bytes, each of which is
+ * sent as a single IR message.  A bitmap with one bit per fragment tracks
+ * which fragments are still missing. */
+#define XFER_FRAGMENT_SIZE		32
+#define XFER_MAX_FRAGMENTS		8
+#define XFER_MAX_SIZE			(XFER_FRAGMENT_SIZE * XFER_MAX_FRAGMENTS)
+
+/* Number of transfers which can be reassembled at once */
+#define XFER_RX_SLOTS			2
+
+typedef struct {
+    bool success;
+    uint16_t numBytes;
+    uint32_t elapsed_ms;
+    uint8_t fragmentsSent;
+    uint8_t fragmentsRetransmitted;
+} xferResult_t;
+
+typedef struct {
+    uint32_t bytesSent;
+    uint32_t bytesReceived;
+    uint16_t fragmentsSent;
+    uint16_t fragmentsRetransmitted;
+    uint16_t fragmentsReceived;
+    uint16_t transfersSent;
+    uint16_t transfersFailed;
+    uint16_t transfersReceived;
+    uint16_t crcErrors;
+    /* Fragments dropped because no reassembly buffer was free */
+    uint16_t rxOverflows;
+} xferStats_t;
+
+/**@brief Called when a transfer started with xfer_send() finishes. */
+typedef void (*xferTxCallback_t)(uint8_t faceNum, const xferResult_t *p_result);
+
+/**@brief Called when a complete payload, with a valid CRC, has been received. */
+typedef void (*xferRxHandler_t)(uint8_t faceNum, uint16_t senderID, const uint8_t *data, uint16_t numBytes);
+
+void xfer_init(void);
+void xfer_deinit(void);
+void xfer_tick(void);
+
+bool xfer_processMessage(uint8_t faceNum, const char *msg);
+
+bool xfer_send(uint8_t faceNum, const uint8_t *data, uint16_t numBytes, xferTxCallback_t callback);
+bool xfer_isBusy(uint8_t faceNum);
+void xfer_abort(uint8_t faceNum);
+void xfer_setRxHandler(xferRxHandler_t handler);
+
+void xfer_getStats(xferStats_t *p_stats);
+void xfer_clearStats(void);
+
+#endif /* XFER_H_ */